@@ -0,0 +1,288 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_AlgebraicMultigrid_H
+#define MIRTK_AlgebraicMultigrid_H
+
+#include "mirtk/Array.h"
+
+#include "Eigen/SparseCore"
+#include "Eigen/SparseCholesky"
+
+
+namespace mirtk {
+
+
+/**
+ * Smoothed aggregation algebraic multigrid preconditioner
+ *
+ * This preconditioner for symmetric positive definite sparse systems builds
+ * a hierarchy of coarser systems by aggregating strongly connected nodes of
+ * the matrix graph (Vanek et al., 1996). The tentative prolongator maps each
+ * aggregate onto the constant vectors of each of the block components, and
+ * is smoothed by one damped Jacobi step. Coarse operators are the Galerkin
+ * products P^T A P. Each application of the preconditioner performs a
+ * symmetric V-cycle with forward and backward Gauss-Seidel smoothing, and
+ * a sparse Cholesky factorization on the coarsest level.
+ *
+ * The class implements the preconditioner interface of the Eigen iterative
+ * solvers, e.g., Eigen::ConjugateGradient. The aggregates only depend on the
+ * matrix graph and the strength of connections. They are kept by factorize,
+ * such that only the prolongators and coarse operators are recomputed for a
+ * matrix with identical sparsity pattern. The call of analyzePattern
+ * discards the aggregates.
+ */
+class AlgebraicMultigrid
+{
+public:
+
+  typedef double                              Scalar;
+  typedef double                              RealScalar;
+  typedef int                                 StorageIndex;
+  typedef Eigen::SparseMatrix<double>         MatrixType;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1> VectorType;
+
+  enum {
+    ColsAtCompileTime    = Eigen::Dynamic,
+    MaxColsAtCompileTime = Eigen::Dynamic
+  };
+
+  // ---------------------------------------------------------------------------
+  // Construction
+
+  /// Default constructor
+  AlgebraicMultigrid();
+
+  /// Construct preconditioner for given matrix
+  template <class TMatrix>
+  explicit AlgebraicMultigrid(const TMatrix &A);
+
+  // ---------------------------------------------------------------------------
+  // Parameters
+
+  /// Number of unknowns per node, e.g., 3 for a vector valued map in 3D
+  ///
+  /// The unknowns of a node must be stored contiguously.
+  void BlockSize(int);
+
+  /// Number of unknowns per node
+  int BlockSize() const;
+
+  /// Maximum size of coarsest system which is solved directly
+  void CoarseSize(int);
+
+  /// Maximum number of levels
+  void MaximumNumberOfLevels(int);
+
+  /// Number of Gauss-Seidel sweeps before and after coarse grid correction
+  void NumberOfSmoothingSweeps(int);
+
+  // ---------------------------------------------------------------------------
+  // Eigen preconditioner interface
+
+  /// Discard aggregates of previous matrix
+  template <class TMatrix>
+  AlgebraicMultigrid &analyzePattern(const TMatrix &);
+
+  /// Set up multigrid hierarchy, reusing previous aggregates if available
+  template <class TMatrix>
+  AlgebraicMultigrid &factorize(const TMatrix &A);
+
+  /// Set up multigrid hierarchy from scratch
+  template <class TMatrix>
+  AlgebraicMultigrid &compute(const TMatrix &A);
+
+  /// Apply one V-cycle to approximately solve A x = b with zero initial guess
+  template <class TRhs>
+  VectorType solve(const TRhs &b) const;
+
+  /// Status of setup
+  Eigen::ComputationInfo info() const;
+
+  /// Number of rows of fine matrix
+  int rows() const;
+
+  /// Number of columns of fine matrix
+  int cols() const;
+
+  // ---------------------------------------------------------------------------
+  // Hierarchy
+
+  /// Number of levels of multigrid hierarchy
+  int NumberOfLevels() const;
+
+  /// Number of unknowns at given level
+  int NumberOfUnknowns(int) const;
+
+  /// Sum of non-zero entries of all levels relative to those of the fine matrix
+  double OperatorComplexity() const;
+
+protected:
+
+  /// Level of multigrid hierarchy
+  struct Level
+  {
+    MatrixType A;          ///< System matrix
+    MatrixType P;          ///< Prolongator from next coarser level
+    MatrixType R;          ///< Restriction to next coarser level, i.e., P^T
+    VectorType D;          ///< Diagonal of system matrix
+    Array<int> Aggregates; ///< Aggregate of each node
+    int        NumberOfAggregates;
+  };
+
+  /// Build multigrid hierarchy
+  void Setup(const MatrixType &A);
+
+  /// Group nodes of matrix graph into aggregates of strongly connected nodes
+  static int Aggregate(const MatrixType &A, int bs, double eps, Array<int> &aggregates);
+
+  /// Estimate spectral radius of D^-1 A
+  static double SpectralRadius(const MatrixType &A, const VectorType &D);
+
+  /// Gauss-Seidel sweep
+  static void Smooth(const MatrixType &A, const VectorType &D,
+                     const VectorType &b, VectorType &x, bool forward);
+
+  /// Apply V-cycle at given level
+  void Cycle(int l, const VectorType &b, VectorType &x) const;
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  int                               _BlockSize;
+  int                               _CoarseSize;
+  int                               _MaximumNumberOfLevels;
+  int                               _NumberOfSmoothingSweeps;
+  Array<Level>                      _Levels;
+  Eigen::SimplicialLDLT<MatrixType> _CoarseSolver;
+  bool                              _CoarseSolverOk;
+  Eigen::ComputationInfo            _Info;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+template <class TMatrix>
+AlgebraicMultigrid::AlgebraicMultigrid(const TMatrix &A)
+:
+  AlgebraicMultigrid()
+{
+  compute(A);
+}
+
+// -----------------------------------------------------------------------------
+inline void AlgebraicMultigrid::BlockSize(int bs)
+{
+  _BlockSize = (bs > 0 ? bs : 1);
+}
+
+// -----------------------------------------------------------------------------
+inline int AlgebraicMultigrid::BlockSize() const
+{
+  return _BlockSize;
+}
+
+// -----------------------------------------------------------------------------
+inline void AlgebraicMultigrid::CoarseSize(int n)
+{
+  _CoarseSize = n;
+}
+
+// -----------------------------------------------------------------------------
+inline void AlgebraicMultigrid::MaximumNumberOfLevels(int n)
+{
+  _MaximumNumberOfLevels = n;
+}
+
+// -----------------------------------------------------------------------------
+inline void AlgebraicMultigrid::NumberOfSmoothingSweeps(int n)
+{
+  _NumberOfSmoothingSweeps = n;
+}
+
+// -----------------------------------------------------------------------------
+template <class TMatrix>
+AlgebraicMultigrid &AlgebraicMultigrid::analyzePattern(const TMatrix &)
+{
+  _Levels.clear();
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+template <class TMatrix>
+AlgebraicMultigrid &AlgebraicMultigrid::factorize(const TMatrix &A)
+{
+  Setup(MatrixType(A));
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+template <class TMatrix>
+AlgebraicMultigrid &AlgebraicMultigrid::compute(const TMatrix &A)
+{
+  analyzePattern(A);
+  return factorize(A);
+}
+
+// -----------------------------------------------------------------------------
+template <class TRhs>
+AlgebraicMultigrid::VectorType AlgebraicMultigrid::solve(const TRhs &b) const
+{
+  VectorType x;
+  if (_Levels.empty()) x = b;
+  else Cycle(0, b, x);
+  return x;
+}
+
+// -----------------------------------------------------------------------------
+inline Eigen::ComputationInfo AlgebraicMultigrid::info() const
+{
+  return _Info;
+}
+
+// -----------------------------------------------------------------------------
+inline int AlgebraicMultigrid::rows() const
+{
+  return _Levels.empty() ? 0 : static_cast<int>(_Levels[0].A.rows());
+}
+
+// -----------------------------------------------------------------------------
+inline int AlgebraicMultigrid::cols() const
+{
+  return rows();
+}
+
+// -----------------------------------------------------------------------------
+inline int AlgebraicMultigrid::NumberOfLevels() const
+{
+  return static_cast<int>(_Levels.size());
+}
+
+// -----------------------------------------------------------------------------
+inline int AlgebraicMultigrid::NumberOfUnknowns(int l) const
+{
+  return static_cast<int>(_Levels[l].A.rows());
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_AlgebraicMultigrid_H
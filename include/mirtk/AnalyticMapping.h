@@ -0,0 +1,135 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_AnalyticMapping_H
+#define MIRTK_AnalyticMapping_H
+
+#include "mirtk/Mapping.h"
+
+#include "mirtk/Parallel.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Base class of maps given by a closed-form expression
+ *
+ * Subclasses define a non-virtual inline function
+ *
+ * \code
+ * bool Map(double *v, double x, double y, double z) const;
+ * \endcode
+ *
+ * which evaluates the map at a single point. The virtual Evaluate functions
+ * call it, and the batched Evaluate function of each subclass passes itself
+ * to EvaluatePoints, whose loop over the points calls this function directly
+ * such that the compiler can inline and vectorize the loop body.
+ */
+class AnalyticMapping : public Mapping
+{
+  mirtkAbstractMacro(AnalyticMapping);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+protected:
+
+  /// Default constructor
+  AnalyticMapping() {}
+
+  /// Copy constructor
+  AnalyticMapping(const AnalyticMapping &other) : Mapping(other) {}
+
+  /// Assignment operator
+  AnalyticMapping &operator =(const AnalyticMapping &other)
+  {
+    Mapping::operator =(other);
+    return *this;
+  }
+
+public:
+
+  /// Destructor
+  virtual ~AnalyticMapping() {}
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  /// Whether the map is given by a closed-form expression
+  virtual bool IsAnalytic() const
+  {
+    return true;
+  }
+
+protected:
+
+  /// Evaluate analytic map at contiguous set of points
+  template <class TMap>
+  struct EvaluateMapAtPoints
+  {
+    const TMap   *_Map;
+    const double *_Points;
+    double       *_Values;
+    bool         *_Inside;
+    int           _NumberOfComponents;
+    double        _OutsideValue;
+
+    void operator ()(const blocked_range<int> &re) const
+    {
+      const double *p = _Points + 3 * re.begin();
+      double       *v = _Values + _NumberOfComponents * re.begin();
+      bool          inside;
+      for (int i = re.begin(); i != re.end(); ++i, p += 3, v += _NumberOfComponents) {
+        inside = _Map->Map(v, p[0], p[1], p[2]);
+        if (!inside) {
+          for (int j = 0; j < _NumberOfComponents; ++j) v[j] = _OutsideValue;
+        }
+        if (_Inside) _Inside[i] = inside;
+      }
+    }
+  };
+
+  /// Evaluate analytic map at multiple points in parallel
+  ///
+  /// \param[in]  map    Analytic map.
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points stored contiguously.
+  /// \param[out] values Map values stored contiguously.
+  /// \param[out] inside Whether each input point is inside map domain.
+  template <class TMap>
+  static void EvaluatePoints(const TMap *map, int n, const double *xyz, double *values, bool *inside)
+  {
+    if (n <= 0) return;
+    EvaluateMapAtPoints<TMap> eval;
+    eval._Map                = map;
+    eval._Points             = xyz;
+    eval._Values             = values;
+    eval._Inside             = inside;
+    eval._NumberOfComponents = map->NumberOfComponents();
+    eval._OutsideValue       = map->OutsideValue();
+    parallel_for(blocked_range<int>(0, n), eval);
+  }
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_AnalyticMapping_H
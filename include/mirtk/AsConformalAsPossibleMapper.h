@@ -34,6 +34,14 @@ namespace mirtk {
  *
  * Paillé & Poulin (2012), As-conformal-as-possible discrete volumetric mapping,
  * Computers and Graphics, 36(5), 427–433.
+ *
+ * The map is computed by alternating local and global steps. The local step
+ * updates the orientation of each tetrahedron given the current map in
+ * parallel, and the global step solves the linear system for the interior
+ * point coordinates given these orientations. The sparsity pattern of the
+ * system is the same in each iteration, such that the symbolic analysis of a
+ * direct solver and the aggregates of the AMG preconditioner are reused, and
+ * iterative solvers start with the map of the previous iteration.
  */
 class AsConformalAsPossibleMapper : public LinearTetrahedralMeshMapper
 {
@@ -45,6 +53,15 @@ class AsConformalAsPossibleMapper : public LinearTetrahedralMeshMapper
   /// Uniform weight of scale and angle conformality
   mirtkPublicAttributeMacro(double, UniformWeight);
 
+  /// Maximum number of local/global iterations
+  ///
+  /// The default of one iteration solves the ACAP system once given the
+  /// orientations of the tetrahedra under the initial harmonic map.
+  mirtkPublicAttributeMacro(int, NumberOfLocalGlobalIterations);
+
+  /// Relative change of ACAP energy below which local/global iterations stop
+  mirtkPublicAttributeMacro(double, EnergyTolerance);
+
   /// Local orientation of tetrahedron (rotation matrix)
   mirtkAttributeMacro(Array<Matrix3x3>, Orientation);
 
@@ -76,9 +93,22 @@ protected:
   /// Initialize filter after input and parameters are set
   void Initialize();
 
+  /// Compute local orientations of tetrahedra given the current map
+  void UpdateOrientation();
+
+  /// Parameterize interior points using local/global iterations
+  void Solve();
+
   /// Finalize filter execution
   void Finalize();
 
+public:
+
+  /// Evaluate ACAP energy of current map given the current local orientations
+  double Energy() const;
+
+protected:
+
   // ---------------------------------------------------------------------------
   // Auxiliary functions
 
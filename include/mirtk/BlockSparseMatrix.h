@@ -0,0 +1,243 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_BlockSparseMatrix_H
+#define MIRTK_BlockSparseMatrix_H
+
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/UninitializedArray.h"
+
+
+namespace mirtk {
+
+
+class MapperObserver;
+
+
+/**
+ * Sparse matrix of 3x3 blocks in compressed sparse row (BSR) format
+ *
+ * The linear systems of the volumetric map solvers couple the three output
+ * coordinates of each pair of adjacent points. Storing the coefficients of
+ * each such pair as a dense 3x3 block requires only one column index per nine
+ * coefficients, and the fixed size inner kernel of the matrix-vector product
+ * is unrolled and vectorized by the compiler. The blocks of a row are sorted
+ * by column index and the coefficients of a block are stored in row-major
+ * order. The product with a vector is computed in parallel over block rows,
+ * such that its cost is bound by the memory bandwidth rather than index access.
+ * The column indices and coefficients are first written by the same parallel
+ * partition of the block rows, such that their memory pages are placed on the
+ * memory nodes of the threads which later multiply these rows.
+ */
+class BlockSparseMatrix3
+{
+public:
+
+  /// Construct empty matrix
+  BlockSparseMatrix3();
+
+  /// Initialize sparsity pattern and set all coefficients to zero
+  ///
+  /// \param[in] n      Number of block rows and columns.
+  /// \param[in] offset Offsets into \p index of the blocks of each row.
+  /// \param[in] index  Sorted column indices of the blocks of each row.
+  void Initialize(int n, const Array<int> &offset, const Array<int> &index);
+
+  /// Number of block rows, i.e., one third of the number of rows
+  int Rows() const;
+
+  /// Number of non-zero 3x3 blocks
+  int NumberOfBlocks() const;
+
+  /// Offset of first block of a given block row
+  int RowOffset(int r) const;
+
+  /// Column index of k-th block
+  int ColumnIndex(int k) const;
+
+  /// Index of block in row r and column c, or -1 if not part of sparsity pattern
+  int Find(int r, int c) const;
+
+  /// Coefficients of k-th block in row-major order
+  double *Block(int k);
+
+  /// Coefficients of k-th block in row-major order
+  const double *Block(int k) const;
+
+  /// Compute matrix-vector product y = A x
+  ///
+  /// \param[in]  x Input  vector of size 3 * Rows().
+  /// \param[out] y Output vector of size 3 * Rows().
+  void Multiply(const double *x, double *y) const;
+
+  /// Get inverse of diagonal blocks in row-major order
+  ///
+  /// Singular diagonal blocks are replaced by the inverse of their diagonal.
+  void InvertDiagonal(Array<double> &inv) const;
+
+private:
+
+  int                        _Rows;         ///< Number of block rows
+  Array<int>                 _RowOffset;    ///< Offset of first block of each row
+  UninitializedArray<int>    _ColumnIndex;  ///< Column index of each block
+  UninitializedArray<double> _Values;       ///< Coefficients of each block
+};
+
+/// Solve symmetric positive definite block sparse system using conjugate gradients
+///
+/// The block Jacobi preconditioner uses the inverse of the 3x3 diagonal blocks.
+/// The iteration stops when the residual norm relative to the norm of the
+/// right-hand side is below the given tolerance.
+///
+/// \param[in]     A       Symmetric positive definite system matrix.
+/// \param[in]     b       Right-hand side vector.
+/// \param[in,out] x       Initial guess and solution vector.
+/// \param[in]     maxiter Maximum number of iterations. When non-positive,
+///                        twice the number of unknowns is used.
+/// \param[in]     tol     Relative residual tolerance. When non-positive,
+///                        the machine epsilon is used.
+/// \param[out]    niter   Number of iterations.
+/// \param[out]    error   Relative residual norm of solution.
+/// \param[in]     observer Observer notified after each iteration.
+///
+/// \returns Whether the solver converged.
+bool ConjugateGradient(const BlockSparseMatrix3 &A, const double *b, double *x,
+                       int maxiter = 0, double tol = .0,
+                       int *niter = nullptr, double *error = nullptr,
+                       MapperObserver *observer = nullptr);
+
+/**
+ * Non-overlapping additive Schwarz preconditioner of a block sparse matrix
+ *
+ * The block rows are split into contiguous subdomains of nearly equal size.
+ * The diagonal submatrix of each subdomain is factorized by a sparse Cholesky
+ * decomposition, and the preconditioner solves the subdomain systems of a
+ * residual in parallel, i.e., it is a block Jacobi preconditioner with one
+ * block per subdomain instead of one 3x3 block per point. The couplings
+ * between points of the same subdomain are thus inverted exactly, which
+ * reduces the number of conjugate gradient iterations at the expense of the
+ * memory of the subdomain factors. The subdomains are spatially compact when
+ * the unknowns are ordered by a bandwidth reducing permutation.
+ */
+class BlockSchwarzPreconditioner
+{
+public:
+
+  /// Block rows and Cholesky factor of a subdomain
+  struct Subdomain;
+
+  /// Constructor
+  BlockSchwarzPreconditioner();
+
+  /// Destructor
+  ~BlockSchwarzPreconditioner();
+
+  /// Factorize diagonal submatrices of subdomains
+  ///
+  /// \param[in] A           Symmetric positive definite system matrix.
+  /// \param[in] nsubdomains Number of subdomains.
+  ///
+  /// \returns Whether all subdomain matrices were factorized.
+  bool Initialize(const BlockSparseMatrix3 &A, int nsubdomains);
+
+  /// Number of subdomains
+  int NumberOfSubdomains() const;
+
+  /// Number of block rows of the factorized matrix
+  int Rows() const;
+
+  /// Apply preconditioner, i.e., z = M^-1 r
+  ///
+  /// \param[in]  r Residual vector of size 3 * Rows().
+  /// \param[out] z Preconditioned vector of size 3 * Rows().
+  void Apply(const double *r, double *z) const;
+
+private:
+
+  int                          _Rows;       ///< Number of block rows
+  Array<SharedPtr<Subdomain> > _Subdomains; ///< Factorized subdomain matrices
+};
+
+/// Solve symmetric positive definite block sparse system using conjugate
+/// gradients with additive Schwarz preconditioner
+///
+/// \sa ConjugateGradient(const BlockSparseMatrix3 &, const double *, double *,
+///                       int, double, int *, double *, MapperObserver *)
+bool ConjugateGradient(const BlockSparseMatrix3 &A, const BlockSchwarzPreconditioner &M,
+                       const double *b, double *x, int maxiter = 0, double tol = .0,
+                       int *niter = nullptr, double *error = nullptr,
+                       MapperObserver *observer = nullptr);
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int BlockSchwarzPreconditioner::NumberOfSubdomains() const
+{
+  return static_cast<int>(_Subdomains.size());
+}
+
+// -----------------------------------------------------------------------------
+inline int BlockSchwarzPreconditioner::Rows() const
+{
+  return _Rows;
+}
+
+// -----------------------------------------------------------------------------
+inline int BlockSparseMatrix3::Rows() const
+{
+  return _Rows;
+}
+
+// -----------------------------------------------------------------------------
+inline int BlockSparseMatrix3::NumberOfBlocks() const
+{
+  return static_cast<int>(_ColumnIndex.size());
+}
+
+// -----------------------------------------------------------------------------
+inline int BlockSparseMatrix3::RowOffset(int r) const
+{
+  return _RowOffset[r];
+}
+
+// -----------------------------------------------------------------------------
+inline int BlockSparseMatrix3::ColumnIndex(int k) const
+{
+  return _ColumnIndex[k];
+}
+
+// -----------------------------------------------------------------------------
+inline double *BlockSparseMatrix3::Block(int k)
+{
+  return _Values.data() + 9 * k;
+}
+
+// -----------------------------------------------------------------------------
+inline const double *BlockSparseMatrix3::Block(int k) const
+{
+  return _Values.data() + 9 * k;
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_BlockSparseMatrix_H
@@ -0,0 +1,165 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_BoundaryDistanceField_H
+#define MIRTK_BoundaryDistanceField_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/Array.h"
+#include "mirtk/GenericImage.h"
+#include "mirtk/ImageAttributes.h"
+
+#include "vtkSmartPointer.h"
+#include "vtkPolyData.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Precomputed signed distance field of a closed triangulated surface
+ *
+ * The signed distance to the surface, which is negative inside and positive
+ * outside the surface, is precomputed at the points of a regular lattice.
+ * The exact distance is first computed at the lattice points within one
+ * lattice spacing of each triangle. The ID of the nearest triangle of these
+ * lattice points is then propagated to all other lattice points by forward
+ * and backward sweeps along each lattice axis, where each sweep processes
+ * the lattice rows in parallel, and the distance of a lattice point is the
+ * exact distance to the nearest triangle found. The sign of the distance is
+ * determined by the angle weighted pseudo-normal of the closest triangle
+ * feature (cf. Bærentzen and Aanæs, 2005), which is exact for a closed,
+ * consistently oriented manifold surface.
+ *
+ * The distance at any other point is interpolated trilinearly. Near the
+ * surface, where the sign matters, and outside the lattice, the distance is
+ * instead computed exactly with respect to the nearest triangles of the
+ * surrounding lattice points. This replaces the closest cell search of
+ * vtkImplicitPolyDataDistance for each query point by a lookup, and the
+ * field can be queried concurrently by multiple threads.
+ *
+ * - Bærentzen and Aanæs (2005). Signed distance computation using the angle
+ *   weighted pseudonormal. IEEE Transactions on Visualization and Computer
+ *   Graphics, 11(3), 243–253.
+ */
+class BoundaryDistanceField : public Object
+{
+  mirtkObjectMacro(BoundaryDistanceField);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Closed triangulated surface
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkPolyData>, Surface);
+
+  /// Lattice on which the signed distance is precomputed
+  ///
+  /// When the lattice is empty, it is derived from the bounding box of the
+  /// surface which is enlarged by Margin lattice spacings on each side.
+  mirtkPublicAttributeMacro(ImageAttributes, Lattice);
+
+  /// Maximum number of points along each axis of the derived lattice
+  mirtkPublicAttributeMacro(int, MaximumSize);
+
+  /// Number of lattice spacings by which the bounds of the derived lattice
+  /// exceed the bounding box of the surface
+  mirtkPublicAttributeMacro(int, Margin);
+
+  /// Distance from the surface in units of the maximum lattice spacing
+  /// within which the distance is computed exactly instead of interpolated
+  mirtkPublicAttributeMacro(double, ExactBandWidth);
+
+  /// Signed distance at lattice points
+  mirtkReadOnlyAttributeMacro(GenericImage<float>, Distances);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const BoundaryDistanceField &);
+
+private:
+
+  Array<double> _Points;        ///< Surface point coordinates
+  Array<int>    _Triangles;     ///< Point IDs of triangle corners
+  Array<double> _FaceNormals;   ///< Unit normal of each triangle
+  Array<double> _EdgeNormals;   ///< Pseudo-normals of edge from corner k to k+1
+  Array<double> _VertexNormals; ///< Angle weighted pseudo-normal of each point
+  Array<int>    _Nearest;       ///< Nearest triangle of each lattice point
+  double        _MaxSpacing;    ///< Maximum lattice spacing
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  BoundaryDistanceField();
+
+  /// Copy constructor
+  BoundaryDistanceField(const BoundaryDistanceField &);
+
+  /// Assignment operator
+  BoundaryDistanceField &operator =(const BoundaryDistanceField &);
+
+  /// Destructor
+  virtual ~BoundaryDistanceField();
+
+  /// Precompute signed distance field of surface
+  void Initialize();
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  /// Number of surface triangles
+  int NumberOfTriangles() const;
+
+  /// Signed distance of a point to a given surface triangle
+  ///
+  /// \param[in] p Point coordinates.
+  /// \param[in] t Triangle index.
+  ///
+  /// \returns Distance of point to the closest point of the triangle, where
+  ///          the sign is given by the pseudo-normal of the closest feature.
+  double Distance(const double p[3], int t) const;
+
+  /// Signed distance of a point to the surface
+  double Evaluate(double x, double y, double z) const;
+
+  /// Signed distance of multiple points to the surface
+  ///
+  /// \param[in]  n   Number of points.
+  /// \param[in]  xyz Point coordinates, i.e., [x1, y1, z1, ..., xn, yn, zn].
+  /// \param[out] d   Signed distance of each point.
+  void Evaluate(int n, const double *xyz, double *d) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int BoundaryDistanceField::NumberOfTriangles() const
+{
+  return static_cast<int>(_Triangles.size() / 3);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_BoundaryDistanceField_H
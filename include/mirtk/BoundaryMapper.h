@@ -26,6 +26,8 @@
 #include "mirtk/Memory.h"
 #include "mirtk/SurfaceBoundary.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/MapperStatistics.h"
+#include "mirtk/MapperObserver.h"
 
 
 namespace mirtk {
@@ -60,6 +62,12 @@ class BoundaryMapper : public Object
   /// Piecewise linear boundary map
   mirtkReadOnlyAttributeMacro(SharedPtr<PiecewiseLinearMap>, Output);
 
+  /// Execution statistics of last Run
+  mirtkReadOnlyAttributeMacro(MapperStatistics, Statistics);
+
+  /// Observer notified after each iteration of the iterative methods, not owned
+  mirtkPublicAttributeMacro(MapperObserver *, Observer);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const BoundaryMapper &);
 
@@ -91,6 +99,10 @@ public:
   /// Compute boundary map values
   virtual void Run();
 
+  /// Outcome of last Run, i.e., whether it completed or the output is the best
+  /// iterate reached before the time limit of the Observer or a cancellation
+  MapperStatus Status() const;
+
   /// Number of map value components
   virtual int NumberOfComponents() const;
 
@@ -151,6 +163,16 @@ protected:
 // Inline definitions
 ////////////////////////////////////////////////////////////////////////////////
 
+// =============================================================================
+// Execution
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+inline MapperStatus BoundaryMapper::Status() const
+{
+  return _Statistics.Status();
+}
+
 // =============================================================================
 // Boundary map
 // =============================================================================
@@ -81,6 +81,26 @@ public:
   /// \param[in] n Index of boundary segment.
   void MapSegment(int n);
 
+  /// Process specified boundary segment using the given parameterizer
+  ///
+  /// \param[in] n     Index of boundary segment.
+  /// \param[in] param Boundary segment parameterizer, e.g., a copy of the
+  ///                  Parameterizer owned by the calling thread.
+  void MapSegment(int n, BoundarySegmentParameterizer &param);
+
+  /// Process specified boundary segments concurrently
+  ///
+  /// Each segment is parameterized by its own copy of the Parameterizer.
+  /// The map values of different segments are assigned by concurrent calls
+  /// of MapBoundarySegment, which only write the values of the points of
+  /// their segment.
+  ///
+  /// \param[in] segments Indices of boundary segments.
+  void MapSegments(const Array<int> &segments);
+
+  /// Process all boundary segments concurrently
+  void MapAll();
+
   /// Finalize boundary map
   virtual void Finalize();
 
@@ -0,0 +1,150 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_BoundedQueue_H
+#define MIRTK_BoundedQueue_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+namespace mirtk {
+
+
+/**
+ * First-in first-out queue of limited capacity between the stages of a pipeline
+ *
+ * Producers block while the queue is full and consumers block while it is
+ * empty, such that a fast stage cannot run ahead of a slow stage by more than
+ * the capacity of the queue between them. This bounds the memory held by
+ * prefetched inputs and by outputs which are yet to be written. Once all
+ * producers are done, the queue is closed, which wakes up all consumers as
+ * soon as the remaining items were taken.
+ *
+ * All member functions can be called by any thread.
+ */
+template <class T>
+class BoundedQueue
+{
+public:
+
+  /// Constructor
+  explicit BoundedQueue(size_t capacity = 1);
+
+  /// Maximum number of items in queue
+  size_t Capacity() const;
+
+  /// Append item, blocks while the queue is full
+  ///
+  /// \returns Whether the item was added, i.e., \c false if the queue is closed.
+  bool Push(T item);
+
+  /// Remove first item, blocks while the queue is empty and not closed
+  ///
+  /// \returns Whether an item was removed, i.e., \c false if the queue is
+  ///          closed and empty.
+  bool Pop(T &item);
+
+  /// Close queue after the last item was added
+  void Close();
+
+private:
+
+  /// Copy constructor
+  /// \note Intentionally not implemented.
+  BoundedQueue(const BoundedQueue &);
+
+  /// Assignment operator
+  /// \note Intentionally not implemented.
+  BoundedQueue &operator =(const BoundedQueue &);
+
+  std::deque<T>           _Items;    ///< Items in order of insertion
+  size_t                  _Capacity; ///< Maximum number of items
+  bool                    _Closed;   ///< Whether no more items are added
+  std::mutex              _Mutex;    ///< Guards items and closed flag
+  std::condition_variable _NotEmpty; ///< Signalled when an item was added or queue closed
+  std::condition_variable _NotFull;  ///< Signalled when an item was removed or queue closed
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+template <class T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+:
+  _Capacity(capacity > 0 ? capacity : 1),
+  _Closed(false)
+{
+}
+
+// -----------------------------------------------------------------------------
+template <class T>
+inline size_t BoundedQueue<T>::Capacity() const
+{
+  return _Capacity;
+}
+
+// -----------------------------------------------------------------------------
+template <class T>
+bool BoundedQueue<T>::Push(T item)
+{
+  std::unique_lock<std::mutex> lock(_Mutex);
+  while (!_Closed && _Items.size() >= _Capacity) _NotFull.wait(lock);
+  if (_Closed) return false;
+  _Items.push_back(std::move(item));
+  lock.unlock();
+  _NotEmpty.notify_one();
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+template <class T>
+bool BoundedQueue<T>::Pop(T &item)
+{
+  std::unique_lock<std::mutex> lock(_Mutex);
+  while (!_Closed && _Items.empty()) _NotEmpty.wait(lock);
+  if (_Items.empty()) return false;
+  item = std::move(_Items.front());
+  _Items.pop_front();
+  lock.unlock();
+  _NotFull.notify_one();
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+template <class T>
+void BoundedQueue<T>::Close()
+{
+  {
+    std::lock_guard<std::mutex> lock(_Mutex);
+    _Closed = true;
+  }
+  _NotEmpty.notify_all();
+  _NotFull.notify_all();
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_BoundedQueue_H
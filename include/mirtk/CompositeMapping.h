@@ -0,0 +1,214 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_CompositeMapping_H
+#define MIRTK_CompositeMapping_H
+
+#include "mirtk/Mapping.h"
+
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Composition of a chain of maps evaluated on demand
+ *
+ * This map evaluates g(x) = fn o ... o f2 o f1(x) without storing the values
+ * of the intermediate maps. The codomain dimension of each map other than the
+ * last one must be at most 3, and its values are the coordinates of the input
+ * point of the next map, where missing coordinates are zero.
+ *
+ * Multiple points are evaluated in batches of at most BatchSize points, where
+ * the batched Evaluate function of each map is called once per batch such
+ * that maps which amortize their set up costs over many points can do so.
+ * Consecutive analytic maps (see Mapping::IsAnalytic) are instead evaluated
+ * point by point in a single parallel loop over the batch. A point is outside
+ * the domain of the composite map when it is outside the domain of any map.
+ *
+ * The maps are shared with other composite maps and copies of this map.
+ * A composite map can not be written to a file.
+ */
+class CompositeMapping : public Mapping
+{
+  mirtkObjectMacro(CompositeMapping);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Maps in order of application
+  mirtkReadOnlyAttributeMacro(Array<SharedPtr<const Mapping> >, Maps);
+
+  /// Maximum number of points evaluated at once by the batched Evaluate
+  ///
+  /// The intermediate map values of one batch are kept in memory. When
+  /// non-positive, all points are evaluated in a single batch.
+  mirtkPublicAttributeMacro(int, BatchSize);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const CompositeMapping &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  CompositeMapping();
+
+  /// Copy constructor
+  CompositeMapping(const CompositeMapping &);
+
+  /// Assignment operator
+  CompositeMapping &operator =(const CompositeMapping &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make copy of this map which shares the component maps
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~CompositeMapping();
+
+  // ---------------------------------------------------------------------------
+  // Component maps
+
+  /// Remove all maps
+  void Clear();
+
+  /// Append map to chain of maps
+  ///
+  /// \param[in] map Map applied to the values of the previously added maps.
+  void Add(const SharedPtr<const Mapping> &map);
+
+  /// Append copy of map to chain of maps
+  ///
+  /// \param[in] map Map applied to the values of the previously added maps.
+  void Add(const Mapping &map);
+
+  /// Number of maps
+  int NumberOfMaps() const;
+
+  /// Get i-th map
+  const Mapping *Map(int i) const;
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get minimum axes-aligned bounding box of domain of first map
+  ///
+  /// \param[out] x1 Lower bound of map domain along x axis.
+  /// \param[out] y1 Lower bound of map domain along y axis.
+  /// \param[out] z1 Lower bound of map domain along z axis.
+  /// \param[out] x2 Upper bound of map domain along x axis.
+  /// \param[out] y2 Upper bound of map domain along y axis.
+  /// \param[out] z2 Upper bound of map domain along z axis.
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain of last map
+  virtual int NumberOfComponents() const;
+
+  /// Whether all maps are analytic
+  virtual bool IsAnalytic() const;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[out] v Map value.
+  /// \param[in]  x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point using reusable scratch memory
+  ///
+  /// The context stores a nested evaluation context for each of the maps.
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    v   Map value.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(EvaluationContext &ctx, double *v,
+                        double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points in batches
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  // Import other overloads
+  using Mapping::EvaluateJacobian;
+
+  /// Evaluate Jacobian of composite map at a given point using the chain rule
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    jac Jacobian matrix stored row by row with three partial
+  ///                    derivatives per map component.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate Jacobian.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate Jacobian.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate Jacobian.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                double x, double y, double z = 0) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int CompositeMapping::NumberOfMaps() const
+{
+  return static_cast<int>(_Maps.size());
+}
+
+// -----------------------------------------------------------------------------
+inline const Mapping *CompositeMapping::Map(int i) const
+{
+  return _Maps[i].get();
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_CompositeMapping_H
@@ -22,10 +22,20 @@
 
 #include "mirtk/SphericalSurfaceMapper.h"
 
+#include "mirtk/Memory.h"
+#include "mirtk/SparseSolverType.h"
+
+#include "vtkType.h"
+
+class vtkPoints;
+
 
 namespace mirtk {
 
 
+class SparseFactorization;
+
+
 /**
  * Computes discrete conformal map of (closed) surface to the complex plane
  *
@@ -59,6 +69,16 @@ namespace mirtk {
  *   IEEE Trans. Vis. Comput. Graphics, 6(2), 181–189.
  * - Desbrun, Meyer, and Alliez (2002). Intrinsic parameterizations of surface meshes.
  *   Computer Graphics Forum, 21(3), 209–218.
+ *
+ * The cotangent Laplacian of a closed surface is singular with the constant
+ * functions as null space. It is made positive definite by fixing the value
+ * of the first surface point, and the mean map value is subtracted from the
+ * solution afterwards. This matrix is factorized once by a sparse Cholesky
+ * solver, which is kept by the filter and solves for both real and imaginary
+ * part of the right-hand side. Subsequent runs for another PolarCellId reuse
+ * the numeric factorization as long as the points and cells of the input
+ * surface were not modified, and runs for other surfaces with the same
+ * connectivity reuse its symbolic analysis.
  */
 class ConformalSurfaceFlattening : public SphericalSurfaceMapper
 {
@@ -87,9 +107,25 @@ class ConformalSurfaceFlattening : public SphericalSurfaceMapper
   /// Tolerance for sparse linear solver
   mirtkPublicAttributeMacro(double, Tolerance);
 
+  /// Sparse linear solver, where SparseSolver_Default selects the fastest
+  /// direct or iterative solver suitable for the system matrix
+  mirtkPublicAttributeMacro(SparseSolverType, Solver);
+
   /// Computed map values at surface points
   mirtkAttributeMacro(vtkSmartPointer<vtkDataArray>, Values);
 
+  /// Factorization of grounded cotangent Laplacian of last run
+  ///
+  /// It is not copied from other instances, which would otherwise share
+  /// a non-thread-safe solver object.
+  mirtkAttributeMacro(SharedPtr<SparseFactorization>, Factorization);
+
+  /// Surface points whose cotangent Laplacian was factorized, not owned
+  mirtkAttributeMacro(vtkPoints *, FactorizedPoints);
+
+  /// Modification time of factorized surface points and cells
+  mirtkAttributeMacro(vtkMTimeType, FactorizedTime);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const ConformalSurfaceFlattening &);
 
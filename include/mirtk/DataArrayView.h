@@ -0,0 +1,196 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_DataArrayView_H
+#define MIRTK_DataArrayView_H
+
+#include "vtkType.h"
+#include "vtkTypeTraits.h"
+#include "vtkVersionMacros.h"
+#include "vtkDataArray.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Direct access to the values of a vtkDataArray in hot loops
+ *
+ * The values of float and double arrays with array-of-structures memory
+ * layout, i.e., vtkFloatArray and vtkDoubleArray, are accessed through a
+ * pointer to their contiguous memory instead of the virtual GetComponent
+ * and SetComponent functions. The data type is determined once on
+ * construction, such that the type test in each accessor is loop invariant.
+ * Arrays of any other type are accessed through the vtkDataArray interface.
+ *
+ * A view is only valid as long as the array is not resized or reallocated.
+ */
+class DataArrayView
+{
+public:
+
+  /// Constructor
+  explicit DataArrayView(vtkDataArray *array = nullptr);
+
+  /// Viewed data array
+  vtkDataArray *Array() const;
+
+  /// Number of components per tuple
+  int NumberOfComponents() const;
+
+  /// Whether values are accessed directly
+  bool IsContiguous() const;
+
+  /// Get pointer to contiguous values of array, \c nullptr if the array
+  /// is not an array of the given value type
+  template <class T> T *Pointer() const;
+
+  /// Get value of component \p j of tuple \p i
+  double Get(vtkIdType i, int j = 0) const;
+
+  /// Set value of component \p j of tuple \p i
+  void Set(vtkIdType i, int j, double v) const;
+
+  /// Get all components of tuple \p i
+  void GetTuple(vtkIdType i, double *v) const;
+
+  /// Set all components of tuple \p i
+  void SetTuple(vtkIdType i, const double *v) const;
+
+private:
+
+  vtkDataArray *_Array;              ///< Viewed data array
+  float        *_Float;              ///< Values of float array or \c nullptr
+  double       *_Double;             ///< Values of double array or \c nullptr
+  int           _NumberOfComponents; ///< Number of components per tuple
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Auxiliary functions
+////////////////////////////////////////////////////////////////////////////////
+
+/// Get pointer to contiguous values of data array of the given value type
+///
+/// \returns Pointer to first value or \c nullptr when the data type of the
+///          array differs from \p T or its memory layout is not contiguous
+///          in array-of-structures order.
+template <class T>
+inline T *DataArrayPointer(vtkDataArray *array)
+{
+  if (!array || array->GetDataType() != vtkTypeTraits<T>::VTKTypeID()) return nullptr;
+  #if VTK_MAJOR_VERSION > 7 || (VTK_MAJOR_VERSION == 7 && VTK_MINOR_VERSION >= 1)
+    if (!array->HasStandardMemoryLayout()) return nullptr;
+  #endif
+  return reinterpret_cast<T *>(array->GetVoidPointer(0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline DataArrayView::DataArrayView(vtkDataArray *array)
+:
+  _Array(array),
+  _Float(DataArrayPointer<float>(array)),
+  _Double(DataArrayPointer<double>(array)),
+  _NumberOfComponents(array ? array->GetNumberOfComponents() : 0)
+{
+}
+
+// -----------------------------------------------------------------------------
+inline vtkDataArray *DataArrayView::Array() const
+{
+  return _Array;
+}
+
+// -----------------------------------------------------------------------------
+inline int DataArrayView::NumberOfComponents() const
+{
+  return _NumberOfComponents;
+}
+
+// -----------------------------------------------------------------------------
+inline bool DataArrayView::IsContiguous() const
+{
+  return _Float != nullptr || _Double != nullptr;
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline float *DataArrayView::Pointer<float>() const
+{
+  return _Float;
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline double *DataArrayView::Pointer<double>() const
+{
+  return _Double;
+}
+
+// -----------------------------------------------------------------------------
+inline double DataArrayView::Get(vtkIdType i, int j) const
+{
+  const vtkIdType idx = i * _NumberOfComponents + j;
+  if (_Double) return _Double[idx];
+  if (_Float)  return static_cast<double>(_Float[idx]);
+  return _Array->GetComponent(i, j);
+}
+
+// -----------------------------------------------------------------------------
+inline void DataArrayView::Set(vtkIdType i, int j, double v) const
+{
+  const vtkIdType idx = i * _NumberOfComponents + j;
+  if      (_Double) _Double[idx] = v;
+  else if (_Float)  _Float [idx] = static_cast<float>(v);
+  else              _Array->SetComponent(i, j, v);
+}
+
+// -----------------------------------------------------------------------------
+inline void DataArrayView::GetTuple(vtkIdType i, double *v) const
+{
+  const vtkIdType idx = i * _NumberOfComponents;
+  if (_Double) {
+    for (int j = 0; j < _NumberOfComponents; ++j) v[j] = _Double[idx + j];
+  } else if (_Float) {
+    for (int j = 0; j < _NumberOfComponents; ++j) v[j] = static_cast<double>(_Float[idx + j]);
+  } else {
+    _Array->GetTuple(i, v);
+  }
+}
+
+// -----------------------------------------------------------------------------
+inline void DataArrayView::SetTuple(vtkIdType i, const double *v) const
+{
+  const vtkIdType idx = i * _NumberOfComponents;
+  if (_Double) {
+    for (int j = 0; j < _NumberOfComponents; ++j) _Double[idx + j] = v[j];
+  } else if (_Float) {
+    for (int j = 0; j < _NumberOfComponents; ++j) _Float[idx + j] = static_cast<float>(v[j]);
+  } else {
+    _Array->SetTuple(i, v);
+  }
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_DataArrayView_H
@@ -0,0 +1,174 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_DiskToSquareMap_H
+#define MIRTK_DiskToSquareMap_H
+
+#include "mirtk/AnalyticMapping.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Point.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Map of 2D points in a disk to the square whose incircle bounds the disk
+ *
+ * This map is the inverse of SquareToDiskMap. Each point is scaled along the
+ * ray from the disk center such that the circle is mapped onto the boundary
+ * of the square. The z coordinate of the input points is ignored.
+ */
+class DiskToSquareMap : public AnalyticMapping
+{
+  mirtkObjectMacro(DiskToSquareMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Center of disk
+  mirtkPublicAttributeMacro(Point, DiskCenter);
+
+  /// Radius of disk
+  mirtkPublicAttributeMacro(double, DiskRadius);
+
+  /// Center of square
+  mirtkPublicAttributeMacro(Point, SquareCenter);
+
+  /// Half the side length of the square, i.e., radius of its incircle
+  mirtkPublicAttributeMacro(double, SquareRadius);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const DiskToSquareMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  DiskToSquareMap();
+
+  /// Copy constructor
+  DiskToSquareMap(const DiskToSquareMap &);
+
+  /// Assignment operator
+  DiskToSquareMap &operator =(const DiskToSquareMap &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make deep copy of this map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~DiskToSquareMap();
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get bounding box of disk
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., number of output values
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point without virtual function call
+  bool Map(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points in parallel
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+protected:
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int DiskToSquareMap::NumberOfComponents() const
+{
+  return 2;
+}
+
+// -----------------------------------------------------------------------------
+inline bool DiskToSquareMap::Map(double *v, double x, double y, double) const
+{
+  x -= _DiskCenter._x;
+  y -= _DiskCenter._y;
+  const double r = sqrt(x * x + y * y);
+  if (r > .0) {
+    // Points on the diagonal are mapped to the diagonal, others are moved
+    // along the ray until the larger coordinate is equal to the radius
+    const double r2 = r * r;
+    double cosa, sina;
+    if (fequal(x, y, 1e-6)) {
+      x = copysign(r, x);
+      y = copysign(r, y);
+    } else if (abs(x) > abs(y)) {
+      cosa = x / r;
+      x = copysign(r,                           x);
+      y = copysign(sqrt(r2 / (cosa*cosa) - r2), y);
+    } else {
+      sina = y / r;
+      x = copysign(sqrt(r2 / (sina*sina) - r2), x);
+      y = copysign(r,                           y);
+    }
+  }
+  const double s = _SquareRadius / _DiskRadius;
+  v[0] = _SquareCenter._x + s * x;
+  v[1] = _SquareCenter._y + s * y;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+inline bool DiskToSquareMap::Evaluate(double *v, double x, double y, double z) const
+{
+  return this->Map(v, x, y, z);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_DiskToSquareMap_H
@@ -0,0 +1,139 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_FlipFreeSurfaceMapRefinement_H
+#define MIRTK_FlipFreeSurfaceMapRefinement_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/Array.h"
+
+#include "vtkSmartPointer.h"
+#include "vtkDataArray.h"
+
+
+namespace mirtk {
+
+
+// Forward declarations
+class TriangleGeometry;
+
+
+/**
+ * Nonlinear refinement of a planar surface map which removes flipped triangles
+ *
+ * The free map values are moved to minimize a barrier-type distortion energy
+ * of the piecewise linear map, i.e., the sum over all triangles of
+ *
+ *   A_t [(1 - theta) |J|^2 / chi(det J) + theta (det J^2 + 1) / chi(det J)],
+ *
+ * where J is the Jacobian of the map of the triangle relative to its scaled
+ * shape on the surface, A_t its area, and chi(D) = (D + sqrt(eps^2 + D^2)) / 2
+ * a regularization of det J which tends to infinity as eps goes to zero for
+ * flipped triangles (cf. Garanzha et al., 2021). Starting with a large eps for
+ * a map with flipped triangles, the energy is minimized by L-BFGS for a
+ * decreasing sequence of eps, which untangles the map while keeping it close
+ * to the initial map outside the flipped regions.
+ *
+ * The geometry of the triangles is taken from the TriangleGeometry cache of
+ * the surface mapper and the inverse reference shape of each triangle is
+ * precomputed once. The energy and its gradient are evaluated in parallel
+ * over the triangles, and the gradients are gathered in parallel over the
+ * free points. The trial steps of the line search only evaluate the energy.
+ *
+ * - Garanzha, Kaporin, Kudryavtseva, Protais, Ray, and Sokolov (2021).
+ *   Foldover-free maps in 50 lines of code. ACM Transactions on Graphics,
+ *   40(4), 102.
+ */
+class FlipFreeSurfaceMapRefinement : public Object
+{
+  mirtkObjectMacro(FlipFreeSurfaceMapRefinement);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Cached geometry of the surface triangles
+  mirtkPublicAttributeMacro(const TriangleGeometry *, Triangles);
+
+  /// Planar map values at surface points, which are modified in place
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkDataArray>, Values);
+
+  /// Whether the map value of each surface point is fixed
+  ///
+  /// When empty, the end points of the boundary edges are fixed.
+  mirtkPublicAttributeMacro(Array<bool>, FixedPoints);
+
+  /// Maximum number of outer iterations, i.e., of decreasing eps values
+  mirtkPublicAttributeMacro(int, NumberOfIterations);
+
+  /// Maximum number of L-BFGS iterations for each value of eps
+  mirtkPublicAttributeMacro(int, NumberOfInnerIterations);
+
+  /// Number of L-BFGS correction pairs
+  mirtkPublicAttributeMacro(int, HistorySize);
+
+  /// Weight theta of area term relative to shape term
+  mirtkPublicAttributeMacro(double, AreaWeight);
+
+  /// Minimum relative decrease of the energy of the untangled map
+  mirtkPublicAttributeMacro(double, Tolerance);
+
+  /// Number of flipped or degenerate triangles of the input map
+  mirtkReadOnlyAttributeMacro(int, NumberOfInitialFlips);
+
+  /// Number of flipped or degenerate triangles of the refined map
+  mirtkReadOnlyAttributeMacro(int, NumberOfFlips);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const FlipFreeSurfaceMapRefinement &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  FlipFreeSurfaceMapRefinement();
+
+  /// Copy constructor
+  FlipFreeSurfaceMapRefinement(const FlipFreeSurfaceMapRefinement &);
+
+  /// Assignment operator
+  FlipFreeSurfaceMapRefinement &operator =(const FlipFreeSurfaceMapRefinement &);
+
+  /// Destructor
+  virtual ~FlipFreeSurfaceMapRefinement();
+
+  // ---------------------------------------------------------------------------
+  // Execution
+
+  /// Refine map values when the map has flipped or degenerate triangles
+  ///
+  /// The map values are left unmodified when the input map has no flipped
+  /// triangles, or when the refined map has more flipped triangles.
+  ///
+  /// \returns Whether the map values were modified.
+  bool Run();
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_FlipFreeSurfaceMapRefinement_H
@@ -0,0 +1,149 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_InverseStereographicMap_H
+#define MIRTK_InverseStereographicMap_H
+
+#include "mirtk/AnalyticMapping.h"
+#include "mirtk/StereographicMap.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Inverse stereographic projection of points in the plane to a sphere
+ *
+ * The 2D points in the plane z = 0 are projected onto the sphere centered at
+ * the origin along the ray towards the chosen pole, where the points in the
+ * disk of the sphere radius are mapped to the hemisphere opposite the pole.
+ * The z coordinate of the input points is ignored.
+ */
+class InverseStereographicMap : public AnalyticMapping
+{
+  mirtkObjectMacro(InverseStereographicMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Radius of sphere
+  mirtkPublicAttributeMacro(double, SphereRadius);
+
+  /// Pole towards which points are projected
+  mirtkPublicAttributeMacro(SpherePole, Pole);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const InverseStereographicMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  InverseStereographicMap();
+
+  /// Copy constructor
+  InverseStereographicMap(const InverseStereographicMap &);
+
+  /// Assignment operator
+  InverseStereographicMap &operator =(const InverseStereographicMap &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make deep copy of this map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~InverseStereographicMap();
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get bounding box of disk whose radius is the sphere radius
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., number of output values
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point without virtual function call
+  bool Map(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points in parallel
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+protected:
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int InverseStereographicMap::NumberOfComponents() const
+{
+  return 3;
+}
+
+// -----------------------------------------------------------------------------
+inline bool InverseStereographicMap::Map(double *v, double x, double y, double) const
+{
+  const double r  = _SphereRadius;
+  const double z0 = (_Pole == SpherePole_North ? -r : r);
+  const double s  = 2.0 * r * r / (x * x + y * y + r * r);
+  v[0] = s * x;
+  v[1] = s * y;
+  v[2] = (1.0 - s) * z0;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+inline bool InverseStereographicMap::Evaluate(double *v, double x, double y, double z) const
+{
+  return this->Map(v, x, y, z);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_InverseStereographicMap_H
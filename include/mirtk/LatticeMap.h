@@ -0,0 +1,179 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_LatticeMap_H
+#define MIRTK_LatticeMap_H
+
+#include "mirtk/Mapping.h"
+
+#include "mirtk/Memory.h"
+#include "mirtk/GenericImage.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Map sampled on a regular lattice
+ *
+ * This map caches the values of another map, which is expensive to evaluate,
+ * such as a meshless map with many source points, at the points of a regular
+ * lattice. The map is then evaluated in constant time by trilinear or cubic
+ * interpolation of these samples, independent of the type of map it replaces.
+ * Lattice points outside the domain of the source map are excluded from the
+ * interpolation, and a point is outside the domain of this map when the
+ * majority of the interpolation weight falls onto such lattice points.
+ *
+ * The source map is only needed to initialize the lattice samples and is
+ * not stored in the map file written by this map.
+ */
+class LatticeMap : public Mapping
+{
+  mirtkObjectMacro(LatticeMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Map sampled by Initialize
+  mirtkPublicAttributeMacro(SharedPtr<const Mapping>, Source);
+
+  /// Lattice spacing, where a non-positive value selects the default
+  /// spacing of Mapping::Attributes(double, double, double)
+  mirtkPublicAttributeMacro(double, Spacing);
+
+  /// Whether to use cubic (Catmull-Rom) interpolation instead of trilinear
+  ///
+  /// Where not all lattice points of the cubic stencil are inside the map
+  /// domain, trilinear interpolation is used instead.
+  mirtkPublicAttributeMacro(bool, CubicInterpolation);
+
+  /// Number of random points at which the interpolation error is checked
+  /// against the source map during initialization
+  mirtkPublicAttributeMacro(int, NumberOfProbes);
+
+  /// Maximum absolute interpolation error at the random probe points
+  mirtkReadOnlyAttributeMacro(double, MaximumError);
+
+  /// Root mean squared interpolation error at the random probe points
+  mirtkReadOnlyAttributeMacro(double, RMSError);
+
+  /// Samples of source map at lattice points, NaN outside map domain
+  mirtkReadOnlyAttributeMacro(GenericImage<float>, Values);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const LatticeMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  LatticeMap();
+
+  /// Construct cached lattice map of given map
+  LatticeMap(SharedPtr<const Mapping>, double ds = .0);
+
+  /// Copy constructor
+  LatticeMap(const LatticeMap &);
+
+  /// Assignment operator
+  LatticeMap &operator =(const LatticeMap &);
+
+  /// Initialize map after inputs and parameters are set
+  ///
+  /// When a source map is set, it is sampled at the points of a regular
+  /// lattice and the interpolation error is checked at random points.
+  virtual void Initialize();
+
+  /// Make deep copy of this map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~LatticeMap();
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get minimum axes-aligned bounding box of map domain
+  ///
+  /// \param[out] x1 Lower bound of map domain along x axis.
+  /// \param[out] y1 Lower bound of map domain along y axis.
+  /// \param[out] z1 Lower bound of map domain along z axis.
+  /// \param[out] x2 Upper bound of map domain along x axis.
+  /// \param[out] y2 Upper bound of map domain along y axis.
+  /// \param[out] z2 Upper bound of map domain along z axis.
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., number of output values
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[out] v Map value.
+  /// \param[in]  x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+protected:
+
+  /// Evaluate map at a given lattice coordinate using trilinear interpolation
+  bool EvaluateLinear(double *v, double i, double j, double k) const;
+
+  /// Evaluate map at a given lattice coordinate using cubic interpolation
+  bool EvaluateCubic(double *v, double i, double j, double k) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int LatticeMap::NumberOfComponents() const
+{
+  return _Values.T();
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_LatticeMap_H
@@ -23,6 +23,7 @@
 #include "mirtk/FreeBoundarySurfaceMapper.h"
 
 #include "mirtk/Array.h"
+#include "mirtk/SparseSolverType.h"
 
 #include "vtkSmartPointer.h"
 #include "vtkDataArray.h"
@@ -49,12 +50,25 @@ namespace mirtk {
  * point is chosen to be as farthest away from the first fixed point as possible
  * based on geodesic distances on the input surface mesh.
  *
+ * By default, the normal equations of the conformal energy are assembled and
+ * solved by a sparse direct or iterative solver. In matrix-free mode, the
+ * conformal energy is instead minimized by LSQR (Paige and Saunders, 1982)
+ * as a sum of squared per-triangle Cauchy-Riemann residuals (Levy, 2002).
+ * The residual coefficients of each triangle are precomputed in parallel
+ * and the residual operator and its transpose are applied without assembling
+ * any sparse matrix. The condition number of the least squares problem is
+ * the square root of the one of the normal equations, and the memory is
+ * linear in the number of triangles. This is suited for large meshes whose
+ * factorization does not fit into memory.
+ *
  * - Levy et al. (2002). Least squares conformal maps for automatic texture atlas
  *   generation. ACM Trans. Graphics, 21(3), 362–371.
  * - Desbrun, Meyer, and Alliez (2002). Intrinsic parameterizations of surface meshes.
  *   Computer Graphics Forum, 21(3), 209–218.
  * - Mullen et al. (2008). Spectral conformal parameterization.
  *   Eurographics Symposium on Geometry Processing, 27(5), 1487–1494.
+ * - Paige and Saunders (1982). LSQR: An algorithm for sparse linear equations
+ *   and sparse least squares. ACM Trans. Math. Software, 8(1), 43–71.
  *
  * \todo Implement area weighting extension as described in Mullen et al. (2008)
  *       to account for irregular surface sampling.
@@ -76,6 +90,18 @@ private:
   /// Tolerance for sparse linear solver
   mirtkPublicAttributeMacro(double, Tolerance);
 
+  /// Sparse linear solver, where SparseSolver_Default selects the fastest
+  /// direct or iterative solver suitable for the system matrix
+  mirtkPublicAttributeMacro(SparseSolverType, Solver);
+
+  /// Whether to minimize the per-triangle conformal energy by matrix-free
+  /// LSQR instead of solving the assembled normal equations
+  ///
+  /// In this mode, the Solver is ignored. The maximum number of LSQR iterations
+  /// is given by NumberOfIterations when greater than one, and the Tolerance
+  /// bounds the relative norm of the normal equations residual.
+  mirtkPublicAttributeMacro(bool, MatrixFree);
+
   /// Index of point in set of points with free (i >= 0) or fixed (i < 0) values
   mirtkAttributeMacro(Array<int>, PointIndex);
 
@@ -140,6 +166,9 @@ protected:
   /// Compute surface map
   virtual void ComputeMap();
 
+  /// Compute surface map by matrix-free LSQR
+  void ComputeMatrixFreeMap();
+
   /// Finalize filter execution
   virtual void Finalize();
 
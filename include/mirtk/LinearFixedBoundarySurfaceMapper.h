@@ -23,14 +23,23 @@
 #include "mirtk/FixedBoundarySurfaceMapper.h"
 
 #include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/SparseSolverType.h"
 
 #include "vtkSmartPointer.h"
+#include "vtkPoints.h"
 #include "vtkDataArray.h"
 
 
 namespace mirtk {
 
 
+// Forward declaration of Eigen dependent types
+class SparseFactorization;
+class ReducedBoundaryBasis;
+class MapperWorkspace;
+
+
 /**
  * Base class of discrete piecewise linear fixed boundary surface mapping methods
  *
@@ -63,6 +72,40 @@ class LinearFixedBoundarySurfaceMapper : public FixedBoundarySurfaceMapper
   /// Tolerance for sparse linear solver
   mirtkPublicAttributeMacro(double, Tolerance);
 
+  /// Sparse linear solver, where SparseSolver_Default selects the fastest
+  /// direct or iterative solver suitable for the system matrix
+  mirtkPublicAttributeMacro(SparseSolverType, Solver);
+
+  /// Whether to solve in single precision with double precision refinement
+  ///
+  /// \sa SparseFactorization
+  mirtkPublicAttributeMacro(bool, MixedPrecision);
+
+  /// Whether to remove flipped triangles of the planar map by nonlinear
+  /// refinement of the free map values after the linear solve
+  ///
+  /// \sa FlipFreeSurfaceMapRefinement
+  mirtkPublicAttributeMacro(bool, FlipFreeRefinement);
+
+  /// Number of levels of coarse-to-fine initialization of iterative solver
+  ///
+  /// When greater than one and an iterative solver is used, the surface mesh
+  /// is decimated, keeping its boundary points, and the map of the coarser
+  /// surface is computed first. Its values interpolated at the closest points
+  /// on the coarser surface are the initial guess of the iterative solver.
+  /// This is applied recursively to obtain the initial guess at the coarser
+  /// level. Direct solvers ignore this setting.
+  mirtkPublicAttributeMacro(int, NumberOfLevels);
+
+  /// Fraction of surface points removed at each coarser level
+  mirtkPublicAttributeMacro(double, LevelReduction);
+
+  /// Whether to renumber the free points by reverse Cuthill-McKee ordering
+  ///
+  /// The renumbering reduces the bandwidth of the sparse system matrix and
+  /// only changes the order of the unknowns, not the point IDs of the surface.
+  mirtkPublicAttributeMacro(bool, ReorderPoints);
+
   /// Index of point in set of points with free (i >= 0) or fixed (i < 0) values
   mirtkAttributeMacro(Array<int>, PointIndex);
 
@@ -75,9 +118,49 @@ class LinearFixedBoundarySurfaceMapper : public FixedBoundarySurfaceMapper
   /// Computed map values at surface points
   mirtkAttributeMacro(vtkSmartPointer<vtkDataArray>, Values);
 
+  /// Offsets into CouplingIndex and CouplingWeight of the fixed points
+  /// contributing to the right-hand side of the equation of each free point
+  ///
+  /// The right-hand side of the r-th equation is the sum of CouplingWeight[k]
+  /// times the value of FixedPointId(CouplingIndex[k]) for all k in
+  /// [CouplingOffset[r], CouplingOffset[r+1]). These coefficients are set by
+  /// the ComputeMap function of subclasses which support RunWithFixedValues.
+  mirtkAttributeMacro(Array<int>, CouplingOffset);
+
+  /// Indices of fixed points contributing to right-hand side of linear system
+  mirtkAttributeMacro(Array<int>, CouplingIndex);
+
+  /// Coefficients of fixed point values in right-hand side of linear system
+  mirtkAttributeMacro(Array<double>, CouplingWeight);
+
+  /// Factorization of system matrix of last direct solve
+  ///
+  /// The symbolic analysis of the system matrix is reused by subsequent solves
+  /// of linear systems with the same sparsity pattern, e.g., when the map is
+  /// recomputed with different edge weights. It is not copied from other
+  /// instances, which would otherwise share a non-thread-safe solver object.
+  mirtkAttributeMacro(SharedPtr<SparseFactorization>, Factorization);
+
+  /// Reusable buffers of the assembly and solve of the linear system
+  ///
+  /// A workspace is created by the first ComputeMap when none is set and kept
+  /// for subsequent runs of this mapper, such that its buffers are reused.
+  /// A workspace may also be shared by mappers that never run concurrently.
+  /// It is not copied from other instances.
+  mirtkPublicAttributeMacro(SharedPtr<MapperWorkspace>, Workspace);
+
+  /// Reduced basis of fixed point values and free point response of the linear operator
+  ///
+  /// Each component of the map values is a separate boundary function, whose
+  /// values are ordered by fixed point index.
+  mirtkReadOnlyAttributeMacro(SharedPtr<ReducedBoundaryBasis>, BoundaryBasis);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const LinearFixedBoundarySurfaceMapper &);
 
+  /// Get workspace, which is created when none is set yet
+  MapperWorkspace &GetWorkspace();
+
   // ---------------------------------------------------------------------------
   // Construction/Destruction
 
@@ -100,6 +183,74 @@ public:
   // ---------------------------------------------------------------------------
   // Execution
 
+  // Import other overloads
+  using FixedBoundarySurfaceMapper::Run;
+
+  /// Compute map of surface with the topology of the input surface
+  ///
+  /// After Run was called for a template surface, this function computes the
+  /// map of another surface with identical connectivity, e.g., a subject
+  /// surface resampled to the template topology, which only differs in the
+  /// positions of its points. The edge table, surface boundary, sets of free
+  /// and fixed points, fixed map values, and the symbolic factorization of the
+  /// sparse system matrix are reused. Only the numeric factorization is
+  /// recomputed. The previous map values serve as initial guess of an
+  /// iterative solver. The Surface and Output are replaced by those of the
+  /// new surface, which is therefore the template of the next call.
+  ///
+  /// \param[in] points Points of surface with template topology.
+  void Run(vtkPoints *points);
+
+  /// Recompute map of the same surface given new values at the fixed points
+  ///
+  /// After Run was called, this function recomputes the map when only the
+  /// values of the fixed points changed, e.g., for a different boundary map
+  /// with the same fixed points. The system matrix and its factorization are
+  /// reused, such that only the right-hand side is rebuilt and the linear
+  /// system solved by forward and backward substitution, or by an iterative
+  /// solver starting at the previous map. The Output is replaced by the new map.
+  ///
+  /// \param[in] values New map values at the surface points, where only the
+  ///                   values of the fixed points are used.
+  void RunWithFixedValues(vtkDataArray *values);
+
+  /// Precompute free point response of a reduced basis of fixed point values
+  ///
+  /// After Run was called, this function computes the mean and principal modes
+  /// of the fixed point values of the given maps and solves the linear system
+  /// once for each of these boundary functions. The map of many other fixed
+  /// point values of the same surface is then evaluated by RunWithBoundaryBasis
+  /// or EvaluateBoundaryBasis as a dense linear combination of these solutions,
+  /// which is exact for mappers whose edge weights are independent of the map,
+  /// e.g., HarmonicSurfaceMapper, and fixed values in the span of the basis.
+  ///
+  /// \param[in] maps      Sample map values at the surface points, where only
+  ///                      the values of the fixed points are used.
+  /// \param[in] max_modes Maximum number of principal modes. When non-positive,
+  ///                      the number of modes is limited only by \p energy.
+  /// \param[in] energy    Minimum fraction of the variance of the sample
+  ///                      fixed point values explained by the principal modes.
+  void PrecomputeBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &maps,
+                               int max_modes = 0, double energy = 1.0);
+
+  /// Approximate map of the same surface given new values at the fixed points
+  /// using the precomputed reduced basis, replacing the Output map
+  ///
+  /// \param[in] values New map values at the surface points, where only the
+  ///                   values of the fixed points are used.
+  void RunWithBoundaryBasis(vtkDataArray *values);
+
+  /// Approximate maps of the same surface for many fixed point values at once
+  ///
+  /// \param[in]  values Map values at the surface points, one array per case,
+  ///                    where only the values of the fixed points are used.
+  /// \param[out] maps   Map values at all surface points.
+  /// \param[out] error  Maximum residual norm of the projection of the fixed
+  ///                    values onto the basis relative to their norm.
+  void EvaluateBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &values,
+                             Array<vtkSmartPointer<vtkDataArray> >       &maps,
+                             double *error = nullptr) const;
+
   /// Initialize filter after input and parameters are set
   virtual void Initialize();
 
@@ -109,6 +260,26 @@ public:
   /// Assemble output surface map
   virtual void Finalize();
 
+protected:
+
+  /// Initialize map values at free points by the map of a decimated surface
+  ///
+  /// \returns Whether a coarser surface map was computed.
+  bool InitializeValuesFromCoarseLevel();
+
+  /// Renumber free points to reduce bandwidth of sparse system matrix
+  void ReorderFreePoints();
+
+  /// Set coefficients of fixed point values in right-hand side of linear system
+  ///
+  /// \param[in] rows    Indices of free points.
+  /// \param[in] cols    Indices of fixed points.
+  /// \param[in] weights Coefficients of fixed point values.
+  void SetCoupling(const Array<int> &rows, const Array<int> &cols, const Array<double> &weights);
+
+  /// Check that map was computed and values are given for all surface points
+  void CheckFixedValues(vtkDataArray *values, const char *func) const;
+
   // ---------------------------------------------------------------------------
   // Auxiliaries
 
@@ -178,6 +349,25 @@ public:
   /// \return The j-th component of the map value evaluated at the i-th fixed point.
   double GetFixedValue(int i, int j = 0) const;
 
+  /// Number of non-zero entries of sparse system matrix
+  ///
+  /// The sparsity pattern of the system matrix is given by the adjacency of
+  /// the free points in the edge table, including the diagonal entries.
+  int NumberOfNonZeros() const;
+
+  /// Get sparsity pattern of system matrix in compressed column storage
+  ///
+  /// This function is used to allocate the compressed arrays of the sparse
+  /// system matrix once and to then write the coefficients in place instead
+  /// of assembling a list of (row, column, value) triplets. Because the
+  /// adjacency is symmetric, the pattern is also the compressed row storage.
+  ///
+  /// \param[out] outer Offset of first entry of each column, array of size
+  ///                   NumberOfFreePoints() + 1.
+  /// \param[out] inner Row indices of non-zero entries in increasing order
+  ///                   within each column, array of size NumberOfNonZeros().
+  void GetSparsityPattern(int *outer, int *inner) const;
+
 protected:
 
   /// Set scalar map value at surface vertex
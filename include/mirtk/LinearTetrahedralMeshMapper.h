@@ -23,6 +23,8 @@
 #include "mirtk/TetrahedralMeshMapper.h"
 
 #include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/SparseSolverType.h"
 
 
 namespace mirtk {
@@ -30,6 +32,10 @@ namespace mirtk {
 
 // Forward declarations
 class Matrix3x3;
+class SparseFactorization;
+class BlockSparseMatrix3;
+class BlockSchwarzPreconditioner;
+class ReducedBoundaryBasis;
 
 
 /**
@@ -48,6 +54,29 @@ class LinearTetrahedralMeshMapper : public TetrahedralMeshMapper
   // ---------------------------------------------------------------------------
   // Attributes
 
+  /// Sparse linear solver
+  ///
+  /// The system matrix is symmetric positive definite. Iterative solvers use
+  /// the current volumetric map as initial guess. The default conjugate
+  /// gradient method operates on a 3x3 block sparse matrix with block Jacobi
+  /// preconditioner, unless MixedPrecision is enabled. It needs an increasing
+  /// number of iterations as the mesh is refined, whereas the number of
+  /// iterations of the AMG solver stays nearly constant.
+  ///
+  /// Direct solvers, in particular the multi-threaded supernodal Cholesky
+  /// factorization of CHOLMOD or PARDISO when available, avoid the slow
+  /// convergence of CG for badly shaped tetrahedra. Their Factorization is
+  /// cached such that the fill-reducing ordering and symbolic analysis are
+  /// reused by subsequent solves with the same sparsity pattern, e.g., the
+  /// iterations of AsConformalAsPossibleMapper, and RunWithBoundaryValues
+  /// only performs the forward and backward substitution.
+  mirtkPublicAttributeMacro(SparseSolverType, Solver);
+
+  /// Whether to solve in single precision with double precision refinement
+  ///
+  /// \sa SparseFactorization
+  mirtkPublicAttributeMacro(bool, MixedPrecision);
+
   /// Maximum number of linear solver iterations
   mirtkPublicAttributeMacro(int, NumberOfIterations);
 
@@ -57,12 +86,84 @@ class LinearTetrahedralMeshMapper : public TetrahedralMeshMapper
   /// Relaxation factor
   mirtkPublicAttributeMacro(double, RelaxationFactor);
 
+  /// Number of levels of coarse-to-fine initialization of iterative solver
+  ///
+  /// When greater than one and an iterative solver is used, the boundary
+  /// surface of the volume is decimated and the volumetric map of the
+  /// tetrahedralization of this coarser surface is computed first. Its values
+  /// interpolated at the interior points are the initial guess of the solver.
+  /// This is applied recursively to obtain the initial map at the coarser level.
+  mirtkPublicAttributeMacro(int, NumberOfLevels);
+
+  /// Fraction of boundary surface points removed at each coarser level
+  mirtkPublicAttributeMacro(double, LevelReduction);
+
+  /// Whether to renumber the interior points by reverse Cuthill-McKee ordering
+  ///
+  /// The order of the interior points output by the tetrahedralization is
+  /// nearly random, which scatters the coefficients of the linear system in
+  /// memory. The renumbering only changes the order of the unknowns of the
+  /// linear system, not the point IDs of the volume mesh.
+  mirtkPublicAttributeMacro(bool, ReorderPoints);
+
+  /// Number of subdomains of the additive Schwarz preconditioner of the block CG solver
+  ///
+  /// When greater than one, the interior points are split into this number of
+  /// contiguous subdomains in the order of the unknowns, which are compact when
+  /// ReorderPoints is enabled. The diagonal submatrix of each subdomain is
+  /// factorized once per system matrix and the subdomain systems are solved in
+  /// parallel in each iteration. Otherwise, the 3x3 block Jacobi preconditioner
+  /// is used.
+  mirtkPublicAttributeMacro(int, NumberOfSubdomains);
+
   /// Original ID of n-th interior point
   mirtkReadOnlyAttributeMacro(Array<int>, InteriorPointId);
 
   /// Variable/linear equation offset of n-th interior point
   mirtkReadOnlyAttributeMacro(Array<int>, InteriorPointPos);
 
+  /// Offsets into NeighborIndex of the interior points adjacent to each interior point
+  mirtkAttributeMacro(Array<int>, NeighborOffset);
+
+  /// Sorted indices of interior points which share a tetrahedron with an interior
+  /// point, including the point itself, i.e., the block sparsity pattern of the
+  /// symmetric linear system with 3x3 blocks of coefficients
+  mirtkAttributeMacro(Array<int>, NeighborIndex);
+
+  /// Offsets into ColoredCells of the tetrahedra of each color
+  mirtkAttributeMacro(Array<int>, ColorOffset);
+
+  /// IDs of tetrahedra with at least one interior point grouped by color,
+  /// where no two tetrahedra of the same color share an interior point
+  ///
+  /// The coefficients of tetrahedra of the same color are added to the
+  /// linear system in parallel. The tetrahedra of the last color, if not
+  /// the only one, are those for which the greedy coloring ran out of
+  /// colors and are added sequentially.
+  mirtkAttributeMacro(Array<int>, ColoredCells);
+
+  /// Factorization or preconditioner of last linear system, which is reused
+  /// by subsequent solves of systems with identical sparsity pattern
+  ///
+  /// This attribute is not copied from other instances.
+  mirtkAttributeMacro(SharedPtr<SparseFactorization>, Factorization);
+
+  /// Block sparse system matrix of last solve using the block CG solver
+  ///
+  /// This attribute is not copied from other instances.
+  mirtkAttributeMacro(SharedPtr<BlockSparseMatrix3>, BlockMatrix);
+
+  /// Additive Schwarz preconditioner of BlockMatrix, if any
+  ///
+  /// This attribute is not copied from other instances.
+  mirtkAttributeMacro(SharedPtr<BlockSchwarzPreconditioner>, BlockPreconditioner);
+
+  /// Reduced basis of boundary maps and interior response of the linear operator
+  ///
+  /// The boundary values are ordered by increasing volume point ID, with the
+  /// three coordinates of each boundary point stored consecutively.
+  mirtkReadOnlyAttributeMacro(SharedPtr<ReducedBoundaryBasis>, BoundaryBasis);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const LinearTetrahedralMeshMapper &);
 
@@ -88,17 +189,102 @@ public:
   // ---------------------------------------------------------------------------
   // Execution
 
+  /// Recompute map of the same volume given new values at the boundary points
+  ///
+  /// After Run was called, this function recomputes the volumetric map when
+  /// only the boundary map changed. The volume mesh, the system matrix, and its
+  /// factorization or preconditioner are reused, such that only the right-hand
+  /// side of the linear system is rebuilt and the system is solved again, where
+  /// an iterative solver starts with the previous map. Mappers whose operator
+  /// depends on the map, i.e., AsConformalAsPossibleMapper, keep the operator
+  /// of the last linear solve. The Output is replaced by the new map.
+  ///
+  /// \param[in] values New map values at either the points of the volume mesh
+  ///                   or the points of the input point set, where only the
+  ///                   values of the boundary points are used.
+  void RunWithBoundaryValues(vtkDataArray *values);
+
+  /// Precompute interior response of a reduced basis of boundary maps
+  ///
+  /// After Run was called, this function computes the mean and principal modes
+  /// of the given boundary maps and solves the linear system once for each of
+  /// these boundary functions. The map of many other boundary maps of the same
+  /// volume is then evaluated by RunWithBoundaryBasis or EvaluateBoundaryBasis
+  /// as a dense linear combination of these solutions, which is exact for
+  /// mappers with a map-independent linear operator, e.g.,
+  /// HarmonicTetrahedralMeshMapper, and boundary maps in the span of the basis.
+  ///
+  /// \param[in] maps      Sample boundary maps given at either the points of
+  ///                      the volume mesh or the points of the input point set.
+  /// \param[in] max_modes Maximum number of principal modes. When non-positive,
+  ///                      the number of modes is limited only by \p energy.
+  /// \param[in] energy    Minimum fraction of the variance of the sample
+  ///                      boundary maps explained by the principal modes.
+  void PrecomputeBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &maps,
+                               int max_modes = 0, double energy = 1.0);
+
+  /// Approximate map of the same volume given new boundary values using the
+  /// precomputed reduced basis, replacing the Output map
+  ///
+  /// \param[in] values New map values at either the points of the volume mesh
+  ///                   or the points of the input point set.
+  void RunWithBoundaryBasis(vtkDataArray *values);
+
+  /// Approximate maps of the same volume for many boundary maps at once
+  ///
+  /// \param[in]  values Map values at either the points of the volume mesh or
+  ///                    the points of the input point set, one array per case.
+  /// \param[out] coords Map values at the points of the volume mesh.
+  /// \param[out] error  Maximum residual norm of the projection of the boundary
+  ///                    values onto the basis relative to their norm.
+  void EvaluateBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &values,
+                             Array<vtkSmartPointer<vtkDataArray> >       &coords,
+                             double *error = nullptr) const;
+
 protected:
 
   /// Initialize filter after input and parameters are set
   virtual void Initialize();
 
+  /// Initialize map values at interior points by the map of a coarser volume
+  ///
+  /// \returns Whether a coarser volumetric map was computed.
+  bool InitializeCoordsFromCoarseLevel();
+
+  /// Pre-compute block sparsity pattern of linear system and coloring of tetrahedra
+  void InitializeSparsityPattern();
+
+  /// Renumber interior points to reduce bandwidth of block sparsity pattern
+  void ReorderInteriorPoints();
+
   /// Parameterize interior points
   virtual void Solve();
 
   /// Solve linear system with operator weights computed using the passed object
   void Solve(const LinearTetrahedralMeshMapper *);
 
+  /// Solve linear system of last Solve with right-hand side of current boundary map
+  void Resolve();
+
+  /// Solve linear system with BlockMatrix using preconditioned conjugate gradients
+  ///
+  /// \param[in]     b        Right-hand side vector.
+  /// \param[in,out] x        Initial guess and solution vector.
+  /// \param[out]    niter    Number of iterations.
+  /// \param[out]    error    Relative residual norm of solution.
+  /// \param[in]     observer Observer notified after each iteration.
+  bool SolveBlockSystem(const double *b, double *x, int *niter = nullptr,
+                        double *error = nullptr, MapperObserver *observer = nullptr) const;
+
+  /// Refine tetrahedra with large deformation gradient of current map
+  virtual bool Refine();
+
+  /// Check that map was computed and values are given for all boundary points
+  void CheckBoundaryValues(vtkDataArray *values, const char *func) const;
+
+  /// Get values of boundary points ordered by increasing volume point ID
+  void GetBoundaryValues(vtkDataArray *values, double *g) const;
+
   // ---------------------------------------------------------------------------
   // Auxiliary functions
 
@@ -0,0 +1,197 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MapperObserver_H
+#define MIRTK_MapperObserver_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/String.h"
+
+#include <atomic>
+#include <chrono>
+
+
+namespace mirtk {
+
+
+// -----------------------------------------------------------------------------
+/// Enumeration of mapper run outcomes
+enum MapperStatus
+{
+  MapperStatus_Completed, ///< Run completed with all iterations or until convergence
+  MapperStatus_Stopped,   ///< Observer stopped an iterative method early
+  MapperStatus_TimeLimit, ///< Wall-clock time limit exceeded, output is best iterate so far
+  MapperStatus_Cancelled  ///< Run cancelled, output is best iterate so far
+};
+
+// -----------------------------------------------------------------------------
+template <>
+inline string ToString(const MapperStatus &value, int w, char c, bool left)
+{
+  const char *str;
+  switch (value) {
+    case MapperStatus_Completed: str = "Completed"; break;
+    case MapperStatus_Stopped:   str = "Stopped";   break;
+    case MapperStatus_TimeLimit: str = "TimeLimit"; break;
+    case MapperStatus_Cancelled: str = "Cancelled"; break;
+    default:                     str = "Unknown";   break;
+  }
+  return ToString(str, w, c, left);
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline bool FromString(const char *str, MapperStatus &value)
+{
+  const string lstr = ToLower(str);
+  if      (lstr == "completed") value = MapperStatus_Completed;
+  else if (lstr == "stopped")   value = MapperStatus_Stopped;
+  else if (lstr == "timelimit") value = MapperStatus_TimeLimit;
+  else if (lstr == "cancelled") value = MapperStatus_Cancelled;
+  else return false;
+  return true;
+}
+
+
+/**
+ * Progress of an iterative method of a mapper at the end of an iteration
+ */
+struct MapperProgress
+{
+  const char *_Phase;       ///< Name of iterative method, i.e., "solve", "fit", or "local-global"
+  int         _Iteration;   ///< Number of completed iterations of this method
+  double      _Residual;    ///< Relative residual norm of linear solver, mean squared
+                            ///< boundary fitting error, or energy of the current iterate
+  double      _MinError;    ///< Minimum boundary fitting error, NaN if not applicable
+  double      _MaxError;    ///< Maximum boundary fitting error, NaN if not applicable
+  double      _StdError;    ///< Standard deviation of boundary fitting error, NaN if not applicable
+  double      _ElapsedTime; ///< Wall-clock time in seconds since the start of the mapper run
+
+  /// Constructor
+  MapperProgress(const char *phase = "", int iter = 0, double residual = .0);
+};
+
+/**
+ * Observer of the convergence of the iterative methods of a mapper
+ *
+ * An observer is notified at the end of each iteration of the conjugate
+ * gradient solver, of each boundary fitting iteration of the meshless volume
+ * mappers, and of each local/global iteration of the as-conformal-as-possible
+ * mapper. The mapper does not take ownership of its observer.
+ *
+ * When Iteration returns \c false, the iterative method stops and the current
+ * iterate is used as solution. An early stop of a linear solver thus continues
+ * the mapper run with a less accurate solution of the linear system.
+ *
+ * The observer also bounds the duration of a mapper run by a wall-clock time
+ * limit and can be cancelled by another thread. Both are checked whenever the
+ * observer is notified and by the parallel assembly loops via Continue. Once
+ * the limit is exceeded or the run was cancelled, all remaining iterations and
+ * assembly steps are skipped, and the mapper output is the best iterate reached
+ * so far, e.g., the initial guess when the linear system was not yet assembled.
+ * The mapper Status reports the reason. An observer with the default Iteration
+ * which always continues thus serves as time budget and cancellation token.
+ *
+ * The iterative methods whose implementation is provided by Eigen, i.e.,
+ * BiCGSTAB, AMG, and the mixed precision solvers, only report their number of
+ * iterations and estimated error after they finished.
+ */
+class MapperObserver : public Object
+{
+  mirtkObjectMacro(MapperObserver);
+
+  /// Wall-clock time limit of mapper run in seconds, unlimited when non-positive
+  mirtkPublicAttributeMacro(double, TimeLimit);
+
+  /// Start time of observed mapper run
+  std::chrono::steady_clock::time_point _StartTime;
+
+  /// Whether the run was cancelled
+  std::atomic<bool> _Cancelled;
+
+  /// Outcome of current run
+  std::atomic<int> _Status;
+
+  /// Copy constructor
+  /// \note Intentionally not implemented.
+  MapperObserver(const MapperObserver &);
+
+  /// Assignment operator
+  /// \note Intentionally not implemented.
+  MapperObserver &operator =(const MapperObserver &);
+
+public:
+
+  /// Constructor
+  MapperObserver();
+
+  /// Destructor
+  virtual ~MapperObserver();
+
+  /// Reset start time of elapsed time measurement and status of run,
+  /// called by the mapper Run
+  void Start();
+
+  /// Wall-clock time in seconds since Start
+  double ElapsedTime() const;
+
+  /// Cancel current and all subsequent mapper runs observed by this object,
+  /// can be called by any thread
+  void Cancel();
+
+  /// Whether the run was cancelled
+  bool IsCancelled() const;
+
+  /// Outcome of current or last run
+  MapperStatus Status() const;
+
+  /// Set outcome of run, where a time limit or cancellation takes precedence
+  /// over an early stop of an iterative method and is not overwritten
+  void Stop(MapperStatus);
+
+  /// Whether the run should continue, i.e., it was not cancelled and the
+  /// time limit was not exceeded
+  ///
+  /// This function is thread-safe and cheap enough to be called by each
+  /// block of a parallel loop.
+  bool Continue();
+
+  /// Set elapsed time of progress report and pass it on to Iteration
+  /// if the run should otherwise continue
+  ///
+  /// \returns Whether to continue the iterative method.
+  bool Notify(MapperProgress progress);
+
+  /// Report progress of solver iteration
+  ///
+  /// \returns Whether to continue the iterative method.
+  bool Notify(const char *phase, int iter, double residual);
+
+  /// Called at the end of each iteration
+  ///
+  /// \returns Whether to continue the iterative method, always \c true by default.
+  virtual bool Iteration(const MapperProgress &);
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MapperObserver_H
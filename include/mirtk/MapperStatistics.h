@@ -0,0 +1,181 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MapperStatistics_H
+#define MIRTK_MapperStatistics_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/Array.h"
+#include "mirtk/MapperObserver.h"
+
+#include <chrono>
+#include <ctime>
+
+
+namespace mirtk {
+
+
+/**
+ * Execution statistics of a boundary, surface, or volume mapper
+ *
+ * The mappers clear these statistics at the start of Run and record the
+ * wall-clock and CPU time of the "initialize", "compute", and "finalize"
+ * phases and of the entire "run". Mappers which solve a sparse linear system
+ * additionally record the time of the "assembly" of the system matrix, the
+ * "factorization" of this matrix by a direct solver or the setup of the
+ * preconditioner of an iterative solver, and the "solve" itself, together
+ * with the size of the linear system, the number of iterations, and the
+ * final residual. The CPU time is the processor time of all threads of the
+ * process and can therefore exceed the wall-clock time of parallel phases.
+ */
+class MapperStatistics : public Object
+{
+  mirtkObjectMacro(MapperStatistics);
+
+public:
+
+  /// Accumulated execution time of a mapper phase
+  struct Phase
+  {
+    string _Name;     ///< Name of phase
+    double _WallTime; ///< Wall-clock time in seconds
+    double _CPUTime;  ///< CPU time of all threads in seconds
+    int    _Count;    ///< Number of times the phase was executed
+  };
+
+  /// Measures the execution time of a mapper phase from construction until
+  /// the timer is stopped or destroyed, whichever occurs first
+  class Timer
+  {
+    MapperStatistics                     *_Statistics;
+    const char                           *_Name;
+    std::chrono::steady_clock::time_point _Wall;
+    clock_t                               _CPU;
+
+  public:
+
+    /// Start timer of named phase, where \p stats may be \c nullptr
+    Timer(MapperStatistics *stats, const char *name);
+
+    /// Stop timer if not stopped before
+    ~Timer();
+
+    /// Add elapsed time to statistics of phase
+    void Stop();
+  };
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Name of mapper class
+  mirtkPublicAttributeMacro(string, Mapper);
+
+  /// Outcome of mapper run
+  mirtkPublicAttributeMacro(MapperStatus, Status);
+
+  /// Execution time of each phase in order of first execution
+  mirtkReadOnlyAttributeMacro(Array<Phase>, Phases);
+
+  /// Name of sparse linear solver used, if any
+  mirtkPublicAttributeMacro(string, Solver);
+
+  /// Number of unknowns of linear system, i.e., number of rows of system matrix
+  mirtkPublicAttributeMacro(int64_t, NumberOfUnknowns);
+
+  /// Number of non-zero entries of sparse system matrix
+  mirtkPublicAttributeMacro(int64_t, NumberOfNonZeros);
+
+  /// Number of iterations of iterative method
+  mirtkPublicAttributeMacro(int, NumberOfIterations);
+
+  /// Final residual or estimated relative error of iterative method,
+  /// NaN if not applicable
+  mirtkPublicAttributeMacro(double, Residual);
+
+  /// Peak resident memory of the process in bytes when last updated,
+  /// zero if not available on this platform
+  mirtkReadOnlyAttributeMacro(int64_t, PeakMemory);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MapperStatistics &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  MapperStatistics();
+
+  /// Copy constructor
+  MapperStatistics(const MapperStatistics &);
+
+  /// Assignment operator
+  MapperStatistics &operator =(const MapperStatistics &);
+
+  /// Destructor
+  virtual ~MapperStatistics();
+
+  /// Reset all statistics
+  void Clear();
+
+  // ---------------------------------------------------------------------------
+  // Statistics
+
+  /// Add execution time of named phase
+  void AddTime(const char *name, double wall, double cpu);
+
+  /// Record size and convergence of solved sparse linear system, where the
+  /// number of iterations is added to the iterations of previous solves
+  void AddLinearSolve(const string &solver, int64_t unknowns, int64_t nnz,
+                      int niter, double residual);
+
+  /// Get statistics of named phase, \c nullptr if phase was not executed
+  const Phase *FindPhase(const char *name) const;
+
+  /// Wall-clock time of named phase in seconds, zero if not executed
+  double WallTime(const char *name) const;
+
+  /// CPU time of named phase in seconds, zero if not executed
+  double CPUTime(const char *name) const;
+
+  /// Update peak memory of process
+  void UpdatePeakMemory();
+
+  // ---------------------------------------------------------------------------
+  // Output
+
+  /// Print statistics as JSON object
+  ///
+  /// \param[in] os     Output stream.
+  /// \param[in] indent Number of spaces by which each line is indented.
+  void Print(ostream &os, int indent = 0) const;
+
+  /// Write statistics as JSON object to file
+  ///
+  /// \returns Whether the file was written successfully.
+  bool Write(const char *fname) const;
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MapperStatistics_H
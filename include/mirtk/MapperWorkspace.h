@@ -0,0 +1,88 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MapperWorkspace_H
+#define MIRTK_MapperWorkspace_H
+
+#include "mirtk/Array.h"
+
+#include "Eigen/SparseCore"
+
+#include <cstddef>
+
+
+namespace mirtk {
+
+
+/**
+ * Reusable buffers of the linear system assembly and solve of a mapper
+ *
+ * The buffers are resized, but not freed, by each solve, such that they keep
+ * their capacity for the next solve. When the same workspace is used by the
+ * repeated runs of a mapper, e.g., for the subjects of a batch, or by the
+ * successive solves within one run, the assembly of linear systems of similar
+ * size makes almost no large memory allocations.
+ *
+ * A workspace must not be used by more than one mapper at a time.
+ */
+class MapperWorkspace
+{
+public:
+
+  /// Sparse system matrix
+  Eigen::SparseMatrix<double> _Matrix;
+
+  /// Right-hand side of linear system with one column per map component
+  Eigen::MatrixXd _RightHandSide;
+
+  /// Solution of linear system with one column per map component
+  Eigen::MatrixXd _Solution;
+
+  /// Offsets into the weights of each row
+  Array<int> _Offset;
+
+  /// Pairs of point IDs of edges
+  Array<int> _Edges;
+
+  /// Edge weights
+  Array<double> _Weights;
+
+  /// Diagonal coefficients of system matrix
+  Array<double> _Diagonal;
+
+  /// Rows of the fixed point coefficients of the right-hand side
+  Array<int> _CouplingRows;
+
+  /// Fixed point indices of the coefficients of the right-hand side
+  Array<int> _CouplingCols;
+
+  /// Fixed point coefficients of the right-hand side
+  Array<double> _CouplingWeights;
+
+  /// Free all buffers
+  void Clear();
+
+  /// Number of bytes allocated by the buffers
+  size_t MemorySize() const;
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MapperWorkspace_H
@@ -22,12 +22,15 @@
 
 #include "mirtk/Object.h"
 
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
 #include "mirtk/Point.h"
 #include "mirtk/Cfstream.h"
 #include "mirtk/ImageAttributes.h"
 
 #include "vtkSmartPointer.h"
 #include "vtkPointSet.h"
+#include "vtkGenericCell.h"
 
 
 namespace mirtk {
@@ -59,6 +62,28 @@ class Mapping : public Object
 {
   mirtkAbstractMacro(Mapping);
 
+public:
+
+  /// Scratch memory reused by subsequent evaluations of a map
+  ///
+  /// An evaluation context must only be used by one thread at a time and
+  /// should be passed to the evaluation functions of a single map only. Each
+  /// map type lazily allocates the scratch memory it needs upon first use
+  /// such that subsequent evaluations require no heap allocations.
+  struct EvaluationContext
+  {
+    vtkSmartPointer<vtkGenericCell> _Cell;    ///< Scratch cell used to locate points
+    vtkIdType                       _CellId;  ///< ID of cell containing previous point
+    Array<vtkIdType>                _PtIds;   ///< IDs of points of this cell
+    Array<double>                   _Weights; ///< Interpolation weights of cell points
+    Array<double>                   _Values;  ///< Buffer of map values
+
+    /// Evaluation contexts of the maps of a composite map
+    Array<SharedPtr<EvaluationContext> > _Nested;
+
+    EvaluationContext() : _CellId(-1) {}
+  };
+
   // ---------------------------------------------------------------------------
   // Attributes
 
@@ -87,6 +112,17 @@ public:
   /// Read mapping from file
   static Mapping *New(const char *);
 
+  /// Create new map of the named type which is stored with a type header
+  ///
+  /// \returns New default constructed map or \c nullptr if the type is unknown.
+  static Mapping *NewOfType(const char *);
+
+  /// Whether the leading bytes of a file identify the type of a map
+  ///
+  /// Only the type header of the file or the format of a piecewise linear map
+  /// is checked. This does not read the map data, which may still be corrupt.
+  static bool IsMapFile(const char *);
+
   /// Destructor
   virtual ~Mapping();
 
@@ -96,6 +132,13 @@ public:
   /// Make deep copy of this map
   virtual Mapping *NewCopy() const = 0;
 
+  /// Reduce memory held by this map by converting its discretization to
+  /// a compact storage type, e.g., single instead of double precision
+  ///
+  /// Maps which have no such representation are unmodified. The map must be
+  /// initialized again after it was compacted before it can be evaluated.
+  virtual void Compact();
+
   // ---------------------------------------------------------------------------
   // Map domain
 
@@ -134,6 +177,22 @@ public:
   /// \param[out] p2 Upper-right-back corner of input domain bounding box.
   void BoundingBox(Point &p1, Point &p2) const;
 
+  /// Mark bricks of a regular lattice which intersect the map domain
+  ///
+  /// The lattice is partitioned into bricks of \p n x \p n x \p n points,
+  /// where the bricks at the upper lattice boundary may be smaller. The flag
+  /// of brick (bi, bj, bk) is stored at index bi + nbx * (bj + nby * bk), where
+  /// nbx and nby are the number of bricks along the x and y axes. The map is
+  /// only evaluated at lattice points inside marked bricks, all other lattice
+  /// points are assigned the \c OutsideValue. A brick must therefore be marked
+  /// when the map value at any of its lattice points may differ from the
+  /// \c OutsideValue. The default implementation marks all bricks.
+  ///
+  /// \param[in]  lattice  Regular lattice.
+  /// \param[in]  n        Number of lattice points along each side of a brick.
+  /// \param[out] occupied Flag of each brick whether it intersects the map domain.
+  virtual void MarkDomainBricks(const ImageAttributes &lattice, int n, Array<bool> &occupied) const;
+
   /// Get regular lattice attributes of map domain
   ///
   /// \param[in] nx Number of lattice points along x axis.
@@ -157,6 +216,14 @@ public:
   /// Dimension of codomain, i.e., number of output values
   virtual int NumberOfComponents() const = 0;
 
+  /// Whether the map is given by a closed-form expression
+  ///
+  /// Analytic maps are cheap to evaluate at a single point and need no set
+  /// up per batch of points. A CompositeMapping therefore evaluates a chain
+  /// of consecutive analytic maps point by point in one loop instead of
+  /// calling the batched Evaluate function of each map.
+  virtual bool IsAnalytic() const;
+
   /// Evaluate map at a given point
   ///
   /// \param[out] v Map value.
@@ -212,6 +279,92 @@ public:
   ///          or the \c OutsideValue when input point is outside the map domain.
   double Evaluate(const Point &, int l = 0) const;
 
+  /// Evaluate range of map value components at a given point
+  ///
+  /// The default implementation evaluates all components and copies the
+  /// requested ones. Subclasses override this function to only compute the
+  /// components in the range [l1, l2).
+  ///
+  /// \param[out] v  Map value components l1 to l2-1.
+  /// \param[in]  x  Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y  Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z  Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]  l1 Index of first map value component.
+  /// \param[in]  l2 Index one past last map value component.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z, int l1, int l2) const;
+
+  /// Evaluate map at a given point using reusable scratch memory
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    v   Map value.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(EvaluationContext &ctx, double *v,
+                        double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point using reusable scratch memory
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]     l   Index of map value component.
+  ///
+  /// \returns The l-th component of the map value evaluated at the given point
+  ///          or the \c OutsideValue when input point is outside the map domain.
+  virtual double Evaluate(EvaluationContext &ctx, double x, double y, double z = 0, int l = 0) const;
+
+  /// Evaluate range of map value components using reusable scratch memory
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    v   Map value components l1 to l2-1.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]     l1  Index of first map value component.
+  /// \param[in]     l2  Index one past last map value component.
+  ///
+  /// \returns Whether input point is inside map domain.
+  ///
+  /// \sa Evaluate(double *, double, double, double, int, int)
+  virtual bool Evaluate(EvaluationContext &ctx, double *v,
+                        double x, double y, double z, int l1, int l2) const;
+
+  /// Evaluate map at multiple points
+  ///
+  /// The default implementation evaluates the map at each point in parallel.
+  /// Subclasses override this function to amortize the set up costs of the
+  /// single point evaluation over a block of points.
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point. Points outside the map domain are
+  ///                    assigned the \c OutsideValue.
+  /// \param[out] inside Whether each input point is inside map domain.
+  ///                    Can be \c nullptr when not needed.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at the points of a mesh
+  ///
+  /// Unlike Evaluate(int, const double *, double *, bool *), subclasses may
+  /// use the connectivity of the mesh cells to order the point evaluations.
+  /// The default implementation evaluates the map at all mesh points at once.
+  ///
+  /// \param[in]  mesh   Point set at whose points to evaluate the map.
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point. Points outside the map domain are
+  ///                    assigned the \c OutsideValue.
+  /// \param[out] inside Whether each point is inside map domain.
+  ///                    Can be \c nullptr when not needed.
+  virtual void Resample(vtkPointSet *mesh, double *values, bool *inside = nullptr) const;
+
   /// Evaluate map at each point of a regular lattice
   ///
   /// \param[out] f Defines lattice on which to evaluate the map. The map value
@@ -221,6 +374,13 @@ public:
   /// \param[in]  l Index of first map value component to store in output image.
   /// \param[in]  m Piecewise linear complex (PLC) defining an arbitrary subset
   ///               of the lattice points at which to evaluate the map.
+  ///
+  /// The lattice is processed in bricks of 8 x 8 x 8 points, which are
+  /// distributed among threads in Morton (Z-)order. Bricks which are not
+  /// marked by MarkDomainBricks are assigned the \c OutsideValue without
+  /// evaluating the map, and lattice points outside the PLC are set to NaN.
+  ///
+  /// \sa MarkDomainBricks
   virtual void Evaluate(GenericImage<float> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
 
   /// Evaluate map at each point of a regular lattice
@@ -234,6 +394,69 @@ public:
   ///               of the lattice points at which to evaluate the map.
   virtual void Evaluate(GenericImage<double> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
 
+  /// Evaluate map at each point of a regular lattice and write values to file
+  ///
+  /// Unlike Evaluate(GenericImage<float> &, int, vtkSmartPointer<vtkPointSet>),
+  /// the map is evaluated for one slab of consecutive lattice slices at a time,
+  /// and each slab is written to the output file before the next slab is
+  /// evaluated. The peak memory is therefore independent of the number of
+  /// lattice slices. The output file is an uncompressed NIfTI-1 image with
+  /// single precision floating point voxels, whose sform is set to the
+  /// image to world matrix of the lattice.
+  ///
+  /// \param[in] fname   Name of output image file with extension ".nii".
+  /// \param[in] lattice Lattice on which to evaluate the map, where the number
+  ///                    of map values stored at each voxel is determined by
+  ///                    the temporal dimension of the lattice.
+  /// \param[in] l       Index of first map value component to store in output image.
+  /// \param[in] m       Piecewise linear complex (PLC) defining an arbitrary subset
+  ///                    of the lattice points at which to evaluate the map.
+  /// \param[in] nz      Number of lattice slices per slab. When non-positive,
+  ///                    slabs of about 2^24 voxel values are evaluated at once.
+  ///
+  /// \returns Whether the output file was written successfully. No file is
+  ///          written when a lattice dimension or the number of map values
+  ///          exceeds 32767, the maximum size of a NIfTI-1 image dimension.
+  bool Evaluate(const char *fname, const ImageAttributes &lattice, int l = 0,
+                vtkSmartPointer<vtkPointSet> m = nullptr, int nz = 0) const;
+
+  /// Evaluate Jacobian of map at a given point
+  ///
+  /// The default implementation approximates the partial derivatives by
+  /// central differences of the map values, or one-sided differences when
+  /// a neighboring point is outside the map domain. Subclasses override
+  /// this function to evaluate the derivatives of the map exactly.
+  ///
+  /// \param[out] jac Jacobian matrix stored row by row with three partial
+  ///                 derivatives per map component, i.e., jac[3 * l + a] is
+  ///                 the derivative of the l-th component along axis a.
+  /// \param[in]  x   Coordinate of point along x axis at which to evaluate Jacobian.
+  /// \param[in]  y   Coordinate of point along y axis at which to evaluate Jacobian.
+  /// \param[in]  z   Coordinate of point along z axis at which to evaluate Jacobian.
+  ///
+  /// \returns Whether input point is inside map domain. When \c false,
+  ///          the Jacobian entries are set to the \c OutsideValue.
+  virtual bool EvaluateJacobian(double *jac, double x, double y, double z = 0) const;
+
+  /// Evaluate Jacobian of map at a given point using reusable scratch memory
+  ///
+  /// \sa EvaluateJacobian(double *, double, double, double)
+  virtual bool EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                double x, double y, double z = 0) const;
+
+  /// Evaluate Jacobian of map at multiple points
+  ///
+  /// The default implementation evaluates the Jacobian at each point in parallel.
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate Jacobian stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] jac    Jacobian matrices stored contiguously with 3 * NumberOfComponents()
+  ///                    values per point in the order of the single point evaluation.
+  /// \param[out] inside Whether each input point is inside map domain.
+  ///                    Can be \c nullptr when not needed.
+  virtual void EvaluateJacobian(int n, const double *xyz, double *jac, bool *inside = nullptr) const;
+
   // ---------------------------------------------------------------------------
   // I/O
 
@@ -293,6 +516,12 @@ inline void Mapping::BoundingBox(Point &p1, Point &p2) const
 // Evaluation
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+inline bool Mapping::IsAnalytic() const
+{
+  return false;
+}
+
 // -----------------------------------------------------------------------------
 inline bool Mapping::Evaluate(double *v, const double p[3]) const
 {
@@ -308,11 +537,42 @@ inline bool Mapping::Evaluate(double *v, const Point &p) const
 // -----------------------------------------------------------------------------
 inline double Mapping::Evaluate(double x, double y, double z, int l) const
 {
-  double * const v = new double[this->NumberOfComponents()];
-  this->Evaluate(v, x, y, z);
-  const double s = v[l];
-  delete[] v;
-  return s;
+  double v;
+  this->Evaluate(&v, x, y, z, l, l + 1);
+  return v;
+}
+
+// -----------------------------------------------------------------------------
+inline bool Mapping::Evaluate(EvaluationContext &, double *v, double x, double y, double z) const
+{
+  return this->Evaluate(v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+inline double Mapping::Evaluate(EvaluationContext &ctx, double x, double y, double z, int l) const
+{
+  double v;
+  this->Evaluate(ctx, &v, x, y, z, l, l + 1);
+  return v;
+}
+
+// -----------------------------------------------------------------------------
+inline bool Mapping::Evaluate(EvaluationContext &ctx, double *v,
+                              double x, double y, double z, int l1, int l2) const
+{
+  const int dim = this->NumberOfComponents();
+  if (l1 == 0 && l2 == dim) return this->Evaluate(ctx, v, x, y, z);
+  if (ctx._Values.size() < static_cast<size_t>(dim)) ctx._Values.resize(dim);
+  const bool inside = this->Evaluate(ctx, ctx._Values.data(), x, y, z);
+  for (int l = l1; l < l2; ++l) v[l - l1] = ctx._Values[l];
+  return inside;
+}
+
+// -----------------------------------------------------------------------------
+inline bool Mapping::EvaluateJacobian(double *jac, double x, double y, double z) const
+{
+  EvaluationContext ctx;
+  return this->EvaluateJacobian(ctx, jac, x, y, z);
 }
 
 // -----------------------------------------------------------------------------
@@ -0,0 +1,272 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeanValueCoordinatesVolumeMap_H
+#define MIRTK_MeanValueCoordinatesVolumeMap_H
+
+#include "mirtk/Mapping.h"
+
+#include "mirtk/Array.h"
+#include "mirtk/ImageAttributes.h"
+
+#include "vtkSmartPointer.h"
+#include "vtkPolyData.h"
+#include "vtkDataArray.h"
+
+#include <cstdint>
+
+
+namespace mirtk {
+
+
+/**
+ * Volumetric map defined by mean value coordinates of a closed surface cage
+ *
+ * The map value at a point inside the closed triangulated boundary surface,
+ * i.e., the cage, is the weighted average of the map values at the cage
+ * points, where the weights are the mean value coordinates of the point with
+ * respect to the cage (cf. Ju, Schaefer, and Warren, 2005). The map requires
+ * no linear system to be solved, but each evaluation visits all cage
+ * triangles. The cage point coordinates and the intermediate values of the
+ * evaluation are stored as contiguous arrays of Real values, i.e., in single
+ * precision when MIRTK is configured to use float by default.
+ *
+ * When the map is evaluated repeatedly at the points of the same lattice,
+ * e.g., for each subject of a cohort with the same boundary surface but
+ * different boundary maps, the mean value coordinates at these lattice points
+ * can be precomputed by PrecomputeWeights. Coordinates whose magnitude is
+ * below the WeightThreshold are discarded and the remaining coordinates are
+ * normalized. The evaluation of the map at the points of this lattice is then
+ * a sparse matrix-vector product with the map values at the cage points. The
+ * precomputed weights are stored in the map file and remain valid as long as
+ * the cage points are unchanged, whereas new Values may be set at any time
+ * followed by Initialize.
+ */
+class MeanValueCoordinatesVolumeMap : public Mapping
+{
+  mirtkObjectMacro(MeanValueCoordinatesVolumeMap);
+
+public:
+
+  /// Floating point type of cage point coordinates and evaluation buffers
+  #if MIRTK_USE_FLOAT_BY_DEFAULT
+    typedef float Real;
+  #else
+    typedef double Real;
+  #endif
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+protected:
+
+  /// Closed surface whose interior is the map domain
+  ///
+  /// Polygons with more than three points are split into triangles.
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkPolyData>, Cage);
+
+  /// Map values at cage points
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkDataArray>, Values);
+
+  /// Minimum magnitude of precomputed mean value coordinates
+  mirtkPublicAttributeMacro(double, WeightThreshold);
+
+  /// Coordinates of cage points as contiguous x, y, and z arrays
+  mirtkAttributeMacro(Array<Real>, CagePoints);
+
+  /// Point indices of cage triangles as contiguous arrays of first,
+  /// second, and third point index
+  mirtkAttributeMacro(Array<int>, CageTriangles);
+
+  /// Map values at cage points
+  mirtkAttributeMacro(Array<double>, CageValues);
+
+  /// Number of cage points
+  mirtkReadOnlyAttributeMacro(int, NumberOfCagePoints);
+
+  /// Number of cage triangles
+  mirtkReadOnlyAttributeMacro(int, NumberOfCageTriangles);
+
+  /// Dimension of codomain
+  mirtkAttributeMacro(int, Dimension);
+
+  /// Bounding box of cage, i.e., [x1, x2, y1, y2, z1, z2]
+  mirtkAttributeMacro(Array<double>, CageBounds);
+
+  /// Hash value of cage points used to validate the precomputed weights
+  mirtkAttributeMacro(uint64_t, CageHash);
+
+  /// Lattice on which the mean value coordinates are precomputed
+  mirtkReadOnlyAttributeMacro(ImageAttributes, WeightsLattice);
+
+  /// Hash value of cage points for which weights were precomputed
+  mirtkAttributeMacro(uint64_t, WeightsHash);
+
+  /// Offsets of the precomputed weights of each lattice point, where
+  /// lattice points outside the map domain have no weights
+  mirtkAttributeMacro(Array<int64_t>, WeightOffset);
+
+  /// Cage point indices of precomputed weights
+  mirtkAttributeMacro(Array<int>, WeightIndex);
+
+  /// Precomputed mean value coordinates
+  mirtkAttributeMacro(Array<float>, WeightValue);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MeanValueCoordinatesVolumeMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  MeanValueCoordinatesVolumeMap();
+
+  /// Copy constructor
+  MeanValueCoordinatesVolumeMap(const MeanValueCoordinatesVolumeMap &);
+
+  /// Assignment operator
+  MeanValueCoordinatesVolumeMap &operator =(const MeanValueCoordinatesVolumeMap &);
+
+  /// Initialize map after inputs and parameters are set
+  ///
+  /// Precomputed weights are discarded when the cage points have changed.
+  virtual void Initialize();
+
+  /// Make deep copy of this map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~MeanValueCoordinatesVolumeMap();
+
+  // ---------------------------------------------------------------------------
+  // Precomputed weights
+
+  /// Precompute truncated mean value coordinates at the points of a lattice
+  ///
+  /// The map must be initialized before.
+  void PrecomputeWeights(const ImageAttributes &);
+
+  /// Whether mean value coordinates were precomputed for the given lattice
+  bool HasWeights(const ImageAttributes &) const;
+
+  /// Discard precomputed mean value coordinates
+  void ClearWeights();
+
+  /// Number of precomputed mean value coordinates
+  int64_t NumberOfWeights() const;
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get minimum axes-aligned bounding box of map domain
+  ///
+  /// \param[out] x1 Lower bound of map domain along x axis.
+  /// \param[out] y1 Lower bound of map domain along y axis.
+  /// \param[out] z1 Lower bound of map domain along z axis.
+  /// \param[out] x2 Upper bound of map domain along x axis.
+  /// \param[out] y2 Upper bound of map domain along y axis.
+  /// \param[out] z2 Upper bound of map domain along z axis.
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., number of output values
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[out] v Map value.
+  /// \param[in]  x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points
+  ///
+  /// The buffers of the mean value coordinates are allocated once per block
+  /// of points which are evaluated by the same thread.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// When mean value coordinates were precomputed for this lattice and no PLC
+  /// is given, the map values are computed by sparse matrix-vector products.
+  virtual void Evaluate(GenericImage<float> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// When mean value coordinates were precomputed for this lattice and no PLC
+  /// is given, the map values are computed by sparse matrix-vector products.
+  virtual void Evaluate(GenericImage<double> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Compute mean value coordinates of a point
+  ///
+  /// \param[in]  p      Point coordinates.
+  /// \param[out] v      Map value or \c nullptr.
+  /// \param[out] w      Normalized mean value coordinates of all cage points or \c nullptr.
+  /// \param[in]  buffer Buffer of size 4 * NumberOfCagePoints().
+  ///
+  /// \returns Whether the point is inside the cage.
+  bool EvaluateCoordinates(const double p[3], double *v, double *w, Real *buffer) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+protected:
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int MeanValueCoordinatesVolumeMap::NumberOfComponents() const
+{
+  return _Dimension;
+}
+
+// -----------------------------------------------------------------------------
+inline int64_t MeanValueCoordinatesVolumeMap::NumberOfWeights() const
+{
+  return static_cast<int64_t>(_WeightValue.size());
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeanValueCoordinatesVolumeMap_H
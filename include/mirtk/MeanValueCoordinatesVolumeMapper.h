@@ -0,0 +1,92 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeanValueCoordinatesVolumeMapper_H
+#define MIRTK_MeanValueCoordinatesVolumeMapper_H
+
+#include "mirtk/VolumeMapper.h"
+
+#include "mirtk/ImageAttributes.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Volumetric map given by mean value coordinates of the boundary surface
+ *
+ * This mapper requires no discretization of the volume nor a linear system
+ * to be solved. The output MeanValueCoordinatesVolumeMap interpolates the
+ * boundary map using the mean value coordinates of each point with respect to
+ * the boundary surface of the input point set. When a WeightsLattice is set,
+ * the truncated coordinates at the points of this lattice are precomputed and
+ * stored with the output map, such that the map can be re-evaluated on this
+ * lattice for different boundary maps by a sparse matrix-vector product.
+ */
+class MeanValueCoordinatesVolumeMapper : public VolumeMapper
+{
+  mirtkObjectMacro(MeanValueCoordinatesVolumeMapper);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Lattice at whose points the mean value coordinates are precomputed,
+  /// no coordinates are precomputed when the lattice is empty
+  mirtkPublicAttributeMacro(ImageAttributes, WeightsLattice);
+
+  /// Minimum magnitude of precomputed mean value coordinates
+  mirtkPublicAttributeMacro(double, WeightThreshold);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MeanValueCoordinatesVolumeMapper &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  MeanValueCoordinatesVolumeMapper();
+
+  /// Copy constructor
+  MeanValueCoordinatesVolumeMapper(const MeanValueCoordinatesVolumeMapper &);
+
+  /// Assignment operator
+  MeanValueCoordinatesVolumeMapper &operator =(const MeanValueCoordinatesVolumeMapper &);
+
+  /// Destructor
+  virtual ~MeanValueCoordinatesVolumeMapper();
+
+  // ---------------------------------------------------------------------------
+  // Execution
+
+protected:
+
+  /// Initialize filter after input and parameters are set
+  virtual void Initialize();
+
+  /// Create output map and precompute mean value coordinates
+  virtual void Solve();
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeanValueCoordinatesVolumeMapper_H
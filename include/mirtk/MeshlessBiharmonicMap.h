@@ -73,7 +73,7 @@ public:
   // Evaluation
 
   // Import other overloads
-  using MeshlessMap::Evaluate;
+  using MeshlessHarmonicMap::Evaluate;
 
   /// Evaluate map at a given point
   ///
@@ -96,6 +96,44 @@ public:
   ///          or the \c OutsideValue when input point is outside the map domain.
   virtual double Evaluate(double x, double y, double z = 0, int l = 0) const;
 
+  /// Evaluate range of map value components at a given point
+  ///
+  /// Only the harmonic and biharmonic coefficient columns [l1, l2) are summed.
+  ///
+  /// \param[out] v  Map value components l1 to l2-1.
+  /// \param[in]  x  Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y  Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z  Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]  l1 Index of first map value component.
+  /// \param[in]  l2 Index one past last map value component.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z, int l1, int l2) const;
+
+  // ---------------------------------------------------------------------------
+  // Source points
+
+  /// Set harmonic and biharmonic coefficients of i-th source point to zero
+  virtual void ClearCoefficients(int i);
+
+  /// Frobenius norm of harmonic and biharmonic coefficients of i-th source point
+  virtual double CoefficientsNorm(int i) const;
+
+protected:
+
+  /// Whether the coefficients include the biharmonic kernel term
+  virtual bool HasBiharmonicTerm() const;
+
+  /// Resize coefficients matrix to the given number of source points
+  ///
+  /// The coefficients of the harmonic kernel of all source points are
+  /// followed by those of the biharmonic kernel, i.e., the biharmonic
+  /// coefficients of the existing source points are moved down.
+  virtual void ResizeCoefficients(int n);
+
+  /// Keep only the harmonic and biharmonic coefficients of the given source points
+  virtual void SelectCoefficients(const Array<int> &keep);
+
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -105,7 +143,13 @@ public:
 // -----------------------------------------------------------------------------
 inline double MeshlessBiharmonicMap::B(double d)
 {
-  return d / (8.0 * pi);
+  return MeshlessBiharmonicKernel()(d);
+}
+
+// -----------------------------------------------------------------------------
+inline bool MeshlessBiharmonicMap::HasBiharmonicTerm() const
+{
+  return true;
 }
 
 
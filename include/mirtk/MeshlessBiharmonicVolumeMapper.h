@@ -0,0 +1,84 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessBiharmonicVolumeMapper_H
+#define MIRTK_MeshlessBiharmonicVolumeMapper_H
+
+#include "mirtk/MeshlessHarmonicVolumeMapper.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Biharmonic volumetric map using the method of fundamental solutions (MFS)
+ *
+ * This class finds a biharmonic volumetric map which is the sum of harmonic
+ * and biharmonic kernel functions centered at the source points, i.e., the
+ * linear system of each source points subset has one unknown of each kernel
+ * per source point. The kernel function values, the cached Cholesky factors
+ * of the coefficients matrices, and the partitioned solve are those of the
+ * harmonic mapper, where a tile of kernel function values is [H | B] and the
+ * values of both kernels are computed in one pass over the pairs of points.
+ *
+ * - Xu et al. (2013). Biharmonic volumetric mapping using fundamental solutions.
+ *   IEEE Transactions on Visualization and Computer Graphics, 19(5), 787–798.
+ */
+class MeshlessBiharmonicVolumeMapper : public MeshlessHarmonicVolumeMapper
+{
+  mirtkObjectMacro(MeshlessBiharmonicVolumeMapper);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  MeshlessBiharmonicVolumeMapper();
+
+  /// Copy constructor
+  MeshlessBiharmonicVolumeMapper(const MeshlessBiharmonicVolumeMapper &);
+
+  /// Assignment operator
+  MeshlessBiharmonicVolumeMapper &operator =(const MeshlessBiharmonicVolumeMapper &);
+
+  /// Destructor
+  virtual ~MeshlessBiharmonicVolumeMapper();
+
+protected:
+
+  /// Whether the map includes the biharmonic kernel term
+  virtual bool HasBiharmonicTerm() const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline bool MeshlessBiharmonicVolumeMapper::HasBiharmonicTerm() const
+{
+  return true;
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessBiharmonicVolumeMapper_H
@@ -0,0 +1,211 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessCompactMap_H
+#define MIRTK_MeshlessCompactMap_H
+
+#include "mirtk/MeshlessMap.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Matrix.h"
+#include "mirtk/PointSet.h"
+#include "mirtk/MeshlessKernel.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Meshless map defined by compactly supported radial basis functions
+ *
+ * The map is the sum of an affine map and of Wendland's C2 radial basis
+ * functions (Wendland, 1995) centered at the source points. Each kernel
+ * function is zero beyond the support radius of its source point. The map
+ * is thus evaluated at a point using only the nearby source points, which
+ * are found using a uniform grid index of the source points whose cell size
+ * is the support radius. Points further than the support radius from all
+ * source points are mapped by the affine part only.
+ *
+ * - Wendland (1995). Piecewise polynomial, positive definite and compactly
+ *   supported radial functions of minimal degree. Advances in Computational
+ *   Mathematics, 4(1), 389–396.
+ */
+class MeshlessCompactMap : public MeshlessMap
+{
+  mirtkObjectMacro(MeshlessCompactMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Radius of support of the kernel functions
+  mirtkPublicAttributeMacro(double, SupportRadius);
+
+  /// Coefficients of the affine part of the map
+  ///
+  /// The 4 x d matrix contains the coefficients of the x, y, and z coordinates
+  /// and the constant offset in its rows for each of the d scalar maps. The
+  /// affine part is zero when this matrix is empty.
+  mirtkPublicAttributeMacro(Matrix, AffineCoefficients);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MeshlessCompactMap &);
+
+private:
+
+  double     _GridOrigin[3];  ///< Lower corner of source points grid
+  double     _GridSpacing;    ///< Cell size of source points grid
+  int        _GridSize[3];    ///< Number of source points grid cells
+  Array<int> _CellOffset;     ///< Offset of first source point of each cell
+  Array<int> _CellIndex;      ///< Indices of source points sorted by cell
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // Auxiliaries
+
+  /// Wendland's C2 kernel function
+  ///
+  /// \param[in] d Distance of point to source point.
+  /// \param[in] r Radius of support.
+  ///
+  /// \returns Kernel function value, which is zero when \p d >= \p r.
+  static double W(double d, double r);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+  /// Default constructor
+  MeshlessCompactMap();
+
+  /// Copy constructor
+  MeshlessCompactMap(const MeshlessCompactMap &);
+
+  /// Assignment operator
+  MeshlessCompactMap &operator =(const MeshlessCompactMap &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make deep copy of this volumetric map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~MeshlessCompactMap();
+
+  // ---------------------------------------------------------------------------
+  // Source points
+
+  /// Update grid index of source points
+  ///
+  /// This function must be called after source points were added or the
+  /// support radius was changed. Until then, the map is evaluated using
+  /// all source points.
+  void UpdateSourceGrid();
+
+  /// Find source points whose kernel function is non-zero at a given point
+  ///
+  /// \param[in]  x    Coordinate of point along x axis.
+  /// \param[in]  y    Coordinate of point along y axis.
+  /// \param[in]  z    Coordinate of point along z axis.
+  /// \param[out] ids  Indices of source points within support radius.
+  /// \param[out] dist Distances of these source points.
+  ///
+  /// \returns Number of source points within support radius.
+  int FindSourcePoints(double x, double y, double z,
+                       Array<int> &ids, Array<double> &dist) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using MeshlessMap::Evaluate;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[out] v Map value.
+  /// \param[in]  x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z = .0) const;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[in] x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in] y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in] z Coordinate of point along z axis at which to evaluate map.
+  /// \param[in] l Index of map value component.
+  ///
+  /// \returns The l-th component of the map value evaluated at the given point.
+  virtual double Evaluate(double x, double y, double z = .0, int l = 0) const;
+
+  /// Evaluate range of map value components at a given point
+  ///
+  /// \param[out] v  Map value components l1 to l2-1.
+  /// \param[in]  x  Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y  Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z  Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]  l1 Index of first map value component.
+  /// \param[in]  l2 Index one past last map value component.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z, int l1, int l2) const;
+
+  /// Evaluate map at multiple points in parallel
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+protected:
+
+  /// Add kernel sum of components [l1, l2) at a given point to v[0, l2 - l1)
+  void AddKernelSum(double *v, double x, double y, double z, int l1, int l2) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline double MeshlessCompactMap::W(double d, double r)
+{
+  return MeshlessWendlandKernel(r)(d);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessCompactMap_H
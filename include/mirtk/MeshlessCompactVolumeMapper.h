@@ -0,0 +1,162 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessCompactVolumeMapper_H
+#define MIRTK_MeshlessCompactVolumeMapper_H
+
+#include "mirtk/MeshlessVolumeMapper.h"
+
+#include "mirtk/Array.h"
+#include "mirtk/SparseSolverType.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Volumetric map using compactly supported radial basis functions
+ *
+ * This class computes a MeshlessCompactMap whose Wendland kernel functions are
+ * centered at source points sampled from the offset surface of the boundary,
+ * as the meshless harmonic volumetric mapper does. Because each kernel function
+ * is non-zero only within its support radius, the matrix of kernel function
+ * values at the boundary points is sparse. It is computed using a grid index
+ * of the source points and stored in compressed row format. The least squares
+ * fit of all source point weights to the residual boundary map is then solved
+ * at once with a sparse linear solver, whose cost grows roughly linearly with
+ * the number of boundary points rather than quadratically as with the dense
+ * systems of the global fundamental solutions.
+ *
+ * An affine map is fitted to the boundary map first such that interior points
+ * further than the support radius from all source points are mapped smoothly.
+ */
+class MeshlessCompactVolumeMapper : public MeshlessVolumeMapper
+{
+  mirtkObjectMacro(MeshlessCompactVolumeMapper);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Radius of support of the kernel functions
+  ///
+  /// If negative, the absolute value is multiplied by the length of the
+  /// diagonal of the bounding box of the boundary points.
+  mirtkPublicAttributeMacro(double, SupportRadius);
+
+  /// Sparse linear solver of normal equations
+  mirtkPublicAttributeMacro(SparseSolverType, Solver);
+
+  /// Maximum number of iterations of iterative sparse linear solver
+  mirtkPublicAttributeMacro(int, NumberOfSolverIterations);
+
+  /// Tolerance of iterative sparse linear solver
+  mirtkPublicAttributeMacro(double, SolverTolerance);
+
+  /// Weight of Tikhonov regularization relative to mean diagonal of normal equations
+  mirtkPublicAttributeMacro(double, Regularization);
+
+  /// Offset of first kernel function value of each boundary point
+  mirtkAttributeMacro(Array<int>, KernelRowOffset);
+
+  /// Source point index of each non-zero kernel function value
+  mirtkAttributeMacro(Array<int>, KernelColumnIndex);
+
+  /// Non-zero kernel function values in compressed row format
+  mirtkAttributeMacro(Array<double>, KernelValue);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MeshlessCompactVolumeMapper &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  MeshlessCompactVolumeMapper();
+
+  /// Copy constructor
+  MeshlessCompactVolumeMapper(const MeshlessCompactVolumeMapper &);
+
+  /// Assignment operator
+  MeshlessCompactVolumeMapper &operator =(const MeshlessCompactVolumeMapper &);
+
+  /// Destructor
+  virtual ~MeshlessCompactVolumeMapper();
+
+  // ---------------------------------------------------------------------------
+  // Execution
+
+protected:
+
+  /// Initialize filter after input and parameters are set
+  virtual void Initialize();
+
+  /// Add source point after filter initialization
+  virtual bool AddSourcePoint(double q[3]);
+
+  /// Add new source points at once
+  virtual void AddSourcePoints(const PointSet &points);
+
+  /// Compute sparse matrix of kernel function values at boundary points
+  void UpdateKernel();
+
+  /// Fit affine part of map to residual boundary map
+  void FitAffineMap();
+
+  /// Compute meshless map coefficients
+  virtual void Solve();
+
+  // ---------------------------------------------------------------------------
+  // Linear system
+
+  /// Get coefficients matrix corresponding to the least squares fitting term(s)
+  /// of the quadratic energy function at constraints points
+  ///
+  /// \param[in]  k     Index of source points subset.
+  /// \param[out] coeff Coefficients matrix.
+  virtual void GetCoefficients(int k, Matrix &coeff) const;
+
+  /// Get right-hand side of linear system
+  ///
+  /// \param[in]  k Index of source points subset.
+  /// \param[out] b Right-hand side of linear system.
+  virtual void GetConstraints(int k, Matrix &b) const;
+
+  /// Add solution of linear system to weights of volumetric map
+  ///
+  /// \param[in] k Index of source points subset.
+  /// \param[in] w Solution of linear system.
+  virtual void AddWeights(int k, const Matrix &w);
+
+  /// Evaluate boundary map corresponding to weights of k-th subset
+  ///
+  /// \param[in]  k Index of source points subset.
+  /// \param[in]  w Weights of source points subset.
+  /// \param[out] f Boundary map values with one row per boundary point.
+  ///
+  /// \returns Whether the boundary map values are available.
+  virtual bool GetBoundaryMap(int k, const Matrix &w, Matrix &f) const;
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessCompactVolumeMapper_H
@@ -25,6 +25,7 @@
 #include "mirtk/Math.h"
 #include "mirtk/PointSet.h"
 #include "mirtk/Vector.h"
+#include "mirtk/MeshlessKernel.h"
 
 
 namespace mirtk {
@@ -40,6 +41,30 @@ class MeshlessHarmonicMap : public MeshlessMap
 {
   mirtkObjectMacro(MeshlessHarmonicMap);
 
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Whether to evaluate the kernel sum at multiple points in single precision
+  ///
+  /// Single precision doubles the number of points processed per vector
+  /// instruction at the expense of accuracy. This parameter is not stored
+  /// in the map file.
+  mirtkPublicAttributeMacro(bool, SinglePrecision);
+
+  /// Opening angle of the multipole acceptance criterion of the treecode used
+  /// to evaluate the kernel sum at multiple points
+  ///
+  /// When positive, the kernel sum is approximated by a Barnes-Hut type
+  /// treecode with relative error of the order of the cube of this value,
+  /// which must be less than one. Otherwise, the kernel sum is evaluated
+  /// directly. This parameter is not stored in the map file.
+  ///
+  /// \sa MeshlessTreecode
+  mirtkPublicAttributeMacro(double, TreecodeOpeningAngle);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MeshlessHarmonicMap &);
+
 public:
 
   // ---------------------------------------------------------------------------
@@ -97,6 +122,85 @@ public:
   ///          or the \c OutsideValue when input point is outside the map domain.
   virtual double Evaluate(double x, double y, double z = .0, int l = 0) const;
 
+  /// Evaluate range of map value components at a given point
+  ///
+  /// Only the coefficient columns [l1, l2) are summed, unlike
+  /// Evaluate(double *, double, double, double), which sums all columns.
+  ///
+  /// \param[out] v  Map value components l1 to l2-1.
+  /// \param[in]  x  Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y  Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z  Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]  l1 Index of first map value component.
+  /// \param[in]  l2 Index one past last map value component.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z, int l1, int l2) const;
+
+  /// Evaluate map at multiple points
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// The kernel sum is evaluated for tiles of contiguous lattice points at
+  /// once, which span multiple rows of short or masked lattices.
+  ///
+  /// \param[out] f Defines lattice on which to evaluate the map. The map value
+  ///               at each lattice point is stored at the respective voxel.
+  ///               The number of map values stored in the output image is
+  ///               determined by the temporal dimension of the image.
+  /// \param[in]  l Index of first map value component to store in output image.
+  /// \param[in]  m Piecewise linear complex (PLC) defining an arbitrary subset
+  ///               of the lattice points at which to evaluate the map.
+  virtual void Evaluate(GenericImage<float> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// \sa Evaluate(GenericImage<float> &, int, vtkSmartPointer<vtkPointSet>)
+  virtual void Evaluate(GenericImage<double> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate Jacobian of map at a given point
+  ///
+  /// The partial derivatives are evaluated exactly from the gradients of the
+  /// kernel functions, including the biharmonic term of a biharmonic map.
+  ///
+  /// \param[out] jac Jacobian matrix stored row by row with three partial
+  ///                 derivatives per map component.
+  /// \param[in]  x   Coordinate of point along x axis at which to evaluate Jacobian.
+  /// \param[in]  y   Coordinate of point along y axis at which to evaluate Jacobian.
+  /// \param[in]  z   Coordinate of point along z axis at which to evaluate Jacobian.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool EvaluateJacobian(double *jac, double x, double y, double z = .0) const;
+
+  /// Evaluate Jacobian of map at a given point
+  ///
+  /// The kernel gradients require no scratch memory and the context is unused.
+  virtual bool EvaluateJacobian(EvaluationContext &, double *jac,
+                                double x, double y, double z = .0) const;
+
+  /// Evaluate Jacobian of map at multiple points in parallel
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate Jacobian stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] jac    Jacobian matrices stored contiguously with 3 * NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  virtual void EvaluateJacobian(int n, const double *xyz, double *jac, bool *inside = nullptr) const;
+
+protected:
+
+  /// Whether the coefficients include the biharmonic kernel term
+  virtual bool HasBiharmonicTerm() const;
+
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -106,7 +210,20 @@ public:
 // -----------------------------------------------------------------------------
 inline double MeshlessHarmonicMap::H(double d)
 {
-  return .25 / (d * pi);
+  return MeshlessHarmonicKernel()(d);
+}
+
+// -----------------------------------------------------------------------------
+inline bool MeshlessHarmonicMap::EvaluateJacobian(EvaluationContext &, double *jac,
+                                                  double x, double y, double z) const
+{
+  return this->EvaluateJacobian(jac, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+inline bool MeshlessHarmonicMap::HasBiharmonicTerm() const
+{
+  return false;
 }
 
 
@@ -21,13 +21,98 @@
 #define MIRTK_MeshlessHarmonicVolumeMapper_H
 
 #include "mirtk/MeshlessVolumeMapper.h"
+#include "mirtk/MeshlessKernelMatrix.h"
 
+#include "mirtk/Array.h"
 #include "mirtk/Matrix.h"
+#include "mirtk/UninitializedArray.h"
+#include "mirtk/String.h"
 
 
 namespace mirtk {
 
 
+// =============================================================================
+// Enumerations
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Enumeration of storage types of the kernel function values
+enum MeshlessKernelStorage
+{
+  MeshlessKernel_Double,     ///< Dense matrix of double precision values
+  MeshlessKernel_Float,      ///< Dense matrix of single precision values
+  MeshlessKernel_MatrixFree  ///< Values evaluated from point coordinates when needed
+};
+
+// -----------------------------------------------------------------------------
+template <>
+inline string ToString(const MeshlessKernelStorage &value, int w, char c, bool left)
+{
+  const char *str;
+  switch (value) {
+    case MeshlessKernel_Double:     str = "Double";     break;
+    case MeshlessKernel_Float:      str = "Float";      break;
+    case MeshlessKernel_MatrixFree: str = "MatrixFree"; break;
+    default:                        str = "Unknown";    break;
+  }
+  return ToString(str, w, c, left);
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline bool FromString(const char *str, MeshlessKernelStorage &value)
+{
+  const string lstr = ToLower(str);
+  if      (lstr == "double")      value = MeshlessKernel_Double;
+  else if (lstr == "float")       value = MeshlessKernel_Float;
+  else if (lstr == "matrixfree" ||
+           lstr == "matrix-free") value = MeshlessKernel_MatrixFree;
+  else return false;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Enumeration of singular value decomposition (SVD) methods
+enum MeshlessSVDMethod
+{
+  MeshlessSVD_Jacobi,     ///< Two-sided Jacobi SVD, accurate but slow for large matrices
+  MeshlessSVD_BDC,        ///< Divide and conquer bidiagonal SVD
+  MeshlessSVD_Randomized  ///< Randomized range finder followed by SVD of projected matrix
+};
+
+// -----------------------------------------------------------------------------
+template <>
+inline string ToString(const MeshlessSVDMethod &value, int w, char c, bool left)
+{
+  const char *str;
+  switch (value) {
+    case MeshlessSVD_Jacobi:     str = "Jacobi";     break;
+    case MeshlessSVD_BDC:        str = "BDC";        break;
+    case MeshlessSVD_Randomized: str = "Randomized"; break;
+    default:                     str = "Unknown";    break;
+  }
+  return ToString(str, w, c, left);
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline bool FromString(const char *str, MeshlessSVDMethod &value)
+{
+  const string lstr = ToLower(str);
+  if      (lstr == "jacobi")     value = MeshlessSVD_Jacobi;
+  else if (lstr == "bdc")        value = MeshlessSVD_BDC;
+  else if (lstr == "randomized" ||
+           lstr == "random")     value = MeshlessSVD_Randomized;
+  else return false;
+  return true;
+}
+
+// =============================================================================
+// Meshless harmonic volumetric map solver
+// =============================================================================
+
+
 /**
  * Harmonic volumetric map using the method of fundamental solutions (MFS)
  *
@@ -47,12 +132,62 @@ class MeshlessHarmonicVolumeMapper : public MeshlessVolumeMapper
   // ---------------------------------------------------------------------------
   // Attributes
 
-  /// Precomputed kernel function values
+  /// Storage of kernel function values of each pair of boundary and source points
+  ///
+  /// The dense m x n matrix of kernel function values needs 8 m n bytes in
+  /// double precision, which limits the number of boundary and source points.
+  /// In single precision, it needs half the memory. Without storage, the
+  /// kernel function values are computed from the point coordinates each time
+  /// they are needed. In all cases, the matrix products of the linear systems
+  /// are computed by streaming through tiles of boundary point rows, which
+  /// fit into the processor caches.
+  mirtkPublicAttributeMacro(MeshlessKernelStorage, KernelStorage);
+
+  /// Coordinates of boundary and source points in SoA layout
+  mirtkAttributeMacro(MeshlessKernelMatrix<double>, KernelMatrix);
+
+  /// Precomputed double precision kernel function values
+  ///
+  /// The number of columns is the capacity for source points, which is doubled
+  /// when exceeded, such that adding a source point copies the kernel function
+  /// values of the other source points only once in a while. Only the first
+  /// NumberOfSourcePoints columns are valid.
   mirtkAttributeMacro(Matrix, Kernel);
 
+  /// Precomputed single precision kernel function values in column-major order
+  ///
+  /// The values are left uninitialized on allocation, such that the memory
+  /// pages are first touched by the threads which compute the kernel columns.
+  mirtkAttributeMacro(UninitializedArray<float>, FloatKernel);
+
+  /// Precomputed double precision biharmonic kernel function values
+  ///
+  /// Only used when HasBiharmonicTerm, in which case the columns are grown
+  /// together with those of the Kernel.
+  mirtkAttributeMacro(Matrix, BiharmonicKernel);
+
+  /// Precomputed single precision biharmonic kernel function values in column-major order
+  mirtkAttributeMacro(UninitializedArray<float>, FloatBiharmonicKernel);
+
   /// Whether to use SVD to solve linear system
   mirtkPublicAttributeMacro(bool, UseSVD);
 
+  /// SVD method used to solve linear system when UseSVD is enabled
+  ///
+  /// The Jacobi SVD of the tall m x n kernel matrix is accurate but needs
+  /// far more time than the divide and conquer (BDC) method for large n.
+  /// The randomized SVD computes an orthonormal basis of the range of the
+  /// kernel matrix using a few products with a random Gaussian matrix and
+  /// decomposes only the projection of the kernel matrix onto this basis.
+  mirtkPublicAttributeMacro(MeshlessSVDMethod, SVDMethod);
+
+  /// Rank of randomized SVD
+  ///
+  /// When non-positive, the number of source points of the subset is used.
+  /// For each method, singular values less than the largest singular value
+  /// divided by MaximumConditionNumber are discarded when solving the system.
+  mirtkPublicAttributeMacro(int, SVDRank);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const MeshlessHarmonicVolumeMapper &);
 
@@ -73,6 +208,37 @@ public:
   /// Destructor
   virtual ~MeshlessHarmonicVolumeMapper();
 
+  // ---------------------------------------------------------------------------
+  // Kernel function values
+
+  /// Get kernel function values of a tile of boundary points and source points
+  ///
+  /// When HasBiharmonicTerm, the tile has 2 \p ncols columns, where the
+  /// columns of the harmonic kernel H are followed by those of the biharmonic
+  /// kernel B, i.e., the tile is [H | B].
+  ///
+  /// \param[in]  r0    Index of first boundary point.
+  /// \param[in]  nrows Number of boundary points.
+  /// \param[in]  cols  Indices of source points.
+  /// \param[in]  ncols Number of source points.
+  /// \param[out] tile  Kernel function values in column-major order.
+  void GetKernel(int r0, int nrows, const int *cols, int ncols, double *tile) const;
+
+  /// Number of unknowns of the linear system of n source points
+  int NumberOfUnknowns(int n) const;
+
+protected:
+
+  /// Whether the map includes the biharmonic kernel term
+  virtual bool HasBiharmonicTerm() const;
+
+  /// Grow storage of kernel function values to at least n source points
+  void ReserveKernel(int n);
+
+  /// Compute and store kernel function values of \p n source points starting
+  /// with the j-th source point, or of all source points when \p j is negative
+  void UpdateKernel(int j = -1, int n = 1);
+
   // ---------------------------------------------------------------------------
   // Execution
 
@@ -88,6 +254,25 @@ protected:
   /// \returns Whether source point was added or too close to existing point.
   virtual bool AddSourcePoint(double q[3]);
 
+  /// Add new source points at once
+  ///
+  /// The storage of the kernel function values is grown only once and the
+  /// kernel function values of the new source points are computed in parallel.
+  ///
+  /// \param[in] points New source points.
+  virtual void AddSourcePoints(const PointSet &points);
+
+  /// Get contribution of each source point to the boundary map
+  ///
+  /// The contribution of a source point is the norm of its kernel function
+  /// values at the boundary points times the norm of its coefficients, which
+  /// bounds the norm of its boundary map values. With biharmonic term, the
+  /// contributions of both kernels are summed.
+  virtual void GetSourcePointContributions(Array<double> &) const;
+
+  /// Remove source points and their stored kernel function values
+  virtual void RemoveSourcePoints(const Array<bool> &remove);
+
   /// Compute meshless map coefficients
   virtual void Solve();
 
@@ -101,6 +286,15 @@ protected:
   /// \param[out] coeff Coefficients matrix.
   virtual void GetCoefficients(int k, Matrix &coeff) const;
 
+  /// Get columns of coefficients matrix of source points appended to a subset
+  ///
+  /// \param[in]  k     Index of source points subset.
+  /// \param[in]  n0    Index of first appended source point.
+  /// \param[out] coeff Trailing columns of coefficients matrix.
+  ///
+  /// \returns Whether the coefficients of appended source points are available.
+  virtual bool GetAppendedCoefficients(int k, int n0, Matrix &coeff) const;
+
   /// Get right-hand side of linear system
   ///
   /// \param[in]  k Index of source points subset.
@@ -113,8 +307,33 @@ protected:
   /// \param[in] w Solution of linear system.
   virtual void AddWeights(int k, const Matrix &w);
 
+  /// Evaluate boundary map corresponding to weights of k-th subset
+  ///
+  /// \param[in]  k Index of source points subset.
+  /// \param[in]  w Weights of source points subset.
+  /// \param[out] f Boundary map values with one row per boundary point.
+  ///
+  /// \returns Whether the boundary map values are available.
+  virtual bool GetBoundaryMap(int k, const Matrix &w, Matrix &f) const;
+
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int MeshlessHarmonicVolumeMapper::NumberOfUnknowns(int n) const
+{
+  return this->HasBiharmonicTerm() ? 2 * n : n;
+}
+
+// -----------------------------------------------------------------------------
+inline bool MeshlessHarmonicVolumeMapper::HasBiharmonicTerm() const
+{
+  return false;
+}
+
 
 } // namespace mirtk
 
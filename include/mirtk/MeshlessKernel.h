@@ -0,0 +1,261 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessKernel_H
+#define MIRTK_MeshlessKernel_H
+
+#include "mirtk/Math.h"
+#include "mirtk/Matrix.h"
+#include "mirtk/Point.h"
+#include "mirtk/PointSet.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Kernel functions
+// =============================================================================
+
+/**
+ * Radial kernel functions of meshless maps
+ *
+ * Each kernel function is a policy type with a call operator which evaluates
+ * the kernel function at a given distance of a point from a source point and
+ * a Derivative function which evaluates its derivative with respect to this
+ * distance. Both are templates of the floating point type such that loops over
+ * the points of the meshless maps and kernel matrices, which take the kernel
+ * type as template argument, are generated for each kernel and precision with
+ * the kernel function inlined. Kernel parameters such as the support radius
+ * are members of the policy object, which is passed by value.
+ *
+ * The static member Singular indicates whether the kernel function is not
+ * defined at the source point, i.e., whether a point coinciding with a source
+ * point is outside the map domain. The static member Compact indicates whether
+ * the kernel function is zero beyond a finite support radius.
+ */
+
+// -----------------------------------------------------------------------------
+/// Fundamental solution of the Laplace equation, H(d) = 1/(4 pi d)
+struct MeshlessHarmonicKernel
+{
+  static const bool Singular = true;
+  static const bool Compact  = false;
+
+  template <class T>
+  T operator ()(T d) const
+  {
+    return static_cast<T>(.25 / pi) / d;
+  }
+
+  template <class T>
+  T Derivative(T d) const
+  {
+    return static_cast<T>(-.25 / pi) / (d * d);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Fundamental solution of the biharmonic equation, B(d) = d/(8 pi)
+struct MeshlessBiharmonicKernel
+{
+  static const bool Singular = false;
+  static const bool Compact  = false;
+
+  template <class T>
+  T operator ()(T d) const
+  {
+    return static_cast<T>(1.0 / (8.0 * pi)) * d;
+  }
+
+  template <class T>
+  T Derivative(T) const
+  {
+    return static_cast<T>(1.0 / (8.0 * pi));
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Wendland's C2 function, W(d) = (1 - d/r)^4 (4 d/r + 1) for d < r
+struct MeshlessWendlandKernel
+{
+  static const bool Singular = false;
+  static const bool Compact  = true;
+
+  double _Radius; ///< Radius of support
+
+  MeshlessWendlandKernel(double r = 1.) : _Radius(r) {}
+
+  template <class T>
+  T operator ()(T d) const
+  {
+    const T t = d / static_cast<T>(_Radius);
+    if (t >= T(1)) return T(0);
+    const T s = T(1) - t;
+    return s * s * s * s * (T(4) * t + T(1));
+  }
+
+  template <class T>
+  T Derivative(T d) const
+  {
+    const T t = d / static_cast<T>(_Radius);
+    if (t >= T(1)) return T(0);
+    const T s = T(1) - t;
+    return T(-20) * t * s * s * s / static_cast<T>(_Radius);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Gaussian function, G(d) = exp(-d^2 / (2 sigma^2))
+struct MeshlessGaussianKernel
+{
+  static const bool Singular = false;
+  static const bool Compact  = false;
+
+  double _Sigma; ///< Standard deviation
+
+  MeshlessGaussianKernel(double sigma = 1.) : _Sigma(sigma) {}
+
+  template <class T>
+  T operator ()(T d) const
+  {
+    const T s = static_cast<T>(_Sigma);
+    return exp(-(d * d) / (T(2) * s * s));
+  }
+
+  template <class T>
+  T Derivative(T d) const
+  {
+    const T s = static_cast<T>(_Sigma);
+    return -d / (s * s) * exp(-(d * d) / (T(2) * s * s));
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Multiquadric function, M(d) = sqrt(d^2 + c^2)
+struct MeshlessMultiquadricKernel
+{
+  static const bool Singular = false;
+  static const bool Compact  = false;
+
+  double _Shape; ///< Shape parameter c
+
+  MeshlessMultiquadricKernel(double c = 1.) : _Shape(c) {}
+
+  template <class T>
+  T operator ()(T d) const
+  {
+    const T c = static_cast<T>(_Shape);
+    return sqrt(d * d + c * c);
+  }
+
+  template <class T>
+  T Derivative(T d) const
+  {
+    const T c = static_cast<T>(_Shape);
+    return d / sqrt(d * d + c * c);
+  }
+};
+
+// =============================================================================
+// Kernel sum
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Add kernel sum of a meshless map at a given point
+///
+/// \param[in]     kernel  Kernel function.
+/// \param[in]     sources Source points, i.e., centers of kernel functions.
+/// \param[in]     coeffs  Coefficients matrix of the meshless map.
+/// \param[in]     r0      Row of the coefficients of the first source point.
+/// \param[in]     p       Point at which to evaluate the kernel sum.
+/// \param[in,out] v       Sum of components [l1, l2) stored at v[0, l2 - l1).
+/// \param[in]     l1      Index of first map component.
+/// \param[in]     l2      Index one past last map component.
+///
+/// \returns Whether the point is inside the map domain, i.e., whether it does
+///          not coincide with a source point of a singular kernel function.
+///          When \c false, the values of \p v are undefined.
+template <class TKernel>
+inline bool AddKernelSum(const TKernel &kernel, const PointSet &sources, const Matrix &coeffs,
+                         int r0, const Point &p, double *v, int l1, int l2)
+{
+  double d, k;
+  for (int i = 0; i < sources.Size(); ++i) {
+    d = p.Distance(sources(i));
+    if (TKernel::Singular && d < 1e-12) return false;
+    k = kernel(d);
+    for (int l = l1; l < l2; ++l) {
+      v[l - l1] += k * coeffs(r0 + i, l);
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Add gradient of kernel sum of a meshless map at a given point
+///
+/// The gradient of a radial kernel function K(d) centered at source point s
+/// is K'(d) (p - s) / d, where d = |p - s|. At the source point of a kernel
+/// function which is not singular, its gradient is taken to be zero.
+///
+/// \param[in]     kernel  Kernel function.
+/// \param[in]     sources Source points, i.e., centers of kernel functions.
+/// \param[in]     coeffs  Coefficients matrix of the meshless map.
+/// \param[in]     r0      Row of the coefficients of the first source point.
+/// \param[in]     p       Point at which to evaluate the gradient.
+/// \param[in,out] jac     Jacobian of components [l1, l2) stored row by row
+///                        at jac[0, 3 * (l2 - l1)).
+/// \param[in]     l1      Index of first map component.
+/// \param[in]     l2      Index one past last map component.
+///
+/// \returns Whether the point is inside the map domain, i.e., whether it does
+///          not coincide with a source point of a singular kernel function.
+///          When \c false, the values of \p jac are undefined.
+template <class TKernel>
+inline bool AddKernelGradient(const TKernel &kernel, const PointSet &sources, const Matrix &coeffs,
+                              int r0, const Point &p, double *jac, int l1, int l2)
+{
+  double d, k, g[3];
+  for (int i = 0; i < sources.Size(); ++i) {
+    const Point &s = sources(i);
+    d = p.Distance(s);
+    if (d < 1e-12) {
+      if (TKernel::Singular) return false;
+      continue;
+    }
+    k = kernel.Derivative(d) / d;
+    g[0] = k * (p._x - s._x);
+    g[1] = k * (p._y - s._y);
+    g[2] = k * (p._z - s._z);
+    for (int l = l1; l < l2; ++l) {
+      const double c = coeffs(r0 + i, l);
+      double * const row = jac + 3 * (l - l1);
+      row[0] += c * g[0];
+      row[1] += c * g[1];
+      row[2] += c * g[2];
+    }
+  }
+  return true;
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessKernel_H
@@ -0,0 +1,397 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessKernelMatrix_H
+#define MIRTK_MeshlessKernelMatrix_H
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/PointSet.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/MeshlessKernel.h"
+
+#include "vtkPoints.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Computes kernel function values of pairs of target and source points
+ *
+ * The fitting systems of the meshless volumetric mappers are assembled from
+ * the m x n matrix of kernel function values of each pair of target point,
+ * i.e., a boundary point, and source point. This class copies the coordinates
+ * of both point sets once into a structure-of-arrays (SoA) layout, such that
+ * a column of a tile of kernel function values is computed by a loop with
+ * unit stride over the target points. This loop is vectorized by the compiler
+ * for the instruction set the library is built for. Tiles of kernel function
+ * values are stored in column-major order with a given leading dimension,
+ * which allows filling a submatrix of a dense kernel matrix in place.
+ *
+ * The kernel function is either given as enumeration value of the kernels of
+ * the meshless harmonic and biharmonic maps, or as kernel policy object (see
+ * mirtk/MeshlessKernel.h), in which case the loop over the target points is
+ * instantiated for this kernel with the kernel function inlined. Tiles of two
+ * kernel functions, e.g., the harmonic and biharmonic kernels of the meshless
+ * biharmonic map, are filled in one pass which computes each distance once.
+ *
+ * \tparam TReal Floating point type used for the distance and kernel function
+ *               evaluation, i.e., either \c double or \c float.
+ */
+template <class TReal>
+class MeshlessKernelMatrix
+{
+public:
+
+  /// Enumeration of kernel functions
+  enum KernelType
+  {
+    Harmonic,   ///< Harmonic kernel H(d) = 1/(4 pi d)
+    Biharmonic  ///< Biharmonic kernel B(d) = d/(8 pi)
+  };
+
+  /// Construct empty kernel matrix
+  MeshlessKernelMatrix();
+
+  /// Copy coordinates of target and source points
+  ///
+  /// \param[in] targets Target points corresponding to the matrix rows.
+  /// \param[in] sources Source points corresponding to the matrix columns.
+  void Initialize(vtkPoints *targets, const PointSet &sources);
+
+  /// Append source point, i.e., a column of the kernel matrix
+  ///
+  /// \returns Index of new source point.
+  int AddSourcePoint(const Point &p);
+
+  /// Number of target points, i.e., rows
+  int NumberOfTargetPoints() const;
+
+  /// Number of source points, i.e., columns
+  int NumberOfSourcePoints() const;
+
+  /// Compute tile of kernel function values
+  ///
+  /// \param[in]  kernel Kernel function.
+  /// \param[in]  r0     Index of first target point.
+  /// \param[in]  nrows  Number of target points.
+  /// \param[in]  cols   Indices of source points. When \c nullptr, the
+  ///                    first \p ncols source points are used.
+  /// \param[in]  ncols  Number of source points.
+  /// \param[out] tile   Kernel function values in column-major order.
+  /// \param[in]  ld     Leading dimension of \p tile. When zero, \p nrows is used.
+  template <class TValue>
+  void Fill(KernelType kernel, int r0, int nrows, const int *cols, int ncols,
+            TValue *tile, size_t ld = 0) const;
+
+  /// Compute tile of kernel function values of a kernel policy
+  ///
+  /// \sa Fill(KernelType, int, int, const int *, int, TValue *, size_t)
+  template <class TKernel, class TValue>
+  void Fill(const TKernel &kernel, int r0, int nrows, const int *cols, int ncols,
+            TValue *tile, size_t ld = 0) const;
+
+  /// Compute tiles of two kernel policies in one pass
+  ///
+  /// The distance of each pair of target and source point is computed once
+  /// and both kernel functions are evaluated for it.
+  ///
+  /// \param[in]  kernel1 First kernel function.
+  /// \param[in]  kernel2 Second kernel function.
+  /// \param[in]  r0      Index of first target point.
+  /// \param[in]  nrows   Number of target points.
+  /// \param[in]  cols    Indices of source points. When \c nullptr, the
+  ///                     first \p ncols source points are used.
+  /// \param[in]  ncols   Number of source points.
+  /// \param[out] tile1   Values of first kernel function in column-major order.
+  /// \param[out] tile2   Values of second kernel function in column-major order.
+  /// \param[in]  ld      Leading dimension of \p tile1 and \p tile2.
+  ///                     When zero, \p nrows is used.
+  template <class TKernel1, class TKernel2, class TValue>
+  void Fill(const TKernel1 &kernel1, const TKernel2 &kernel2,
+            int r0, int nrows, const int *cols, int ncols,
+            TValue *tile1, TValue *tile2, size_t ld = 0) const;
+
+  /// Compute kernel function values of all target points in parallel
+  ///
+  /// The columns are distributed among the threads of mirtk/Parallel.h.
+  ///
+  /// \param[in]  kernel Kernel function.
+  /// \param[in]  cols   Indices of source points. When \c nullptr, the
+  ///                    first \p ncols source points are used.
+  /// \param[in]  ncols  Number of source points.
+  /// \param[out] values Kernel function values in column-major order.
+  /// \param[in]  ld     Leading dimension of \p values. When zero,
+  ///                    NumberOfTargetPoints() is used.
+  template <class TValue>
+  void ParallelFill(KernelType kernel, const int *cols, int ncols,
+                    TValue *values, size_t ld = 0) const;
+
+  /// Compute kernel function values of a kernel policy of all target points in parallel
+  ///
+  /// \sa ParallelFill(KernelType, const int *, int, TValue *, size_t)
+  template <class TKernel, class TValue>
+  void ParallelFill(const TKernel &kernel, const int *cols, int ncols,
+                    TValue *values, size_t ld = 0) const;
+
+  /// Compute values of two kernel policies of all target points in parallel
+  ///
+  /// \sa Fill(const TKernel1 &, const TKernel2 &, int, int, const int *, int,
+  ///         TValue *, TValue *, size_t)
+  template <class TKernel1, class TKernel2, class TValue>
+  void ParallelFill(const TKernel1 &kernel1, const TKernel2 &kernel2,
+                    const int *cols, int ncols,
+                    TValue *values1, TValue *values2, size_t ld = 0) const;
+
+private:
+
+  /// Compute columns of kernel matrix in parallel
+  template <class TKernel, class TValue>
+  struct FillColumns
+  {
+    const MeshlessKernelMatrix *_Matrix;
+    TKernel                     _Kernel;
+    const int                  *_Cols;
+    TValue                     *_Values;
+    size_t                      _LeadingDimension;
+
+    void operator ()(const blocked_range<int> &re) const
+    {
+      const int m = _Matrix->NumberOfTargetPoints();
+      for (int j = re.begin(); j != re.end(); ++j) {
+        const int c = (_Cols ? _Cols[j] : j);
+        _Matrix->Fill(_Kernel, 0, m, &c, 1, _Values + static_cast<size_t>(j) * _LeadingDimension);
+      }
+    }
+  };
+
+  /// Compute columns of two kernel matrices in parallel
+  template <class TKernel1, class TKernel2, class TValue>
+  struct FillColumnPairs
+  {
+    const MeshlessKernelMatrix *_Matrix;
+    TKernel1                    _Kernel1;
+    TKernel2                    _Kernel2;
+    const int                  *_Cols;
+    TValue                     *_Values1;
+    TValue                     *_Values2;
+    size_t                      _LeadingDimension;
+
+    void operator ()(const blocked_range<int> &re) const
+    {
+      const int m = _Matrix->NumberOfTargetPoints();
+      for (int j = re.begin(); j != re.end(); ++j) {
+        const int    c      = (_Cols ? _Cols[j] : j);
+        const size_t offset = static_cast<size_t>(j) * _LeadingDimension;
+        _Matrix->Fill(_Kernel1, _Kernel2, 0, m, &c, 1, _Values1 + offset, _Values2 + offset);
+      }
+    }
+  };
+
+  Array<TReal> _TargetX, _TargetY, _TargetZ; ///< Coordinates of target points
+  Array<TReal> _SourceX, _SourceY, _SourceZ; ///< Coordinates of source points
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+MeshlessKernelMatrix<TReal>::MeshlessKernelMatrix()
+{
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+void MeshlessKernelMatrix<TReal>::Initialize(vtkPoints *targets, const PointSet &sources)
+{
+  const int m = static_cast<int>(targets->GetNumberOfPoints());
+  const int n = sources.Size();
+
+  double p[3];
+  _TargetX.resize(m);
+  _TargetY.resize(m);
+  _TargetZ.resize(m);
+  for (int i = 0; i < m; ++i) {
+    targets->GetPoint(i, p);
+    _TargetX[i] = static_cast<TReal>(p[0]);
+    _TargetY[i] = static_cast<TReal>(p[1]);
+    _TargetZ[i] = static_cast<TReal>(p[2]);
+  }
+
+  _SourceX.resize(n);
+  _SourceY.resize(n);
+  _SourceZ.resize(n);
+  for (int j = 0; j < n; ++j) {
+    const Point &q = sources(j);
+    _SourceX[j] = static_cast<TReal>(q._x);
+    _SourceY[j] = static_cast<TReal>(q._y);
+    _SourceZ[j] = static_cast<TReal>(q._z);
+  }
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+int MeshlessKernelMatrix<TReal>::AddSourcePoint(const Point &p)
+{
+  _SourceX.push_back(static_cast<TReal>(p._x));
+  _SourceY.push_back(static_cast<TReal>(p._y));
+  _SourceZ.push_back(static_cast<TReal>(p._z));
+  return static_cast<int>(_SourceX.size()) - 1;
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+inline int MeshlessKernelMatrix<TReal>::NumberOfTargetPoints() const
+{
+  return static_cast<int>(_TargetX.size());
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+inline int MeshlessKernelMatrix<TReal>::NumberOfSourcePoints() const
+{
+  return static_cast<int>(_SourceX.size());
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+template <class TValue>
+void MeshlessKernelMatrix<TReal>
+::Fill(KernelType kernel, int r0, int nrows, const int *cols, int ncols,
+       TValue *tile, size_t ld) const
+{
+  if (kernel == Harmonic) {
+    Fill(MeshlessHarmonicKernel(), r0, nrows, cols, ncols, tile, ld);
+  } else {
+    Fill(MeshlessBiharmonicKernel(), r0, nrows, cols, ncols, tile, ld);
+  }
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+template <class TKernel, class TValue>
+void MeshlessKernelMatrix<TReal>
+::Fill(const TKernel &kernel, int r0, int nrows, const int *cols, int ncols,
+       TValue *tile, size_t ld) const
+{
+  if (ld == 0) ld = static_cast<size_t>(nrows);
+
+  const TReal *x = _TargetX.data() + r0;
+  const TReal *y = _TargetY.data() + r0;
+  const TReal *z = _TargetZ.data() + r0;
+
+  TReal sx, sy, sz, dx, dy, dz;
+  for (int j = 0; j < ncols; ++j) {
+    const int c = (cols ? cols[j] : j);
+    sx = _SourceX[c], sy = _SourceY[c], sz = _SourceZ[c];
+    TValue *v = tile + static_cast<size_t>(j) * ld;
+    for (int i = 0; i < nrows; ++i) {
+      dx = x[i] - sx;
+      dy = y[i] - sy;
+      dz = z[i] - sz;
+      v[i] = static_cast<TValue>(kernel(sqrt(dx * dx + dy * dy + dz * dz)));
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+template <class TKernel1, class TKernel2, class TValue>
+void MeshlessKernelMatrix<TReal>
+::Fill(const TKernel1 &kernel1, const TKernel2 &kernel2,
+       int r0, int nrows, const int *cols, int ncols,
+       TValue *tile1, TValue *tile2, size_t ld) const
+{
+  if (ld == 0) ld = static_cast<size_t>(nrows);
+
+  const TReal *x = _TargetX.data() + r0;
+  const TReal *y = _TargetY.data() + r0;
+  const TReal *z = _TargetZ.data() + r0;
+
+  TReal sx, sy, sz, dx, dy, dz, d;
+  for (int j = 0; j < ncols; ++j) {
+    const int c = (cols ? cols[j] : j);
+    sx = _SourceX[c], sy = _SourceY[c], sz = _SourceZ[c];
+    TValue *v1 = tile1 + static_cast<size_t>(j) * ld;
+    TValue *v2 = tile2 + static_cast<size_t>(j) * ld;
+    for (int i = 0; i < nrows; ++i) {
+      dx = x[i] - sx;
+      dy = y[i] - sy;
+      dz = z[i] - sz;
+      d  = sqrt(dx * dx + dy * dy + dz * dz);
+      v1[i] = static_cast<TValue>(kernel1(d));
+      v2[i] = static_cast<TValue>(kernel2(d));
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+template <class TValue>
+void MeshlessKernelMatrix<TReal>
+::ParallelFill(KernelType kernel, const int *cols, int ncols, TValue *values, size_t ld) const
+{
+  if (kernel == Harmonic) {
+    ParallelFill(MeshlessHarmonicKernel(), cols, ncols, values, ld);
+  } else {
+    ParallelFill(MeshlessBiharmonicKernel(), cols, ncols, values, ld);
+  }
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+template <class TKernel, class TValue>
+void MeshlessKernelMatrix<TReal>
+::ParallelFill(const TKernel &kernel, const int *cols, int ncols, TValue *values, size_t ld) const
+{
+  FillColumns<TKernel, TValue> fill;
+  fill._Matrix           = this;
+  fill._Kernel           = kernel;
+  fill._Cols             = cols;
+  fill._Values           = values;
+  fill._LeadingDimension = (ld == 0 ? static_cast<size_t>(NumberOfTargetPoints()) : ld);
+  parallel_for(blocked_range<int>(0, ncols), fill);
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+template <class TKernel1, class TKernel2, class TValue>
+void MeshlessKernelMatrix<TReal>
+::ParallelFill(const TKernel1 &kernel1, const TKernel2 &kernel2,
+               const int *cols, int ncols,
+               TValue *values1, TValue *values2, size_t ld) const
+{
+  FillColumnPairs<TKernel1, TKernel2, TValue> fill;
+  fill._Matrix           = this;
+  fill._Kernel1          = kernel1;
+  fill._Kernel2          = kernel2;
+  fill._Cols             = cols;
+  fill._Values1          = values1;
+  fill._Values2          = values2;
+  fill._LeadingDimension = (ld == 0 ? static_cast<size_t>(NumberOfTargetPoints()) : ld);
+  parallel_for(blocked_range<int>(0, ncols), fill);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessKernelMatrix_H
@@ -0,0 +1,224 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessKernelSum_H
+#define MIRTK_MeshlessKernelSum_H
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Matrix.h"
+#include "mirtk/PointSet.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Evaluates the kernel sum of a meshless map at blocks of points
+ *
+ * The source point coordinates and the coefficients of each map component
+ * are stored in a structure-of-arrays (SoA) layout such that the inner loops
+ * over a block of BlockSize target points have unit stride and no reductions.
+ * These loops are vectorized by the compiler for the instruction set the
+ * library is built for. The coefficients are pre-multiplied by the constant
+ * factors of the harmonic kernel H(d) = 1/(4 pi d) and the biharmonic kernel
+ * B(d) = d/(8 pi), respectively, such that only a square root and a division
+ * remain per pair of source and target point.
+ *
+ * \tparam TReal Floating point type used for the kernel sum, i.e., either
+ *               \c double or \c float. Single precision halves the memory
+ *               bandwidth and doubles the number of vector lanes.
+ */
+template <class TReal>
+class MeshlessKernelSum
+{
+public:
+
+  /// Number of target points processed at once
+  static const int BlockSize = 64;
+
+  /// Constructor
+  ///
+  /// \param[in] sources    Source points, i.e., centers of kernel functions.
+  /// \param[in] coeffs     Coefficients of the meshless map. When \p biharmonic
+  ///                       is \c true, the first n rows are the coefficients of
+  ///                       the harmonic kernel and the following n rows are
+  ///                       those of the biharmonic kernel.
+  /// \param[in] biharmonic Whether the map has a biharmonic kernel term.
+  MeshlessKernelSum(const PointSet &sources, const Matrix &coeffs, bool biharmonic = false);
+
+  /// Number of source points
+  int NumberOfSourcePoints() const;
+
+  /// Number of map components
+  int NumberOfComponents() const;
+
+  /// Evaluate kernel sum at multiple points
+  ///
+  /// \param[in]  m       Number of points.
+  /// \param[in]  xyz     Coordinates of points stored contiguously, i.e.,
+  ///                     [x_1, y_1, z_1, ..., x_m, y_m, z_m].
+  /// \param[out] values  Map values stored contiguously with NumberOfComponents()
+  ///                     values per point.
+  /// \param[out] inside  Whether each point is inside the map domain.
+  /// \param[in]  outside Value assigned to points coinciding with a source point.
+  void Evaluate(int m, const double *xyz, double *values, bool *inside, double outside) const;
+
+private:
+
+  int          _NumberOfSourcePoints; ///< Number of source points
+  int          _NumberOfComponents;   ///< Number of map components
+  bool         _Biharmonic;           ///< Whether biharmonic coefficients are set
+  Array<TReal> _X, _Y, _Z;            ///< Coordinates of source points
+  Array<TReal> _H;                    ///< Scaled harmonic coefficients of each component
+  Array<TReal> _B;                    ///< Scaled biharmonic coefficients of each component
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+MeshlessKernelSum<TReal>
+::MeshlessKernelSum(const PointSet &sources, const Matrix &coeffs, bool biharmonic)
+:
+  _NumberOfSourcePoints(sources.Size()),
+  _NumberOfComponents(coeffs.Cols()),
+  _Biharmonic(biharmonic)
+{
+  const int n   = _NumberOfSourcePoints;
+  const int dim = _NumberOfComponents;
+
+  _X.resize(n);
+  _Y.resize(n);
+  _Z.resize(n);
+  for (int i = 0; i < n; ++i) {
+    const Point &p = sources(i);
+    _X[i] = static_cast<TReal>(p._x);
+    _Y[i] = static_cast<TReal>(p._y);
+    _Z[i] = static_cast<TReal>(p._z);
+  }
+
+  const double h = .25 / pi;
+  _H.resize(dim * n);
+  for (int j = 0; j < dim; ++j)
+  for (int i = 0; i < n;   ++i) {
+    _H[j * n + i] = static_cast<TReal>(h * coeffs(i, j));
+  }
+
+  if (_Biharmonic) {
+    const double b = 1.0 / (8.0 * pi);
+    _B.resize(dim * n);
+    for (int j = 0; j < dim; ++j)
+    for (int i = 0; i < n;   ++i) {
+      _B[j * n + i] = static_cast<TReal>(b * coeffs(i + n, j));
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+inline int MeshlessKernelSum<TReal>::NumberOfSourcePoints() const
+{
+  return _NumberOfSourcePoints;
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+inline int MeshlessKernelSum<TReal>::NumberOfComponents() const
+{
+  return _NumberOfComponents;
+}
+
+// -----------------------------------------------------------------------------
+template <class TReal>
+void MeshlessKernelSum<TReal>
+::Evaluate(int m, const double *xyz, double *values, bool *inside, double outside) const
+{
+  const int    n    = _NumberOfSourcePoints;
+  const int    dim  = _NumberOfComponents;
+  const TReal  one  = static_cast<TReal>(1);
+  const double eps2 = 1e-24;
+
+  TReal x[BlockSize], y[BlockSize], z[BlockSize];
+  TReal r[BlockSize], ir[BlockSize], r2min[BlockSize];
+  Array<TReal> acc(dim * BlockSize);
+
+  TReal dx, dy, dz, r2, sx, sy, sz, c, *a;
+
+  for (int b = 0; b < m; b += BlockSize) {
+    const int     nb = (m - b < BlockSize ? m - b : BlockSize);
+    const double *p  = xyz + 3 * b;
+
+    // Transpose block of target points to SoA layout
+    for (int k = 0; k < nb; ++k, p += 3) {
+      x[k] = static_cast<TReal>(p[0]);
+      y[k] = static_cast<TReal>(p[1]);
+      z[k] = static_cast<TReal>(p[2]);
+      r2min[k] = numeric_limits<TReal>::max();
+    }
+    for (size_t k = 0; k < acc.size(); ++k) acc[k] = TReal(0);
+
+    // Accumulate kernel sum of each component
+    for (int i = 0; i < n; ++i) {
+      sx = _X[i], sy = _Y[i], sz = _Z[i];
+      for (int k = 0; k < nb; ++k) {
+        dx = x[k] - sx;
+        dy = y[k] - sy;
+        dz = z[k] - sz;
+        r2 = dx * dx + dy * dy + dz * dz;
+        r2min[k] = (r2 < r2min[k] ? r2 : r2min[k]);
+        r [k] = sqrt(r2);
+        ir[k] = one / r[k];
+      }
+      for (int j = 0; j < dim; ++j) {
+        c = _H[j * n + i];
+        a = acc.data() + j * BlockSize;
+        for (int k = 0; k < nb; ++k) {
+          a[k] += c * ir[k];
+        }
+      }
+      if (_Biharmonic) {
+        for (int j = 0; j < dim; ++j) {
+          c = _B[j * n + i];
+          a = acc.data() + j * BlockSize;
+          for (int k = 0; k < nb; ++k) {
+            a[k] += c * r[k];
+          }
+        }
+      }
+    }
+
+    // Store map values in AoS layout
+    double *v = values + dim * b;
+    for (int k = 0; k < nb; ++k, v += dim) {
+      const bool is_inside = (static_cast<double>(r2min[k]) >= eps2);
+      for (int j = 0; j < dim; ++j) {
+        v[j] = (is_inside ? static_cast<double>(acc[j * BlockSize + k]) : outside);
+      }
+      if (inside) inside[b + k] = is_inside;
+    }
+  }
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessKernelSum_H
@@ -23,6 +23,7 @@
 #include "mirtk/Mapping.h"
 
 #include "mirtk/Math.h"
+#include "mirtk/Array.h"
 #include "mirtk/Matrix.h"
 #include "mirtk/PointSet.h"
 
@@ -105,20 +106,48 @@ public:
   /// \returns Whether source point was added or too close to existing point.
   bool AddSourcePoint(double p[3], double tol = .0);
 
+  /// Add source points with zero coefficients
+  ///
+  /// Unlike AddSourcePoint, the new points are not compared to the existing
+  /// source points and the coefficients matrix is resized only once.
+  void AddSourcePoints(const PointSet &points);
+
+  /// Remove source points and their coefficients
+  ///
+  /// \param[in] remove Whether to remove each source point.
+  ///
+  /// \returns Number of removed source points.
+  int RemoveSourcePoints(const Array<bool> &remove);
+
   /// Get number of source points
   int NumberOfSourcePoints() const;
 
+  /// Set coefficients of i-th source point to zero
+  virtual void ClearCoefficients(int i);
+
+  /// Frobenius norm of coefficients of i-th source point
+  virtual double CoefficientsNorm(int i) const;
+
   // ---------------------------------------------------------------------------
   // Evaluation
 
   /// Dimension of codomain, i.e., number of output values
   virtual int NumberOfComponents() const;
 
+protected:
+
+  /// Resize coefficients matrix to the given number of source points,
+  /// where the coefficients of new source points are zero
+  virtual void ResizeCoefficients(int n);
+
+  /// Keep only the coefficients of the given source points in the given order
+  ///
+  /// \param[in] keep Indices of remaining source points.
+  virtual void SelectCoefficients(const Array<int> &keep);
+
   // ---------------------------------------------------------------------------
   // I/O
 
-protected:
-
   /// Read map attributes and parameters from file stream
   virtual void ReadMap(Cifstream &);
 
@@ -145,10 +174,25 @@ inline bool MeshlessMap::AddSourcePoint(double p[3], double tol)
     }
   }
   _SourcePoints.Add(p);
-  _Coefficients.Resize(_SourcePoints.Size(), _Coefficients.Cols());
+  this->ResizeCoefficients(_SourcePoints.Size());
   return true;
 }
 
+// -----------------------------------------------------------------------------
+inline void MeshlessMap::AddSourcePoints(const PointSet &points)
+{
+  for (int i = 0; i < points.Size(); ++i) {
+    _SourcePoints.Add(points(i));
+  }
+  this->ResizeCoefficients(_SourcePoints.Size());
+}
+
+// -----------------------------------------------------------------------------
+inline void MeshlessMap::ResizeCoefficients(int n)
+{
+  _Coefficients.Resize(n, _Coefficients.Cols());
+}
+
 // -----------------------------------------------------------------------------
 inline int MeshlessMap::NumberOfSourcePoints() const
 {
@@ -0,0 +1,148 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MeshlessTreecode_H
+#define MIRTK_MeshlessTreecode_H
+
+#include "mirtk/Array.h"
+#include "mirtk/Matrix.h"
+#include "mirtk/PointSet.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Hierarchical evaluation of the kernel sum of a meshless map
+ *
+ * This Barnes-Hut type treecode partitions the source points into a binary
+ * space partitioning tree. The contribution of the source points of a tree
+ * node to the kernel sum at a target point is approximated by the multipole
+ * expansion of the harmonic kernel H(d) = 1/(4 pi d) and the biharmonic
+ * kernel B(d) = d/(8 pi) up to second order about the node center when the
+ * multipole acceptance criterion r / R < theta is satisfied, where r is the
+ * radius of the node and R the distance of the target point from its center.
+ * Otherwise, the children of the node are visited, down to the leaves at
+ * which the kernel sum is evaluated directly. The relative error of the
+ * approximation is of the order theta^3, while the cost of evaluating the
+ * kernel sum at a point is only logarithmic in the number of source points.
+ */
+class MeshlessTreecode
+{
+public:
+
+  /// Maximum number of source points per leaf node
+  static const int LeafSize = 32;
+
+  /// Constructor
+  ///
+  /// \param[in] sources    Source points, i.e., centers of kernel functions.
+  /// \param[in] coeffs     Coefficients of the meshless map. When \p biharmonic
+  ///                       is \c true, the first n rows are the coefficients of
+  ///                       the harmonic kernel and the following n rows are
+  ///                       those of the biharmonic kernel.
+  /// \param[in] biharmonic Whether the map has a biharmonic kernel term.
+  /// \param[in] theta      Opening angle of multipole acceptance criterion,
+  ///                       where a value in (0, 1) is required.
+  MeshlessTreecode(const PointSet &sources, const Matrix &coeffs,
+                   bool biharmonic = false, double theta = .5);
+
+  /// Number of source points
+  int NumberOfSourcePoints() const;
+
+  /// Number of map components
+  int NumberOfComponents() const;
+
+  /// Number of tree nodes
+  int NumberOfNodes() const;
+
+  /// Evaluate kernel sum at a point
+  ///
+  /// \param[in]  p Point coordinates.
+  /// \param[out] v Map value.
+  ///
+  /// \returns Whether the point does not coincide with a source point.
+  bool Evaluate(const double p[3], double *v) const;
+
+  /// Evaluate kernel sum at multiple points
+  ///
+  /// \param[in]  m       Number of points.
+  /// \param[in]  xyz     Coordinates of points stored contiguously, i.e.,
+  ///                     [x_1, y_1, z_1, ..., x_m, y_m, z_m].
+  /// \param[out] values  Map values stored contiguously with NumberOfComponents()
+  ///                     values per point.
+  /// \param[out] inside  Whether each point is inside the map domain.
+  /// \param[in]  outside Value assigned to points coinciding with a source point.
+  void Evaluate(int m, const double *xyz, double *values, bool *inside, double outside) const;
+
+private:
+
+  /// Node of binary space partitioning tree
+  ///
+  /// The left child of an inner node is stored right after its parent.
+  struct Node
+  {
+    double _Center[3]; ///< Center of expansion
+    double _Radius;    ///< Maximum distance of source points from center
+    int    _Offset;    ///< Index of right child or of first source point of leaf
+    int    _Count;     ///< Number of source points of leaf node, zero for inner node
+  };
+
+  /// Build subtree for source points in the given range of the point order
+  int BuildNode(Array<int> &, const PointSet &, int, int);
+
+  /// Compute multipole moments of each tree node
+  void ComputeMoments();
+
+  int           _NumberOfSourcePoints; ///< Number of source points
+  int           _NumberOfComponents;   ///< Number of map components
+  int           _NumberOfKernels;      ///< Number of kernel terms, i.e., 1 or 2
+  double        _Theta2;               ///< Squared opening angle
+  Array<Node>   _Nodes;                ///< Tree nodes in depth-first order
+  Array<double> _Points;               ///< Source point coordinates in leaf order
+  Array<double> _Coefficients;         ///< Scaled coefficients of each point and kernel
+  Array<double> _Moments;              ///< Multipole moments of each node
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int MeshlessTreecode::NumberOfSourcePoints() const
+{
+  return _NumberOfSourcePoints;
+}
+
+// -----------------------------------------------------------------------------
+inline int MeshlessTreecode::NumberOfComponents() const
+{
+  return _NumberOfComponents;
+}
+
+// -----------------------------------------------------------------------------
+inline int MeshlessTreecode::NumberOfNodes() const
+{
+  return static_cast<int>(_Nodes.size());
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MeshlessTreecode_H
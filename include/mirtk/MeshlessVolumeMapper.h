@@ -23,6 +23,7 @@
 #include "mirtk/VolumeMapper.h"
 
 #include "mirtk/Array.h"
+#include "mirtk/String.h"
 #include "mirtk/PointSet.h"
 #include "mirtk/MeshlessMap.h"
 
@@ -32,6 +33,52 @@
 namespace mirtk {
 
 
+// =============================================================================
+// Enumerations
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Enumeration of methods to partition the source points into subsets
+enum MeshlessPartitioning
+{
+  MeshlessPartition_RoundRobin, ///< Assign i-th source point to subset i modulo number of subsets
+  MeshlessPartition_Morton,     ///< Split source points sorted along Morton (Z-order) curve
+  MeshlessPartition_KMeans      ///< Cluster source points using k-means
+};
+
+// -----------------------------------------------------------------------------
+template <>
+inline string ToString(const MeshlessPartitioning &value, int w, char c, bool left)
+{
+  const char *str;
+  switch (value) {
+    case MeshlessPartition_RoundRobin: str = "RoundRobin"; break;
+    case MeshlessPartition_Morton:     str = "Morton";     break;
+    case MeshlessPartition_KMeans:     str = "KMeans";     break;
+    default:                           str = "Unknown";    break;
+  }
+  return ToString(str, w, c, left);
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline bool FromString(const char *str, MeshlessPartitioning &value)
+{
+  const string lstr = ToLower(str);
+  if      (lstr == "roundrobin" ||
+           lstr == "round-robin") value = MeshlessPartition_RoundRobin;
+  else if (lstr == "morton")      value = MeshlessPartition_Morton;
+  else if (lstr == "kmeans" ||
+           lstr == "k-means")     value = MeshlessPartition_KMeans;
+  else return false;
+  return true;
+}
+
+// =============================================================================
+// Meshless volumetric map solver
+// =============================================================================
+
+
 /**
  * Base class of filters which compute a volumetric map of the interior of a
  * piecewise linear complex (PLC) using the method of fundamental solutions (MFS)
@@ -73,6 +120,14 @@ class MeshlessVolumeMapper : public VolumeMapper
   /// Maximum number of source points in each subset
   mirtkPublicAttributeMacro(int, MaximumNumberOfSourcePoints);
 
+  /// Method used to partition the source points into subsets
+  ///
+  /// The round-robin partition spreads each subset across the entire offset
+  /// surface. The spatial partitions keep the source points of each subset
+  /// close to each other instead, such that the kernel functions of different
+  /// subsets overlap less and the coefficients matrices are better conditioned.
+  mirtkPublicAttributeMacro(MeshlessPartitioning, SourcePartitioning);
+
   /// Number of iterations / approximation functions
   mirtkPublicAttributeMacro(int, NumberOfIterations);
 
@@ -89,9 +144,72 @@ class MeshlessVolumeMapper : public VolumeMapper
   /// distance offset value.
   mirtkPublicAttributeMacro(double, DistanceOffset);
 
+  /// Minimum distance of a new source point from the other source points
+  ///
+  /// New source points which are closer to an existing or another new source
+  /// point are discarded. If negative, the absolute value is multiplied by
+  /// the mean edge length of the offset surface.
+  mirtkPublicAttributeMacro(double, MinimumSourcePointDistance);
+
+  /// Directory of cached offset surfaces from which source points are sampled
+  ///
+  /// When not empty, the decimated offset surface is read from a VTK file in
+  /// this directory whose name is the hash value of the boundary surface and
+  /// the parameters of the offset surface construction. When no such file
+  /// exists, the offset surface is computed as usual and written to this
+  /// directory for subsequent runs with identical input.
+  mirtkPublicAttributeMacro(string, OffsetSurfaceCache);
+
   /// Upper threshold of condition number of coefficient matrix
   mirtkPublicAttributeMacro(double, MaximumConditionNumber);
 
+  /// Whether to solve the linear systems of all source points subsets
+  /// concurrently for the same residual boundary map (block-Jacobi)
+  ///
+  /// By default, the subsets are fitted one after another to the residual
+  /// boundary map left by the previous subsets (block Gauss-Seidel), which
+  /// requires a residual update after each subset. In additive mode, the
+  /// linear systems of all subsets are solved in parallel and their
+  /// solutions are combined with the damping factor AdditiveDamping.
+  mirtkPublicAttributeMacro(bool, AdditiveSubsets);
+
+  /// Damping factor of combined solutions of source points subsets in additive mode
+  ///
+  /// When non-positive, the factor which minimizes the boundary fitting error
+  /// along the combined solution is determined by a line search.
+  mirtkPublicAttributeMacro(double, AdditiveDamping);
+
+  /// File to which the map is written periodically during the iterations
+  ///
+  /// The number of completed iterations is written to a file with the same
+  /// name and extension ".state", which is replaced only after the map file.
+  /// When empty, no checkpoints are written.
+  mirtkPublicAttributeMacro(string, CheckpointFile);
+
+  /// Number of iterations between checkpoints
+  mirtkPublicAttributeMacro(int, CheckpointInterval);
+
+  /// Whether to resume the iterations from an existing CheckpointFile
+  ///
+  /// The source points and coefficients of the map are restored from the
+  /// checkpoint, which must have been written for the same input and
+  /// parameters. The residual boundary map is recomputed from the restored
+  /// map. When no checkpoint exists yet, the map is computed from scratch.
+  mirtkPublicAttributeMacro(bool, Resume);
+
+  /// Maximum relative increase of the boundary fitting error (MSE) by the
+  /// removal of source points after the last iteration
+  ///
+  /// Source points are removed in batches in order of increasing contribution
+  /// to the boundary map, and the remaining source points are refitted after
+  /// each batch. A batch is rejected and its size halved when the refitted
+  /// map exceeds the admissible error. When non-positive, all source points
+  /// are kept.
+  mirtkPublicAttributeMacro(double, SparsificationTolerance);
+
+  /// Number of boundary fitting iterations after each removed batch of source points
+  mirtkPublicAttributeMacro(int, NumberOfSparsificationIterations);
+
   /// Decimated offset surface from which to sample the source points
   mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkPolyData>, OffsetSurface);
 
@@ -104,6 +222,23 @@ class MeshlessVolumeMapper : public VolumeMapper
   /// Residual boundary map
   mirtkAttributeMacro(vtkSmartPointer<vtkDataArray>, ResidualMap);
 
+  /// Source points subsets of cached Cholesky factors
+  mirtkAttributeMacro(Array<Array<int> >, FactorPartition);
+
+  /// Cholesky factors of the regularized coefficient matrices of the source
+  /// points subsets, which are reused while a subset remains unchanged
+  ///
+  /// Only the right-hand side of the linear system of a source points subset
+  /// changes from one iteration to the next as long as no source points are
+  /// added to it. The lower triangular factor L of A + alpha I = L L^T is
+  /// therefore kept such that the system is solved by forward and backward
+  /// substitution in O(n^2) instead of recomputing A in O(m n^2) and
+  /// factorizing it in O(n^3) operations.
+  mirtkAttributeMacro(Array<Matrix>, Factor);
+
+  /// Regularization weight of cached Cholesky factors
+  mirtkAttributeMacro(double, FactorRegularization);
+
 protected:
 
   /// Get total number of boundary / constraints points
@@ -161,6 +296,16 @@ protected:
   /// Compute and sample offset surface for placement of source points
   virtual void PlaceSourcePoints();
 
+  /// Compute decimated offset surface of boundary surface
+  ///
+  /// The unsigned distance to the boundary surface is computed in parallel
+  /// at the lattice points within a narrow band around the surface. Its
+  /// isosurface at the offset distance outside the boundary surface is
+  /// smoothed and decimated.
+  ///
+  /// \param[in] offset Absolute distance of offset surface.
+  virtual vtkSmartPointer<vtkPolyData> ComputeOffsetSurface(double offset);
+
   /// Add new source point
   ///
   /// \param[in] q Source point coordinates.
@@ -168,9 +313,37 @@ protected:
   /// \returns Whether source point was added or too close to existing point.
   virtual bool AddSourcePoint(double q[3]);
 
-  /// Evenly partition source points into smaller subsets
+  /// Add new source points at once
+  ///
+  /// \param[in] points Source points whose distance from each other and from
+  ///                   the existing source points exceeds a tolerance.
+  virtual void AddSourcePoints(const PointSet &points);
+
+  /// Insert new source points near boundary points with high residual error
+  ///
+  /// The boundary points whose squared residual norm exceeds the threshold
+  /// are selected and projected onto the offset surface in parallel. The
+  /// projected points are added as new source points at once, except for
+  /// those closer than MinimumSourcePointDistance to another source point.
+  ///
+  /// \param[in] threshold Threshold of squared residual norm.
+  ///
+  /// \returns Number of inserted source points.
+  int InsertSourcePoints(double threshold);
+
+  /// Partition source points into smaller subsets
+  ///
+  /// The indices of the source points of each subset are sorted, such that a
+  /// subset which only gained new source points since the last partitioning
+  /// starts with its previous source points and its cached Cholesky factor
+  /// is updated rather than recomputed.
   virtual void PartitionSourcePoints();
 
+  /// Partition source points into compact subsets
+  ///
+  /// \param[in] nsubsets Number of subsets.
+  void PartitionSourcePointsSpatially(int nsubsets);
+
   /// Initialize residual boundary map
   virtual void InitializeResidualMap();
 
@@ -181,12 +354,145 @@ protected:
                                    double * = nullptr,
                                    double * = nullptr);
 
+  /// Update residual boundary map after weights of k-th subset were added
+  ///
+  /// Only the boundary map values of the added weights of the source points
+  /// subset are subtracted from the residual boundary map, which requires
+  /// O(m n_k) instead of O(m N) operations to re-evaluate the entire output
+  /// map at all boundary points. The error statistics are computed in the
+  /// same parallel pass. When the subclass does not implement GetBoundaryMap,
+  /// the entire residual boundary map is re-evaluated instead.
+  ///
+  /// \param[in] k Index of source points subset.
+  /// \param[in] w Weights added to the volumetric map.
+  ///
+  /// \returns Mean squared error of boundary map approximation.
+  double UpdateResidualMap(int k, const Matrix &w, double * = nullptr,
+                                                   double * = nullptr,
+                                                   double * = nullptr);
+
   /// Initialize filter after input and parameters are set
   virtual void Initialize();
 
   /// Compute meshless map coefficients
   virtual void Solve();
 
+  /// Restore map from checkpoint file if Resume is enabled
+  ///
+  /// The source points that were inserted before the checkpoint was written
+  /// are added using AddSourcePoints, such that subclasses update their data
+  /// structures, before the map coefficients are read from the file.
+  ///
+  /// \returns Number of completed iterations, zero when not resumed.
+  int RestoreCheckpoint();
+
+  /// Write map and number of completed iterations to checkpoint file
+  ///
+  /// \param[in] iter Number of completed iterations.
+  void WriteCheckpoint(int iter) const;
+
+  /// Write checkpoint after the given number of completed iterations
+  /// when due according to CheckpointInterval
+  void WriteCheckpointIfDue(int iter) const;
+
+  /// Notify observer of boundary fitting error after the given number of
+  /// completed iterations
+  ///
+  /// \returns Whether to continue the boundary fitting iterations.
+  bool NotifyFittingError(int iter, double error, double min_error,
+                          double max_error, double std_error) const;
+
+  /// Fit source points subsets to the residual boundary map
+  ///
+  /// The subsets are fitted one after another or concurrently when
+  /// AdditiveSubsets is enabled.
+  ///
+  /// \param[in,out] alpha Regularization weight, see Factorize.
+  /// \param[out]    min   Minimum squared error of boundary map approximation.
+  /// \param[out]    max   Maximum squared error of boundary map approximation.
+  /// \param[out]    std   Standard deviation of squared error.
+  ///
+  /// \returns Mean squared error of boundary map approximation.
+  double FitSourcePointSets(double &alpha, double *min = nullptr,
+                                           double *max = nullptr,
+                                           double *std = nullptr);
+
+  /// Get contribution of each source point to the boundary map
+  ///
+  /// The default implementation uses the norm of the coefficients of each
+  /// source point, which ignores the magnitude of its kernel functions.
+  virtual void GetSourcePointContributions(Array<double> &) const;
+
+  /// Remove source points from the output map
+  ///
+  /// Subclasses which store additional data of each source point override
+  /// this function to update their data structures.
+  ///
+  /// \param[in] remove Whether to remove each source point.
+  virtual void RemoveSourcePoints(const Array<bool> &remove);
+
+  /// Refit map to boundary map without the source points marked as removed
+  ///
+  /// \param[in,out] alpha   Regularization weight, see Factorize.
+  /// \param[in]     removed Whether each source point was removed, where the
+  ///                         coefficients of removed source points are zero.
+  ///
+  /// \returns Mean squared error of boundary map approximation.
+  double RefitSourcePoints(double &alpha, const Array<bool> &removed,
+                           double *min = nullptr,
+                           double *max = nullptr,
+                           double *std = nullptr);
+
+  /// Remove source points with insignificant contribution to the boundary map
+  ///
+  /// \param[in,out] alpha Regularization weight, see Factorize.
+  ///
+  /// \returns Number of removed source points.
+  int SparsifySourcePoints(double &alpha);
+
+  /// Fit all source points subsets concurrently to the residual boundary map
+  ///
+  /// \param[in,out] alpha Regularization weight, see Factorize.
+  /// \param[out]    min   Minimum squared error of boundary map approximation.
+  /// \param[out]    max   Maximum squared error of boundary map approximation.
+  /// \param[out]    std   Standard deviation of squared error.
+  ///
+  /// \returns Mean squared error of boundary map approximation.
+  double SolveAdditive(double &alpha, double *min = nullptr,
+                                      double *max = nullptr,
+                                      double *std = nullptr);
+
+  /// Factorize regularized coefficients matrix of k-th source points subset
+  ///
+  /// \param[in]     k     Index of source points subset.
+  /// \param[in,out] alpha Regularization weight. When zero, it is set such
+  ///                      that the condition number of the regularized matrix
+  ///                      is at most MaximumConditionNumber.
+  ///
+  /// \returns Whether the cached factor of this subset was reused or updated.
+  bool Factorize(int k, double &alpha);
+
+  /// Update cached Cholesky factor of k-th subset after source points were appended
+  ///
+  /// When the cached subset is a prefix of the current subset, i.e., when only
+  /// new source points were added to it, the rows of the factor corresponding
+  /// to the new points are appended to the existing factor. This requires only
+  /// the coefficients of the new columns, i.e., O(m n) operations per source
+  /// point instead of the O(m n^2) and O(n^3) operations, respectively, of
+  /// recomputing and refactorizing the entire coefficients matrix.
+  ///
+  /// \param[in] k Index of source points subset.
+  ///
+  /// \returns Whether the factor was updated.
+  bool UpdateFactor(int k);
+
+  /// Solve linear system of k-th source points subset using its Cholesky factor
+  ///
+  /// \param[in]  k Index of source points subset.
+  /// \param[in]  b Right-hand side of linear system.
+  /// \param[out] x Solution of linear system.
+  void SolveFactorized(int k, const Matrix &b, Matrix &x) const;
+
   // ---------------------------------------------------------------------------
   // Linear system
 
@@ -199,6 +505,22 @@ protected:
   /// \param[out] coeff Coefficients matrix.
   virtual void GetCoefficients(int k, Matrix &coeff) const = 0;
 
+  /// Get columns of coefficients matrix of source points appended to a subset
+  ///
+  /// This function is only implemented by subclasses whose unknowns of the
+  /// appended source points follow those of the leading source points of the
+  /// subset, such that the coefficients matrix is extended by new trailing
+  /// rows and columns.
+  ///
+  /// \param[in]  k     Index of source points subset.
+  /// \param[in]  n0    Number of leading source points whose coefficients
+  ///                   are known, i.e., index of first appended source point.
+  /// \param[out] coeff Trailing columns of coefficients matrix with one row
+  ///                   per unknown of the entire subset.
+  ///
+  /// \returns Whether the coefficients of appended source points are available.
+  virtual bool GetAppendedCoefficients(int k, int n0, Matrix &coeff) const;
+
   /// Get right-hand side of linear system
   ///
   /// \param[in]  k Index of source points subset.
@@ -211,6 +533,15 @@ protected:
   /// \param[in] w Solution of linear system.
   virtual void AddWeights(int k, const Matrix &w) = 0;
 
+  /// Evaluate boundary map corresponding to weights of k-th subset
+  ///
+  /// \param[in]  k Index of source points subset.
+  /// \param[in]  w Weights of source points subset.
+  /// \param[out] f Boundary map values with one row per boundary point.
+  ///
+  /// \returns Whether the boundary map values are available.
+  virtual bool GetBoundaryMap(int k, const Matrix &w, Matrix &f) const;
+
 };
 
 ////////////////////////////////////////////////////////////////////////////////
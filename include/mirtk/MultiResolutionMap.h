@@ -0,0 +1,335 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_MultiResolutionMap_H
+#define MIRTK_MultiResolutionMap_H
+
+#include "mirtk/Mapping.h"
+#include "mirtk/PiecewiseLinearMap.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Piecewise linear map with a hierarchy of decimated domain meshes
+ *
+ * Each level of detail is a piecewise linear map whose domain mesh is a
+ * decimation of the domain of the next finer level, where level 0 is the
+ * input map at full resolution. The map values at the points of a coarse
+ * level are interpolated from the finest level. The approximation error of
+ * each level is the maximum norm of the difference between the finest map
+ * values and the coarse map interpolated at the closest points of the finest
+ * domain mesh. The map is evaluated at the active Level, which can be chosen
+ * for a given error tolerance using FindLevel.
+ *
+ * All levels are stored in a single file from the coarsest to the finest
+ * level. When the map is read, the levels finer than FinestLevelToRead are
+ * skipped without being parsed, such that a coarse map loads quickly.
+ *
+ * \note The domain of a coarse surface level only approximates the surface
+ *       of the finest level. Such level must be evaluated at points of its
+ *       own domain mesh, see Map.
+ */
+class MultiResolutionMap : public Mapping
+{
+  mirtkObjectMacro(MultiResolutionMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Piecewise linear map of each level of detail, finest level first
+  ///
+  /// Levels which were not read from file are \c nullptr. The maps are
+  /// immutable once built and shared by copies of this map.
+  mirtkAttributeMacro(Array<SharedPtr<PiecewiseLinearMap> >, Levels);
+
+  /// Maximum approximation error of each level relative to the finest level
+  mirtkReadOnlyAttributeMacro(Array<double>, LevelErrors);
+
+  /// Level of detail at which the map is evaluated
+  ///
+  /// When this level was not read from file, the finest level read is used.
+  mirtkPublicAttributeMacro(int, Level);
+
+  /// Finest level of detail read from file
+  mirtkPublicAttributeMacro(int, FinestLevelToRead);
+
+  /// Fraction of domain mesh points removed from one level to the next
+  mirtkPublicAttributeMacro(double, LevelReduction);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const MultiResolutionMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Version of map file format
+  static const int FileVersion = 1;
+
+  /// Default constructor
+  MultiResolutionMap();
+
+  /// Copy constructor
+  MultiResolutionMap(const MultiResolutionMap &);
+
+  /// Assignment operator
+  MultiResolutionMap &operator =(const MultiResolutionMap &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make copy of this map which shares the maps of each level
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~MultiResolutionMap();
+
+  // ---------------------------------------------------------------------------
+  // Levels of detail
+
+  /// Build hierarchy of levels of detail from a given map
+  ///
+  /// A triangulated surface mesh is decimated using vtkDecimatePro, where
+  /// the topology and the boundary points are preserved. A tetrahedral mesh is
+  /// decimated using vtkUnstructuredGridQuadricDecimation. The hierarchy ends
+  /// before the requested number of levels when a decimation removes less
+  /// than 10% of the points of the previous level.
+  ///
+  /// \param[in] map     Piecewise linear map at full resolution.
+  /// \param[in] nlevels Maximum number of levels including the finest level.
+  void Build(const PiecewiseLinearMap &map, int nlevels);
+
+  /// Number of levels of detail, including levels not read from file
+  int NumberOfLevels() const;
+
+  /// Finest level of detail which was read from file
+  int FinestLevel() const;
+
+  /// Whether the given level of detail was read from file
+  bool IsLoaded(int level) const;
+
+  /// Get piecewise linear map of given level of detail
+  ///
+  /// \returns Map of given level or \c nullptr when it was not read from file.
+  const PiecewiseLinearMap *Map(int level) const;
+
+  /// Coarsest level of detail whose approximation error is within tolerance
+  ///
+  /// \param[in] tol Maximum approximation error.
+  ///
+  /// \returns Coarsest level with sufficiently small error or the finest level
+  ///          read from file when no level satisfies the tolerance.
+  int FindLevel(double tol) const;
+
+  /// Level of detail at which the map is evaluated
+  int ActiveLevel() const;
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get minimum axes-aligned bounding box of domain of active level
+  ///
+  /// \param[out] x1 Lower bound of map domain along x axis.
+  /// \param[out] y1 Lower bound of map domain along y axis.
+  /// \param[out] z1 Lower bound of map domain along z axis.
+  /// \param[out] x2 Upper bound of map domain along x axis.
+  /// \param[out] y2 Upper bound of map domain along y axis.
+  /// \param[out] z2 Upper bound of map domain along z axis.
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  /// Mark bricks of a regular lattice which intersect the domain of active level
+  ///
+  /// \sa Mapping::MarkDomainBricks
+  virtual void MarkDomainBricks(const ImageAttributes &lattice, int n, Array<bool> &occupied) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., number of output values
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[out] v Map value.
+  /// \param[in]  x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point
+  ///
+  /// \param[in] x Coordinate of point along x axis at which to evaluate map.
+  /// \param[in] y Coordinate of point along y axis at which to evaluate map.
+  /// \param[in] z Coordinate of point along z axis at which to evaluate map.
+  /// \param[in] l Index of map value component.
+  ///
+  /// \returns The l-th component of the map value evaluate at the given point
+  ///          or the \c OutsideValue when input point is outside the map domain.
+  virtual double Evaluate(double x, double y, double z = 0, int l = 0) const;
+
+  /// Evaluate map at a given point using reusable scratch memory
+  ///
+  /// The context stores a nested evaluation context for each level.
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    v   Map value.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(EvaluationContext &ctx, double *v,
+                        double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at the points of a mesh
+  ///
+  /// \sa PiecewiseLinearMap::Resample
+  virtual void Resample(vtkPointSet *mesh, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// \sa PiecewiseLinearMap::Evaluate(GenericImage<float> &, int, vtkSmartPointer<vtkPointSet>)
+  virtual void Evaluate(GenericImage<float> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// \sa PiecewiseLinearMap::Evaluate(GenericImage<double> &, int, vtkSmartPointer<vtkPointSet>)
+  virtual void Evaluate(GenericImage<double> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate map at a given point at the given level of detail
+  ///
+  /// \param[in]  level Level of detail.
+  /// \param[out] v     Map value.
+  /// \param[in]  x     Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y     Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z     Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  bool EvaluateAtLevel(int level, double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points at the given level of detail
+  ///
+  /// \param[in]  level  Level of detail.
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  void EvaluateAtLevel(int level, int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at a given point at the coarsest level within tolerance
+  ///
+  /// \param[in]  tol Maximum approximation error.
+  /// \param[out] v   Map value.
+  /// \param[in]  x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z   Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  ///
+  /// \sa FindLevel
+  bool EvaluateWithTolerance(double tol, double *v, double x, double y, double z = 0) const;
+
+  // Import other overloads
+  using Mapping::EvaluateJacobian;
+
+  /// Evaluate Jacobian of map at the active level using reusable scratch memory
+  ///
+  /// \sa PiecewiseLinearMap::EvaluateJacobian
+  virtual bool EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                double x, double y, double z = 0) const;
+
+protected:
+
+  /// Get map of given level of detail or of the finest level read
+  const PiecewiseLinearMap &LevelMap(int level) const;
+
+  /// Get evaluation context of given level nested in context of this map
+  EvaluationContext &LevelContext(EvaluationContext &ctx, int level) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+  /// Read levels of detail from file stream, coarsest level first
+  virtual void ReadMap(Cifstream &);
+
+  /// Write levels of detail to file stream, coarsest level first
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int MultiResolutionMap::NumberOfLevels() const
+{
+  return static_cast<int>(_Levels.size());
+}
+
+// -----------------------------------------------------------------------------
+inline bool MultiResolutionMap::IsLoaded(int level) const
+{
+  return 0 <= level && level < NumberOfLevels() && _Levels[level] != nullptr;
+}
+
+// -----------------------------------------------------------------------------
+inline const PiecewiseLinearMap *MultiResolutionMap::Map(int level) const
+{
+  return IsLoaded(level) ? _Levels[level].get() : nullptr;
+}
+
+// -----------------------------------------------------------------------------
+inline int MultiResolutionMap::ActiveLevel() const
+{
+  return max(min(_Level, NumberOfLevels() - 1), FinestLevel());
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_MultiResolutionMap_H
@@ -64,7 +64,10 @@ public:
   /// Construct and solve (non-symmetric) system of linear equations
   virtual void ComputeMap();
 
-protected:
+  // ---------------------------------------------------------------------------
+  // Auxiliaries
+
+public:
 
   /// Weight of directed edge (i, j)
   ///
@@ -0,0 +1,413 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_ParallelConjugateGradient_H
+#define MIRTK_ParallelConjugateGradient_H
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/MapperObserver.h"
+
+#include <algorithm>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Parallel vector operations
+// =============================================================================
+
+namespace ParallelConjugateGradientUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute dot product of two vectors
+struct DotProduct
+{
+  const double *_A;
+  const double *_B;
+  double        _Value;
+
+  DotProduct() : _Value(.0) {}
+
+  DotProduct(const DotProduct &other, split)
+  :
+    _A(other._A), _B(other._B), _Value(.0)
+  {}
+
+  void join(const DotProduct &other)
+  {
+    _Value += other._Value;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Value += _A[i] * _B[i];
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute dot product of two vectors in parallel
+inline double Dot(const double *a, const double *b, int n)
+{
+  DotProduct dot;
+  dot._A = a;
+  dot._B = b;
+  parallel_reduce(blocked_range<int>(0, n), dot);
+  return dot._Value;
+}
+
+// -----------------------------------------------------------------------------
+/// Update solution and residual, i.e., x += alpha p and r -= alpha q
+struct UpdateSolution
+{
+  const double *_P;
+  const double *_Q;
+  double       *_X;
+  double       *_R;
+  double        _Alpha;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _X[i] += _Alpha * _P[i];
+      _R[i] -= _Alpha * _Q[i];
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Update search direction, i.e., p = z + beta p
+struct UpdateDirection
+{
+  const double *_Z;
+  double       *_P;
+  double        _Beta;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _P[i] = _Z[i] + _Beta * _P[i];
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute residual, i.e., r = b - r
+struct SubtractFromRightHandSide
+{
+  const double *_B;
+  double       *_R;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _R[i] = _B[i] - _R[i];
+    }
+  }
+};
+
+
+// -----------------------------------------------------------------------------
+/// Compute scaled sum of two vectors, i.e., y = a + c b
+struct AddScaled
+{
+  const double *_A;
+  const double *_B;
+  double       *_Y;
+  double        _C;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Y[i] = _A[i] + _C * _B[i];
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Update BiCGSTAB search direction, i.e., p = r + beta (p - omega v)
+struct UpdateStabilizedDirection
+{
+  const double *_R;
+  const double *_V;
+  double       *_P;
+  double        _Beta;
+  double        _Omega;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _P[i] = _R[i] + _Beta * (_P[i] - _Omega * _V[i]);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Update BiCGSTAB solution, i.e., x += alpha y + omega z
+struct UpdateStabilizedSolution
+{
+  const double *_Y;
+  const double *_Z;
+  double       *_X;
+  double        _Alpha;
+  double        _Omega;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _X[i] += _Alpha * _Y[i] + _Omega * _Z[i];
+    }
+  }
+};
+
+
+} // namespace ParallelConjugateGradientUtils
+
+// =============================================================================
+// Solver
+// =============================================================================
+
+/// Solve symmetric positive definite system using multi-threaded
+/// preconditioned conjugate gradients
+///
+/// The sparse matrix-vector products, preconditioner applications, dot
+/// products, and vector updates are executed by the threads of mirtk/Parallel.h
+/// whose number is set by the global -threads option of the MIRTK commands.
+/// The iteration stops when the residual norm relative to the norm of the
+/// right-hand side is below the given tolerance, as with Eigen::ConjugateGradient.
+///
+/// \param[in]     op      Linear operator with member functions
+///                        Multiply(const double *x, double *y) const, which
+///                        computes y = A x, and Precondition(const double *r,
+///                        double *z) const, which computes z = M^-1 r.
+/// \param[in]     n       Number of unknowns.
+/// \param[in]     b       Right-hand side vector.
+/// \param[in,out] x       Initial guess and solution vector.
+/// \param[in]     guess   Whether \p x contains an initial guess. Otherwise,
+///                        the iteration starts with the zero vector.
+/// \param[in]     maxiter Maximum number of iterations. When non-positive,
+///                        twice the number of unknowns is used.
+/// \param[in]     tol     Relative residual tolerance. When non-positive,
+///                        the machine epsilon is used.
+/// \param[out]    niter   Number of iterations.
+/// \param[out]    error   Relative residual norm of solution.
+/// \param[in]     observer Observer notified of the relative residual norm
+///                         after each iteration, which may stop the iteration.
+///
+/// \returns Whether the solver converged.
+template <class TOperator>
+bool ParallelConjugateGradient(const TOperator &op, int n, const double *b, double *x,
+                               bool guess = true, int maxiter = 0, double tol = .0,
+                               int *niter = nullptr, double *error = nullptr,
+                               MapperObserver *observer = nullptr)
+{
+  using namespace ParallelConjugateGradientUtils;
+
+  if (maxiter <= 0) maxiter = 2 * n;
+  if (tol     <= .0) tol    = numeric_limits<double>::epsilon();
+
+  if (niter) *niter = 0;
+  if (error) *error = .0;
+
+  // Trivial solution of homogeneous system
+  const double bb = Dot(b, b, n);
+  if (bb == .0) {
+    for (int i = 0; i < n; ++i) x[i] = .0;
+    return true;
+  }
+  const double threshold = tol * tol * bb;
+  const blocked_range<int> range(0, n);
+
+  // Initial residual r = b - A x
+  Array<double> r(n), z(n), p(n), q(n);
+  if (guess) {
+    SubtractFromRightHandSide residual;
+    residual._B = b;
+    residual._R = r.data();
+    op.Multiply(x, r.data());
+    parallel_for(range, residual);
+  } else {
+    for (int i = 0; i < n; ++i) x[i] = .0, r[i] = b[i];
+  }
+  double rr = Dot(r.data(), r.data(), n);
+  if (rr < threshold) {
+    if (error) *error = sqrt(rr / bb);
+    return true;
+  }
+  op.Precondition(r.data(), z.data());
+  double rz = Dot(r.data(), z.data(), n);
+
+  UpdateSolution update;
+  update._P = p.data();
+  update._Q = q.data();
+  update._X = x;
+  update._R = r.data();
+
+  UpdateDirection direction;
+  direction._Z = z.data();
+  direction._P = p.data();
+
+  p = z;
+  int iter = 0;
+  while (iter < maxiter) {
+    op.Multiply(p.data(), q.data());
+    update._Alpha = rz / Dot(p.data(), q.data(), n);
+    parallel_for(range, update);
+    rr = Dot(r.data(), r.data(), n);
+    ++iter;
+    if (rr < threshold) break;
+    if (observer && !observer->Notify("solve", iter, sqrt(rr / bb))) break;
+    op.Precondition(r.data(), z.data());
+    const double rz_next = Dot(r.data(), z.data(), n);
+    direction._Beta = rz_next / rz;
+    parallel_for(range, direction);
+    rz = rz_next;
+  }
+
+  if (niter) *niter = iter;
+  if (error) *error = sqrt(rr / bb);
+  return rr < threshold;
+}
+
+/// Solve general square system using multi-threaded right-preconditioned
+/// bi-conjugate gradient stabilized method (BiCGSTAB)
+///
+/// The linear operator, parameters, and stopping criterion are the same as
+/// those of ParallelConjugateGradient, but the system matrix need not be
+/// symmetric. When the shadow residual becomes orthogonal to the residual,
+/// the iteration is restarted with the current residual, as with Eigen::BiCGSTAB.
+///
+/// \sa ParallelConjugateGradient
+template <class TOperator>
+bool ParallelBiCGSTAB(const TOperator &op, int n, const double *b, double *x,
+                      bool guess = true, int maxiter = 0, double tol = .0,
+                      int *niter = nullptr, double *error = nullptr,
+                      MapperObserver *observer = nullptr)
+{
+  using namespace ParallelConjugateGradientUtils;
+
+  if (maxiter <= 0) maxiter = 2 * n;
+  if (tol     <= .0) tol    = numeric_limits<double>::epsilon();
+
+  if (niter) *niter = 0;
+  if (error) *error = .0;
+
+  // Trivial solution of homogeneous system
+  const double bb = Dot(b, b, n);
+  if (bb == .0) {
+    for (int i = 0; i < n; ++i) x[i] = .0;
+    return true;
+  }
+  const double threshold = tol * tol * bb;
+  const double eps2      = numeric_limits<double>::epsilon() * numeric_limits<double>::epsilon();
+  const blocked_range<int> range(0, n);
+
+  // Initial residual r = b - A x
+  Array<double> r(n), r0(n), p(n, .0), v(n, .0), s(n), t(n), y(n), z(n);
+  if (guess) {
+    SubtractFromRightHandSide residual;
+    residual._B = b;
+    residual._R = r.data();
+    op.Multiply(x, r.data());
+    parallel_for(range, residual);
+  } else {
+    for (int i = 0; i < n; ++i) x[i] = .0, r[i] = b[i];
+  }
+  double rr = Dot(r.data(), r.data(), n);
+  if (rr < threshold) {
+    if (error) *error = sqrt(rr / bb);
+    return true;
+  }
+  r0 = r;
+
+  UpdateStabilizedDirection direction;
+  direction._R = r.data();
+  direction._V = v.data();
+  direction._P = p.data();
+
+  AddScaled update_s;
+  update_s._A = r.data();
+  update_s._B = v.data();
+  update_s._Y = s.data();
+
+  AddScaled update_r;
+  update_r._A = s.data();
+  update_r._B = t.data();
+  update_r._Y = r.data();
+
+  UpdateStabilizedSolution update_x;
+  update_x._Y = y.data();
+  update_x._Z = z.data();
+  update_x._X = x;
+
+  double rho = 1., alpha = 1., omega = 1., rho_next, tt;
+  double r0r0 = rr;
+  int iter = 0;
+  while (iter < maxiter) {
+    rho_next = Dot(r0.data(), r.data(), n);
+    if (abs(rho_next) < eps2 * r0r0) {
+      // Restart with current residual as new shadow residual
+      r0 = r;
+      rho_next = r0r0 = rr;
+      std::fill(p.begin(), p.end(), .0);
+      std::fill(v.begin(), v.end(), .0);
+      rho = alpha = omega = 1.;
+    }
+    direction._Beta  = (rho_next / rho) * (alpha / omega);
+    direction._Omega = omega;
+    parallel_for(range, direction);
+    rho = rho_next;
+
+    op.Precondition(p.data(), y.data());
+    op.Multiply(y.data(), v.data());
+    alpha = rho / Dot(r0.data(), v.data(), n);
+    update_s._C = -alpha;
+    parallel_for(range, update_s);
+
+    op.Precondition(s.data(), z.data());
+    op.Multiply(z.data(), t.data());
+    tt = Dot(t.data(), t.data(), n);
+    omega = (tt > .0 ? Dot(t.data(), s.data(), n) / tt : .0);
+
+    update_x._Alpha = alpha;
+    update_x._Omega = omega;
+    parallel_for(range, update_x);
+    update_r._C = -omega;
+    parallel_for(range, update_r);
+
+    rr = Dot(r.data(), r.data(), n);
+    ++iter;
+    if (rr < threshold || omega == .0) break;
+    if (observer && !observer->Notify("solve", iter, sqrt(rr / bb))) break;
+  }
+
+  if (niter) *niter = iter;
+  if (error) *error = sqrt(rr / bb);
+  return rr < threshold;
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_ParallelConjugateGradient_H
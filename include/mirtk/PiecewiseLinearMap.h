@@ -22,16 +22,26 @@
 
 #include "mirtk/Mapping.h"
 #include "mirtk/Point.h"
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/SimplicialCellLocator.h"
 
 #include "vtkSmartPointer.h"
 #include "vtkDataSet.h"
 #include "vtkDataArray.h"
 #include "vtkAbstractCellLocator.h"
 
+#include <atomic>
+#include <mutex>
+
 
 namespace mirtk {
 
 
+// Forward declaration of array accessor used by interpolation kernels
+class DataArrayView;
+
+
 /**
  * Piecewise linear map defined at mesh nodes
  *
@@ -44,26 +54,144 @@ namespace mirtk {
  * triangular surface mesh, while a tetrahedral mesh is commonly used to
  * parameterize a volumetric map. These maps are usually computed using a
  * finite element method (FEM).
+ *
+ * Besides the map values, the domain mesh may carry further named value
+ * arrays, i.e., fields, such as the maps computed by different methods or
+ * for different labels on the same mesh. EvaluateFields locates the cell
+ * containing each point only once and interpolates all requested fields
+ * using the same interpolation weights, such that the point location and
+ * the memory of the cell locator are shared by these fields.
  */
 class PiecewiseLinearMap : public Mapping
 {
   mirtkObjectMacro(PiecewiseLinearMap);
 
+public:
+
+  /// Function which interpolates the map values at the points of a cell
+  ///
+  /// \param[in]  values Map values at domain mesh points.
+  /// \param[in]  ptIds  IDs of cell points.
+  /// \param[in]  npts   Number of cell points.
+  /// \param[in]  w      Interpolation weights of cell points.
+  /// \param[out] v      Interpolated value with one entry per component.
+  typedef void (*InterpolationKernel)(const DataArrayView &values, const vtkIdType *ptIds,
+                                      int npts, const double *w, double *v);
+
   // ---------------------------------------------------------------------------
   // Attributes
 
+protected:
+
   /// Mesh which discretizes the domain of this piecewise linear map
-  mirtkPublicAttributeMacro(vtkSmartPointer<vtkDataSet>, Domain);
+  ///
+  /// The domain mesh is shared by copies of this map. A private deep copy
+  /// is made only when the mesh is accessed for modification using the
+  /// MutableDomain() accessor while it is shared with another map.
+  mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkDataSet>, Domain);
 
   /// Point data array with map values at mesh points
-  mirtkPublicAttributeMacro(vtkSmartPointer<vtkDataArray>, Values);
+  ///
+  /// The map values are shared by copies of this map. A private deep copy
+  /// is made only when the values are accessed for modification using the
+  /// MutableValues() accessor while these are shared with another map.
+  mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkDataArray>, Values);
 
-  /// Locates cell within which a given point lies
-  mirtkAttributeMacro(vtkSmartPointer<vtkAbstractCellLocator>, Locator);
+  /// Additional value arrays at mesh points, i.e., fields 1 to NumberOfFields() - 1
+  ///
+  /// The arrays are not modified by this map and shared by copies of it.
+  mirtkAttributeMacro(Array<vtkSmartPointer<vtkDataArray> >, Fields);
+
+  /// Reference count of maps which share the domain mesh
+  mirtkAttributeMacro(SharedPtr<int>, DomainRefs);
+
+  /// Reference count of maps which share the map values
+  mirtkAttributeMacro(SharedPtr<int>, ValuesRefs);
+
+  /// Point location structures of the domain mesh
+  ///
+  /// These structures are only needed to locate the cell containing a point
+  /// and are therefore built on demand by the first evaluation of the map,
+  /// such that maps which are only converted, written, or whose values are
+  /// modified do not pay for their construction.
+  struct CellLocators
+  {
+    /// Locates cell within which a given point lies
+    ///
+    /// The locator is only queried using the thread-safe vtkAbstractCellLocator
+    /// interface and used when the domain is not a simplicial mesh.
+    vtkSmartPointer<vtkAbstractCellLocator> _Locator;
+
+    /// Locates simplicial cell within which a given point lies
+    ///
+    /// When the domain is a triangular or tetrahedral mesh, this locator is
+    /// used instead of the generic VTK cell locator.
+    SharedPtr<SimplicialCellLocator> _SimplicialLocator;
+
+    /// Number of faces of each (simplicial) cell, zero if mesh walk unsupported
+    int _NumberOfCellFaces;
+
+    /// IDs of face neighbors of each cell, where the i-th neighbor of a cell
+    /// shares the face opposite to the i-th cell point or -1 at the boundary
+    Array<vtkIdType> _CellNeighbors;
+
+    /// Whether the structures were built, set once all fields are final
+    std::atomic<bool> _Built;
+
+    /// Serializes concurrent first calls of BuildLocators
+    std::mutex _Mutex;
+
+    /// Constructor
+    CellLocators() : _NumberOfCellFaces(0), _Built(false) {}
+  };
+
+  /// Point location structures built on demand by BuildLocators
+  ///
+  /// A new, empty instance is created by Initialize. The structures are
+  /// immutable once built and shared by copies of this map, including copies
+  /// made before they were built, such that they are built at most once.
+  mirtkAttributeMacro(SharedPtr<CellLocators>, Locators);
 
   /// Maximum number cell points
   mirtkAttributeMacro(int, MaxCellSize);
 
+  /// Kernel which interpolates the map values, selected by Initialize
+  ///
+  /// When all domain cells are triangles or tetrahedra and the map values are
+  /// float or double values with up to three components, this is a kernel
+  /// specialized for the number of cell points, the number of components,
+  /// and the value type, whose loops have bounds known at compile time.
+  /// Otherwise, or when the map values were replaced by an array of another
+  /// type since, the generic kernel interpolates the values.
+  mirtkReadOnlyAttributeMacro(InterpolationKernel, Kernel);
+
+  /// Maximum number of cells visited when walking from the cell which
+  /// contained the previously evaluated point towards the next point
+  ///
+  /// When the domain is a triangular or tetrahedral mesh, a point is located
+  /// by first walking from the cell which contained the previous point through
+  /// the face neighbors in the direction of the point. Only when the walk ends
+  /// at the domain boundary or exceeds this number of steps is the point
+  /// located using the cell locator. This makes the evaluation at spatially
+  /// coherent points, such as the voxels of a lattice in scanline order,
+  /// considerably faster. A non-positive value disables the mesh walk.
+  mirtkPublicAttributeMacro(int, MaximumNumberOfWalkSteps);
+
+  /// Inverse map initialized by InitializeInverse
+  ///
+  /// The inverse map is immutable once initialized and shared by copies of this map.
+  mirtkAttributeMacro(SharedPtr<PiecewiseLinearMap>, InverseMap);
+
+  /// Number of points of each simplicial cell with cached gradients
+  mirtkAttributeMacro(int, NumberOfCellGradients);
+
+  /// Gradients of the barycentric coordinates of each simplicial cell
+  /// initialized by InitializeCellGradients
+  ///
+  /// The gradients depend only on the domain mesh, not on the map values.
+  /// This table is immutable once built and shared by copies of this map.
+  mirtkAttributeMacro(SharedPtr<Array<double> >, CellGradients);
+
   /// Squared distance tolerance used to locate cells
   /// \note Unused argument of vtkCellLocator::FindCell (as of VTK <= 7.0).
   static const double _Tolerance2;
@@ -86,11 +214,38 @@ public:
   PiecewiseLinearMap &operator =(const PiecewiseLinearMap &);
 
   /// Initialize map after inputs and parameters are set
+  ///
+  /// The inputs are validated, but the cell locator is not built until the
+  /// map is first evaluated or BuildLocators is called.
   virtual void Initialize();
 
-  /// Make deep copy of this volumetric map
+  /// Build cell locator and face neighbors if not done before
+  ///
+  /// This function is called by the first evaluation of the map which needs
+  /// to locate a point. It is safe to call it concurrently from multiple
+  /// threads, in which case the structures are built by only one of them.
+  /// Call it explicitly to build the locator before a parallel evaluation,
+  /// e.g., when the time of the evaluation itself is measured.
+  void BuildLocators() const;
+
+  /// Whether the cell locator was built
+  bool HasLocators() const;
+
+  /// Make copy of this volumetric map
+  ///
+  /// The copy shares the domain mesh, map values, and cell locators with
+  /// this map until either map modifies its domain mesh or map values.
   virtual Mapping *NewCopy() const;
 
+  /// Convert map values and domain point coordinates to single precision and
+  /// cell connectivity to 32-bit IDs when the number of points permits
+  ///
+  /// The domain mesh and map values shared with other maps or inputs are not
+  /// modified. Evaluation still interpolates the single precision values in
+  /// double precision. Initialize() must be called after the map was compacted.
+  /// \note Cell connectivity is only converted when built with VTK >= 9.
+  virtual void Compact();
+
   /// Destructor
   virtual ~PiecewiseLinearMap();
 
@@ -100,6 +255,20 @@ public:
   // Import other overloads
   using Mapping::BoundingBox;
 
+  /// Set mesh which discretizes the domain of this map
+  ///
+  /// \note Initialize() must be called before the map is evaluated.
+  void Domain(vtkDataSet *);
+
+  /// Get mesh which discretizes the domain of this map for modification
+  ///
+  /// When the domain mesh is shared with another map, a private deep copy of
+  /// the mesh is made first. Call Initialize() after the point coordinates or
+  /// cells of the returned mesh were modified. Use the const Domain() accessor
+  /// to only read the mesh, which neither copies it nor discards the cached
+  /// cell gradients.
+  vtkDataSet *MutableDomain();
+
   /// Number of discrete points at which map values are given
   int NumberOfPoints() const;
 
@@ -142,12 +311,27 @@ public:
   virtual void BoundingBox(double &x1, double &y1, double &z1,
                            double &x2, double &y2, double &z2) const;
 
+  /// Mark bricks of a regular lattice which intersect the bounding box of
+  /// at least one cell of the map domain
+  ///
+  /// \sa Mapping::MarkDomainBricks
+  virtual void MarkDomainBricks(const ImageAttributes &lattice, int n, Array<bool> &occupied) const;
+
   // ---------------------------------------------------------------------------
   // Map codomain
 
   /// Dimension of codomain, i.e., number of output values
   virtual int NumberOfComponents() const;
 
+  /// Set point data array with map values at domain mesh points
+  void Values(vtkDataArray *);
+
+  /// Get point data array with map values at domain mesh points for modification
+  ///
+  /// When the map values are shared with another map, a private deep copy of
+  /// the data array is made first.
+  vtkDataArray *MutableValues();
+
   /// Mesh discretizing the map domain with mapped mesh points
   ///
   /// \note Use this function only when the dimension of the codomain is 2 or 3.
@@ -159,6 +343,42 @@ public:
   ///          when the dimension of the codomain is not 2 or 3.
   vtkSmartPointer<vtkDataSet> Codomain() const;
 
+  /// Inverse of this map
+  ///
+  /// The domain of the inverse map is the Codomain() mesh, which shares the
+  /// cell connectivity of the domain mesh of this map, and its values are
+  /// the coordinates of the domain mesh points. The inverse map is initialized
+  /// before it is returned, while its cell locator is only built on demand.
+  ///
+  /// \note The inverse is only valid when this map is bijective.
+  ///
+  /// \returns New inverse map which must be deleted by the caller or nullptr
+  ///          when the dimension of the codomain is not 2 or 3.
+  PiecewiseLinearMap *Inverse() const;
+
+  /// Bake values at domain mesh points into an image of the map codomain
+  ///
+  /// The cells of the Codomain() mesh are rasterized in parallel, and the
+  /// values at the lattice points inside each cell are interpolated linearly
+  /// from the values at the cell points. Lattice points outside the codomain
+  /// are set to the OutsideValue. This is, for example, used to bake texture
+  /// images of surface attributes given a planar parameterization, or, when
+  /// no values are given, geometry images of the domain point coordinates.
+  ///
+  /// \note Triangulated domains require a 2D image and a 2D codomain.
+  ///
+  /// \param[out] f      Output image, whose frames are the value components.
+  /// \param[in]  values Values at domain mesh points. When \c nullptr, the
+  ///                    coordinates of the domain mesh points are used.
+  ///
+  /// \returns Whether the codomain mesh could be rasterized onto the lattice.
+  bool Bake(GenericImage<float> &f, vtkDataArray *values = nullptr) const;
+
+  /// Bake values at domain mesh points into an image of the map codomain
+  ///
+  /// \sa Bake(GenericImage<float> &, vtkDataArray *)
+  bool Bake(GenericImage<double> &f, vtkDataArray *values = nullptr) const;
+
   // ---------------------------------------------------------------------------
   // Evaluation
 
@@ -200,21 +420,367 @@ public:
   ///          or the \c OutsideValue when input point is outside the map domain.
   virtual double Evaluate(double x, double y, double z = 0, int l = 0) const;
 
+  /// Evaluate range of map value components at a given point
+  ///
+  /// Only the columns [l1, l2) of the map values at the cell points are
+  /// interpolated, unless all components are requested.
+  ///
+  /// \param[out] v  Map value components l1 to l2-1.
+  /// \param[in]  x  Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]  y  Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]  z  Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]  l1 Index of first map value component.
+  /// \param[in]  l2 Index one past last map value component.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(double *v, double x, double y, double z, int l1, int l2) const;
+
+  /// Evaluate map at a given point using reusable scratch memory
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    v   Map value.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool Evaluate(EvaluationContext &ctx, double *v,
+                        double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point using reusable scratch memory
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate map.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate map.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate map.
+  /// \param[in]     l   Index of map value component.
+  ///
+  /// \returns The l-th component of the map value evaluated at the given point
+  ///          or the \c OutsideValue when input point is outside the map domain.
+  virtual double Evaluate(EvaluationContext &ctx, double x, double y, double z = 0, int l = 0) const;
+
+  /// Evaluate range of map value components using reusable scratch memory
+  ///
+  /// \sa Evaluate(double *, double, double, double, int, int)
+  virtual bool Evaluate(EvaluationContext &ctx, double *v,
+                        double x, double y, double z, int l1, int l2) const;
+
+  /// Evaluate map at multiple points
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate map stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Map values stored contiguously with NumberOfComponents()
+  ///                    values per point.
+  /// \param[out] inside Whether each input point is inside map domain.
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at the points of a mesh
+  ///
+  /// When the mesh walk is enabled, the mesh points are visited in breadth-first
+  /// order of the edge graph of the mesh cells, and the walk to each point
+  /// starts at the cell which contained the neighboring point from which it
+  /// was reached. The breadth-first order is split into patches of points
+  /// which are evaluated in parallel. Otherwise, the map is evaluated at all
+  /// mesh points at once.
+  ///
+  /// \sa Mapping::Resample
+  virtual void Resample(vtkPointSet *mesh, double *values, bool *inside = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// When the map domain is a tetrahedral mesh, or a triangular mesh and the
+  /// lattice is two-dimensional, the cells are rasterized onto the lattice,
+  /// i.e., the map values at the lattice points within the bounding box of
+  /// each cell are interpolated directly from their barycentric coordinates.
+  /// Otherwise, the map is evaluated at each lattice point separately.
+  ///
+  /// \param[out] f Defines lattice on which to evaluate the map. The map value
+  ///               at each lattice point is stored at the respective voxel.
+  ///               The number of map values stored in the output image is
+  ///               determined by the temporal dimension of the image.
+  /// \param[in]  l Index of first map value component to store in output image.
+  /// \param[in]  m Piecewise linear complex (PLC) defining an arbitrary subset
+  ///               of the lattice points at which to evaluate the map.
+  virtual void Evaluate(GenericImage<float> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate map at each point of a regular lattice
+  ///
+  /// \sa Evaluate(GenericImage<float> &, int, vtkSmartPointer<vtkPointSet>)
+  virtual void Evaluate(GenericImage<double> &f, int l = 0, vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  // ---------------------------------------------------------------------------
+  // Multiple fields
+
+  /// Add named value array at mesh points or replace field of the same name
+  ///
+  /// \returns Index of field, where field 0 are the map Values.
+  int AddField(vtkDataArray *);
+
+  /// Remove all fields except the map Values
+  void ClearFields();
+
+  /// Number of fields including the map Values
+  int NumberOfFields() const;
+
+  /// Get index of named field
+  ///
+  /// \returns Index of field or -1 if no field has this name.
+  int FieldIndex(const char *) const;
+
+  /// Get value array of i-th field, where field 0 are the map Values
+  vtkDataArray *Field(int) const;
+
+  /// Total number of components of the given fields
+  ///
+  /// \param[in] nfields Number of fields.
+  /// \param[in] fields  Indices of fields.
+  int NumberOfFieldComponents(int nfields, const int *fields) const;
+
+  /// Evaluate multiple fields at a given point using reusable scratch memory
+  ///
+  /// The point is located only once and all fields are interpolated with the
+  /// same weights. Outside the map domain, all values are the OutsideValue.
+  ///
+  /// \param[in,out] ctx     Evaluation context owned by the calling thread.
+  /// \param[in]     nfields Number of fields.
+  /// \param[in]     fields  Indices of fields.
+  /// \param[out]    v       Values of the fields one after another.
+  /// \param[in]     x       Coordinate of point along x axis at which to evaluate fields.
+  /// \param[in]     y       Coordinate of point along y axis at which to evaluate fields.
+  /// \param[in]     z       Coordinate of point along z axis at which to evaluate fields.
+  ///
+  /// \returns Whether input point is inside map domain.
+  bool EvaluateFields(EvaluationContext &ctx, int nfields, const int *fields,
+                      double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate multiple fields at multiple points
+  ///
+  /// \param[in]  nfields Number of fields.
+  /// \param[in]  fields  Indices of fields.
+  /// \param[in]  n       Number of points.
+  /// \param[in]  xyz     Coordinates of points stored contiguously.
+  /// \param[out] values  Values stored contiguously with NumberOfFieldComponents()
+  ///                     values per point.
+  /// \param[out] inside  Whether each input point is inside map domain.
+  void EvaluateFields(int nfields, const int *fields, int n, const double *xyz,
+                      double *values, bool *inside = nullptr) const;
+
+  /// Evaluate multiple fields at each point of a regular lattice
+  ///
+  /// The cells are rasterized onto the lattice once for all fields when
+  /// possible, see Evaluate(GenericImage<float> &, int, vtkSmartPointer<vtkPointSet>).
+  ///
+  /// \param[in]  nfields Number of fields.
+  /// \param[in]  fields  Indices of fields.
+  /// \param[out] f       Defines lattice on which to evaluate the fields. The
+  ///                     number of frames must equal NumberOfFieldComponents(),
+  ///                     where the components of the fields follow one another.
+  /// \param[in]  m       Piecewise linear complex (PLC) defining an arbitrary
+  ///                     subset of the lattice points at which to evaluate.
+  void EvaluateFields(int nfields, const int *fields, GenericImage<float> &f,
+                      vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  /// Evaluate multiple fields at each point of a regular lattice
+  ///
+  /// \sa EvaluateFields(int, const int *, GenericImage<float> &, vtkSmartPointer<vtkPointSet>)
+  void EvaluateFields(int nfields, const int *fields, GenericImage<double> &f,
+                      vtkSmartPointer<vtkPointSet> m = nullptr) const;
+
+  // ---------------------------------------------------------------------------
+  // Jacobian evaluation
+
+  // Import other overloads
+  using Mapping::EvaluateJacobian;
+
+  /// Initialize table of barycentric coordinate gradients of each cell
+  ///
+  /// The Jacobian of the map is constant within each triangle or tetrahedron
+  /// and is the sum of the map values at the cell points weighted by the
+  /// gradients of their barycentric coordinates. When this table is built,
+  /// these gradients are looked up instead of being computed from the cell
+  /// points each time the Jacobian is evaluated. The table must be rebuilt
+  /// after the domain mesh was modified.
+  ///
+  /// \returns Whether the domain is a triangular or tetrahedral mesh.
+  bool InitializeCellGradients();
+
+  /// Whether the table of cell gradients was initialized
+  bool HasCellGradients() const;
+
+  /// Evaluate Jacobian of map at a given point using reusable scratch memory
+  ///
+  /// The Jacobian of the map within a triangle or tetrahedron is exact. For
+  /// other cell types, the Jacobian is approximated by finite differences.
+  /// The Jacobian of a surface map is the derivative within the plane of the
+  /// triangle containing the point, i.e., its derivative along the triangle
+  /// normal is zero.
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    jac Jacobian matrix stored row by row with three partial
+  ///                    derivatives per map component.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate Jacobian.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate Jacobian.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate Jacobian.
+  ///
+  /// \returns Whether input point is inside map domain.
+  virtual bool EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                double x, double y, double z = 0) const;
+
+  // ---------------------------------------------------------------------------
+  // Inverse evaluation
+
+  /// Initialize inverse map used by EvaluateInverse
+  ///
+  /// \returns Whether this map has an inverse, i.e., its codomain dimension is 2 or 3.
+  bool InitializeInverse();
+
+  /// Whether the inverse map was initialized
+  bool HasInverse() const;
+
+  /// Evaluate inverse map at a given point
+  ///
+  /// \param[out] v Domain point which is mapped to the given point.
+  /// \param[in]  x Coordinate of point along x axis at which to evaluate inverse.
+  /// \param[in]  y Coordinate of point along y axis at which to evaluate inverse.
+  /// \param[in]  z Coordinate of point along z axis at which to evaluate inverse.
+  ///
+  /// \returns Whether input point is inside the map codomain.
+  bool EvaluateInverse(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate inverse map at a given point using reusable scratch memory
+  ///
+  /// \param[in,out] ctx Evaluation context owned by the calling thread.
+  /// \param[out]    v   Domain point which is mapped to the given point.
+  /// \param[in]     x   Coordinate of point along x axis at which to evaluate inverse.
+  /// \param[in]     y   Coordinate of point along y axis at which to evaluate inverse.
+  /// \param[in]     z   Coordinate of point along z axis at which to evaluate inverse.
+  ///
+  /// \returns Whether input point is inside the map codomain.
+  bool EvaluateInverse(EvaluationContext &ctx, double *v,
+                       double x, double y, double z = 0) const;
+
+  /// Evaluate inverse map at multiple points
+  ///
+  /// \param[in]  n      Number of points.
+  /// \param[in]  xyz    Coordinates of points at which to evaluate inverse stored
+  ///                    contiguously, i.e., [x_1, y_1, z_1, ..., x_n, y_n, z_n].
+  /// \param[out] values Domain points stored contiguously with three coordinates per point.
+  /// \param[out] inside Whether each input point is inside map codomain.
+  void EvaluateInverse(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+protected:
+
+  /// Allocate scratch memory of evaluation context if not done before
+  void InitializeContext(EvaluationContext &) const;
+
+  /// Find cell containing the given point and compute its interpolation weights
+  ///
+  /// \returns Whether the point is inside the map domain. When \c true, the
+  ///          cell and weights of the context are set.
+  bool FindCell(EvaluationContext &, double x, double y, double z) const;
+
+  /// Walk from the cell of the previous point through face neighbors
+  ///
+  /// \returns Whether a cell containing the point was found.
+  bool WalkToCell(EvaluationContext &, const double p[3]) const;
+
+  /// Build cell locator and face neighbors of domain mesh
+  void InitializeLocators(CellLocators &) const;
+
+  /// Initialize table of face neighbors used by mesh walk
+  void InitializeCellNeighbors(CellLocators &) const;
+
+public:
+
   // ---------------------------------------------------------------------------
   // I/O
 
+  /// Enumeration of supported map file formats
+  enum FileFormat
+  {
+    UnknownFileFormat, ///< Format could not be determined
+    NativeFileFormat,  ///< Native binary format (.plm, or compressed .plmz)
+    PointSetFormat,    ///< VTK point set, i.e., surface mesh or unstructured grid
+    ImageDataFormat    ///< VTK XML image data (.vti)
+  };
+
+  /// Determine file format from leading bytes of map file and its extension
+  ///
+  /// \param[in] fname Name of map file.
+  /// \param[in] data  Leading bytes of map file.
+  /// \param[in] n     Number of leading bytes.
+  static FileFormat DetectFileFormat(const char *fname, const char *data, int n);
+
+  /// Determine file format from leading bytes of map file and its extension
+  static FileFormat DetectFileFormat(const char *fname);
+
   /// Read map from file
+  ///
+  /// Files with extension ".plm" or ".plmz" are read using the native binary
+  /// format, which includes the cell locator such that it need not be rebuilt.
+  /// When a VTK file has more than one point data array, the first array holds
+  /// the map values and the other arrays are added as fields.
   virtual bool Read(const char *);
 
+  /// Read map from file of given format
+  ///
+  /// The file is parsed only once by the reader of the given format. When the
+  /// format is unknown, the file is read as VTK point set or, if that fails,
+  /// VTK XML image data.
+  bool Read(const char *, FileFormat);
+
   /// Write map to file
+  ///
+  /// When the file name extension is ".plm", the map is written using the
+  /// native binary format, which stores only the map Values and no further
+  /// fields. When it is ".plmz", the native binary format is compressed,
+  /// i.e., each map value component is quantized to a 16-bit fixed point
+  /// number relative to the range of this component, which is given by
+  /// the bounds of the map codomain, and the cell connectivity is
+  /// losslessly delta coded. The absolute error of the decoded map values is
+  /// at most 1/131070 of the range of each component. Otherwise, a VTK file
+  /// format is used and the fields are stored as further point data arrays.
   virtual bool Write(const char *) const;
 
+protected:
+
+  /// Read map from native binary file
+  bool ReadBinary(const char *);
+
+  /// Write map to native binary file
+  ///
+  /// The cell locator is built if not done before, such that it is stored
+  /// in the file and need not be rebuilt when the map is read again.
+  ///
+  /// \param[in] fname    File name.
+  /// \param[in] compress Whether to quantize map values and delta code cells.
+  bool WriteBinary(const char *fname, bool compress = false) const;
+
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // Inline definitions
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+inline bool PiecewiseLinearMap::HasLocators() const
+{
+  return _Locators && _Locators->_Built.load(std::memory_order_acquire);
+}
+
+// -----------------------------------------------------------------------------
+inline bool PiecewiseLinearMap::HasInverse() const
+{
+  return _InverseMap != nullptr;
+}
+
+// -----------------------------------------------------------------------------
+inline bool PiecewiseLinearMap::HasCellGradients() const
+{
+  return _CellGradients != nullptr;
+}
+
 // -----------------------------------------------------------------------------
 inline int PiecewiseLinearMap::NumberOfPoints() const
 {
@@ -251,6 +817,18 @@ inline Point PiecewiseLinearMap::Point(int i) const
   return p;
 }
 
+// -----------------------------------------------------------------------------
+inline int PiecewiseLinearMap::NumberOfFields() const
+{
+  return 1 + static_cast<int>(_Fields.size());
+}
+
+// -----------------------------------------------------------------------------
+inline vtkDataArray *PiecewiseLinearMap::Field(int i) const
+{
+  return (i == 0 ? _Values.GetPointer() : _Fields[i - 1].GetPointer());
+}
+
 // -----------------------------------------------------------------------------
 inline void PiecewiseLinearMap::GetValue(int i, double *v) const
 {
@@ -0,0 +1,148 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_ReducedBoundaryBasis_H
+#define MIRTK_ReducedBoundaryBasis_H
+
+#include "Eigen/Core"
+
+
+namespace mirtk {
+
+
+/**
+ * Low-rank basis of boundary conditions of a linear map and its response
+ *
+ * When the same domain is mapped with many different boundary maps, the
+ * interior values of a linear map solver are a linear function of the
+ * boundary values. Given sample boundary values, this basis stores their
+ * mean and principal modes together with the interior values computed for
+ * each of these boundary functions. The interior values for new boundary
+ * values are then a dense linear combination of the precomputed responses,
+ * whose coefficients are the projection of the boundary values onto the
+ * modes. The map of many cases is thus computed by two dense matrix-matrix
+ * products instead of one sparse linear solve per case. The result is exact
+ * for boundary values in the span of the mean and the retained modes.
+ */
+class ReducedBoundaryBasis
+{
+public:
+
+  /// Construct empty basis
+  ReducedBoundaryBasis();
+
+  /// Compute mean and principal modes of sample boundary values
+  ///
+  /// \param[in] samples   Boundary values, one column per sample.
+  /// \param[in] max_modes Maximum number of modes. When non-positive, all
+  ///                      modes with non-zero singular value are retained.
+  /// \param[in] energy    Minimum fraction of the variance of the samples
+  ///                      explained by the retained modes.
+  void Initialize(const Eigen::MatrixXd &samples, int max_modes = 0, double energy = 1.0);
+
+  /// Number of boundary values
+  int NumberOfBoundaryValues() const;
+
+  /// Number of interior values
+  int NumberOfInteriorValues() const;
+
+  /// Number of retained modes
+  int NumberOfModes() const;
+
+  /// Fraction of variance of sample boundary values explained by retained modes
+  double ExplainedVariance() const;
+
+  /// Boundary functions whose response is required, i.e., the mean followed by the modes
+  Eigen::MatrixXd Functions() const;
+
+  /// Set interior values computed for each column of Functions
+  void Response(const Eigen::MatrixXd &);
+
+  /// Interior values computed for each column of Functions
+  const Eigen::MatrixXd &Response() const;
+
+  /// Whether the response of the boundary functions was set
+  bool HasResponse() const;
+
+  /// Compute coefficients of boundary values in basis of modes
+  ///
+  /// \param[in]  g     Boundary values, one column per case.
+  /// \param[out] alpha Coefficients of modes, one column per case.
+  void Project(const Eigen::MatrixXd &g, Eigen::MatrixXd &alpha) const;
+
+  /// Compute interior values for given boundary values
+  ///
+  /// \param[in]  g     Boundary values, one column per case.
+  /// \param[out] x     Interior values, one column per case.
+  /// \param[out] error Maximum norm of the residual of the projection of the
+  ///                   boundary values onto the modes relative to their norm.
+  void Evaluate(const Eigen::MatrixXd &g, Eigen::MatrixXd &x, double *error = nullptr) const;
+
+private:
+
+  Eigen::VectorXd _Mean;               ///< Mean of sample boundary values
+  Eigen::MatrixXd _Modes;              ///< Orthonormal modes of sample boundary values
+  Eigen::MatrixXd _Response;           ///< Response of mean and modes
+  double          _ExplainedVariance;  ///< Fraction of variance explained by modes
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int ReducedBoundaryBasis::NumberOfBoundaryValues() const
+{
+  return static_cast<int>(_Mean.rows());
+}
+
+// -----------------------------------------------------------------------------
+inline int ReducedBoundaryBasis::NumberOfInteriorValues() const
+{
+  return static_cast<int>(_Response.rows());
+}
+
+// -----------------------------------------------------------------------------
+inline int ReducedBoundaryBasis::NumberOfModes() const
+{
+  return static_cast<int>(_Modes.cols());
+}
+
+// -----------------------------------------------------------------------------
+inline double ReducedBoundaryBasis::ExplainedVariance() const
+{
+  return _ExplainedVariance;
+}
+
+// -----------------------------------------------------------------------------
+inline const Eigen::MatrixXd &ReducedBoundaryBasis::Response() const
+{
+  return _Response;
+}
+
+// -----------------------------------------------------------------------------
+inline bool ReducedBoundaryBasis::HasResponse() const
+{
+  return _Mean.rows() > 0 && _Response.cols() == _Modes.cols() + 1;
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_ReducedBoundaryBasis_H
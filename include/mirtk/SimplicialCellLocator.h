@@ -0,0 +1,168 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SimplicialCellLocator_H
+#define MIRTK_SimplicialCellLocator_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/Array.h"
+
+#include "vtkType.h"
+#include "vtkDataSet.h"
+
+#include <iosfwd>
+
+
+namespace mirtk {
+
+
+/**
+ * Bounding volume hierarchy for locating cells of triangular and tetrahedral meshes
+ *
+ * This locator stores a flattened bounding volume hierarchy (BVH) over the
+ * cells of a simplicial mesh. The inverse of the matrix of edge vectors of
+ * each cell is precomputed and stored together with the first cell point in
+ * structure-of-arrays (SoA) layout in the order of the leaf nodes. A leaf test
+ * thus computes the barycentric coordinates of a point with respect to up to
+ * LeafSize cells at once using a fixed-width loop over contiguous memory,
+ * which the compiler vectorizes.
+ *
+ * For a triangle, the third column of the edge matrix is the unit normal of
+ * the triangle plane. The third transformed coordinate is the signed distance
+ * of the point from this plane and must be within the distance tolerance.
+ *
+ * Once built, the locator is immutable and can be shared by multiple threads
+ * and piecewise linear maps.
+ */
+class SimplicialCellLocator : public Object
+{
+  mirtkObjectMacro(SimplicialCellLocator);
+
+public:
+
+  /// Maximum number of cells per leaf node
+  static const int LeafSize = 8;
+
+  /// Node of flattened bounding volume hierarchy
+  ///
+  /// The left child of an inner node is stored right after its parent.
+  struct Node
+  {
+    double _Bounds[6]; ///< Bounding box [x1, x2, y1, y2, z1, z2]
+    int    _Offset;    ///< Index of right child or of first cell of leaf
+    int    _Count;     ///< Number of cells of leaf node, zero for inner node
+  };
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+private:
+
+  /// Number of points per cell, i.e., 3 for triangles and 4 for tetrahedra
+  mirtkReadOnlyAttributeMacro(int, NumberOfCellPoints);
+
+  /// Number of located cells
+  mirtkReadOnlyAttributeMacro(int, NumberOfCells);
+
+  /// Nodes of bounding volume hierarchy in depth-first order
+  mirtkAttributeMacro(Array<Node>, Nodes);
+
+  /// IDs of dataset cells in order of leaf nodes
+  mirtkAttributeMacro(Array<vtkIdType>, CellIds);
+
+  /// IDs of cell points in order of leaf nodes
+  mirtkAttributeMacro(Array<vtkIdType>, PointIds);
+
+  /// Cell geometry in SoA layout, i.e., twelve rows of length _NumberOfCells
+  /// with the coordinates of the first cell point and the row-major entries
+  /// of the inverse edge matrix of each cell.
+  mirtkAttributeMacro(Array<double>, Geometry);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const SimplicialCellLocator &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  SimplicialCellLocator();
+
+  /// Copy constructor
+  SimplicialCellLocator(const SimplicialCellLocator &);
+
+  /// Assignment operator
+  SimplicialCellLocator &operator =(const SimplicialCellLocator &);
+
+  /// Destructor
+  virtual ~SimplicialCellLocator();
+
+  /// Whether all cells of a dataset are either triangles or tetrahedra
+  static bool IsSupported(vtkDataSet *);
+
+  /// Invert 3x3 matrix of cell edge vectors stored in row-major order
+  ///
+  /// \returns Whether the matrix is invertible, i.e., the cell is not degenerate.
+  static bool Invert3x3(const double *m, double *inv);
+
+  /// Build locator for the cells of a triangular or tetrahedral mesh
+  ///
+  /// \returns Whether the locator was build, i.e., the dataset is supported.
+  bool Build(vtkDataSet *);
+
+  /// Approximate size of locator in bytes
+  size_t MemorySize() const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+  /// Write locator to binary stream in native byte order
+  ///
+  /// Cell and point IDs are stored as int64 independent of the size of vtkIdType.
+  bool WriteBinary(std::ostream &) const;
+
+  /// Read locator from binary stream in native byte order
+  bool ReadBinary(std::istream &);
+
+  // ---------------------------------------------------------------------------
+  // Point location
+
+  /// Find cell which contains a given point
+  ///
+  /// \param[in]  p     Point coordinates.
+  /// \param[in]  tol2  Squared distance tolerance of points from triangles.
+  /// \param[out] w     Barycentric coordinates of point.
+  /// \param[out] ptIds Pointer to IDs of the cell points.
+  ///
+  /// \returns ID of dataset cell containing the point or -1 if none.
+  vtkIdType FindCell(const double p[3], double tol2, double *w, const vtkIdType *&ptIds) const;
+
+protected:
+
+  /// Build subtree for cells in the given range of the cell order
+  int BuildNode(Array<int> &, const Array<double> &, const Array<double> &, int, int);
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SimplicialCellLocator_H
@@ -0,0 +1,60 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SparseMatrixOrdering_H
+#define MIRTK_SparseMatrixOrdering_H
+
+#include "mirtk/Array.h"
+
+
+namespace mirtk {
+
+
+/// Compute reverse Cuthill-McKee ordering of symmetric sparsity pattern
+///
+/// The rows are renumbered by a breadth-first traversal of the adjacency
+/// graph, starting at a pseudo-peripheral node of each connected component
+/// and visiting the neighbors of each node by increasing degree. The reversed
+/// order reduces the bandwidth and profile of the permuted matrix, such that
+/// the coefficients accessed by a matrix-vector product or a sweep over the
+/// rows of the matrix are close in memory.
+///
+/// \param[in]  n      Number of rows and columns.
+/// \param[in]  offset Offsets into \p index of the entries of each row, array
+///                    of size \p n + 1.
+/// \param[in]  index  Column indices of the entries of each row. Diagonal
+///                    entries are ignored.
+/// \param[out] order  New to old index map, i.e., order[i] is the index of
+///                    the row which becomes the i-th row.
+void ReverseCuthillMcKeeOrdering(int n, const int *offset, const int *index, Array<int> &order);
+
+/// Compute bandwidth of symmetric sparsity pattern after renumbering
+///
+/// \param[in] n      Number of rows and columns.
+/// \param[in] offset Offsets into \p index of the entries of each row.
+/// \param[in] index  Column indices of the entries of each row.
+/// \param[in] order  New to old index map, or nullptr for identity.
+///
+/// \returns Maximum distance of an entry from the diagonal.
+int Bandwidth(int n, const int *offset, const int *index, const int *order = nullptr);
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SparseMatrixOrdering_H
@@ -0,0 +1,525 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SparseSolver_H
+#define MIRTK_SparseSolver_H
+
+#include "mirtk/SparseSolverType.h"
+#include "mirtk/AlgebraicMultigrid.h"
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Stream.h"
+
+#include "Eigen/SparseCore"
+#include "Eigen/SparseLU"
+#include "Eigen/SparseCholesky"
+#include "Eigen/OrderingMethods"
+#include "Eigen/IterativeLinearSolvers"
+
+#if MIRTK_Mapping_WITH_CHOLMOD
+#  include "Eigen/CholmodSupport"
+#endif
+#if MIRTK_Mapping_WITH_SuperLU
+#  include "Eigen/SuperLUSupport"
+#endif
+#if MIRTK_Mapping_WITH_Pardiso
+#  include "Eigen/PardisoSupport"
+#endif
+
+
+namespace mirtk {
+
+
+class MapperObserver;
+class MapperStatistics;
+
+
+// =============================================================================
+// Solve sparse linear system
+// =============================================================================
+
+namespace SparseSolverUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Solve sparse linear system using a direct method
+template <class TSolver, class TMatrix, class TRhs, class TSol>
+bool SolveDirect(TSolver &solver, const TMatrix &A, const TRhs &b, TSol &x)
+{
+  solver.compute(A);
+  if (solver.info() != Eigen::Success) return false;
+  x = solver.solve(b);
+  return solver.info() == Eigen::Success;
+}
+
+// -----------------------------------------------------------------------------
+/// Solve sparse linear system using an iterative method
+template <class TSolver, class TMatrix, class TRhs, class TSol>
+bool SolveIterative(TSolver &solver, const TMatrix &A, const TRhs &b, TSol &x,
+                    int maxiter, double tol, bool guess, int &niter, double &error)
+{
+  if (maxiter > 0) solver.setMaxIterations(maxiter);
+  if (tol     > 0.) solver.setTolerance(tol);
+  solver.compute(A);
+  if (guess) x = solver.solveWithGuess(b, x);
+  else       x = solver.solve(b);
+  niter = static_cast<int>(solver.iterations());
+  error = solver.error();
+  return solver.info() != Eigen::NumericalIssue && solver.info() != Eigen::InvalidInput;
+}
+
+// -----------------------------------------------------------------------------
+/// Solve symmetric positive definite sparse linear system using conjugate
+/// gradients with diagonal preconditioner
+template <class TMatrix, class TRhs, class TSol>
+bool SolveConjugateGradient(const TMatrix &A, const TRhs &b, TSol &x,
+                            int maxiter, double tol, bool guess, int &niter, double &error,
+                            MapperObserver * = nullptr)
+{
+  typedef Eigen::DiagonalPreconditioner<typename TMatrix::Scalar> Preconditioner;
+  Eigen::ConjugateGradient<TMatrix, Eigen::Lower|Eigen::Upper, Preconditioner> solver;
+  return SolveIterative(solver, A, b, x, maxiter, tol, guess, niter, error);
+}
+
+// -----------------------------------------------------------------------------
+/// Solve symmetric positive definite sparse linear system using multi-threaded
+/// conjugate gradients with diagonal preconditioner
+///
+/// Unlike Eigen::ConjugateGradient, which is only parallelized when Eigen uses
+/// OpenMP, the sparse matrix-vector products, dot products, and vector updates
+/// are executed by the threads of mirtk/Parallel.h.
+///
+/// \sa ParallelConjugateGradient
+bool SolveConjugateGradient(const Eigen::SparseMatrix<double> &A,
+                            const Eigen::VectorXd &b, Eigen::VectorXd &x,
+                            int maxiter, double tol, bool guess, int &niter, double &error,
+                            MapperObserver *observer = nullptr);
+
+// -----------------------------------------------------------------------------
+/// Solve symmetric positive definite sparse linear system with multiple
+/// right-hand sides using multi-threaded conjugate gradients
+///
+/// The returned number of iterations and error are the maximum over all columns.
+bool SolveConjugateGradient(const Eigen::SparseMatrix<double> &A,
+                            const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+                            int maxiter, double tol, bool guess, int &niter, double &error,
+                            MapperObserver *observer = nullptr);
+
+// -----------------------------------------------------------------------------
+/// Solve general sparse linear system using the bi-conjugate gradient
+/// stabilized method with diagonal preconditioner
+template <class TMatrix, class TRhs, class TSol>
+bool SolveBiCGSTAB(const TMatrix &A, const TRhs &b, TSol &x,
+                   int maxiter, double tol, bool guess, int &niter, double &error,
+                   MapperObserver * = nullptr)
+{
+  typedef Eigen::DiagonalPreconditioner<typename TMatrix::Scalar> Preconditioner;
+  Eigen::BiCGSTAB<TMatrix, Preconditioner> solver;
+  return SolveIterative(solver, A, b, x, maxiter, tol, guess, niter, error);
+}
+
+// -----------------------------------------------------------------------------
+/// Solve general sparse linear system using the multi-threaded bi-conjugate
+/// gradient stabilized method with diagonal preconditioner
+///
+/// The system matrix is copied once to compressed row storage, such that
+/// each value of the sparse matrix-vector products is computed by a single
+/// thread from one contiguous row.
+///
+/// \sa ParallelBiCGSTAB
+bool SolveBiCGSTAB(const Eigen::SparseMatrix<double> &A,
+                   const Eigen::VectorXd &b, Eigen::VectorXd &x,
+                   int maxiter, double tol, bool guess, int &niter, double &error,
+                   MapperObserver *observer = nullptr);
+
+// -----------------------------------------------------------------------------
+/// Solve general sparse linear system with multiple right-hand sides using
+/// the multi-threaded bi-conjugate gradient stabilized method
+///
+/// The returned number of iterations and error are the maximum over all columns.
+bool SolveBiCGSTAB(const Eigen::SparseMatrix<double> &A,
+                   const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+                   int maxiter, double tol, bool guess, int &niter, double &error,
+                   MapperObserver *observer = nullptr);
+
+
+} // namespace SparseSolverUtils
+
+// -----------------------------------------------------------------------------
+/// Solve sparse linear system of equations A x = b
+///
+/// \param[in]     type    Solver type. When SparseSolver_Default, the fastest
+///                        available direct or iterative solver for the given
+///                        type of system matrix is chosen.
+/// \param[in]     mtype   Type of system matrix.
+/// \param[in]     direct  Whether to use a direct method when \p type is
+///                        SparseSolver_Default.
+/// \param[in]     A       Sparse system matrix.
+/// \param[in]     b       Right hand side vector or matrix.
+/// \param[in,out] x       Solution vector or matrix. When \p guess is \c true,
+///                        the initial values are used as initial guess of an
+///                        iterative method.
+/// \param[in]     maxiter Maximum number of iterations of iterative method.
+/// \param[in]     tol     Tolerance of iterative method.
+/// \param[in]     guess   Whether \p x contains an initial guess.
+/// \param[out]    niter   Number of iterations of iterative method.
+/// \param[out]    error   Estimated relative error of iterative method.
+/// \param[in]     observer Observer notified after each iteration of the
+///                         conjugate gradient solver, which may stop it early.
+///
+/// \returns Type of solver used.
+template <class TMatrix, class TRhs, class TSol>
+SparseSolverType SolveSparseLinearSystem(SparseSolverType type, SparseMatrixType mtype,
+                                         bool direct, const TMatrix &A, const TRhs &b, TSol &x,
+                                         int maxiter = 0, double tol = .0, bool guess = false,
+                                         int *niter = nullptr, double *error = nullptr,
+                                         MapperObserver *observer = nullptr)
+{
+  using namespace SparseSolverUtils;
+
+  if (type == SparseSolver_Default) type = DefaultSparseSolver(mtype, direct);
+  if (!IsAvailable(type)) {
+    cerr << "SolveSparseLinearSystem: " << ToString(type) << " solver not available in this build" << endl;
+    exit(1);
+  }
+  if (mtype == SparseMatrix_General && IsSymmetricSolver(type)) {
+    cerr << "SolveSparseLinearSystem: " << ToString(type) << " solver requires symmetric matrix" << endl;
+    exit(1);
+  }
+
+  int    n = 0;
+  double e = .0;
+  bool   ok = false;
+  switch (type) {
+    case SparseSolver_LU: {
+      Eigen::SparseLU<TMatrix, Eigen::COLAMDOrdering<int> > solver;
+      ok = SolveDirect(solver, A, b, x);
+    } break;
+    case SparseSolver_LDLT: {
+      Eigen::SimplicialLDLT<TMatrix> solver;
+      ok = SolveDirect(solver, A, b, x);
+    } break;
+    case SparseSolver_LLT: {
+      Eigen::SimplicialLLT<TMatrix> solver;
+      ok = SolveDirect(solver, A, b, x);
+    } break;
+    #if MIRTK_Mapping_WITH_CHOLMOD
+      case SparseSolver_CHOLMOD: {
+        Eigen::CholmodSupernodalLLT<TMatrix> solver;
+        ok = SolveDirect(solver, A, b, x);
+      } break;
+    #endif
+    #if MIRTK_Mapping_WITH_SuperLU
+      case SparseSolver_SuperLU: {
+        Eigen::SuperLU<TMatrix> solver;
+        ok = SolveDirect(solver, A, b, x);
+      } break;
+    #endif
+    #if MIRTK_Mapping_WITH_Pardiso
+      case SparseSolver_Pardiso: {
+        if (mtype == SparseMatrix_SPD) {
+          Eigen::PardisoLLT<TMatrix> solver;
+          ok = SolveDirect(solver, A, b, x);
+        } else {
+          Eigen::PardisoLU<TMatrix> solver;
+          ok = SolveDirect(solver, A, b, x);
+        }
+      } break;
+    #endif
+    case SparseSolver_CG: {
+      ok = SolveConjugateGradient(A, b, x, maxiter, tol, guess, n, e, observer);
+    } break;
+    case SparseSolver_BiCGSTAB: {
+      ok = SolveBiCGSTAB(A, b, x, maxiter, tol, guess, n, e, observer);
+    } break;
+    case SparseSolver_AMG: {
+      Eigen::ConjugateGradient<TMatrix, Eigen::Lower|Eigen::Upper, AlgebraicMultigrid> solver;
+      ok = SolveIterative(solver, A, b, x, maxiter, tol, guess, n, e);
+    } break;
+    default: break;
+  }
+  if (!ok) {
+    cerr << "SolveSparseLinearSystem: " << ToString(type) << " solver failed to solve linear system" << endl;
+    exit(1);
+  }
+  if (niter) *niter = n;
+  if (error) *error = e;
+  return type;
+}
+
+
+// =============================================================================
+// Reusable factorization
+// =============================================================================
+
+/**
+ * Factorization of a sparse system matrix which reuses its symbolic analysis
+ *
+ * The fill-reducing ordering and the symbolic factorization of a sparse
+ * direct solver only depend on the sparsity pattern of the system matrix.
+ * This object keeps the solver of the last compute call and only repeats
+ * the symbolic analysis when the sparsity pattern or the solver type changed.
+ * Otherwise, only the numeric factorization is recomputed. This benefits
+ * repeated solves of systems with identical connectivity but different
+ * coefficients, e.g., for different energy weights or subject meshes.
+ *
+ * The Eigen solvers, i.e., LU, LDLT, and LLT, as well as the multi-threaded
+ * supernodal Cholesky factorization of CHOLMOD and the PARDISO solver, when
+ * available, are reused. The latter two compute their own fill-reducing
+ * ordering during the symbolic analysis, and PARDISO uses its Cholesky
+ * factorization for symmetric positive definite matrices. Other solvers
+ * are delegated to SolveSparseLinearSystem. The same applies to the setup of
+ * the algebraic multigrid preconditioner of the AMG solver, whose aggregates
+ * only depend on the sparsity pattern when the coefficients are similar. Its
+ * prolongators and coarse operators are recomputed for each new matrix.
+ *
+ * In mixed precision mode, the LU, LDLT, LLT, and CG solvers factorize or
+ * iterate on a single precision copy of the system matrix. The solution is
+ * then improved by iterative refinement, where the residual is computed in
+ * double precision and the correction is solved for in single precision.
+ * This halves the storage of the factors and the memory bandwidth of the
+ * sparse matrix-vector products of the inner solver, while the refined
+ * solution attains the accuracy of a double precision solve as long as the
+ * system is not too ill-conditioned for single precision.
+ *
+ * A copy of the last system matrix is retained, such that Resolve can solve
+ * the same system for another right-hand side, e.g., when only the boundary
+ * values of a map changed, using the existing factorization or preconditioner.
+ */
+class SparseFactorization
+{
+public:
+
+  /// Type of sparse system matrix
+  typedef Eigen::SparseMatrix<double> MatrixType;
+
+  /// Constructor
+  SparseFactorization();
+
+  /// Destructor
+  ~SparseFactorization();
+
+  /// Discard factorization
+  void Clear();
+
+  /// Set number of unknowns per node used by the AMG preconditioner
+  void BlockSize(int);
+
+  /// Number of unknowns per node used by the AMG preconditioner
+  int BlockSize() const;
+
+  /// Enable/disable single precision solves with double precision refinement
+  void MixedPrecision(bool);
+
+  /// Whether single precision solves with double precision refinement are used
+  bool MixedPrecision() const;
+
+  /// Number of symbolic analyses performed so far
+  int NumberOfAnalyses() const;
+
+  /// Number of numeric factorizations performed so far
+  int NumberOfFactorizations() const;
+
+  /// Set statistics to which the time of each factorization and solve as well
+  /// as the size of the linear system and the solver convergence are recorded
+  void Statistics(MapperStatistics *);
+
+  /// Statistics to which factorizations and solves are recorded, if any
+  MapperStatistics *Statistics() const;
+
+  /// Set observer notified after each iteration of the conjugate gradient solver
+  void Observer(MapperObserver *);
+
+  /// Observer notified after each iteration of the conjugate gradient solver
+  MapperObserver *Observer() const;
+
+  /// Solve sparse linear system of equations A x = b
+  ///
+  /// \sa SolveSparseLinearSystem
+  ///
+  /// \returns Type of solver used.
+  SparseSolverType Solve(SparseSolverType type, SparseMatrixType mtype,
+                         bool direct, const MatrixType &A,
+                         const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+                         int maxiter = 0, double tol = .0, bool guess = false,
+                         int *niter = nullptr, double *error = nullptr);
+
+  /// Solve sparse linear system of equations A x = b
+  ///
+  /// \sa SolveSparseLinearSystem
+  ///
+  /// \returns Type of solver used.
+  SparseSolverType Solve(SparseSolverType type, SparseMatrixType mtype,
+                         bool direct, const MatrixType &A,
+                         const Eigen::VectorXd &b, Eigen::VectorXd &x,
+                         int maxiter = 0, double tol = .0, bool guess = false,
+                         int *niter = nullptr, double *error = nullptr);
+
+  /// Whether the system matrix of a previous Solve is retained
+  bool HasMatrix() const;
+
+  /// Solve linear system with the system matrix of the last Solve for a new
+  /// right-hand side, without analyzing or factorizing the matrix again
+  ///
+  /// \returns Type of solver used.
+  SparseSolverType Resolve(const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+                           int maxiter = 0, double tol = .0, bool guess = false,
+                           int *niter = nullptr, double *error = nullptr);
+
+  /// Solve linear system with the system matrix of the last Solve for a new
+  /// right-hand side, without analyzing or factorizing the matrix again
+  ///
+  /// \returns Type of solver used.
+  SparseSolverType Resolve(const Eigen::VectorXd &b, Eigen::VectorXd &x,
+                           int maxiter = 0, double tol = .0, bool guess = false,
+                           int *niter = nullptr, double *error = nullptr);
+
+private:
+
+  /// Compute numeric factorization, reusing the symbolic analysis if possible
+  ///
+  /// \returns Whether the factorization succeeded.
+  bool Factorize(SparseSolverType, const MatrixType &);
+
+  /// Whether the given solver type is reused by this object
+  bool IsReusable(SparseSolverType) const;
+
+  /// Whether the given solver type supports mixed precision
+  static bool IsMixedPrecisionSolver(SparseSolverType);
+
+  /// Solve sparse linear system of equations A x = b
+  template <class TRhs, class TSol>
+  SparseSolverType SolveSystem(SparseSolverType, SparseMatrixType, bool,
+                               const MatrixType &, const TRhs &, TSol &,
+                               int, double, bool, int *, double *);
+
+  /// Solve linear system with retained system matrix
+  template <class TRhs, class TSol>
+  SparseSolverType ResolveSystem(const TRhs &, TSol &, int, double, bool, int *, double *);
+
+  /// Solver instances of the supported types
+  struct Solvers;
+
+  UniquePtr<Solvers> _Solvers;           ///< Solver of last factorization
+  SparseSolverType   _Type;              ///< Type of solver of last factorization
+  bool               _Mixed;             ///< Whether last factorization was mixed precision
+  SparseMatrixType   _FactorMatrixType;  ///< Type of matrix of last factorization
+  Array<int>         _OuterIndex;        ///< Sparsity pattern of last matrix
+  Array<int>         _InnerIndex;        ///< Sparsity pattern of last matrix
+  int                _Rows;              ///< Number of rows of last matrix
+  int                _BlockSize;         ///< Number of unknowns per node
+  bool               _MixedPrecision;    ///< Whether to use single precision solvers
+  int                _NumberOfAnalyses;  ///< Number of symbolic analyses
+  int                _NumberOfFactorizations; ///< Number of numeric factorizations
+  MatrixType         _Matrix;            ///< Retained system matrix of last solve
+  SparseSolverType   _MatrixSolver;      ///< Solver used for retained system matrix
+  SparseMatrixType   _MatrixType;        ///< Type of retained system matrix
+  bool               _MatrixDirect;      ///< Whether a direct solver was requested
+  bool               _HasMatrix;         ///< Whether a system matrix is retained
+  MapperStatistics  *_Statistics;        ///< Optional output execution statistics
+  MapperObserver    *_Observer;          ///< Optional observer of solver iterations
+
+  /// Copy constructor not implemented
+  SparseFactorization(const SparseFactorization &);
+
+  /// Assignment operator not implemented
+  SparseFactorization &operator =(const SparseFactorization &);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline void SparseFactorization::BlockSize(int bs)
+{
+  if (bs < 1) bs = 1;
+  if (bs != _BlockSize) {
+    Clear();
+    _BlockSize = bs;
+  }
+}
+
+// -----------------------------------------------------------------------------
+inline int SparseFactorization::BlockSize() const
+{
+  return _BlockSize;
+}
+
+// -----------------------------------------------------------------------------
+inline void SparseFactorization::MixedPrecision(bool mixed)
+{
+  if (mixed != _MixedPrecision) {
+    Clear();
+    _MixedPrecision = mixed;
+  }
+}
+
+// -----------------------------------------------------------------------------
+inline bool SparseFactorization::MixedPrecision() const
+{
+  return _MixedPrecision;
+}
+
+// -----------------------------------------------------------------------------
+inline int SparseFactorization::NumberOfAnalyses() const
+{
+  return _NumberOfAnalyses;
+}
+
+// -----------------------------------------------------------------------------
+inline int SparseFactorization::NumberOfFactorizations() const
+{
+  return _NumberOfFactorizations;
+}
+
+// -----------------------------------------------------------------------------
+inline void SparseFactorization::Statistics(MapperStatistics *stats)
+{
+  _Statistics = stats;
+}
+
+// -----------------------------------------------------------------------------
+inline MapperStatistics *SparseFactorization::Statistics() const
+{
+  return _Statistics;
+}
+
+// -----------------------------------------------------------------------------
+inline void SparseFactorization::Observer(MapperObserver *observer)
+{
+  _Observer = observer;
+}
+
+// -----------------------------------------------------------------------------
+inline MapperObserver *SparseFactorization::Observer() const
+{
+  return _Observer;
+}
+
+// -----------------------------------------------------------------------------
+inline bool SparseFactorization::HasMatrix() const
+{
+  return _HasMatrix;
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SparseSolver_H
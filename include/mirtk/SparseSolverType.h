@@ -0,0 +1,133 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SparseSolverType_H
+#define MIRTK_SparseSolverType_H
+
+#include "mirtk/String.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Enumerations
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Enumeration of sparse linear solvers
+enum SparseSolverType
+{
+  SparseSolver_Default,  ///< Fastest solver suitable for the type of system matrix
+  SparseSolver_LU,       ///< Supernodal LU factorization (Eigen::SparseLU)
+  SparseSolver_LDLT,     ///< Simplicial LDLT factorization (Eigen::SimplicialLDLT)
+  SparseSolver_LLT,      ///< Simplicial Cholesky factorization (Eigen::SimplicialLLT)
+  SparseSolver_CHOLMOD,  ///< Supernodal Cholesky factorization of CHOLMOD
+  SparseSolver_SuperLU,  ///< Supernodal LU factorization of SuperLU
+  SparseSolver_Pardiso,  ///< LU or, for SPD matrices, Cholesky factorization of Intel MKL PARDISO
+  SparseSolver_CG,       ///< Conjugate gradient method with diagonal preconditioner
+  SparseSolver_BiCGSTAB, ///< Bi-conjugate gradient stabilized method with diagonal preconditioner
+  SparseSolver_AMG       ///< Conjugate gradient method with algebraic multigrid preconditioner
+};
+
+// -----------------------------------------------------------------------------
+/// Enumeration of sparse system matrix types
+enum SparseMatrixType
+{
+  SparseMatrix_SPD,       ///< Symmetric positive definite
+  SparseMatrix_Symmetric, ///< Symmetric, possibly indefinite or singular
+  SparseMatrix_General    ///< Non-symmetric
+};
+
+// -----------------------------------------------------------------------------
+template <>
+inline string ToString(const SparseSolverType &value, int w, char c, bool left)
+{
+  const char *str;
+  switch (value) {
+    case SparseSolver_Default:  str = "Default";  break;
+    case SparseSolver_LU:       str = "LU";       break;
+    case SparseSolver_LDLT:     str = "LDLT";     break;
+    case SparseSolver_LLT:      str = "LLT";      break;
+    case SparseSolver_CHOLMOD:  str = "CHOLMOD";  break;
+    case SparseSolver_SuperLU:  str = "SuperLU";  break;
+    case SparseSolver_Pardiso:  str = "Pardiso";  break;
+    case SparseSolver_CG:       str = "CG";       break;
+    case SparseSolver_BiCGSTAB: str = "BiCGSTAB"; break;
+    case SparseSolver_AMG:      str = "AMG";      break;
+    default:                    str = "Unknown";  break;
+  }
+  return ToString(str, w, c, left);
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline bool FromString(const char *str, SparseSolverType &value)
+{
+  const string lstr = ToLower(str);
+  if      (lstr == "default")  value = SparseSolver_Default;
+  else if (lstr == "lu")       value = SparseSolver_LU;
+  else if (lstr == "ldlt")     value = SparseSolver_LDLT;
+  else if (lstr == "llt" ||
+           lstr == "cholesky") value = SparseSolver_LLT;
+  else if (lstr == "cholmod")  value = SparseSolver_CHOLMOD;
+  else if (lstr == "superlu")  value = SparseSolver_SuperLU;
+  else if (lstr == "pardiso")  value = SparseSolver_Pardiso;
+  else if (lstr == "cg")       value = SparseSolver_CG;
+  else if (lstr == "bicgstab") value = SparseSolver_BiCGSTAB;
+  else if (lstr == "amg")      value = SparseSolver_AMG;
+  else return false;
+  return true;
+}
+
+// =============================================================================
+// Solver properties
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Whether the sparse solver is a direct method
+inline bool IsDirectSolver(SparseSolverType type)
+{
+  return type != SparseSolver_CG && type != SparseSolver_BiCGSTAB && type != SparseSolver_AMG;
+}
+
+// -----------------------------------------------------------------------------
+/// Whether the sparse solver requires a symmetric system matrix
+inline bool IsSymmetricSolver(SparseSolverType type)
+{
+  return type == SparseSolver_LDLT || type == SparseSolver_LLT ||
+         type == SparseSolver_CHOLMOD || type == SparseSolver_CG ||
+         type == SparseSolver_AMG;
+}
+
+// -----------------------------------------------------------------------------
+/// Whether the sparse solver is available in this build of the library
+bool IsAvailable(SparseSolverType);
+
+// -----------------------------------------------------------------------------
+/// Get fastest available solver suitable for the given type of system matrix
+///
+/// \param[in] mtype  Type of system matrix.
+/// \param[in] direct Whether to use a direct or an iterative method.
+SparseSolverType DefaultSparseSolver(SparseMatrixType mtype, bool direct = true);
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SparseSolverType_H
@@ -23,6 +23,8 @@
 #include "mirtk/FreeBoundarySurfaceMapper.h"
 
 #include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/SparseSolverType.h"
 
 #include "vtkSmartPointer.h"
 #include "vtkDataArray.h"
@@ -31,12 +33,29 @@
 namespace mirtk {
 
 
+class SparseFactorization;
+
+
 /**
  * Least squares conformal map without boundary constraints
  *
  * - Mullen et al. (2008). Spectral conformal parameterization.
  *   Eurographics Symposium on Geometry Processing, 27(5), 1487–1494.
  *
+ * When no fixed points are added, the map minimizes the conformal energy
+ * L_C subject to a unit norm of the boundary values. It is given by the
+ * generalized eigenvector of (L_C, B) with the smallest non-zero eigenvalue,
+ * where B is the diagonal indicator matrix of the boundary points. This
+ * eigenvector is computed by a built-in block inverse subspace iteration
+ * with Rayleigh-Ritz projection, where the sparse Cholesky factor of the
+ * shifted matrix L_C + sigma B is computed once and reused by each iteration.
+ * The iteration can be warm-started from the values of a previous map, e.g.,
+ * the map of a coarser mesh interpolated at the surface points, or of another
+ * surface with the same connectivity.
+ *
+ * When fixed points are added, the least squares conformal map with these
+ * point constraints is computed instead, as by LeastSquaresConformalSurfaceMapper.
+ *
  * \todo Implement area weighting extension as described in Mullen et al. (2008)
  *       to account for irregular surface sampling.
  */
@@ -57,6 +76,32 @@ private:
   /// Tolerance for sparse linear solver
   mirtkPublicAttributeMacro(double, Tolerance);
 
+  /// Sparse linear solver, where SparseSolver_Default selects the fastest
+  /// direct or iterative solver suitable for the system matrix
+  mirtkPublicAttributeMacro(SparseSolverType, Solver);
+
+  /// Maximum number of eigensolver iterations
+  mirtkPublicAttributeMacro(int, NumberOfEigenIterations);
+
+  /// Relative residual of eigenvector at which the eigensolver has converged
+  mirtkPublicAttributeMacro(double, EigenTolerance);
+
+  /// Map values at surface points from which the eigensolver is started
+  ///
+  /// When not set, the eigensolver is started from the surface point
+  /// coordinates projected onto the coordinate planes.
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkDataArray>, InitialValues);
+
+  /// Eigenvalue of computed spectral conformal map
+  mirtkReadOnlyAttributeMacro(double, Eigenvalue);
+
+  /// Factorization of shifted system matrix of last eigensolver run
+  ///
+  /// The symbolic analysis is reused by subsequent runs for surfaces with
+  /// the same connectivity. It is not copied from other instances, which
+  /// would otherwise share a non-thread-safe solver object.
+  mirtkAttributeMacro(SharedPtr<SparseFactorization>, Factorization);
+
   /// Index of point in set of points with free (i >= 0) or fixed (i < 0) values
   mirtkAttributeMacro(Array<int>, PointIndex);
 
@@ -121,6 +166,9 @@ protected:
   /// Compute surface map
   virtual void ComputeMap();
 
+  /// Compute spectral conformal map without fixed points
+  void ComputeSpectralMap();
+
   /// Finalize filter execution
   virtual void Finalize();
 
@@ -0,0 +1,109 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SpectralTetrahedralMeshMapper_H
+#define MIRTK_SpectralTetrahedralMeshMapper_H
+
+#include "mirtk/TetrahedralMeshMapper.h"
+
+#include "mirtk/Array.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Piecewise linear volumetric map defined by spectral coordinates
+ *
+ * The spectral coordinates of the points of the tetrahedral mesh are the
+ * eigenvectors of the smallest non-zero eigenvalues of the generalized
+ * eigenproblem L v = lambda M v, where L is the piecewise linear (cotangent)
+ * Laplace operator of the volume with natural boundary conditions and M is
+ * the lumped mass matrix. The map values are the affine combination of these
+ * spectral coordinates which best fits the boundary map in the least squares
+ * sense. The boundary values are hence approximated rather than interpolated,
+ * and the map is smooth and independent of the tetrahedralization.
+ *
+ * The eigenvectors are computed by the locally optimal block preconditioned
+ * conjugate gradient method (LOBPCG; Knyazev, 2001), where the preconditioner
+ * is one V-cycle of the smoothed aggregation AlgebraicMultigrid, which is
+ * also used by the harmonic tetrahedral mesh mappers, of the slightly shifted
+ * operator L + sigma M. The number of iterations is thus nearly independent
+ * of the size of the mesh. The sparse matrix products and the preconditioner
+ * are applied to the columns of the block in parallel.
+ *
+ * - Knyazev (2001). Toward the optimal preconditioned eigensolver: Locally
+ *   optimal block preconditioned conjugate gradient method. SIAM Journal on
+ *   Scientific Computing, 23(2), 517–541.
+ */
+class SpectralTetrahedralMeshMapper : public TetrahedralMeshMapper
+{
+  mirtkObjectMacro(SpectralTetrahedralMeshMapper);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Number of spectral coordinates, i.e., non-trivial eigenvectors
+  ///
+  /// When non-positive, the number of components of the input map is used.
+  mirtkPublicAttributeMacro(int, NumberOfEigenvectors);
+
+  /// Maximum number of LOBPCG iterations
+  mirtkPublicAttributeMacro(int, NumberOfIterations);
+
+  /// Maximum relative residual norm of the computed eigenvectors
+  mirtkPublicAttributeMacro(double, Tolerance);
+
+  /// Eigenvalues of the spectral coordinates computed by the last Solve
+  mirtkReadOnlyAttributeMacro(Array<double>, Eigenvalues);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const SpectralTetrahedralMeshMapper &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  SpectralTetrahedralMeshMapper();
+
+  /// Copy constructor
+  SpectralTetrahedralMeshMapper(const SpectralTetrahedralMeshMapper &);
+
+  /// Assignment operator
+  SpectralTetrahedralMeshMapper &operator =(const SpectralTetrahedralMeshMapper &);
+
+  /// Destructor
+  virtual ~SpectralTetrahedralMeshMapper();
+
+  // ---------------------------------------------------------------------------
+  // Execution
+
+protected:
+
+  /// Compute spectral coordinates and fit them to the boundary map
+  virtual void Solve();
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SpectralTetrahedralMeshMapper_H
@@ -0,0 +1,156 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SquareToDiskMap_H
+#define MIRTK_SquareToDiskMap_H
+
+#include "mirtk/AnalyticMapping.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Point.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Map of 2D points in a square to the disk bounded by its incircle
+ *
+ * Each point is scaled along the ray from the square center such that the
+ * boundary of the square is mapped onto the circle of the given radius.
+ * The z coordinate of the input points is ignored.
+ */
+class SquareToDiskMap : public AnalyticMapping
+{
+  mirtkObjectMacro(SquareToDiskMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Center of square
+  mirtkPublicAttributeMacro(Point, SquareCenter);
+
+  /// Half the side length of the square
+  mirtkPublicAttributeMacro(double, SquareRadius);
+
+  /// Center of disk
+  mirtkPublicAttributeMacro(Point, DiskCenter);
+
+  /// Radius of disk
+  mirtkPublicAttributeMacro(double, DiskRadius);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const SquareToDiskMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  SquareToDiskMap();
+
+  /// Copy constructor
+  SquareToDiskMap(const SquareToDiskMap &);
+
+  /// Assignment operator
+  SquareToDiskMap &operator =(const SquareToDiskMap &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make deep copy of this map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~SquareToDiskMap();
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get bounding box of square
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., number of output values
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point without virtual function call
+  bool Map(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points in parallel
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+protected:
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int SquareToDiskMap::NumberOfComponents() const
+{
+  return 2;
+}
+
+// -----------------------------------------------------------------------------
+inline bool SquareToDiskMap::Map(double *v, double x, double y, double) const
+{
+  x -= _SquareCenter._x;
+  y -= _SquareCenter._y;
+  const double r = sqrt(x * x + y * y);
+  const double s = (r > .0 ? (_DiskRadius / _SquareRadius) * (max(abs(x), abs(y)) / r) : .0);
+  v[0] = _DiskCenter._x + s * x;
+  v[1] = _DiskCenter._y + s * y;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+inline bool SquareToDiskMap::Evaluate(double *v, double x, double y, double z) const
+{
+  return this->Map(v, x, y, z);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SquareToDiskMap_H
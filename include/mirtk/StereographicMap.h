@@ -0,0 +1,202 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_StereographicMap_H
+#define MIRTK_StereographicMap_H
+
+#include "mirtk/AnalyticMapping.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Point.h"
+#include "mirtk/String.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Enumerations
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Enumeration of sphere poles used as center of stereographic projection
+enum SpherePole
+{
+  SpherePole_North, ///< Pole with maximum z coordinate
+  SpherePole_South  ///< Pole with minimum z coordinate
+};
+
+// -----------------------------------------------------------------------------
+template <>
+inline string ToString(const SpherePole &value, int w, char c, bool left)
+{
+  const char *str;
+  switch (value) {
+    case SpherePole_North: str = "N";       break;
+    case SpherePole_South: str = "S";       break;
+    default:               str = "Unknown"; break;
+  }
+  return ToString(str, w, c, left);
+}
+
+// -----------------------------------------------------------------------------
+template <>
+inline bool FromString(const char *str, SpherePole &value)
+{
+  const string lstr = ToLower(str);
+  if      (lstr == "n" || lstr == "north") value = SpherePole_North;
+  else if (lstr == "s" || lstr == "south") value = SpherePole_South;
+  else return false;
+  return true;
+}
+
+// =============================================================================
+// Stereographic projection
+// =============================================================================
+
+/**
+ * Stereographic projection of points on a sphere to a plane
+ *
+ * Each point is projected along the ray from the chosen pole of the sphere
+ * onto the plane orthogonal to the z axis at the given offset from the sphere
+ * center. The projection is undefined at the pole itself, which is outside
+ * the map domain. When the plane contains the origin, the map values are the
+ * 2D coordinates of the projected points within the plane.
+ */
+class StereographicMap : public AnalyticMapping
+{
+  mirtkObjectMacro(StereographicMap);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Center of sphere
+  mirtkPublicAttributeMacro(Point, SphereCenter);
+
+  /// Radius of sphere
+  mirtkPublicAttributeMacro(double, SphereRadius);
+
+  /// Pole from which points are projected
+  mirtkPublicAttributeMacro(SpherePole, Pole);
+
+  /// Offset of projection plane from sphere center along z axis
+  mirtkPublicAttributeMacro(double, PlaneOffset);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const StereographicMap &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  StereographicMap();
+
+  /// Copy constructor
+  StereographicMap(const StereographicMap &);
+
+  /// Assignment operator
+  StereographicMap &operator =(const StereographicMap &);
+
+  /// Initialize map after inputs and parameters are set
+  virtual void Initialize();
+
+  /// Make deep copy of this map
+  virtual Mapping *NewCopy() const;
+
+  /// Destructor
+  virtual ~StereographicMap();
+
+  // ---------------------------------------------------------------------------
+  // Map domain
+
+  // Import other overloads
+  using Mapping::BoundingBox;
+
+  /// Get bounding box of sphere
+  virtual void BoundingBox(double &x1, double &y1, double &z1,
+                           double &x2, double &y2, double &z2) const;
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  // Import other overloads
+  using Mapping::Evaluate;
+
+  /// Dimension of codomain, i.e., 2 when the plane contains the origin and 3 otherwise
+  virtual int NumberOfComponents() const;
+
+  /// Evaluate map at a given point without virtual function call
+  bool Map(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at a given point
+  virtual bool Evaluate(double *v, double x, double y, double z = 0) const;
+
+  /// Evaluate map at multiple points in parallel
+  virtual void Evaluate(int n, const double *xyz, double *values, bool *inside = nullptr) const;
+
+  // ---------------------------------------------------------------------------
+  // I/O
+
+protected:
+
+  /// Read map attributes and parameters from file stream
+  virtual void ReadMap(Cifstream &);
+
+  /// Write map attributes and parameters to file stream
+  virtual void WriteMap(Cofstream &) const;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int StereographicMap::NumberOfComponents() const
+{
+  return fequal(_SphereCenter._z + _PlaneOffset, .0, 1e-6) ? 2 : 3;
+}
+
+// -----------------------------------------------------------------------------
+inline bool StereographicMap::Map(double *v, double x, double y, double z) const
+{
+  const double zpole = (_Pole == SpherePole_North ? _SphereRadius : -_SphereRadius);
+  x -= _SphereCenter._x;
+  y -= _SphereCenter._y;
+  z -= _SphereCenter._z;
+  if (z == zpole) return false;
+  const double s = (_PlaneOffset - zpole) / (z - zpole);
+  v[0] = _SphereCenter._x + s * x;
+  v[1] = _SphereCenter._y + s * y;
+  if (NumberOfComponents() == 3) v[2] = _SphereCenter._z + _PlaneOffset;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+inline bool StereographicMap::Evaluate(double *v, double x, double y, double z) const
+{
+  return this->Map(v, x, y, z);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_StereographicMap_H
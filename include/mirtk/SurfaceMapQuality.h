@@ -0,0 +1,120 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SurfaceMapQuality_H
+#define MIRTK_SurfaceMapQuality_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/PiecewiseLinearMap.h"
+
+#include "vtkSmartPointer.h"
+#include "vtkDataArray.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Quantitative quality measures of a piecewise linear surface map
+ *
+ * All measures are computed by two parallel passes over the triangles of the
+ * map domain, irrespective of the number of selected measures. The first pass
+ * computes the area and edge lengths of each triangle before and after the
+ * mapping as well as the signed area of the mapped triangles, where each thread
+ * accumulates partial sums and counts which are joined at the end. The second
+ * pass normalizes the ratios of these quantities by the global scale factor and
+ * accumulates the squared deviation from one. Each edge of the surface mesh is
+ * accounted for only once by the first triangle which contains it.
+ */
+class SurfaceMapQuality : public Object
+{
+  mirtkObjectMacro(SurfaceMapQuality);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Piecewise linear surface map
+  mirtkPublicAttributeMacro(const PiecewiseLinearMap *, Map);
+
+  /// Whether to evaluate signed area of triangles mapped to the plane
+  mirtkPublicAttributeMacro(bool, EvaluateSignedArea);
+
+  /// Whether to evaluate triangle area distortion
+  mirtkPublicAttributeMacro(bool, EvaluateAreaDistortion);
+
+  /// Whether to evaluate edge-length distortion
+  mirtkPublicAttributeMacro(bool, EvaluateEdgeLengthDistortion);
+
+  /// Absolute signed area below which a mapped triangle is considered degenerate
+  mirtkPublicAttributeMacro(double, AreaTolerance);
+
+  /// Signed area of each mapped triangle
+  mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkDataArray>, SignedArea);
+
+  /// Normalized area ratio of each triangle
+  mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkDataArray>, CellAreaDistortion);
+
+  /// Mean normalized edge-length ratio of the edges of each triangle
+  mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkDataArray>, CellEdgeLengthDistortion);
+
+  /// Number of mapped triangles with inconsistent normal direction
+  mirtkReadOnlyAttributeMacro(int, NumberOfFlippedTriangles);
+
+  /// Number of mapped triangles with zero area
+  mirtkReadOnlyAttributeMacro(int, NumberOfDegeneratedTriangles);
+
+  /// Root mean squared deviation of normalized area ratios from one
+  mirtkReadOnlyAttributeMacro(double, AreaDistortion);
+
+  /// Root mean squared deviation of normalized edge-length ratios from one
+  mirtkReadOnlyAttributeMacro(double, EdgeLengthDistortion);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const SurfaceMapQuality &);
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  SurfaceMapQuality();
+
+  /// Copy constructor
+  SurfaceMapQuality(const SurfaceMapQuality &);
+
+  /// Assignment operator
+  SurfaceMapQuality &operator =(const SurfaceMapQuality &);
+
+  /// Destructor
+  virtual ~SurfaceMapQuality();
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  /// Evaluate selected quality measures of surface map
+  void Run();
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SurfaceMapQuality_H
@@ -27,7 +27,11 @@
 
 #include "mirtk/EdgeTable.h"
 #include "mirtk/SurfaceBoundary.h"
+#include "mirtk/TriangleGeometry.h"
+#include "mirtk/SurfaceTopology.h"
 #include "mirtk/Mapping.h"
+#include "mirtk/MapperStatistics.h"
+#include "mirtk/MapperObserver.h"
 
 #include "vtkSmartPointer.h"
 #include "vtkPolyData.h"
@@ -62,12 +66,34 @@ class SurfaceMapper : public Object
   /// Extracted surface mesh boundary
   mirtkPublicAttributeMacro(SharedPtr<SurfaceBoundary>, Boundary);
 
+  /// Cached geometry of surface triangles, computed by Initialize
+  mirtkAttributeMacro(SharedPtr<mirtk::TriangleGeometry>, TriangleGeometry);
+
+  /// Topology context shared with other mappers of the same surface
+  ///
+  /// When set and the Surface is the one of this context, Initialize uses
+  /// its edge table, boundary, and triangle geometry instead of computing
+  /// them, and does not modify the surface.
+  mirtkReadOnlyAttributeMacro(SharedPtr<const SurfaceTopology>, Topology);
+
   /// Output surface map
   ///
   /// \note The output map is uninitialized! Mapping::Initialize must be
   ///       called before this map can be evaluated at map domain points.
   mirtkReadOnlyAttributeMacro(SharedPtr<Mapping>, Output);
 
+  /// Execution statistics of last Run
+  mirtkReadOnlyAttributeMacro(MapperStatistics, Statistics);
+
+  /// Observer notified after each iteration of the iterative methods, not owned
+  mirtkPublicAttributeMacro(MapperObserver *, Observer);
+
+  /// Whether to store the output map compactly, i.e., with single precision
+  /// point coordinates and map values and 32-bit cell connectivity if possible
+  ///
+  /// \sa Mapping::Compact
+  mirtkPublicAttributeMacro(bool, CompactOutput);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const SurfaceMapper &);
 
@@ -90,12 +116,23 @@ public:
   /// Destructor
   virtual ~SurfaceMapper();
 
+  // ---------------------------------------------------------------------------
+  // Input
+
+  /// Attach topology context of surface, which also sets the Surface,
+  /// EdgeTable, and Boundary of this mapper
+  void Topology(const SharedPtr<const SurfaceTopology> &);
+
   // ---------------------------------------------------------------------------
   // Execution
 
   /// Compute surface map
   void Run();
 
+  /// Outcome of last Run, i.e., whether it completed or the output is the best
+  /// iterate reached before the time limit of the Observer or a cancellation
+  MapperStatus Status() const;
+
 protected:
 
   /// Initialize filter after input and parameters are set
@@ -144,12 +181,36 @@ protected:
   ///          mesh is triangulated, the return value is 1 for a boundary edge,
   ///          and 2 for an interior edge.
   int GetEdgeNeighborPoints(int i, int j, int &k, int &l) const;
+
+  /// Get triangles adjacent to an edge and their corners opposite this edge
+  ///
+  /// In contrast to GetEdgeNeighborPoints, this function looks up the
+  /// adjacent triangles in the cached TriangleGeometry, and terminates with
+  /// an error if the surface mesh is not triangulated.
+  ///
+  /// \param[in]  i  Edge start point.
+  /// \param[in]  j  Edge end point.
+  /// \param[out] t  Adjacent triangles, where t[1] is -1 for a boundary edge.
+  /// \param[out] k  Corners of adjacent triangles opposite the edge.
+  ///
+  /// \returns Number of triangles adjacent to the specified edge.
+  int GetEdgeTriangles(int i, int j, int t[2], int k[2]) const;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // Inline definitions
 ////////////////////////////////////////////////////////////////////////////////
 
+// =============================================================================
+// Execution
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+inline MapperStatus SurfaceMapper::Status() const
+{
+  return _Statistics.Status();
+}
+
 // =============================================================================
 // Auxiliaries
 // =============================================================================
@@ -0,0 +1,199 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_SurfaceTopology_H
+#define MIRTK_SurfaceTopology_H
+
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/EdgeTable.h"
+#include "mirtk/SurfaceBoundary.h"
+#include "mirtk/TriangleGeometry.h"
+
+#include "vtkSmartPointer.h"
+#include "vtkPolyData.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Topology context shared by the surface mappers of the same surface mesh
+ *
+ * Surface mappers need the edge table, the boundary segments, and the cached
+ * triangle geometry of their input surface. These are normally computed
+ * anew by each mapper. When several mappers are run on the same surface,
+ * e.g., for a comparison of methods, the surface topology can instead be
+ * computed once and attached to each mapper using SurfaceMapper::Topology,
+ * or to a boundary mapper using its Boundary attribute. The boundary and
+ * the triangle geometry are computed in parallel. The context furthermore
+ * partitions the surface points into interior and boundary points, i.e.,
+ * the free and fixed points of a map with fixed boundary values.
+ *
+ * The surface cell links are built by the constructor. Afterwards, the context
+ * and its surface are only read, such that a context can be shared by mappers
+ * executed by different threads. The surface must not be modified while the
+ * context is in use.
+ */
+class SurfaceTopology
+{
+public:
+
+  /// Constructor
+  ///
+  /// \param[in] surface Surface mesh.
+  explicit SurfaceTopology(vtkPolyData *surface);
+
+  /// Surface mesh
+  vtkPolyData *Surface() const;
+
+  /// Edge table of surface mesh
+  const SharedPtr<class EdgeTable> &EdgeTable() const;
+
+  /// Boundary segments of surface mesh
+  const SharedPtr<SurfaceBoundary> &Boundary() const;
+
+  /// Cached geometry of surface triangles, \c nullptr if surface has no polygons
+  const SharedPtr<class TriangleGeometry> &TriangleGeometry() const;
+
+  /// Number of surface points
+  int NumberOfPoints() const;
+
+  /// Number of interior points
+  int NumberOfInteriorPoints() const;
+
+  /// Number of boundary points
+  int NumberOfBoundaryPoints() const;
+
+  /// Whether surface point is on the boundary
+  bool IsBoundaryPoint(int ptId) const;
+
+  /// Index of surface point among the interior points, or -1 for boundary points
+  int InteriorPointIndex(int ptId) const;
+
+  /// Index of surface point among the boundary points, or -1 for interior points
+  int BoundaryPointIndex(int ptId) const;
+
+  /// Surface point ID of i-th interior point
+  int InteriorPointId(int i) const;
+
+  /// Surface point ID of i-th boundary point
+  int BoundaryPointId(int i) const;
+
+private:
+
+  /// Copy constructor
+  /// \note Intentionally not implemented.
+  SurfaceTopology(const SurfaceTopology &);
+
+  /// Assignment operator
+  /// \note Intentionally not implemented.
+  SurfaceTopology &operator =(const SurfaceTopology &);
+
+  vtkSmartPointer<vtkPolyData>      _Surface;          ///< Surface mesh
+  SharedPtr<class EdgeTable>        _EdgeTable;        ///< Edge table
+  SharedPtr<SurfaceBoundary>        _Boundary;         ///< Boundary segments
+  SharedPtr<class TriangleGeometry> _TriangleGeometry; ///< Triangle geometry
+  Array<int>                        _PointIndex;       ///< Interior (i >= 0) or boundary (i < 0) point index
+  Array<int>                        _InteriorPoints;   ///< IDs of interior points
+  Array<int>                        _BoundaryPoints;   ///< IDs of boundary points
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline vtkPolyData *SurfaceTopology::Surface() const
+{
+  return _Surface;
+}
+
+// -----------------------------------------------------------------------------
+inline const SharedPtr<EdgeTable> &SurfaceTopology::EdgeTable() const
+{
+  return _EdgeTable;
+}
+
+// -----------------------------------------------------------------------------
+inline const SharedPtr<SurfaceBoundary> &SurfaceTopology::Boundary() const
+{
+  return _Boundary;
+}
+
+// -----------------------------------------------------------------------------
+inline const SharedPtr<TriangleGeometry> &SurfaceTopology::TriangleGeometry() const
+{
+  return _TriangleGeometry;
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::NumberOfPoints() const
+{
+  return static_cast<int>(_PointIndex.size());
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::NumberOfInteriorPoints() const
+{
+  return static_cast<int>(_InteriorPoints.size());
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::NumberOfBoundaryPoints() const
+{
+  return static_cast<int>(_BoundaryPoints.size());
+}
+
+// -----------------------------------------------------------------------------
+inline bool SurfaceTopology::IsBoundaryPoint(int ptId) const
+{
+  return _PointIndex[ptId] < 0;
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::InteriorPointIndex(int ptId) const
+{
+  const int i = _PointIndex[ptId];
+  return i >= 0 ? i : -1;
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::BoundaryPointIndex(int ptId) const
+{
+  const int i = _PointIndex[ptId];
+  return i < 0 ? -(i + 1) : -1;
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::InteriorPointId(int i) const
+{
+  return _InteriorPoints[i];
+}
+
+// -----------------------------------------------------------------------------
+inline int SurfaceTopology::BoundaryPointId(int i) const
+{
+  return _BoundaryPoints[i];
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_SurfaceTopology_H
@@ -64,7 +64,10 @@ public:
   /// Construct and solve symmetric system of linear equations
   virtual void ComputeMap();
 
-protected:
+  // ---------------------------------------------------------------------------
+  // Auxiliaries
+
+public:
 
   /// Weight of undirected edge (i, j)
   ///
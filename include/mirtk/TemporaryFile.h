@@ -0,0 +1,48 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MIRTK_TemporaryFile_H
+#define MIRTK_TemporaryFile_H
+
+#include "mirtk/String.h"
+
+
+namespace mirtk {
+
+
+/// Get name of temporary file to which an output file is written before it
+/// is renamed to the final output file name
+///
+/// The name is unique for each process and thread, such that concurrent
+/// writers of the same output file never write to the same temporary file.
+/// The temporary file is located in the same directory as the output file,
+/// which is required for the atomic rename of the completed file.
+///
+/// \param[in] fname Name of output file.
+/// \param[in] ext   File name extension appended to the temporary file name,
+///                  e.g., to select the file format of a writer.
+///
+/// \returns Temporary file name.
+string TemporaryFileName(const string &fname, const char *ext = "");
+
+
+} // namespace mirtk
+
+#endif // MIRTK_TemporaryFile_H
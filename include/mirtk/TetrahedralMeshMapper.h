@@ -22,6 +22,8 @@
 
 #include "mirtk/VolumeMapper.h"
 
+#include "mirtk/String.h"
+
 #include "vtkSmartPointer.h"
 #include "vtkPointSet.h"
 #include "vtkDataArray.h"
@@ -35,6 +37,24 @@ namespace mirtk {
  *
  * Solvers of this type use a discretization of the volume for which a volumetric
  * map is computed based on tetrahedral elements.
+ *
+ * The tetrahedralization of the input point set is often more expensive than
+ * the computation of the map itself. When the same input is mapped repeatedly,
+ * e.g., with different boundary maps or mapping methods, a precomputed
+ * tetrahedral mesh can be passed as InputVolume, or the tetrahedral meshes
+ * can be cached on disk in the TetrahedralizationCache directory. Cached
+ * meshes are read and written in chunks of tetrahedra, and the connectivity
+ * of computed, cached, and refined meshes is stored with 32-bit indices when
+ * VTK >= 9 permits, which bounds the peak memory of large tetrahedral meshes.
+ *
+ * The element sizes of the tetrahedralization computed by Initialize can be
+ * controlled by a MaximumVolume of the tetrahedra and a SizeGrading of the
+ * edge lengths with increasing distance from the boundary. Tetrahedra which
+ * exceed these bounds are refined by bisection of their longest interior edge.
+ * After the map was computed, tetrahedra where the deformation gradient of the
+ * map is large compared to its median are refined in the same way and the map
+ * is recomputed, for up to NumberOfRefinements times. Edges of the boundary
+ * surface are never split, i.e., the boundary map remains unmodified.
  */
 class TetrahedralMeshMapper : public VolumeMapper
 {
@@ -48,6 +68,50 @@ protected:
   /// Boolean array indicating which points are on the boundary, i.e., fixed
   mirtkPublicAttributeMacro(vtkSmartPointer<vtkDataArray>, InputMask);
 
+  /// Precomputed tetrahedralization of the input point set
+  ///
+  /// The first points of this tetrahedral mesh must be the points of the
+  /// input point set in the same order. Any additional (Steiner) points are
+  /// interior points whose map values are initialized to zero. The point data
+  /// of this mesh is ignored. When not set, the input point set is
+  /// tetrahedralized by Initialize.
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkPointSet>, InputVolume);
+
+  /// Directory of cached tetrahedralizations of input point sets
+  ///
+  /// When not empty and no InputVolume is given, the tetrahedral mesh of an
+  /// input point set is read from a binary file in this directory whose name
+  /// is the hash value of the input points, cells, and mask. When no such file
+  /// exists, the input is tetrahedralized as usual and the result is written
+  /// to this directory for subsequent runs with identical input.
+  mirtkPublicAttributeMacro(string, TetrahedralizationCache);
+
+  /// Maximum volume of tetrahedra, unlimited when non-positive
+  ///
+  /// This bound is not applied to a precomputed InputVolume.
+  mirtkPublicAttributeMacro(double, MaximumVolume);
+
+  /// Increase of maximum edge length per unit distance from the boundary
+  ///
+  /// When positive, the length of the interior edges of a tetrahedron whose
+  /// center is at distance d from the boundary is bounded by h + SizeGrading * d,
+  /// where h is the mean edge length of the boundary surface. A value of zero
+  /// disables this bound. It is not applied to a precomputed InputVolume.
+  mirtkPublicAttributeMacro(double, SizeGrading);
+
+  /// Maximum number of adaptive refinements of the volume mesh
+  mirtkPublicAttributeMacro(int, NumberOfRefinements);
+
+  /// Refine tetrahedra whose Frobenius norm of the deformation gradient of the
+  /// map exceeds the median norm by this factor
+  mirtkPublicAttributeMacro(double, RefinementThreshold);
+
+  /// Adaptively refined tetrahedral mesh used by Initialize
+  mirtkAttributeMacro(vtkSmartPointer<vtkPointSet>, RefinedVolume);
+
+  /// Number of adaptive refinements performed during last Run
+  mirtkReadOnlyAttributeMacro(int, RefinementLevel);
+
   /// Discretized input domain, i.e., tetrahedral mesh
   mirtkReadOnlyAttributeMacro(vtkSmartPointer<vtkPointSet>, Volume);
 
@@ -97,11 +161,44 @@ public:
   // ---------------------------------------------------------------------------
   // Execution
 
+  /// Tetrahedralize input point set before Run
+  ///
+  /// This allows the preprocessing stage of a pipeline to tetrahedralize the
+  /// next input while the mapper of another stage solves for the map of the
+  /// previous input. The InputVolume, a cached tetrahedralization, or a new
+  /// tetrahedralization of the InputSet is returned without point data, such
+  /// that it can be set as InputVolume of a mapper with the same input.
+  ///
+  /// \returns Tetrahedral mesh whose first points are the input points, or
+  ///          \c nullptr when the tetrahedralization reordered the input points.
+  vtkSmartPointer<vtkPointSet> TetrahedralizeInputSet() const;
+
 protected:
 
   /// Initialize filter after input and parameters are set
   virtual void Initialize();
 
+  /// Get tetrahedral mesh of input point set with fixed point values and mask
+  ///
+  /// The returned mesh is the InputVolume when set, a cached tetrahedralization,
+  /// or the tetrahedralization of the input point set computed by this function.
+  ///
+  /// \param[out] map_index  Index of point data array of map values.
+  /// \param[out] mask_index Index of point data array of boundary mask or -1.
+  vtkSmartPointer<vtkPointSet> TetrahedralizeInput(int &map_index, int &mask_index) const;
+
+  /// Refine tetrahedral mesh of input point set to requested element sizes
+  ///
+  /// \returns Refined mesh whose first points are the points of the given mesh,
+  ///          or the given mesh itself when no tetrahedron had to be refined.
+  vtkSmartPointer<vtkPointSet> RefineToSize(vtkPointSet *) const;
+
+  /// Refine tetrahedra with large deformation gradient of current map
+  ///
+  /// The filter is re-initialized with the refined mesh, where the map values
+  /// of the previous solution are used as initial guess of the next Solve.
+  virtual bool Refine();
+
   /// Finalize filter execution
   virtual void Finalize();
 
@@ -0,0 +1,181 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_TriangleGeometry_H
+#define MIRTK_TriangleGeometry_H
+
+#include "mirtk/Array.h"
+#include "mirtk/EdgeTable.h"
+
+#include "vtkPolyData.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Cached geometry of the triangles of a surface mesh
+ *
+ * The weights of many surface mapping methods are functions of the corner
+ * angles, edge lengths, and areas of the triangles adjacent to an edge.
+ * This table stores these quantities for each triangle in structure of
+ * arrays layout, computed in parallel once, together with the triangles
+ * adjacent to each edge of the edge table. The weight functions of the
+ * surface mappers read from it instead of recomputing the geometry of
+ * each triangle once per incident edge.
+ *
+ * The corners of a triangle are numbered 0, 1, 2 in the order of its point
+ * IDs, and the edge with index k of a triangle is the one opposite corner k.
+ */
+class TriangleGeometry
+{
+public:
+
+  /// Constructor
+  ///
+  /// \param[in] surface Triangulated surface mesh.
+  /// \param[in] edges   Edge table of surface mesh.
+  TriangleGeometry(vtkPolyData *surface, const EdgeTable *edges);
+
+  /// Number of triangles
+  int NumberOfTriangles() const;
+
+  /// Whether all cells of the surface mesh are triangles and no edge is
+  /// shared by more than two triangles
+  bool IsTriangulated() const;
+
+  /// Get point ID of triangle corner
+  int PointId(int t, int k) const;
+
+  /// Get corner index of point in triangle or -1 if it is not a corner
+  int Corner(int t, int ptId) const;
+
+  /// Interior angle of triangle at corner k
+  double Angle(int t, int k) const;
+
+  /// Cotangent of interior angle of triangle at corner k
+  double Cotangent(int t, int k) const;
+
+  /// Length of triangle edge opposite corner k
+  double EdgeLength(int t, int k) const;
+
+  /// Area of triangle
+  double Area(int t) const;
+
+  /// Get triangles adjacent to an edge
+  ///
+  /// \param[in]  i  First end point of edge.
+  /// \param[in]  j  Second end point of edge.
+  /// \param[out] t1 First adjacent triangle.
+  /// \param[out] t2 Second adjacent triangle or -1 for a boundary edge.
+  ///
+  /// \returns Number of triangles adjacent to the edge, i.e., 0, 1, or 2.
+  int GetEdgeTriangles(int i, int j, int &t1, int &t2) const;
+
+  /// Get corner of triangle adjacent to an edge which is opposite this edge
+  int OppositeCorner(int t, int i, int j) const;
+
+private:
+
+  const EdgeTable *_EdgeTable;          ///< Edge table of surface mesh
+  bool             _IsTriangulated;     ///< Whether mesh is a triangulated manifold
+  Array<int>       _PointIds;           ///< Point IDs of triangle corners
+  Array<double>    _Angle[3];           ///< Interior angle at each corner
+  Array<double>    _Cotangent[3];       ///< Cotangent of angle at each corner
+  Array<double>    _EdgeLength[3];      ///< Length of edge opposite each corner
+  Array<double>    _Area;               ///< Area of each triangle
+  Array<int>       _EdgeTriangles;      ///< Two triangles adjacent to each edge
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Inline definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+inline int TriangleGeometry::NumberOfTriangles() const
+{
+  return static_cast<int>(_Area.size());
+}
+
+// -----------------------------------------------------------------------------
+inline bool TriangleGeometry::IsTriangulated() const
+{
+  return _IsTriangulated;
+}
+
+// -----------------------------------------------------------------------------
+inline int TriangleGeometry::PointId(int t, int k) const
+{
+  return _PointIds[3 * t + k];
+}
+
+// -----------------------------------------------------------------------------
+inline int TriangleGeometry::Corner(int t, int ptId) const
+{
+  const int *ptIds = _PointIds.data() + 3 * t;
+  return (ptIds[0] == ptId ? 0 : (ptIds[1] == ptId ? 1 : (ptIds[2] == ptId ? 2 : -1)));
+}
+
+// -----------------------------------------------------------------------------
+inline double TriangleGeometry::Angle(int t, int k) const
+{
+  return _Angle[k][t];
+}
+
+// -----------------------------------------------------------------------------
+inline double TriangleGeometry::Cotangent(int t, int k) const
+{
+  return _Cotangent[k][t];
+}
+
+// -----------------------------------------------------------------------------
+inline double TriangleGeometry::EdgeLength(int t, int k) const
+{
+  return _EdgeLength[k][t];
+}
+
+// -----------------------------------------------------------------------------
+inline double TriangleGeometry::Area(int t) const
+{
+  return _Area[t];
+}
+
+// -----------------------------------------------------------------------------
+inline int TriangleGeometry::GetEdgeTriangles(int i, int j, int &t1, int &t2) const
+{
+  const int edgeId = _EdgeTable->EdgeId(i, j);
+  if (edgeId < 0) {
+    t1 = t2 = -1;
+    return 0;
+  }
+  t1 = _EdgeTriangles[2 * edgeId];
+  t2 = _EdgeTriangles[2 * edgeId + 1];
+  return (t1 < 0 ? 0 : (t2 < 0 ? 1 : 2));
+}
+
+// -----------------------------------------------------------------------------
+inline int TriangleGeometry::OppositeCorner(int t, int i, int j) const
+{
+  return 3 - Corner(t, i) - Corner(t, j);
+}
+
+
+} // namespace mirtk
+
+#endif // MIRTK_TriangleGeometry_H
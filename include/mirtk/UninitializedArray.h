@@ -0,0 +1,81 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_UninitializedArray_H
+#define MIRTK_UninitializedArray_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace mirtk {
+
+
+/**
+ * Allocator which default-initializes instead of value-initializes elements
+ *
+ * Resizing a std::vector which uses this allocator leaves new elements of
+ * trivial type uninitialized instead of setting them to zero. The memory
+ * pages of a large buffer are therefore not touched by the resizing thread,
+ * but by the threads which first write its values. With a first-touch page
+ * placement policy, as used by Linux on NUMA systems, each page is then
+ * allocated on the memory node of the thread which fills it. When the values
+ * are later read by the same partition of a parallel loop, most accesses
+ * stay local to the memory node of the reading thread.
+ */
+template <class T>
+class UninitializedAllocator : public std::allocator<T>
+{
+public:
+
+  template <class U>
+  struct rebind { typedef UninitializedAllocator<U> other; };
+
+  UninitializedAllocator() noexcept {}
+
+  template <class U>
+  UninitializedAllocator(const UninitializedAllocator<U> &) noexcept {}
+
+  /// Default-initialize element
+  template <class U>
+  void construct(U *p) noexcept
+  {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  /// Construct element from arguments
+  template <class U, class... Args>
+  void construct(U *p, Args &&... args)
+  {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+};
+
+/// Contiguous array whose new elements of trivial type are left uninitialized
+///
+/// \sa UninitializedAllocator
+template <class T>
+using UninitializedArray = std::vector<T, UninitializedAllocator<T> >;
+
+
+} // namespace mirtk
+
+#endif // MIRTK_UninitializedArray_H
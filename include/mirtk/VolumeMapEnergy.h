@@ -0,0 +1,153 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIRTK_VolumeMapEnergy_H
+#define MIRTK_VolumeMapEnergy_H
+
+#include "mirtk/Object.h"
+
+#include "mirtk/Mapping.h"
+#include "mirtk/GenericImage.h"
+#include "mirtk/ImageAttributes.h"
+
+#include "vtkSmartPointer.h"
+#include "vtkPointSet.h"
+
+
+namespace mirtk {
+
+
+/**
+ * Harmonic and deformation energy of a volumetric map
+ *
+ * The energies are integrated over the points of a regular lattice, where
+ * the Jacobian of the map is approximated by central differences of the map
+ * values at neighboring lattice points. The map is evaluated for one slab of
+ * consecutive lattice slices at a time, with one additional slice on either
+ * side of the slab, and the energy density of each slice of the slab is summed
+ * in parallel. The peak memory is therefore independent of the number of
+ * lattice slices. The energy of each lattice slice is summed using Neumaier's
+ * compensated summation, and the total energy is the compensated sum of the
+ * slice energies in slice order, which does not depend on the number of threads.
+ *
+ * Lattice points outside the optional mask and points whose neighbors are
+ * outside the map domain do not contribute finite differences. Alternatively,
+ * the Jacobian of the map is evaluated at each lattice point of a slab using
+ * Mapping::EvaluateJacobian, which is exact for maps that override it.
+ *
+ * - Li et al. (2009). Meshless harmonic volumetric mapping using fundamental
+ *   solution methods. IEEE Transactions on Automation Science and Engineering,
+ *   6(3), 409–422.
+ */
+class VolumeMapEnergy : public Object
+{
+  mirtkObjectMacro(VolumeMapEnergy);
+
+  // ---------------------------------------------------------------------------
+  // Attributes
+
+  /// Lattice on which to evaluate the map
+  mirtkPublicAttributeMacro(ImageAttributes, Lattice);
+
+  /// Piecewise linear complex (PLC) defining the subset of lattice points
+  /// at which to evaluate the map, all lattice points if \c nullptr
+  mirtkPublicAttributeMacro(vtkSmartPointer<vtkPointSet>, Mask);
+
+  /// Whether to evaluate the harmonic energy
+  mirtkPublicAttributeMacro(bool, EvaluateHarmonicEnergy);
+
+  /// Whether to evaluate the deformation energy of a 3D -> 3D map
+  mirtkPublicAttributeMacro(bool, EvaluateDeformationEnergy);
+
+  /// First Lamé parameter of deformation energy
+  mirtkPublicAttributeMacro(double, Lambda);
+
+  /// Second Lamé parameter (shear modulus) of deformation energy
+  mirtkPublicAttributeMacro(double, Mu);
+
+  /// Whether to evaluate the Jacobian of the map at each lattice point using
+  /// Mapping::EvaluateJacobian instead of finite differences of map values
+  mirtkPublicAttributeMacro(bool, UseMapJacobian);
+
+  /// Number of lattice slices per slab
+  ///
+  /// When non-positive, slabs of about 2^24 map values are evaluated at once.
+  mirtkPublicAttributeMacro(int, NumberOfSlicesPerSlab);
+
+  /// Optional output image of harmonic energy of each lattice point
+  mirtkPublicAttributeMacro(GenericImage<double> *, HarmonicEnergyImage);
+
+  /// Optional output image of deformation energy of each lattice point
+  mirtkPublicAttributeMacro(GenericImage<double> *, DeformationEnergyImage);
+
+  /// Harmonic energy of map
+  mirtkReadOnlyAttributeMacro(double, HarmonicEnergy);
+
+  /// Deformation energy of map
+  mirtkReadOnlyAttributeMacro(double, DeformationEnergy);
+
+  /// Copy attributes of this class from another instance
+  void CopyAttributes(const VolumeMapEnergy &);
+
+private:
+
+  double _DomainScale[3];   ///< Scaling of map domain along each axis
+  double _CodomainScale[3]; ///< Scaling of map values of each component
+
+  // ---------------------------------------------------------------------------
+  // Construction/Destruction
+
+public:
+
+  /// Default constructor
+  VolumeMapEnergy();
+
+  /// Copy constructor
+  VolumeMapEnergy(const VolumeMapEnergy &);
+
+  /// Assignment operator
+  VolumeMapEnergy &operator =(const VolumeMapEnergy &);
+
+  /// Destructor
+  virtual ~VolumeMapEnergy();
+
+  // ---------------------------------------------------------------------------
+  // Evaluation
+
+  /// Normalize map domain and codomain to the unit box
+  ///
+  /// The energies are evaluated as if the map domain and the map values
+  /// were scaled such that the given bounding boxes are mapped to the unit
+  /// box, which makes the energies of different maps comparable.
+  ///
+  /// \param[in] domain   Bounds of map domain in VTK order.
+  /// \param[in] codomain Bounds of map codomain in VTK order.
+  void Normalize(const double domain[6], const double codomain[6]);
+
+  /// Evaluate energies of given map
+  ///
+  /// \param[in] map Volumetric map.
+  void Run(const Mapping *map);
+
+};
+
+
+} // namespace mirtk
+
+#endif // MIRTK_VolumeMapEnergy_H
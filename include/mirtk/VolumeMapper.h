@@ -23,6 +23,8 @@
 #include "mirtk/Object.h"
 
 #include "mirtk/Mapping.h"
+#include "mirtk/MapperStatistics.h"
+#include "mirtk/MapperObserver.h"
 
 #include "vtkSmartPointer.h"
 #include "vtkPointSet.h"
@@ -66,6 +68,27 @@ class VolumeMapper : public Object
   ///       called before this map can be evaluated at map domain points.
   mirtkReadOnlyAttributeMacro(SharedPtr<Mapping>, Output);
 
+  /// Execution statistics of last Run
+  mirtkReadOnlyAttributeMacro(MapperStatistics, Statistics);
+
+  /// Observer notified after each iteration of the iterative methods, not owned
+  mirtkPublicAttributeMacro(MapperObserver *, Observer);
+
+  /// Whether to store the output map compactly, i.e., with single precision
+  /// point coordinates and map values and 32-bit cell connectivity if possible
+  ///
+  /// \sa Mapping::Compact
+  mirtkPublicAttributeMacro(bool, CompactOutput);
+
+  /// Maximum number of threads which execute the parallel loops of Run
+  ///
+  /// When positive, Run is executed in a task arena of this concurrency, such
+  /// that multiple mappers which run concurrently on the same machine, e.g.,
+  /// the jobs of a batch, each use at most this number of threads of the
+  /// shared thread pool. A non-positive value imposes no limit. The limit is
+  /// only effective when MIRTK is built with TBB.
+  mirtkPublicAttributeMacro(int, MaximumNumberOfThreads);
+
   /// Copy attributes of this class from another instance
   void CopyAttributes(const VolumeMapper &);
 
@@ -100,6 +123,20 @@ public:
   /// Parameterize interior of input data set
   void Run();
 
+private:
+
+  /// Functor which executes the steps of Run within a task arena
+  struct Execution;
+
+  /// Execute steps of Run, i.e., Initialize, Solve, Refine, and Finalize
+  void Execute();
+
+public:
+
+  /// Outcome of last Run, i.e., whether it completed or the output is the best
+  /// iterate reached before the time limit of the Observer or a cancellation
+  MapperStatus Status() const;
+
 protected:
 
   /// Initialize filter after input and parameters are set
@@ -111,6 +148,12 @@ protected:
   /// Compute map value at free points
   virtual void Solve() = 0;
 
+  /// Adapt discretization of volume to map computed by last Solve
+  ///
+  /// \returns Whether the discretization was modified and the map must be
+  ///          computed again by Solve. The default implementation returns false.
+  virtual bool Refine();
+
   /// Finalize filter execution
   virtual void Finalize();
 
@@ -120,6 +163,12 @@ protected:
 // Inline definitions
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+inline MapperStatus VolumeMapper::Status() const
+{
+  return _Statistics.Status();
+}
+
 // -----------------------------------------------------------------------------
 inline int VolumeMapper::NumberOfComponents() const
 {
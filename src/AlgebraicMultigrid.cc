@@ -0,0 +1,348 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/AlgebraicMultigrid.h"
+
+#include "mirtk/Math.h"
+
+#include <cstring>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace AlgebraicMultigridUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Whether two compressed sparse matrices have the same sparsity pattern
+bool HaveSamePattern(const AlgebraicMultigrid::MatrixType &A,
+                     const AlgebraicMultigrid::MatrixType &B)
+{
+  if (A.rows() != B.rows() || A.cols() != B.cols() || A.nonZeros() != B.nonZeros()) {
+    return false;
+  }
+  const size_t nouter = static_cast<size_t>(A.outerSize() + 1);
+  const size_t ninner = static_cast<size_t>(A.nonZeros());
+  return memcmp(A.outerIndexPtr(), B.outerIndexPtr(), nouter * sizeof(*A.outerIndexPtr())) == 0 &&
+         memcmp(A.innerIndexPtr(), B.innerIndexPtr(), ninner * sizeof(*A.innerIndexPtr())) == 0;
+}
+
+
+} // namespace AlgebraicMultigridUtils
+using namespace AlgebraicMultigridUtils;
+
+// =============================================================================
+// Construction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+AlgebraicMultigrid::AlgebraicMultigrid()
+:
+  _BlockSize(1),
+  _CoarseSize(500),
+  _MaximumNumberOfLevels(20),
+  _NumberOfSmoothingSweeps(1),
+  _CoarseSolverOk(false),
+  _Info(Eigen::Success)
+{
+}
+
+// =============================================================================
+// Setup
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int AlgebraicMultigrid::Aggregate(const MatrixType &A, int bs, double eps, Array<int> &aggregates)
+{
+  typedef Eigen::Triplet<double> Entry;
+
+  const int n = static_cast<int>(A.rows()) / bs;
+
+  // Strength of connection between nodes, i.e., Frobenius norm of blocks
+  MatrixType S(n, n);
+  {
+    Array<Entry> entries;
+    entries.reserve(A.nonZeros());
+    for (int c = 0; c < A.outerSize(); ++c)
+    for (MatrixType::InnerIterator it(A, c); it; ++it) {
+      entries.push_back(Entry(static_cast<int>(it.row()) / bs, c / bs, it.value() * it.value()));
+    }
+    S.setFromTriplets(entries.begin(), entries.end());
+  }
+  VectorType d(n);
+  d.setZero();
+  for (int j = 0; j < n; ++j)
+  for (MatrixType::InnerIterator it(S, j); it; ++it) {
+    if (it.row() == j) d(j) = sqrt(it.value());
+  }
+
+  // Adjacency of strongly connected nodes
+  Array<int> offsets(n + 1, 0), neighbors;
+  neighbors.reserve(S.nonZeros());
+  for (int j = 0; j < n; ++j) {
+    for (MatrixType::InnerIterator it(S, j); it; ++it) {
+      const int i = static_cast<int>(it.row());
+      if (i != j && sqrt(it.value()) >= eps * sqrt(d(i) * d(j))) {
+        neighbors.push_back(i);
+      }
+    }
+    offsets[j + 1] = static_cast<int>(neighbors.size());
+  }
+
+  // Phase 1: Nodes whose strong neighbors are all unaggregated
+  //          form an aggregate together with these neighbors
+  int num = 0;
+  aggregates.assign(n, -1);
+  for (int i = 0; i < n; ++i) {
+    if (aggregates[i] >= 0) continue;
+    bool free = true;
+    for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+      if (aggregates[neighbors[k]] >= 0) {
+        free = false;
+        break;
+      }
+    }
+    if (free && offsets[i + 1] > offsets[i]) {
+      aggregates[i] = num;
+      for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+        aggregates[neighbors[k]] = num;
+      }
+      ++num;
+    }
+  }
+
+  // Phase 2: Remaining nodes join an aggregate of a strong neighbor
+  Array<int> phase2(aggregates);
+  for (int i = 0; i < n; ++i) {
+    if (phase2[i] >= 0) continue;
+    for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+      if (phase2[neighbors[k]] >= 0) {
+        aggregates[i] = phase2[neighbors[k]];
+        break;
+      }
+    }
+  }
+
+  // Phase 3: Left over nodes form aggregates with their unaggregated neighbors
+  for (int i = 0; i < n; ++i) {
+    if (aggregates[i] >= 0) continue;
+    aggregates[i] = num;
+    for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+      if (aggregates[neighbors[k]] < 0) aggregates[neighbors[k]] = num;
+    }
+    ++num;
+  }
+
+  return num;
+}
+
+// -----------------------------------------------------------------------------
+double AlgebraicMultigrid::SpectralRadius(const MatrixType &A, const VectorType &D)
+{
+  const int n = static_cast<int>(A.rows());
+  VectorType x(n), y(n);
+  for (int i = 0; i < n; ++i) {
+    x(i) = 1. + static_cast<double>(i % 7) / 7.;
+  }
+  double rho = 1.;
+  for (int iter = 0; iter < 15; ++iter) {
+    const double norm = x.norm();
+    if (norm == .0) break;
+    x /= norm;
+    y = A * x;
+    y = y.cwiseQuotient(D);
+    rho = y.norm();
+    x = y;
+  }
+  return rho;
+}
+
+// -----------------------------------------------------------------------------
+void AlgebraicMultigrid::Setup(const MatrixType &A)
+{
+  typedef Eigen::Triplet<double> Entry;
+
+  MatrixType A0 = A;
+  A0.makeCompressed();
+
+  // Keep aggregates of previous hierarchy, which only depend on the pattern
+  Array<Array<int> > aggregates;
+  Array<int>         naggregates;
+  if (!_Levels.empty() && HaveSamePattern(_Levels[0].A, A0)) {
+    for (size_t l = 0; l + 1 < _Levels.size(); ++l) {
+      aggregates .push_back(_Levels[l].Aggregates);
+      naggregates.push_back(_Levels[l].NumberOfAggregates);
+    }
+  }
+
+  _Levels.clear();
+  _Levels.reserve(_MaximumNumberOfLevels > 0 ? _MaximumNumberOfLevels : 1);
+  _Levels.push_back(Level());
+  _Levels[0].A.swap(A0);
+
+  const int bs = (_BlockSize > 0 && A.rows() % _BlockSize == 0 ? _BlockSize : 1);
+
+  double eps = .08;
+  for (size_t l = 0; ; ++l, eps *= .5) {
+    const int n = static_cast<int>(_Levels[l].A.rows());
+
+    // Diagonal of system matrix
+    _Levels[l].D = _Levels[l].A.diagonal();
+    for (int i = 0; i < n; ++i) {
+      if (_Levels[l].D(i) == .0) _Levels[l].D(i) = 1.;
+    }
+    _Levels[l].NumberOfAggregates = 0;
+    if (n <= _CoarseSize || static_cast<int>(l + 1) >= _MaximumNumberOfLevels) break;
+
+    // Aggregate nodes
+    Array<int> &agg = _Levels[l].Aggregates;
+    int        &num = _Levels[l].NumberOfAggregates;
+    if (l < aggregates.size() && static_cast<int>(aggregates[l].size()) * bs == n) {
+      agg = aggregates[l];
+      num = naggregates[l];
+    } else {
+      aggregates.clear();
+      num = Aggregate(_Levels[l].A, bs, eps, agg);
+    }
+    if (num * bs >= n || num == 0) {
+      num = 0;
+      break;
+    }
+
+    // Tentative prolongator with constant vector of each component per aggregate
+    Array<int> size(num, 0);
+    for (size_t i = 0; i < agg.size(); ++i) ++size[agg[i]];
+    MatrixType T(n, num * bs);
+    {
+      Array<Entry> entries;
+      entries.reserve(n);
+      for (int i = 0; i < n; ++i) {
+        const int node = i / bs, c = i % bs;
+        entries.push_back(Entry(i, agg[node] * bs + c, 1. / sqrt(static_cast<double>(size[agg[node]]))));
+      }
+      T.setFromTriplets(entries.begin(), entries.end());
+    }
+
+    // Smoothed prolongator P = (I - omega D^-1 A) T
+    const double omega = (4. / 3.) / SpectralRadius(_Levels[l].A, _Levels[l].D);
+    const VectorType Dinv = _Levels[l].D.cwiseInverse();
+    const MatrixType AT = _Levels[l].A * T;
+    const MatrixType DAT = Dinv.asDiagonal() * AT;
+    MatrixType P = T - omega * DAT;
+    P.prune(.0);
+
+    // Galerkin coarse operator
+    Level coarse;
+    coarse.R = P.transpose();
+    coarse.P = P;
+    {
+      MatrixType RA = coarse.R * _Levels[l].A;
+      coarse.A = RA * P;
+    }
+    coarse.A.prune(.0);
+    coarse.A.makeCompressed();
+    _Levels[l].P.swap(coarse.P);
+    _Levels[l].R.swap(coarse.R);
+    _Levels.push_back(coarse);
+  }
+
+  // Factorize coarsest system
+  _CoarseSolver.compute(_Levels.back().A);
+  _CoarseSolverOk = (_CoarseSolver.info() == Eigen::Success);
+  _Info = Eigen::Success;
+}
+
+// =============================================================================
+// Solve
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void AlgebraicMultigrid::Smooth(const MatrixType &A, const VectorType &D,
+                                const VectorType &b, VectorType &x, bool forward)
+{
+  // Symmetric matrix, i.e., column i contains the entries of row i
+  const int n = static_cast<int>(A.rows());
+  for (int k = 0; k < n; ++k) {
+    const int i = (forward ? k : n - 1 - k);
+    double s = b(i);
+    for (MatrixType::InnerIterator it(A, i); it; ++it) {
+      if (it.row() != i) s -= it.value() * x(it.row());
+    }
+    x(i) = s / D(i);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void AlgebraicMultigrid::Cycle(int l, const VectorType &b, VectorType &x) const
+{
+  const Level &level = _Levels[l];
+  x.setZero(b.rows());
+
+  // Coarsest level
+  if (l + 1 == NumberOfLevels()) {
+    if (_CoarseSolverOk) {
+      x = _CoarseSolver.solve(b);
+    } else {
+      for (int i = 0; i < 2 * _NumberOfSmoothingSweeps; ++i) {
+        Smooth(level.A, level.D, b, x, true);
+        Smooth(level.A, level.D, b, x, false);
+      }
+    }
+    return;
+  }
+
+  // Pre-smoothing
+  for (int i = 0; i < _NumberOfSmoothingSweeps; ++i) {
+    Smooth(level.A, level.D, b, x, true);
+  }
+
+  // Coarse grid correction
+  VectorType r  = b - level.A * x;
+  VectorType bc = level.R * r, xc;
+  Cycle(l + 1, bc, xc);
+  x += level.P * xc;
+
+  // Post-smoothing in reverse order such that preconditioner is symmetric
+  for (int i = 0; i < _NumberOfSmoothingSweeps; ++i) {
+    Smooth(level.A, level.D, b, x, false);
+  }
+}
+
+// =============================================================================
+// Hierarchy
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+double AlgebraicMultigrid::OperatorComplexity() const
+{
+  if (_Levels.empty() || _Levels[0].A.nonZeros() == 0) return .0;
+  double nnz = .0;
+  for (size_t l = 0; l < _Levels.size(); ++l) {
+    nnz += static_cast<double>(_Levels[l].A.nonZeros());
+  }
+  return nnz / static_cast<double>(_Levels[0].A.nonZeros());
+}
+
+
+} // namespace mirtk
@@ -38,8 +38,12 @@
 namespace mirtk {
 
 
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
 // =============================================================================
-// Construction/destruction
+// Auxiliary functors
 // =============================================================================
 
 namespace AsConformalAsPossibleMapperUtils {
@@ -172,8 +176,84 @@ public:
 };
 
 
-}
-// namespace AsConformalAsPossibleMapperUtils
+// -----------------------------------------------------------------------------
+/// Evaluate quadratic energy of piecewise linear map defined by operator weights
+class EvaluateEnergy
+{
+  const LinearTetrahedralMeshMapper *_Filter;
+
+public:
+
+  double _Energy;
+
+  // ---------------------------------------------------------------------------
+  EvaluateEnergy(const LinearTetrahedralMeshMapper *filter)
+  :
+    _Filter(filter), _Energy(.0)
+  {}
+
+  EvaluateEnergy(const EvaluateEnergy &other, split)
+  :
+    _Filter(other._Filter), _Energy(.0)
+  {}
+
+  void join(const EvaluateEnergy &other)
+  {
+    _Energy += other._Energy;
+  }
+
+  // ---------------------------------------------------------------------------
+  /// Energy of edge, where the system matrix has the negated weight as
+  /// diagonal block and the weight as off-diagonal block
+  double EdgeEnergy(vtkIdType ptId0, vtkIdType ptId1, const Matrix3x3 &weight) const
+  {
+    double d[3], e = .0;
+    for (int i = 0; i < 3; ++i) {
+      d[i] = _Filter->Coords()->GetComponent(ptId0, i) - _Filter->Coords()->GetComponent(ptId1, i);
+    }
+    for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) {
+      e -= d[i] * weight[i][j] * d[j];
+    }
+    return e;
+  }
+
+  // ---------------------------------------------------------------------------
+  void operator ()(const blocked_range<vtkIdType> &cellIds)
+  {
+    vtkIdType i0, i1, i2, i3;
+    double    v0[3], v1[3], v2[3], v3[3], volume;
+
+    vtkPointSet * const pointset = _Filter->Volume();
+    vtkNew<vtkIdList> ptIds;
+
+    for (vtkIdType cellId = cellIds.begin(); cellId != cellIds.end(); ++cellId) {
+      GetCellPoints(pointset, cellId, ptIds.GetPointer());
+
+      i0 = ptIds->GetId(0);
+      i1 = ptIds->GetId(1);
+      i2 = ptIds->GetId(2);
+      i3 = ptIds->GetId(3);
+
+      pointset->GetPoint(i0, v0);
+      pointset->GetPoint(i1, v1);
+      pointset->GetPoint(i2, v2);
+      pointset->GetPoint(i3, v3);
+
+      volume = vtkTetra::ComputeVolume(v0, v1, v2, v3);
+
+      _Energy += EdgeEnergy(i0, i1, _Filter->GetWeight(cellId, v0, v1, v2, v3, volume));
+      _Energy += EdgeEnergy(i0, i2, _Filter->GetWeight(cellId, v0, v2, v3, v1, volume));
+      _Energy += EdgeEnergy(i0, i3, _Filter->GetWeight(cellId, v0, v3, v1, v2, volume));
+      _Energy += EdgeEnergy(i1, i2, _Filter->GetWeight(cellId, v1, v2, v0, v3, volume));
+      _Energy += EdgeEnergy(i1, i3, _Filter->GetWeight(cellId, v1, v3, v2, v0, volume));
+      _Energy += EdgeEnergy(i2, i3, _Filter->GetWeight(cellId, v2, v3, v0, v1, volume));
+    }
+  }
+};
+
+
+} // namespace AsConformalAsPossibleMapperUtils
 using namespace AsConformalAsPossibleMapperUtils;
 
 // =============================================================================
@@ -184,14 +264,18 @@ using namespace AsConformalAsPossibleMapperUtils;
 void AsConformalAsPossibleMapper
 ::CopyAttributes(const AsConformalAsPossibleMapper &other)
 {
-  _UniformWeight = other._UniformWeight;
-  _Orientation   = other._Orientation;
+  _UniformWeight                 = other._UniformWeight;
+  _NumberOfLocalGlobalIterations = other._NumberOfLocalGlobalIterations;
+  _EnergyTolerance               = other._EnergyTolerance;
+  _Orientation                   = other._Orientation;
 }
 
 // -----------------------------------------------------------------------------
 AsConformalAsPossibleMapper::AsConformalAsPossibleMapper()
 :
-  _UniformWeight(.7)
+  _UniformWeight(.7),
+  _NumberOfLocalGlobalIterations(1),
+  _EnergyTolerance(1e-4)
 {
 }
 
@@ -254,6 +338,12 @@ void AsConformalAsPossibleMapper::Initialize()
   }
 
   // Compute local orientation of each tetrahedron
+  UpdateOrientation();
+}
+
+// -----------------------------------------------------------------------------
+void AsConformalAsPossibleMapper::UpdateOrientation()
+{
   _Orientation.resize(_Volume->GetNumberOfCells());
   ComputeOrientationOfTetrahedra eval;
   eval._PointSet    = _Volume;
@@ -263,6 +353,35 @@ void AsConformalAsPossibleMapper::Initialize()
   parallel_for(cellIds, eval);
 }
 
+// -----------------------------------------------------------------------------
+void AsConformalAsPossibleMapper::Solve()
+{
+  const int maxiter = max(1, _NumberOfLocalGlobalIterations);
+
+  double energy = (maxiter > 1 ? Energy() : .0), prev;
+  if (verbose && maxiter > 1) {
+    cout << "\nInitial ACAP energy = " << energy << endl;
+  }
+  for (int iter = 1; iter <= maxiter; ++iter) {
+
+    // Global step
+    LinearTetrahedralMeshMapper::Solve(this);
+    if (iter == maxiter) break;
+
+    // Check convergence, where orientations are those of the last global step
+    prev   = energy;
+    energy = Energy();
+    if (verbose) {
+      cout << "\nACAP energy after iteration " << iter << " = " << energy << endl;
+    }
+    if (abs(prev - energy) <= _EnergyTolerance * abs(prev)) break;
+    if (_Observer && !_Observer->Notify("local-global", iter, energy)) break;
+
+    // Local step
+    UpdateOrientation();
+  }
+}
+
 // -----------------------------------------------------------------------------
 void AsConformalAsPossibleMapper::Finalize()
 {
@@ -277,6 +396,15 @@ void AsConformalAsPossibleMapper::Finalize()
 // Auxiliary functions
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+double AsConformalAsPossibleMapper::Energy() const
+{
+  EvaluateEnergy eval(this);
+  blocked_range<vtkIdType> cellIds(0, _Volume->GetNumberOfCells());
+  parallel_reduce(cellIds, eval);
+  return eval._Energy;
+}
+
 // -----------------------------------------------------------------------------
 static inline Matrix3x3 GetScaleMatrix(const double n[3], double w)
 {
@@ -69,24 +69,21 @@ AuthalicSurfaceMapper::~AuthalicSurfaceMapper()
 // -----------------------------------------------------------------------------
 double AuthalicSurfaceMapper::Weight(int i, int j) const
 {
-  double a[3], b[3], c[3], w;
-
-  int k, l;
-  if (GetEdgeNeighborPoints(i, j, k, l) > 2 || k < 0) {
+  int t[2], k[2];
+  if (GetEdgeTriangles(i, j, t, k) == 0) {
     cerr << this->NameOfType() << "::Weight: Surface mesh must be triangulated!" << endl;
     exit(1);
   }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
-  _Surface->GetPoint(static_cast<vtkIdType>(i), a);
-  _Surface->GetPoint(static_cast<vtkIdType>(j), b);
-  _Surface->GetPoint(static_cast<vtkIdType>(k), c);
-  w = Triangle::Cotangent(a, b, c);
-  if (l >= 0) {
-    _Surface->GetPoint(static_cast<vtkIdType>(l), c);
-    w += Triangle::Cotangent(a, b, c);
+  // Cotangents of the angles at j of the triangles adjacent to edge (i, j)
+  double w = tris.Cotangent(t[0], tris.Corner(t[0], j));
+  if (t[1] >= 0) {
+    w += tris.Cotangent(t[1], tris.Corner(t[1], j));
   }
 
-  return w / vtkMath::Distance2BetweenPoints(a, b);
+  const double d = tris.EdgeLength(t[0], k[0]);
+  return w / (d * d);
 }
 
 
@@ -0,0 +1,421 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/BlockSparseMatrix.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Stream.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/ParallelConjugateGradient.h"
+
+#include "Eigen/SparseCore"
+#include "Eigen/SparseCholesky"
+
+#include <cstdint>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace BlockSparseMatrixUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Copy column indices and zero coefficients of block rows
+///
+/// The first write to these arrays uses the same partition of the block rows
+/// as the matrix-vector product, which places the memory pages on the memory
+/// nodes of the threads that later read them.
+struct InitializeBlockRows
+{
+  const int *_RowOffset;
+  const int *_Index;
+  int       *_ColumnIndex;
+  double    *_Values;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int begin = _RowOffset[re.begin()];
+    const int end   = _RowOffset[re.end()];
+    for (int k = begin; k < end; ++k) {
+      _ColumnIndex[k] = _Index[k];
+    }
+    for (int i = 9 * begin; i < 9 * end; ++i) {
+      _Values[i] = .0;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Multiply block sparse matrix by vector
+struct MultiplyBlockRows
+{
+  const BlockSparseMatrix3 *_Matrix;
+  const double             *_X;
+  double                   *_Y;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double *a, *x;
+    double        y0, y1, y2;
+    for (int r = re.begin(); r != re.end(); ++r) {
+      y0 = y1 = y2 = .0;
+      for (int k = _Matrix->RowOffset(r); k < _Matrix->RowOffset(r + 1); ++k) {
+        a = _Matrix->Block(k);
+        x = _X + 3 * _Matrix->ColumnIndex(k);
+        y0 += a[0] * x[0] + a[1] * x[1] + a[2] * x[2];
+        y1 += a[3] * x[0] + a[4] * x[1] + a[5] * x[2];
+        y2 += a[6] * x[0] + a[7] * x[1] + a[8] * x[2];
+      }
+      _Y[3 * r    ] = y0;
+      _Y[3 * r + 1] = y1;
+      _Y[3 * r + 2] = y2;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Apply block Jacobi preconditioner, i.e., z = M^-1 r
+struct ApplyBlockJacobi
+{
+  const double *_Inverse;
+  const double *_R;
+  double       *_Z;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double *m, *r;
+    double       *z;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      m = _Inverse + 9 * i;
+      r = _R + 3 * i;
+      z = _Z + 3 * i;
+      z[0] = m[0] * r[0] + m[1] * r[1] + m[2] * r[2];
+      z[1] = m[3] * r[0] + m[4] * r[1] + m[5] * r[2];
+      z[2] = m[6] * r[0] + m[7] * r[1] + m[8] * r[2];
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Block sparse matrix with block Jacobi preconditioner
+struct BlockJacobiOperator
+{
+  const BlockSparseMatrix3 *_Matrix;
+  Array<double>             _Inverse;
+
+  void Multiply(const double *x, double *y) const
+  {
+    _Matrix->Multiply(x, y);
+  }
+
+  void Precondition(const double *r, double *z) const
+  {
+    ApplyBlockJacobi precond;
+    precond._Inverse = _Inverse.data();
+    precond._R       = r;
+    precond._Z       = z;
+    parallel_for(blocked_range<int>(0, _Matrix->Rows()), precond);
+  }
+};
+
+
+// -----------------------------------------------------------------------------
+/// Block sparse matrix with additive Schwarz preconditioner
+struct BlockSchwarzOperator
+{
+  const BlockSparseMatrix3         *_Matrix;
+  const BlockSchwarzPreconditioner *_Preconditioner;
+
+  void Multiply(const double *x, double *y) const
+  {
+    _Matrix->Multiply(x, y);
+  }
+
+  void Precondition(const double *r, double *z) const
+  {
+    _Preconditioner->Apply(r, z);
+  }
+};
+
+
+} // namespace BlockSparseMatrixUtils
+using namespace BlockSparseMatrixUtils;
+
+// =============================================================================
+// Construction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+BlockSparseMatrix3::BlockSparseMatrix3()
+:
+  _Rows(0), _RowOffset(1, 0)
+{
+}
+
+// -----------------------------------------------------------------------------
+void BlockSparseMatrix3
+::Initialize(int n, const Array<int> &offset, const Array<int> &index)
+{
+  if (static_cast<int>(offset.size()) != n + 1 || offset[n] != static_cast<int>(index.size())) {
+    cerr << "BlockSparseMatrix3::Initialize: Invalid sparsity pattern" << endl;
+    exit(1);
+  }
+  _Rows        = n;
+  _RowOffset = offset;
+  _ColumnIndex.clear();
+  _ColumnIndex.shrink_to_fit();
+  _ColumnIndex.resize(index.size());
+  _Values.clear();
+  _Values.shrink_to_fit();
+  _Values.resize(9 * index.size());
+  if (n > 0) {
+    InitializeBlockRows init;
+    init._RowOffset   = _RowOffset.data();
+    init._Index       = index.data();
+    init._ColumnIndex = _ColumnIndex.data();
+    init._Values      = _Values.data();
+    parallel_for(blocked_range<int>(0, n), init);
+  }
+}
+
+// =============================================================================
+// Operations
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int BlockSparseMatrix3::Find(int r, int c) const
+{
+  const int *begin = _ColumnIndex.data() + _RowOffset[r];
+  const int *end   = _ColumnIndex.data() + _RowOffset[r + 1];
+  const int *pos   = lower_bound(begin, end, c);
+  if (pos == end || *pos != c) return -1;
+  return static_cast<int>(pos - _ColumnIndex.data());
+}
+
+// -----------------------------------------------------------------------------
+void BlockSparseMatrix3::Multiply(const double *x, double *y) const
+{
+  MultiplyBlockRows mul;
+  mul._Matrix = this;
+  mul._X      = x;
+  mul._Y      = y;
+  parallel_for(blocked_range<int>(0, _Rows), mul);
+}
+
+// -----------------------------------------------------------------------------
+void BlockSparseMatrix3::InvertDiagonal(Array<double> &inv) const
+{
+  inv.resize(9 * _Rows);
+  double *m = inv.data(), det;
+  for (int r = 0; r < _Rows; ++r, m += 9) {
+    const int k = Find(r, r);
+    for (int i = 0; i < 9; ++i) m[i] = .0;
+    if (k < 0) {
+      m[0] = m[4] = m[8] = 1.;
+      continue;
+    }
+    const double *a = Block(k);
+    m[0] = a[4] * a[8] - a[5] * a[7];
+    m[1] = a[2] * a[7] - a[1] * a[8];
+    m[2] = a[1] * a[5] - a[2] * a[4];
+    m[3] = a[5] * a[6] - a[3] * a[8];
+    m[4] = a[0] * a[8] - a[2] * a[6];
+    m[5] = a[2] * a[3] - a[0] * a[5];
+    m[6] = a[3] * a[7] - a[4] * a[6];
+    m[7] = a[1] * a[6] - a[0] * a[7];
+    m[8] = a[0] * a[4] - a[1] * a[3];
+    det  = a[0] * m[0] + a[1] * m[3] + a[2] * m[6];
+    if (det != .0) {
+      for (int i = 0; i < 9; ++i) m[i] /= det;
+    } else {
+      for (int i = 0; i < 9; ++i) m[i] = .0;
+      m[0] = (a[0] != .0 ? 1. / a[0] : 1.);
+      m[4] = (a[4] != .0 ? 1. / a[4] : 1.);
+      m[8] = (a[8] != .0 ? 1. / a[8] : 1.);
+    }
+  }
+}
+
+// =============================================================================
+// Additive Schwarz preconditioner
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+struct BlockSchwarzPreconditioner::Subdomain
+{
+  int                                                _Begin; ///< First block row
+  int                                                _End;   ///< End of block rows
+  Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > _LLT;   ///< Factor of diagonal submatrix
+};
+
+namespace BlockSparseMatrixUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Factorize diagonal submatrices of subdomains
+struct FactorizeSubdomains
+{
+  typedef BlockSchwarzPreconditioner::Subdomain Subdomain;
+
+  const BlockSparseMatrix3 *_Matrix;
+  SharedPtr<Subdomain>     *_Subdomains;
+  bool                     *_Success;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    typedef Eigen::Triplet<double> Triplet;
+    Array<Triplet> entries;
+    for (int s = re.begin(); s != re.end(); ++s) {
+      Subdomain &sub = *_Subdomains[s];
+      const int  r0  = sub._Begin;
+      const int  n   = 3 * (sub._End - r0);
+      entries.clear();
+      for (int r = sub._Begin; r < sub._End; ++r) {
+        for (int k = _Matrix->RowOffset(r); k < _Matrix->RowOffset(r + 1); ++k) {
+          const int c = _Matrix->ColumnIndex(k);
+          if (c < sub._Begin || c >= sub._End) continue;
+          const double *a = _Matrix->Block(k);
+          for (int i = 0; i < 3; ++i)
+          for (int j = 0; j < 3; ++j) {
+            if (a[3 * i + j] != .0) {
+              entries.push_back(Triplet(3 * (r - r0) + i, 3 * (c - r0) + j, a[3 * i + j]));
+            }
+          }
+        }
+      }
+      Eigen::SparseMatrix<double> A(n, n);
+      A.setFromTriplets(entries.begin(), entries.end());
+      sub._LLT.compute(A);
+      _Success[s] = (sub._LLT.info() == Eigen::Success);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Solve subdomain systems
+struct SolveSubdomains
+{
+  typedef BlockSchwarzPreconditioner::Subdomain Subdomain;
+
+  const SharedPtr<Subdomain> *_Subdomains;
+  const double               *_R;
+  double                     *_Z;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int s = re.begin(); s != re.end(); ++s) {
+      const Subdomain &sub = *_Subdomains[s];
+      const int        n   = 3 * (sub._End - sub._Begin);
+      Eigen::Map<const Eigen::VectorXd> r(_R + 3 * sub._Begin, n);
+      Eigen::Map<Eigen::VectorXd>       z(_Z + 3 * sub._Begin, n);
+      z = sub._LLT.solve(r);
+    }
+  }
+};
+
+
+} // namespace BlockSparseMatrixUtils
+
+// -----------------------------------------------------------------------------
+BlockSchwarzPreconditioner::BlockSchwarzPreconditioner()
+:
+  _Rows(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+BlockSchwarzPreconditioner::~BlockSchwarzPreconditioner()
+{
+}
+
+// -----------------------------------------------------------------------------
+bool BlockSchwarzPreconditioner::Initialize(const BlockSparseMatrix3 &A, int nsubdomains)
+{
+  _Rows = A.Rows();
+  _Subdomains.clear();
+  nsubdomains = max(1, min(nsubdomains, _Rows));
+  if (_Rows == 0) return true;
+  _Subdomains.resize(nsubdomains);
+  for (int s = 0; s < nsubdomains; ++s) {
+    _Subdomains[s] = NewShared<Subdomain>();
+    _Subdomains[s]->_Begin = static_cast<int>((static_cast<int64_t>(s)     * _Rows) / nsubdomains);
+    _Subdomains[s]->_End   = static_cast<int>((static_cast<int64_t>(s + 1) * _Rows) / nsubdomains);
+  }
+  Array<bool> success(nsubdomains, false);
+  FactorizeSubdomains factorize;
+  factorize._Matrix     = &A;
+  factorize._Subdomains = _Subdomains.data();
+  factorize._Success    = success.data();
+  parallel_for(blocked_range<int>(0, nsubdomains, 1), factorize);
+  for (int s = 0; s < nsubdomains; ++s) {
+    if (!success[s]) {
+      _Subdomains.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void BlockSchwarzPreconditioner::Apply(const double *r, double *z) const
+{
+  SolveSubdomains solve;
+  solve._Subdomains = _Subdomains.data();
+  solve._R          = r;
+  solve._Z          = z;
+  parallel_for(blocked_range<int>(0, NumberOfSubdomains(), 1), solve);
+}
+
+// =============================================================================
+// Solver
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool ConjugateGradient(const BlockSparseMatrix3 &A, const double *b, double *x,
+                       int maxiter, double tol, int *niter, double *error,
+                       MapperObserver *observer)
+{
+  BlockJacobiOperator op;
+  op._Matrix = &A;
+  A.InvertDiagonal(op._Inverse);
+  return ParallelConjugateGradient(op, 3 * A.Rows(), b, x, true, maxiter, tol, niter, error, observer);
+}
+
+// -----------------------------------------------------------------------------
+bool ConjugateGradient(const BlockSparseMatrix3 &A, const BlockSchwarzPreconditioner &M,
+                       const double *b, double *x, int maxiter, double tol,
+                       int *niter, double *error, MapperObserver *observer)
+{
+  if (M.Rows() != A.Rows() || M.NumberOfSubdomains() == 0) {
+    return ConjugateGradient(A, b, x, maxiter, tol, niter, error, observer);
+  }
+  BlockSchwarzOperator op;
+  op._Matrix         = &A;
+  op._Preconditioner = &M;
+  return ParallelConjugateGradient(op, 3 * A.Rows(), b, x, true, maxiter, tol, niter, error, observer);
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,584 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/BoundaryDistanceField.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/PointSetUtils.h"
+
+#include "vtkNew.h"
+#include "vtkIdList.h"
+#include "vtkCellType.h"
+#include "vtkMath.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace BoundaryDistanceFieldUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute closest point of a triangle (cf. Ericson, 2005, Section 5.1.5)
+///
+/// \returns Closest triangle feature, i.e., 0 for the face, 1 + k for corner k,
+///          and 4 + k for the edge from corner k to corner (k + 1) % 3.
+int ClosestPoint(const double p[3], const double a[3], const double b[3],
+                 const double c[3], double q[3])
+{
+  double ab[3], ac[3], ap[3], bp[3], cp[3];
+  for (int i = 0; i < 3; ++i) {
+    ab[i] = b[i] - a[i];
+    ac[i] = c[i] - a[i];
+    ap[i] = p[i] - a[i];
+    bp[i] = p[i] - b[i];
+    cp[i] = p[i] - c[i];
+  }
+  const double d1 = vtkMath::Dot(ab, ap);
+  const double d2 = vtkMath::Dot(ac, ap);
+  if (d1 <= .0 && d2 <= .0) {
+    q[0] = a[0], q[1] = a[1], q[2] = a[2];
+    return 1;
+  }
+  const double d3 = vtkMath::Dot(ab, bp);
+  const double d4 = vtkMath::Dot(ac, bp);
+  if (d3 >= .0 && d4 <= d3) {
+    q[0] = b[0], q[1] = b[1], q[2] = b[2];
+    return 2;
+  }
+  const double vc = d1 * d4 - d3 * d2;
+  if (vc <= .0 && d1 >= .0 && d3 <= .0) {
+    const double v = (d1 - d3 > .0 ? d1 / (d1 - d3) : .0);
+    for (int i = 0; i < 3; ++i) q[i] = a[i] + v * ab[i];
+    return 4;
+  }
+  const double d5 = vtkMath::Dot(ab, cp);
+  const double d6 = vtkMath::Dot(ac, cp);
+  if (d6 >= .0 && d5 <= d6) {
+    q[0] = c[0], q[1] = c[1], q[2] = c[2];
+    return 3;
+  }
+  const double vb = d5 * d2 - d1 * d6;
+  if (vb <= .0 && d2 >= .0 && d6 <= .0) {
+    const double w = (d2 - d6 > .0 ? d2 / (d2 - d6) : .0);
+    for (int i = 0; i < 3; ++i) q[i] = a[i] + w * ac[i];
+    return 6;
+  }
+  const double va = d3 * d6 - d5 * d4;
+  if (va <= .0 && d4 - d3 >= .0 && d5 - d6 >= .0) {
+    const double den = (d4 - d3) + (d5 - d6);
+    const double w   = (den > .0 ? (d4 - d3) / den : .0);
+    for (int i = 0; i < 3; ++i) q[i] = b[i] + w * (c[i] - b[i]);
+    return 5;
+  }
+  const double den = va + vb + vc;
+  if (den <= .0) {
+    q[0] = a[0], q[1] = a[1], q[2] = a[2];
+    return 1;
+  }
+  const double v = vb / den;
+  const double w = vc / den;
+  for (int i = 0; i < 3; ++i) q[i] = a[i] + v * ab[i] + w * ac[i];
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+/// Edge of a triangle used to find the triangles sharing an edge
+struct TriangleEdge
+{
+  int _PtId1; ///< Smaller point ID
+  int _PtId2; ///< Larger point ID
+  int _Index; ///< Index of edge, i.e., 3 * triangle + corner
+
+  bool operator <(const TriangleEdge &other) const
+  {
+    return _PtId1 < other._PtId1 || (_PtId1 == other._PtId1 && _PtId2 < other._PtId2);
+  }
+
+  bool operator ==(const TriangleEdge &other) const
+  {
+    return _PtId1 == other._PtId1 && _PtId2 == other._PtId2;
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute exact distance at lattice points near the triangles of each slice
+struct SeedNearestTriangles
+{
+  const BoundaryDistanceField *_Field;
+  const ImageAttributes       *_Lattice;
+  const int                   *_Boxes;
+  const int                   *_Offset;
+  const int                   *_List;
+  float                       *_Distance;
+  int                         *_Nearest;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int nx = _Lattice->_x;
+    const int ny = _Lattice->_y;
+    double p[3], d;
+    int vox;
+    for (int k = re.begin(); k != re.end(); ++k)
+    for (int n = _Offset[k]; n < _Offset[k + 1]; ++n) {
+      const int  t   = _List[n];
+      const int *box = _Boxes + 6 * t;
+      for (int j = box[2]; j <= box[3]; ++j)
+      for (int i = box[0]; i <= box[1]; ++i) {
+        p[0] = i, p[1] = j, p[2] = k;
+        _Lattice->LatticeToWorld(p[0], p[1], p[2]);
+        d   = _Field->Distance(p, t);
+        vox = i + nx * (j + ny * k);
+        if (abs(d) < abs(static_cast<double>(_Distance[vox]))) {
+          _Distance[vox] = static_cast<float>(d);
+          _Nearest [vox] = t;
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Propagate nearest triangle along one lattice axis in both directions
+struct PropagateNearestTriangle
+{
+  const BoundaryDistanceField *_Field;
+  const ImageAttributes       *_Lattice;
+  float                       *_Distance;
+  int                         *_Nearest;
+  int                          _Axis;
+  int                          _NumberOfChanges;
+
+  PropagateNearestTriangle() : _NumberOfChanges(0) {}
+
+  PropagateNearestTriangle(const PropagateNearestTriangle &other, split)
+  :
+    _Field(other._Field),
+    _Lattice(other._Lattice),
+    _Distance(other._Distance),
+    _Nearest(other._Nearest),
+    _Axis(other._Axis),
+    _NumberOfChanges(0)
+  {}
+
+  void join(const PropagateNearestTriangle &other)
+  {
+    _NumberOfChanges += other._NumberOfChanges;
+  }
+
+  /// Update distance of lattice point from nearest triangle of its neighbor
+  void Update(int ijk[3], int vox, int prev)
+  {
+    const int t = _Nearest[prev];
+    if (t < 0 || t == _Nearest[vox]) return;
+    double p[3] = {double(ijk[0]), double(ijk[1]), double(ijk[2])};
+    _Lattice->LatticeToWorld(p[0], p[1], p[2]);
+    const double d = _Field->Distance(p, t);
+    if (abs(d) < abs(static_cast<double>(_Distance[vox]))) {
+      _Distance[vox] = static_cast<float>(d);
+      _Nearest [vox] = t;
+      ++_NumberOfChanges;
+    }
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    const int dim[3] = {_Lattice->_x, _Lattice->_y, _Lattice->_z};
+    const int a = _Axis, b = (_Axis + 1) % 3, c = (_Axis + 2) % 3;
+    const int stride[3] = {1, dim[0], dim[0] * dim[1]};
+    int ijk[3], vox;
+    for (int r = re.begin(); r != re.end(); ++r) {
+      ijk[b] = r % dim[b];
+      ijk[c] = r / dim[b];
+      ijk[a] = 0;
+      vox = ijk[0] + dim[0] * (ijk[1] + dim[1] * ijk[2]);
+      for (ijk[a] = 1, vox += stride[a]; ijk[a] < dim[a]; ++ijk[a], vox += stride[a]) {
+        Update(ijk, vox, vox - stride[a]);
+      }
+      for (ijk[a] = dim[a] - 2, vox -= 2 * stride[a]; ijk[a] >= 0; --ijk[a], vox -= stride[a]) {
+        Update(ijk, vox, vox + stride[a]);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate signed distance of multiple points
+struct EvaluateDistances
+{
+  const BoundaryDistanceField *_Field;
+  const double                *_Points;
+  double                      *_Distances;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double *p;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      p = _Points + 3 * i;
+      _Distances[i] = _Field->Evaluate(p[0], p[1], p[2]);
+    }
+  }
+};
+
+
+} // namespace BoundaryDistanceFieldUtils
+using namespace BoundaryDistanceFieldUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void BoundaryDistanceField::CopyAttributes(const BoundaryDistanceField &other)
+{
+  _Surface        = other._Surface;
+  _Lattice        = other._Lattice;
+  _MaximumSize    = other._MaximumSize;
+  _Margin         = other._Margin;
+  _ExactBandWidth = other._ExactBandWidth;
+  _Distances      = other._Distances;
+  _Points         = other._Points;
+  _Triangles      = other._Triangles;
+  _FaceNormals    = other._FaceNormals;
+  _EdgeNormals    = other._EdgeNormals;
+  _VertexNormals  = other._VertexNormals;
+  _Nearest        = other._Nearest;
+  _MaxSpacing     = other._MaxSpacing;
+}
+
+// -----------------------------------------------------------------------------
+BoundaryDistanceField::BoundaryDistanceField()
+:
+  _MaximumSize(128),
+  _Margin(2),
+  _ExactBandWidth(2.),
+  _MaxSpacing(.0)
+{
+}
+
+// -----------------------------------------------------------------------------
+BoundaryDistanceField::BoundaryDistanceField(const BoundaryDistanceField &other)
+:
+  Object(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+BoundaryDistanceField &BoundaryDistanceField::operator =(const BoundaryDistanceField &other)
+{
+  if (this != &other) {
+    Object::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+BoundaryDistanceField::~BoundaryDistanceField()
+{
+}
+
+// -----------------------------------------------------------------------------
+void BoundaryDistanceField::Initialize()
+{
+  if (!_Surface) {
+    cerr << this->NameOfType() << "::Initialize: No surface set" << endl;
+    exit(1);
+  }
+
+  // Surface points
+  const int npoints = static_cast<int>(_Surface->GetNumberOfPoints());
+  _Points.resize(3 * npoints);
+  for (int ptId = 0; ptId < npoints; ++ptId) {
+    _Surface->GetPoint(static_cast<vtkIdType>(ptId), _Points.data() + 3 * ptId);
+  }
+
+  // Surface triangles, where polygons are split into triangle fans
+  _Triangles.clear();
+  vtkNew<vtkIdList> ptIds;
+  for (vtkIdType cellId = 0; cellId < _Surface->GetNumberOfCells(); ++cellId) {
+    const int type = _Surface->GetCellType(cellId);
+    if (type != VTK_TRIANGLE && type != VTK_QUAD && type != VTK_POLYGON) continue;
+    GetCellPoints(_Surface, cellId, ptIds.GetPointer());
+    for (vtkIdType i = 2; i < ptIds->GetNumberOfIds(); ++i) {
+      _Triangles.push_back(static_cast<int>(ptIds->GetId(0)));
+      _Triangles.push_back(static_cast<int>(ptIds->GetId(i - 1)));
+      _Triangles.push_back(static_cast<int>(ptIds->GetId(i)));
+    }
+  }
+  const int ntris = this->NumberOfTriangles();
+  if (ntris == 0) {
+    cerr << this->NameOfType() << "::Initialize: Surface has no triangles" << endl;
+    exit(1);
+  }
+
+  // Orient triangles such that the enclosed volume is positive, i.e., the
+  // normals point outwards and the distance is positive outside the surface
+  double volume = .0, ab[3];
+  for (int t = 0; t < ntris; ++t) {
+    const double *a = _Points.data() + 3 * _Triangles[3 * t    ];
+    const double *b = _Points.data() + 3 * _Triangles[3 * t + 1];
+    const double *c = _Points.data() + 3 * _Triangles[3 * t + 2];
+    vtkMath::Cross(b, c, ab);
+    volume += vtkMath::Dot(a, ab);
+  }
+  if (volume < .0) {
+    for (int t = 0; t < ntris; ++t) {
+      std::swap(_Triangles[3 * t + 1], _Triangles[3 * t + 2]);
+    }
+  }
+
+  // Face normals and angle weighted vertex pseudo-normals
+  _FaceNormals  .assign(3 * ntris, .0);
+  _VertexNormals.assign(3 * npoints, .0);
+  double e[3][3], angle, len;
+  for (int t = 0; t < ntris; ++t) {
+    const int *ids = _Triangles.data() + 3 * t;
+    double    *n   = _FaceNormals.data() + 3 * t;
+    for (int k = 0; k < 3; ++k) {
+      const double *p1 = _Points.data() + 3 * ids[k];
+      const double *p2 = _Points.data() + 3 * ids[(k + 1) % 3];
+      for (int i = 0; i < 3; ++i) e[k][i] = p2[i] - p1[i];
+    }
+    vtkMath::Cross(e[0], e[1], n);
+    if (vtkMath::Normalize(n) == .0) continue;
+    for (int k = 0; k < 3; ++k) {
+      // Interior angle between edge to next corner and edge from previous corner
+      const double *e1 = e[k];
+      const double *e2 = e[(k + 2) % 3];
+      len = vtkMath::Norm(e1) * vtkMath::Norm(e2);
+      if (len == .0) continue;
+      angle = acos(max(-1., min(1., -vtkMath::Dot(e1, e2) / len)));
+      double *nv = _VertexNormals.data() + 3 * ids[k];
+      for (int i = 0; i < 3; ++i) nv[i] += angle * n[i];
+    }
+  }
+
+  // Edge pseudo-normals, i.e., sum of normals of triangles sharing the edge
+  Array<TriangleEdge> edges(3 * ntris);
+  for (int t = 0; t < ntris; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      TriangleEdge &edge = edges[3 * t + k];
+      edge._PtId1 = min(_Triangles[3 * t + k], _Triangles[3 * t + (k + 1) % 3]);
+      edge._PtId2 = max(_Triangles[3 * t + k], _Triangles[3 * t + (k + 1) % 3]);
+      edge._Index = 3 * t + k;
+    }
+  }
+  sort(edges.begin(), edges.end());
+  _EdgeNormals.assign(9 * ntris, .0);
+  for (size_t n1 = 0, n2; n1 < edges.size(); n1 = n2) {
+    double sum[3] = {.0, .0, .0};
+    for (n2 = n1; n2 < edges.size() && edges[n2] == edges[n1]; ++n2) {
+      const double *n = _FaceNormals.data() + 3 * (edges[n2]._Index / 3);
+      for (int i = 0; i < 3; ++i) sum[i] += n[i];
+    }
+    for (size_t n = n1; n < n2; ++n) {
+      double *ne = _EdgeNormals.data() + 3 * edges[n]._Index;
+      for (int i = 0; i < 3; ++i) ne[i] = sum[i];
+    }
+  }
+
+  // Lattice on which the distance is precomputed
+  double bounds[6];
+  _Surface->GetBounds(bounds);
+  if (_Lattice._x <= 0 || _Lattice._y <= 0 || _Lattice._z <= 0) {
+    const double lx = bounds[1] - bounds[0];
+    const double ly = bounds[3] - bounds[2];
+    const double lz = bounds[5] - bounds[4];
+    const int    n  = max(_MaximumSize - 1 - 2 * max(_Margin, 0), 1);
+    double ds = max(max(lx, ly), lz) / n;
+    if (ds <= .0) ds = 1.;
+    _Lattice = ImageAttributes();
+    _Lattice._xorigin = bounds[0] + .5 * lx;
+    _Lattice._yorigin = bounds[2] + .5 * ly;
+    _Lattice._zorigin = bounds[4] + .5 * lz;
+    _Lattice._x       = max(2, iceil(lx / ds) + 1 + 2 * max(_Margin, 0));
+    _Lattice._y       = max(2, iceil(ly / ds) + 1 + 2 * max(_Margin, 0));
+    _Lattice._z       = max(2, iceil(lz / ds) + 1 + 2 * max(_Margin, 0));
+    _Lattice._dx      = ds;
+    _Lattice._dy      = ds;
+    _Lattice._dz      = ds;
+  }
+  _Lattice._t  = 1;
+  _Lattice._dt = .0;
+  if (_Lattice._x < 2 || _Lattice._y < 2 || _Lattice._z < 2) {
+    cerr << this->NameOfType() << "::Initialize: Lattice must have at least two points along each axis" << endl;
+    exit(1);
+  }
+  _MaxSpacing = max(max(abs(_Lattice._dx), abs(_Lattice._dy)), abs(_Lattice._dz));
+
+  const int nx = _Lattice._x;
+  const int ny = _Lattice._y;
+  const int nz = _Lattice._z;
+  const int nvox = nx * ny * nz;
+  _Distances.Initialize(_Lattice, 1);
+  float * const distance = _Distances.Data();
+  for (int vox = 0; vox < nvox; ++vox) {
+    distance[vox] = numeric_limits<float>::infinity();
+  }
+  _Nearest.assign(nvox, -1);
+
+  // Lattice bounding box of each triangle enlarged by one lattice spacing,
+  // and list of triangles whose bounding box intersects each lattice slice
+  Array<int> boxes(6 * ntris), offset(nz + 1, 0), list;
+  double p[3];
+  for (int t = 0; t < ntris; ++t) {
+    double b[6] = {+inf, -inf, +inf, -inf, +inf, -inf};
+    for (int k = 0; k < 3; ++k) {
+      const double *x = _Points.data() + 3 * _Triangles[3 * t + k];
+      p[0] = x[0], p[1] = x[1], p[2] = x[2];
+      _Lattice.WorldToLattice(p[0], p[1], p[2]);
+      for (int d = 0; d < 3; ++d) {
+        b[2*d  ] = min(b[2*d  ], p[d]);
+        b[2*d+1] = max(b[2*d+1], p[d]);
+      }
+    }
+    int *box = boxes.data() + 6 * t;
+    box[0] = max(0,      ifloor(b[0]) - 1);
+    box[1] = min(nx - 1, iceil (b[1]) + 1);
+    box[2] = max(0,      ifloor(b[2]) - 1);
+    box[3] = min(ny - 1, iceil (b[3]) + 1);
+    box[4] = max(0,      ifloor(b[4]) - 1);
+    box[5] = min(nz - 1, iceil (b[5]) + 1);
+    for (int k = box[4]; k <= box[5]; ++k) ++offset[k + 1];
+  }
+  for (int k = 0; k < nz; ++k) offset[k + 1] += offset[k];
+  list.resize(offset[nz]);
+  {
+    Array<int> pos(offset.begin(), offset.end() - 1);
+    for (int t = 0; t < ntris; ++t) {
+      const int *box = boxes.data() + 6 * t;
+      for (int k = box[4]; k <= box[5]; ++k) list[pos[k]++] = t;
+    }
+  }
+
+  // Exact distance at lattice points near the surface
+  SeedNearestTriangles seed;
+  seed._Field    = this;
+  seed._Lattice  = &_Lattice;
+  seed._Boxes    = boxes.data();
+  seed._Offset   = offset.data();
+  seed._List     = list.data();
+  seed._Distance = distance;
+  seed._Nearest  = _Nearest.data();
+  parallel_for(blocked_range<int>(0, nz), seed);
+
+  // Propagate nearest triangles until no distance decreases any further
+  const int dim[3] = {nx, ny, nz};
+  for (int iter = 0; iter < 8; ++iter) {
+    int nchanges = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      PropagateNearestTriangle propagate;
+      propagate._Field    = this;
+      propagate._Lattice  = &_Lattice;
+      propagate._Distance = distance;
+      propagate._Nearest  = _Nearest.data();
+      propagate._Axis     = axis;
+      parallel_reduce(blocked_range<int>(0, nvox / dim[axis]), propagate);
+      nchanges += propagate._NumberOfChanges;
+    }
+    if (nchanges == 0) break;
+  }
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+double BoundaryDistanceField::Distance(const double p[3], int t) const
+{
+  const int    *ids = _Triangles.data() + 3 * t;
+  const double *a   = _Points.data() + 3 * ids[0];
+  const double *b   = _Points.data() + 3 * ids[1];
+  const double *c   = _Points.data() + 3 * ids[2];
+  double q[3];
+  const int feature = ClosestPoint(p, a, b, c, q);
+  const double *n;
+  if      (feature == 0) n = _FaceNormals.data() + 3 * t;
+  else if (feature <  4) n = _VertexNormals.data() + 3 * ids[feature - 1];
+  else                   n = _EdgeNormals.data() + 9 * t + 3 * (feature - 4);
+  const double v[3] = {p[0] - q[0], p[1] - q[1], p[2] - q[2]};
+  const double d = sqrt(vtkMath::Dot(v, v));
+  return (vtkMath::Dot(v, n) < .0 ? -d : d);
+}
+
+// -----------------------------------------------------------------------------
+double BoundaryDistanceField::Evaluate(double x, double y, double z) const
+{
+  const int nx = _Lattice._x;
+  const int ny = _Lattice._y;
+  const int nz = _Lattice._z;
+
+  double p[3] = {x, y, z};
+  _Lattice.WorldToLattice(x, y, z);
+  const int i = max(0, min(nx - 2, ifloor(x)));
+  const int j = max(0, min(ny - 2, ifloor(y)));
+  const int k = max(0, min(nz - 2, ifloor(z)));
+  const bool outside = (x < .0 || x > nx - 1 || y < .0 || y > ny - 1 || z < .0 || z > nz - 1);
+
+  // Trilinear interpolation of precomputed distance
+  const float * const distance = _Distances.Data();
+  const double wx = x - i, wy = y - j, wz = z - k;
+  double d = .0;
+  int vox[8], n = 0;
+  for (int c = 0; c <= 1; ++c)
+  for (int b = 0; b <= 1; ++b)
+  for (int a = 0; a <= 1; ++a, ++n) {
+    vox[n] = (i + a) + nx * ((j + b) + ny * (k + c));
+    d += (a ? wx : 1. - wx) * (b ? wy : 1. - wy) * (c ? wz : 1. - wz) * distance[vox[n]];
+  }
+  if (!outside && abs(d) > _ExactBandWidth * _MaxSpacing) return d;
+
+  // Exact distance to nearest triangles of surrounding lattice points
+  double dmin = inf, dt;
+  int    t;
+  for (n = 0; n < 8; ++n) {
+    t = _Nearest[vox[n]];
+    if (t < 0) continue;
+    bool visited = false;
+    for (int m = 0; m < n; ++m) {
+      if (_Nearest[vox[m]] == t) visited = true;
+    }
+    if (visited) continue;
+    dt = Distance(p, t);
+    if (abs(dt) < abs(dmin)) dmin = dt;
+  }
+  return (IsInf(dmin) ? d : dmin);
+}
+
+// -----------------------------------------------------------------------------
+void BoundaryDistanceField::Evaluate(int n, const double *xyz, double *d) const
+{
+  EvaluateDistances eval;
+  eval._Field     = this;
+  eval._Points    = xyz;
+  eval._Distances = d;
+  parallel_for(blocked_range<int>(0, n), eval);
+}
+
+
+} // namespace mirtk
@@ -21,18 +21,115 @@
 
 #include "mirtk/Algorithm.h"
 #include "mirtk/Memory.h"
-#include "mirtk/UnorderedMap.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/DataArrayView.h"
 
 #include "vtkPolyData.h"
 #include "vtkPoints.h"
 #include "vtkCellArray.h"
 #include "vtkDataArray.h"
 #include "vtkDoubleArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkNew.h"
 
 
 namespace mirtk {
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace BoundaryMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Copy boundary points with valid map value to preallocated output arrays
+struct CopyBoundaryPoints
+{
+  SurfaceBoundary       *_Boundary;
+  const Matrix          *_Values;
+  const vtkIdType       *_PointIds;
+  const DataArrayView   *_Points;
+  const DataArrayView   *_Output;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    double p[3];
+    for (int i = re.begin(); i != re.end(); ++i) {
+      const vtkIdType ptId = _PointIds[i];
+      if (ptId >= 0) {
+        _Boundary->GetPoint(i, p);
+        _Points->SetTuple(ptId, p);
+        _Output->SetTuple(ptId, _Values->Col(i));
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Count or write line and vertex cells of each boundary segment
+///
+/// A line connects consecutive segment points with valid map value, and an
+/// isolated point with valid map value forms a vertex. When the cell counts
+/// are requested, the connectivity is not written. Otherwise, the cells of
+/// segment n are written in legacy vtkCellArray format starting at the cell
+/// offsets of this segment, i.e., the prefix sums of the cell counts.
+struct GetBoundarySegmentCells
+{
+  SurfaceBoundary       *_Boundary;
+  const vtkIdType       *_PointIds;
+  vtkIdType             *_NumberOfLines;
+  vtkIdType             *_NumberOfVertices;
+  const vtkIdType       *_LineOffset;
+  const vtkIdType       *_VertexOffset;
+  vtkIdType             *_Lines;
+  vtkIdType             *_Vertices;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    int       curPt, prePt, nxtPt;
+    vtkIdType curId, preId, nxtId, nl, nv;
+    vtkIdType *line, *vert;
+    for (int n = re.begin(); n != re.end(); ++n) {
+      line = (_Lines    ? _Lines    + 3 * _LineOffset  [n] : nullptr);
+      vert = (_Vertices ? _Vertices + 2 * _VertexOffset[n] : nullptr);
+      nl = nv = 0;
+      prePt = _Boundary->PointIndex(n, -1);
+      preId = (_PointIds[prePt] < 0 ? -1 : -2);
+      for (int i = 0; i < _Boundary->NumberOfPoints(n); ++i) {
+        curPt = _Boundary->PointIndex(n, i);
+        curId = _PointIds[curPt];
+        if (curId >= 0) {
+          nxtPt = _Boundary->PointIndex(n, i+1);
+          nxtId = _PointIds[nxtPt];
+          if (nxtId >= 0) {
+            if (line) {
+              line[0] = 2, line[1] = curId, line[2] = nxtId;
+              line += 3;
+            }
+            ++nl;
+          } else if (preId == -1) {
+            if (vert) {
+              vert[0] = 1, vert[1] = curId;
+              vert += 2;
+            }
+            ++nv;
+          }
+        }
+        prePt = curPt;
+        preId = curId;
+      }
+      if (_NumberOfLines)    _NumberOfLines   [n] = nl;
+      if (_NumberOfVertices) _NumberOfVertices[n] = nv;
+    }
+  }
+};
+
+
+} // namespace BoundaryMapperUtils
+using namespace BoundaryMapperUtils;
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -40,8 +137,10 @@ namespace mirtk {
 // -----------------------------------------------------------------------------
 void BoundaryMapper::CopyAttributes(const BoundaryMapper &other)
 {
-  _Boundary = other._Boundary;
-  _Values   = other._Values;
+  _Boundary   = other._Boundary;
+  _Values     = other._Values;
+  _Statistics = other._Statistics;
+  _Observer   = other._Observer;
 
   if (other._Output) {
     PiecewiseLinearMap *output;
@@ -54,6 +153,8 @@ void BoundaryMapper::CopyAttributes(const BoundaryMapper &other)
 
 // -----------------------------------------------------------------------------
 BoundaryMapper::BoundaryMapper()
+:
+  _Observer(nullptr)
 {
 }
 
@@ -85,9 +186,25 @@ BoundaryMapper::~BoundaryMapper()
 // -----------------------------------------------------------------------------
 void BoundaryMapper::Run()
 {
-  this->Initialize();
-  this->ComputeMap();
-  this->Finalize();
+  _Statistics.Clear();
+  _Statistics.Mapper(this->NameOfClass());
+  if (_Observer) _Observer->Start();
+  MapperStatistics::Timer run(&_Statistics, "run");
+  {
+    MapperStatistics::Timer timer(&_Statistics, "initialize");
+    this->Initialize();
+  }
+  if (!_Observer || _Observer->Continue()) {
+    MapperStatistics::Timer timer(&_Statistics, "compute");
+    this->ComputeMap();
+  }
+  {
+    MapperStatistics::Timer timer(&_Statistics, "finalize");
+    this->Finalize();
+  }
+  run.Stop();
+  _Statistics.Status(_Observer ? _Observer->Status() : MapperStatus_Completed);
+  _Statistics.UpdatePeakMemory();
 }
 
 // -----------------------------------------------------------------------------
@@ -136,72 +253,77 @@ void BoundaryMapper::Finalize()
   vtkSmartPointer<vtkCellArray> lines  = vtkSmartPointer<vtkCellArray>::New();
   vtkSmartPointer<vtkDataArray> values = vtkSmartPointer<vtkDoubleArray>::New();
 
-  // Get only those boundary points with valid map value
-  values->SetName("BoundaryMap");
-  values->SetNumberOfComponents(dim);
-  points->Allocate(static_cast<vtkIdType>(num));
-  values->Allocate(static_cast<vtkIdType>(dim * num));
-
-  double p[3];
-  UnorderedMap<int, vtkIdType> ptIds;
-  ptIds.reserve(num);
-
-  for (int i = 0; i < num;  ++i) {
-    if (HasBoundaryValue(i)) {
-      _Boundary->GetPoint(i, p);
-      ptIds[i] = points->InsertNextPoint(p);
-      values->InsertNextTuple(_Values.Col(i));
-    }
+  // Get only those boundary points with valid map value, where the output
+  // point IDs are the prefix sum of the valid point indicators
+  Array<vtkIdType> ptIds(num);
+  vtkIdType        npoints = 0;
+  for (int i = 0; i < num; ++i) {
+    ptIds[i] = (HasBoundaryValue(i) ? npoints++ : -1);
   }
-  if (points->GetNumberOfPoints() == 0) {
+  if (npoints == 0) {
     cerr << this->NameOfType() << "::Finalize: No boundary map values have been assigned!" << endl;
     exit(1);
   }
 
-  points->Squeeze();
-  values->Squeeze();
-
-  // Determine topology of boundary map domain
-  int       curPt, prePt, nxtPt;
-  vtkIdType curId, preId, line[2];
-
-  verts->Allocate(verts->EstimateSize(static_cast<vtkIdType>(ptIds.size()), 1));
-  lines->Allocate(lines->EstimateSize(static_cast<vtkIdType>(ptIds.size()), 2));
-
-  for (int n = 0; n < _Boundary->NumberOfSegments(); ++n) {
-    prePt = _Boundary->PointIndex(n, -1);
-    preId = (ptIds.find(prePt) == ptIds.end() ? -1 : -2);
-    for (int i = 0; i < _Boundary->NumberOfPoints(n); ++i) {
-      curPt = _Boundary->PointIndex(n, i);
-      auto curIt = ptIds.find(curPt);
-      if (curIt != ptIds.end()) {
-        curId = curIt->second;
-        nxtPt = _Boundary->PointIndex(n, i+1);
-        auto nxtIt = ptIds.find(nxtPt);
-        if (nxtIt != ptIds.end()) {
-          line[0] = curId;
-          line[1] = nxtIt->second;
-          lines->InsertNextCell(2, line);
-        } else if (preId == -1) {
-          verts->InsertNextCell(1, &curId);
-        }
-      } else {
-        curId = -1;
-      }
-      prePt = curPt;
-      preId = curId;
-    }
+  values->SetName("BoundaryMap");
+  values->SetNumberOfComponents(dim);
+  values->SetNumberOfTuples(npoints);
+  points->SetNumberOfPoints(npoints);
+  {
+    const DataArrayView coords(points->GetData());
+    const DataArrayView output(values);
+    CopyBoundaryPoints copy;
+    copy._Boundary = _Boundary.get();
+    copy._Values   = &_Values;
+    copy._PointIds = ptIds.data();
+    copy._Points   = &coords;
+    copy._Output   = &output;
+    parallel_for(blocked_range<int>(0, num), copy);
+  }
+
+  // Determine topology of boundary map domain, where the cells of each segment
+  // are counted and then written to offsets given by their prefix sums
+  const int nsegments = _Boundary->NumberOfSegments();
+  Array<vtkIdType> nlines(nsegments + 1, 0), nverts(nsegments + 1, 0);
+  {
+    GetBoundarySegmentCells count;
+    count._Boundary = _Boundary.get();
+    count._PointIds = ptIds.data();
+    count._NumberOfLines    = nlines.data() + 1;
+    count._NumberOfVertices = nverts.data() + 1;
+    count._Lines    = nullptr;
+    count._Vertices = nullptr;
+    parallel_for(blocked_range<int>(0, nsegments, 1), count);
+  }
+  for (int n = 0; n < nsegments; ++n) {
+    nlines[n + 1] += nlines[n];
+    nverts[n + 1] += nverts[n];
+  }
+  vtkNew<vtkIdTypeArray> line_conn, vert_conn;
+  line_conn->SetNumberOfTuples(3 * nlines[nsegments]);
+  vert_conn->SetNumberOfTuples(2 * nverts[nsegments]);
+  {
+    GetBoundarySegmentCells write;
+    write._Boundary = _Boundary.get();
+    write._PointIds = ptIds.data();
+    write._LineOffset   = nlines.data();
+    write._VertexOffset = nverts.data();
+    write._NumberOfLines    = nullptr;
+    write._NumberOfVertices = nullptr;
+    write._Lines    = line_conn->GetPointer(0);
+    write._Vertices = vert_conn->GetPointer(0);
+    parallel_for(blocked_range<int>(0, nsegments, 1), write);
   }
 
   // Assemble piecewise linear output map
   vtkSmartPointer<vtkPolyData> domain = vtkSmartPointer<vtkPolyData>::New();
   domain->SetPoints(points);
-  if (verts->GetNumberOfCells() > 0) {
-    verts ->Squeeze();
+  if (nverts[nsegments] > 0) {
+    verts ->SetCells(nverts[nsegments], vert_conn.GetPointer());
     domain->SetVerts(verts);
   }
-  if (lines->GetNumberOfCells() > 0) {
-    lines ->Squeeze();
+  if (nlines[nsegments] > 0) {
+    lines ->SetCells(nlines[nsegments], line_conn.GetPointer());
     domain->SetLines(lines);
   }
 
@@ -20,12 +20,43 @@
 #include "mirtk/BoundarySegmentMapper.h"
 
 #include "mirtk/Algorithm.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Parallel.h"
 #include "mirtk/ChordLengthBoundarySegmentParameterizer.h"
 
 
 namespace mirtk {
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace BoundarySegmentMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Parameterize and map boundary segments in parallel
+struct MapBoundarySegments
+{
+  BoundarySegmentMapper              *_Mapper;
+  const BoundarySegmentParameterizer *_Parameterizer;
+  const int                          *_Segments;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    UniquePtr<BoundarySegmentParameterizer> param(_Parameterizer->NewCopy());
+    for (int k = re.begin(); k != re.end(); ++k) {
+      _Mapper->MapSegment(_Segments[k], *param);
+    }
+  }
+};
+
+
+} // namespace BoundarySegmentMapperUtils
+using namespace BoundarySegmentMapperUtils;
+
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -102,18 +133,24 @@ void BoundarySegmentMapper::MapLargest()
 
 // -----------------------------------------------------------------------------
 void BoundarySegmentMapper::MapSegment(int n)
+{
+  this->MapSegment(n, *_Parameterizer);
+}
+
+// -----------------------------------------------------------------------------
+void BoundarySegmentMapper::MapSegment(int n, BoundarySegmentParameterizer &param)
 {
   // Get boundary segment
   const BoundarySegment &segment = _Boundary->Segment(n);
 
   // Parameterize boundary curve
-  _Parameterizer->Boundary(segment);
-  _Parameterizer->Run();
+  param.Boundary(segment);
+  param.Run();
 
   // Sort points by increasing parameter value
   const int        npoints = segment.NumberOfPoints();
   const Array<int> indices = _Boundary->PointIndices(n);
-  const Array<int> order   = IncreasingOrder(_Parameterizer->Values());
+  const Array<int> order   = IncreasingOrder(param.Values());
 
   Array<int>    i(npoints);
   Array<double> t(npoints);
@@ -123,7 +160,7 @@ void BoundarySegmentMapper::MapSegment(int n)
   for (int j = 0; j < npoints; ++j) {
     const auto &pos = order[j];
     i[j] = indices[pos];
-    t[j] = _Parameterizer->Value(pos);
+    t[j] = param.Value(pos);
     if (segment.IsSelected(pos)) {
       selection.push_back(j);
     }
@@ -133,6 +170,30 @@ void BoundarySegmentMapper::MapSegment(int n)
   this->MapBoundarySegment(n, i, t, selection);
 }
 
+// -----------------------------------------------------------------------------
+void BoundarySegmentMapper::MapSegments(const Array<int> &segments)
+{
+  if (segments.size() == 1) {
+    this->MapSegment(segments[0]);
+  } else if (!segments.empty()) {
+    MapBoundarySegments eval;
+    eval._Mapper        = this;
+    eval._Parameterizer = _Parameterizer.get();
+    eval._Segments      = segments.data();
+    parallel_for(blocked_range<int>(0, static_cast<int>(segments.size()), 1), eval);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void BoundarySegmentMapper::MapAll()
+{
+  Array<int> segments(_Boundary->NumberOfSegments());
+  for (int n = 0; n < _Boundary->NumberOfSegments(); ++n) {
+    segments[n] = n;
+  }
+  this->MapSegments(segments);
+}
+
 // -----------------------------------------------------------------------------
 void BoundarySegmentMapper::Finalize()
 {
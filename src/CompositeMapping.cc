@@ -0,0 +1,410 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/CompositeMapping.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Parallel.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliary functors
+// =============================================================================
+
+namespace CompositeMappingUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Evaluate consecutive analytic maps point by point
+struct EvaluateAnalyticMaps
+{
+  const SharedPtr<const Mapping> *_Maps;
+  int                             _NumberOfMaps;
+  const double                   *_Points;
+  double                         *_Values;
+  int                             _NumberOfComponents; ///< Stride of output values
+  bool                           *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    double p[3], q[3];
+    const double *x = _Points + 3 * re.begin();
+    double       *v = _Values + _NumberOfComponents * re.begin();
+    const int     last = _NumberOfMaps - 1;
+    for (int i = re.begin(); i != re.end(); ++i, x += 3, v += _NumberOfComponents) {
+      p[0] = x[0], p[1] = x[1], p[2] = x[2];
+      for (int k = 0; k < last; ++k) {
+        q[0] = q[1] = q[2] = .0;
+        if (!_Maps[k]->Evaluate(q, p[0], p[1], p[2])) _Inside[i] = false;
+        p[0] = q[0], p[1] = q[1], p[2] = q[2];
+      }
+      if (_NumberOfComponents == 3) {
+        q[0] = q[1] = q[2] = .0;
+        if (!_Maps[last]->Evaluate(q, p[0], p[1], p[2])) _Inside[i] = false;
+        v[0] = q[0], v[1] = q[1], v[2] = q[2];
+      } else {
+        if (!_Maps[last]->Evaluate(v, p[0], p[1], p[2])) _Inside[i] = false;
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Combine domain flags of a map with those of the previous maps and convert
+/// its values to input points of the next map
+struct CombineMapValues
+{
+  const double *_Values;
+  int           _NumberOfComponents;
+  double       *_Points;      ///< Input points of next map or nullptr
+  const bool   *_MapInside;
+  bool         *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      if (!_MapInside[i]) _Inside[i] = false;
+      if (_Points) {
+        const double *v = _Values + _NumberOfComponents * i;
+        double       *p = _Points + 3 * i;
+        for (int j = 0; j < 3; ++j) {
+          p[j] = (j < _NumberOfComponents ? v[j] : .0);
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Assign outside value to points outside the composite map domain
+struct SetOutsideValues
+{
+  double     *_Values;
+  int         _NumberOfComponents;
+  const bool *_Inside;
+  double      _OutsideValue;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      if (!_Inside[i]) {
+        double *v = _Values + _NumberOfComponents * i;
+        for (int j = 0; j < _NumberOfComponents; ++j) {
+          v[j] = _OutsideValue;
+        }
+      }
+    }
+  }
+};
+
+
+} // namespace CompositeMappingUtils
+using namespace CompositeMappingUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::CopyAttributes(const CompositeMapping &other)
+{
+  _Maps      = other._Maps;
+  _BatchSize = other._BatchSize;
+}
+
+// -----------------------------------------------------------------------------
+CompositeMapping::CompositeMapping()
+:
+  _BatchSize(65536)
+{
+}
+
+// -----------------------------------------------------------------------------
+CompositeMapping::CompositeMapping(const CompositeMapping &other)
+:
+  Mapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+CompositeMapping &CompositeMapping::operator =(const CompositeMapping &other)
+{
+  if (this != &other) {
+    Mapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::Initialize()
+{
+  Mapping::Initialize();
+  if (_Maps.empty()) {
+    cerr << this->NameOfType() << "::Initialize: No maps to compose" << endl;
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *CompositeMapping::NewCopy() const
+{
+  return new CompositeMapping(*this);
+}
+
+// -----------------------------------------------------------------------------
+CompositeMapping::~CompositeMapping()
+{
+}
+
+// =============================================================================
+// Component maps
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::Clear()
+{
+  _Maps.clear();
+}
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::Add(const SharedPtr<const Mapping> &map)
+{
+  if (!map) {
+    cerr << this->NameOfType() << "::Add: Map must not be null" << endl;
+    exit(1);
+  }
+  if (!_Maps.empty() && _Maps.back()->NumberOfComponents() > 3) {
+    cerr << this->NameOfType() << "::Add: Codomain dimension of intermediate maps must be at most 3" << endl;
+    exit(1);
+  }
+  _Maps.push_back(map);
+}
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::Add(const Mapping &map)
+{
+  this->Add(SharedPtr<const Mapping>(map.NewCopy()));
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::BoundingBox(double &x1, double &y1, double &z1,
+                                   double &x2, double &y2, double &z2) const
+{
+  if (_Maps.empty()) {
+    x1 = y1 = z1 = x2 = y2 = z2 = .0;
+  } else {
+    _Maps.front()->BoundingBox(x1, y1, z1, x2, y2, z2);
+  }
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int CompositeMapping::NumberOfComponents() const
+{
+  return _Maps.empty() ? 0 : _Maps.back()->NumberOfComponents();
+}
+
+// -----------------------------------------------------------------------------
+bool CompositeMapping::IsAnalytic() const
+{
+  for (size_t k = 0; k < _Maps.size(); ++k) {
+    if (!_Maps[k]->IsAnalytic()) return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool CompositeMapping::Evaluate(double *v, double x, double y, double z) const
+{
+  const int last = NumberOfMaps() - 1;
+  double p[3] = {x, y, z}, q[3];
+  bool inside = true;
+  for (int k = 0; inside && k < last; ++k) {
+    q[0] = q[1] = q[2] = .0;
+    inside = _Maps[k]->Evaluate(q, p[0], p[1], p[2]);
+    p[0] = q[0], p[1] = q[1], p[2] = q[2];
+  }
+  if (inside) inside = _Maps[last]->Evaluate(v, p[0], p[1], p[2]);
+  if (!inside) {
+    for (int j = 0; j < NumberOfComponents(); ++j) v[j] = _OutsideValue;
+  }
+  return inside;
+}
+
+// -----------------------------------------------------------------------------
+bool CompositeMapping::Evaluate(EvaluationContext &ctx, double *v, double x, double y, double z) const
+{
+  const int nmaps = NumberOfMaps();
+  if (static_cast<int>(ctx._Nested.size()) < nmaps) {
+    ctx._Nested.resize(nmaps);
+    for (int k = 0; k < nmaps; ++k) {
+      if (!ctx._Nested[k]) ctx._Nested[k] = NewShared<EvaluationContext>();
+    }
+  }
+  const int last = nmaps - 1;
+  double p[3] = {x, y, z}, q[3];
+  bool inside = true;
+  for (int k = 0; inside && k < last; ++k) {
+    q[0] = q[1] = q[2] = .0;
+    inside = _Maps[k]->Evaluate(*ctx._Nested[k], q, p[0], p[1], p[2]);
+    p[0] = q[0], p[1] = q[1], p[2] = q[2];
+  }
+  if (inside) inside = _Maps[last]->Evaluate(*ctx._Nested[last], v, p[0], p[1], p[2]);
+  if (!inside) {
+    for (int j = 0; j < NumberOfComponents(); ++j) v[j] = _OutsideValue;
+  }
+  return inside;
+}
+
+// -----------------------------------------------------------------------------
+void CompositeMapping::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+
+  const int nmaps = NumberOfMaps();
+  const int dim   = NumberOfComponents();
+  const int batch = (_BatchSize > 0 ? min(_BatchSize, n) : n);
+
+  // Intermediate map values and input points of next map of one batch
+  Array<double> points(3 * static_cast<size_t>(batch));
+  Array<double> buffer(3 * static_cast<size_t>(batch));
+  UniquePtr<bool[]> batch_inside(new bool[batch]);
+  UniquePtr<bool[]> map_inside  (new bool[batch]);
+
+  for (int i0 = 0; i0 < n; i0 += batch) {
+    const int m = min(batch, n - i0);
+    const blocked_range<int> range(0, m);
+
+    const double *x = xyz    + 3   * static_cast<size_t>(i0);
+    double       *v = values + dim * static_cast<size_t>(i0);
+    bool         *b = (inside ? inside + i0 : batch_inside.get());
+    for (int i = 0; i < m; ++i) b[i] = true;
+
+    int k1 = 0, k2;
+    while (k1 < nmaps) {
+      const Mapping * const map = _Maps[k1].get();
+      k2 = k1 + 1;
+      if (map->IsAnalytic()) {
+        while (k2 < nmaps && _Maps[k2]->IsAnalytic()) ++k2;
+      }
+      const bool last = (k2 == nmaps);
+
+      if (map->IsAnalytic()) {
+        // Fused point by point evaluation of consecutive analytic maps,
+        // where each point is read before its values are overwritten
+        EvaluateAnalyticMaps eval;
+        eval._Maps               = _Maps.data() + k1;
+        eval._NumberOfMaps       = k2 - k1;
+        eval._Points             = x;
+        eval._Values             = (last ? v : points.data());
+        eval._NumberOfComponents = (last ? dim : 3);
+        eval._Inside             = b;
+        parallel_for(range, eval);
+      } else {
+        // Batched evaluation of other map
+        double *f = (last ? v : buffer.data());
+        map->Evaluate(m, x, f, map_inside.get());
+        CombineMapValues combine;
+        combine._Values             = f;
+        combine._NumberOfComponents = map->NumberOfComponents();
+        combine._Points             = (last ? nullptr : points.data());
+        combine._MapInside          = map_inside.get();
+        combine._Inside             = b;
+        parallel_for(range, combine);
+      }
+
+      x  = points.data();
+      k1 = k2;
+    }
+
+    SetOutsideValues outside;
+    outside._Values             = v;
+    outside._NumberOfComponents = dim;
+    outside._Inside             = b;
+    outside._OutsideValue       = _OutsideValue;
+    parallel_for(range, outside);
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool CompositeMapping::EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                        double x, double y, double z) const
+{
+  const int nmaps = NumberOfMaps();
+  const int dim   = NumberOfComponents();
+  if (static_cast<int>(ctx._Nested.size()) < nmaps) {
+    ctx._Nested.resize(nmaps);
+    for (int k = 0; k < nmaps; ++k) {
+      if (!ctx._Nested[k]) ctx._Nested[k] = NewShared<EvaluationContext>();
+    }
+  }
+  const size_t n = static_cast<size_t>(3 * dim);
+  if (ctx._Values.size() < n) ctx._Values.resize(n);
+  double * const jlast = ctx._Values.data();
+
+  // Product of Jacobians of maps applied so far, where the missing rows of
+  // maps with less than three components correspond to zero coordinates
+  double J[9] = {1., 0., 0., 0., 1., 0., 0., 0., 1.}, Jk[9], JJ[9];
+  double p[3] = {x, y, z}, q[3];
+  const int last = nmaps - 1;
+  bool inside = true;
+  for (int k = 0; inside && k < last; ++k) {
+    const Mapping &map = *_Maps[k];
+    q[0] = q[1] = q[2] = .0;
+    for (int i = 0; i < 9; ++i) Jk[i] = .0;
+    inside = map.Evaluate(*ctx._Nested[k], q, p[0], p[1], p[2]) &&
+             map.EvaluateJacobian(*ctx._Nested[k], Jk, p[0], p[1], p[2]);
+    for (int r = map.NumberOfComponents(); r < 3; ++r) {
+      Jk[3 * r] = Jk[3 * r + 1] = Jk[3 * r + 2] = .0;
+    }
+    for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c) {
+      JJ[3 * r + c] = Jk[3 * r] * J[c] + Jk[3 * r + 1] * J[3 + c] + Jk[3 * r + 2] * J[6 + c];
+    }
+    for (int i = 0; i < 9; ++i) J[i] = JJ[i];
+    p[0] = q[0], p[1] = q[1], p[2] = q[2];
+  }
+  if (inside) inside = _Maps[last]->EvaluateJacobian(*ctx._Nested[last], jlast, p[0], p[1], p[2]);
+  if (!inside) {
+    for (int j = 0; j < 3 * dim; ++j) jac[j] = _OutsideValue;
+    return false;
+  }
+  for (int l = 0; l < dim; ++l) {
+    const double * const g = jlast + 3 * l;
+    for (int c = 0; c < 3; ++c) {
+      jac[3 * l + c] = g[0] * J[c] + g[1] * J[3 + c] + g[2] * J[6 + c];
+    }
+  }
+  return true;
+}
+
+
+} // namespace mirtk
@@ -28,6 +28,8 @@
 #include "mirtk/PointSetUtils.h"
 
 #include "vtkIdList.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
 #include "vtkPointData.h"
 #include "vtkCellData.h"
 
@@ -37,10 +39,7 @@
   #include "vtkDoubleArray.h"
 #endif
 
-#include "Eigen/SparseCore"
-#include "Eigen/SparseLU"
-#include "Eigen/OrderingMethods"
-#include "Eigen/IterativeLinearSolvers"
+#include "mirtk/SparseSolver.h"
 
 
 namespace mirtk {
@@ -64,6 +63,7 @@ void ConformalSurfaceFlattening
   _Radius             = other._Radius;
   _NumberOfIterations = other._NumberOfIterations;
   _Tolerance          = other._Tolerance;
+  _Solver             = other._Solver;
 }
 
 // -----------------------------------------------------------------------------
@@ -74,7 +74,10 @@ ConformalSurfaceFlattening::ConformalSurfaceFlattening()
   _Scale(0.),
   _Radius(1.),
   _NumberOfIterations(-1),
-  _Tolerance(-1.)
+  _Tolerance(-1.),
+  _Solver(SparseSolver_Default),
+  _FactorizedPoints(nullptr),
+  _FactorizedTime(0)
 {
 }
 
@@ -171,9 +174,10 @@ void ConformalSurfaceFlattening::Initialize()
 // -----------------------------------------------------------------------------
 void ConformalSurfaceFlattening::ComputeMap()
 {
-  const double use_direct_solver = (_NumberOfIterations < 0 || _NumberOfIterations == 1);
+  const bool use_direct_solver = (_NumberOfIterations < 0 || _NumberOfIterations == 1);
 
   MIRTK_START_TIMING();
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
 
   typedef Eigen::MatrixXd             Values;
   typedef Eigen::SparseMatrix<double> Matrix;
@@ -181,9 +185,15 @@ void ConformalSurfaceFlattening::ComputeMap()
   const int n = NumberOfPoints();
   const int m = 2;
 
+  // Reuse factorization of Laplacian when surface was not modified since
+  vtkPoints * const  points = _Surface->GetPoints();
+  const vtkMTimeType mtime  = max(points->GetMTime(), _Surface->GetPolys()->GetMTime());
+  const bool         reuse  = (_Factorization && _Factorization->HasMatrix() &&
+                               _FactorizedPoints == points && _FactorizedTime == mtime);
+
   // Calculate matrix D
   Matrix D(n, n);
-  {
+  if (!reuse) {
     typedef Eigen::VectorXi Vector;
 
     vtkNew<vtkIdList> ptIds;             // cell links list reference
@@ -223,6 +233,15 @@ void ConformalSurfaceFlattening::ComputeMap()
       D.coeffRef(ptIdC, ptIdA) -= cotABC;
     }
     D.makeCompressed();
+
+    // Fix value of first point, which removes the null space of D
+    for (int k = 0; k < D.outerSize(); ++k) {
+      for (Matrix::InnerIterator it(D, k); it; ++it) {
+        if (it.row() == 0 || it.col() == 0) {
+          it.valueRef() = (it.row() == it.col() ? 1. : .0);
+        }
+      }
+    }
   }
 
   // Calculate (complex) right hand side vector b
@@ -267,16 +286,22 @@ void ConformalSurfaceFlattening::ComputeMap()
     b(ptIdA, 1) =  y * (1. - theta);
     b(ptIdB, 1) =  y * theta;
     b(ptIdC, 1) = -y;
+
+    // Equation of first point is implied by the others, whose sum is zero
+    b(0, 0) = b(0, 1) = .0;
   }
 
   MIRTK_DEBUG_TIMING(1, "building sparse linear system");
+  assembly.Stop();
 
   // Solve linear system
   if (verbose) {
     cout << "\n";
     cout << "  No. of surface points  = " << NumberOfPoints() << "\n";
     cout << "  No. of fixed points    = 3\n";
-    cout << "  No. of non-zero values = " << D.nonZeros() << "\n";
+    if (!reuse) {
+      cout << "  No. of non-zero values = " << D.nonZeros() << "\n";
+    }
     cout << "  Dimension of codomain  = " << m << "\n";
     cout.flush();
   }
@@ -287,31 +312,38 @@ void ConformalSurfaceFlattening::ComputeMap()
   int    niter = 0;
   double error = nan;
 
-  if (use_direct_solver) {
-    Eigen::SparseLU<Matrix> solver;
-    solver.analyzePattern(D);
-    solver.factorize(D);
-    x = solver.solve(b);
+  if (!_Factorization) _Factorization = NewShared<SparseFactorization>();
+  _Factorization->Statistics(&_Statistics);
+  _Factorization->Observer(_Observer);
+  SparseSolverType solver;
+  if (reuse) {
+    solver = _Factorization->Resolve(b, x, _NumberOfIterations, _Tolerance,
+                                     false, &niter, &error);
   } else {
-    Eigen::ConjugateGradient<Matrix> solver(D);
-    if (_NumberOfIterations > 0 ) solver.setMaxIterations(_NumberOfIterations);
-    if (_Tolerance          > 0.) solver.setTolerance(_Tolerance);
-    x = solver.solve(b);
-    niter = solver.iterations();
-    error = solver.error();
+    solver = _Factorization->Solve(_Solver, SparseMatrix_SPD, use_direct_solver, D, b, x,
+                                   _NumberOfIterations, _Tolerance, false, &niter, &error);
+    _FactorizedPoints = points;
+    _FactorizedTime   = mtime;
   }
 
+  // Choose solution with zero mean among those differing by a constant
+  const Eigen::RowVectorXd mean = x.colwise().mean();
   for (int i = 0; i < n; ++i) {
     for (int l = 0; l < m; ++l) {
-      _Values->SetComponent(static_cast<vtkIdType>(i), l, x(i, l));
+      _Values->SetComponent(static_cast<vtkIdType>(i), l, x(i, l) - mean(l));
     }
   }
 
   MIRTK_DEBUG_TIMING(1, "solving sparse linear system");
 
-  if (verbose && !use_direct_solver) {
-    cout << "  No. of iterations      = " << niter << "\n";
-    cout << "  Estimated error        = " << error << "\n";
+  if (verbose) {
+    cout << "  Sparse linear solver   = " << ToString(solver) << "\n";
+    if (IsDirectSolver(solver)) {
+      cout << "  No. of factorizations  = " << _Factorization->NumberOfFactorizations() << "\n";
+    } else {
+      cout << "  No. of iterations      = " << niter << "\n";
+      cout << "  Estimated error        = " << error << "\n";
+    }
     cout.flush();
   }
 }
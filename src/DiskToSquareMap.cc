@@ -0,0 +1,141 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/DiskToSquareMap.h"
+
+#include "mirtk/Cfstream.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void DiskToSquareMap::CopyAttributes(const DiskToSquareMap &other)
+{
+  _DiskCenter   = other._DiskCenter;
+  _DiskRadius   = other._DiskRadius;
+  _SquareCenter = other._SquareCenter;
+  _SquareRadius = other._SquareRadius;
+}
+
+// -----------------------------------------------------------------------------
+DiskToSquareMap::DiskToSquareMap()
+:
+  _DiskCenter(.0, .0, .0),
+  _DiskRadius(1.0),
+  _SquareCenter(.0, .0, .0),
+  _SquareRadius(1.0)
+{
+}
+
+// -----------------------------------------------------------------------------
+DiskToSquareMap::DiskToSquareMap(const DiskToSquareMap &other)
+:
+  AnalyticMapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+DiskToSquareMap &DiskToSquareMap::operator =(const DiskToSquareMap &other)
+{
+  if (this != &other) {
+    AnalyticMapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void DiskToSquareMap::Initialize()
+{
+  AnalyticMapping::Initialize();
+  if (_SquareRadius <= .0 || _DiskRadius <= .0) {
+    cerr << this->NameOfType() << "::Initialize: Square and disk radius must be positive" << endl;
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *DiskToSquareMap::NewCopy() const
+{
+  return new DiskToSquareMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+DiskToSquareMap::~DiskToSquareMap()
+{
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void DiskToSquareMap::BoundingBox(double &x1, double &y1, double &z1,
+                                  double &x2, double &y2, double &z2) const
+{
+  x1 = _DiskCenter._x - _DiskRadius;
+  y1 = _DiskCenter._y - _DiskRadius;
+  x2 = _DiskCenter._x + _DiskRadius;
+  y2 = _DiskCenter._y + _DiskRadius;
+  z1 = z2 = .0;
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void DiskToSquareMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  EvaluatePoints(this, n, xyz, values, inside);
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void DiskToSquareMap::ReadMap(Cifstream &is)
+{
+  double params[6];
+  is.ReadAsDouble(params, 6);
+  _DiskCenter   = Point(params[0], params[1], .0);
+  _DiskRadius   = params[2];
+  _SquareCenter = Point(params[3], params[4], .0);
+  _SquareRadius = params[5];
+}
+
+// -----------------------------------------------------------------------------
+void DiskToSquareMap::WriteMap(Cofstream &os) const
+{
+  const double params[6] = {
+    _DiskCenter._x,   _DiskCenter._y,   _DiskRadius,
+    _SquareCenter._x, _SquareCenter._y, _SquareRadius
+  };
+  os.WriteAsDouble(params, 6);
+}
+
+
+} // namespace mirtk
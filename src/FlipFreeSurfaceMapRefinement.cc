@@ -0,0 +1,499 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/FlipFreeSurfaceMapRefinement.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/TriangleGeometry.h"
+
+#include "Eigen/Core"
+
+#include <deque>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace FlipFreeSurfaceMapRefinementUtils {
+
+typedef Eigen::VectorXd Vector;
+
+
+// -----------------------------------------------------------------------------
+/// Regularized Jacobian determinant
+inline double Chi(double d, double eps)
+{
+  return .5 * (d + sqrt(eps * eps + d * d));
+}
+
+// -----------------------------------------------------------------------------
+/// Compute signed area of each mapped triangle
+struct AccumulateSignedArea
+{
+  const TriangleGeometry *_Triangles;
+  const double           *_X;
+  double                  _SignedArea;
+  double                  _Area;
+
+  AccumulateSignedArea() : _SignedArea(.0), _Area(.0) {}
+
+  AccumulateSignedArea(const AccumulateSignedArea &other, split)
+  :
+    _Triangles(other._Triangles),
+    _X(other._X),
+    _SignedArea(.0),
+    _Area(.0)
+  {}
+
+  void join(const AccumulateSignedArea &other)
+  {
+    _SignedArea += other._SignedArea;
+    _Area       += other._Area;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    const double *u0, *u1, *u2;
+    for (int t = re.begin(); t != re.end(); ++t) {
+      u0 = _X + 2 * _Triangles->PointId(t, 0);
+      u1 = _X + 2 * _Triangles->PointId(t, 1);
+      u2 = _X + 2 * _Triangles->PointId(t, 2);
+      _SignedArea += .5 * ((u1[0] - u0[0]) * (u2[1] - u0[1]) - (u2[0] - u0[0]) * (u1[1] - u0[1]));
+      _Area       += _Triangles->Area(t);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate untangling energy and optionally its gradient w.r.t. each corner
+struct EvaluateEnergy
+{
+  const TriangleGeometry *_Triangles;
+  const double           *_Qinv;      ///< Inverse reference shape (q00, q01, q11)
+  const double           *_RefArea;   ///< Scaled area of triangle
+  const double           *_X;         ///< Map values
+  double                 *_Gradient;  ///< Gradient w.r.t. corners or nullptr
+  double                  _Sign;      ///< Orientation of the map
+  double                  _Epsilon;
+  double                  _Theta;
+  double                  _Energy;
+  double                  _MinDet;
+  int                     _NumberOfFlips;
+
+  EvaluateEnergy() : _Energy(.0), _MinDet(inf), _NumberOfFlips(0) {}
+
+  EvaluateEnergy(const EvaluateEnergy &other, split)
+  :
+    _Triangles(other._Triangles),
+    _Qinv(other._Qinv),
+    _RefArea(other._RefArea),
+    _X(other._X),
+    _Gradient(other._Gradient),
+    _Sign(other._Sign),
+    _Epsilon(other._Epsilon),
+    _Theta(other._Theta),
+    _Energy(.0),
+    _MinDet(inf),
+    _NumberOfFlips(0)
+  {}
+
+  void join(const EvaluateEnergy &other)
+  {
+    _Energy        += other._Energy;
+    _MinDet         = min(_MinDet, other._MinDet);
+    _NumberOfFlips += other._NumberOfFlips;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    const double *u0, *u1, *u2, *q;
+    double a, b, c, d, D, F, r, chi, dchi, f1, f2, G[4], U[4], *g;
+
+    for (int t = re.begin(); t != re.end(); ++t) {
+      if (_RefArea[t] <= .0) continue;
+      q  = _Qinv + 3 * t;
+      u0 = _X + 2 * _Triangles->PointId(t, 0);
+      u1 = _X + 2 * _Triangles->PointId(t, 1);
+      u2 = _X + 2 * _Triangles->PointId(t, 2);
+      // Jacobian J = U Q^-1 of map relative to reference triangle
+      U[0] = u1[0] - u0[0];
+      U[1] = u2[0] - u0[0];
+      U[2] = _Sign * (u1[1] - u0[1]);
+      U[3] = _Sign * (u2[1] - u0[1]);
+      a = U[0] * q[0];
+      b = U[0] * q[1] + U[1] * q[2];
+      c = U[2] * q[0];
+      d = U[2] * q[1] + U[3] * q[2];
+      D = a * d - b * c;
+      F = a * a + b * b + c * c + d * d;
+      if (D <= .0) ++_NumberOfFlips;
+      if (D < _MinDet) _MinDet = D;
+      r    = sqrt(_Epsilon * _Epsilon + D * D);
+      chi  = .5 * (D + r);
+      dchi = .5 * (1. + D / r);
+      _Energy += _RefArea[t] * ((1. - _Theta) * F / chi + _Theta * (D * D + 1.) / chi);
+      if (_Gradient) {
+        // Derivative w.r.t. J, where dD/dJ = [d, -c; -b, a]
+        f1 = _RefArea[t] * (1. - _Theta) * 2. / chi;
+        f2 = _RefArea[t] * ((_Theta - 1.) * F * dchi / (chi * chi)
+                           + _Theta * (2. * D / chi - (D * D + 1.) * dchi / (chi * chi)));
+        G[0] = f1 * a + f2 * d;
+        G[1] = f1 * b - f2 * c;
+        G[2] = f1 * c - f2 * b;
+        G[3] = f1 * d + f2 * a;
+        // Derivative w.r.t. corners, i.e., dE/dU = dE/dJ Q^-T
+        g = _Gradient + 6 * t;
+        g[2] = G[0] * q[0] + G[1] * q[1];
+        g[4] = G[1] * q[2];
+        g[3] = _Sign * (G[2] * q[0] + G[3] * q[1]);
+        g[5] = _Sign * (G[3] * q[2]);
+        g[0] = - g[2] - g[4];
+        g[1] = - g[3] - g[5];
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Gather gradient of energy w.r.t. free points from adjacent triangles
+struct GatherGradient
+{
+  const int    *_Offset;   ///< Offset of point in _Corners
+  const int    *_Corners;  ///< Adjacent triangle corners, i.e., 3 * t + k
+  const char   *_Fixed;
+  const double *_TriangleGradient;
+  double       *_Gradient;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double *g;
+    double gx, gy;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      gx = gy = .0;
+      if (!_Fixed[i]) {
+        for (int l = _Offset[i]; l < _Offset[i+1]; ++l) {
+          g = _TriangleGradient + 2 * _Corners[l];
+          gx += g[0], gy += g[1];
+        }
+      }
+      _Gradient[2 * i    ] = gx;
+      _Gradient[2 * i + 1] = gy;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Untangling energy and its gradient w.r.t. the map values
+struct UntanglingEnergy
+{
+  int            _NumberOfCells;
+  int            _NumberOfPoints;
+  EvaluateEnergy _Eval;
+  GatherGradient _Gather;
+  Array<double>  _Gradient;
+
+  double Evaluate(const Vector &x, Vector *g, double &mindet, int &nflips)
+  {
+    EvaluateEnergy eval(_Eval, split());
+    eval._X        = x.data();
+    eval._Gradient = (g ? _Gradient.data() : nullptr);
+    parallel_reduce(blocked_range<int>(0, _NumberOfCells), eval);
+    if (g) {
+      _Gather._Gradient = g->data();
+      parallel_for(blocked_range<int>(0, _NumberOfPoints), _Gather);
+    }
+    mindet = eval._MinDet;
+    nflips = eval._NumberOfFlips;
+    return eval._Energy;
+  }
+};
+
+
+} // namespace FlipFreeSurfaceMapRefinementUtils
+using namespace FlipFreeSurfaceMapRefinementUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void FlipFreeSurfaceMapRefinement::CopyAttributes(const FlipFreeSurfaceMapRefinement &other)
+{
+  _Triangles               = other._Triangles;
+  _Values                  = other._Values;
+  _FixedPoints             = other._FixedPoints;
+  _NumberOfIterations      = other._NumberOfIterations;
+  _NumberOfInnerIterations = other._NumberOfInnerIterations;
+  _HistorySize             = other._HistorySize;
+  _AreaWeight              = other._AreaWeight;
+  _Tolerance               = other._Tolerance;
+  _NumberOfInitialFlips    = other._NumberOfInitialFlips;
+  _NumberOfFlips           = other._NumberOfFlips;
+}
+
+// -----------------------------------------------------------------------------
+FlipFreeSurfaceMapRefinement::FlipFreeSurfaceMapRefinement()
+:
+  _Triangles(nullptr),
+  _NumberOfIterations(100),
+  _NumberOfInnerIterations(50),
+  _HistorySize(8),
+  _AreaWeight(1. / 128.),
+  _Tolerance(1e-5),
+  _NumberOfInitialFlips(0),
+  _NumberOfFlips(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+FlipFreeSurfaceMapRefinement
+::FlipFreeSurfaceMapRefinement(const FlipFreeSurfaceMapRefinement &other)
+:
+  Object(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+FlipFreeSurfaceMapRefinement &FlipFreeSurfaceMapRefinement
+::operator =(const FlipFreeSurfaceMapRefinement &other)
+{
+  if (this != &other) {
+    Object::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+FlipFreeSurfaceMapRefinement::~FlipFreeSurfaceMapRefinement()
+{
+}
+
+// =============================================================================
+// Execution
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool FlipFreeSurfaceMapRefinement::Run()
+{
+  _NumberOfInitialFlips = _NumberOfFlips = 0;
+
+  if (_Triangles == nullptr || _Triangles->NumberOfTriangles() == 0) {
+    cerr << NameOfType() << "::Run: Missing surface triangles" << endl;
+    exit(1);
+  }
+  if (!_Values || _Values->GetNumberOfComponents() != 2) {
+    cerr << NameOfType() << "::Run: Map values must be planar, i.e., have two components" << endl;
+    exit(1);
+  }
+
+  const int npoints = static_cast<int>(_Values->GetNumberOfTuples());
+  const int ncells  = _Triangles->NumberOfTriangles();
+
+  // Fixed points, i.e., end points of boundary edges by default
+  Array<char> fixed(npoints, false);
+  if (_FixedPoints.empty()) {
+    int i, j, t1, t2;
+    for (int t = 0; t < ncells; ++t) {
+      for (int k = 0; k < 3; ++k) {
+        i = _Triangles->PointId(t, k);
+        j = _Triangles->PointId(t, (k + 1) % 3);
+        if (_Triangles->GetEdgeTriangles(i, j, t1, t2) == 1) {
+          fixed[i] = fixed[j] = true;
+        }
+      }
+    }
+  } else if (static_cast<int>(_FixedPoints.size()) == npoints) {
+    for (int i = 0; i < npoints; ++i) fixed[i] = _FixedPoints[i];
+  } else {
+    cerr << NameOfType() << "::Run: Number of fixed point flags does not match number of map values" << endl;
+    exit(1);
+  }
+
+  // Copy map values
+  Vector x(2 * npoints);
+  for (int i = 0; i < npoints; ++i) {
+    x(2 * i    ) = _Values->GetComponent(i, 0);
+    x(2 * i + 1) = _Values->GetComponent(i, 1);
+  }
+
+  // Orientation and scale of the map relative to the surface
+  AccumulateSignedArea area;
+  area._Triangles = _Triangles;
+  area._X         = x.data();
+  parallel_reduce(blocked_range<int>(0, ncells), area);
+  if (area._SignedArea == .0 || area._Area <= .0) return false;
+  const double sign  = (area._SignedArea < .0 ? -1. : 1.);
+  const double scale = sqrt(abs(area._SignedArea) / area._Area);
+
+  // Precompute inverse shape of scaled reference triangles
+  Array<double> qinv(3 * ncells, .0), aref(ncells, .0);
+  double l1, l2, a0, sin_a0, h = .0;
+  for (int t = 0; t < ncells; ++t) {
+    l1 = _Triangles->EdgeLength(t, 1);
+    l2 = _Triangles->EdgeLength(t, 2);
+    a0 = _Triangles->Angle(t, 0);
+    sin_a0 = sin(a0);
+    h += l1 + l2;
+    if (l1 <= .0 || l2 <= .0 || sin_a0 <= .0) continue;
+    qinv[3 * t    ] =  1. / (scale * l2);
+    qinv[3 * t + 1] = -cos(a0) / (scale * l2 * sin_a0);
+    qinv[3 * t + 2] =  1. / (scale * l1 * sin_a0);
+    aref[t] = scale * scale * _Triangles->Area(t);
+  }
+  h = .05 * scale * h / (2 * ncells);
+
+  // Adjacent triangle corners of each point
+  Array<int> offset(npoints + 1, 0), corners(3 * ncells);
+  for (int t = 0; t < ncells; ++t) {
+    for (int k = 0; k < 3; ++k) ++offset[_Triangles->PointId(t, k) + 1];
+  }
+  for (int i = 0; i < npoints; ++i) offset[i+1] += offset[i];
+  {
+    Array<int> pos(offset.begin(), offset.end() - 1);
+    for (int t = 0; t < ncells; ++t) {
+      for (int k = 0; k < 3; ++k) {
+        corners[pos[_Triangles->PointId(t, k)]++] = 3 * t + k;
+      }
+    }
+  }
+
+  // Energy evaluation
+  UntanglingEnergy objective;
+  objective._NumberOfCells  = ncells;
+  objective._NumberOfPoints = npoints;
+  objective._Gradient.resize(6 * ncells);
+  objective._Eval._Triangles = _Triangles;
+  objective._Eval._Qinv      = qinv.data();
+  objective._Eval._RefArea   = aref.data();
+  objective._Eval._Sign      = sign;
+  objective._Eval._Theta     = _AreaWeight;
+  objective._Eval._Epsilon   = 1.;
+  objective._Gather._Offset           = offset.data();
+  objective._Gather._Corners          = corners.data();
+  objective._Gather._Fixed            = fixed.data();
+  objective._Gather._TriangleGradient = objective._Gradient.data();
+
+  double E, mindet;
+  E = objective.Evaluate(x, nullptr, mindet, _NumberOfInitialFlips);
+  _NumberOfFlips = _NumberOfInitialFlips;
+  if (_NumberOfInitialFlips == 0) return false;
+
+  // Minimize energy for decreasing sequence of eps (cf. Garanzha et al., 2021)
+  const int m = max(1, _HistorySize);
+  double E_prev, E_new, mindet_new, step, gp, sigma, mu;
+  Vector g(2 * npoints), g_new(2 * npoints), x_new(2 * npoints), p(2 * npoints);
+  std::deque<Vector> S, Y;
+  std::deque<double> rho;
+  Array<double> alpha(m);
+  int nflips;
+
+  double &eps = objective._Eval._Epsilon;
+  eps = sqrt(1e-12 + .04 * pow(min(mindet, .0), 2));
+  for (int iter = 0; iter < _NumberOfIterations; ++iter) {
+    E = E_prev = objective.Evaluate(x, &g, mindet, nflips);
+    S.clear(), Y.clear(), rho.clear();
+
+    // L-BFGS iterations
+    for (int inner = 0; inner < _NumberOfInnerIterations; ++inner) {
+      // Two-loop recursion
+      p = -g;
+      for (int l = static_cast<int>(S.size()) - 1; l >= 0; --l) {
+        alpha[l] = rho[l] * S[l].dot(p);
+        p -= alpha[l] * Y[l];
+      }
+      if (!S.empty()) {
+        p *= S.back().dot(Y.back()) / Y.back().squaredNorm();
+      }
+      for (size_t l = 0; l < S.size(); ++l) {
+        p += (alpha[l] - rho[l] * Y[l].dot(p)) * S[l];
+      }
+      gp = p.dot(g);
+      // Steepest descent step limited to a fraction of the mean edge length
+      if (S.empty() || gp >= .0) {
+        S.clear(), Y.clear(), rho.clear();
+        const double gmax = g.lpNorm<Eigen::Infinity>();
+        if (gmax <= .0) break;
+        p = (-h / gmax) * g;
+        gp = p.dot(g);
+      }
+      // Backtracking line search with sufficient decrease condition,
+      // where only the energy is evaluated at the trial points
+      bool accepted = false;
+      step = 1.;
+      for (int l = 0; l < 30; ++l, step *= .5) {
+        x_new = x + step * p;
+        E_new = objective.Evaluate(x_new, nullptr, mindet_new, nflips);
+        if (E_new <= E + 1e-4 * step * gp) {
+          accepted = true;
+          break;
+        }
+      }
+      if (!accepted) break;
+      objective.Evaluate(x_new, &g_new, mindet_new, nflips);
+      // Update correction pairs
+      S.push_back(x_new - x);
+      Y.push_back(g_new - g);
+      const double sy = S.back().dot(Y.back());
+      if (sy > 1e-12 * Y.back().squaredNorm()) {
+        rho.push_back(1. / sy);
+        if (static_cast<int>(S.size()) > m) {
+          S.pop_front(), Y.pop_front(), rho.pop_front();
+        }
+      } else {
+        S.pop_back(), Y.pop_back();
+      }
+      const bool converged = (E - E_new <= 1e-9 * abs(E));
+      x.swap(x_new), g.swap(g_new);
+      E = E_new, mindet = mindet_new;
+      if (converged) break;
+    }
+
+    // Stop when map is untangled and energy no longer decreases
+    if (mindet > .0 && abs(E_prev - E) <= _Tolerance * abs(E)) break;
+
+    // Update regularization parameter
+    sigma = max(1. - E / E_prev, .1);
+    mu    = (1. - sigma) * Chi(mindet, eps);
+    if (mindet < mu) eps = 2. * sqrt(mu * (mu - mindet));
+    else             eps = 1e-10;
+  }
+
+  // Restore input map when number of flipped triangles increased
+  objective.Evaluate(x, nullptr, mindet, _NumberOfFlips);
+  if (_NumberOfFlips > _NumberOfInitialFlips) {
+    _NumberOfFlips = _NumberOfInitialFlips;
+    return false;
+  }
+  for (int i = 0; i < npoints; ++i) {
+    if (fixed[i]) continue;
+    _Values->SetComponent(i, 0, x(2 * i    ));
+    _Values->SetComponent(i, 1, x(2 * i + 1));
+  }
+  return true;
+}
+
+
+} // namespace mirtk
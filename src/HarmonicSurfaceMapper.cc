@@ -73,24 +73,19 @@ HarmonicSurfaceMapper::~HarmonicSurfaceMapper()
 // -----------------------------------------------------------------------------
 double HarmonicSurfaceMapper::Weight(int i, int j) const
 {
-  double a[3], b[3], c[3], w;
-
-  int k, l;
-  if (GetEdgeNeighborPoints(i, j, k, l) > 2 || k < 0) {
+  int t[2], k[2];
+  if (GetEdgeTriangles(i, j, t, k) == 0) {
     cerr << this->NameOfType() << "::Weight: Surface mesh must be triangulated!" << endl;
     exit(1);
   }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
   // The value computed by the Cotangent function found in Meyer et al. (2002)
   // is identical to the spring constants in Eck et al. (1995) up to a constant
   // factor of 1/4 missing from Eck et al.'s formula.
-  _Surface->GetPoint(static_cast<vtkIdType>(i), a);
-  _Surface->GetPoint(static_cast<vtkIdType>(k), b);
-  _Surface->GetPoint(static_cast<vtkIdType>(j), c);
-  w = Triangle::Cotangent(a, b, c);
-  if (l >= 0) {
-    _Surface->GetPoint(static_cast<vtkIdType>(l), b);
-    w += Triangle::Cotangent(a, b, c);
+  double w = tris.Cotangent(t[0], k[0]);
+  if (t[1] >= 0) {
+    w += tris.Cotangent(t[1], k[1]);
   }
 
   // Factor 1/2 canceled by multiplying both sides of the linear equations with 2.
@@ -20,6 +20,7 @@
 #include "mirtk/IntrinsicLeastAreaDistortionSurfaceMapper.h"
 
 #include "mirtk/Math.h"
+#include "mirtk/Parallel.h"
 #include "mirtk/VtkMath.h"
 #include "mirtk/Triangle.h"
 #include "mirtk/PointSetUtils.h"
@@ -27,6 +28,7 @@
 
 #include "vtkNew.h"
 #include "vtkIdList.h"
+#include "vtkDoubleArray.h"
 
 #include "boost/math/tools/polynomial.hpp"
 using namespace boost::math::tools;
@@ -39,6 +41,121 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace IntrinsicLeastAreaDistortionSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Accumulate coefficients of area distortion energy polynomial in parallel
+///
+/// The double area of a triangle mapped by (1 - lambda) u0 + lambda u1 is a
+/// quadratic polynomial in lambda, the distortion of the area ratio a quartic,
+/// and its square which is summed over all triangles of degree 8.
+template <class T>
+struct AccumulateAreaDistortionEnergy
+{
+  const class TriangleGeometry *_Triangles;
+  const T                      *_U0;
+  const T                      *_U1;
+  int                           _Stride;
+  double                        _Scale;
+  double                        _Epsilon;
+  double                        _Energy[9];
+
+  AccumulateAreaDistortionEnergy()
+  {
+    for (int k = 0; k < 9; ++k) _Energy[k] = .0;
+  }
+
+  AccumulateAreaDistortionEnergy(const AccumulateAreaDistortionEnergy &other, split)
+  :
+    _Triangles(other._Triangles),
+    _U0(other._U0),
+    _U1(other._U1),
+    _Stride(other._Stride),
+    _Scale(other._Scale),
+    _Epsilon(other._Epsilon)
+  {
+    for (int k = 0; k < 9; ++k) _Energy[k] = .0;
+  }
+
+  void join(const AccumulateAreaDistortionEnergy &other)
+  {
+    for (int k = 0; k < 9; ++k) _Energy[k] += other._Energy[k];
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    double u[3][2], du[3][2], r[3], d[5], s;
+    const T *a, *b;
+    int i, j;
+
+    for (int t = re.begin(); t != re.end(); ++t) {
+
+      // Linear map coordinates u = (u1 - u0) lambda + u0 of triangle corners
+      for (i = 0; i < 3; ++i) {
+        a = _U0 + _Stride * _Triangles->PointId(t, i);
+        b = _U1 + _Stride * _Triangles->PointId(t, i);
+        u [i][0] = static_cast<double>(a[0]);
+        u [i][1] = static_cast<double>(a[1]);
+        du[i][0] = static_cast<double>(b[0]) - u[i][0];
+        du[i][1] = static_cast<double>(b[1]) - u[i][1];
+      }
+
+      // Parametric double area polynomial divided by twice the original area
+      r[0] = r[1] = r[2] = .0;
+      for (i = 0; i < 3; ++i) {
+        j = (i + 1) % 3;
+        r[0] += u [i][0] * u [j][1] - u [i][1] * u [j][0];
+        r[1] += u [i][0] * du[j][1] + du[i][0] * u [j][1]
+              - u [i][1] * du[j][0] - du[i][1] * u [j][0];
+        r[2] += du[i][0] * du[j][1] - du[i][1] * du[j][0];
+      }
+      r[0] += _Epsilon;
+      s = _Scale / (2. * _Triangles->Area(t) + _Epsilon);
+      r[0] *= s, r[1] *= s, r[2] *= s;
+
+      // Polynomial of distortion, i.e., squared area ratio minus one
+      d[0] = r[0] * r[0] - 1.;
+      d[1] = 2. * r[0] * r[1];
+      d[2] = r[1] * r[1] + 2. * r[0] * r[2];
+      d[3] = 2. * r[1] * r[2];
+      d[4] = r[2] * r[2];
+
+      // Add squared distortion to energy
+      for (i = 0; i < 5; ++i)
+      for (j = 0; j < 5; ++j) {
+        _Energy[i + j] += d[i] * d[j];
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute coefficients of area distortion energy polynomial
+template <class T>
+void ComputeAreaDistortionEnergy(const class TriangleGeometry &tris,
+                                 vtkDataArray *u0, vtkDataArray *u1,
+                                 double scale, double eps, double energy[9])
+{
+  AccumulateAreaDistortionEnergy<T> eval;
+  eval._Triangles = &tris;
+  eval._U0        = reinterpret_cast<const T *>(u0->GetVoidPointer(0));
+  eval._U1        = reinterpret_cast<const T *>(u1->GetVoidPointer(0));
+  eval._Stride    = u0->GetNumberOfComponents();
+  eval._Scale     = scale;
+  eval._Epsilon   = eps;
+  parallel_reduce(blocked_range<int>(0, tris.NumberOfTriangles()), eval);
+  for (int k = 0; k < 9; ++k) energy[k] = eval._Energy[k];
+}
+
+
+} // namespace IntrinsicLeastAreaDistortionSurfaceMapperUtils
+using namespace IntrinsicLeastAreaDistortionSurfaceMapperUtils;
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -108,64 +225,28 @@ double IntrinsicLeastAreaDistortionSurfaceMapper
 
   // Compute coefficients of area distortion polynomial
   // (except of the constant coefficient e which is not needed to find minimum)
-  const int    energy_degree         = 8;
-  const double zero[energy_degree+1] = {0.};
-
-  vtkIdType          ptId;
-  vtkNew<vtkIdList>  ptIds;
-  double             a[3], b[3], c[3];
-  polynomial<double> u_i(zero, 1), v_i(zero, 1), u_j(zero, 1), v_j(zero, 1);
-  polynomial<double> area[3], ratio(zero, 2), distortion(zero, energy_degree);
-  polynomial<double> energy(zero, energy_degree);
-
-  for (int i = 0; i < 3; ++i) {
-    area[i] = polynomial<double>(zero, 2);
-  }
-  for (vtkIdType cellId = 0; cellId < _Surface->GetNumberOfCells(); ++cellId) {
-    GetCellPoints(_Surface, cellId, ptIds.GetPointer());
-    if (ptIds->GetNumberOfIds() != 3) {
-      cerr << this->NameOfType() << "::ComputeLambda: Surface mesh must be triangulated" << endl;
-      exit(1);
-    }
-
-    // Get surface triangle corner points
-    _Surface->GetPoint(ptIds->GetId(0), a);
-    _Surface->GetPoint(ptIds->GetId(1), b);
-    _Surface->GetPoint(ptIds->GetId(2), c);
-
-    // Coefficients of first edge start point polynomial
-    // u = (u1 - u0) lambda + u0
-    ptId = ptIds->GetId(0);
-    u_i[0] = u0->GetComponent(ptId, 0);
-    u_i[1] = u1->GetComponent(ptId, 0) - u0->GetComponent(ptId, 0);
-    v_i[0] = u0->GetComponent(ptId, 1);
-    v_i[1] = u1->GetComponent(ptId, 1) - u0->GetComponent(ptId, 1);
-    for (int i = 0; i < 3; ++i) {
-      // Coefficients of edge end point polynomial
-      ptId = ptIds->GetId((i + 1) % 3);
-      u_j[0] = u0->GetComponent(ptId, 0);
-      u_j[1] = u1->GetComponent(ptId, 0) - u0->GetComponent(ptId, 0);
-      v_j[0] = u0->GetComponent(ptId, 1);
-      v_j[1] = u1->GetComponent(ptId, 1) - u0->GetComponent(ptId, 1);
-      // Polynomial of edge area contribution
-      area[i] = u_i * v_j - v_i * u_j;
-      // Set start point of next edge
-      u_i = u_j, v_i = v_j;
-    }
-
-    // Compute parametric double area polynomial
-    // and divide by twice the original area
-    ratio  = area[0] + area[1] + area[2];
-    ratio += eps;
-    ratio *= scale / (Triangle::DoubleArea(a, b, c) + eps);
+  const int energy_degree = 8;
 
-    // Calculate polynomial of distortion energy
-    distortion  = ratio * ratio;
-    distortion -= 1.;
+  if (!_TriangleGeometry || !_TriangleGeometry->IsTriangulated()) {
+    cerr << this->NameOfType() << "::ComputeLambda: Surface mesh must be triangulated" << endl;
+    exit(1);
+  }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
-    energy += distortion * distortion;
+  vtkSmartPointer<vtkDataArray> a0 = u0, a1 = u1;
+  if (u0->GetDataType() != u1->GetDataType() ||
+      (u0->GetDataType() != VTK_FLOAT && u0->GetDataType() != VTK_DOUBLE)) {
+    a0 = vtkSmartPointer<vtkDoubleArray>::New(), a0->DeepCopy(u0);
+    a1 = vtkSmartPointer<vtkDoubleArray>::New(), a1->DeepCopy(u1);
+  }
+  double coeffs[energy_degree + 1];
+  if (a0->GetDataType() == VTK_FLOAT) {
+    ComputeAreaDistortionEnergy<float >(tris, a0, a1, scale, eps, coeffs);
+  } else {
+    ComputeAreaDistortionEnergy<double>(tris, a0, a1, scale, eps, coeffs);
   }
-  energy *= 1. / _Surface->GetNumberOfCells();
+  polynomial<double> energy(coeffs, energy_degree);
+  energy *= 1. / tris.NumberOfTriangles();
 
   // Find lambda value with minimum area distortion, starting with lambda=0
   // which corresponds to the map which minimizes the authalic energy
@@ -175,6 +256,7 @@ double IntrinsicLeastAreaDistortionSurfaceMapper
   double value   = energy.evaluate(lambda);
   double x, dx, f, df;
 
+  const double zero[energy_degree] = {0.};
   polynomial<double> derivative(zero, static_cast<unsigned int>(energy.degree() - 1));
   for (polynomial<double>::size_type d = 1; d <= energy.degree(); ++d) {
     derivative[d-1] = d * energy[d];
@@ -20,10 +20,14 @@
 #include "mirtk/IntrinsicLeastEdgeLengthDistortionSurfaceMapper.h"
 
 #include "mirtk/Math.h"
+#include "mirtk/Parallel.h"
 #include "mirtk/VtkMath.h"
 #include "mirtk/PointSetUtils.h"
 #include "mirtk/PolynomialSolvers.h"
 
+#include "vtkSmartPointer.h"
+#include "vtkDoubleArray.h"
+
 #include "boost/math/tools/polynomial.hpp"
 using namespace boost::math::tools;
 
@@ -35,6 +39,122 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace IntrinsicLeastEdgeLengthDistortionSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Accumulate coefficients of edge-length distortion energy polynomial in parallel
+///
+/// Each edge is visited once from its end point with the smaller index.
+template <class T>
+struct AccumulateEdgeLengthDistortionEnergy
+{
+  vtkPolyData     *_Surface;
+  const EdgeTable *_EdgeTable;
+  const T         *_U0;
+  const T         *_U1;
+  int              _Stride;
+  double           _Scale;
+  double           _Epsilon;
+  double           _Energy[5];
+
+  AccumulateEdgeLengthDistortionEnergy()
+  {
+    for (int k = 0; k < 5; ++k) _Energy[k] = .0;
+  }
+
+  AccumulateEdgeLengthDistortionEnergy(const AccumulateEdgeLengthDistortionEnergy &other, split)
+  :
+    _Surface(other._Surface),
+    _EdgeTable(other._EdgeTable),
+    _U0(other._U0),
+    _U1(other._U1),
+    _Stride(other._Stride),
+    _Scale(other._Scale),
+    _Epsilon(other._Epsilon)
+  {
+    for (int k = 0; k < 5; ++k) _Energy[k] = .0;
+  }
+
+  void join(const AccumulateEdgeLengthDistortionEnergy &other)
+  {
+    for (int k = 0; k < 5; ++k) _Energy[k] += other._Energy[k];
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    int        numAdjPts, j;
+    const int *adjPts;
+    double     a, b, s, d[3], p_i[3], p_j[3];
+    const T   *u0_i, *u0_j, *u1_i, *u1_j;
+
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Surface->GetPoint(i, p_i);
+      u0_i = _U0 + _Stride * i;
+      u1_i = _U1 + _Stride * i;
+      _EdgeTable->GetAdjacentPoints(i, numAdjPts, adjPts);
+      for (int k = 0; k < numAdjPts; ++k) {
+        j = adjPts[k];
+        if (j <= i) continue;
+        _Surface->GetPoint(j, p_j);
+        u0_j = _U0 + _Stride * j;
+        u1_j = _U1 + _Stride * j;
+
+        // Parametric squared edge length polynomial
+        a = (double(u1_i[0]) - double(u0_i[0])) - (double(u1_j[0]) - double(u0_j[0]));
+        b =  double(u0_i[0]) - double(u0_j[0]);
+        d[0] = b * b, d[1] = a * b, d[2] = a * a;
+
+        a = (double(u1_i[1]) - double(u0_i[1])) - (double(u1_j[1]) - double(u0_j[1]));
+        b =  double(u0_i[1]) - double(u0_j[1]);
+        d[0] += b * b, d[1] += a * b, d[2] += a * a;
+
+        d[0] += _Epsilon;
+        d[1] *= 2.;
+
+        // Polynomial of distortion, i.e., squared length ratio minus one
+        s = _Scale / (vtkMath::Distance2BetweenPoints(p_i, p_j) + _Epsilon);
+        d[0] *= s, d[1] *= s, d[2] *= s;
+        d[0] -= 1.;
+
+        // Add squared distortion to energy
+        _Energy[0] += d[0] * d[0];
+        _Energy[1] += 2. * d[0] * d[1];
+        _Energy[2] += d[1] * d[1] + 2. * d[0] * d[2];
+        _Energy[3] += 2. * d[1] * d[2];
+        _Energy[4] += d[2] * d[2];
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute coefficients of edge-length distortion energy polynomial
+template <class T>
+void ComputeEdgeLengthDistortionEnergy(vtkPolyData *surface, const EdgeTable &edgeTable,
+                                       vtkDataArray *u0, vtkDataArray *u1,
+                                       double scale, double eps, double energy[5])
+{
+  AccumulateEdgeLengthDistortionEnergy<T> eval;
+  eval._Surface   = surface;
+  eval._EdgeTable = &edgeTable;
+  eval._U0        = reinterpret_cast<const T *>(u0->GetVoidPointer(0));
+  eval._U1        = reinterpret_cast<const T *>(u1->GetVoidPointer(0));
+  eval._Stride    = u0->GetNumberOfComponents();
+  eval._Scale     = scale;
+  eval._Epsilon   = eps;
+  parallel_reduce(blocked_range<int>(0, static_cast<int>(surface->GetNumberOfPoints())), eval);
+  for (int k = 0; k < 5; ++k) energy[k] = eval._Energy[k];
+}
+
+
+} // namespace IntrinsicLeastEdgeLengthDistortionSurfaceMapperUtils
+using namespace IntrinsicLeastEdgeLengthDistortionSurfaceMapperUtils;
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -96,49 +216,21 @@ double IntrinsicLeastEdgeLengthDistortionSurfaceMapper
 
   // Compute coefficients of edge-length distortion polynomial
   // (except of the constant coefficient e which is not needed to find minimum)
-  const int    energy_degree       = 4;
-  const double zero[energy_degree] = {0.};
-
-  polynomial<double> dist2(zero, 2);
-  polynomial<double> distortion(zero, energy_degree);
-  polynomial<double> energy(zero, energy_degree);
-
-  int    i, j;
-  double a, b, p_i[3], p_j[3], u0_i[2], u0_j[2], u1_i[2], u1_j[2];
-
-  EdgeIterator it(*_EdgeTable);
-  for (it.InitTraversal(); it.GetNextEdge(i, j) != -1;) {
-    _Surface->GetPoint(i, p_i);
-    _Surface->GetPoint(j, p_j);
+  const int energy_degree = 4;
 
-    u0->GetTuple(i, u0_i);
-    u0->GetTuple(j, u0_j);
-    u1->GetTuple(i, u1_i);
-    u1->GetTuple(j, u1_j);
-
-    a = (u1_i[0] - u0_i[0]) - (u1_j[0] - u0_j[0]);
-    b = (u0_i[0] - u0_j[0]);
-
-    dist2[0] = b * b;
-    dist2[1] = a * b;
-    dist2[2] = a * a;
-
-    a = (u1_i[1] - u0_i[1]) - (u1_j[1] - u0_j[1]);
-    b = (u0_i[1] - u0_j[1]);
-
-    dist2[0] += b * b;
-    dist2[1] += a * b;
-    dist2[2] += a * a;
-
-    dist2[0] += eps;
-    dist2[1] *= 2.;
-
-    distortion  = dist2;
-    distortion *= scale / (vtkMath::Distance2BetweenPoints(p_i, p_j) + eps);
-    distortion -= 1.;
-
-    energy += distortion * distortion;
+  vtkSmartPointer<vtkDataArray> a0 = u0, a1 = u1;
+  if (u0->GetDataType() != u1->GetDataType() ||
+      (u0->GetDataType() != VTK_FLOAT && u0->GetDataType() != VTK_DOUBLE)) {
+    a0 = vtkSmartPointer<vtkDoubleArray>::New(), a0->DeepCopy(u0);
+    a1 = vtkSmartPointer<vtkDoubleArray>::New(), a1->DeepCopy(u1);
+  }
+  double coeffs[energy_degree + 1];
+  if (a0->GetDataType() == VTK_FLOAT) {
+    ComputeEdgeLengthDistortionEnergy<float >(_Surface, *_EdgeTable, a0, a1, scale, eps, coeffs);
+  } else {
+    ComputeEdgeLengthDistortionEnergy<double>(_Surface, *_EdgeTable, a0, a1, scale, eps, coeffs);
   }
+  polynomial<double> energy(coeffs, energy_degree);
 
   // Find roots of derivative using cubic equation formula
   double lambda = MinimumOf4thDegreePolynomial(energy);
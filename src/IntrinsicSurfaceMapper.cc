@@ -73,28 +73,24 @@ IntrinsicSurfaceMapper::~IntrinsicSurfaceMapper()
 // -----------------------------------------------------------------------------
 double IntrinsicSurfaceMapper::Weight(int i, int j) const
 {
-  double a[3], b[3], c[3], w_conformal = 0., w_authalic = 0.;
-
-  int k, l;
-  if (GetEdgeNeighborPoints(i, j, k, l) > 2 || k < 0) {
+  int t[2], k[2];
+  if (GetEdgeTriangles(i, j, t, k) == 0) {
     cerr << this->NameOfType() << "::Weight: Surface mesh must be triangulated!" << endl;
     exit(1);
   }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
-  _Surface->GetPoint(static_cast<vtkIdType>(i), a);
-  _Surface->GetPoint(static_cast<vtkIdType>(j), b);
+  double w_conformal = 0., w_authalic = 0.;
 
   double mu = (1. - _Lambda);
-  if (mu != 0.) mu /= vtkMath::Distance2BetweenPoints(a, b);
-
-  _Surface->GetPoint(static_cast<vtkIdType>(k), c);
-  if (_Lambda != 0.) w_conformal = Triangle::Cotangent(a, c, b);
-  if (mu      != 0.) w_authalic  = Triangle::Cotangent(a, b, c);
+  if (mu != 0.) {
+    const double d = tris.EdgeLength(t[0], k[0]);
+    mu /= d * d;
+  }
 
-  if (l >= 0) {
-    _Surface->GetPoint(static_cast<vtkIdType>(l), c);
-    if (_Lambda != 0.) w_conformal += Triangle::Cotangent(a, c, b);
-    if (mu      != 0.) w_authalic  += Triangle::Cotangent(a, b, c);
+  for (int n = 0; n < 2 && t[n] >= 0; ++n) {
+    if (_Lambda != 0.) w_conformal += tris.Cotangent(t[n], k[n]);
+    if (mu      != 0.) w_authalic  += tris.Cotangent(t[n], tris.Corner(t[n], j));
   }
 
   return _Lambda * w_conformal + mu * w_authalic;
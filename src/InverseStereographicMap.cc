@@ -0,0 +1,131 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/InverseStereographicMap.h"
+
+#include "mirtk/Cfstream.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void InverseStereographicMap::CopyAttributes(const InverseStereographicMap &other)
+{
+  _SphereRadius = other._SphereRadius;
+  _Pole         = other._Pole;
+}
+
+// -----------------------------------------------------------------------------
+InverseStereographicMap::InverseStereographicMap()
+:
+  _SphereRadius(1.0),
+  _Pole(SpherePole_North)
+{
+}
+
+// -----------------------------------------------------------------------------
+InverseStereographicMap::InverseStereographicMap(const InverseStereographicMap &other)
+:
+  AnalyticMapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+InverseStereographicMap &InverseStereographicMap::operator =(const InverseStereographicMap &other)
+{
+  if (this != &other) {
+    AnalyticMapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void InverseStereographicMap::Initialize()
+{
+  AnalyticMapping::Initialize();
+  if (_SphereRadius <= .0) {
+    cerr << this->NameOfType() << "::Initialize: Sphere radius must be positive" << endl;
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *InverseStereographicMap::NewCopy() const
+{
+  return new InverseStereographicMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+InverseStereographicMap::~InverseStereographicMap()
+{
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void InverseStereographicMap::BoundingBox(double &x1, double &y1, double &z1,
+                                          double &x2, double &y2, double &z2) const
+{
+  x1 = y1 = -_SphereRadius;
+  x2 = y2 = +_SphereRadius;
+  z1 = z2 = .0;
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void InverseStereographicMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  EvaluatePoints(this, n, xyz, values, inside);
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void InverseStereographicMap::ReadMap(Cifstream &is)
+{
+  int pole;
+  is.ReadAsDouble(&_SphereRadius, 1);
+  is.ReadAsInt(&pole, 1);
+  _Pole = static_cast<SpherePole>(pole);
+}
+
+// -----------------------------------------------------------------------------
+void InverseStereographicMap::WriteMap(Cofstream &os) const
+{
+  const int pole = static_cast<int>(_Pole);
+  os.WriteAsDouble(&_SphereRadius, 1);
+  os.WriteAsInt(&pole, 1);
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,399 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/LatticeMap.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Cfstream.h"
+
+#include <random>
+
+
+namespace mirtk {
+
+
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace LatticeMapUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Get indices and weights of linear interpolation along one lattice axis
+///
+/// Lattice coordinates up to half a voxel beyond the first and last lattice
+/// point are clamped to the boundary.
+inline bool LinearStencil(double x, int n, int &i0, int &i1, double &w1)
+{
+  if (x < -.5 || x > n - .5) return false;
+  if (x <= .0) {
+    i0 = i1 = 0, w1 = .0;
+  } else if (x >= n - 1) {
+    i0 = i1 = n - 1, w1 = .0;
+  } else {
+    i0 = ifloor(x), i1 = i0 + 1, w1 = x - i0;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Get indices and weights of Catmull-Rom interpolation along one lattice axis
+///
+/// \returns Whether all lattice points of the cubic stencil exist.
+inline bool CubicStencil(double x, int n, int i[4], double w[4], int &m)
+{
+  if (n == 1) {
+    if (x < -.5 || x > .5) return false;
+    i[0] = 0, w[0] = 1.0, m = 1;
+    return true;
+  }
+  const int i1 = ifloor(x);
+  if (i1 < 1 || i1 + 2 > n - 1) return false;
+  const double t  = x - i1;
+  const double t2 = t * t;
+  const double t3 = t * t2;
+  w[0] = .5 * (-t3 + 2.0 * t2 - t);
+  w[1] = .5 * (3.0 * t3 - 5.0 * t2 + 2.0);
+  w[2] = .5 * (-3.0 * t3 + 4.0 * t2 + t);
+  w[3] = .5 * (t3 - t2);
+  for (int k = 0; k < 4; ++k) i[k] = i1 - 1 + k;
+  m = 4;
+  return true;
+}
+
+
+} // namespace LatticeMapUtils
+using namespace LatticeMapUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void LatticeMap::CopyAttributes(const LatticeMap &other)
+{
+  _Source             = other._Source;
+  _Spacing            = other._Spacing;
+  _CubicInterpolation = other._CubicInterpolation;
+  _NumberOfProbes     = other._NumberOfProbes;
+  _MaximumError       = other._MaximumError;
+  _RMSError           = other._RMSError;
+  _Values             = other._Values;
+}
+
+// -----------------------------------------------------------------------------
+LatticeMap::LatticeMap()
+:
+  _Spacing(.0),
+  _CubicInterpolation(false),
+  _NumberOfProbes(1000),
+  _MaximumError(mirtk::nan),
+  _RMSError(mirtk::nan)
+{
+}
+
+// -----------------------------------------------------------------------------
+LatticeMap::LatticeMap(SharedPtr<const Mapping> source, double ds)
+:
+  _Source(source),
+  _Spacing(ds),
+  _CubicInterpolation(false),
+  _NumberOfProbes(1000),
+  _MaximumError(mirtk::nan),
+  _RMSError(mirtk::nan)
+{
+}
+
+// -----------------------------------------------------------------------------
+LatticeMap::LatticeMap(const LatticeMap &other)
+:
+  Mapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+LatticeMap &LatticeMap::operator =(const LatticeMap &other)
+{
+  if (this != &other) {
+    Mapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void LatticeMap::Initialize()
+{
+  // Initialize base class
+  Mapping::Initialize();
+
+  // Use previously sampled or read lattice values when no source map is set
+  if (!_Source) {
+    if (_Values.IsEmpty()) {
+      cerr << this->NameOfType() << "::Initialize: No source map set" << endl;
+      exit(1);
+    }
+    return;
+  }
+
+  // Sample source map at lattice points, where NaN marks lattice points
+  // outside the domain of the source map
+  UniquePtr<Mapping> source(_Source->NewCopy());
+  source->OutsideValue(mirtk::nan);
+  _Values.Initialize(source->Attributes(_Spacing, _Spacing, _Spacing), source->NumberOfComponents());
+  source->Evaluate(_Values);
+
+  // Check interpolation error at random points
+  _MaximumError = _RMSError = mirtk::nan;
+  if (_NumberOfProbes > 0) {
+    const int dim = source->NumberOfComponents();
+    double x1, y1, z1, x2, y2, z2;
+    source->BoundingBox(x1, y1, z1, x2, y2, z2);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> u(.0, 1.0);
+    Array<double> xyz(3 * _NumberOfProbes), expected(dim * _NumberOfProbes), v(dim);
+    for (int i = 0; i < _NumberOfProbes; ++i) {
+      xyz[3 * i    ] = x1 + u(rng) * (x2 - x1);
+      xyz[3 * i + 1] = y1 + u(rng) * (y2 - y1);
+      xyz[3 * i + 2] = z1 + u(rng) * (z2 - z1);
+    }
+    UniquePtr<bool[]> inside(new bool[_NumberOfProbes]);
+    source->Evaluate(_NumberOfProbes, xyz.data(), expected.data(), inside.get());
+
+    int    n = 0;
+    double e, emax = .0, esum = .0;
+    for (int i = 0; i < _NumberOfProbes; ++i) {
+      if (inside[i] && this->Evaluate(v.data(), xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2])) {
+        for (int l = 0; l < dim; ++l) {
+          e = abs(v[l] - expected[dim * i + l]);
+          if (e > emax) emax = e;
+          esum += e * e;
+        }
+        ++n;
+      }
+    }
+    if (n > 0) {
+      _MaximumError = emax;
+      _RMSError     = sqrt(esum / (n * dim));
+    }
+    if (verbose) {
+      cout << this->NameOfType() << "::Initialize: Interpolation error at " << n
+           << " random points: max = " << _MaximumError << ", RMS = " << _RMSError << endl;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *LatticeMap::NewCopy() const
+{
+  return new LatticeMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+LatticeMap::~LatticeMap()
+{
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void LatticeMap::BoundingBox(double &x1, double &y1, double &z1,
+                             double &x2, double &y2, double &z2) const
+{
+  if (_Values.IsEmpty()) {
+    x1 = x2 = y1 = y2 = z1 = z2 = .0;
+    return;
+  }
+  x1 = y1 = z1 = +inf;
+  x2 = y2 = z2 = -inf;
+  const double ci[2] = { -.5, _Values.X() - .5 };
+  const double cj[2] = { -.5, _Values.Y() - .5 };
+  const double ck[2] = { -.5, _Values.Z() - .5 };
+  double x, y, z;
+  for (int k = 0; k < 2; ++k)
+  for (int j = 0; j < 2; ++j)
+  for (int i = 0; i < 2; ++i) {
+    x = ci[i], y = cj[j], z = ck[k];
+    _Values.ImageToWorld(x, y, z);
+    x1 = min(x1, x), x2 = max(x2, x);
+    y1 = min(y1, y), y2 = max(y2, y);
+    z1 = min(z1, z), z2 = max(z2, z);
+  }
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool LatticeMap::EvaluateLinear(double *v, double i, double j, double k) const
+{
+  const int nx  = _Values.X();
+  const int ny  = _Values.Y();
+  const int nz  = _Values.Z();
+  const int dim = _Values.T();
+
+  int    i0, i1, j0, j1, k0, k1;
+  double wi, wj, wk;
+  if (!LinearStencil(i, nx, i0, i1, wi) ||
+      !LinearStencil(j, ny, j0, j1, wj) ||
+      !LinearStencil(k, nz, k0, k1, wk)) {
+    return false;
+  }
+
+  const int    nvox = nx * ny * nz;
+  const float *data = _Values.GetPointerToVoxels();
+  const int    ci[2] = { i0, i1 }, cj[2] = { j0, j1 }, ck[2] = { k0, k1 };
+  const double wx[2] = { 1.0 - wi, wi }, wy[2] = { 1.0 - wj, wj }, wz[2] = { 1.0 - wk, wk };
+
+  for (int l = 0; l < dim; ++l) v[l] = .0;
+
+  double w, wsum = .0;
+  for (int c = 0; c < 2; ++c)
+  for (int b = 0; b < 2; ++b)
+  for (int a = 0; a < 2; ++a) {
+    w = wx[a] * wy[b] * wz[c];
+    if (w == .0) continue;
+    const float *p = data + ci[a] + nx * (cj[b] + ny * ck[c]);
+    if (IsNaN(*p)) continue;
+    for (int l = 0; l < dim; ++l, p += nvox) {
+      v[l] += w * static_cast<double>(*p);
+    }
+    wsum += w;
+  }
+
+  if (wsum < .5) return false;
+  for (int l = 0; l < dim; ++l) v[l] /= wsum;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool LatticeMap::EvaluateCubic(double *v, double i, double j, double k) const
+{
+  const int nx  = _Values.X();
+  const int ny  = _Values.Y();
+  const int nz  = _Values.Z();
+  const int dim = _Values.T();
+
+  int    ci[4], cj[4], ck[4], mi, mj, mk;
+  double wi[4], wj[4], wk[4];
+  if (!CubicStencil(i, nx, ci, wi, mi) ||
+      !CubicStencil(j, ny, cj, wj, mj) ||
+      !CubicStencil(k, nz, ck, wk, mk)) {
+    return false;
+  }
+
+  const int    nvox = nx * ny * nz;
+  const float *data = _Values.GetPointerToVoxels();
+
+  for (int l = 0; l < dim; ++l) v[l] = .0;
+
+  double w;
+  for (int c = 0; c < mk; ++c)
+  for (int b = 0; b < mj; ++b)
+  for (int a = 0; a < mi; ++a) {
+    const float *p = data + ci[a] + nx * (cj[b] + ny * ck[c]);
+    if (IsNaN(*p)) return false;
+    w = wi[a] * wj[b] * wk[c];
+    for (int l = 0; l < dim; ++l, p += nvox) {
+      v[l] += w * static_cast<double>(*p);
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool LatticeMap::Evaluate(double *v, double x, double y, double z) const
+{
+  _Values.WorldToImage(x, y, z);
+  if ((_CubicInterpolation && EvaluateCubic(v, x, y, z)) || EvaluateLinear(v, x, y, z)) {
+    return true;
+  }
+  for (int l = 0; l < _Values.T(); ++l) {
+    v[l] = _OutsideValue;
+  }
+  return false;
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void LatticeMap::ReadMap(Cifstream &is)
+{
+  int    size[4], cubic;
+  double geom[15];
+  is.ReadAsInt(size, 4);
+  is.ReadAsDouble(geom, 15);
+  is.ReadAsInt(&cubic, 1);
+
+  ImageAttributes lattice;
+  lattice._x       = size[0];
+  lattice._y       = size[1];
+  lattice._z       = size[2];
+  lattice._xorigin = geom[0];
+  lattice._yorigin = geom[1];
+  lattice._zorigin = geom[2];
+  lattice._dx      = geom[3];
+  lattice._dy      = geom[4];
+  lattice._dz      = geom[5];
+  for (int d = 0; d < 3; ++d) {
+    lattice._xaxis[d] = geom[ 6 + d];
+    lattice._yaxis[d] = geom[ 9 + d];
+    lattice._zaxis[d] = geom[12 + d];
+  }
+  _Values.Initialize(lattice, size[3]);
+  is.ReadAsFloat(_Values.GetPointerToVoxels(), _Values.NumberOfVoxels());
+
+  _Source             = nullptr;
+  _CubicInterpolation = (cubic != 0);
+}
+
+// -----------------------------------------------------------------------------
+void LatticeMap::WriteMap(Cofstream &os) const
+{
+  const ImageAttributes &lattice = _Values.Attributes();
+  int    size[4] = { lattice._x, lattice._y, lattice._z, _Values.T() };
+  double geom[15] = {
+    lattice._xorigin, lattice._yorigin, lattice._zorigin,
+    lattice._dx,      lattice._dy,      lattice._dz,
+    lattice._xaxis[0], lattice._xaxis[1], lattice._xaxis[2],
+    lattice._yaxis[0], lattice._yaxis[1], lattice._yaxis[2],
+    lattice._zaxis[0], lattice._zaxis[1], lattice._zaxis[2]
+  };
+  int cubic = (_CubicInterpolation ? 1 : 0);
+  os.WriteAsInt(size, 4);
+  os.WriteAsDouble(geom, 15);
+  os.WriteAsInt(&cubic, 1);
+  os.WriteAsFloat(_Values.GetPointerToVoxels(), _Values.NumberOfVoxels());
+}
+
+
+} // namespace mirtk
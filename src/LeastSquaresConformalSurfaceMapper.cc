@@ -20,16 +20,20 @@
 #include "mirtk/LeastSquaresConformalSurfaceMapper.h"
 
 #include "mirtk/Algorithm.h"
+#include "mirtk/Math.h"
+#include "mirtk/Parallel.h"
 #include "mirtk/Triangle.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/DataArrayView.h"
 #include "mirtk/ChordLengthBoundarySegmentParameterizer.h"
 
 #include "vtkPointData.h"
 #include "vtkCellData.h"
 #include "vtkFloatArray.h"
 #include "vtkDoubleArray.h"
+#include "vtkMath.h"
 
-#include "Eigen/Sparse"
+#include "mirtk/SparseSolver.h"
 
 
 namespace mirtk {
@@ -39,6 +43,145 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliary functors
+// =============================================================================
+
+namespace LeastSquaresConformalSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute Cauchy-Riemann residual coefficients of each triangle
+///
+/// The residual of triangle t with corners k = 0, 1, 2 and opposite edge
+/// vectors (a_k, b_k) in a local 2D frame is given by the two rows
+/// sum_k (a_k u_k - b_k v_k) / d_t and sum_k (b_k u_k + a_k v_k) / d_t,
+/// where d_t = 2 sqrt(area_t). Map values of fixed corners are moved to
+/// the right-hand side of the least squares problem.
+struct ComputeTriangleTerms
+{
+  vtkPolyData                  *_Surface;
+  const class TriangleGeometry *_Triangles;
+  const Array<int>             *_PointIndex;
+  const DataArrayView          *_Values;
+  int                          *_Column;
+  double                       *_Re;
+  double                       *_Im;
+  double                       *_Rhs;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    double p[3][3], e1[3], e2[3], n[3], ex[3], ey[3], x[3], y[3], d, u, v;
+    int    ptId;
+    for (int t = re.begin(); t != re.end(); ++t) {
+      for (int k = 0; k < 3; ++k) {
+        _Surface->GetPoint(_Triangles->PointId(t, k), p[k]);
+      }
+      // Local orthonormal frame in plane of triangle
+      vtkMath::Subtract(p[1], p[0], e1);
+      vtkMath::Subtract(p[2], p[0], e2);
+      vtkMath::Cross(e1, e2, n);
+      ex[0] = e1[0], ex[1] = e1[1], ex[2] = e1[2];
+      vtkMath::Normalize(ex);
+      vtkMath::Cross(n, ex, ey);
+      vtkMath::Normalize(ey);
+      x[0] = .0, x[1] = vtkMath::Norm(e1), x[2] = vtkMath::Dot(e2, ex);
+      y[0] = .0, y[1] = .0,                y[2] = vtkMath::Dot(e2, ey);
+      d = 2. * sqrt(.5 * vtkMath::Norm(n));
+      if (d > .0) d = 1. / d;
+      _Rhs[2 * t] = _Rhs[2 * t + 1] = .0;
+      for (int k = 0, k1, k2, c; k < 3; ++k) {
+        k1 = (k + 1) % 3;
+        k2 = (k + 2) % 3;
+        c  = 3 * t + k;
+        _Re[c] = d * (x[k2] - x[k1]);
+        _Im[c] = d * (y[k2] - y[k1]);
+        ptId = _Triangles->PointId(t, k);
+        _Column[c] = (*_PointIndex)[ptId];
+        if (_Column[c] < 0) {
+          u = _Values->Get(ptId, 0);
+          v = _Values->Get(ptId, 1);
+          _Rhs[2 * t    ] -= _Re[c] * u - _Im[c] * v;
+          _Rhs[2 * t + 1] -= _Im[c] * u + _Re[c] * v;
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Apply column scaled residual operator, i.e., y = M D x
+struct MultiplyResidualOperator
+{
+  const int    *_Column;
+  const double *_Re;
+  const double *_Im;
+  const double *_Scale;
+  const double *_X;
+  double       *_Y;
+  int           _NumberOfFreePoints;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int n = _NumberOfFreePoints;
+    double u, v, y1, y2;
+    for (int t = re.begin(); t != re.end(); ++t) {
+      y1 = y2 = .0;
+      for (int c = 3 * t, r; c < 3 * t + 3; ++c) {
+        r = _Column[c];
+        if (r >= 0) {
+          u = _Scale[r] * _X[r];
+          v = _Scale[r] * _X[r + n];
+          y1 += _Re[c] * u - _Im[c] * v;
+          y2 += _Im[c] * u + _Re[c] * v;
+        }
+      }
+      _Y[2 * t    ] = y1;
+      _Y[2 * t + 1] = y2;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Apply transpose of column scaled residual operator, i.e., x = D M^T y,
+/// by gathering the terms of the triangle corners incident to each free point
+struct MultiplyTransposedResidualOperator
+{
+  const int    *_Offset;
+  const int    *_Corner;
+  const double *_Re;
+  const double *_Im;
+  const double *_Scale;
+  const double *_Y;
+  double       *_X;
+  int           _NumberOfFreePoints;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int n = _NumberOfFreePoints;
+    double xu, xv, y1, y2;
+    for (int r = re.begin(); r != re.end(); ++r) {
+      xu = xv = .0;
+      for (int k = _Offset[r], c, t; k < _Offset[r + 1]; ++k) {
+        c  = _Corner[k];
+        t  = c / 3;
+        y1 = _Y[2 * t];
+        y2 = _Y[2 * t + 1];
+        xu += _Re[c] * y1 + _Im[c] * y2;
+        xv += _Re[c] * y2 - _Im[c] * y1;
+      }
+      _X[r    ] = _Scale[r] * xu;
+      _X[r + n] = _Scale[r] * xv;
+    }
+  }
+};
+
+
+} // namespace LeastSquaresConformalSurfaceMapperUtils
+
+using namespace LeastSquaresConformalSurfaceMapperUtils;
+
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -49,6 +192,8 @@ void LeastSquaresConformalSurfaceMapper
 {
   _NumberOfIterations = other._NumberOfIterations;
   _Tolerance          = other._Tolerance;
+  _Solver             = other._Solver;
+  _MatrixFree         = other._MatrixFree;
   _PointIndex         = other._PointIndex;
   _FreePoints         = other._FreePoints;
   _FixedPoints        = other._FixedPoints;
@@ -66,7 +211,9 @@ void LeastSquaresConformalSurfaceMapper
 LeastSquaresConformalSurfaceMapper::LeastSquaresConformalSurfaceMapper()
 :
   _NumberOfIterations(-1),
-  _Tolerance(-1.)
+  _Tolerance(-1.),
+  _Solver(SparseSolver_Default),
+  _MatrixFree(false)
 {
 }
 
@@ -125,22 +272,16 @@ void LeastSquaresConformalSurfaceMapper::AddFixedPoint(int i, double u, double v
 // -----------------------------------------------------------------------------
 double LeastSquaresConformalSurfaceMapper::Weight(int i, int j) const
 {
-  int    k, l;
-  double a[3], b[3], c[3], w;
-
-  const int n = GetEdgeNeighborPoints(i, j, k, l);
-  if (n == 0 || n > 2) {
+  int t[2], k[2];
+  if (GetEdgeTriangles(i, j, t, k) == 0) {
     cerr << this->NameOfType() << "::Weight: Surface mesh must be triangulated!" << endl;
     exit(1);
   }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
-  _Surface->GetPoint(static_cast<vtkIdType>(i), a);
-  _Surface->GetPoint(static_cast<vtkIdType>(k), b);
-  _Surface->GetPoint(static_cast<vtkIdType>(j), c);
-  w = Triangle::Cotangent(a, b, c);
-  if (n == 2) {
-    _Surface->GetPoint(static_cast<vtkIdType>(l), b);
-    w += Triangle::Cotangent(a, b, c);
+  double w = tris.Cotangent(t[0], k[0]);
+  if (t[1] >= 0) {
+    w += tris.Cotangent(t[1], k[1]);
   }
 
   return w;
@@ -229,9 +370,15 @@ void LeastSquaresConformalSurfaceMapper::Initialize()
 // -----------------------------------------------------------------------------
 void LeastSquaresConformalSurfaceMapper::ComputeMap()
 {
+  if (_MatrixFree) {
+    ComputeMatrixFreeMap();
+    return;
+  }
+
   const bool use_direct_solver = (_NumberOfIterations == 1 || _NumberOfIterations < 0);
 
   MIRTK_START_TIMING();
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
 
   typedef Eigen::VectorXd             Vector;
   typedef Eigen::SparseMatrix<double> Matrix;
@@ -241,6 +388,7 @@ void LeastSquaresConformalSurfaceMapper::ComputeMap()
   const int m = 2;
 
   int i, j, ui, vi, uj, vj;
+  const DataArrayView values(_Values);
 
   Matrix A(m * n, m * n);
   Vector b(m * n);
@@ -264,11 +412,11 @@ void LeastSquaresConformalSurfaceMapper::ComputeMap()
           w.push_back(NZEntry(vi, vj, w_ij));
           w.push_back(NZEntry(vj, vi, w_ij));
         } else if (ui >= 0) {
-          b(ui) -= w_ij * GetValue(j, 0);
-          b(vi) -= w_ij * GetValue(j, 1);
+          b(ui) -= w_ij * values.Get(j, 0);
+          b(vi) -= w_ij * values.Get(j, 1);
         } else if (uj >= 0) {
-          b(uj) -= w_ij * GetValue(i, 0);
-          b(vj) -= w_ij * GetValue(i, 1);
+          b(uj) -= w_ij * values.Get(i, 0);
+          b(vj) -= w_ij * values.Get(i, 1);
         }
         if (ui >= 0) {
           w_ii[ui] -= w_ij;
@@ -298,11 +446,11 @@ void LeastSquaresConformalSurfaceMapper::ComputeMap()
         A.coeffRef(uj, vi) += 1.;
         A.coeffRef(vi, uj) += 1.;
       } else if (ui >= 0) {
-        b(ui) += GetValue(j, 1);
-        b(vi) -= GetValue(j, 0);
+        b(ui) += values.Get(j, 1);
+        b(vi) -= values.Get(j, 0);
       } else if (uj >= 0) {
-        b(uj) -= GetValue(i, 1);
-        b(vj) += GetValue(i, 0);
+        b(uj) -= values.Get(i, 1);
+        b(vj) += values.Get(i, 0);
       }
     }
 
@@ -310,6 +458,7 @@ void LeastSquaresConformalSurfaceMapper::ComputeMap()
   }
 
   MIRTK_DEBUG_TIMING(1, "building sparse linear system");
+  assembly.Stop();
 
   if (verbose) {
     cout << "\n";
@@ -327,29 +476,185 @@ void LeastSquaresConformalSurfaceMapper::ComputeMap()
   int    niter = 0;
   double error = nan;
 
-  if (use_direct_solver) {
-    Eigen::SparseLU<Matrix> solver;
-    solver.analyzePattern(A);
-    solver.factorize(A);
-    x = solver.solve(b);
-  } else {
-    Eigen::ConjugateGradient<Matrix> solver(A);
-    if (_NumberOfIterations > 0 ) solver.setMaxIterations(_NumberOfIterations);
-    if (_Tolerance          > 0.) solver.setTolerance(_Tolerance);
-    x = solver.solve(b);
-    niter = solver.iterations();
-    error = solver.error();
-  }
+  MapperStatistics::Timer timer(&_Statistics, "solve");
+  const SparseSolverType solver = SolveSparseLinearSystem(_Solver, SparseMatrix_SPD,
+                                                          use_direct_solver, A, b, x,
+                                                          _NumberOfIterations, _Tolerance,
+                                                          false, &niter, &error, _Observer);
+  timer.Stop();
+  _Statistics.AddLinearSolve(ToString(solver), A.rows(), A.nonZeros(), niter, error);
 
   for (ui = 0, vi = n; ui < n; ++ui, ++vi) {
     i = FreePointId(ui);
-    SetValue(i, 0, x(ui));
-    SetValue(i, 1, x(vi));
+    values.Set(i, 0, x(ui));
+    values.Set(i, 1, x(vi));
   }
 
   MIRTK_DEBUG_TIMING(1, "solving sparse linear system");
 
-  if (verbose && !use_direct_solver) {
+  if (verbose) {
+    cout << "  Sparse linear solver         = " << ToString(solver) << "\n";
+    if (!IsDirectSolver(solver)) {
+      cout << "  No. of iterations            = " << niter << "\n";
+      cout << "  Estimated error              = " << error << "\n";
+    }
+    cout.flush();
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LeastSquaresConformalSurfaceMapper::ComputeMatrixFreeMap()
+{
+  typedef Eigen::VectorXd Vector;
+
+  MIRTK_START_TIMING();
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
+
+  const class TriangleGeometry &tris = *_TriangleGeometry;
+  const int n  = NumberOfFreePoints();
+  const int m  = 2;
+  const int nt = tris.NumberOfTriangles();
+  const DataArrayView values(_Values);
+
+  // Precompute residual coefficients of each triangle corner
+  Array<int>    column(3 * nt);
+  Array<double> re(3 * nt), im(3 * nt);
+  Vector        b(m * nt);
+  {
+    ComputeTriangleTerms terms;
+    terms._Surface    = _Surface;
+    terms._Triangles  = &tris;
+    terms._PointIndex = &_PointIndex;
+    terms._Values     = &values;
+    terms._Column     = column.data();
+    terms._Re         = re.data();
+    terms._Im         = im.data();
+    terms._Rhs        = b.data();
+    parallel_for(blocked_range<int>(0, nt), terms);
+  }
+
+  // Triangle corners incident to each free point and column scaling, where
+  // the u and v columns of a point have identical norm
+  Array<int>    offset(n + 1, 0), corner;
+  Array<double> scale(n, .0);
+  for (int c = 0; c < 3 * nt; ++c) {
+    if (column[c] >= 0) ++offset[column[c] + 1];
+  }
+  for (int r = 0; r < n; ++r) offset[r + 1] += offset[r];
+  corner.resize(offset[n]);
+  {
+    Array<int> pos(offset.begin(), offset.end() - 1);
+    for (int c = 0, r; c < 3 * nt; ++c) {
+      r = column[c];
+      if (r >= 0) {
+        corner[pos[r]++] = c;
+        scale[r] += re[c] * re[c] + im[c] * im[c];
+      }
+    }
+  }
+  for (int r = 0; r < n; ++r) {
+    scale[r] = (scale[r] > .0 ? 1. / sqrt(scale[r]) : 1.);
+  }
+
+  MultiplyResidualOperator Av;
+  Av._Column             = column.data();
+  Av._Re                 = re.data();
+  Av._Im                 = im.data();
+  Av._Scale              = scale.data();
+  Av._NumberOfFreePoints = n;
+
+  MultiplyTransposedResidualOperator Atu;
+  Atu._Offset             = offset.data();
+  Atu._Corner             = corner.data();
+  Atu._Re                 = re.data();
+  Atu._Im                 = im.data();
+  Atu._Scale              = scale.data();
+  Atu._NumberOfFreePoints = n;
+
+  const blocked_range<int> rows(0, nt), cols(0, n);
+
+  MIRTK_DEBUG_TIMING(1, "precomputing triangle residual terms");
+  assembly.Stop();
+
+  if (verbose) {
+    cout << "\n";
+    cout << "  No. of surface points        = " << NumberOfPoints() << "\n";
+    cout << "  No. of fixed points          = " << NumberOfFixedPoints() << "\n";
+    cout << "  No. of free points           = " << n << "\n";
+    cout << "  No. of triangles             = " << nt << "\n";
+    cout << "  Dimension of map codomain    = " << m << "\n";
+    cout.flush();
+  }
+
+  MIRTK_RESET_TIMING();
+  MapperStatistics::Timer timer(&_Statistics, "solve");
+
+  // LSQR iterations for min_y ||M D y - b||, where x = D y
+  const int    maxiter = (_NumberOfIterations > 1 ? _NumberOfIterations : 10000);
+  const double tol     = (_Tolerance > .0 ? _Tolerance : 1e-8);
+
+  Vector u = b, v(m * n), w(m * n), y(m * n), Mv(m * nt), Mtu(m * n);
+  double alpha, beta, rho, rho_bar, phi, phi_bar, c, s, theta, anorm2 = .0;
+  double error = .0;
+  int    niter = 0;
+
+  y.setZero();
+  beta = u.norm();
+  if (beta > .0) u /= beta;
+  Atu._Y = u.data(), Atu._X = v.data();
+  parallel_for(cols, Atu);
+  alpha = v.norm();
+  if (alpha > .0) v /= alpha;
+  w       = v;
+  phi_bar = beta;
+  rho_bar = alpha;
+
+  while (niter < maxiter && alpha * beta > .0) {
+    // Continue bidiagonalization
+    Av._X = v.data(), Av._Y = Mv.data();
+    parallel_for(rows, Av);
+    u = Mv - alpha * u;
+    beta = u.norm();
+    if (beta > .0) u /= beta;
+    anorm2 += alpha * alpha + beta * beta;
+    Atu._Y = u.data(), Atu._X = Mtu.data();
+    parallel_for(cols, Atu);
+    v = Mtu - beta * v;
+    alpha = v.norm();
+    if (alpha > .0) v /= alpha;
+    // Apply plane rotation and update solution
+    rho     = sqrt(rho_bar * rho_bar + beta * beta);
+    c       = rho_bar / rho;
+    s       = beta / rho;
+    theta   = s * alpha;
+    rho_bar = - c * alpha;
+    phi     = c * phi_bar;
+    phi_bar = s * phi_bar;
+    y += (phi / rho) * w;
+    w  = v - (theta / rho) * w;
+    ++niter;
+    // Relative norm of normal equations residual ||(MD)^T r|| / (||MD|| ||r||)
+    error = alpha * abs(c) / sqrt(anorm2);
+    if (verbose > 2) {
+      cout << "  Iteration " << niter << ": residual = " << phi_bar
+           << ", relative normal residual = " << error << endl;
+    }
+    if (error <= tol) break;
+    if (_Observer && !_Observer->Continue()) break;
+  }
+  timer.Stop();
+  _Statistics.AddLinearSolve("LSQR", m * n, 6 * 2 * static_cast<int64_t>(nt), niter, error);
+
+  for (int r = 0, i; r < n; ++r) {
+    i = FreePointId(r);
+    values.Set(i, 0, scale[r] * y(r));
+    values.Set(i, 1, scale[r] * y(r + n));
+  }
+
+  MIRTK_DEBUG_TIMING(1, "solving least squares problem");
+
+  if (verbose) {
+    cout << "  Sparse linear solver         = LSQR (matrix-free)\n";
     cout << "  No. of iterations            = " << niter << "\n";
     cout << "  Estimated error              = " << error << "\n";
     cout.flush();
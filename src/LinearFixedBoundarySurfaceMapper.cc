@@ -19,20 +19,37 @@
 
 #include "mirtk/LinearFixedBoundarySurfaceMapper.h"
 
+#include "mirtk/Math.h"
 #include "mirtk/Memory.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/SparseSolver.h"
+#include "mirtk/SparseMatrixOrdering.h"
+#include "mirtk/ReducedBoundaryBasis.h"
+#include "mirtk/MapperWorkspace.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/FlipFreeSurfaceMapRefinement.h"
+#include "mirtk/DataArrayView.h"
+#include "mirtk/Vtk.h"
 
 #include "vtkSmartPointer.h"
+#include "vtkNew.h"
 #include "vtkPolyData.h"
 #include "vtkPointData.h"
 #include "vtkCellData.h"
 #include "vtkFloatArray.h"
 #include "vtkDoubleArray.h"
+#include "vtkDecimatePro.h"
+#include "vtkCellLocator.h"
+#include "vtkGenericCell.h"
 
 
 namespace mirtk {
 
 
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -43,9 +60,19 @@ void LinearFixedBoundarySurfaceMapper
 {
   _NumberOfIterations = other._NumberOfIterations;
   _Tolerance          = other._Tolerance;
+  _Solver             = other._Solver;
+  _MixedPrecision     = other._MixedPrecision;
+  _FlipFreeRefinement = other._FlipFreeRefinement;
+  _NumberOfLevels     = other._NumberOfLevels;
+  _LevelReduction     = other._LevelReduction;
+  _ReorderPoints      = other._ReorderPoints;
   _PointIndex         = other._PointIndex;
   _FreePoints         = other._FreePoints;
   _FixedPoints        = other._FixedPoints;
+  _CouplingOffset     = other._CouplingOffset;
+  _CouplingIndex      = other._CouplingIndex;
+  _CouplingWeight     = other._CouplingWeight;
+  _BoundaryBasis      = other._BoundaryBasis;
 
   if (other._Values) {
     _Values.TakeReference(other._Values->NewInstance());
@@ -59,7 +86,13 @@ void LinearFixedBoundarySurfaceMapper
 LinearFixedBoundarySurfaceMapper::LinearFixedBoundarySurfaceMapper()
 :
   _NumberOfIterations(-1),
-  _Tolerance(-1.0)
+  _Tolerance(-1.0),
+  _Solver(SparseSolver_Default),
+  _MixedPrecision(false),
+  _FlipFreeRefinement(false),
+  _NumberOfLevels(1),
+  _LevelReduction(.75),
+  _ReorderPoints(true)
 {
 }
 
@@ -88,10 +121,269 @@ LinearFixedBoundarySurfaceMapper::~LinearFixedBoundarySurfaceMapper()
 {
 }
 
+// -----------------------------------------------------------------------------
+MapperWorkspace &LinearFixedBoundarySurfaceMapper::GetWorkspace()
+{
+  if (!_Workspace) _Workspace = NewShared<MapperWorkspace>();
+  return *_Workspace;
+}
+
 // =============================================================================
 // Execution
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper::Run(vtkPoints *points)
+{
+  if (!_Surface || !_Values || _PointIndex.empty()) {
+    cerr << this->NameOfType() << "::Run: Map of template surface must be computed first" << endl;
+    exit(1);
+  }
+  if (points->GetNumberOfPoints() != _Surface->GetNumberOfPoints()) {
+    cerr << this->NameOfType() << "::Run: Number of points differs from template surface" << endl;
+    exit(1);
+  }
+
+  _Statistics.Clear();
+  _Statistics.Mapper(this->NameOfClass());
+  if (_Observer) _Observer->Start();
+  MapperStatistics::Timer run(&_Statistics, "run");
+
+  // Replace surface points, sharing the cells and links of the template
+  vtkSmartPointer<vtkPolyData> surface;
+  surface.TakeReference(_Surface->NewInstance());
+  surface->ShallowCopy(_Surface);
+  surface->SetPoints(points);
+  _Surface = surface;
+  if (_TriangleGeometry) {
+    _TriangleGeometry = NewShared<class TriangleGeometry>(_Surface, _EdgeTable.get());
+  }
+
+  // Copy map values as output of previous run references them
+  vtkSmartPointer<vtkDataArray> values;
+  values.TakeReference(_Values->NewInstance());
+  values->DeepCopy(_Values);
+  _Values = values;
+
+  // Compute map of surface
+  _Output        = nullptr;
+  _BoundaryBasis = nullptr;
+  if (!_Observer || _Observer->Continue()) {
+    MapperStatistics::Timer timer(&_Statistics, "compute");
+    this->ComputeMap();
+  }
+  {
+    MapperStatistics::Timer timer(&_Statistics, "finalize");
+    this->Finalize();
+  }
+  run.Stop();
+  _Statistics.Status(_Observer ? _Observer->Status() : MapperStatus_Completed);
+  _Statistics.UpdatePeakMemory();
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper
+::CheckFixedValues(vtkDataArray *values, const char *func) const
+{
+  if (!_Surface || !_Values || !_Factorization || !_Factorization->HasMatrix()) {
+    cerr << this->NameOfType() << "::" << func << ": Map must be computed by Run first" << endl;
+    exit(1);
+  }
+  if (_CouplingOffset.size() != _FreePoints.size() + 1) {
+    cerr << this->NameOfType() << "::" << func << ": Not supported by this surface mapper" << endl;
+    exit(1);
+  }
+  const int m = NumberOfComponents();
+  if (!values || values->GetNumberOfTuples() != static_cast<vtkIdType>(NumberOfPoints()) ||
+      values->GetNumberOfComponents() != m) {
+    cerr << this->NameOfType() << "::" << func << ": Array must have one "
+         << m << "-dimensional map value per surface point" << endl;
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper::RunWithFixedValues(vtkDataArray *values)
+{
+  CheckFixedValues(values, "RunWithFixedValues");
+  const int n = NumberOfFreePoints();
+  const int m = NumberOfComponents();
+
+  _Statistics.Clear();
+  _Statistics.Mapper(this->NameOfClass());
+  if (_Observer) _Observer->Start();
+  MapperStatistics::Timer run(&_Statistics, "run");
+
+  // Copy map values as output of previous run references them
+  vtkSmartPointer<vtkDataArray> copy;
+  copy.TakeReference(_Values->NewInstance());
+  copy->DeepCopy(_Values);
+  _Values = copy;
+  const DataArrayView src(values), dst(_Values);
+  for (int k = 0; k < NumberOfFixedPoints(); ++k) {
+    const int i = FixedPointId(k);
+    for (int l = 0; l < m; ++l) {
+      dst.Set(i, l, src.Get(i, l));
+    }
+  }
+
+  // Update right-hand side and solve linear system with retained factorization
+  Eigen::MatrixXd b(n, m), x(n, m);
+  for (int r = 0; r < n; ++r) {
+    for (int l = 0; l < m; ++l) {
+      b(r, l) = .0;
+      x(r, l) = dst.Get(FreePointId(r), l);
+    }
+    for (int k = _CouplingOffset[r]; k < _CouplingOffset[r + 1]; ++k) {
+      for (int l = 0; l < m; ++l) {
+        b(r, l) += _CouplingWeight[k] * dst.Get(FixedPointId(_CouplingIndex[k]), l);
+      }
+    }
+  }
+  int    niter = 0;
+  double error = .0;
+  _Factorization->Statistics(&_Statistics);
+  _Factorization->Observer(_Observer);
+  const SparseSolverType solver = _Factorization->Resolve(b, x, _NumberOfIterations, _Tolerance,
+                                                          true, &niter, &error);
+  for (int r = 0; r < n; ++r) {
+    for (int l = 0; l < m; ++l) {
+      dst.Set(FreePointId(r), l, x(r, l));
+    }
+  }
+  if (verbose) {
+    cout << "\n  Resolved linear system using " << ToString(solver) << " solver";
+    if (!IsDirectSolver(solver)) {
+      cout << " (no. of iterations = " << niter << ", estimated error = " << error << ")";
+    }
+    cout << endl;
+  }
+
+  _Output = nullptr;
+  {
+    MapperStatistics::Timer timer(&_Statistics, "finalize");
+    this->Finalize();
+  }
+  run.Stop();
+  _Statistics.Status(_Observer ? _Observer->Status() : MapperStatus_Completed);
+  _Statistics.UpdatePeakMemory();
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper
+::PrecomputeBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &maps,
+                          int max_modes, double energy)
+{
+  const int n = NumberOfFreePoints();
+  const int f = NumberOfFixedPoints();
+  const int m = NumberOfComponents();
+  const int s = static_cast<int>(maps.size());
+
+  if (s == 0) {
+    cerr << this->NameOfType() << "::PrecomputeBoundaryBasis: No sample maps given" << endl;
+    exit(1);
+  }
+
+  // Compute mean and principal modes of sample fixed point values
+  Eigen::MatrixXd samples(f, s * m);
+  for (int k = 0; k < s; ++k) {
+    CheckFixedValues(maps[k], "PrecomputeBoundaryBasis");
+    for (int i = 0; i < f; ++i) {
+      for (int l = 0; l < m; ++l) {
+        samples(i, k * m + l) = maps[k]->GetComponent(FixedPointId(i), l);
+      }
+    }
+  }
+  SharedPtr<ReducedBoundaryBasis> basis = NewShared<ReducedBoundaryBasis>();
+  basis->Initialize(samples, max_modes, energy);
+  samples.resize(0, 0);
+  if (verbose) {
+    cout << "\n  Boundary basis has " << basis->NumberOfModes() << " principal modes of "
+         << s * m << " sample functions explaining " << 100.0 * basis->ExplainedVariance()
+         << "% of their variance" << endl;
+  }
+
+  // Right-hand side of linear system for each boundary function
+  const Eigen::MatrixXd g = basis->Functions();
+  const int             c = static_cast<int>(g.cols());
+  Eigen::MatrixXd b(n, c), x(n, c);
+  b.setZero();
+  x.setZero();
+  for (int r = 0; r < n; ++r) {
+    for (int k = _CouplingOffset[r]; k < _CouplingOffset[r + 1]; ++k) {
+      b.row(r) += _CouplingWeight[k] * g.row(_CouplingIndex[k]);
+    }
+  }
+
+  // Solve linear system for all boundary functions
+  _Factorization->Resolve(b, x, _NumberOfIterations, _Tolerance, false);
+  basis->Response(x);
+  _BoundaryBasis = basis;
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper
+::EvaluateBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &values,
+                        Array<vtkSmartPointer<vtkDataArray> >       &maps,
+                        double *error) const
+{
+  const int f = NumberOfFixedPoints();
+  const int m = NumberOfComponents();
+  const int c = static_cast<int>(values.size());
+
+  if (!_BoundaryBasis || !_BoundaryBasis->HasResponse()) {
+    cerr << this->NameOfType() << "::EvaluateBoundaryBasis: Boundary basis must be"
+            " computed by PrecomputeBoundaryBasis first" << endl;
+    exit(1);
+  }
+
+  // Free point values as linear combination of responses of boundary functions
+  Eigen::MatrixXd g(f, c * m), x;
+  for (int k = 0; k < c; ++k) {
+    CheckFixedValues(values[k], "EvaluateBoundaryBasis");
+    for (int i = 0; i < f; ++i) {
+      for (int l = 0; l < m; ++l) {
+        g(i, k * m + l) = values[k]->GetComponent(FixedPointId(i), l);
+      }
+    }
+  }
+  _BoundaryBasis->Evaluate(g, x, error);
+
+  // Assemble map values at all surface points
+  maps.resize(c);
+  for (int k = 0; k < c; ++k) {
+    vtkSmartPointer<vtkDataArray> &map = maps[k];
+    map.TakeReference(_Values->NewInstance());
+    map->SetName(_Values->GetName());
+    map->SetNumberOfComponents(m);
+    map->SetNumberOfTuples(static_cast<vtkIdType>(NumberOfPoints()));
+    for (int i = 0; i < f; ++i) {
+      for (int l = 0; l < m; ++l) {
+        map->SetComponent(FixedPointId(i), l, g(i, k * m + l));
+      }
+    }
+    for (int r = 0; r < NumberOfFreePoints(); ++r) {
+      for (int l = 0; l < m; ++l) {
+        map->SetComponent(FreePointId(r), l, x(r, k * m + l));
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper::RunWithBoundaryBasis(vtkDataArray *values)
+{
+  Array<vtkSmartPointer<vtkDataArray> > input(1, values), output;
+  double error = .0;
+  EvaluateBoundaryBasis(input, output, &error);
+  if (verbose) {
+    cout << "\n  Relative residual of fixed values projection = " << error << endl;
+  }
+  _Values = output[0];
+  _Output = nullptr;
+  this->Finalize();
+}
+
 // -----------------------------------------------------------------------------
 void LinearFixedBoundarySurfaceMapper::Initialize()
 {
@@ -118,6 +410,9 @@ void LinearFixedBoundarySurfaceMapper::Initialize()
   _Values->SetNumberOfComponents(dim);
   _Values->SetNumberOfTuples(static_cast<vtkIdType>(num));
 
+  _BoundaryBasis = nullptr;
+  _FreePoints .clear();
+  _FixedPoints.clear();
   _FreePoints .reserve(num);
   _FixedPoints.reserve(num);
   _PointIndex .resize (num);
@@ -134,13 +429,172 @@ void LinearFixedBoundarySurfaceMapper::Initialize()
     }
   }
 
-  _FixedPoints.shrink_to_fit();
-  _FreePoints .shrink_to_fit();
+  // Renumber free points for locality of sparse system matrix
+  if (_ReorderPoints && _FreePoints.size() > 1) {
+    ReorderFreePoints();
+  }
+
+  // Initial guess of iterative solver from map of coarser surface
+  if (_NumberOfLevels > 1 && !_FreePoints.empty()) {
+    const bool use_direct_solver = (_NumberOfIterations < 0 || _NumberOfIterations == 1);
+    if (_Solver == SparseSolver_Default ? !use_direct_solver : !IsDirectSolver(_Solver)) {
+      InitializeValuesFromCoarseLevel();
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool LinearFixedBoundarySurfaceMapper::InitializeValuesFromCoarseLevel()
+{
+  if (!_TriangleGeometry || !_TriangleGeometry->IsTriangulated()) return false;
+
+  // Decimate surface mesh, keeping the boundary points with fixed map values
+  vtkNew<vtkDecimatePro> decimator;
+  SetVTKInput(decimator, _Surface);
+  decimator->SetTargetReduction(max(.0, min(_LevelReduction, .99)));
+  decimator->PreserveTopologyOn();
+  decimator->SplittingOff();
+  decimator->BoundaryVertexDeletionOff();
+  decimator->Update();
+
+  vtkSmartPointer<vtkPolyData> coarse = decimator->GetOutput();
+  const double free = static_cast<double>(coarse->GetNumberOfPoints() - NumberOfFixedPoints());
+  if (free < 1. || free > .9 * static_cast<double>(NumberOfFreePoints())) return false;
+  coarse->GetPointData()->Initialize();
+  coarse->GetCellData ()->Initialize();
+
+  // Compute map of coarse surface using this filter
+  vtkSmartPointer<vtkPolyData>       surface       = _Surface;
+  SharedPtr<class EdgeTable>         edges         = _EdgeTable;
+  SharedPtr<SurfaceBoundary>         boundary      = _Boundary;
+  SharedPtr<class TriangleGeometry>  geometry      = _TriangleGeometry;
+  SharedPtr<SparseFactorization>     factorization = _Factorization;
+  Array<int>                         index         = _PointIndex;
+  Array<int>                         free_points   = _FreePoints;
+  Array<int>                         fixed_points  = _FixedPoints;
+  vtkSmartPointer<vtkDataArray>      values        = _Values;
+
+  if (verbose) {
+    cout << "\n  Computing map of coarse surface with " << coarse->GetNumberOfPoints() << " points...\n";
+    cout.flush();
+  }
+  _Surface       = coarse;
+  _EdgeTable     = nullptr;
+  _Boundary      = nullptr;
+  _Factorization = nullptr;
+  --_NumberOfLevels;
+  this->Initialize();
+  this->ComputeMap();
+  ++_NumberOfLevels;
+  vtkSmartPointer<vtkDataArray> coarse_values = _Values;
+
+  _Surface          = surface;
+  _EdgeTable        = edges;
+  _Boundary         = boundary;
+  _TriangleGeometry = geometry;
+  _Factorization    = factorization;
+  _PointIndex       = index;
+  _FreePoints       = free_points;
+  _FixedPoints      = fixed_points;
+  _Values           = values;
+  _Output           = nullptr;
+
+  // Interpolate coarse map at closest points on coarse surface
+  vtkNew<vtkCellLocator> locator;
+  locator->SetDataSet(coarse);
+  locator->BuildLocator();
+
+  const int dim = this->NumberOfComponents();
+  vtkNew<vtkGenericCell> cell;
+  Array<double> weights(max(3, coarse->GetMaxCellSize())), v(dim);
+  double p[3], q[3], pcoords[3], dist2;
+  vtkIdType cellId;
+  int subId, i;
+  for (int r = 0; r < NumberOfFreePoints(); ++r) {
+    i = FreePointId(r);
+    GetPoint(i, p);
+    locator->FindClosestPoint(p, q, cell.GetPointer(), cellId, subId, dist2);
+    if (cellId < 0) continue;
+    cell->EvaluatePosition(q, nullptr, subId, pcoords, dist2, weights.data());
+    for (int l = 0; l < dim; ++l) v[l] = .0;
+    for (vtkIdType k = 0; k < cell->GetNumberOfPoints(); ++k) {
+      for (int l = 0; l < dim; ++l) {
+        v[l] += weights[k] * coarse_values->GetComponent(cell->GetPointId(k), l);
+      }
+    }
+    for (int l = 0; l < dim; ++l) SetValue(i, l, v[l]);
+  }
+
+  if (verbose) {
+    cout << "  Initialized map values from coarse surface\n";
+    cout.flush();
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper::ReorderFreePoints()
+{
+  const int n = NumberOfFreePoints();
+
+  Array<int> offset(n + 1), index(NumberOfNonZeros()), order;
+  GetSparsityPattern(offset.data(), index.data());
+  ReverseCuthillMcKeeOrdering(n, offset.data(), index.data(), order);
+
+  if (verbose > 1) {
+    cout << "Bandwidth of system matrix = "
+         << Bandwidth(n, offset.data(), index.data()) << " (original), "
+         << Bandwidth(n, offset.data(), index.data(), order.data()) << " (reordered)" << endl;
+  }
+
+  Array<int> free_points(n);
+  for (int i = 0; i < n; ++i) {
+    free_points[i] = _FreePoints[order[i]];
+    _PointIndex[free_points[i]] = i;
+  }
+  _FreePoints.swap(free_points);
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper
+::SetCoupling(const Array<int> &rows, const Array<int> &cols, const Array<double> &weights)
+{
+  const int n = NumberOfFreePoints();
+  _CouplingOffset.clear();
+  _CouplingOffset.resize(n + 1, 0);
+  for (size_t k = 0; k < rows.size(); ++k) {
+    ++_CouplingOffset[rows[k] + 1];
+  }
+  for (int r = 0; r < n; ++r) {
+    _CouplingOffset[r + 1] += _CouplingOffset[r];
+  }
+  _CouplingIndex .resize(rows.size());
+  _CouplingWeight.resize(rows.size());
+  Array<int> pos(_CouplingOffset.begin(), _CouplingOffset.end() - 1);
+  for (size_t k = 0; k < rows.size(); ++k) {
+    const int l = pos[rows[k]]++;
+    _CouplingIndex [l] = cols[k];
+    _CouplingWeight[l] = weights[k];
+  }
 }
 
 // -----------------------------------------------------------------------------
 void LinearFixedBoundarySurfaceMapper::Finalize()
 {
+  // Untangle planar map with flipped triangles
+  if (_FlipFreeRefinement && _TriangleGeometry && _Values && _Values->GetNumberOfComponents() == 2) {
+    MapperStatistics::Timer timer(&_Statistics, "refinement");
+    Array<bool> fixed(NumberOfPoints());
+    for (int i = 0; i < NumberOfPoints(); ++i) {
+      fixed[i] = IsFixedPoint(i);
+    }
+    FlipFreeSurfaceMapRefinement refinement;
+    refinement.Triangles(_TriangleGeometry.get());
+    refinement.Values(_Values);
+    refinement.FixedPoints(fixed);
+    refinement.Run();
+  }
+
   // Assemble surface map
   SharedPtr<PiecewiseLinearMap> map = NewShared<PiecewiseLinearMap>();
   vtkSmartPointer<vtkPolyData> domain;
@@ -156,5 +610,42 @@ void LinearFixedBoundarySurfaceMapper::Finalize()
   FixedBoundarySurfaceMapper::Finalize();
 }
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int LinearFixedBoundarySurfaceMapper::NumberOfNonZeros() const
+{
+  int nnz = 0, d_i;
+  const int *j;
+  for (int r = 0; r < NumberOfFreePoints(); ++r) {
+    _EdgeTable->GetAdjacentPoints(FreePointId(r), d_i, j);
+    for (int k = 0; k < d_i; ++k) {
+      if (IsFreePoint(j[k])) ++nnz;
+    }
+    ++nnz;
+  }
+  return nnz;
+}
+
+// -----------------------------------------------------------------------------
+void LinearFixedBoundarySurfaceMapper::GetSparsityPattern(int *outer, int *inner) const
+{
+  int d_i, c, pos = 0;
+  const int *j;
+  for (int r = 0; r < NumberOfFreePoints(); ++r) {
+    outer[r] = pos;
+    _EdgeTable->GetAdjacentPoints(FreePointId(r), d_i, j);
+    for (int k = 0; k < d_i; ++k) {
+      c = FreePointIndex(j[k]);
+      if (c >= 0) inner[pos++] = c;
+    }
+    inner[pos++] = r;
+    sort(inner + outer[r], inner + pos);
+  }
+  outer[NumberOfFreePoints()] = pos;
+}
+
 
 } // namespace mirtk
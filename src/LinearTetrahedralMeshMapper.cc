@@ -19,16 +19,28 @@
 
 #include "mirtk/LinearTetrahedralMeshMapper.h"
 
+#include "mirtk/Math.h"
 #include "mirtk/Array.h"
+#include "mirtk/Pair.h"
+#include "mirtk/Algorithm.h"
 #include "mirtk/Parallel.h"
+#include "mirtk/DataArrayView.h"
 #include "mirtk/Matrix3x3.h"
 #include "mirtk/Vtk.h"
 #include "mirtk/VtkMath.h"
+#include "mirtk/SparseSolver.h"
+#include "mirtk/BlockSparseMatrix.h"
+#include "mirtk/SparseMatrixOrdering.h"
+#include "mirtk/ReducedBoundaryBasis.h"
+#include "mirtk/PiecewiseLinearMap.h"
 
 #include "vtkNew.h"
 #include "vtkSmartPointer.h"
 #include "vtkPointSet.h"
+#include "vtkPolyData.h"
 #include "vtkPointData.h"
+#include "vtkCellData.h"
+#include "vtkDecimatePro.h"
 #include "vtkIdList.h"
 #include "vtkTetra.h"
 
@@ -50,43 +62,111 @@ MIRTK_Common_EXPORT extern int verbose;
 namespace LinearTetrahedralMeshMapperUtils {
 
 
+/// Maximum number of colors of tetrahedra whose coefficients are added in parallel
+const int MaxNumberOfParallelColors = 64;
+
+// -----------------------------------------------------------------------------
+/// Collect sorted indices of interior points adjacent to each interior point
+struct CollectNeighbors
+{
+  const LinearTetrahedralMeshMapper *_Filter;
+  const int                         *_CellPoints;   ///< Point IDs of each tetrahedron
+  const int                         *_LinkOffset;   ///< Offsets into _Links of each point
+  const int                         *_Links;        ///< IDs of tetrahedra of each point
+  int                               *_Count;        ///< Number of neighbors of each point
+  const int                         *_Offset;       ///< Offsets into _Neighbors if not null
+  int                               *_Neighbors;    ///< Sorted neighbors of each point
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    Array<int> adj;
+    int ptId, cellId, nbrId;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      ptId = _Filter->InteriorPointId()[i];
+      adj.clear();
+      adj.push_back(i);
+      for (int l = _LinkOffset[ptId]; l < _LinkOffset[ptId + 1]; ++l) {
+        cellId = _Links[l];
+        for (int k = 0; k < 4; ++k) {
+          nbrId = _CellPoints[4 * cellId + k];
+          if (!_Filter->IsBoundaryPoint(nbrId)) {
+            adj.push_back(_Filter->InteriorPointPos()[nbrId] / 3);
+          }
+        }
+      }
+      sort(adj.begin(), adj.end());
+      adj.erase(unique(adj.begin(), adj.end()), adj.end());
+      if (_Offset) {
+        copy(adj.begin(), adj.end(), _Neighbors + _Offset[i]);
+      } else {
+        _Count[i] = static_cast<int>(adj.size());
+      }
+    }
+  }
+};
+
 // -----------------------------------------------------------------------------
+/// Add coefficients of tetrahedra directly to compressed storage of linear system
+///
+/// The 3x3 block of coefficients of interior points r and c is either stored
+/// in the columns 3c, 3c+1, 3c+2 of the column-major sparse matrix, where each
+/// of these columns stores the rows of the 3 output dimensions of each interior
+/// point r adjacent to c in sorted order, or as k-th block of block row r of
+/// the block sparse matrix in row-major order. Only tetrahedra which do not share
+/// an interior point are processed in parallel, such that each block column
+/// and right-hand side entry is modified by at most one thread at a time.
 template <class Scalar>
 class LinearSystem
 {
-  const LinearTetrahedralMeshMapper        *_Filter;
-  const LinearTetrahedralMeshMapper        *_Operator;
-  Array<Eigen::Triplet<Scalar> >            _Coefficients;
-  Eigen::Matrix<Scalar, Eigen::Dynamic, 1>  _RightHandSide;
+  const LinearTetrahedralMeshMapper *_Filter;
+  const LinearTetrahedralMeshMapper *_Operator;
+  const int                         *_Cells;
+  Scalar                            *_Coefficients;
+  Scalar                            *_RightHandSide;
+  bool                               _BlockRows;
 
 public:
 
   // ---------------------------------------------------------------------------
   LinearSystem(const LinearTetrahedralMeshMapper *filter,
-               const LinearTetrahedralMeshMapper *map, int n)
-  :
-    _Filter(filter), _Operator(map ? map : filter), _RightHandSide(n)
-  {
-    _RightHandSide.setZero();
-  }
-
-  LinearSystem(const LinearSystem &other, split)
+               const LinearTetrahedralMeshMapper *map,
+               Scalar *coeffs, Scalar *rhs, bool block_rows = false)
   :
-    _Filter(other._Filter), _Operator(other._Operator),
-    _RightHandSide(other._RightHandSide.rows())
-  {
-    _RightHandSide.setZero();
-  }
+    _Filter(filter), _Operator(map ? map : filter),
+    _Cells(filter->ColoredCells().data()),
+    _Coefficients(coeffs), _RightHandSide(rhs),
+    _BlockRows(block_rows)
+  {}
 
   // ---------------------------------------------------------------------------
-  void join(const LinearSystem &other)
+  /// Add (transposed) 3x3 block of coefficients scaled by s in row r, column c
+  void AddBlock(int r, int c, const Matrix3x3 &weight, double s, bool transpose) const
   {
-    _Coefficients.insert(_Coefficients.end(), other._Coefficients.begin(), other._Coefficients.end());
-    _RightHandSide += other._RightHandSide;
+    if (!_Coefficients) return;
+    if (_BlockRows) {
+      const int *begin = _Filter->NeighborIndex().data() + _Filter->NeighborOffset()[r];
+      const int *end   = _Filter->NeighborIndex().data() + _Filter->NeighborOffset()[r + 1];
+      const int  k     = static_cast<int>(lower_bound(begin, end, c) - begin);
+      Scalar    *a     = _Coefficients + 9 * (_Filter->NeighborOffset()[r] + k);
+      for (int i = 0; i < 3; ++i, a += 3)
+      for (int j = 0; j < 3; ++j) {
+        a[j] += static_cast<Scalar>(s * (transpose ? weight[j][i] : weight[i][j]));
+      }
+      return;
+    }
+    const int *begin = _Filter->NeighborIndex().data() + _Filter->NeighborOffset()[c];
+    const int *end   = _Filter->NeighborIndex().data() + _Filter->NeighborOffset()[c + 1];
+    const int  n     = static_cast<int>(end - begin);
+    const int  k     = static_cast<int>(lower_bound(begin, end, r) - begin);
+    Scalar    *a     = _Coefficients + 9 * _Filter->NeighborOffset()[c] + 3 * k;
+    for (int j = 0; j < 3; ++j, a += 3 * n)
+    for (int i = 0; i < 3; ++i) {
+      a[i] += static_cast<Scalar>(s * (transpose ? weight[j][i] : weight[i][j]));
+    }
   }
 
   // ---------------------------------------------------------------------------
-  void AddWeight(vtkIdType ptId0, bool isBoundary0, vtkIdType ptId1, bool isBoundary1, const Matrix3x3 &weight)
+  void AddWeight(vtkIdType ptId0, bool isBoundary0, vtkIdType ptId1, bool isBoundary1, const Matrix3x3 &weight) const
   {
     if (isBoundary0 && isBoundary1) {
 
@@ -100,11 +180,9 @@ public:
       // Pre-multiply coefficient by constant boundary coordinates
       for (int i = 0; i < 3; ++i)
       for (int j = 0; j < 3; ++j) {
-        const double &w = weight[i][j];
-        if (w == .0) continue;
-        _RightHandSide(c + j) -= w * _Filter->Coords()->GetComponent(ptId0, i);
-        _Coefficients.push_back(Eigen::Triplet<Scalar>(c + j, c + i, -w));
+        _RightHandSide[c + j] -= weight[i][j] * _Filter->Coords()->GetComponent(ptId0, i);
       }
+      AddBlock(c / 3, c / 3, weight, -1., true);
 
     } else if (isBoundary1) {
 
@@ -114,43 +192,41 @@ public:
       // Pre-multiply coefficient by constant boundary coordinates
       for (int i = 0; i < 3; ++i)
       for (int j = 0; j < 3; ++j) {
-        const double &w = weight[i][j];
-        if (w == .0) continue;
-        _RightHandSide(r + i) -= w * _Filter->Coords()->GetComponent(ptId1, j);
-        _Coefficients.push_back(Eigen::Triplet<Scalar>(r + i, r + j, -w));
+        _RightHandSide[r + i] -= weight[i][j] * _Filter->Coords()->GetComponent(ptId1, j);
       }
+      AddBlock(r / 3, r / 3, weight, -1., false);
 
     } else {
 
-      // Point variables base indices
-      const int r = _Filter->InteriorPointPos()[ptId0];
-      const int c = _Filter->InteriorPointPos()[ptId1];
+      // Point indices
+      const int r = _Filter->InteriorPointPos()[ptId0] / 3;
+      const int c = _Filter->InteriorPointPos()[ptId1] / 3;
 
       // Add symmetric coefficients
-      for (int i = 0; i < 3; ++i)
-      for (int j = 0; j < 3; ++j) {
-        const double &w = weight[i][j];
-        if (w == .0) continue;
-        _Coefficients.push_back(Eigen::Triplet<Scalar>(r + i, c + j,  w));
-        _Coefficients.push_back(Eigen::Triplet<Scalar>(r + i, r + j, -w));
-        _Coefficients.push_back(Eigen::Triplet<Scalar>(c + j, r + i,  w));
-        _Coefficients.push_back(Eigen::Triplet<Scalar>(c + j, c + i, -w));
-      }
+      AddBlock(r, c, weight,  1., false);
+      AddBlock(r, r, weight, -1., false);
+      AddBlock(c, r, weight,  1., true);
+      AddBlock(c, c, weight, -1., true);
 
     }
   }
 
   // ---------------------------------------------------------------------------
-  void operator ()(const blocked_range<vtkIdType> &cellIds)
+  void operator ()(const blocked_range<int> &re) const
   {
-    vtkIdType i0, i1, i2, i3;
+    vtkIdType cellId, i0, i1, i2, i3;
     bool      b0, b1, b2, b3;
     double    v0[3], v1[3], v2[3], v3[3], volume;
 
+    // Skip remaining tetrahedra when time limit exceeded or run cancelled
+    MapperObserver * const observer = _Filter->Observer();
+    if (observer && !observer->Continue()) return;
+
     vtkPointSet * const pointset = _Filter->Volume();
     vtkNew<vtkIdList> ptIds;
 
-    for (vtkIdType cellId = cellIds.begin(); cellId != cellIds.end(); ++cellId) {
+    for (int idx = re.begin(); idx != re.end(); ++idx) {
+      cellId = static_cast<vtkIdType>(_Cells[idx]);
       GetCellPoints(pointset, cellId, ptIds.GetPointer());
 
       i0 = ptIds->GetId(0);
@@ -163,6 +239,9 @@ public:
       b2 = _Filter->IsBoundaryPoint(i2);
       b3 = _Filter->IsBoundaryPoint(i3);
 
+      // Only tetrahedra with boundary points contribute to right-hand side
+      if (!_Coefficients && !(b0 || b1 || b2 || b3)) continue;
+
       pointset->GetPoint(i0, v0);
       pointset->GetPoint(i1, v1);
       pointset->GetPoint(i2, v2);
@@ -186,12 +265,78 @@ public:
                     Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &b,
                     int                                       n)
   {
-    LinearSystem problem(filter, mapop, n);
-    blocked_range<vtkIdType> cellIds(0, filter->Volume()->GetNumberOfCells());
-    parallel_reduce(cellIds, problem);
+    const Array<int> &offset = filter->NeighborOffset();
+    const Array<int> &index  = filter->NeighborIndex();
+    const int         np     = n / 3;
+
+    // Allocate compressed storage with pre-computed sparsity pattern
     A.resize(n, n);
-    A.setFromTriplets(problem._Coefficients.begin(), problem._Coefficients.end());
-    b = problem._RightHandSide;
+    A.resizeNonZeros(9 * offset[np]);
+    int *outer = A.outerIndexPtr();
+    int *inner = A.innerIndexPtr();
+    for (int c = 0; c < np; ++c) {
+      const int deg = offset[c + 1] - offset[c];
+      for (int j = 0; j < 3; ++j) {
+        *outer++ = 9 * offset[c] + 3 * j * deg;
+        for (int k = offset[c]; k < offset[c + 1]; ++k)
+        for (int i = 0; i < 3; ++i) {
+          *inner++ = 3 * index[k] + i;
+        }
+      }
+    }
+    *outer = 9 * offset[np];
+    Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, 1> >(A.valuePtr(), A.nonZeros()).setZero();
+    b.resize(n);
+    b.setZero();
+
+    // Add coefficients of tetrahedra
+    LinearSystem problem(filter, mapop, A.valuePtr(), b.data());
+    problem.Run();
+  }
+
+  // ---------------------------------------------------------------------------
+  static void Build(const LinearTetrahedralMeshMapper        *filter,
+                    const LinearTetrahedralMeshMapper        *mapop,
+                    BlockSparseMatrix3                       &A,
+                    Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &b,
+                    int                                       n)
+  {
+    // Allocate block sparse storage with pre-computed sparsity pattern
+    A.Initialize(n / 3, filter->NeighborOffset(), filter->NeighborIndex());
+    b.resize(n);
+    b.setZero();
+
+    // Add coefficients of tetrahedra
+    LinearSystem problem(filter, mapop, A.Block(0), b.data(), true);
+    problem.Run();
+  }
+
+  // ---------------------------------------------------------------------------
+  static void BuildRightHandSide(const LinearTetrahedralMeshMapper        *filter,
+                                 const LinearTetrahedralMeshMapper        *mapop,
+                                 Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &b,
+                                 int                                       n)
+  {
+    b.resize(n);
+    b.setZero();
+    LinearSystem problem(filter, mapop, nullptr, b.data());
+    problem.Run();
+  }
+
+  // ---------------------------------------------------------------------------
+  /// Add coefficients of tetrahedra of each color
+  void Run() const
+  {
+    const Array<int> &colors = _Filter->ColorOffset();
+    const int         ncolor = static_cast<int>(colors.size()) - 1;
+    for (int k = 0; k < ncolor; ++k) {
+      blocked_range<int> cells(colors[k], colors[k + 1]);
+      if (k == MaxNumberOfParallelColors) {
+        (*this)(cells);
+      } else {
+        parallel_for(cells, *this);
+      }
+    }
   }
 };
 
@@ -207,19 +352,36 @@ using namespace LinearTetrahedralMeshMapperUtils;
 void LinearTetrahedralMeshMapper
 ::CopyAttributes(const LinearTetrahedralMeshMapper &other)
 {
+  _Solver             = other._Solver;
+  _MixedPrecision     = other._MixedPrecision;
   _NumberOfIterations = other._NumberOfIterations;
   _Tolerance          = other._Tolerance;
   _RelaxationFactor   = other._RelaxationFactor;
+  _NumberOfLevels     = other._NumberOfLevels;
+  _LevelReduction     = other._LevelReduction;
+  _ReorderPoints      = other._ReorderPoints;
+  _NumberOfSubdomains = other._NumberOfSubdomains;
+  _BoundaryBasis      = other._BoundaryBasis;
   _InteriorPointId    = other._InteriorPointId;
   _InteriorPointPos   = other._InteriorPointPos;
+  _NeighborOffset     = other._NeighborOffset;
+  _NeighborIndex      = other._NeighborIndex;
+  _ColorOffset        = other._ColorOffset;
+  _ColoredCells       = other._ColoredCells;
 }
 
 // -----------------------------------------------------------------------------
 LinearTetrahedralMeshMapper::LinearTetrahedralMeshMapper()
 :
+  _Solver(SparseSolver_CG),
+  _MixedPrecision(false),
   _NumberOfIterations(0),
   _Tolerance(.0),
-  _RelaxationFactor(1.0)
+  _RelaxationFactor(1.0),
+  _NumberOfLevels(1),
+  _LevelReduction(.75),
+  _ReorderPoints(true),
+  _NumberOfSubdomains(0)
 {
 }
 
@@ -258,6 +420,7 @@ void LinearTetrahedralMeshMapper::Initialize()
 
   // Initialize base class
   TetrahedralMeshMapper::Initialize();
+  _BoundaryBasis = nullptr;
 
   // Force number of output map components to be equal to dim
   if (_Coords->GetNumberOfComponents() != dim) {
@@ -292,6 +455,554 @@ void LinearTetrahedralMeshMapper::Initialize()
     _InteriorPointPos[ptId] = dim * i;
     ++i;
   }
+
+  // Pre-compute sparsity pattern of linear system
+  InitializeSparsityPattern();
+  if (_ReorderPoints && _NumberOfInteriorPoints > 1) {
+    ReorderInteriorPoints();
+  }
+
+  // Initial guess of iterative solver from map of coarser volume, unless the
+  // map of the previous mesh is used as initial guess after adaptive refinement
+  if (_NumberOfLevels > 1 && _NumberOfInteriorPoints > 0 && !_RefinedVolume &&
+      (_Solver == SparseSolver_Default || !IsDirectSolver(_Solver))) {
+    InitializeCoordsFromCoarseLevel();
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper::InitializeSparsityPattern()
+{
+  const int ncells = static_cast<int>(_Volume->GetNumberOfCells());
+
+  // Point IDs of tetrahedra and IDs of tetrahedra with interior points
+  Array<int> cellPts(4 * ncells);
+  Array<int> linkOffset(_NumberOfPoints + 1, 0);
+  vtkNew<vtkIdList> ptIds;
+  for (int cellId = 0; cellId < ncells; ++cellId) {
+    GetCellPoints(_Volume, cellId, ptIds.GetPointer());
+    if (ptIds->GetNumberOfIds() != 4) {
+      cerr << this->NameOfType() << "::InitializeSparsityPattern: Volume mesh must consist of tetrahedra only" << endl;
+      exit(1);
+    }
+    for (int k = 0; k < 4; ++k) {
+      cellPts[4 * cellId + k] = static_cast<int>(ptIds->GetId(k));
+      ++linkOffset[cellPts[4 * cellId + k] + 1];
+    }
+  }
+  for (int ptId = 0; ptId < _NumberOfPoints; ++ptId) {
+    linkOffset[ptId + 1] += linkOffset[ptId];
+  }
+  Array<int> links(linkOffset[_NumberOfPoints]);
+  {
+    Array<int> pos(linkOffset.begin(), linkOffset.end() - 1);
+    for (int cellId = 0; cellId < ncells; ++cellId) {
+      for (int k = 0; k < 4; ++k) {
+        links[pos[cellPts[4 * cellId + k]]++] = cellId;
+      }
+    }
+  }
+
+  // Sorted interior points adjacent to each interior point
+  _NeighborOffset.resize(_NumberOfInteriorPoints + 1);
+  CollectNeighbors eval;
+  eval._Filter     = this;
+  eval._CellPoints = cellPts.data();
+  eval._LinkOffset = linkOffset.data();
+  eval._Links      = links.data();
+  eval._Count      = _NeighborOffset.data() + 1;
+  eval._Offset     = nullptr;
+  eval._Neighbors  = nullptr;
+  parallel_for(blocked_range<int>(0, _NumberOfInteriorPoints), eval);
+  _NeighborOffset[0] = 0;
+  for (int i = 0; i < _NumberOfInteriorPoints; ++i) {
+    _NeighborOffset[i + 1] += _NeighborOffset[i];
+  }
+  _NeighborIndex.resize(_NeighborOffset[_NumberOfInteriorPoints]);
+  eval._Offset    = _NeighborOffset.data();
+  eval._Neighbors = _NeighborIndex.data();
+  parallel_for(blocked_range<int>(0, _NumberOfInteriorPoints), eval);
+
+  // Greedy coloring of tetrahedra with at least one interior point such that
+  // no two tetrahedra of the same color share an interior point, where those
+  // which cannot be colored with the available colors get the last color
+  const int ncolors = MaxNumberOfParallelColors + 1;
+  Array<unsigned long long> used(_NumberOfPoints, 0);
+  Array<int>                color(ncells, -1);
+  unsigned long long        mask;
+  int                       ptId;
+  _ColorOffset.clear();
+  _ColorOffset.resize(ncolors + 1, 0);
+  for (int cellId = 0; cellId < ncells; ++cellId) {
+    bool interior = false;
+    mask = 0;
+    for (int k = 0; k < 4; ++k) {
+      ptId = cellPts[4 * cellId + k];
+      if (!IsBoundaryPoint(ptId)) {
+        mask |= used[ptId];
+        interior = true;
+      }
+    }
+    if (!interior) continue;
+    int c = 0;
+    while (c < MaxNumberOfParallelColors && (mask & (1ull << c)) != 0) ++c;
+    color[cellId] = c;
+    if (c < MaxNumberOfParallelColors) {
+      for (int k = 0; k < 4; ++k) {
+        ptId = cellPts[4 * cellId + k];
+        if (!IsBoundaryPoint(ptId)) used[ptId] |= (1ull << c);
+      }
+    }
+    ++_ColorOffset[c + 1];
+  }
+  while (_ColorOffset.size() > 1 && _ColorOffset.back() == 0) {
+    _ColorOffset.pop_back();
+  }
+  for (size_t c = 1; c < _ColorOffset.size(); ++c) {
+    _ColorOffset[c] += _ColorOffset[c - 1];
+  }
+  _ColoredCells.resize(_ColorOffset.back());
+  {
+    Array<int> pos(_ColorOffset.begin(), _ColorOffset.end() - 1);
+    for (int cellId = 0; cellId < ncells; ++cellId) {
+      if (color[cellId] >= 0) _ColoredCells[pos[color[cellId]]++] = cellId;
+    }
+  }
+
+  if (verbose > 1) {
+    cout << "No. of non-zero 3x3 blocks = " << _NeighborIndex.size() << "\n";
+    cout << "No. of tetrahedra colors   = " << _ColorOffset.size() - 1 << endl;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper::ReorderInteriorPoints()
+{
+  const int dim = 3;
+  const int n   = _NumberOfInteriorPoints;
+
+  Array<int> order, rank(n);
+  ReverseCuthillMcKeeOrdering(n, _NeighborOffset.data(), _NeighborIndex.data(), order);
+  for (int i = 0; i < n; ++i) rank[order[i]] = i;
+
+  if (verbose > 1) {
+    cout << "Bandwidth of block pattern = "
+         << Bandwidth(n, _NeighborOffset.data(), _NeighborIndex.data()) << " (original), "
+         << Bandwidth(n, _NeighborOffset.data(), _NeighborIndex.data(), order.data()) << " (reordered)" << endl;
+  }
+
+  // Permute block sparsity pattern
+  Array<int> offset(n + 1), index(_NeighborIndex.size());
+  offset[0] = 0;
+  for (int i = 0; i < n; ++i) {
+    const int r = order[i];
+    int pos = offset[i];
+    for (int k = _NeighborOffset[r]; k < _NeighborOffset[r + 1]; ++k) {
+      index[pos++] = rank[_NeighborIndex[k]];
+    }
+    sort(index.begin() + offset[i], index.begin() + pos);
+    offset[i + 1] = pos;
+  }
+  _NeighborOffset.swap(offset);
+  _NeighborIndex .swap(index);
+
+  // Renumber interior points
+  Array<int> ids(n);
+  for (int i = 0; i < n; ++i) {
+    ids[i] = _InteriorPointId[order[i]];
+    _InteriorPointPos[ids[i]] = dim * i;
+  }
+  _InteriorPointId.swap(ids);
+
+  // Sort tetrahedra of each color by their first interior point such that
+  // the coefficients of consecutively processed tetrahedra are close in memory
+  vtkNew<vtkIdList> ptIds;
+  Array<Pair<int, int> > cells;
+  for (size_t c = 0; c + 1 < _ColorOffset.size(); ++c) {
+    cells.resize(_ColorOffset[c + 1] - _ColorOffset[c]);
+    for (int k = _ColorOffset[c], l = 0; k < _ColorOffset[c + 1]; ++k, ++l) {
+      GetCellPoints(_Volume, _ColoredCells[k], ptIds.GetPointer());
+      int first = n;
+      for (vtkIdType j = 0; j < ptIds->GetNumberOfIds(); ++j) {
+        const int pos = _InteriorPointPos[ptIds->GetId(j)];
+        if (pos >= 0) first = min(first, pos / dim);
+      }
+      cells[l] = MakePair(first, _ColoredCells[k]);
+    }
+    sort(cells.begin(), cells.end());
+    for (int k = _ColorOffset[c], l = 0; k < _ColorOffset[c + 1]; ++k, ++l) {
+      _ColoredCells[k] = cells[l].second;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool LinearTetrahedralMeshMapper::InitializeCoordsFromCoarseLevel()
+{
+  const int dim = 3; // Dimension of output domain
+
+  // Decimate boundary surface, keeping the map values of remaining points
+  vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+  surface->ShallowCopy(_Boundary);
+  surface->GetCellData ()->Initialize();
+  surface->GetPointData()->Initialize();
+  const int map_index = surface->GetPointData()->AddArray(_BoundaryMap);
+
+  vtkNew<vtkDecimatePro> decimator;
+  SetVTKInput(decimator, surface);
+  decimator->SetTargetReduction(max(.0, min(_LevelReduction, .99)));
+  decimator->PreserveTopologyOn();
+  decimator->SplittingOff();
+  decimator->Update();
+
+  vtkSmartPointer<vtkPolyData> coarse = decimator->GetOutput();
+  vtkSmartPointer<vtkDataArray> coarse_map = coarse->GetPointData()->GetArray(map_index);
+  if (!coarse_map || coarse->GetNumberOfPoints() < 4 ||
+      coarse->GetNumberOfPoints() > .9 * _Boundary->GetNumberOfPoints()) {
+    return false;
+  }
+
+  // Compute map of tetrahedralized coarse volume using this filter
+  vtkSmartPointer<vtkPointSet>   input_set       = _InputSet;
+  vtkSmartPointer<vtkDataArray>  input_map       = _InputMap;
+  vtkSmartPointer<vtkDataArray>  input_mask      = _InputMask;
+  vtkSmartPointer<vtkPolyData>   boundary        = _Boundary;
+  vtkSmartPointer<vtkDataArray>  boundary_map    = _BoundaryMap;
+  vtkSmartPointer<vtkPointSet>   volume          = _Volume;
+  vtkSmartPointer<vtkDataArray>  coords          = _Coords;
+  vtkSmartPointer<vtkDataArray>  boundary_mask   = _BoundaryMask;
+  const int                      npoints         = _NumberOfPoints;
+  const int                      nboundary       = _NumberOfBoundaryPoints;
+  const int                      ninterior       = _NumberOfInteriorPoints;
+  Array<int>                     interior_id     = _InteriorPointId;
+  Array<int>                     interior_pos    = _InteriorPointPos;
+  Array<int>                     nbr_offset      = _NeighborOffset;
+  Array<int>                     nbr_index       = _NeighborIndex;
+  Array<int>                     color_offset    = _ColorOffset;
+  Array<int>                     colored_cells   = _ColoredCells;
+  SharedPtr<SparseFactorization> factorization   = _Factorization;
+  SharedPtr<BlockSparseMatrix3>  block_matrix    = _BlockMatrix;
+  SharedPtr<BlockSchwarzPreconditioner> block_precond = _BlockPreconditioner;
+
+  if (verbose) {
+    cout << "\nComputing map of coarse volume with " << coarse->GetNumberOfPoints() << " boundary points..." << endl;
+  }
+  _InputSet      = coarse;
+  _InputMap      = coarse_map;
+  _InputMask     = nullptr;
+  _Factorization = nullptr;
+  _BlockMatrix   = nullptr;
+  _BlockPreconditioner = nullptr;
+  --_NumberOfLevels;
+  this->Initialize();
+  this->Solve();
+  ++_NumberOfLevels;
+  PiecewiseLinearMap coarse_volume_map;
+  coarse_volume_map.Domain(_Volume);
+  coarse_volume_map.Values(_Coords);
+  coarse_volume_map.Initialize();
+
+  _InputSet               = input_set;
+  _InputMap               = input_map;
+  _InputMask              = input_mask;
+  _Boundary               = boundary;
+  _BoundaryMap            = boundary_map;
+  _Volume                 = volume;
+  _Coords                 = coords;
+  _BoundaryMask           = boundary_mask;
+  _NumberOfPoints         = npoints;
+  _NumberOfBoundaryPoints = nboundary;
+  _NumberOfInteriorPoints = ninterior;
+  _InteriorPointId        = interior_id;
+  _InteriorPointPos       = interior_pos;
+  _NeighborOffset         = nbr_offset;
+  _NeighborIndex          = nbr_index;
+  _ColorOffset            = color_offset;
+  _ColoredCells           = colored_cells;
+  _Factorization          = factorization;
+  _BlockMatrix            = block_matrix;
+  _BlockPreconditioner    = block_precond;
+
+  // Interpolate coarse map at interior points inside the coarse volume
+  int    ninside = 0;
+  double p[3], v[dim];
+  for (int i = 0; i < _NumberOfInteriorPoints; ++i) {
+    _Volume->GetPoint(_InteriorPointId[i], p);
+    if (coarse_volume_map.Evaluate(v, p)) {
+      for (int j = 0; j < dim; ++j) {
+        _Coords->SetComponent(_InteriorPointId[i], j, v[j]);
+      }
+      ++ninside;
+    }
+  }
+
+  if (verbose) {
+    cout << "Initialized map at " << ninside << " of " << _NumberOfInteriorPoints
+         << " interior points from coarse volume" << endl;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper
+::CheckBoundaryValues(vtkDataArray *values, const char *func) const
+{
+  const int dim = 3;
+
+  if (!_Volume || !_Coords || !_BoundaryMask ||
+      (!_BlockMatrix && !(_Factorization && _Factorization->HasMatrix()))) {
+    cerr << this->NameOfType() << "::" << func << ": Map must be computed by Run first" << endl;
+    exit(1);
+  }
+  if (!values || values->GetNumberOfComponents() < dim) {
+    cerr << this->NameOfType() << "::" << func << ": Boundary values must have "
+         << dim << " components" << endl;
+    exit(1);
+  }
+  const vtkIdType nvalues = values->GetNumberOfTuples();
+  if (nvalues != static_cast<vtkIdType>(_NumberOfPoints)) {
+    if (!_InputSet || nvalues != _InputSet->GetNumberOfPoints()) {
+      cerr << this->NameOfType() << "::" << func << ": Number of values must match"
+              " either the number of volume points or the number of input points" << endl;
+      exit(1);
+    }
+    for (vtkIdType ptId = nvalues; ptId < static_cast<vtkIdType>(_NumberOfPoints); ++ptId) {
+      if (IsBoundaryPoint(ptId)) {
+        cerr << this->NameOfType() << "::" << func << ": Volume has boundary points"
+                " which are not input points, values must be given for all volume points" << endl;
+        exit(1);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper::GetBoundaryValues(vtkDataArray *values, double *g) const
+{
+  const int dim = 3;
+  const DataArrayView view(values);
+  for (int ptId = 0; ptId < _NumberOfPoints; ++ptId) {
+    if (IsBoundaryPoint(ptId)) {
+      for (int j = 0; j < dim; ++j, ++g) {
+        *g = view.Get(ptId, j);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper::RunWithBoundaryValues(vtkDataArray *values)
+{
+  const int dim = 3;
+
+  // Check that values are given for all boundary points
+  CheckBoundaryValues(values, "RunWithBoundaryValues");
+  const vtkIdType nvalues = values->GetNumberOfTuples();
+
+  _Statistics.Clear();
+  _Statistics.Mapper(this->NameOfClass());
+  if (_Observer) _Observer->Start();
+  MapperStatistics::Timer run(&_Statistics, "run");
+
+  // Copy map values such that previous output remains valid
+  vtkSmartPointer<vtkPointSet>  volume;
+  vtkSmartPointer<vtkDataArray> coords;
+  coords.TakeReference(_Coords->NewInstance());
+  coords->DeepCopy(_Coords);
+  volume.TakeReference(_Volume->NewInstance());
+  volume->ShallowCopy(_Volume);
+  volume->GetPointData()->Initialize();
+  volume->GetPointData()->AddArray(coords);
+  volume->GetPointData()->AddArray(_BoundaryMask);
+  _Volume = volume;
+  _Coords = coords;
+
+  // Set new values of boundary points
+  const DataArrayView src(values), dst(_Coords);
+  for (vtkIdType ptId = 0; ptId < nvalues; ++ptId) {
+    if (IsBoundaryPoint(ptId)) {
+      for (int j = 0; j < dim; ++j) {
+        dst.Set(ptId, j, src.Get(ptId, j));
+      }
+    }
+  }
+
+  // Parameterize interior points and replace output map
+  _Output = nullptr;
+  if (!_Observer || _Observer->Continue()) {
+    MapperStatistics::Timer timer(&_Statistics, "compute");
+    this->Resolve();
+  }
+  {
+    MapperStatistics::Timer timer(&_Statistics, "finalize");
+    this->Finalize();
+  }
+  run.Stop();
+  _Statistics.Status(_Observer ? _Observer->Status() : MapperStatus_Completed);
+  _Statistics.UpdatePeakMemory();
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper
+::PrecomputeBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &maps,
+                          int max_modes, double energy)
+{
+  typedef Eigen::MatrixXd Matrix;
+
+  const int dim = 3;
+  const int m   = dim * _NumberOfBoundaryPoints;
+  const int n   = dim * _NumberOfInteriorPoints;
+  const int s   = static_cast<int>(maps.size());
+
+  if (s == 0) {
+    cerr << this->NameOfType() << "::PrecomputeBoundaryBasis: No sample boundary maps given" << endl;
+    exit(1);
+  }
+
+  // Compute mean and principal modes of sample boundary maps
+  Matrix samples(m, s);
+  for (int k = 0; k < s; ++k) {
+    CheckBoundaryValues(maps[k], "PrecomputeBoundaryBasis");
+    GetBoundaryValues(maps[k], samples.col(k).data());
+  }
+  SharedPtr<ReducedBoundaryBasis> basis = NewShared<ReducedBoundaryBasis>();
+  basis->Initialize(samples, max_modes, energy);
+  samples.resize(0, 0);
+
+  const Matrix f = basis->Functions();
+  const int    c = static_cast<int>(f.cols());
+  if (verbose) {
+    cout << "\nBoundary basis has " << basis->NumberOfModes() << " principal modes of "
+         << s << " sample maps explaining " << 100.0 * basis->ExplainedVariance()
+         << "% of their variance" << endl;
+  }
+
+  // Right-hand side of linear system for each boundary function
+  Eigen::VectorXd g(m), rhs;
+  Matrix b(n, c), x(n, c);
+  GetBoundaryValues(_Coords, g.data());
+  const DataArrayView coords(_Coords);
+  for (int k = 0; k < c; ++k) {
+    for (int ptId = 0, i = 0; ptId < _NumberOfPoints; ++ptId) {
+      if (IsBoundaryPoint(ptId)) {
+        for (int j = 0; j < dim; ++j, ++i) {
+          coords.Set(ptId, j, f(i, k));
+        }
+      }
+    }
+    LinearSystem<double>::BuildRightHandSide(this, this, rhs, n);
+    b.col(k) = rhs;
+  }
+  for (int ptId = 0, i = 0; ptId < _NumberOfPoints; ++ptId) {
+    if (IsBoundaryPoint(ptId)) {
+      for (int j = 0; j < dim; ++j, ++i) {
+        coords.Set(ptId, j, g(i));
+      }
+    }
+  }
+
+  // Solve linear system for all boundary functions
+  if (verbose) cout << "Solve system for " << c << " boundary functions...", cout.flush();
+  x.setZero();
+  if (_BlockMatrix) {
+    for (int k = 0; k < c; ++k) {
+      SolveBlockSystem(b.col(k).data(), x.col(k).data());
+    }
+  } else {
+    _Factorization->Resolve(b, x, _NumberOfIterations, _Tolerance, false);
+  }
+  if (verbose) cout << " done" << endl;
+
+  basis->Response(x);
+  _BoundaryBasis = basis;
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper
+::EvaluateBoundaryBasis(const Array<vtkSmartPointer<vtkDataArray> > &values,
+                        Array<vtkSmartPointer<vtkDataArray> >       &coords,
+                        double *error) const
+{
+  const int dim = 3;
+  const int m   = dim * _NumberOfBoundaryPoints;
+  const int c   = static_cast<int>(values.size());
+
+  if (!_BoundaryBasis || !_BoundaryBasis->HasResponse()) {
+    cerr << this->NameOfType() << "::EvaluateBoundaryBasis: Boundary basis must be"
+            " computed by PrecomputeBoundaryBasis first" << endl;
+    exit(1);
+  }
+
+  // Interior values as linear combination of responses of boundary functions
+  Eigen::MatrixXd g(m, c), x;
+  for (int k = 0; k < c; ++k) {
+    CheckBoundaryValues(values[k], "EvaluateBoundaryBasis");
+    GetBoundaryValues(values[k], g.col(k).data());
+  }
+  _BoundaryBasis->Evaluate(g, x, error);
+
+  // Assemble map values at all volume points
+  coords.resize(c);
+  for (int k = 0; k < c; ++k) {
+    vtkSmartPointer<vtkDataArray> &map = coords[k];
+    map.TakeReference(_Coords->NewInstance());
+    map->SetName(_Coords->GetName());
+    map->SetNumberOfComponents(dim);
+    map->SetNumberOfTuples(_NumberOfPoints);
+    const DataArrayView view(map);
+    for (int ptId = 0, i = 0; ptId < _NumberOfPoints; ++ptId) {
+      if (IsBoundaryPoint(ptId)) {
+        for (int j = 0; j < dim; ++j, ++i) {
+          view.Set(ptId, j, g(i, k));
+        }
+      }
+    }
+    for (int i = 0, r = 0; i < _NumberOfInteriorPoints; ++i, r += dim) {
+      for (int j = 0; j < dim; ++j) {
+        view.Set(_InteriorPointId[i], j, x(r + j, k));
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper::RunWithBoundaryBasis(vtkDataArray *values)
+{
+  Array<vtkSmartPointer<vtkDataArray> > input(1, values), output;
+  double error = .0;
+  EvaluateBoundaryBasis(input, output, &error);
+  if (verbose) {
+    cout << "\nRelative residual of boundary map projection = " << error << endl;
+  }
+
+  vtkSmartPointer<vtkPointSet> volume;
+  volume.TakeReference(_Volume->NewInstance());
+  volume->ShallowCopy(_Volume);
+  volume->GetPointData()->Initialize();
+  volume->GetPointData()->AddArray(output[0]);
+  volume->GetPointData()->AddArray(_BoundaryMask);
+  _Volume = volume;
+  _Coords = output[0];
+
+  _Output = nullptr;
+  this->Finalize();
+}
+
+// -----------------------------------------------------------------------------
+bool LinearTetrahedralMeshMapper::Refine()
+{
+  // Factorization and matrix of previous mesh cannot be reused
+  SharedPtr<SparseFactorization> factorization = _Factorization;
+  SharedPtr<BlockSparseMatrix3>  block_matrix  = _BlockMatrix;
+  SharedPtr<BlockSchwarzPreconditioner> block_precond = _BlockPreconditioner;
+  _Factorization = nullptr;
+  _BlockMatrix   = nullptr;
+  _BlockPreconditioner = nullptr;
+  if (TetrahedralMeshMapper::Refine()) return true;
+  _Factorization = factorization;
+  _BlockMatrix   = block_matrix;
+  _BlockPreconditioner = block_precond;
+  return false;
 }
 
 // -----------------------------------------------------------------------------
@@ -307,7 +1018,6 @@ void LinearTetrahedralMeshMapper
   typedef double                                   Scalar;
   typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
   typedef Eigen::SparseMatrix<Scalar>              Matrix;
-  typedef Eigen::DiagonalPreconditioner<Scalar>    Preconditioner;
 
   const int dim = 3;                             // Dimension of output domain
   const int n   = dim * _NumberOfInteriorPoints; // Size of linear system
@@ -317,37 +1027,152 @@ void LinearTetrahedralMeshMapper
 
   // Use current parameterization of interior points as initial guess
   x.resize(n);
+  const DataArrayView coords(_Coords);
   for (int i = 0, r = 0; i < _NumberOfInteriorPoints; ++i) {
     for (int j = 0; j < dim; ++j, ++r) {
-      x(r) = static_cast<Scalar>(_Coords->GetComponent(_InteriorPointId[i], j));
+      x(r) = static_cast<Scalar>(coords.Get(_InteriorPointId[i], j));
     }
   }
 
+  // Conjugate gradient solver with block Jacobi preconditioner working
+  // directly on the 3x3 block sparse matrix, unless mixed precision is used
+  const bool use_block_solver = (_Solver == SparseSolver_CG && !_MixedPrecision);
+
   // Build linear system
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
   if (verbose) cout << "\nBuilding linear system...", cout.flush();
-  LinearSystem<Scalar>::Build(this, mapop, A, b, n);
+  _BlockPreconditioner = nullptr;
+  if (use_block_solver) {
+    _BlockMatrix = NewShared<BlockSparseMatrix3>();
+    LinearSystem<Scalar>::Build(this, mapop, *_BlockMatrix, b, n);
+  } else {
+    _BlockMatrix = nullptr;
+    LinearSystem<Scalar>::Build(this, mapop, A, b, n);
+  }
+  assembly.Stop();
+  if (_Observer && !_Observer->Continue()) {
+    // Keep current parameterization when linear system is incomplete
+    if (verbose) cout << " stopped: " << ToString(_Observer->Status()) << endl;
+    _BlockMatrix = nullptr;
+    return;
+  }
   if (verbose) cout << " done" << endl;
 
   // Solve linear system
-  if (verbose) cout << "Solve system using conjugate gradient...", cout.flush();
-  Eigen::ConjugateGradient<Matrix, Eigen::Upper|Eigen::Lower, Preconditioner> solver(A);
-  if (_NumberOfIterations >  0) solver.setMaxIterations(_NumberOfIterations);
-  if (_Tolerance          > .0) solver.setTolerance(_Tolerance);
-  x = solver.solveWithGuess(b, x);
+  if (verbose) cout << "Solve system using " << ToString(_Solver) << " solver...", cout.flush();
+  SparseSolverType solver = _Solver;
+  int              niter  = 0;
+  double           error  = .0;
+  if (use_block_solver) {
+    if (_NumberOfSubdomains > 1) {
+      MapperStatistics::Timer timer(&_Statistics, "factorization");
+      _BlockPreconditioner = NewShared<BlockSchwarzPreconditioner>();
+      if (!_BlockPreconditioner->Initialize(*_BlockMatrix, _NumberOfSubdomains)) {
+        _BlockPreconditioner = nullptr;
+      }
+    }
+    MapperStatistics::Timer timer(&_Statistics, "solve");
+    SolveBlockSystem(b.data(), x.data(), &niter, &error, _Observer);
+    timer.Stop();
+    _Statistics.AddLinearSolve(ToString(solver), n, 9 * int64_t(_BlockMatrix->NumberOfBlocks()), niter, error);
+  } else {
+    if (!_Factorization) _Factorization = NewShared<SparseFactorization>();
+    _Factorization->BlockSize(dim);
+    _Factorization->MixedPrecision(_MixedPrecision);
+    _Factorization->Statistics(&_Statistics);
+    _Factorization->Observer(_Observer);
+    solver = _Factorization->Solve(_Solver, SparseMatrix_SPD, false, A, b, x,
+                                   _NumberOfIterations, _Tolerance, true,
+                                   &niter, &error);
+  }
   if (verbose) {
     cout << " done" << endl;
-    cout << "\nNo. of iterations = " << solver.iterations();
-    cout << "\nEstimated error   = " << solver.error();
-    cout << endl;
+    if (!IsDirectSolver(solver)) {
+      cout << "\nNo. of iterations = " << niter;
+      cout << "\nEstimated error   = " << error;
+      cout << endl;
+    }
   }
 
   // Update parameterization of interior points
   for (int i = 0, r = 0; i < _NumberOfInteriorPoints; ++i, r += dim) {
     for (int j = 0; j < dim; ++j) {
-      _Coords->SetComponent(_InteriorPointId[i], j, static_cast<double>(x(r + j)));
+      coords.Set(_InteriorPointId[i], j, static_cast<double>(x(r + j)));
     }
   }
 }
 
+// -----------------------------------------------------------------------------
+void LinearTetrahedralMeshMapper::Resolve()
+{
+  typedef double                                   Scalar;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+  const int dim = 3;                             // Dimension of output domain
+  const int n   = dim * _NumberOfInteriorPoints; // Size of linear system
+
+  // Use current parameterization of interior points as initial guess
+  Vector x(n), b;
+  const DataArrayView coords(_Coords);
+  for (int i = 0, r = 0; i < _NumberOfInteriorPoints; ++i) {
+    for (int j = 0; j < dim; ++j, ++r) {
+      x(r) = static_cast<Scalar>(coords.Get(_InteriorPointId[i], j));
+    }
+  }
+
+  // Rebuild only right-hand side of linear system
+  if (verbose) cout << "\nBuilding right-hand side of linear system...", cout.flush();
+  LinearSystem<Scalar>::BuildRightHandSide(this, this, b, n);
+  if (_Observer && !_Observer->Continue()) {
+    if (verbose) cout << " stopped: " << ToString(_Observer->Status()) << endl;
+    return;
+  }
+  if (verbose) cout << " done" << endl;
+
+  // Solve linear system using previous matrix and factorization
+  SparseSolverType solver = _Solver;
+  int              niter  = 0;
+  double           error  = .0;
+  if (verbose) cout << "Solve system using " << ToString(_Solver) << " solver...", cout.flush();
+  if (_BlockMatrix) {
+    MapperStatistics::Timer timer(&_Statistics, "solve");
+    SolveBlockSystem(b.data(), x.data(), &niter, &error, _Observer);
+    timer.Stop();
+    _Statistics.AddLinearSolve(ToString(solver), n, 9 * int64_t(_BlockMatrix->NumberOfBlocks()), niter, error);
+  } else {
+    _Factorization->Statistics(&_Statistics);
+    _Factorization->Observer(_Observer);
+    solver = _Factorization->Resolve(b, x, _NumberOfIterations, _Tolerance, true, &niter, &error);
+  }
+  if (verbose) {
+    cout << " done" << endl;
+    if (!IsDirectSolver(solver)) {
+      cout << "\nNo. of iterations = " << niter;
+      cout << "\nEstimated error   = " << error;
+      cout << endl;
+    }
+  }
+
+  // Update parameterization of interior points
+  for (int i = 0, r = 0; i < _NumberOfInteriorPoints; ++i, r += dim) {
+    for (int j = 0; j < dim; ++j) {
+      coords.Set(_InteriorPointId[i], j, static_cast<double>(x(r + j)));
+    }
+  }
+}
+
+
+// -----------------------------------------------------------------------------
+bool LinearTetrahedralMeshMapper
+::SolveBlockSystem(const double *b, double *x, int *niter, double *error,
+                   MapperObserver *observer) const
+{
+  if (_BlockPreconditioner) {
+    return ConjugateGradient(*_BlockMatrix, *_BlockPreconditioner, b, x,
+                             _NumberOfIterations, _Tolerance, niter, error, observer);
+  }
+  return ConjugateGradient(*_BlockMatrix, b, x, _NumberOfIterations, _Tolerance,
+                           niter, error, observer);
+}
 
 } // namespace mirtk
@@ -0,0 +1,146 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MapperObserver.h"
+
+#include "mirtk/Math.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// MapperProgress
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+MapperProgress::MapperProgress(const char *phase, int iter, double residual)
+:
+  _Phase(phase),
+  _Iteration(iter),
+  _Residual(residual),
+  _MinError(nan),
+  _MaxError(nan),
+  _StdError(nan),
+  _ElapsedTime(.0)
+{
+}
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+MapperObserver::MapperObserver()
+:
+  _TimeLimit(.0),
+  _StartTime(std::chrono::steady_clock::now()),
+  _Cancelled(false),
+  _Status(MapperStatus_Completed)
+{
+}
+
+// -----------------------------------------------------------------------------
+MapperObserver::~MapperObserver()
+{
+}
+
+// =============================================================================
+// Notification
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MapperObserver::Start()
+{
+  _StartTime = std::chrono::steady_clock::now();
+  _Status    = MapperStatus_Completed;
+}
+
+// -----------------------------------------------------------------------------
+double MapperObserver::ElapsedTime() const
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - _StartTime).count();
+}
+
+// -----------------------------------------------------------------------------
+void MapperObserver::Cancel()
+{
+  _Cancelled = true;
+}
+
+// -----------------------------------------------------------------------------
+bool MapperObserver::IsCancelled() const
+{
+  return _Cancelled;
+}
+
+// -----------------------------------------------------------------------------
+MapperStatus MapperObserver::Status() const
+{
+  return static_cast<MapperStatus>(_Status.load());
+}
+
+// -----------------------------------------------------------------------------
+void MapperObserver::Stop(MapperStatus status)
+{
+  int current = _Status;
+  while ((current == MapperStatus_Completed ||
+         (current == MapperStatus_Stopped && status != MapperStatus_Stopped)) &&
+         !_Status.compare_exchange_weak(current, static_cast<int>(status))) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool MapperObserver::Continue()
+{
+  if (_Cancelled) {
+    Stop(MapperStatus_Cancelled);
+  } else if (_TimeLimit > .0 && ElapsedTime() > _TimeLimit) {
+    Stop(MapperStatus_TimeLimit);
+  }
+  const int status = _Status;
+  return status != MapperStatus_TimeLimit && status != MapperStatus_Cancelled;
+}
+
+// -----------------------------------------------------------------------------
+bool MapperObserver::Notify(MapperProgress progress)
+{
+  if (!Continue()) return false;
+  progress._ElapsedTime = ElapsedTime();
+  if (!this->Iteration(progress)) {
+    Stop(MapperStatus_Stopped);
+    return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool MapperObserver::Notify(const char *phase, int iter, double residual)
+{
+  return Notify(MapperProgress(phase, iter, residual));
+}
+
+// -----------------------------------------------------------------------------
+bool MapperObserver::Iteration(const MapperProgress &)
+{
+  return true;
+}
+
+
+} // namespace mirtk
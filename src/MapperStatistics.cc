@@ -0,0 +1,252 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MapperStatistics.h"
+
+#include "mirtk/Math.h"
+
+#include <fstream>
+#include <iomanip>
+
+#ifndef WINDOWS
+  #include <sys/resource.h>
+#endif
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Timer
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+MapperStatistics::Timer::Timer(MapperStatistics *stats, const char *name)
+:
+  _Statistics(stats),
+  _Name(name),
+  _Wall(std::chrono::steady_clock::now()),
+  _CPU(clock())
+{
+}
+
+// -----------------------------------------------------------------------------
+MapperStatistics::Timer::~Timer()
+{
+  Stop();
+}
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::Timer::Stop()
+{
+  if (_Statistics) {
+    const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - _Wall).count();
+    const double cpu  = static_cast<double>(clock() - _CPU) / static_cast<double>(CLOCKS_PER_SEC);
+    _Statistics->AddTime(_Name, wall, cpu);
+    _Statistics = nullptr;
+  }
+}
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::CopyAttributes(const MapperStatistics &other)
+{
+  _Mapper             = other._Mapper;
+  _Status             = other._Status;
+  _Phases             = other._Phases;
+  _Solver             = other._Solver;
+  _NumberOfUnknowns   = other._NumberOfUnknowns;
+  _NumberOfNonZeros   = other._NumberOfNonZeros;
+  _NumberOfIterations = other._NumberOfIterations;
+  _Residual           = other._Residual;
+  _PeakMemory         = other._PeakMemory;
+}
+
+// -----------------------------------------------------------------------------
+MapperStatistics::MapperStatistics()
+:
+  _Status(MapperStatus_Completed),
+  _NumberOfUnknowns(0),
+  _NumberOfNonZeros(0),
+  _NumberOfIterations(0),
+  _Residual(nan),
+  _PeakMemory(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+MapperStatistics::MapperStatistics(const MapperStatistics &other)
+:
+  Object(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+MapperStatistics &MapperStatistics::operator =(const MapperStatistics &other)
+{
+  if (this != &other) {
+    Object::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+MapperStatistics::~MapperStatistics()
+{
+}
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::Clear()
+{
+  _Status             = MapperStatus_Completed;
+  _Phases.clear();
+  _Solver.clear();
+  _NumberOfUnknowns   = 0;
+  _NumberOfNonZeros   = 0;
+  _NumberOfIterations = 0;
+  _Residual           = nan;
+  _PeakMemory         = 0;
+}
+
+// =============================================================================
+// Statistics
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::AddTime(const char *name, double wall, double cpu)
+{
+  for (auto &phase : _Phases) {
+    if (phase._Name == name) {
+      phase._WallTime += wall;
+      phase._CPUTime  += cpu;
+      phase._Count    += 1;
+      return;
+    }
+  }
+  Phase phase;
+  phase._Name     = name;
+  phase._WallTime = wall;
+  phase._CPUTime  = cpu;
+  phase._Count    = 1;
+  _Phases.push_back(phase);
+}
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::AddLinearSolve(const string &solver, int64_t unknowns, int64_t nnz,
+                                      int niter, double residual)
+{
+  _Solver              = solver;
+  _NumberOfUnknowns    = unknowns;
+  _NumberOfNonZeros    = nnz;
+  _NumberOfIterations += niter;
+  _Residual            = residual;
+}
+
+// -----------------------------------------------------------------------------
+const MapperStatistics::Phase *MapperStatistics::FindPhase(const char *name) const
+{
+  for (const auto &phase : _Phases) {
+    if (phase._Name == name) return &phase;
+  }
+  return nullptr;
+}
+
+// -----------------------------------------------------------------------------
+double MapperStatistics::WallTime(const char *name) const
+{
+  const Phase *phase = FindPhase(name);
+  return phase ? phase->_WallTime : .0;
+}
+
+// -----------------------------------------------------------------------------
+double MapperStatistics::CPUTime(const char *name) const
+{
+  const Phase *phase = FindPhase(name);
+  return phase ? phase->_CPUTime : .0;
+}
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::UpdatePeakMemory()
+{
+  #ifndef WINDOWS
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+      #ifdef __APPLE__
+        _PeakMemory = static_cast<int64_t>(usage.ru_maxrss);
+      #else
+        _PeakMemory = static_cast<int64_t>(usage.ru_maxrss) * 1024;
+      #endif
+    }
+  #endif
+}
+
+// =============================================================================
+// Output
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MapperStatistics::Print(ostream &os, int indent) const
+{
+  const string pre(indent, ' ');
+  const streamsize precision = os.precision(9);
+  os << "{\n";
+  os << pre << "  \"mapper\": \"" << _Mapper << "\",\n";
+  os << pre << "  \"status\": \"" << ToString(_Status) << "\",\n";
+  os << pre << "  \"phases\": {";
+  for (size_t i = 0; i < _Phases.size(); ++i) {
+    const Phase &phase = _Phases[i];
+    os << (i > 0 ? "," : "") << "\n" << pre << "    \"" << phase._Name << "\": {"
+       << "\"wall_time\": " << phase._WallTime << ", "
+       << "\"cpu_time\": " << phase._CPUTime << ", "
+       << "\"count\": " << phase._Count << "}";
+  }
+  os << "\n" << pre << "  },\n";
+  os << pre << "  \"solver\": ";
+  if (_Solver.empty()) os << "null";
+  else                 os << "\"" << _Solver << "\"";
+  os << ",\n";
+  os << pre << "  \"unknowns\": " << _NumberOfUnknowns << ",\n";
+  os << pre << "  \"nnz\": " << _NumberOfNonZeros << ",\n";
+  os << pre << "  \"iterations\": " << _NumberOfIterations << ",\n";
+  os << pre << "  \"residual\": ";
+  if (IsNaN(_Residual) || IsInf(_Residual)) os << "null";
+  else                                      os << _Residual;
+  os << ",\n";
+  os << pre << "  \"peak_memory\": " << _PeakMemory << "\n";
+  os << pre << "}";
+  os.precision(precision);
+}
+
+// -----------------------------------------------------------------------------
+bool MapperStatistics::Write(const char *fname) const
+{
+  std::ofstream ofs(fname);
+  if (!ofs) return false;
+  Print(ofs);
+  ofs << "\n";
+  return !ofs.fail();
+}
+
+
+} // namespace mirtk
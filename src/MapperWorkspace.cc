@@ -0,0 +1,74 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MapperWorkspace.h"
+
+
+namespace mirtk {
+
+
+// -----------------------------------------------------------------------------
+template <class T>
+inline void FreeArray(Array<T> &a)
+{
+  Array<T>().swap(a);
+}
+
+// -----------------------------------------------------------------------------
+template <class T>
+inline size_t ArraySize(const Array<T> &a)
+{
+  return a.capacity() * sizeof(T);
+}
+
+// -----------------------------------------------------------------------------
+void MapperWorkspace::Clear()
+{
+  _Matrix = Eigen::SparseMatrix<double>();
+  _RightHandSide.resize(0, 0);
+  _Solution.resize(0, 0);
+  FreeArray(_Offset);
+  FreeArray(_Edges);
+  FreeArray(_Weights);
+  FreeArray(_Diagonal);
+  FreeArray(_CouplingRows);
+  FreeArray(_CouplingCols);
+  FreeArray(_CouplingWeights);
+}
+
+// -----------------------------------------------------------------------------
+size_t MapperWorkspace::MemorySize() const
+{
+  size_t n = 0;
+  n += static_cast<size_t>(_Matrix.data().allocatedSize()) * (sizeof(double) + sizeof(int));
+  n += static_cast<size_t>(_Matrix.outerSize() + 1) * sizeof(int);
+  n += static_cast<size_t>(_RightHandSide.size()) * sizeof(double);
+  n += static_cast<size_t>(_Solution.size()) * sizeof(double);
+  n += ArraySize(_Offset);
+  n += ArraySize(_Edges);
+  n += ArraySize(_Weights);
+  n += ArraySize(_Diagonal);
+  n += ArraySize(_CouplingRows);
+  n += ArraySize(_CouplingCols);
+  n += ArraySize(_CouplingWeights);
+  return n;
+}
+
+
+} // namespace mirtk
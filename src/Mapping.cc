@@ -22,9 +22,11 @@
 #include "mirtk/Config.h" // WINDOWS
 #include "mirtk/Math.h"
 #include "mirtk/Memory.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/Path.h"
 #include "mirtk/Cfstream.h"
 #include "mirtk/BaseImage.h"
-#include "mirtk/VoxelFunction.h"
+#include "mirtk/GenericImage.h"
 #include "mirtk/PointSetUtils.h"
 
 #include "vtkSmartPointer.h"
@@ -32,10 +34,22 @@
 #include "vtkPolyData.h"
 #include "vtkImageData.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <utility>
 
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/MultiResolutionMap.h"
 #include "mirtk/MeshlessHarmonicMap.h"
 #include "mirtk/MeshlessBiharmonicMap.h"
+#include "mirtk/MeshlessCompactMap.h"
+#include "mirtk/LatticeMap.h"
+#include "mirtk/MeanValueCoordinatesVolumeMap.h"
+#include "mirtk/SquareToDiskMap.h"
+#include "mirtk/DiskToSquareMap.h"
+#include "mirtk/StereographicMap.h"
+#include "mirtk/InverseStereographicMap.h"
 
 
 namespace mirtk {
@@ -45,28 +59,74 @@ namespace mirtk {
 // =============================================================================
 
 // -----------------------------------------------------------------------------
-Mapping *Mapping::New(const char *fname)
+/// Length of the type name header of map files
+static const size_t MapTypeNameLength = 32;
+
+// -----------------------------------------------------------------------------
+Mapping *Mapping::NewOfType(const char *type_name)
 {
-  UniquePtr<Mapping> map;
+  if (strncmp(type_name, MeshlessHarmonicMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new MeshlessHarmonicMap();
+  } else if (strncmp(type_name, MeshlessBiharmonicMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new MeshlessBiharmonicMap();
+  } else if (strncmp(type_name, MeshlessCompactMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new MeshlessCompactMap();
+  } else if (strncmp(type_name, MultiResolutionMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new MultiResolutionMap();
+  } else if (strncmp(type_name, LatticeMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new LatticeMap();
+  } else if (strncmp(type_name, MeanValueCoordinatesVolumeMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new MeanValueCoordinatesVolumeMap();
+  } else if (strncmp(type_name, SquareToDiskMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new SquareToDiskMap();
+  } else if (strncmp(type_name, DiskToSquareMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new DiskToSquareMap();
+  } else if (strncmp(type_name, StereographicMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new StereographicMap();
+  } else if (strncmp(type_name, InverseStereographicMap::NameOfType(), MapTypeNameLength) == 0) {
+    return new InverseStereographicMap();
+  }
+  return nullptr;
+}
 
-  const size_t max_name_len = 32;
-  char         map_type_name[max_name_len];
+// -----------------------------------------------------------------------------
+bool Mapping::IsMapFile(const char *fname)
+{
+  char header[256] = {0};
+  std::ifstream is(fname, std::ios::in | std::ios::binary);
+  is.read(header, sizeof(header));
+  const int n = static_cast<int>(is.gcount());
+  if (n <= 0) return false;
+  UniquePtr<Mapping> map(NewOfType(header));
+  if (map) return true;
+  return PiecewiseLinearMap::DetectFileFormat(fname, header, n) != PiecewiseLinearMap::UnknownFileFormat;
+}
+
+// -----------------------------------------------------------------------------
+Mapping *Mapping::New(const char *fname)
+{
+  char map_type_name[MapTypeNameLength] = {0};
 
+  // The file is opened only once and the type header is passed on to the
+  // reader of the detected map type, which continues reading the same stream
   Cifstream is(fname);
-  is.ReadAsChar(map_type_name, max_name_len);
+  is.ReadAsChar(map_type_name, MapTypeNameLength);
 
-  if (strncmp(map_type_name, MeshlessHarmonicMap::NameOfType(), max_name_len) == 0) {
-    map.reset(new MeshlessHarmonicMap());
-  } else if (strncmp(map_type_name, MeshlessBiharmonicMap::NameOfType(), max_name_len) == 0) {
-    map.reset(new MeshlessBiharmonicMap());
-  } else {
-    // Note that a picewise linear map is stored using a VTK file format and
-    // therefore the map file contains no "mirtk::PiecewiseLinearMap" header.
-    map.reset(new PiecewiseLinearMap());
+  UniquePtr<Mapping> map(NewOfType(map_type_name));
+  if (map) {
+    map->ReadMap(is);
+    map->Initialize();
+    return map.release();
   }
 
-  map->Read(fname);
-  return map.release();
+  // Note that a picewise linear map is stored using a VTK file format or the
+  // native binary format and therefore the map file contains no type header.
+  // Its format is determined from the leading bytes already read instead.
+  is.Close();
+  UniquePtr<PiecewiseLinearMap> plm(new PiecewiseLinearMap());
+  const int n = static_cast<int>(MapTypeNameLength);
+  plm->Read(fname, PiecewiseLinearMap::DetectFileFormat(fname, map_type_name, n));
+  return plm.release();
 }
 
 // =============================================================================
@@ -77,49 +137,290 @@ namespace MappingUtils {
 
 
 // -----------------------------------------------------------------------------
-/// Evaluate map at lattice points
-class EvaluateMap : public VoxelFunction
-{
-  const Mapping   *_Map;
-  vtkImageData    *_Domain;
-  const BaseImage *_Output;
-  const int        _NumberOfVoxels;
-  const int        _l1, _l2;
+/// Number of lattice points along each side of a brick of lattice points
+const int LatticeBrickSize = 8;
 
-public:
+// -----------------------------------------------------------------------------
+/// Morton code (Z-order) of brick with the given indices, i.e., the bits of
+/// the brick indices interleaved, with 21 bits per index
+inline uint64_t MortonCode(int i, int j, int k)
+{
+  uint64_t code = 0;
+  for (int b = 0; b < 21; ++b) {
+    code |= ((static_cast<uint64_t>(i) >> b) & 1) << (3 * b);
+    code |= ((static_cast<uint64_t>(j) >> b) & 1) << (3 * b + 1);
+    code |= ((static_cast<uint64_t>(k) >> b) & 1) << (3 * b + 2);
+  }
+  return code;
+}
 
-  EvaluateMap(const Mapping   *map,
-              vtkImageData    *domain,
-              const BaseImage *output,
-              int l1, int l2)
-  :
-    _Map(map),
-    _Domain(domain),
-    _Output(output),
-    _NumberOfVoxels(output->NumberOfSpatialVoxels()),
-    _l1(l1), _l2(l2)
-  {}
+// -----------------------------------------------------------------------------
+/// Get indices of lattice bricks in Morton order
+///
+/// Consecutive bricks in this order are spatially close, such that each
+/// contiguous range of bricks processed by one thread is compact.
+void MortonOrder(int nbx, int nby, int nbz, Array<int> &order)
+{
+  const int nbricks = nbx * nby * nbz;
+  Array<std::pair<uint64_t, int> > codes(nbricks);
+  for (int bk = 0, b = 0; bk < nbz; ++bk)
+  for (int bj = 0;        bj < nby; ++bj)
+  for (int bi = 0;        bi < nbx; ++bi, ++b) {
+    codes[b] = std::make_pair(MortonCode(bi, bj, bk), b);
+  }
+  std::sort(codes.begin(), codes.end());
+  order.resize(nbricks);
+  for (int b = 0; b < nbricks; ++b) {
+    order[b] = codes[b].second;
+  }
+}
 
-  template <class T>
-  void operator ()(int i, int j, int k, int, T *v) const
+// -----------------------------------------------------------------------------
+/// Evaluate map at lattice points brick by brick
+///
+/// Lattice points within bricks which do not intersect the map domain are
+/// assigned the outside value without evaluating the map. The bricks are
+/// visited in Morton order and the lattice points of each brick along a
+/// serpentine path, such that consecutive points are neighbors. This keeps
+/// the cell found last by a mesh-walking evaluator and the locator nodes
+/// of nearby cells in cache. Each brick is processed by one thread only,
+/// which uses its own evaluation context such that no heap memory is
+/// allocated per voxel.
+template <class T>
+struct EvaluateMapInBricks
+{
+  const Mapping       *_Map;
+  const unsigned char *_Mask;     ///< Lattice points at which to evaluate the map
+  const Array<int>    *_Order;    ///< Indices of bricks in order of traversal
+  const Array<bool>   *_Occupied; ///< Bricks intersecting the map domain
+  GenericImage<T>     *_Output;
+  int                  _NumberOfBricksX;
+  int                  _NumberOfBricksY;
+  int                  _l1, _l2;
+
+  void operator ()(const blocked_range<int> &re) const
   {
-    if (!_Domain || _Domain->GetScalarComponentAsFloat(i, j, k, 0) != .0) {
-      double x = i, y = j, z = k;
-      _Output->ImageToWorld(x, y, z);
-      double *f = new double[_Map->NumberOfComponents()];
-      _Map->Evaluate(f, x, y, z);
-      for (int l = _l1; l < _l2; ++l, v += _NumberOfVoxels) {
-        *v = f[l];
-      }
-      delete[] f;
-    } else {
-      for (int l = _l1; l < _l2; ++l, v += _NumberOfVoxels) {
-        *v = numeric_limits<T>::quiet_NaN();
+    const int nx      = _Output->X();
+    const int ny      = _Output->Y();
+    const int nz      = _Output->Z();
+    const int nvox    = _Output->NumberOfSpatialVoxels();
+    const int n       = LatticeBrickSize;
+    const T   undef   = numeric_limits<T>::quiet_NaN();
+    const T   outside = static_cast<T>(_Map->OutsideValue());
+
+    Mapping::EvaluationContext ctx;
+    Array<double> values(_l2 - _l1);
+    T * const data = _Output->Data();
+
+    int b, bi, bj, bk, i1, j1, k1, i2, j2, k2, i, j, vox;
+    double x, y, z;
+    for (int pos = re.begin(); pos != re.end(); ++pos) {
+      b  = (*_Order)[pos];
+      bi = b % _NumberOfBricksX;
+      bj = (b / _NumberOfBricksX) % _NumberOfBricksY;
+      bk = b / (_NumberOfBricksX * _NumberOfBricksY);
+      i1 = bi * n, i2 = min(i1 + n, nx);
+      j1 = bj * n, j2 = min(j1 + n, ny);
+      k1 = bk * n, k2 = min(k1 + n, nz);
+      const bool occupied = (*_Occupied)[b];
+      for (int k = k1; k < k2; ++k)
+      for (int t = j1; t < j2; ++t)
+      for (int s = i1; s < i2; ++s) {
+        j   = ((k - k1) % 2 == 0 ? t : j1 + j2 - 1 - t);
+        i   = ((t - j1 + k - k1) % 2 == 0 ? s : i1 + i2 - 1 - s);
+        vox = i + nx * (j + ny * k);
+        if (_Mask && _Mask[vox] == 0) {
+          for (int l = _l1; l < _l2; ++l) data[vox + (l - _l1) * nvox] = undef;
+        } else if (!occupied) {
+          for (int l = _l1; l < _l2; ++l) data[vox + (l - _l1) * nvox] = outside;
+        } else {
+          x = i, y = j, z = k;
+          _Output->ImageToWorld(x, y, z);
+          _Map->Evaluate(ctx, values.data(), x, y, z, _l1, _l2);
+          for (int l = _l1; l < _l2; ++l) {
+            data[vox + (l - _l1) * nvox] = static_cast<T>(values[l - _l1]);
+          }
+        }
       }
     }
   }
 };
 
+// -----------------------------------------------------------------------------
+/// Evaluate map at lattice points of image, optionally restricted to a PLC
+template <class T>
+void EvaluateAtLattice(const Mapping *map, GenericImage<T> &f, int l,
+                       vtkSmartPointer<vtkPointSet> m)
+{
+  ImageAttributes lattice = f.Attributes();
+  lattice._dt = .0;
+
+  if (l >= map->NumberOfComponents() || l + lattice._t > map->NumberOfComponents()) {
+    cerr << map->NameOfType() << "::Evaluate: Component index out of range" << endl;
+    exit(1);
+  }
+
+  vtkSmartPointer<vtkImageData> mask;
+  if (m) {
+    mask = NewVtkMask(lattice._x, lattice._y, lattice._z);
+    ImageStencilToMask(ImageStencil(mask, WorldToImage(m, &f)), mask);
+  }
+
+  const int n   = LatticeBrickSize;
+  const int nbx = (lattice._x + n - 1) / n;
+  const int nby = (lattice._y + n - 1) / n;
+  const int nbz = (lattice._z + n - 1) / n;
+  Array<bool> occupied;
+  map->MarkDomainBricks(lattice, n, occupied);
+  occupied.resize(nbx * nby * nbz, true);
+  Array<int> order;
+  MortonOrder(nbx, nby, nbz, order);
+
+  EvaluateMapInBricks<T> eval;
+  eval._Map             = map;
+  eval._Mask            = (mask ? reinterpret_cast<const unsigned char *>(mask->GetScalarPointer()) : nullptr);
+  eval._Order           = &order;
+  eval._Occupied        = &occupied;
+  eval._Output          = &f;
+  eval._NumberOfBricksX = nbx;
+  eval._NumberOfBricksY = nby;
+  eval._l1              = l;
+  eval._l2              = l + lattice._t;
+  parallel_for(blocked_range<int>(0, nbx * nby * nbz), eval);
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at contiguous set of points
+struct EvaluateMapAtPoints
+{
+  const Mapping *_Map;
+  const double  *_Points;
+  double        *_Values;
+  bool          *_Inside;
+  int            _NumberOfComponents;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double *p = _Points + 3 * re.begin();
+    double       *v = _Values + _NumberOfComponents * re.begin();
+    bool          inside;
+    for (int i = re.begin(); i != re.end(); ++i, p += 3, v += _NumberOfComponents) {
+      inside = _Map->Evaluate(v, p[0], p[1], p[2]);
+      if (_Inside) _Inside[i] = inside;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate Jacobian of map at contiguous set of points
+struct EvaluateJacobianAtPoints
+{
+  const Mapping *_Map;
+  const double  *_Points;
+  double        *_Jacobian;
+  bool          *_Inside;
+  int            _NumberOfComponents;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    Mapping::EvaluationContext ctx;
+    const int     stride = 3 * _NumberOfComponents;
+    const double *p      = _Points   + 3      * re.begin();
+    double       *jac    = _Jacobian + stride * re.begin();
+    bool          inside;
+    for (int i = re.begin(); i != re.end(); ++i, p += 3, jac += stride) {
+      inside = _Map->EvaluateJacobian(ctx, jac, p[0], p[1], p[2]);
+      if (_Inside) _Inside[i] = inside;
+    }
+  }
+};
+
+
+// -----------------------------------------------------------------------------
+/// NIfTI-1 image file header
+struct NiftiHeader
+{
+  int32_t sizeof_hdr;
+  char    data_type[10];
+  char    db_name[18];
+  int32_t extents;
+  int16_t session_error;
+  char    regular;
+  char    dim_info;
+  int16_t dim[8];
+  float   intent_p1, intent_p2, intent_p3;
+  int16_t intent_code;
+  int16_t datatype;
+  int16_t bitpix;
+  int16_t slice_start;
+  float   pixdim[8];
+  float   vox_offset;
+  float   scl_slope;
+  float   scl_inter;
+  int16_t slice_end;
+  char    slice_code;
+  char    xyzt_units;
+  float   cal_max, cal_min;
+  float   slice_duration;
+  float   toffset;
+  int32_t glmax, glmin;
+  char    descrip[80];
+  char    aux_file[24];
+  int16_t qform_code, sform_code;
+  float   quatern_b, quatern_c, quatern_d;
+  float   qoffset_x, qoffset_y, qoffset_z;
+  float   srow_x[4], srow_y[4], srow_z[4];
+  char    intent_name[16];
+  char    magic[4];
+};
+
+static_assert(sizeof(NiftiHeader) == 348, "NIfTI-1 header must be 348 bytes");
+
+// -----------------------------------------------------------------------------
+/// Write NIfTI-1 header of single precision image with given attributes
+void WriteNiftiHeader(std::ostream &os, const ImageAttributes &lattice)
+{
+  NiftiHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.sizeof_hdr = 348;
+  hdr.regular    = 'r';
+  hdr.dim[1]     = static_cast<int16_t>(lattice._x);
+  hdr.dim[2]     = static_cast<int16_t>(lattice._y);
+  hdr.dim[3]     = static_cast<int16_t>(lattice._z);
+  hdr.pixdim[0]  = 1.0f;
+  hdr.pixdim[1]  = static_cast<float>(lattice._dx);
+  hdr.pixdim[2]  = static_cast<float>(lattice._dy);
+  hdr.pixdim[3]  = static_cast<float>(lattice._dz);
+  if (lattice._t > 1) {
+    // Vector valued image, cf. NIFTI_INTENT_VECTOR
+    hdr.dim[0]      = 5;
+    hdr.dim[4]      = 1;
+    hdr.dim[5]      = static_cast<int16_t>(lattice._t);
+    hdr.pixdim[4]   = 1.0f;
+    hdr.pixdim[5]   = 1.0f;
+    hdr.intent_code = 1007;
+  } else {
+    hdr.dim[0] = 3;
+  }
+  for (int d = hdr.dim[0] + 1; d < 8; ++d) hdr.dim[d] = 1;
+  hdr.datatype   = 16; // NIFTI_TYPE_FLOAT32
+  hdr.bitpix     = 32;
+  hdr.vox_offset = 352.0f;
+  hdr.scl_slope  = 1.0f;
+  hdr.xyzt_units = 2;  // NIFTI_UNITS_MM
+  hdr.sform_code = 1;  // NIFTI_XFORM_SCANNER_ANAT
+  const Matrix i2w = lattice.GetImageToWorldMatrix();
+  for (int c = 0; c < 4; ++c) {
+    hdr.srow_x[c] = static_cast<float>(i2w(0, c));
+    hdr.srow_y[c] = static_cast<float>(i2w(1, c));
+    hdr.srow_z[c] = static_cast<float>(i2w(2, c));
+  }
+  memcpy(hdr.magic, "n+1", 4);
+  const char extension[4] = {0, 0, 0, 0};
+  os.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+  os.write(extension, 4);
+}
+
 
 } // namespace MappingUtils
 using namespace MappingUtils;
@@ -164,6 +465,11 @@ void Mapping::Initialize()
 {
 }
 
+// -----------------------------------------------------------------------------
+void Mapping::Compact()
+{
+}
+
 // -----------------------------------------------------------------------------
 Mapping::~Mapping()
 {
@@ -253,48 +559,196 @@ ImageAttributes Mapping::Attributes(double dx, double dy, double dz) const
   return lattice;
 }
 
+// -----------------------------------------------------------------------------
+void Mapping::MarkDomainBricks(const ImageAttributes &lattice, int n, Array<bool> &occupied) const
+{
+  const int nbx = (lattice._x + n - 1) / n;
+  const int nby = (lattice._y + n - 1) / n;
+  const int nbz = (lattice._z + n - 1) / n;
+  occupied.assign(nbx * nby * nbz, true);
+}
+
 // =============================================================================
 // Evaluation
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+bool Mapping::Evaluate(double *v, double x, double y, double z, int l1, int l2) const
+{
+  const int dim = this->NumberOfComponents();
+  if (l1 == 0 && l2 == dim) return this->Evaluate(v, x, y, z);
+  const int maxdim = 16;
+  if (dim <= maxdim) {
+    double values[maxdim];
+    const bool inside = this->Evaluate(values, x, y, z);
+    for (int l = l1; l < l2; ++l) v[l - l1] = values[l];
+    return inside;
+  }
+  Array<double> values(dim);
+  const bool inside = this->Evaluate(values.data(), x, y, z);
+  for (int l = l1; l < l2; ++l) v[l - l1] = values[l];
+  return inside;
+}
+
+// -----------------------------------------------------------------------------
+void Mapping::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateMapAtPoints eval;
+  eval._Map                = this;
+  eval._Points             = xyz;
+  eval._Values             = values;
+  eval._Inside             = inside;
+  eval._NumberOfComponents = this->NumberOfComponents();
+  parallel_for(blocked_range<int>(0, n), eval);
+}
+
+// -----------------------------------------------------------------------------
+void Mapping::Resample(vtkPointSet *mesh, double *values, bool *inside) const
+{
+  const int n = static_cast<int>(mesh->GetNumberOfPoints());
+  if (n <= 0) return;
+  Array<double> xyz(3 * n);
+  for (int ptId = 0; ptId < n; ++ptId) {
+    mesh->GetPoint(static_cast<vtkIdType>(ptId), xyz.data() + 3 * ptId);
+  }
+  this->Evaluate(n, xyz.data(), values, inside);
+}
+
 // -----------------------------------------------------------------------------
 void Mapping::Evaluate(GenericImage<float> &f, int l, vtkSmartPointer<vtkPointSet> m) const
 {
-  ImageAttributes lattice = f.Attributes();
-  lattice._dt = .0;
+  EvaluateAtLattice(this, f, l, m);
+}
+
+// -----------------------------------------------------------------------------
+void Mapping::Evaluate(GenericImage<double> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  EvaluateAtLattice(this, f, l, m);
+}
 
-  if (l >= NumberOfComponents() || l + lattice._t > NumberOfComponents()) {
+// -----------------------------------------------------------------------------
+bool Mapping::Evaluate(const char *fname, const ImageAttributes &lattice, int l,
+                       vtkSmartPointer<vtkPointSet> m, int nz) const
+{
+  const int nt = max(lattice._t, 1);
+  if (l < 0 || l + nt > NumberOfComponents()) {
     cerr << this->NameOfType() << "::Evaluate: Component index out of range" << endl;
     exit(1);
   }
+  if (Extension(fname) != ".nii") {
+    cerr << this->NameOfType() << "::Evaluate: Streamed output file must be an uncompressed NIfTI-1 image (.nii)" << endl;
+    return false;
+  }
 
-  vtkSmartPointer<vtkImageData> mask;
-  if (m) {
-    mask = NewVtkMask(lattice._x, lattice._y, lattice._z);
-    ImageStencilToMask(ImageStencil(mask, WorldToImage(m, &f)), mask);
+  // NIfTI-1 stores the image size as 16-bit signed integers
+  const int max_dim = numeric_limits<int16_t>::max();
+  if (lattice._x < 1 || lattice._y < 1 || lattice._z < 1 ||
+      lattice._x > max_dim || lattice._y > max_dim || lattice._z > max_dim || nt > max_dim) {
+    cerr << this->NameOfType() << "::Evaluate: Lattice size " << lattice._x << "x" << lattice._y
+         << "x" << lattice._z << "x" << nt << " cannot be stored in NIfTI-1 header" << endl;
+    return false;
+  }
+
+  // Number of lattice slices per slab, where 64-bit sizes and file offsets
+  // are used because long is only 32-bit on Windows
+  const int64_t nxy = static_cast<int64_t>(lattice._x) * static_cast<int64_t>(lattice._y);
+  if (nz <= 0) nz = static_cast<int>(max(int64_t(1), (int64_t(1) << 24) / (nxy * nt)));
+  if (nz > lattice._z) nz = lattice._z;
+
+  std::ofstream os(fname, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!os) {
+    cerr << this->NameOfType() << "::Evaluate: Failed to open file " << fname << endl;
+    return false;
+  }
+  ImageAttributes attr = lattice;
+  attr._t  = nt;
+  attr._dt = .0;
+  WriteNiftiHeader(os, attr);
+
+  // Evaluate and write one slab at a time, where the slab lattice is centered
+  // at the world coordinates of its central slice in the full lattice
+  const int64_t nvox = nxy * static_cast<int64_t>(lattice._z);
+  GenericImage<float> slab;
+  double x, y, z;
+  for (int k1 = 0; k1 < lattice._z; k1 += nz) {
+    const int k2 = min(k1 + nz, lattice._z);
+    ImageAttributes slab_attr = attr;
+    slab_attr._z = k2 - k1;
+    x = .5 * (lattice._x - 1);
+    y = .5 * (lattice._y - 1);
+    z = k1 + .5 * (slab_attr._z - 1);
+    lattice.LatticeToWorld(x, y, z);
+    slab_attr._xorigin = x;
+    slab_attr._yorigin = y;
+    slab_attr._zorigin = z;
+    if (slab.Z() != slab_attr._z) slab.Initialize(slab_attr);
+    else                          slab.PutOrigin(x, y, z);
+    this->Evaluate(slab, l, m);
+    const int64_t nslab = nxy * static_cast<int64_t>(slab_attr._z);
+    for (int c = 0; c < nt; ++c) {
+      const int64_t offset = 352 + static_cast<int64_t>(sizeof(float)) * (c * nvox + k1 * nxy);
+      os.seekp(static_cast<std::streamoff>(offset));
+      os.write(reinterpret_cast<const char *>(slab.Data(0, 0, 0, c)),
+               static_cast<std::streamsize>(nslab * static_cast<int64_t>(sizeof(float))));
+    }
+    if (os.fail()) {
+      cerr << this->NameOfType() << "::Evaluate: Failed to write slab to " << fname << endl;
+      return false;
+    }
   }
 
-  ParallelForEachVoxel(EvaluateMap(this, mask, &f, l, l + lattice._t), lattice, f);
+  return true;
 }
 
 // -----------------------------------------------------------------------------
-void Mapping::Evaluate(GenericImage<double> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+bool Mapping::EvaluateJacobian(EvaluationContext &ctx, double *jac, double x, double y, double z) const
 {
-  ImageAttributes lattice = f.Attributes();
-  lattice._dt = .0;
+  const int    dim = this->NumberOfComponents();
+  const double eps = 6e-6; // ~ cube root of machine epsilon
 
-  if (l >= NumberOfComponents() || l + lattice._t > NumberOfComponents()) {
-    cerr << this->NameOfType() << "::Evaluate: Component index out of range" << endl;
-    exit(1);
+  const size_t n = static_cast<size_t>(3 * dim);
+  if (ctx._Values.size() < n) ctx._Values.resize(n);
+  double * const v0 = ctx._Values.data();
+  double * const v1 = v0 + dim;
+  double * const v2 = v1 + dim;
+
+  if (!this->Evaluate(ctx, v0, x, y, z)) {
+    for (int i = 0; i < 3 * dim; ++i) jac[i] = _OutsideValue;
+    return false;
   }
 
-  vtkSmartPointer<vtkImageData> mask;
-  if (m) {
-    mask = NewVtkMask(lattice._x, lattice._y, lattice._z);
-    ImageStencilToMask(ImageStencil(mask, WorldToImage(m, &f)), mask);
+  const double p[3] = {x, y, z};
+  double q[3], h;
+  bool   inside1, inside2;
+  for (int a = 0; a < 3; ++a) {
+    h = eps * max(1.0, abs(p[a]));
+    q[0] = p[0], q[1] = p[1], q[2] = p[2];
+    q[a] = p[a] - h;
+    inside1 = this->Evaluate(ctx, v1, q[0], q[1], q[2]);
+    q[a] = p[a] + h;
+    inside2 = this->Evaluate(ctx, v2, q[0], q[1], q[2]);
+    for (int l = 0; l < dim; ++l) {
+      if (inside1 && inside2) jac[3 * l + a] = (v2[l] - v1[l]) / (2.0 * h);
+      else if (inside2)       jac[3 * l + a] = (v2[l] - v0[l]) / h;
+      else if (inside1)       jac[3 * l + a] = (v0[l] - v1[l]) / h;
+      else                    jac[3 * l + a] = .0;
+    }
   }
+  return true;
+}
 
-  ParallelForEachVoxel(EvaluateMap(this, mask, &f, l, l + lattice._t), lattice, f);
+// -----------------------------------------------------------------------------
+void Mapping::EvaluateJacobian(int n, const double *xyz, double *jac, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateJacobianAtPoints eval;
+  eval._Map                = this;
+  eval._Points             = xyz;
+  eval._Jacobian           = jac;
+  eval._Inside             = inside;
+  eval._NumberOfComponents = this->NumberOfComponents();
+  parallel_for(blocked_range<int>(0, n), eval);
 }
 
 // =============================================================================
@@ -0,0 +1,786 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MeanValueCoordinatesVolumeMap.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/Cfstream.h"
+#include "mirtk/GenericImage.h"
+#include "mirtk/PointSetUtils.h"
+
+#include "vtkNew.h"
+#include "vtkIdList.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkCellType.h"
+#include "vtkDoubleArray.h"
+
+
+namespace mirtk {
+
+
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace MeanValueCoordinatesVolumeMapUtils {
+
+typedef MeanValueCoordinatesVolumeMap::Real Real;
+
+
+// -----------------------------------------------------------------------------
+/// Update 64-bit FNV-1a hash value
+inline void Hash(uint64_t &h, const void *data, size_t n)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<uint64_t>(p[i]);
+    h *= 1099511628211ULL;
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Compute hash value of cage points and triangles
+uint64_t HashCage(vtkPolyData *cage, const Array<int> &triangles)
+{
+  uint64_t h = 14695981039346656037ULL;
+  double   p[3];
+  for (vtkIdType ptId = 0; ptId < cage->GetNumberOfPoints(); ++ptId) {
+    cage->GetPoint(ptId, p);
+    Hash(h, p, sizeof(p));
+  }
+  if (!triangles.empty()) {
+    Hash(h, triangles.data(), triangles.size() * sizeof(int));
+  }
+  return h;
+}
+
+// -----------------------------------------------------------------------------
+/// Whether two lattices have the same size and geometry
+bool SameLattice(const ImageAttributes &a, const ImageAttributes &b)
+{
+  if (a._x != b._x || a._y != b._y || a._z != b._z) return false;
+  if (!fequal(a._xorigin, b._xorigin) || !fequal(a._yorigin, b._yorigin) || !fequal(a._zorigin, b._zorigin)) return false;
+  if (!fequal(a._dx, b._dx) || !fequal(a._dy, b._dy) || !fequal(a._dz, b._dz)) return false;
+  for (int d = 0; d < 3; ++d) {
+    if (!fequal(a._xaxis[d], b._xaxis[d])) return false;
+    if (!fequal(a._yaxis[d], b._yaxis[d])) return false;
+    if (!fequal(a._zaxis[d], b._zaxis[d])) return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at contiguous set of points
+struct EvaluateMeanValueMap
+{
+  const MeanValueCoordinatesVolumeMap *_Map;
+  const double                        *_Points;
+  double                              *_Values;
+  bool                                *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int m = _Map->NumberOfComponents();
+    Array<Real> buffer(4 * _Map->NumberOfCagePoints());
+    bool inside;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      inside = _Map->EvaluateCoordinates(_Points + 3 * i, _Values + m * i, nullptr, buffer.data());
+      if (_Inside) _Inside[i] = inside;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute truncated mean value coordinates at lattice points of one slice
+struct ComputeSliceWeights
+{
+  const MeanValueCoordinatesVolumeMap *_Map;
+  const ImageAttributes               *_Lattice;
+  int                                  _Slice;
+  double                               _Threshold;
+  Array<Array<int> >                  *_Index;
+  Array<Array<float> >                *_Value;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int n  = _Map->NumberOfCagePoints();
+    const int nx = _Lattice->_x;
+    Array<Real>   buffer(4 * n);
+    Array<double> w(n);
+    double p[3], wmax, sum;
+    for (int j = re.begin(); j != re.end(); ++j)
+    for (int i = 0; i < nx; ++i) {
+      const int idx = j * nx + i;
+      Array<int>   &index = (*_Index)[idx];
+      Array<float> &value = (*_Value)[idx];
+      index.clear();
+      value.clear();
+      p[0] = i, p[1] = j, p[2] = _Slice;
+      _Lattice->LatticeToWorld(p[0], p[1], p[2]);
+      if (!_Map->EvaluateCoordinates(p, nullptr, w.data(), buffer.data())) continue;
+      // Discard small coordinates, but always keep the largest one
+      wmax = .0;
+      for (int k = 0; k < n; ++k) wmax = max(wmax, abs(w[k]));
+      sum = .0;
+      for (int k = 0; k < n; ++k) {
+        if (abs(w[k]) >= _Threshold || abs(w[k]) == wmax) {
+          index.push_back(k);
+          value.push_back(static_cast<float>(w[k]));
+          sum += w[k];
+        }
+      }
+      if (sum != .0) {
+        for (size_t k = 0; k < value.size(); ++k) {
+          value[k] = static_cast<float>(value[k] / sum);
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at lattice points using precomputed mean value coordinates
+template <class T>
+struct EvaluateWeightedSum
+{
+  const int64_t *_Offset;
+  const int     *_Index;
+  const float   *_Weight;
+  const double  *_CageValues;
+  int            _Dimension;
+  int            _FirstComponent;
+  int            _NumberOfComponents;
+  int64_t        _NumberOfVoxels;
+  double         _OutsideValue;
+  T             *_Output;
+
+  void operator ()(const blocked_range<int64_t> &re) const
+  {
+    double v;
+    for (int64_t vox = re.begin(); vox != re.end(); ++vox) {
+      const int64_t begin = _Offset[vox];
+      const int64_t end   = _Offset[vox + 1];
+      for (int t = 0; t < _NumberOfComponents; ++t) {
+        if (begin == end) {
+          v = _OutsideValue;
+        } else {
+          const double *values = _CageValues + _FirstComponent + t;
+          v = .0;
+          for (int64_t k = begin; k < end; ++k) {
+            v += static_cast<double>(_Weight[k]) * values[_Dimension * _Index[k]];
+          }
+        }
+        _Output[t * _NumberOfVoxels + vox] = static_cast<T>(v);
+      }
+    }
+  }
+};
+
+
+} // namespace MeanValueCoordinatesVolumeMapUtils
+using namespace MeanValueCoordinatesVolumeMapUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::CopyAttributes(const MeanValueCoordinatesVolumeMap &other)
+{
+  _Cage                  = other._Cage;
+  _Values                = other._Values;
+  _WeightThreshold       = other._WeightThreshold;
+  _CagePoints            = other._CagePoints;
+  _CageTriangles         = other._CageTriangles;
+  _CageValues            = other._CageValues;
+  _NumberOfCagePoints    = other._NumberOfCagePoints;
+  _NumberOfCageTriangles = other._NumberOfCageTriangles;
+  _Dimension             = other._Dimension;
+  _CageBounds            = other._CageBounds;
+  _CageHash              = other._CageHash;
+  _WeightsLattice        = other._WeightsLattice;
+  _WeightsHash           = other._WeightsHash;
+  _WeightOffset          = other._WeightOffset;
+  _WeightIndex           = other._WeightIndex;
+  _WeightValue           = other._WeightValue;
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMap::MeanValueCoordinatesVolumeMap()
+:
+  _WeightThreshold(1e-4),
+  _NumberOfCagePoints(0),
+  _NumberOfCageTriangles(0),
+  _Dimension(0),
+  _CageBounds(6, .0),
+  _CageHash(0),
+  _WeightsHash(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMap
+::MeanValueCoordinatesVolumeMap(const MeanValueCoordinatesVolumeMap &other)
+:
+  Mapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMap &MeanValueCoordinatesVolumeMap
+::operator =(const MeanValueCoordinatesVolumeMap &other)
+{
+  if (this != &other) {
+    Mapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::Initialize()
+{
+  // Initialize base class
+  Mapping::Initialize();
+
+  // Check inputs
+  if (!_Cage || _Cage->GetNumberOfPoints() < 4) {
+    cerr << this->NameOfType() << "::Initialize: Missing or invalid cage surface" << endl;
+    exit(1);
+  }
+  if (!_Values || _Values->GetNumberOfTuples() != _Cage->GetNumberOfPoints()) {
+    cerr << this->NameOfType() << "::Initialize: Missing or invalid cage point values" << endl;
+    exit(1);
+  }
+
+  // Cage point coordinates
+  const int n = static_cast<int>(_Cage->GetNumberOfPoints());
+  _NumberOfCagePoints = n;
+  _CagePoints.resize(3 * n);
+  double p[3];
+  for (int i = 0; i < n; ++i) {
+    _Cage->GetPoint(static_cast<vtkIdType>(i), p);
+    _CagePoints[i        ] = static_cast<Real>(p[0]);
+    _CagePoints[i +     n] = static_cast<Real>(p[1]);
+    _CagePoints[i + 2 * n] = static_cast<Real>(p[2]);
+  }
+  _CageBounds.resize(6);
+  _Cage->GetBounds(_CageBounds.data());
+
+  // Cage triangles, where polygons are split into triangle fans
+  Array<int> t0, t1, t2;
+  vtkNew<vtkIdList> ptIds;
+  for (vtkIdType cellId = 0; cellId < _Cage->GetNumberOfCells(); ++cellId) {
+    const int type = _Cage->GetCellType(cellId);
+    if (type != VTK_TRIANGLE && type != VTK_QUAD && type != VTK_POLYGON) continue;
+    GetCellPoints(_Cage, cellId, ptIds.GetPointer());
+    for (vtkIdType i = 2; i < ptIds->GetNumberOfIds(); ++i) {
+      t0.push_back(static_cast<int>(ptIds->GetId(0)));
+      t1.push_back(static_cast<int>(ptIds->GetId(i - 1)));
+      t2.push_back(static_cast<int>(ptIds->GetId(i)));
+    }
+  }
+  if (t0.empty()) {
+    cerr << this->NameOfType() << "::Initialize: Cage surface has no triangles" << endl;
+    exit(1);
+  }
+  const int nt = static_cast<int>(t0.size());
+  _NumberOfCageTriangles = nt;
+  _CageTriangles.resize(3 * nt);
+  std::copy(t0.begin(), t0.end(), _CageTriangles.begin());
+  std::copy(t1.begin(), t1.end(), _CageTriangles.begin() + nt);
+  std::copy(t2.begin(), t2.end(), _CageTriangles.begin() + 2 * nt);
+
+  // Cage point values
+  _Dimension = _Values->GetNumberOfComponents();
+  _CageValues.resize(n * _Dimension);
+  for (int i = 0; i < n; ++i) {
+    _Values->GetTuple(static_cast<vtkIdType>(i), _CageValues.data() + i * _Dimension);
+  }
+
+  // Discard precomputed weights of different cage
+  _CageHash = HashCage(_Cage, _CageTriangles);
+  if (_CageHash != _WeightsHash) ClearWeights();
+}
+
+// -----------------------------------------------------------------------------
+Mapping *MeanValueCoordinatesVolumeMap::NewCopy() const
+{
+  return new MeanValueCoordinatesVolumeMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMap::~MeanValueCoordinatesVolumeMap()
+{
+}
+
+// =============================================================================
+// Precomputed weights
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::PrecomputeWeights(const ImageAttributes &lattice)
+{
+  if (_NumberOfCagePoints == 0) {
+    cerr << this->NameOfType() << "::PrecomputeWeights: Map must be initialized" << endl;
+    exit(1);
+  }
+  ClearWeights();
+
+  const int     nx   = lattice._x;
+  const int     ny   = lattice._y;
+  const int     nz   = lattice._z;
+  const int64_t nxy  = static_cast<int64_t>(nx) * static_cast<int64_t>(ny);
+  const int64_t nvox = nxy * static_cast<int64_t>(nz);
+
+  // Compute weights one slice at a time to limit the size of the buffers
+  Array<Array<int> >   index(nxy);
+  Array<Array<float> > value(nxy);
+  ComputeSliceWeights eval;
+  eval._Map       = this;
+  eval._Lattice   = &lattice;
+  eval._Threshold = _WeightThreshold;
+  eval._Index     = &index;
+  eval._Value     = &value;
+
+  _WeightOffset.resize(nvox + 1);
+  _WeightOffset[0] = 0;
+  int64_t vox = 0;
+  for (int k = 0; k < nz; ++k) {
+    eval._Slice = k;
+    parallel_for(blocked_range<int>(0, ny), eval);
+    for (int64_t idx = 0; idx < nxy; ++idx, ++vox) {
+      _WeightIndex.insert(_WeightIndex.end(), index[idx].begin(), index[idx].end());
+      _WeightValue.insert(_WeightValue.end(), value[idx].begin(), value[idx].end());
+      _WeightOffset[vox + 1] = static_cast<int64_t>(_WeightValue.size());
+    }
+  }
+  _WeightsLattice     = lattice;
+  _WeightsLattice._t  = 1;
+  _WeightsLattice._dt = .0;
+  _WeightsHash        = _CageHash;
+
+  if (verbose) {
+    cout << this->NameOfType() << "::PrecomputeWeights: Stored " << _WeightValue.size()
+         << " mean value coordinates at " << nvox << " lattice points, i.e., "
+         << (nvox > 0 ? static_cast<double>(_WeightValue.size()) / nvox : .0)
+         << " per lattice point" << endl;
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool MeanValueCoordinatesVolumeMap::HasWeights(const ImageAttributes &lattice) const
+{
+  return !_WeightOffset.empty() && _WeightsHash == _CageHash && SameLattice(lattice, _WeightsLattice);
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::ClearWeights()
+{
+  _WeightsLattice = ImageAttributes();
+  _WeightsHash    = 0;
+  _WeightOffset.clear();
+  _WeightIndex .clear();
+  _WeightValue .clear();
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::BoundingBox(double &x1, double &y1, double &z1,
+                                                double &x2, double &y2, double &z2) const
+{
+  x1 = _CageBounds[0], x2 = _CageBounds[1];
+  y1 = _CageBounds[2], y2 = _CageBounds[3];
+  z1 = _CageBounds[4], z2 = _CageBounds[5];
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool MeanValueCoordinatesVolumeMap
+::EvaluateCoordinates(const double p[3], double *v, double *w, Real *buffer) const
+{
+  const int n  = _NumberOfCagePoints;
+  const int nt = _NumberOfCageTriangles;
+  const int m  = _Dimension;
+
+  const Real *px = _CagePoints.data();
+  const Real *py = px + n;
+  const Real *pz = py + n;
+  const int  *t0 = _CageTriangles.data();
+  const int  *t1 = t0 + nt;
+  const int  *t2 = t1 + nt;
+  Real       *ux = buffer;
+  Real       *uy = ux + n;
+  Real       *uz = uy + n;
+  Real       *d  = uz + n;
+
+  if (v) for (int j = 0; j < m; ++j) v[j] = .0;
+  if (w) for (int i = 0; i < n; ++i) w[i] = .0;
+
+  if (p[0] < _CageBounds[0] || p[0] > _CageBounds[1] ||
+      p[1] < _CageBounds[2] || p[1] > _CageBounds[3] ||
+      p[2] < _CageBounds[4] || p[2] > _CageBounds[5]) {
+    if (v) for (int j = 0; j < m; ++j) v[j] = _OutsideValue;
+    return false;
+  }
+
+  const double diag = sqrt(pow(_CageBounds[1] - _CageBounds[0], 2) +
+                           pow(_CageBounds[3] - _CageBounds[2], 2) +
+                           pow(_CageBounds[5] - _CageBounds[4], 2));
+  const Real eps_dist  = static_cast<Real>(1e-6 * diag);
+  const Real eps_angle = static_cast<Real>(1e-6);
+
+  // Distances and unit vectors from point to cage points, where the loops over
+  // the contiguous coordinate arrays are vectorized by the compiler
+  const Real x = static_cast<Real>(p[0]);
+  const Real y = static_cast<Real>(p[1]);
+  const Real z = static_cast<Real>(p[2]);
+  for (int i = 0; i < n; ++i) {
+    ux[i] = px[i] - x;
+    uy[i] = py[i] - y;
+    uz[i] = pz[i] - z;
+    d [i] = sqrt(ux[i] * ux[i] + uy[i] * uy[i] + uz[i] * uz[i]);
+  }
+  for (int i = 0; i < n; ++i) {
+    if (d[i] < eps_dist) {
+      if (v) for (int j = 0; j < m; ++j) v[j] = _CageValues[m * i + j];
+      if (w) w[i] = 1.0;
+      return true;
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    const Real s = Real(1) / d[i];
+    ux[i] *= s;
+    uy[i] *= s;
+    uz[i] *= s;
+  }
+
+  // Accumulate mean value coordinates of cage triangles
+  double sum_w = .0, sum_omega = .0, wa, wb, wc;
+  for (int t = 0; t < nt; ++t) {
+    const int a = t0[t], b = t1[t], c = t2[t];
+    const Real ua[3] = { ux[a], uy[a], uz[a] };
+    const Real ub[3] = { ux[b], uy[b], uz[b] };
+    const Real uc[3] = { ux[c], uy[c], uz[c] };
+
+    const Real la = sqrt(pow(ub[0] - uc[0], 2) + pow(ub[1] - uc[1], 2) + pow(ub[2] - uc[2], 2));
+    const Real lb = sqrt(pow(uc[0] - ua[0], 2) + pow(uc[1] - ua[1], 2) + pow(uc[2] - ua[2], 2));
+    const Real lc = sqrt(pow(ua[0] - ub[0], 2) + pow(ua[1] - ub[1], 2) + pow(ua[2] - ub[2], 2));
+    const Real ta = Real(2) * asin(min(Real(.5) * la, Real(1)));
+    const Real tb = Real(2) * asin(min(Real(.5) * lb, Real(1)));
+    const Real tc = Real(2) * asin(min(Real(.5) * lc, Real(1)));
+    const Real h  = Real(.5) * (ta + tb + tc);
+
+    const Real det = ua[0] * (ub[1] * uc[2] - ub[2] * uc[1])
+                   + ua[1] * (ub[2] * uc[0] - ub[0] * uc[2])
+                   + ua[2] * (ub[0] * uc[1] - ub[1] * uc[0]);
+
+    // Signed solid angle of triangle used to test whether point is inside
+    const Real dot = Real(1) + ua[0] * ub[0] + ua[1] * ub[1] + ua[2] * ub[2]
+                             + ub[0] * uc[0] + ub[1] * uc[1] + ub[2] * uc[2]
+                             + uc[0] * ua[0] + uc[1] * ua[1] + uc[2] * ua[2];
+    sum_omega += 2.0 * atan2(static_cast<double>(det), static_cast<double>(dot));
+
+    // Point lies on triangle, use its 2D barycentric coordinates
+    if (pi - h < eps_angle) {
+      wa = sin(ta) * d[b] * d[c];
+      wb = sin(tb) * d[c] * d[a];
+      wc = sin(tc) * d[a] * d[b];
+      const double s = wa + wb + wc;
+      if (v) {
+        for (int j = 0; j < m; ++j) {
+          v[j] = (wa * _CageValues[m * a + j] + wb * _CageValues[m * b + j] + wc * _CageValues[m * c + j]) / s;
+        }
+      }
+      if (w) {
+        for (int i = 0; i < n; ++i) w[i] = .0;
+        w[a] = wa / s, w[b] = wb / s, w[c] = wc / s;
+      }
+      return true;
+    }
+
+    const Real sa = sin(ta), sb = sin(tb), sc = sin(tc);
+    if (sa <= eps_angle || sb <= eps_angle || sc <= eps_angle) continue;
+    const Real ca = Real(2) * sin(h) * sin(h - ta) / (sb * sc) - Real(1);
+    const Real cb = Real(2) * sin(h) * sin(h - tb) / (sc * sa) - Real(1);
+    const Real cc = Real(2) * sin(h) * sin(h - tc) / (sa * sb) - Real(1);
+    const Real sign = (det < Real(0) ? Real(-1) : Real(1));
+    const Real qa = sign * sqrt(max(Real(0), Real(1) - ca * ca));
+    const Real qb = sign * sqrt(max(Real(0), Real(1) - cb * cb));
+    const Real qc = sign * sqrt(max(Real(0), Real(1) - cc * cc));
+
+    // Point lies outside triangle on the same plane, ignore triangle
+    if (abs(qa) <= eps_angle || abs(qb) <= eps_angle || abs(qc) <= eps_angle) continue;
+
+    wa = (ta - cb * tc - cc * tb) / (d[a] * sb * qc);
+    wb = (tb - cc * ta - ca * tc) / (d[b] * sc * qa);
+    wc = (tc - ca * tb - cb * ta) / (d[c] * sa * qb);
+    sum_w += wa + wb + wc;
+    if (v) {
+      for (int j = 0; j < m; ++j) {
+        v[j] += wa * _CageValues[m * a + j] + wb * _CageValues[m * b + j] + wc * _CageValues[m * c + j];
+      }
+    }
+    if (w) {
+      w[a] += wa, w[b] += wb, w[c] += wc;
+    }
+  }
+
+  // Winding number of cage around point is zero outside
+  if (abs(sum_omega) < two_pi || sum_w == .0) {
+    if (v) for (int j = 0; j < m; ++j) v[j] = _OutsideValue;
+    if (w) for (int i = 0; i < n; ++i) w[i] = .0;
+    return false;
+  }
+  if (v) for (int j = 0; j < m; ++j) v[j] /= sum_w;
+  if (w) for (int i = 0; i < n; ++i) w[i] /= sum_w;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool MeanValueCoordinatesVolumeMap::Evaluate(double *v, double x, double y, double z) const
+{
+  const double p[3] = { x, y, z };
+  Array<Real> buffer(4 * _NumberOfCagePoints);
+  return EvaluateCoordinates(p, v, nullptr, buffer.data());
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateMeanValueMap eval;
+  eval._Map    = this;
+  eval._Points = xyz;
+  eval._Values = values;
+  eval._Inside = inside;
+  parallel_for(blocked_range<int>(0, n), eval);
+}
+
+// -----------------------------------------------------------------------------
+template <class T>
+void EvaluateWithWeights(const MeanValueCoordinatesVolumeMap *map,
+                         const Array<int64_t> &offset, const Array<int> &index,
+                         const Array<float> &weight, const Array<double> &values,
+                         GenericImage<T> &f, int l)
+{
+  const int nt = max(f.T(), 1);
+  if (l < 0 || l + nt > map->NumberOfComponents()) {
+    cerr << map->NameOfType() << "::Evaluate: Component index out of range" << endl;
+    exit(1);
+  }
+  EvaluateWeightedSum<T> eval;
+  eval._Offset             = offset.data();
+  eval._Index              = index.data();
+  eval._Weight             = weight.data();
+  eval._CageValues         = values.data();
+  eval._Dimension          = map->NumberOfComponents();
+  eval._FirstComponent     = l;
+  eval._NumberOfComponents = nt;
+  eval._NumberOfVoxels     = static_cast<int64_t>(f.X()) * static_cast<int64_t>(f.Y()) * static_cast<int64_t>(f.Z());
+  eval._OutsideValue       = map->OutsideValue();
+  eval._Output             = f.GetPointerToVoxels();
+  parallel_for(blocked_range<int64_t>(0, eval._NumberOfVoxels), eval);
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap
+::Evaluate(GenericImage<float> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  if (!m && HasWeights(f.Attributes())) {
+    EvaluateWithWeights(this, _WeightOffset, _WeightIndex, _WeightValue, _CageValues, f, l);
+  } else {
+    Mapping::Evaluate(f, l, m);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap
+::Evaluate(GenericImage<double> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  if (!m && HasWeights(f.Attributes())) {
+    EvaluateWithWeights(this, _WeightOffset, _WeightIndex, _WeightValue, _CageValues, f, l);
+  } else {
+    Mapping::Evaluate(f, l, m);
+  }
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::ReadMap(Cifstream &is)
+{
+  int info[4];
+  is.ReadAsInt(info, 4);
+  const int n  = info[0];
+  const int nt = info[1];
+  const int m  = info[2];
+  if (n < 4 || nt < 1 || m < 1) {
+    cerr << this->NameOfType() << "::ReadMap: Invalid cage size" << endl;
+    exit(1);
+  }
+
+  // Cage surface and point values
+  vtkNew<vtkDoubleArray> coords;
+  coords->SetNumberOfComponents(3);
+  coords->SetNumberOfTuples(n);
+  is.ReadAsDouble(coords->GetPointer(0), 3 * n);
+  vtkNew<vtkPoints> points;
+  points->SetData(coords.GetPointer());
+
+  Array<int> triangles(3 * nt);
+  is.ReadAsInt(triangles.data(), 3 * nt);
+  vtkNew<vtkCellArray> cells;
+  vtkIdType pts[3];
+  for (int t = 0; t < nt; ++t) {
+    for (int i = 0; i < 3; ++i) {
+      if (triangles[3 * t + i] < 0 || triangles[3 * t + i] >= n) {
+        cerr << this->NameOfType() << "::ReadMap: Invalid cage triangle" << endl;
+        exit(1);
+      }
+      pts[i] = static_cast<vtkIdType>(triangles[3 * t + i]);
+    }
+    cells->InsertNextCell(3, pts);
+  }
+  _Cage = vtkSmartPointer<vtkPolyData>::New();
+  _Cage->SetPoints(points.GetPointer());
+  _Cage->SetPolys(cells.GetPointer());
+
+  vtkSmartPointer<vtkDoubleArray> values = vtkSmartPointer<vtkDoubleArray>::New();
+  values->SetName("CageValues");
+  values->SetNumberOfComponents(m);
+  values->SetNumberOfTuples(n);
+  is.ReadAsDouble(values->GetPointer(0), n * m);
+  _Values = values;
+  is.ReadAsDouble(&_WeightThreshold, 1);
+
+  // Initialize cage before the precomputed weights are restored
+  ClearWeights();
+  this->Initialize();
+  if (info[3] != 0) {
+    int    size[3];
+    double geom[15];
+    is.ReadAsInt(size, 3);
+    is.ReadAsDouble(geom, 15);
+    ImageAttributes lattice;
+    lattice._x       = size[0];
+    lattice._y       = size[1];
+    lattice._z       = size[2];
+    lattice._xorigin = geom[0];
+    lattice._yorigin = geom[1];
+    lattice._zorigin = geom[2];
+    lattice._dx      = geom[3];
+    lattice._dy      = geom[4];
+    lattice._dz      = geom[5];
+    for (int d = 0; d < 3; ++d) {
+      lattice._xaxis[d] = geom[ 6 + d];
+      lattice._yaxis[d] = geom[ 9 + d];
+      lattice._zaxis[d] = geom[12 + d];
+    }
+    const int64_t nvox = static_cast<int64_t>(size[0]) * static_cast<int64_t>(size[1]) * static_cast<int64_t>(size[2]);
+    Array<int> count(nvox);
+    is.ReadAsInt(count.data(), nvox);
+    _WeightOffset.resize(nvox + 1);
+    _WeightOffset[0] = 0;
+    for (int64_t vox = 0; vox < nvox; ++vox) {
+      _WeightOffset[vox + 1] = _WeightOffset[vox] + static_cast<int64_t>(count[vox]);
+    }
+    _WeightIndex.resize(_WeightOffset[nvox]);
+    _WeightValue.resize(_WeightOffset[nvox]);
+    is.ReadAsInt  (_WeightIndex.data(), _WeightOffset[nvox]);
+    is.ReadAsFloat(_WeightValue.data(), _WeightOffset[nvox]);
+    for (size_t k = 0; k < _WeightIndex.size(); ++k) {
+      if (_WeightIndex[k] < 0 || _WeightIndex[k] >= n) {
+        cerr << this->NameOfType() << "::ReadMap: Invalid cage point index of precomputed weight" << endl;
+        exit(1);
+      }
+    }
+    _WeightsLattice = lattice;
+    _WeightsHash    = _CageHash;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMap::WriteMap(Cofstream &os) const
+{
+  const int n  = _NumberOfCagePoints;
+  const int nt = _NumberOfCageTriangles;
+  const int m  = _Dimension;
+  const bool has_weights = (!_WeightOffset.empty() && _WeightsHash == _CageHash);
+
+  int info[4] = { n, nt, m, has_weights ? 1 : 0 };
+  os.WriteAsInt(info, 4);
+
+  Array<double> coords(3 * n);
+  for (int i = 0; i < n; ++i) {
+    _Cage->GetPoint(static_cast<vtkIdType>(i), coords.data() + 3 * i);
+  }
+  os.WriteAsDouble(coords.data(), 3 * n);
+  Array<int> triangles(3 * nt);
+  for (int t = 0; t < nt; ++t) {
+    triangles[3 * t    ] = _CageTriangles[t];
+    triangles[3 * t + 1] = _CageTriangles[t + nt];
+    triangles[3 * t + 2] = _CageTriangles[t + 2 * nt];
+  }
+  os.WriteAsInt(triangles.data(), 3 * nt);
+  os.WriteAsDouble(_CageValues.data(), n * m);
+  os.WriteAsDouble(&_WeightThreshold, 1);
+
+  if (has_weights) {
+    const ImageAttributes &lattice = _WeightsLattice;
+    int    size[3] = { lattice._x, lattice._y, lattice._z };
+    double geom[15] = {
+      lattice._xorigin, lattice._yorigin, lattice._zorigin,
+      lattice._dx,      lattice._dy,      lattice._dz,
+      lattice._xaxis[0], lattice._xaxis[1], lattice._xaxis[2],
+      lattice._yaxis[0], lattice._yaxis[1], lattice._yaxis[2],
+      lattice._zaxis[0], lattice._zaxis[1], lattice._zaxis[2]
+    };
+    os.WriteAsInt(size, 3);
+    os.WriteAsDouble(geom, 15);
+    const int64_t nvox = static_cast<int64_t>(_WeightOffset.size()) - 1;
+    Array<int> count(nvox);
+    for (int64_t vox = 0; vox < nvox; ++vox) {
+      count[vox] = static_cast<int>(_WeightOffset[vox + 1] - _WeightOffset[vox]);
+    }
+    os.WriteAsInt(count.data(), nvox);
+    os.WriteAsInt  (_WeightIndex.data(), static_cast<int64_t>(_WeightIndex.size()));
+    os.WriteAsFloat(_WeightValue.data(), static_cast<int64_t>(_WeightValue.size()));
+  }
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,102 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MeanValueCoordinatesVolumeMapper.h"
+
+#include "mirtk/MeanValueCoordinatesVolumeMap.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMapper
+::CopyAttributes(const MeanValueCoordinatesVolumeMapper &other)
+{
+  _WeightsLattice  = other._WeightsLattice;
+  _WeightThreshold = other._WeightThreshold;
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMapper::MeanValueCoordinatesVolumeMapper()
+:
+  _WeightThreshold(1e-4)
+{
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMapper
+::MeanValueCoordinatesVolumeMapper(const MeanValueCoordinatesVolumeMapper &other)
+:
+  VolumeMapper(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMapper &MeanValueCoordinatesVolumeMapper
+::operator =(const MeanValueCoordinatesVolumeMapper &other)
+{
+  if (this != &other) {
+    VolumeMapper::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+MeanValueCoordinatesVolumeMapper::~MeanValueCoordinatesVolumeMapper()
+{
+}
+
+// =============================================================================
+// Execution
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMapper::Initialize()
+{
+  // Initialize base class
+  VolumeMapper::Initialize();
+
+  // Extract boundary surface, i.e., cage of mean value coordinates
+  this->InitializeBoundary(_InputSet, _InputMap);
+}
+
+// -----------------------------------------------------------------------------
+void MeanValueCoordinatesVolumeMapper::Solve()
+{
+  SharedPtr<MeanValueCoordinatesVolumeMap> map = NewShared<MeanValueCoordinatesVolumeMap>();
+  map->Cage(_Boundary);
+  map->Values(_BoundaryMap);
+  map->WeightThreshold(_WeightThreshold);
+  if (_WeightsLattice._x > 0 && _WeightsLattice._y > 0 && _WeightsLattice._z > 0) {
+    MapperStatistics::Timer timer(&_Statistics, "weights");
+    map->Initialize();
+    map->PrecomputeWeights(_WeightsLattice);
+  }
+  _Output = map;
+}
+
+
+} // namespace mirtk
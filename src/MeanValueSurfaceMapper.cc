@@ -77,37 +77,20 @@ MeanValueSurfaceMapper::~MeanValueSurfaceMapper()
 // to compute the required tangens weights using only inner and outer vector products
 double MeanValueSurfaceMapper::Weight(int i, int j) const
 {
-  double a[3], b[3], c[3], ab[3], ac[3], n[3], d_ab, d_ac, n_norm, w;
-
-  int k, l;
-  if (GetEdgeNeighborPoints(i, j, k, l) > 2 || k < 0) {
+  int t[2], k[2];
+  if (GetEdgeTriangles(i, j, t, k) == 0) {
     cerr << this->NameOfType() << "::Weight: Surface mesh must be triangulated!" << endl;
     exit(1);
   }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
-  _Surface->GetPoint(static_cast<vtkIdType>(i), a);
-  _Surface->GetPoint(static_cast<vtkIdType>(j), b);
-  vtkMath::Subtract(b, a, ab);
-  d_ab = vtkMath::Norm(ab);
-
-  _Surface->GetPoint(static_cast<vtkIdType>(k), c);
-  vtkMath::Subtract(c, a, ac);
-  vtkMath::Cross(ab, ac, n);
-  d_ac   = vtkMath::Norm(ac);
-  n_norm = vtkMath::Norm(n);
-
-  w = (d_ab * d_ac - vtkMath::Dot(ab, ac)) / n_norm;
-
-  if (l >= 0) {
-    _Surface->GetPoint(static_cast<vtkIdType>(l), c);
-    vtkMath::Subtract(c, a, ac);
-    vtkMath::Cross(ab, ac, n);
-    d_ac   = vtkMath::Norm(ac);
-    n_norm = vtkMath::Norm(n);
-    w += (d_ab * d_ac - vtkMath::Dot(ab, ac)) / n_norm;
+  // Tangent of half the angle at i of each triangle adjacent to edge (i, j)
+  double w = tan(.5 * tris.Angle(t[0], tris.Corner(t[0], i)));
+  if (t[1] >= 0) {
+    w += tan(.5 * tris.Angle(t[1], tris.Corner(t[1], i)));
   }
 
-  return w / d_ab;
+  return w / tris.EdgeLength(t[0], k[0]);
 }
 
 
@@ -82,6 +82,63 @@ MeshlessBiharmonicMap::~MeshlessBiharmonicMap()
 {
 }
 
+// -----------------------------------------------------------------------------
+void MeshlessBiharmonicMap::ResizeCoefficients(int n)
+{
+  const int n0  = _Coefficients.Rows() / 2;
+  const int dim = _Coefficients.Cols();
+  if (n == n0) return;
+  Matrix coeffs(2 * n, dim);
+  const int nc = min(n, n0);
+  for (int j = 0; j < dim; ++j)
+  for (int i = 0; i < nc;  ++i) {
+    coeffs(i,     j) = _Coefficients(i,      j);
+    coeffs(n + i, j) = _Coefficients(n0 + i, j);
+  }
+  _Coefficients = coeffs;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessBiharmonicMap::SelectCoefficients(const Array<int> &keep)
+{
+  const int n0  = _Coefficients.Rows() / 2;
+  const int n   = static_cast<int>(keep.size());
+  const int dim = _Coefficients.Cols();
+  Matrix coeffs(2 * n, dim);
+  for (int j = 0; j < dim; ++j)
+  for (int i = 0; i < n;   ++i) {
+    coeffs(i,     j) = _Coefficients(keep[i],      j);
+    coeffs(n + i, j) = _Coefficients(n0 + keep[i], j);
+  }
+  _Coefficients = coeffs;
+}
+
+// =============================================================================
+// Source points
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessBiharmonicMap::ClearCoefficients(int i)
+{
+  const int n = _Coefficients.Rows() / 2;
+  for (int j = 0; j < _Coefficients.Cols(); ++j) {
+    _Coefficients(i,     j) = .0;
+    _Coefficients(n + i, j) = .0;
+  }
+}
+
+// -----------------------------------------------------------------------------
+double MeshlessBiharmonicMap::CoefficientsNorm(int i) const
+{
+  const int n = _Coefficients.Rows() / 2;
+  double norm2 = .0;
+  for (int j = 0; j < _Coefficients.Cols(); ++j) {
+    norm2 += _Coefficients(i,     j) * _Coefficients(i,     j);
+    norm2 += _Coefficients(n + i, j) * _Coefficients(n + i, j);
+  }
+  return sqrt(norm2);
+}
+
 // =============================================================================
 // Evaluation
 // =============================================================================
@@ -89,50 +146,48 @@ MeshlessBiharmonicMap::~MeshlessBiharmonicMap()
 // -----------------------------------------------------------------------------
 bool MeshlessBiharmonicMap::Evaluate(double *v, double x, double y, double z) const
 {
-  const int n = _SourcePoints.Size();
+  const int   n   = _SourcePoints.Size();
+  const int   dim = _Coefficients.Cols();
+  const Point p(x, y, z);
 
-  Point p(x, y, z);
-  double    d, h, b;
-
-  for (int j = 0; j < _Coefficients.Cols(); ++j) {
+  for (int j = 0; j < dim; ++j) {
     v[j] = .0;
   }
-
-  for (int i = 0; i < n; ++i) {
-    d = p.Distance(_SourcePoints(i));
-    if (d < 1e-12) {
-      for (int j = 0; j < _Coefficients.Cols(); ++j) {
-        v[j] = _OutsideValue;
-      }
-      return false;
-    }
-    h = H(d);
-    b = B(d);
-    for (int j = 0; j < _Coefficients.Cols(); ++j) {
-      v[j] += h * _Coefficients(i,     j);
-      v[j] += b * _Coefficients(i + n, j);
+  if (!AddKernelSum(MeshlessHarmonicKernel(), _SourcePoints, _Coefficients, 0, p, v, 0, dim)) {
+    for (int j = 0; j < dim; ++j) {
+      v[j] = _OutsideValue;
     }
+    return false;
   }
-
+  AddKernelSum(MeshlessBiharmonicKernel(), _SourcePoints, _Coefficients, n, p, v, 0, dim);
   return true;
 }
 
 // -----------------------------------------------------------------------------
 double MeshlessBiharmonicMap::Evaluate(double x, double y, double z, int l) const
 {
-  const int n = _SourcePoints.Size();
+  double v;
+  MeshlessBiharmonicMap::Evaluate(&v, x, y, z, l, l + 1);
+  return v;
+}
 
-  Point p(x, y, z);
-  double    d, v = .0;
+// -----------------------------------------------------------------------------
+bool MeshlessBiharmonicMap::Evaluate(double *v, double x, double y, double z, int l1, int l2) const
+{
+  const int   n = _SourcePoints.Size();
+  const Point p(x, y, z);
 
-  for (int i = 0; i < n; ++i) {
-    d = p.Distance(_SourcePoints(i));
-    if (d < 1e-12) return _OutsideValue;
-    v += H(d) * _Coefficients(i,     l);
-    v += B(d) * _Coefficients(i + n, l);
+  for (int j = l1; j < l2; ++j) {
+    v[j - l1] = .0;
   }
-
-  return v;
+  if (!AddKernelSum(MeshlessHarmonicKernel(), _SourcePoints, _Coefficients, 0, p, v, l1, l2)) {
+    for (int j = l1; j < l2; ++j) {
+      v[j - l1] = _OutsideValue;
+    }
+    return false;
+  }
+  AddKernelSum(MeshlessBiharmonicKernel(), _SourcePoints, _Coefficients, n, p, v, l1, l2);
+  return true;
 }
 
 
@@ -0,0 +1,59 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MeshlessBiharmonicVolumeMapper.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+MeshlessBiharmonicVolumeMapper::MeshlessBiharmonicVolumeMapper()
+{
+}
+
+// -----------------------------------------------------------------------------
+MeshlessBiharmonicVolumeMapper
+::MeshlessBiharmonicVolumeMapper(const MeshlessBiharmonicVolumeMapper &other)
+:
+  MeshlessHarmonicVolumeMapper(other)
+{
+}
+
+// -----------------------------------------------------------------------------
+MeshlessBiharmonicVolumeMapper &MeshlessBiharmonicVolumeMapper
+::operator =(const MeshlessBiharmonicVolumeMapper &other)
+{
+  if (this != &other) {
+    MeshlessHarmonicVolumeMapper::operator =(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+MeshlessBiharmonicVolumeMapper::~MeshlessBiharmonicVolumeMapper()
+{
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,371 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MeshlessCompactMap.h"
+
+#include "mirtk/Point.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/Cfstream.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliary functors
+// =============================================================================
+
+namespace MeshlessCompactMapUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at contiguous set of points
+struct EvaluateMapAtPoints
+{
+  const MeshlessCompactMap *_Map;
+  const double             *_Points;
+  double                   *_Values;
+  bool                     *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int dim = _Map->NumberOfComponents();
+    const double *p = _Points + 3 * re.begin();
+    double       *v = _Values + dim * re.begin();
+    for (int i = re.begin(); i != re.end(); ++i, p += 3, v += dim) {
+      const bool inside = _Map->Evaluate(v, p[0], p[1], p[2]);
+      if (_Inside) _Inside[i] = inside;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Clamp lattice index of a coordinate to the range [-1, n]
+inline int CellIndex(double x, double origin, double spacing, int n)
+{
+  const double c = floor((x - origin) / spacing);
+  if (c < -1.) return -1;
+  if (c > static_cast<double>(n)) return n;
+  return static_cast<int>(c);
+}
+
+
+} // namespace MeshlessCompactMapUtils
+using namespace MeshlessCompactMapUtils;
+
+
+// =============================================================================
+// Construction/destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::CopyAttributes(const MeshlessCompactMap &other)
+{
+  _SupportRadius      = other._SupportRadius;
+  _AffineCoefficients = other._AffineCoefficients;
+  _GridSpacing        = other._GridSpacing;
+  _CellOffset         = other._CellOffset;
+  _CellIndex          = other._CellIndex;
+  for (int i = 0; i < 3; ++i) {
+    _GridOrigin[i] = other._GridOrigin[i];
+    _GridSize  [i] = other._GridSize  [i];
+  }
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactMap::MeshlessCompactMap()
+:
+  _SupportRadius(.0),
+  _GridSpacing(.0)
+{
+  _GridOrigin[0] = _GridOrigin[1] = _GridOrigin[2] = .0;
+  _GridSize  [0] = _GridSize  [1] = _GridSize  [2] = 0;
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactMap::MeshlessCompactMap(const MeshlessCompactMap &other)
+:
+  MeshlessMap(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactMap &MeshlessCompactMap::operator =(const MeshlessCompactMap &other)
+{
+  if (this != &other) {
+    MeshlessMap::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::Initialize()
+{
+  // Initialize base class
+  MeshlessMap::Initialize();
+
+  // Check parameters
+  if (_SupportRadius <= .0) {
+    cerr << this->NameOfType() << "::Initialize: Support radius must be positive" << endl;
+    exit(1);
+  }
+  if (_AffineCoefficients.Rows() != 0) {
+    if (_AffineCoefficients.Rows() != 4 || _AffineCoefficients.Cols() != _Coefficients.Cols()) {
+      cerr << this->NameOfType() << "::Initialize: Affine coefficients must be 4 x " << _Coefficients.Cols() << " matrix" << endl;
+      exit(1);
+    }
+  }
+
+  // Build grid index of source points
+  UpdateSourceGrid();
+}
+
+// -----------------------------------------------------------------------------
+Mapping *MeshlessCompactMap::NewCopy() const
+{
+  return new MeshlessCompactMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactMap::~MeshlessCompactMap()
+{
+}
+
+// =============================================================================
+// Source points
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::UpdateSourceGrid()
+{
+  const int n = _SourcePoints.Size();
+
+  _CellOffset.clear();
+  _CellIndex.clear();
+  if (n == 0 || _SupportRadius <= .0) return;
+
+  double bounds[6] = { +inf, -inf, +inf, -inf, +inf, -inf };
+  for (int j = 0; j < n; ++j) {
+    const Point &p = _SourcePoints(j);
+    bounds[0] = min(bounds[0], p._x), bounds[1] = max(bounds[1], p._x);
+    bounds[2] = min(bounds[2], p._y), bounds[3] = max(bounds[3], p._y);
+    bounds[4] = min(bounds[4], p._z), bounds[5] = max(bounds[5], p._z);
+  }
+  _GridOrigin[0] = bounds[0];
+  _GridOrigin[1] = bounds[2];
+  _GridOrigin[2] = bounds[4];
+
+  // Cells of the size of the support radius, such that the source points
+  // within the support of a point are in the 3x3x3 neighboring cells, unless
+  // the number of cells would be excessive compared to the number of points
+  double ncells;
+  _GridSpacing = _SupportRadius;
+  do {
+    ncells = 1.;
+    for (int i = 0; i < 3; ++i) {
+      _GridSize[i] = static_cast<int>((bounds[2*i+1] - bounds[2*i]) / _GridSpacing) + 1;
+      ncells *= _GridSize[i];
+    }
+    if (ncells > 8. * n + 64.) _GridSpacing *= 2.;
+  } while (ncells > 8. * n + 64.);
+
+  // Sort source points by cell in compressed row format
+  Array<int> cell(n);
+  _CellOffset.resize(static_cast<size_t>(ncells) + 1, 0);
+  for (int j = 0; j < n; ++j) {
+    const Point &p = _SourcePoints(j);
+    int c[3] = {
+      CellIndex(p._x, _GridOrigin[0], _GridSpacing, _GridSize[0]),
+      CellIndex(p._y, _GridOrigin[1], _GridSpacing, _GridSize[1]),
+      CellIndex(p._z, _GridOrigin[2], _GridSpacing, _GridSize[2])
+    };
+    for (int i = 0; i < 3; ++i) {
+      c[i] = max(0, min(c[i], _GridSize[i] - 1));
+    }
+    cell[j] = (c[2] * _GridSize[1] + c[1]) * _GridSize[0] + c[0];
+    ++_CellOffset[cell[j] + 1];
+  }
+  for (size_t c = 1; c < _CellOffset.size(); ++c) {
+    _CellOffset[c] += _CellOffset[c - 1];
+  }
+  Array<int> pos(_CellOffset.begin(), _CellOffset.end() - 1);
+  _CellIndex.resize(n);
+  for (int j = 0; j < n; ++j) {
+    _CellIndex[pos[cell[j]]++] = j;
+  }
+}
+
+// -----------------------------------------------------------------------------
+int MeshlessCompactMap::FindSourcePoints(double x, double y, double z,
+                                         Array<int> &ids, Array<double> &dist) const
+{
+  const double r = _SupportRadius;
+  const Point  p(x, y, z);
+  double       d;
+
+  ids.clear();
+  dist.clear();
+  if (static_cast<int>(_CellIndex.size()) != _SourcePoints.Size() || _CellIndex.empty()) {
+    for (int j = 0; j < _SourcePoints.Size(); ++j) {
+      d = p.Distance(_SourcePoints(j));
+      if (d < r) ids.push_back(j), dist.push_back(d);
+    }
+  } else {
+    const int i1 = max(0,                CellIndex(x - r, _GridOrigin[0], _GridSpacing, _GridSize[0]));
+    const int i2 = min(_GridSize[0] - 1, CellIndex(x + r, _GridOrigin[0], _GridSpacing, _GridSize[0]));
+    const int j1 = max(0,                CellIndex(y - r, _GridOrigin[1], _GridSpacing, _GridSize[1]));
+    const int j2 = min(_GridSize[1] - 1, CellIndex(y + r, _GridOrigin[1], _GridSpacing, _GridSize[1]));
+    const int k1 = max(0,                CellIndex(z - r, _GridOrigin[2], _GridSpacing, _GridSize[2]));
+    const int k2 = min(_GridSize[2] - 1, CellIndex(z + r, _GridOrigin[2], _GridSpacing, _GridSize[2]));
+    for (int k = k1; k <= k2; ++k)
+    for (int j = j1; j <= j2; ++j) {
+      const int c = (k * _GridSize[1] + j) * _GridSize[0];
+      for (int idx = _CellOffset[c + i1]; idx < _CellOffset[c + i2 + 1]; ++idx) {
+        d = p.Distance(_SourcePoints(_CellIndex[idx]));
+        if (d < r) ids.push_back(_CellIndex[idx]), dist.push_back(d);
+      }
+    }
+  }
+  return static_cast<int>(ids.size());
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::AddKernelSum(double *v, double x, double y, double z, int l1, int l2) const
+{
+  const double r = _SupportRadius;
+  const Point  p(x, y, z);
+  double       d, w;
+
+  const MeshlessWendlandKernel kernel(r);
+  if (static_cast<int>(_CellIndex.size()) != _SourcePoints.Size() || _CellIndex.empty()) {
+    mirtk::AddKernelSum(kernel, _SourcePoints, _Coefficients, 0, p, v, l1, l2);
+  } else {
+    // Consecutive cells of a lattice row are stored contiguously, such that
+    // the source points of the cells of a row are visited in a single loop
+    const int i1 = max(0,                CellIndex(x - r, _GridOrigin[0], _GridSpacing, _GridSize[0]));
+    const int i2 = min(_GridSize[0] - 1, CellIndex(x + r, _GridOrigin[0], _GridSpacing, _GridSize[0]));
+    const int j1 = max(0,                CellIndex(y - r, _GridOrigin[1], _GridSpacing, _GridSize[1]));
+    const int j2 = min(_GridSize[1] - 1, CellIndex(y + r, _GridOrigin[1], _GridSpacing, _GridSize[1]));
+    const int k1 = max(0,                CellIndex(z - r, _GridOrigin[2], _GridSpacing, _GridSize[2]));
+    const int k2 = min(_GridSize[2] - 1, CellIndex(z + r, _GridOrigin[2], _GridSpacing, _GridSize[2]));
+    for (int k = k1; k <= k2; ++k)
+    for (int j = j1; j <= j2; ++j) {
+      const int c = (k * _GridSize[1] + j) * _GridSize[0];
+      for (int idx = _CellOffset[c + i1]; idx < _CellOffset[c + i2 + 1]; ++idx) {
+        const int s = _CellIndex[idx];
+        d = p.Distance(_SourcePoints(s));
+        if (d < r) {
+          w = kernel(d);
+          for (int l = l1; l < l2; ++l) v[l - l1] += w * _Coefficients(s, l);
+        }
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessCompactMap::Evaluate(double *v, double x, double y, double z) const
+{
+  const int dim = _Coefficients.Cols();
+  if (_AffineCoefficients.Rows() == 4) {
+    for (int l = 0; l < dim; ++l) {
+      v[l] = _AffineCoefficients(0, l) * x
+           + _AffineCoefficients(1, l) * y
+           + _AffineCoefficients(2, l) * z
+           + _AffineCoefficients(3, l);
+    }
+  } else {
+    for (int l = 0; l < dim; ++l) v[l] = .0;
+  }
+  AddKernelSum(v, x, y, z, 0, dim);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+double MeshlessCompactMap::Evaluate(double x, double y, double z, int l) const
+{
+  double v = .0;
+  if (_AffineCoefficients.Rows() == 4) {
+    v = _AffineCoefficients(0, l) * x
+      + _AffineCoefficients(1, l) * y
+      + _AffineCoefficients(2, l) * z
+      + _AffineCoefficients(3, l);
+  }
+  AddKernelSum(&v, x, y, z, l, l + 1);
+  return v;
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessCompactMap::Evaluate(double *v, double x, double y, double z, int l1, int l2) const
+{
+  if (_AffineCoefficients.Rows() == 4) {
+    for (int l = l1; l < l2; ++l) {
+      v[l - l1] = _AffineCoefficients(0, l) * x
+                + _AffineCoefficients(1, l) * y
+                + _AffineCoefficients(2, l) * z
+                + _AffineCoefficients(3, l);
+    }
+  } else {
+    for (int l = l1; l < l2; ++l) v[l - l1] = .0;
+  }
+  AddKernelSum(v, x, y, z, l1, l2);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateMapAtPoints eval;
+  eval._Map    = this;
+  eval._Points = xyz;
+  eval._Values = values;
+  eval._Inside = inside;
+  parallel_for(blocked_range<int>(0, n), eval);
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::ReadMap(Cifstream &is)
+{
+  MeshlessMap::ReadMap(is);
+  is.ReadAsDouble(&_SupportRadius, 1);
+  is >> _AffineCoefficients;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactMap::WriteMap(Cofstream &os) const
+{
+  MeshlessMap::WriteMap(os);
+  double radius = _SupportRadius;
+  os.WriteAsDouble(&radius, 1);
+  os << _AffineCoefficients;
+}
+
+
+} // namespace mirtk
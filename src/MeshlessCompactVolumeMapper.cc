@@ -0,0 +1,545 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MeshlessCompactVolumeMapper.h"
+#include "mirtk/MeshlessCompactMap.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Assert.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Array.h"
+#include "mirtk/Pair.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/PointSet.h"
+#include "mirtk/Matrix.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/SparseSolver.h"
+
+#include "vtkPoints.h"
+#include "vtkPointData.h"
+
+#include "mirtk/Eigen.h"
+#include "Eigen/SparseCore"
+#include "Eigen/Cholesky"
+
+
+namespace mirtk {
+
+
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
+// =============================================================================
+// Auxiliary functors
+// =============================================================================
+
+namespace MeshlessCompactVolumeMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Count source points within support radius of each boundary point
+struct CountKernelEntries
+{
+  const MeshlessCompactMap *_Map;
+  vtkPoints                *_Points;
+  int                      *_Count;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    Array<int>    ids;
+    Array<double> dist;
+    double        p[3];
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Points->GetPoint(i, p);
+      _Count[i] = _Map->FindSourcePoints(p[0], p[1], p[2], ids, dist);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute kernel function values of each boundary point in compressed row format
+struct FillKernelEntries
+{
+  const MeshlessCompactMap *_Map;
+  vtkPoints                *_Points;
+  const int                *_Offset;
+  int                      *_Index;
+  double                   *_Value;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double r = _Map->SupportRadius();
+
+    Array<int>                ids;
+    Array<double>             dist;
+    Array<Pair<int, double> > row;
+    double                    p[3];
+
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Points->GetPoint(i, p);
+      const int n = _Map->FindSourcePoints(p[0], p[1], p[2], ids, dist);
+      mirtkAssert(n == _Offset[i + 1] - _Offset[i], "number of source points unchanged");
+      row.resize(n);
+      for (int l = 0; l < n; ++l) {
+        row[l] = MakePair(ids[l], MeshlessCompactMap::W(dist[l], r));
+      }
+      sort(row.begin(), row.end());
+      for (int l = 0, k = _Offset[i]; l < n; ++l, ++k) {
+        _Index[k] = row[l].first;
+        _Value[k] = row[l].second;
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute normal equations of least squares fit of affine map
+struct ComputeAffineNormalEquations
+{
+  vtkPoints       *_Points;
+  vtkDataArray    *_ResidualMap;
+  int              _OutputDimension;
+  Eigen::MatrixXd  _A;
+  Eigen::MatrixXd  _B;
+
+  ComputeAffineNormalEquations() {}
+
+  ComputeAffineNormalEquations(const ComputeAffineNormalEquations &other, split)
+  :
+    _Points(other._Points),
+    _ResidualMap(other._ResidualMap),
+    _OutputDimension(other._OutputDimension),
+    _A(Eigen::MatrixXd::Zero(4, 4)),
+    _B(Eigen::MatrixXd::Zero(4, other._OutputDimension))
+  {}
+
+  void join(const ComputeAffineNormalEquations &other)
+  {
+    _A += other._A;
+    _B += other._B;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    Eigen::Vector4d x;
+    double          p[3];
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Points->GetPoint(i, p);
+      x << p[0], p[1], p[2], 1.;
+      _A.noalias() += x * x.transpose();
+      for (int j = 0; j < _OutputDimension; ++j) {
+        _B.col(j) += _ResidualMap->GetComponent(i, j) * x;
+      }
+    }
+  }
+};
+
+
+} // namespace MeshlessCompactVolumeMapperUtils
+using namespace MeshlessCompactVolumeMapperUtils;
+
+// =============================================================================
+// Construction/destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper
+::CopyAttributes(const MeshlessCompactVolumeMapper &other)
+{
+  _SupportRadius            = other._SupportRadius;
+  _Solver                   = other._Solver;
+  _NumberOfSolverIterations = other._NumberOfSolverIterations;
+  _SolverTolerance          = other._SolverTolerance;
+  _Regularization           = other._Regularization;
+  _KernelRowOffset          = other._KernelRowOffset;
+  _KernelColumnIndex        = other._KernelColumnIndex;
+  _KernelValue              = other._KernelValue;
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactVolumeMapper::MeshlessCompactVolumeMapper()
+:
+  _SupportRadius(-.25),
+  _Solver(SparseSolver_CG),
+  _NumberOfSolverIterations(0),
+  _SolverTolerance(1e-6),
+  _Regularization(1e-6)
+{
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactVolumeMapper
+::MeshlessCompactVolumeMapper(const MeshlessCompactVolumeMapper &other)
+:
+  MeshlessVolumeMapper(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactVolumeMapper &MeshlessCompactVolumeMapper
+::operator =(const MeshlessCompactVolumeMapper &other)
+{
+  if (this != &other) {
+    MeshlessVolumeMapper::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+MeshlessCompactVolumeMapper::~MeshlessCompactVolumeMapper()
+{
+}
+
+// =============================================================================
+// Execution
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper::Initialize()
+{
+  // Initialize base class
+  MeshlessVolumeMapper::Initialize();
+
+  const int n = NumberOfSourcePoints();
+  const int d = NumberOfComponents();
+
+  // Absolute support radius
+  double radius = _SupportRadius;
+  if (radius < .0) {
+    double bounds[6];
+    _Boundary->GetBounds(bounds);
+    radius = abs(radius) * sqrt(pow(bounds[1] - bounds[0], 2) +
+                                pow(bounds[3] - bounds[2], 2) +
+                                pow(bounds[5] - bounds[4], 2));
+  }
+  if (radius <= .0) {
+    cerr << this->NameOfType() << "::Initialize: Support radius must be positive" << endl;
+    exit(1);
+  }
+
+  // Initialize compactly supported map
+  double q[3];
+
+  SharedPtr<MeshlessCompactMap> map = NewShared<MeshlessCompactMap>();
+
+  PointSet &points  = map->SourcePoints();
+  Matrix   &weights = map->Coefficients();
+
+  points.Resize(n);
+  weights.Initialize(n, d);
+  for (int j = 0; j < n; ++j) {
+    _OffsetSurface->GetPoint(j, q);
+    points.SetPoint(j, q);
+  }
+  map->AffineCoefficients().Initialize(4, d);
+  map->SupportRadius(radius);
+  map->UpdateSourceGrid();
+
+  // Set output map
+  _Output = map;
+
+  // Compute sparse kernel matrix
+  UpdateKernel();
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessCompactVolumeMapper::AddSourcePoint(double q[3])
+{
+  if (!MeshlessVolumeMapper::AddSourcePoint(q)) return false;
+  MeshlessCompactMap *map = dynamic_cast<MeshlessCompactMap *>(_Output.get());
+  map->UpdateSourceGrid();
+  UpdateKernel();
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper::AddSourcePoints(const PointSet &points)
+{
+  const int n0 = NumberOfSourcePoints();
+  MeshlessVolumeMapper::AddSourcePoints(points);
+  if (NumberOfSourcePoints() == n0) return;
+  MeshlessCompactMap *map = dynamic_cast<MeshlessCompactMap *>(_Output.get());
+  map->UpdateSourceGrid();
+  UpdateKernel();
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper::UpdateKernel()
+{
+  const int m = NumberOfBoundaryPoints();
+  const MeshlessCompactMap *map = dynamic_cast<const MeshlessCompactMap *>(_Output.get());
+
+  _KernelRowOffset.resize(m + 1);
+  _KernelRowOffset[0] = 0;
+
+  CountKernelEntries count;
+  count._Map    = map;
+  count._Points = _Boundary->GetPoints();
+  count._Count  = _KernelRowOffset.data() + 1;
+  parallel_for(blocked_range<int>(0, m), count);
+
+  for (int i = 0; i < m; ++i) {
+    _KernelRowOffset[i + 1] += _KernelRowOffset[i];
+  }
+  _KernelColumnIndex.resize(_KernelRowOffset[m]);
+  _KernelValue      .resize(_KernelRowOffset[m]);
+
+  FillKernelEntries fill;
+  fill._Map    = map;
+  fill._Points = _Boundary->GetPoints();
+  fill._Offset = _KernelRowOffset.data();
+  fill._Index  = _KernelColumnIndex.data();
+  fill._Value  = _KernelValue.data();
+  parallel_for(blocked_range<int>(0, m), fill);
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper::FitAffineMap()
+{
+  const int d = NumberOfComponents();
+  MeshlessCompactMap *map = dynamic_cast<MeshlessCompactMap *>(_Output.get());
+
+  ComputeAffineNormalEquations eval;
+  eval._Points          = _Boundary->GetPoints();
+  eval._ResidualMap     = _ResidualMap;
+  eval._OutputDimension = d;
+  eval._A               = Eigen::MatrixXd::Zero(4, 4);
+  eval._B               = Eigen::MatrixXd::Zero(4, d);
+  parallel_reduce(blocked_range<int>(0, NumberOfBoundaryPoints()), eval);
+
+  // Small ridge in case all boundary points are coplanar
+  eval._A.diagonal().array() += 1e-12 * eval._A.diagonal().maxCoeff();
+  const Eigen::MatrixXd x = eval._A.ldlt().solve(eval._B);
+
+  Matrix &affine = map->AffineCoefficients();
+  for (int j = 0; j < d; ++j)
+  for (int i = 0; i < 4; ++i) {
+    affine(i, j) += x(i, j);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper::Solve()
+{
+  typedef Eigen::SparseMatrix<double, Eigen::RowMajor> KernelMatrix;
+
+  const int m = NumberOfBoundaryPoints();
+  const int d = NumberOfComponents();
+
+  MeshlessCompactMap *map = dynamic_cast<MeshlessCompactMap *>(_Output.get());
+
+  double error;   // error of boundary map approximation
+  double min_error, max_error, std_error;
+
+  // Restore map from previous run, including its affine part
+  const int iter0 = this->RestoreCheckpoint();
+
+  // Fit affine part of map
+  if (iter0 > 0) {
+    if (verbose) cout << "Initialize residual boundary map...", cout.flush();
+  } else {
+    if (verbose) cout << "Fit affine map to boundary map...", cout.flush();
+    this->FitAffineMap();
+  }
+  error = this->UpdateResidualMap(&min_error, &max_error, &std_error);
+  if (verbose) {
+    cout << " done\nBoundary fitting error (MSE) = " << error
+         << " (+/-" << std_error << "), range = ["
+         << min_error << ", " << max_error << "]" << endl;
+  }
+
+  // Iteratively approximate volumetric map
+  for (int iter = iter0; iter < _NumberOfIterations; ++iter) {
+
+    if (verbose) cout << "\nIteration " << (iter+1) << endl;
+
+    const int n = NumberOfSourcePoints();
+    Eigen::Map<const KernelMatrix> K(m, n, static_cast<int>(_KernelValue.size()),
+                                     _KernelRowOffset.data(),
+                                     _KernelColumnIndex.data(),
+                                     _KernelValue.data());
+
+    // Normal equations of regularized least squares fit to residual boundary map
+    MapperStatistics::Timer assembly(&_Statistics, "assembly");
+    if (verbose) {
+      cout << "Build normal equations with " << K.nonZeros() << " non-zero kernel values...";
+      cout.flush();
+    }
+    Eigen::SparseMatrix<double> A = K.transpose() * K;
+    double lambda = (n > 0 ? A.diagonal().sum() / n : .0) * _Regularization;
+    if (lambda <= .0) lambda = _Regularization;
+    Eigen::SparseMatrix<double> I(n, n);
+    I.setIdentity();
+    A += lambda * I;
+
+    Eigen::MatrixXd r(m, d);
+    for (int j = 0; j < d; ++j)
+    for (int i = 0; i < m; ++i) {
+      r(i, j) = _ResidualMap->GetComponent(i, j);
+    }
+    const Eigen::MatrixXd b = K.transpose() * r;
+    if (verbose) cout << " done" << endl;
+    assembly.Stop();
+
+    // Solve sparse linear system
+    if (verbose) cout << "Solve system using " << ToString(_Solver) << " solver...", cout.flush();
+    Eigen::MatrixXd x = Eigen::MatrixXd::Zero(n, d);
+    int    niter        = 0;
+    double solver_error = .0;
+    MapperStatistics::Timer timer(&_Statistics, "solve");
+    const SparseSolverType solver = SolveSparseLinearSystem(_Solver, SparseMatrix_SPD, false, A, b, x,
+                                                            _NumberOfSolverIterations, _SolverTolerance,
+                                                            false, &niter, &solver_error, _Observer);
+    timer.Stop();
+    _Statistics.AddLinearSolve(ToString(solver), A.rows(), A.nonZeros(), niter, solver_error);
+    if (verbose) {
+      cout << " done" << endl;
+      if (!IsDirectSolver(solver)) {
+        cout << "No. of iterations = " << niter << ", estimated error = " << solver_error << endl;
+      }
+    }
+
+    // Add solution to volumetric map
+    Matrix &weights = map->Coefficients();
+    for (int j = 0; j < d; ++j)
+    for (int i = 0; i < n; ++i) {
+      weights(i, j) += x(i, j);
+    }
+
+    // Update residual boundary map
+    if (verbose) cout << "Update residual boundary map...", cout.flush();
+    error = this->UpdateResidualMap(&min_error, &max_error, &std_error);
+    if (verbose) {
+      cout << " done\nBoundary fitting error (MSE) = " << error
+           << " (+/-" << std_error << "), range = ["
+           << min_error << ", " << max_error << "]" << endl;
+    }
+
+    // Notify observer, which may stop the iteration with the current map
+    if (!this->NotifyFittingError(iter + 1, error, min_error, max_error, std_error)) break;
+
+    // Insert new source points near boundary points with high residual error
+    if (iter + 1 < _NumberOfIterations) {
+      if (verbose) cout << "Insert new source points...", cout.flush();
+      this->InsertSourcePoints(error + 1.5 * std_error);
+      if (verbose) {
+        cout << " done: #points = " << NumberOfSourcePoints()
+             << " (+" << (NumberOfSourcePoints() - n) << ")" << endl;
+      }
+    }
+
+    // Save intermediate result
+    this->WriteCheckpointIfDue(iter + 1);
+  }
+}
+
+// =============================================================================
+// Linear system
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper
+::GetCoefficients(int k, Matrix &coeffs) const
+{
+  const int m = NumberOfBoundaryPoints();
+  const int n = NumberOfSourcePoints(k);
+
+  Array<int> local(NumberOfSourcePoints(), -1);
+  for (int i = 0; i < n; ++i) local[SourcePointIndex(k, i)] = i;
+
+  coeffs.Initialize(n, n);
+  for (int r = 0; r < m; ++r) {
+    for (int a = _KernelRowOffset[r]; a < _KernelRowOffset[r + 1]; ++a) {
+      const int i = local[_KernelColumnIndex[a]];
+      if (i < 0) continue;
+      for (int b = _KernelRowOffset[r]; b < _KernelRowOffset[r + 1]; ++b) {
+        const int j = local[_KernelColumnIndex[b]];
+        if (j < 0) continue;
+        coeffs(i, j) += _KernelValue[a] * _KernelValue[b];
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper
+::GetConstraints(int k, Matrix &b) const
+{
+  const int m = NumberOfBoundaryPoints();
+  const int n = NumberOfSourcePoints(k);
+  const int d = NumberOfComponents();
+
+  Array<int> local(NumberOfSourcePoints(), -1);
+  for (int i = 0; i < n; ++i) local[SourcePointIndex(k, i)] = i;
+
+  b.Initialize(n, d);
+  for (int r = 0; r < m; ++r) {
+    for (int a = _KernelRowOffset[r]; a < _KernelRowOffset[r + 1]; ++a) {
+      const int i = local[_KernelColumnIndex[a]];
+      if (i < 0) continue;
+      for (int j = 0; j < d; ++j) {
+        b(i, j) += _KernelValue[a] * _ResidualMap->GetComponent(r, j);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessCompactVolumeMapper
+::AddWeights(int k, const Matrix &w)
+{
+  const int d = NumberOfComponents();
+  MeshlessCompactMap *map = dynamic_cast<MeshlessCompactMap *>(_Output.get());
+  Matrix &weights = map->Coefficients();
+  for (int i = 0; i < NumberOfSourcePoints(k); ++i) {
+    const int r = SourcePointIndex(k, i);
+    for (int j = 0; j < d; ++j) {
+      weights(r, j) += w(i, j);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessCompactVolumeMapper
+::GetBoundaryMap(int k, const Matrix &w, Matrix &f) const
+{
+  const int m = NumberOfBoundaryPoints();
+  const int n = NumberOfSourcePoints(k);
+
+  Array<int> local(NumberOfSourcePoints(), -1);
+  for (int i = 0; i < n; ++i) local[SourcePointIndex(k, i)] = i;
+
+  f.Initialize(m, w.Cols());
+  for (int r = 0; r < m; ++r) {
+    for (int a = _KernelRowOffset[r]; a < _KernelRowOffset[r + 1]; ++a) {
+      const int i = local[_KernelColumnIndex[a]];
+      if (i < 0) continue;
+      for (int j = 0; j < w.Cols(); ++j) {
+        f(r, j) += _KernelValue[a] * w(i, j);
+      }
+    }
+  }
+  return true;
+}
+
+
+} // namespace mirtk
@@ -20,17 +20,253 @@
 #include "mirtk/MeshlessHarmonicMap.h"
 
 #include "mirtk/Point.h"
+#include "mirtk/Array.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/GenericImage.h"
+#include "mirtk/PointSetUtils.h"
+#include "mirtk/MeshlessKernelSum.h"
+#include "mirtk/MeshlessTreecode.h"
+
+#include "vtkImageData.h"
 
 
 namespace mirtk {
 
 
+// =============================================================================
+// Auxiliary functors
+// =============================================================================
+
+namespace MeshlessHarmonicMapUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Evaluate kernel sum at contiguous set of points
+///
+/// \tparam TEvaluator Type of kernel sum evaluator, i.e., either
+///                    MeshlessKernelSum or MeshlessTreecode.
+template <class TEvaluator>
+struct EvaluateMapAtPoints
+{
+  const TEvaluator *_Evaluator;
+  const double     *_Points;
+  double           *_Values;
+  bool             *_Inside;
+  double            _OutsideValue;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int dim = _Evaluator->NumberOfComponents();
+    _Evaluator->Evaluate(static_cast<int>(re.size()),
+                         _Points + 3 * re.begin(),
+                         _Values + dim * re.begin(),
+                         _Inside ? _Inside + re.begin() : nullptr,
+                         _OutsideValue);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate Jacobian of map at contiguous set of points
+struct EvaluateJacobianAtPoints
+{
+  const MeshlessHarmonicMap *_Map;
+  const double              *_Points;
+  double                    *_Jacobian;
+  bool                      *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int     stride = 3 * _Map->NumberOfComponents();
+    const double *p      = _Points   + 3      * re.begin();
+    double       *jac    = _Jacobian + stride * re.begin();
+    bool          inside;
+    for (int i = re.begin(); i != re.end(); ++i, p += 3, jac += stride) {
+      inside = _Map->EvaluateJacobian(jac, p[0], p[1], p[2]);
+      if (_Inside) _Inside[i] = inside;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Number of lattice points per tile evaluated at once
+///
+/// The tiles are contiguous ranges of the flattened lattice, which span
+/// multiple rows when the rows are short, such that the loop over all source
+/// points is amortized over many target points also for small or masked
+/// lattices.
+const int LatticeTileSize = 512;
+
+// -----------------------------------------------------------------------------
+/// Evaluate kernel sum at tiles of contiguous lattice points
+template <class TEvaluator, class TVoxel>
+struct EvaluateMapAtLatticePoints
+{
+  const TEvaluator     *_Evaluator;
+  GenericImage<TVoxel> *_Output;
+  vtkImageData         *_Mask;
+  int                   _l1, _l2;
+  double                _OutsideValue;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int nx  = _Output->X();
+    const int ny  = _Output->Y();
+    const int dim = _Evaluator->NumberOfComponents();
+
+    Array<double> xyz(3 * LatticeTileSize), values(dim * LatticeTileSize);
+    Array<int>    index(LatticeTileSize);
+    double        x, y, z;
+    int           i, j, k, l, n;
+
+    for (int t0 = re.begin(), t1; t0 < re.end(); t0 = t1) {
+      t1 = min(t0 + LatticeTileSize, re.end());
+      n  = 0;
+      for (int idx = t0; idx < t1; ++idx) {
+        i = idx % nx;
+        j = (idx / nx) % ny;
+        k = idx / (nx * ny);
+        if (!_Mask || _Mask->GetScalarComponentAsFloat(i, j, k, 0) != .0) {
+          x = i, y = j, z = k;
+          _Output->ImageToWorld(x, y, z);
+          xyz[3 * n    ] = x;
+          xyz[3 * n + 1] = y;
+          xyz[3 * n + 2] = z;
+          index[n++] = idx;
+        } else {
+          for (l = _l1; l < _l2; ++l) {
+            _Output->Put(i, j, k, l - _l1, numeric_limits<TVoxel>::quiet_NaN());
+          }
+        }
+      }
+      _Evaluator->Evaluate(n, xyz.data(), values.data(), nullptr, _OutsideValue);
+      for (int p = 0; p < n; ++p) {
+        i = index[p] % nx;
+        j = (index[p] / nx) % ny;
+        k = index[p] / (nx * ny);
+        for (l = _l1; l < _l2; ++l) {
+          _Output->Put(i, j, k, l - _l1, static_cast<TVoxel>(values[dim * p + l]));
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate kernel sum at lattice points using the given evaluator
+template <class TEvaluator, class TVoxel>
+void EvaluateOnLattice(const MeshlessHarmonicMap *map, const TEvaluator &evaluator,
+                       GenericImage<TVoxel> &f, int l, vtkImageData *mask)
+{
+  EvaluateMapAtLatticePoints<TEvaluator, TVoxel> eval;
+  eval._Evaluator    = &evaluator;
+  eval._Output       = &f;
+  eval._Mask         = mask;
+  eval._l1           = l;
+  eval._l2           = l + f.T();
+  eval._OutsideValue = map->OutsideValue();
+  parallel_for(blocked_range<int>(0, f.X() * f.Y() * f.Z(), LatticeTileSize), eval);
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at lattice points
+template <class TVoxel>
+void EvaluateOnLattice(const MeshlessHarmonicMap *map, bool biharmonic,
+                       GenericImage<TVoxel> &f, int l, vtkSmartPointer<vtkPointSet> m)
+{
+  ImageAttributes lattice = f.Attributes();
+  lattice._dt = .0;
+
+  if (l >= map->NumberOfComponents() || l + lattice._t > map->NumberOfComponents()) {
+    cerr << map->NameOfType() << "::Evaluate: Component index out of range" << endl;
+    exit(1);
+  }
+
+  vtkSmartPointer<vtkImageData> mask;
+  if (m) {
+    mask = NewVtkMask(lattice._x, lattice._y, lattice._z);
+    ImageStencilToMask(ImageStencil(mask, WorldToImage(m, &f)), mask);
+  }
+
+  // Evaluate kernel sum of requested coefficient columns only
+  const PointSet &sources = map->SourcePoints();
+  const int       nt      = max(f.T(), 1);
+  Matrix          columns;
+  const Matrix   *coeffs  = &map->Coefficients();
+  if (l != 0 || nt != coeffs->Cols()) {
+    columns.Initialize(coeffs->Rows(), nt);
+    for (int j = 0; j < nt; ++j)
+    for (int i = 0; i < coeffs->Rows(); ++i) {
+      columns(i, j) = (*coeffs)(i, l + j);
+    }
+    coeffs = &columns;
+  }
+  if (map->TreecodeOpeningAngle() > .0) {
+    MeshlessTreecode tree(sources, *coeffs, biharmonic, map->TreecodeOpeningAngle());
+    EvaluateOnLattice(map, tree, f, 0, mask.GetPointer());
+  } else if (map->SinglePrecision()) {
+    MeshlessKernelSum<float> sum(sources, *coeffs, biharmonic);
+    EvaluateOnLattice(map, sum, f, 0, mask.GetPointer());
+  } else {
+    MeshlessKernelSum<double> sum(sources, *coeffs, biharmonic);
+    EvaluateOnLattice(map, sum, f, 0, mask.GetPointer());
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate kernel sum at contiguous set of points using the given evaluator
+template <class TEvaluator>
+void EvaluateAtPoints(const MeshlessHarmonicMap *map, const TEvaluator &evaluator,
+                      int n, const double *xyz, double *values, bool *inside, int grainsize)
+{
+  EvaluateMapAtPoints<TEvaluator> eval;
+  eval._Evaluator    = &evaluator;
+  eval._Points       = xyz;
+  eval._Values       = values;
+  eval._Inside       = inside;
+  eval._OutsideValue = map->OutsideValue();
+  parallel_for(blocked_range<int>(0, n, grainsize), eval);
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at contiguous set of points
+void EvaluateAtPoints(const MeshlessHarmonicMap *map, bool biharmonic,
+                      int n, const double *xyz, double *values, bool *inside)
+{
+  const PointSet &sources = map->SourcePoints();
+  const Matrix   &coeffs  = map->Coefficients();
+  if (map->TreecodeOpeningAngle() > .0) {
+    MeshlessTreecode tree(sources, coeffs, biharmonic, map->TreecodeOpeningAngle());
+    EvaluateAtPoints(map, tree, n, xyz, values, inside, 1);
+  } else if (map->SinglePrecision()) {
+    MeshlessKernelSum<float> sum(sources, coeffs, biharmonic);
+    EvaluateAtPoints(map, sum, n, xyz, values, inside, MeshlessKernelSum<float>::BlockSize);
+  } else {
+    MeshlessKernelSum<double> sum(sources, coeffs, biharmonic);
+    EvaluateAtPoints(map, sum, n, xyz, values, inside, MeshlessKernelSum<double>::BlockSize);
+  }
+}
+
+
+} // namespace MeshlessHarmonicMapUtils
+using namespace MeshlessHarmonicMapUtils;
+
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicMap::CopyAttributes(const MeshlessHarmonicMap &other)
+{
+  _SinglePrecision      = other._SinglePrecision;
+  _TreecodeOpeningAngle = other._TreecodeOpeningAngle;
+}
+
 // -----------------------------------------------------------------------------
 MeshlessHarmonicMap::MeshlessHarmonicMap()
+:
+  _SinglePrecision(false),
+  _TreecodeOpeningAngle(.0)
 {
 }
 
@@ -39,6 +275,7 @@ MeshlessHarmonicMap::MeshlessHarmonicMap(const MeshlessHarmonicMap &other)
 :
   MeshlessMap(other)
 {
+  CopyAttributes(other);
 }
 
 // -----------------------------------------------------------------------------
@@ -46,6 +283,7 @@ MeshlessHarmonicMap &MeshlessHarmonicMap::operator =(const MeshlessHarmonicMap &
 {
   if (this != &other) {
     MeshlessMap::operator =(other);
+    CopyAttributes(other);
   }
   return *this;
 }
@@ -68,43 +306,98 @@ MeshlessHarmonicMap::~MeshlessHarmonicMap()
 // -----------------------------------------------------------------------------
 bool MeshlessHarmonicMap::Evaluate(double *v, double x, double y, double z) const
 {
-  Point  p(x, y, z);
-  double d, h;
+  const int dim = _Coefficients.Cols();
+  const Point p(x, y, z);
 
-  for (int j = 0; j < _Coefficients.Cols(); ++j) {
+  for (int j = 0; j < dim; ++j) {
     v[j] = .0;
   }
-
-  for (int i = 0; i < _SourcePoints.Size(); ++i) {
-    d = p.Distance(_SourcePoints(i));
-    if (d < 1e-12) {
-      for (int j = 0; j < _Coefficients.Cols(); ++j) {
-        v[j] = _OutsideValue;
-      }
-      return false;
-    }
-    h = H(d);
-    for (int j = 0; j < _Coefficients.Cols(); ++j) {
-      v[j] += h * _Coefficients(i, j);
+  if (!AddKernelSum(MeshlessHarmonicKernel(), _SourcePoints, _Coefficients, 0, p, v, 0, dim)) {
+    for (int j = 0; j < dim; ++j) {
+      v[j] = _OutsideValue;
     }
+    return false;
   }
-
   return true;
 }
 
 // -----------------------------------------------------------------------------
 double MeshlessHarmonicMap::Evaluate(double x, double y, double z, int l) const
 {
-  Point p(x, y, z);
-  double    d, v = .0;
+  double v;
+  MeshlessHarmonicMap::Evaluate(&v, x, y, z, l, l + 1);
+  return v;
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessHarmonicMap::Evaluate(double *v, double x, double y, double z, int l1, int l2) const
+{
+  const Point p(x, y, z);
 
-  for (int i = 0; i < _SourcePoints.Size(); ++i) {
-    d = p.Distance(_SourcePoints(i));
-    if (d < 1e-12) return _OutsideValue;
-    v += H(d) * _Coefficients(i, l);
+  for (int j = l1; j < l2; ++j) {
+    v[j - l1] = .0;
+  }
+  if (!AddKernelSum(MeshlessHarmonicKernel(), _SourcePoints, _Coefficients, 0, p, v, l1, l2)) {
+    for (int j = l1; j < l2; ++j) {
+      v[j - l1] = _OutsideValue;
+    }
+    return false;
   }
+  return true;
+}
 
-  return v;
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateAtPoints(this, this->HasBiharmonicTerm(), n, xyz, values, inside);
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicMap::Evaluate(GenericImage<float> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  EvaluateOnLattice(this, this->HasBiharmonicTerm(), f, l, m);
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicMap::Evaluate(GenericImage<double> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  EvaluateOnLattice(this, this->HasBiharmonicTerm(), f, l, m);
+}
+
+
+// -----------------------------------------------------------------------------
+bool MeshlessHarmonicMap::EvaluateJacobian(double *jac, double x, double y, double z) const
+{
+  const int   n   = _SourcePoints.Size();
+  const int   dim = _Coefficients.Cols();
+  const Point p(x, y, z);
+
+  for (int j = 0; j < 3 * dim; ++j) {
+    jac[j] = .0;
+  }
+  if (!AddKernelGradient(MeshlessHarmonicKernel(), _SourcePoints, _Coefficients, 0, p, jac, 0, dim)) {
+    for (int j = 0; j < 3 * dim; ++j) {
+      jac[j] = _OutsideValue;
+    }
+    return false;
+  }
+  if (this->HasBiharmonicTerm()) {
+    AddKernelGradient(MeshlessBiharmonicKernel(), _SourcePoints, _Coefficients, n, p, jac, 0, dim);
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicMap::EvaluateJacobian(int n, const double *xyz, double *jac, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateJacobianAtPoints eval;
+  eval._Map      = this;
+  eval._Points   = xyz;
+  eval._Jacobian = jac;
+  eval._Inside   = inside;
+  parallel_for(blocked_range<int>(0, n), eval);
 }
 
 
@@ -19,6 +19,7 @@
 
 #include "mirtk/MeshlessHarmonicVolumeMapper.h"
 #include "mirtk/MeshlessHarmonicMap.h"
+#include "mirtk/MeshlessBiharmonicMap.h"
 
 #include "mirtk/Math.h"
 #include "mirtk/Memory.h"
@@ -26,10 +27,16 @@
 #include "mirtk/PointSet.h"
 #include "mirtk/Matrix.h"
 #include "mirtk/Parallel.h"
-#include "mirtk/VtkMath.h"
+#include "mirtk/DataArrayView.h"
+
+#include "vtkPoints.h"
 
 #include "mirtk/Eigen.h"
 #include "Eigen/SVD"
+#include "Eigen/QR"
+
+#include <algorithm>
+#include <random>
 
 
 namespace mirtk {
@@ -45,57 +52,236 @@ MIRTK_Common_EXPORT extern int verbose;
 
 namespace MeshlessHarmonicVolumeMapperUtils {
 
+
+// -----------------------------------------------------------------------------
+/// Number of boundary points per tile of kernel function values
+inline int KernelTileSize(int ncols)
+{
+  // 256 kB of double precision values per tile
+  return max(16, 32768 / max(1, ncols));
+}
+
 // -----------------------------------------------------------------------------
-/// Compute A = K^T K
-struct ComputeCoefficients
+/// Compute A = K^T K, its trailing columns starting at _FirstCol, or b = K^T f
+///
+/// The products are accumulated over tiles of boundary points, such that the
+/// kernel function values are never materialized for all boundary points.
+/// Only the lower triangle of the symmetric matrix K^T K is computed. The
+/// number of columns of K is the number of unknowns of the source points,
+/// i.e., twice the number of source points when the tiles are [H | B].
+struct ComputeKernelProduct
 {
-  const Matrix     *_Kernel;
-  const Array<int> *_ColIdx;
-  Matrix           *_Coeffs;
+  const MeshlessHarmonicVolumeMapper *_Mapper;
+  const int                          *_Cols;
+  int                                 _NumberOfCols;
+  int                                 _NumberOfUnknowns;
+  int                                 _FirstCol;
+  vtkDataArray                       *_BoundaryMap;
+  Eigen::MatrixXd                     _Result;
+
+  ComputeKernelProduct() : _FirstCol(0), _BoundaryMap(nullptr) {}
+
+  ComputeKernelProduct(const ComputeKernelProduct &other, split)
+  :
+    _Mapper(other._Mapper),
+    _Cols(other._Cols),
+    _NumberOfCols(other._NumberOfCols),
+    _NumberOfUnknowns(other._NumberOfUnknowns),
+    _FirstCol(other._FirstCol),
+    _BoundaryMap(other._BoundaryMap),
+    _Result(Eigen::MatrixXd::Zero(other._Result.rows(), other._Result.cols()))
+  {}
+
+  void join(const ComputeKernelProduct &other)
+  {
+    _Result += other._Result;
+  }
 
-  void operator ()(const blocked_range2d<int> &re) const
+  void operator ()(const blocked_range<int> &re)
   {
-    double sum;
-    const double *ci, *cj;
-    for (int j = re.cols().begin(); j < re.cols().end(); ++j)
-    for (int i = re.rows().begin(); i < re.rows().end(); ++i) {
-      sum = .0;
-      ci = _Kernel->RawPointer(0, (*_ColIdx)[i]);
-      cj = _Kernel->RawPointer(0, (*_ColIdx)[j]);
-      for (int r = 0; r < _Kernel->Rows(); ++r, ++ci, ++cj) {
-        sum += (*ci) * (*cj);
+    const int tile = KernelTileSize(_NumberOfUnknowns);
+    const DataArrayView boundary_map(_BoundaryMap);
+    Eigen::MatrixXd K, f;
+    for (int r0 = re.begin(), nrows; r0 < re.end(); r0 += nrows) {
+      nrows = min(tile, re.end() - r0);
+      K.resize(nrows, _NumberOfUnknowns);
+      _Mapper->GetKernel(r0, nrows, _Cols, _NumberOfCols, K.data());
+      if (_BoundaryMap) {
+        f.resize(nrows, _Result.cols());
+        for (int j = 0; j < f.cols(); ++j)
+        for (int i = 0; i < nrows; ++i) {
+          f(i, j) = boundary_map.Get(r0 + i, j);
+        }
+        _Result.noalias() += K.transpose() * f;
+      } else if (_FirstCol == 0) {
+        _Result.selfadjointView<Eigen::Lower>().rankUpdate(K.transpose());
+      } else {
+        _Result.noalias() += K.transpose() * K.rightCols(_NumberOfUnknowns - _FirstCol);
       }
-      _Coeffs->Put(i, j, sum);
     }
   }
 };
 
+
+// -----------------------------------------------------------------------------
+/// Compute f = K w for tiles of boundary points
+struct ComputeBoundaryMap
+{
+  const MeshlessHarmonicVolumeMapper *_Mapper;
+  const int                          *_Cols;
+  int                                 _NumberOfCols;
+  const Matrix                       *_Weights;
+  Matrix                             *_BoundaryMap;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int m    = _BoundaryMap->Rows();
+    const int d    = _BoundaryMap->Cols();
+    const int nu   = _Weights->Rows();
+    const int tile = KernelTileSize(nu);
+    Eigen::Map<const Eigen::MatrixXd> w(_Weights->RawPointer(), nu, d);
+    Eigen::Map<Eigen::MatrixXd>       f(_BoundaryMap->RawPointer(), m, d);
+    Eigen::MatrixXd K;
+    for (int r0 = re.begin(), nrows; r0 < re.end(); r0 += nrows) {
+      nrows = min(tile, re.end() - r0);
+      K.resize(nrows, nu);
+      _Mapper->GetKernel(r0, nrows, _Cols, _NumberOfCols, K.data());
+      f.middleRows(r0, nrows).noalias() = K * w;
+    }
+  }
+};
+
+
 // -----------------------------------------------------------------------------
-/// Compute b = K^T f
-struct ComputeConstraints
+/// Compute contribution of each source point to the boundary map
+struct ComputeSourcePointContribution
 {
-  const Matrix     *_Kernel;
-  const Array<int> *_ColIdx;
-  vtkDataArray     *_BoundaryMap;
-  Matrix           *_b;
+  const MeshlessHarmonicVolumeMapper *_Mapper;
+  const MeshlessHarmonicMap          *_Map;
+  int                                 _NumberOfBoundaryPoints;
+  bool                                _Biharmonic;
+  double                             *_Contribution;
 
-  void operator ()(const blocked_range2d<int> &re) const
+  void operator ()(const blocked_range<int> &re) const
   {
-    double sum;
-    const double *ci;
-    for (int j = re.cols().begin(); j < re.cols().end(); ++j)
-    for (int i = re.rows().begin(); i < re.rows().end(); ++i) {
-      sum = .0;
-      ci = _Kernel->RawPointer(0, (*_ColIdx)[i]);
-      for (int r = 0; r < _Kernel->Rows(); ++r, ++ci) {
-        sum += (*ci) * _BoundaryMap->GetComponent(r, j);
+    const int     m = _NumberOfBoundaryPoints;
+    const int     n = _Map->NumberOfSourcePoints();
+    const Matrix &w = _Map->Coefficients();
+    Array<double> col(_Biharmonic ? 2 * m : m);
+    double k2, w2;
+    for (int i = re.begin(); i < re.end(); ++i) {
+      _Mapper->GetKernel(0, m, &i, 1, col.data());
+      k2 = w2 = .0;
+      for (int r = 0; r < m; ++r) k2 += col[r] * col[r];
+      for (int j = 0; j < w.Cols(); ++j) w2 += w(i, j) * w(i, j);
+      _Contribution[i] = sqrt(k2 * w2);
+      if (_Biharmonic) {
+        k2 = w2 = .0;
+        for (int r = m; r < 2 * m; ++r) k2 += col[r] * col[r];
+        for (int j = 0; j < w.Cols(); ++j) w2 += w(n + i, j) * w(n + i, j);
+        _Contribution[i] += sqrt(k2 * w2);
       }
-      _b->Put(i, j, sum);
     }
   }
 };
 
 
+// -----------------------------------------------------------------------------
+/// Compute thin SVD of a matrix
+template <class TSVD>
+void ComputeSVD(const Eigen::MatrixXd &A, Eigen::MatrixXd &U, Eigen::VectorXd &sigma, Eigen::MatrixXd &V)
+{
+  TSVD svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+  U     = svd.matrixU();
+  sigma = svd.singularValues();
+  V     = svd.matrixV();
+}
+
+// -----------------------------------------------------------------------------
+/// Compute truncated SVD of a matrix using a randomized range finder
+///
+/// Halko et al. (2011). Finding structure with randomness: Probabilistic
+/// algorithms for constructing approximate matrix decompositions.
+/// SIAM Review, 53(2), 217–288.
+///
+/// \param[in]  A      Matrix to decompose.
+/// \param[in]  rank   Number of singular values and vectors.
+/// \param[out] U      Left singular vectors.
+/// \param[out] sigma  Singular values in decreasing order.
+/// \param[out] V      Right singular vectors.
+/// \param[in]  npower Number of power iterations, which improve the accuracy
+///                    when the singular values decay slowly.
+void ComputeRandomizedSVD(const Eigen::MatrixXd &A, int rank,
+                          Eigen::MatrixXd &U, Eigen::VectorXd &sigma, Eigen::MatrixXd &V,
+                          int npower = 2)
+{
+  const int m = static_cast<int>(A.rows());
+  const int n = static_cast<int>(A.cols());
+  const int l = min(min(m, n), rank + 10);
+
+  // Gaussian test matrix with fixed seed for reproducible results
+  std::mt19937 rng(42);
+  std::normal_distribution<double> normal;
+  Eigen::MatrixXd omega(n, l);
+  for (int j = 0; j < l; ++j)
+  for (int i = 0; i < n; ++i) {
+    omega(i, j) = normal(rng);
+  }
+
+  // Orthonormal basis Q of range of A, re-orthonormalized after each product
+  Eigen::MatrixXd Y = A * omega, Z;
+  Eigen::MatrixXd Q = Eigen::HouseholderQR<Eigen::MatrixXd>(Y).householderQ() * Eigen::MatrixXd::Identity(m, l);
+  for (int iter = 0; iter < npower; ++iter) {
+    Z = A.transpose() * Q;
+    Z = Eigen::HouseholderQR<Eigen::MatrixXd>(Z).householderQ() * Eigen::MatrixXd::Identity(n, l);
+    Y = A * Z;
+    Q = Eigen::HouseholderQR<Eigen::MatrixXd>(Y).householderQ() * Eigen::MatrixXd::Identity(m, l);
+  }
+
+  // SVD of projected l x n matrix
+  Eigen::MatrixXd B = Q.transpose() * A, Ub;
+  ComputeSVD<Eigen::BDCSVD<Eigen::MatrixXd> >(B, Ub, sigma, V);
+  const int k = min(rank, static_cast<int>(sigma.size()));
+  U     = Q * Ub.leftCols(k);
+  sigma = sigma.head(k).eval();
+  V     = V.leftCols(k).eval();
+}
+
+
+// -----------------------------------------------------------------------------
+/// Copy contiguous values in parallel
+struct CopyValues
+{
+  const float *_Input;
+  float       *_Output;
+
+  void operator ()(const blocked_range<size_t> &re) const
+  {
+    std::copy(_Input + re.begin(), _Input + re.end(), _Output + re.begin());
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Grow single precision kernel storage to the given number of values
+///
+/// Unlike std::vector::resize, the existing values are copied in parallel to
+/// the new storage, such that its memory pages are spread over the memory
+/// nodes of the copying threads instead of being first touched by one thread.
+/// The new values are left uninitialized.
+void GrowKernel(UninitializedArray<float> &kernel, size_t n)
+{
+  UninitializedArray<float> values;
+  values.resize(n);
+  if (!kernel.empty()) {
+    CopyValues copy;
+    copy._Input  = kernel.data();
+    copy._Output = values.data();
+    parallel_for(blocked_range<size_t>(0, kernel.size()), copy);
+  }
+  kernel.swap(values);
+}
+
+
 } // namespace MeshlessHarmonicVolumeMapperUtils
 using namespace MeshlessHarmonicVolumeMapperUtils;
 
@@ -107,14 +293,24 @@ using namespace MeshlessHarmonicVolumeMapperUtils;
 void MeshlessHarmonicVolumeMapper
 ::CopyAttributes(const MeshlessHarmonicVolumeMapper &other)
 {
-  _Kernel = other._Kernel;
-  _UseSVD = other._UseSVD;
+  _KernelStorage = other._KernelStorage;
+  _KernelMatrix  = other._KernelMatrix;
+  _Kernel        = other._Kernel;
+  _FloatKernel   = other._FloatKernel;
+  _BiharmonicKernel      = other._BiharmonicKernel;
+  _FloatBiharmonicKernel = other._FloatBiharmonicKernel;
+  _UseSVD        = other._UseSVD;
+  _SVDMethod     = other._SVDMethod;
+  _SVDRank       = other._SVDRank;
 }
 
 // -----------------------------------------------------------------------------
 MeshlessHarmonicVolumeMapper::MeshlessHarmonicVolumeMapper()
 :
-  _UseSVD(false)
+  _KernelStorage(MeshlessKernel_Double),
+  _UseSVD(false),
+  _SVDMethod(MeshlessSVD_BDC),
+  _SVDRank(0)
 {
 }
 
@@ -157,31 +353,41 @@ void MeshlessHarmonicVolumeMapper::Initialize()
   const int n = NumberOfSourcePoints();
   const int d = NumberOfComponents();
 
-  // Initialize harmonic map and precompute kernel function values
-  double p[3], q[3], dist;
+  // Initialize harmonic or biharmonic map
+  double q[3];
 
-  SharedPtr<MeshlessHarmonicMap> map = NewShared<MeshlessHarmonicMap>();
+  SharedPtr<MeshlessHarmonicMap> map;
+  if (this->HasBiharmonicTerm()) map = NewShared<MeshlessBiharmonicMap>();
+  else                           map = NewShared<MeshlessHarmonicMap>();
 
   PointSet &points  = map->SourcePoints();
   Matrix   &weights = map->Coefficients();
 
   points.Resize(n);
-  weights.Initialize(n, d);
-  _Kernel.Initialize(m, n);
-
-  double *c = _Kernel.RawPointer();
+  weights.Initialize(NumberOfUnknowns(n), d);
   for (int j = 0; j < n; ++j) {
     _OffsetSurface->GetPoint(j, q);
     points.SetPoint(j, q);
-    for (int i = 0; i < m; ++i, ++c) {
-      _Boundary->GetPoint(i, p);
-      dist = sqrt(vtkMath::Distance2BetweenPoints(p, q));
-      *c = MeshlessHarmonicMap::H(dist);
-    }
   }
 
   // Set output map
   _Output = map;
+
+  // Precompute kernel function values
+  _KernelMatrix.Initialize(_Boundary->GetPoints(), points);
+  _Kernel = Matrix();
+  UninitializedArray<float>().swap(_FloatKernel);
+  _BiharmonicKernel = Matrix();
+  UninitializedArray<float>().swap(_FloatBiharmonicKernel);
+  if (_KernelStorage == MeshlessKernel_Double) {
+    _Kernel.Initialize(m, n);
+    if (this->HasBiharmonicTerm()) _BiharmonicKernel.Initialize(m, n);
+  } else if (_KernelStorage == MeshlessKernel_Float) {
+    // Values are first touched by the parallel fill of UpdateKernel
+    _FloatKernel.resize(static_cast<size_t>(m) * static_cast<size_t>(n));
+    if (this->HasBiharmonicTerm()) _FloatBiharmonicKernel.resize(_FloatKernel.size());
+  }
+  UpdateKernel(-1);
 }
 
 // -----------------------------------------------------------------------------
@@ -189,19 +395,171 @@ bool MeshlessHarmonicVolumeMapper::AddSourcePoint(double q[3])
 {
   if (!MeshlessVolumeMapper::AddSourcePoint(q)) return false;
 
-  const int m = NumberOfBoundaryPoints();
   const int n = NumberOfSourcePoints();
+  const MeshlessHarmonicMap *map = dynamic_cast<const MeshlessHarmonicMap *>(_Output.get());
+  ReserveKernel(n);
+  _KernelMatrix.AddSourcePoint(map->SourcePoints()(n - 1));
+  UpdateKernel(n - 1);
 
-  _Kernel.Resize(m, n);
+  return true;
+}
 
-  double p[3], dist, *c = _Kernel.RawPointer(0, n - 1);
-  for (int i = 0; i < m; ++i, ++c) {
-    _Boundary->GetPoint(i, p);
-    dist = sqrt(vtkMath::Distance2BetweenPoints(p, q));
-    *c = MeshlessHarmonicMap::H(dist);
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicVolumeMapper::AddSourcePoints(const PointSet &points)
+{
+  const int n0 = NumberOfSourcePoints();
+  MeshlessVolumeMapper::AddSourcePoints(points);
+  const int n  = NumberOfSourcePoints();
+  if (n == n0) return;
+
+  const MeshlessHarmonicMap *map = dynamic_cast<const MeshlessHarmonicMap *>(_Output.get());
+  ReserveKernel(n);
+  for (int j = n0; j < n; ++j) {
+    _KernelMatrix.AddSourcePoint(map->SourcePoints()(j));
   }
+  UpdateKernel(n0, n - n0);
+}
 
-  return true;
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicVolumeMapper::GetSourcePointContributions(Array<double> &contrib) const
+{
+  contrib.resize(NumberOfSourcePoints());
+  ComputeSourcePointContribution eval;
+  eval._Mapper                 = this;
+  eval._Map                    = dynamic_cast<const MeshlessHarmonicMap *>(_Output.get());
+  eval._NumberOfBoundaryPoints = NumberOfBoundaryPoints();
+  eval._Biharmonic             = this->HasBiharmonicTerm();
+  eval._Contribution           = contrib.data();
+  parallel_for(blocked_range<int>(0, NumberOfSourcePoints()), eval);
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicVolumeMapper::RemoveSourcePoints(const Array<bool> &remove)
+{
+  const int    n0 = NumberOfSourcePoints();
+  const size_t m  = static_cast<size_t>(NumberOfBoundaryPoints());
+  const bool   b  = this->HasBiharmonicTerm();
+
+  // Move stored kernel function values of remaining source points to the front
+  int c = 0;
+  for (int j = 0; j < n0; ++j) {
+    if (j < static_cast<int>(remove.size()) && remove[j]) continue;
+    if (c != j) {
+      if (_KernelStorage == MeshlessKernel_Double) {
+        std::copy(_Kernel.RawPointer(0, j), _Kernel.RawPointer(0, j) + m, _Kernel.RawPointer(0, c));
+        if (b) {
+          std::copy(_BiharmonicKernel.RawPointer(0, j), _BiharmonicKernel.RawPointer(0, j) + m,
+                    _BiharmonicKernel.RawPointer(0, c));
+        }
+      } else if (_KernelStorage == MeshlessKernel_Float) {
+        const size_t src = static_cast<size_t>(j) * m;
+        const size_t dst = static_cast<size_t>(c) * m;
+        std::copy(_FloatKernel.begin() + src, _FloatKernel.begin() + src + m, _FloatKernel.begin() + dst);
+        if (b) {
+          std::copy(_FloatBiharmonicKernel.begin() + src, _FloatBiharmonicKernel.begin() + src + m,
+                    _FloatBiharmonicKernel.begin() + dst);
+        }
+      }
+    }
+    ++c;
+  }
+
+  // Remove source points from output map
+  MeshlessVolumeMapper::RemoveSourcePoints(remove);
+
+  // Update coordinates of source points
+  const MeshlessHarmonicMap *map = dynamic_cast<const MeshlessHarmonicMap *>(_Output.get());
+  _KernelMatrix.Initialize(_Boundary->GetPoints(), map->SourcePoints());
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicVolumeMapper::ReserveKernel(int n)
+{
+  const size_t m = static_cast<size_t>(NumberOfBoundaryPoints());
+
+  // Grow storage of kernel function values by doubling its capacity
+  if (_KernelStorage == MeshlessKernel_Double) {
+    if (n > _Kernel.Cols()) {
+      _Kernel.Resize(static_cast<int>(m), max(n, 2 * _Kernel.Cols()));
+      if (this->HasBiharmonicTerm()) {
+        _BiharmonicKernel.Resize(static_cast<int>(m), _Kernel.Cols());
+      }
+    }
+  } else if (_KernelStorage == MeshlessKernel_Float) {
+    if (static_cast<size_t>(n) * m > _FloatKernel.size()) {
+      GrowKernel(_FloatKernel, max(static_cast<size_t>(n), 2 * (_FloatKernel.size() / max(m, size_t(1)))) * m);
+      if (this->HasBiharmonicTerm()) {
+        GrowKernel(_FloatBiharmonicKernel, _FloatKernel.size());
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicVolumeMapper::UpdateKernel(int j, int n)
+{
+  typedef MeshlessKernelMatrix<double> KernelMatrix;
+  if (_KernelStorage == MeshlessKernel_MatrixFree) return;
+  const int m = NumberOfBoundaryPoints();
+  if (j < 0) j = 0, n = NumberOfSourcePoints();
+  if (n <= 0) return;
+  Array<int> cols(n);
+  for (int c = 0; c < n; ++c) cols[c] = j + c;
+  if (this->HasBiharmonicTerm()) {
+    // Fill columns of both kernels in one pass over the pairs of points
+    const MeshlessHarmonicKernel   H;
+    const MeshlessBiharmonicKernel B;
+    if (_KernelStorage == MeshlessKernel_Double) {
+      _KernelMatrix.ParallelFill(H, B, cols.data(), n, _Kernel.RawPointer(0, j),
+                                 _BiharmonicKernel.RawPointer(0, j), m);
+    } else {
+      const size_t offset = static_cast<size_t>(j) * static_cast<size_t>(m);
+      _KernelMatrix.ParallelFill(H, B, cols.data(), n, _FloatKernel.data() + offset,
+                                 _FloatBiharmonicKernel.data() + offset, m);
+    }
+  } else if (_KernelStorage == MeshlessKernel_Double) {
+    _KernelMatrix.ParallelFill(KernelMatrix::Harmonic, cols.data(), n, _Kernel.RawPointer(0, j), m);
+  } else {
+    float *v = _FloatKernel.data() + static_cast<size_t>(j) * static_cast<size_t>(m);
+    _KernelMatrix.ParallelFill(KernelMatrix::Harmonic, cols.data(), n, v, m);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessHarmonicVolumeMapper
+::GetKernel(int r0, int nrows, const int *cols, int ncols, double *tile) const
+{
+  const size_t m = static_cast<size_t>(NumberOfBoundaryPoints());
+  const bool   b = this->HasBiharmonicTerm();
+  if (_KernelStorage == MeshlessKernel_Double) {
+    for (int j = 0; j < ncols; ++j) {
+      const double *v = _Kernel.RawPointer(r0, cols[j]);
+      for (int i = 0; i < nrows; ++i, ++tile) *tile = v[i];
+    }
+    if (b) {
+      for (int j = 0; j < ncols; ++j) {
+        const double *v = _BiharmonicKernel.RawPointer(r0, cols[j]);
+        for (int i = 0; i < nrows; ++i, ++tile) *tile = v[i];
+      }
+    }
+  } else if (_KernelStorage == MeshlessKernel_Float) {
+    for (int j = 0; j < ncols; ++j) {
+      const float *v = _FloatKernel.data() + static_cast<size_t>(cols[j]) * m + static_cast<size_t>(r0);
+      for (int i = 0; i < nrows; ++i, ++tile) *tile = static_cast<double>(v[i]);
+    }
+    if (b) {
+      for (int j = 0; j < ncols; ++j) {
+        const float *v = _FloatBiharmonicKernel.data() + static_cast<size_t>(cols[j]) * m + static_cast<size_t>(r0);
+        for (int i = 0; i < nrows; ++i, ++tile) *tile = static_cast<double>(v[i]);
+      }
+    }
+  } else if (b) {
+    const size_t offset = static_cast<size_t>(ncols) * static_cast<size_t>(nrows);
+    _KernelMatrix.Fill(MeshlessHarmonicKernel(), MeshlessBiharmonicKernel(),
+                       r0, nrows, cols, ncols, tile, tile + offset);
+  } else {
+    _KernelMatrix.Fill(MeshlessKernelMatrix<double>::Harmonic, r0, nrows, cols, ncols, tile);
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -213,17 +571,17 @@ void MeshlessHarmonicVolumeMapper::Solve()
     return;
   }
 
-  typedef Eigen::JacobiSVD<Eigen::MatrixXd> SVD;
-  typedef SVD::SingularValuesType           SingularValues;
-
   const int m = NumberOfBoundaryPoints();
   const int d = NumberOfComponents();
 
-  Matrix         A, b(m, d), x; // coefficients matrix, right-hand side, solution of Ax = b
-  SingularValues sigma;         // singular values of coefficients matrix
-  double         error;         // error of boundary map approximation
+  Matrix          A, b(m, d), x; // coefficients matrix, right-hand side, solution of Ax = b
+  Eigen::MatrixXd U, V;          // singular vectors of coefficients matrix
+  Eigen::VectorXd sigma;         // singular values of coefficients matrix
+  double          error;         // error of boundary map approximation
   double         min_error, max_error, std_error;
-  double         p[3], q[3];
+
+  // Restore map from previous run
+  const int iter0 = this->RestoreCheckpoint();
 
   // Compute initial error
   if (verbose) {
@@ -237,8 +595,8 @@ void MeshlessHarmonicVolumeMapper::Solve()
   }
 
   // Iteratively approximate volumetric map
-  double *df = new double[d];
-  for (int iter = 0; iter < _NumberOfIterations; ++iter) {
+  int nfit = 0;
+  for (int iter = iter0; iter < _NumberOfIterations; ++iter) {
 
     if (verbose) cout << "\nIteration " << (iter+1) << endl;
 
@@ -255,30 +613,39 @@ void MeshlessHarmonicVolumeMapper::Solve()
       }
 
       // Get coefficients
-      A.Initialize(m, n);
-      for (int j = 0, c; j < n; ++j) {
-        c = SourcePointIndex(k, j);
-        for (int i = 0; i < m; ++i) {
-          A(i, j) = _Kernel(i, c);
-        }
-      }
+      const int nu = NumberOfUnknowns(n);
+      A.Initialize(m, nu);
+      GetKernel(0, m, _SourcePartition[k].data(), n, A.RawPointer());
 
       // Get right-hand side
+      const DataArrayView residual(_ResidualMap);
       double *c = b.RawPointer();
       for (int j = 0; j < d; ++j)
       for (int i = 0; i < m; ++i, ++c) {
-        *c = _ResidualMap->GetComponent(i, j);
+        *c = residual.Get(i, j);
       }
 
-      // Solve linear system using SVD
-      if (verbose) cout << "Solve linear system using SVD...", cout.flush();
-      SVD svd(MatrixToEigen(A), Eigen::ComputeThinU | Eigen::ComputeThinV);
-      x = EigenToMatrix(svd.solve(MatrixToEigen(b)));
-      sigma = svd.singularValues();
+      // Solve linear system using SVD, discarding the singular values
+      // which exceed the upper bound of the condition number
+      if (verbose) cout << "Solve linear system using " << ToString(_SVDMethod) << " SVD...", cout.flush();
+      if (_SVDMethod == MeshlessSVD_Randomized) {
+        ComputeRandomizedSVD(MatrixToEigen(A), _SVDRank > 0 ? min(_SVDRank, nu) : nu, U, sigma, V);
+      } else if (_SVDMethod == MeshlessSVD_Jacobi) {
+        ComputeSVD<Eigen::JacobiSVD<Eigen::MatrixXd> >(MatrixToEigen(A), U, sigma, V);
+      } else {
+        ComputeSVD<Eigen::BDCSVD<Eigen::MatrixXd> >(MatrixToEigen(A), U, sigma, V);
+      }
+      int rank = 0;
+      while (rank < sigma.size() && sigma(rank) > .0 && sigma(0) / sigma(rank) <= _MaximumConditionNumber) {
+        ++rank;
+      }
+      x = EigenToMatrix(Eigen::MatrixXd(V.leftCols(rank) * (sigma.head(rank).cwiseInverse().asDiagonal() *
+                                                            (U.leftCols(rank).transpose() * MatrixToEigen(b)))));
       if (verbose) {
         cout << " done\nmax(sigma) = " << sigma(0)
              << ", min(sigma) = " << sigma(sigma.size() - 1)
-             << ", cond(A) = " << (sigma(0) / sigma(sigma.size() - 1)) << endl;
+             << ", cond(A) = " << (sigma(0) / sigma(sigma.size() - 1))
+             << ", rank = " << rank << endl;
       }
 
       // Add solution to volumetric map
@@ -288,7 +655,7 @@ void MeshlessHarmonicVolumeMapper::Solve()
 
       // Update residual boundary map
       if (verbose) cout << "Update residual boundary map...", cout.flush();
-      error = this->UpdateResidualMap(&min_error, &max_error, &std_error);
+      error = this->UpdateResidualMap(k, x, &min_error, &max_error, &std_error);
       if (verbose) {
         cout << " done\n";
         cout << "Boundary fitting error (MSE) = " << error
@@ -298,25 +665,29 @@ void MeshlessHarmonicVolumeMapper::Solve()
 
       // TODO: Adapt set of source points (Xu et al., 2013)
     }
+    ++nfit;
+
+    // Notify observer, which may stop the iteration with the current map
+    if (!this->NotifyFittingError(iter + 1, error, min_error, max_error, std_error)) break;
 
     // Insert new source points by projecting boundary points with
     // high residual error onto the offset surface (cf. Xu et al., 2013)
     if (verbose) cout << "Insert new source points...", cout.flush();
     const int n = NumberOfSourcePoints();
-    for (vtkIdType ptId = 0; ptId < _Boundary->GetNumberOfPoints(); ++ptId) {
-      _ResidualMap->GetTuple(ptId, df);
-      if ((df[0]*df[0] + df[1]*df[1] + df[2]*df[2]) > (error + 1.5 * std_error)) {
-        _Boundary->GetPoint(ptId, p);
-        GetClosestPointOnOffsetSurface(p, q);
-        this->AddSourcePoint(q);
-      }
-    }
+    this->InsertSourcePoints(error + 1.5 * std_error);
     if (verbose) {
       cout << " done: #points = " << NumberOfSourcePoints()
            << " (+" << (NumberOfSourcePoints() - n) << ")" << endl;
     }
+
+    // Save intermediate result
+    this->WriteCheckpointIfDue(iter + 1);
   }
-  delete[] df;
+
+  // Record number of source points, fitting iterations, and final fitting error
+  _Statistics.NumberOfUnknowns(NumberOfSourcePoints());
+  _Statistics.NumberOfIterations(nfit);
+  _Statistics.Residual(error);
 }
 
 // =============================================================================
@@ -327,44 +698,98 @@ void MeshlessHarmonicVolumeMapper::Solve()
 void MeshlessHarmonicVolumeMapper
 ::GetCoefficients(int k, Matrix &coeffs) const
 {
+  const int n  = NumberOfSourcePoints(k);
+  const int nu = NumberOfUnknowns(n);
+  ComputeKernelProduct eval;
+  eval._Mapper           = this;
+  eval._Cols             = _SourcePartition[k].data();
+  eval._NumberOfCols     = n;
+  eval._NumberOfUnknowns = nu;
+  eval._Result           = Eigen::MatrixXd::Zero(nu, nu);
+  parallel_reduce(blocked_range<int>(0, NumberOfBoundaryPoints(), KernelTileSize(nu)), eval);
+  coeffs.Initialize(nu, nu);
+  for (int j = 0; j < nu; ++j)
+  for (int i = j; i < nu; ++i) {
+    coeffs(i, j) = coeffs(j, i) = eval._Result(i, j);
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessHarmonicVolumeMapper
+::GetAppendedCoefficients(int k, int n0, Matrix &coeffs) const
+{
+  // Unknowns of appended source points are not trailing in [H | B]
+  if (this->HasBiharmonicTerm()) return false;
   const int n = NumberOfSourcePoints(k);
-  coeffs.Initialize(n, n);
-  ComputeCoefficients eval;
-  eval._Kernel = &_Kernel;
-  eval._ColIdx = &_SourcePartition[k];
-  eval._Coeffs = &coeffs;
-  parallel_for(blocked_range2d<int>(0, n, 0, n), eval);
+  if (n0 < 0 || n0 >= n) return false;
+  ComputeKernelProduct eval;
+  eval._Mapper           = this;
+  eval._Cols             = _SourcePartition[k].data();
+  eval._NumberOfCols     = n;
+  eval._NumberOfUnknowns = n;
+  eval._FirstCol         = n0;
+  eval._Result           = Eigen::MatrixXd::Zero(n, n - n0);
+  parallel_reduce(blocked_range<int>(0, NumberOfBoundaryPoints(), KernelTileSize(n)), eval);
+  coeffs = EigenToMatrix(eval._Result);
+  return true;
 }
 
 // -----------------------------------------------------------------------------
 void MeshlessHarmonicVolumeMapper
 ::GetConstraints(int k, Matrix &b) const
 {
-  const int n = NumberOfSourcePoints(k);
-  const int d = NumberOfComponents();
-  b.Initialize(n, d);
-  ComputeConstraints eval;
-  eval._Kernel      = &_Kernel;
-  eval._ColIdx      = &_SourcePartition[k];
-  eval._BoundaryMap = _ResidualMap;
-  eval._b           = &b;
-  parallel_for(blocked_range2d<int>(0, n, 0, d), eval);
+  const int n  = NumberOfSourcePoints(k);
+  const int nu = NumberOfUnknowns(n);
+  const int d  = NumberOfComponents();
+  ComputeKernelProduct eval;
+  eval._Mapper           = this;
+  eval._Cols             = _SourcePartition[k].data();
+  eval._NumberOfCols     = n;
+  eval._NumberOfUnknowns = nu;
+  eval._BoundaryMap      = _ResidualMap;
+  eval._Result           = Eigen::MatrixXd::Zero(nu, d);
+  parallel_reduce(blocked_range<int>(0, NumberOfBoundaryPoints(), KernelTileSize(nu)), eval);
+  b = EigenToMatrix(eval._Result);
 }
 
 // -----------------------------------------------------------------------------
 void MeshlessHarmonicVolumeMapper
 ::AddWeights(int k, const Matrix &w)
 {
-  const int d = NumberOfComponents();
+  const int d  = NumberOfComponents();
+  const int n  = NumberOfSourcePoints();
+  const int nk = NumberOfSourcePoints(k);
+  const bool b = this->HasBiharmonicTerm();
   MeshlessHarmonicMap *map = dynamic_cast<MeshlessHarmonicMap *>(_Output.get());
   Matrix &weights = map->Coefficients();
-  for (int i = 0; i < NumberOfSourcePoints(k); ++i) {
+  for (int i = 0; i < nk; ++i) {
     const int r = SourcePointIndex(k, i);
     for (int j = 0; j < d; ++j) {
       weights(r, j) += w(i, j);
     }
+    if (b) {
+      for (int j = 0; j < d; ++j) {
+        weights(n + r, j) += w(nk + i, j);
+      }
+    }
   }
 }
 
+// -----------------------------------------------------------------------------
+bool MeshlessHarmonicVolumeMapper
+::GetBoundaryMap(int k, const Matrix &w, Matrix &f) const
+{
+  const int n = NumberOfSourcePoints(k);
+  f.Initialize(NumberOfBoundaryPoints(), w.Cols());
+  ComputeBoundaryMap eval;
+  eval._Mapper       = this;
+  eval._Cols         = _SourcePartition[k].data();
+  eval._NumberOfCols = n;
+  eval._Weights      = &w;
+  eval._BoundaryMap  = &f;
+  parallel_for(blocked_range<int>(0, NumberOfBoundaryPoints(), KernelTileSize(NumberOfUnknowns(n))), eval);
+  return true;
+}
+
 
 } // namespace mirtk
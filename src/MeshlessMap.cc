@@ -111,6 +111,60 @@ void MeshlessMap::BoundingBox(double &x1, double &y1, double &z1,
   }
 }
 
+// =============================================================================
+// Source points
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int MeshlessMap::RemoveSourcePoints(const Array<bool> &remove)
+{
+  Array<int> keep;
+  keep.reserve(_SourcePoints.Size());
+  for (int i = 0; i < _SourcePoints.Size(); ++i) {
+    if (i >= static_cast<int>(remove.size()) || !remove[i]) keep.push_back(i);
+  }
+  const int nremoved = _SourcePoints.Size() - static_cast<int>(keep.size());
+  if (nremoved == 0) return 0;
+  PointSet points(static_cast<int>(keep.size()));
+  for (size_t i = 0; i < keep.size(); ++i) {
+    points(static_cast<int>(i)) = _SourcePoints(keep[i]);
+  }
+  this->SelectCoefficients(keep);
+  _SourcePoints = points;
+  return nremoved;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessMap::ClearCoefficients(int i)
+{
+  for (int j = 0; j < _Coefficients.Cols(); ++j) {
+    _Coefficients(i, j) = .0;
+  }
+}
+
+// -----------------------------------------------------------------------------
+double MeshlessMap::CoefficientsNorm(int i) const
+{
+  double norm2 = .0;
+  for (int j = 0; j < _Coefficients.Cols(); ++j) {
+    norm2 += _Coefficients(i, j) * _Coefficients(i, j);
+  }
+  return sqrt(norm2);
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessMap::SelectCoefficients(const Array<int> &keep)
+{
+  const int n   = static_cast<int>(keep.size());
+  const int dim = _Coefficients.Cols();
+  Matrix coeffs(n, dim);
+  for (int j = 0; j < dim; ++j)
+  for (int i = 0; i < n;   ++i) {
+    coeffs(i, j) = _Coefficients(keep[i], j);
+  }
+  _Coefficients = coeffs;
+}
+
 // =============================================================================
 // I/O
 // =============================================================================
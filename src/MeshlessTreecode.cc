@@ -0,0 +1,284 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MeshlessTreecode.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Algorithm.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace MeshlessTreecodeUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Get coordinate of point along given axis
+inline double Coordinate(const Point &p, int axis)
+{
+  return (axis == 0 ? p._x : (axis == 1 ? p._y : p._z));
+}
+
+
+} // namespace MeshlessTreecodeUtils
+using namespace MeshlessTreecodeUtils;
+
+// =============================================================================
+// Construction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+MeshlessTreecode::MeshlessTreecode(const PointSet &sources, const Matrix &coeffs,
+                                   bool biharmonic, double theta)
+:
+  _NumberOfSourcePoints(sources.Size()),
+  _NumberOfComponents(coeffs.Cols()),
+  _NumberOfKernels(biharmonic ? 2 : 1),
+  _Theta2(theta * theta)
+{
+  if (theta <= .0 || theta >= 1.0) {
+    cerr << "MeshlessTreecode: Opening angle must be in the open interval (0, 1)" << endl;
+    exit(1);
+  }
+
+  const int n   = _NumberOfSourcePoints;
+  const int dim = _NumberOfComponents;
+  const int nk  = _NumberOfKernels;
+  if (n == 0) return;
+
+  // Build tree
+  Array<int> order(n);
+  for (int i = 0; i < n; ++i) order[i] = i;
+  _Nodes.reserve(4 * (n / LeafSize + 1));
+  BuildNode(order, sources, 0, n);
+
+  // Store source points and scaled coefficients in leaf order
+  const double scale[2] = { .25 / pi, 1.0 / (8.0 * pi) };
+  _Points      .resize(3 * n);
+  _Coefficients.resize(n * nk * dim);
+  for (int i = 0; i < n; ++i) {
+    const Point &p = sources(order[i]);
+    _Points[3 * i    ] = p._x;
+    _Points[3 * i + 1] = p._y;
+    _Points[3 * i + 2] = p._z;
+    for (int k = 0; k < nk; ++k)
+    for (int j = 0; j < dim; ++j) {
+      _Coefficients[(i * nk + k) * dim + j] = scale[k] * coeffs(order[i] + k * n, j);
+    }
+  }
+
+  ComputeMoments();
+}
+
+// -----------------------------------------------------------------------------
+int MeshlessTreecode::BuildNode(Array<int> &order, const PointSet &sources, int begin, int end)
+{
+  const int index = static_cast<int>(_Nodes.size());
+  _Nodes.push_back(Node());
+
+  // Bounding box of source points
+  double b[6] = { +inf, -inf, +inf, -inf, +inf, -inf };
+  for (int i = begin; i < end; ++i) {
+    const Point &p = sources(order[i]);
+    b[0] = min(b[0], p._x), b[1] = max(b[1], p._x);
+    b[2] = min(b[2], p._y), b[3] = max(b[3], p._y);
+    b[4] = min(b[4], p._z), b[5] = max(b[5], p._z);
+  }
+
+  // Center of expansion and radius of node
+  Node &node = _Nodes[index];
+  node._Center[0] = .5 * (b[0] + b[1]);
+  node._Center[1] = .5 * (b[2] + b[3]);
+  node._Center[2] = .5 * (b[4] + b[5]);
+  double r2 = .0, dx, dy, dz;
+  for (int i = begin; i < end; ++i) {
+    const Point &p = sources(order[i]);
+    dx = p._x - node._Center[0];
+    dy = p._y - node._Center[1];
+    dz = p._z - node._Center[2];
+    r2 = max(r2, dx * dx + dy * dy + dz * dz);
+  }
+  node._Radius = sqrt(r2);
+
+  // Leaf node
+  if (end - begin <= LeafSize) {
+    node._Offset = begin;
+    node._Count  = end - begin;
+    return index;
+  }
+
+  // Split source points at median along longest axis
+  int axis = 0;
+  if (b[3] - b[2] > b[2*axis+1] - b[2*axis]) axis = 1;
+  if (b[5] - b[4] > b[2*axis+1] - b[2*axis]) axis = 2;
+  const int mid = begin + (end - begin) / 2;
+  nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+              [&sources, axis](int a, int b) {
+                return Coordinate(sources(a), axis) < Coordinate(sources(b), axis);
+              });
+
+  BuildNode(order, sources, begin, mid);
+  const int right = BuildNode(order, sources, mid, end);
+  _Nodes[index]._Offset = right;
+  _Nodes[index]._Count  = 0;
+  return index;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessTreecode::ComputeMoments()
+{
+  const int nk     = _NumberOfKernels;
+  const int dim    = _NumberOfComponents;
+  const int stride = 10 * nk * dim;
+
+  _Moments.clear();
+  _Moments.resize(_Nodes.size() * stride, .0);
+
+  // Source points of a subtree are contiguous in leaf order
+  Array<int> begin(_Nodes.size()), end(_Nodes.size());
+  for (int index = static_cast<int>(_Nodes.size()) - 1; index >= 0; --index) {
+    const Node &node = _Nodes[index];
+    if (node._Count > 0) {
+      begin[index] = node._Offset;
+      end  [index] = node._Offset + node._Count;
+    } else {
+      begin[index] = begin[index + 1];
+      end  [index] = end  [node._Offset];
+    }
+  }
+
+  double d[3], c, *m;
+  for (size_t index = 0; index < _Nodes.size(); ++index) {
+    const Node &node = _Nodes[index];
+    for (int i = begin[index]; i < end[index]; ++i) {
+      d[0] = _Points[3 * i    ] - node._Center[0];
+      d[1] = _Points[3 * i + 1] - node._Center[1];
+      d[2] = _Points[3 * i + 2] - node._Center[2];
+      for (int k = 0; k < nk; ++k)
+      for (int j = 0; j < dim; ++j) {
+        c = _Coefficients[(i * nk + k) * dim + j];
+        m = _Moments.data() + index * stride + 10 * (k * dim + j);
+        m[0] += c;
+        m[1] += c * d[0];
+        m[2] += c * d[1];
+        m[3] += c * d[2];
+        m[4] += c * d[0] * d[0];
+        m[5] += c * d[0] * d[1];
+        m[6] += c * d[0] * d[2];
+        m[7] += c * d[1] * d[1];
+        m[8] += c * d[1] * d[2];
+        m[9] += c * d[2] * d[2];
+      }
+    }
+  }
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool MeshlessTreecode::Evaluate(const double p[3], double *v) const
+{
+  const int nk     = _NumberOfKernels;
+  const int dim    = _NumberOfComponents;
+  const int stride = 10 * nk * dim;
+
+  for (int j = 0; j < dim; ++j) v[j] = .0;
+  if (_Nodes.empty()) return true;
+
+  int    stack[64], top = 0;
+  double R[3], r, r2, ir, u[3], um1, umu, tr;
+  const double *c, *m;
+
+  stack[top++] = 0;
+  while (top > 0) {
+    const int   index = stack[--top];
+    const Node &node  = _Nodes[index];
+    R[0] = p[0] - node._Center[0];
+    R[1] = p[1] - node._Center[1];
+    R[2] = p[2] - node._Center[2];
+    r2   = R[0] * R[0] + R[1] * R[1] + R[2] * R[2];
+    if (node._Radius * node._Radius < _Theta2 * r2) {
+      // Multipole expansion about node center
+      r  = sqrt(r2);
+      ir = 1.0 / r;
+      u[0] = R[0] * ir, u[1] = R[1] * ir, u[2] = R[2] * ir;
+      m = _Moments.data() + index * stride;
+      for (int j = 0; j < dim; ++j, m += 10) {
+        um1 = u[0] * m[1] + u[1] * m[2] + u[2] * m[3];
+        umu = u[0] * u[0] * m[4] + u[1] * u[1] * m[7] + u[2] * u[2] * m[9]
+            + 2.0 * (u[0] * u[1] * m[5] + u[0] * u[2] * m[6] + u[1] * u[2] * m[8]);
+        tr  = m[4] + m[7] + m[9];
+        v[j] += ir * (m[0] + ir * (um1 + ir * (1.5 * umu - .5 * tr)));
+      }
+      if (nk > 1) {
+        for (int j = 0; j < dim; ++j, m += 10) {
+          um1 = u[0] * m[1] + u[1] * m[2] + u[2] * m[3];
+          umu = u[0] * u[0] * m[4] + u[1] * u[1] * m[7] + u[2] * u[2] * m[9]
+              + 2.0 * (u[0] * u[1] * m[5] + u[0] * u[2] * m[6] + u[1] * u[2] * m[8]);
+          tr  = m[4] + m[7] + m[9];
+          v[j] += m[0] * r - um1 + .5 * ir * (tr - umu);
+        }
+      }
+    } else if (node._Count > 0) {
+      // Direct summation over source points of leaf
+      for (int i = node._Offset; i < node._Offset + node._Count; ++i) {
+        R[0] = p[0] - _Points[3 * i    ];
+        R[1] = p[1] - _Points[3 * i + 1];
+        R[2] = p[2] - _Points[3 * i + 2];
+        r = sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+        if (r < 1e-12) return false;
+        ir = 1.0 / r;
+        c  = _Coefficients.data() + i * nk * dim;
+        for (int j = 0; j < dim; ++j) v[j] += c[j] * ir;
+        if (nk > 1) {
+          c += dim;
+          for (int j = 0; j < dim; ++j) v[j] += c[j] * r;
+        }
+      }
+    } else {
+      stack[top++] = node._Offset;
+      stack[top++] = index + 1;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessTreecode
+::Evaluate(int m, const double *xyz, double *values, bool *inside, double outside) const
+{
+  const int dim = _NumberOfComponents;
+  for (int i = 0; i < m; ++i, xyz += 3, values += dim) {
+    const bool is_inside = Evaluate(xyz, values);
+    if (!is_inside) {
+      for (int j = 0; j < dim; ++j) values[j] = outside;
+    }
+    if (inside) inside[i] = is_inside;
+  }
+}
+
+
+} // namespace mirtk
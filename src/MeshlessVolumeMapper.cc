@@ -23,14 +23,26 @@
 
 #include "mirtk/Math.h"
 #include "mirtk/Assert.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Cfstream.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/Pair.h"
 #include "mirtk/Parallel.h"
+#include "mirtk/Profiling.h"
 #include "mirtk/MeshSmoothing.h"
 #include "mirtk/PointSetIO.h"
+#include "mirtk/PointSetUtils.h"
+#include "mirtk/TemporaryFile.h"
+#include "mirtk/UnorderedMap.h"
+#include "mirtk/VtkMath.h"
 
 #include "mirtk/Vtk.h"
 #include "vtkPointData.h"
 #include "vtkCellData.h"
-#include "vtkImplicitModeller.h"
+#include "vtkNew.h"
+#include "vtkIdList.h"
+#include "vtkImageData.h"
+#include "vtkFloatArray.h"
 #include "vtkPolyDataConnectivityFilter.h"
 #include "vtkContourFilter.h"
 #include "vtkLinearSubdivisionFilter.h"
@@ -40,8 +52,14 @@
 #include "vtkGenericCell.h"
 
 #include "mirtk/Eigen.h"
-#include "Eigen/LU"
-#include "Eigen/SVD"
+#include "Eigen/Cholesky"
+#include "Eigen/Eigenvalues"
+
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 
 
 namespace mirtk {
@@ -135,6 +153,735 @@ struct ComputeResidualMap
 };
 
 
+// -----------------------------------------------------------------------------
+/// Compute df -= f_k, where f_k is the boundary map of the added weights
+struct SubtractFromResidualMap
+{
+  const Matrix  *_BoundaryMap;
+  vtkDataArray  *_ResidualMap;
+  int            _OutputDimension;
+  double         _SquaredError;
+  double         _SquaredError2;
+  double         _MinSquaredError;
+  double         _MaxSquaredError;
+
+  SubtractFromResidualMap()
+  :
+    _SquaredError(.0),
+    _SquaredError2(.0),
+    _MinSquaredError(numeric_limits<double>::infinity()),
+    _MaxSquaredError(.0)
+  {}
+
+  SubtractFromResidualMap(const SubtractFromResidualMap &other, split)
+  :
+    _BoundaryMap    (other._BoundaryMap),
+    _ResidualMap    (other._ResidualMap),
+    _OutputDimension(other._OutputDimension),
+    _SquaredError   (.0),
+    _SquaredError2  (.0),
+    _MinSquaredError(other._MinSquaredError),
+    _MaxSquaredError(other._MaxSquaredError)
+  {}
+
+  void join(const SubtractFromResidualMap &other)
+  {
+    _SquaredError   += other._SquaredError;
+    _SquaredError2  += other._SquaredError2;
+    _MinSquaredError = min(_MinSquaredError, other._MinSquaredError);
+    _MaxSquaredError = max(_MaxSquaredError, other._MaxSquaredError);
+  }
+
+  void operator ()(const blocked_range<vtkIdType> &re)
+  {
+    double df, dist2;
+    for (vtkIdType ptId = re.begin(); ptId != re.end(); ++ptId) {
+      dist2 = .0;
+      for (int i = 0; i < _OutputDimension; ++i) {
+        df = _ResidualMap->GetComponent(ptId, i) - (*_BoundaryMap)(static_cast<int>(ptId), i);
+        _ResidualMap->SetComponent(ptId, i, df);
+        dist2 += df * df;
+      }
+      _SquaredError  += dist2;
+      _SquaredError2 += dist2 * dist2;
+      if (dist2 < _MinSquaredError) _MinSquaredError = dist2;
+      if (dist2 > _MaxSquaredError) _MaxSquaredError = dist2;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Estimate smallest and largest eigenvalues of symmetric positive semi-definite
+/// matrix using Lanczos iterations
+///
+/// The extreme eigenvalues of the tridiagonal matrix of the Lanczos recurrence
+/// converge much faster to those of the input matrix than the power iterations
+/// do to its largest eigenvalue. Without reorthogonalization of the Lanczos
+/// vectors, spurious copies of converged eigenvalues may appear, which does
+/// not affect the estimates of the extreme eigenvalues. The estimated
+/// smallest eigenvalue is an upper bound of the true smallest eigenvalue.
+void ExtremeEigenvalues(const Eigen::Map<const Eigen::MatrixXd> &A,
+                        double &lmin, double &lmax, int maxiter = 50)
+{
+  const int n = static_cast<int>(A.rows());
+  maxiter = min(maxiter, n);
+  lmin = lmax = .0;
+  if (maxiter <= 0) return;
+  Eigen::VectorXd alpha(maxiter), beta(maxiter);
+  Eigen::VectorXd v = Eigen::VectorXd::Ones(n) / sqrt(double(n)), v0, w;
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig;
+  int m = 0;
+  double prev_min = .0, prev_max = .0;
+  v0.setZero(n);
+  for (int iter = 0; iter < maxiter; ++iter) {
+    w.noalias() = A.selfadjointView<Eigen::Lower>() * v;
+    alpha(iter) = w.dot(v);
+    w -= alpha(iter) * v;
+    if (iter > 0) w -= beta(iter - 1) * v0;
+    beta(iter) = w.norm();
+    m = iter + 1;
+    // Eigenvalues of tridiagonal matrix
+    eig.computeFromTridiagonal(alpha.head(m), beta.head(m - 1), Eigen::EigenvaluesOnly);
+    lmin = eig.eigenvalues()(0);
+    lmax = eig.eigenvalues()(m - 1);
+    if (beta(iter) <= 1e-12 * abs(lmax)) break; // invariant subspace found
+    if (iter > 0 && abs(lmax - prev_max) <= 1e-6 * lmax
+                 && abs(lmin - prev_min) <= 1e-6 * lmax) break;
+    prev_min = lmin, prev_max = lmax;
+    v0 = v;
+    v  = w / beta(iter);
+  }
+  if (lmin < .0) lmin = .0;
+}
+
+// -----------------------------------------------------------------------------
+/// Solve linear systems L L^T x = b of multiple source points subsets
+struct SolveCholesky
+{
+  const Matrix *_Factor;
+  Matrix       *_Solution;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int k = re.begin(); k != re.end(); ++k) {
+      const Matrix &A = _Factor[k];
+      const int     n = A.Rows();
+      Eigen::Map<const Eigen::MatrixXd> L(A.RawPointer(), n, n);
+      Eigen::Map<Eigen::MatrixXd> X(_Solution[k].RawPointer(), n, _Solution[k].Cols());
+      L.triangularView<Eigen::Lower>().solveInPlace(X);
+      L.triangularView<Eigen::Lower>().adjoint().solveInPlace(X);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Compute dot products <r0, r0 - r1> and <r0 - r1, r0 - r1> of residuals
+struct ComputeResidualChange
+{
+  vtkDataArray *_Residual0;
+  vtkDataArray *_Residual1;
+  double        _Dot;
+  double        _Norm2;
+
+  ComputeResidualChange() : _Dot(.0), _Norm2(.0) {}
+
+  ComputeResidualChange(const ComputeResidualChange &other, split)
+  :
+    _Residual0(other._Residual0),
+    _Residual1(other._Residual1),
+    _Dot(.0), _Norm2(.0)
+  {}
+
+  void join(const ComputeResidualChange &other)
+  {
+    _Dot   += other._Dot;
+    _Norm2 += other._Norm2;
+  }
+
+  void operator ()(const blocked_range<vtkIdType> &re)
+  {
+    double r0, dr;
+    const int d = _Residual0->GetNumberOfComponents();
+    for (vtkIdType ptId = re.begin(); ptId != re.end(); ++ptId)
+    for (int j = 0; j < d; ++j) {
+      r0 = _Residual0->GetComponent(ptId, j);
+      dr = r0 - _Residual1->GetComponent(ptId, j);
+      _Dot   += r0 * dr;
+      _Norm2 += dr * dr;
+    }
+  }
+};
+
+
+// -----------------------------------------------------------------------------
+/// Get point coordinates of triangles of surface mesh, where polygons are
+/// triangulated as triangle fans and lines and vertices are ignored
+void GetTriangles(vtkPolyData *surface, Array<double> &triangles)
+{
+  triangles.clear();
+  triangles.reserve(9 * surface->GetNumberOfCells());
+  vtkNew<vtkIdList> ptIds;
+  double a[3], b[3], c[3];
+  for (vtkIdType cellId = 0; cellId < surface->GetNumberOfCells(); ++cellId) {
+    const int type = surface->GetCellType(cellId);
+    GetCellPoints(surface, cellId, ptIds.GetPointer());
+    for (vtkIdType i = 2; i < ptIds->GetNumberOfIds(); ++i) {
+      if (type == VTK_TRIANGLE_STRIP) {
+        surface->GetPoint(ptIds->GetId(i - 2), a);
+      } else {
+        surface->GetPoint(ptIds->GetId(0), a);
+      }
+      surface->GetPoint(ptIds->GetId(i - 1), b);
+      surface->GetPoint(ptIds->GetId(i), c);
+      triangles.insert(triangles.end(), a, a + 3);
+      triangles.insert(triangles.end(), b, b + 3);
+      triangles.insert(triangles.end(), c, c + 3);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Get lattice index bounds [i1, i2, j1, j2, k1, k2] of each triangle
+/// extended by the width of the narrow band
+void GetTriangleBounds(const Array<double> &triangles, double band,
+                       const double origin[3], const double spacing[3],
+                       const int size[3], Array<int> &bounds)
+{
+  const int ntriangles = static_cast<int>(triangles.size() / 9);
+  bounds.resize(6 * ntriangles);
+  double lo, hi;
+  for (int t = 0; t < ntriangles; ++t) {
+    const double *p = triangles.data() + 9 * t;
+    int          *b = bounds.data() + 6 * t;
+    for (int d = 0; d < 3; ++d) {
+      lo = min(min(p[d], p[3 + d]), p[6 + d]) - band;
+      hi = max(max(p[d], p[3 + d]), p[6 + d]) + band;
+      b[2 * d    ] = max(0,           static_cast<int>(floor((lo - origin[d]) / spacing[d])));
+      b[2 * d + 1] = min(size[d] - 1, static_cast<int>(ceil ((hi - origin[d]) / spacing[d])));
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Closest point on triangle and its squared distance
+/// (cf. Ericson, Real-Time Collision Detection, Section 5.1.5)
+double ClosestPointOnTriangle(const double p[3], const double a[3], const double b[3],
+                              const double c[3], double q[3])
+{
+  double ab[3], ac[3], ap[3], bp[3], cp[3];
+  for (int d = 0; d < 3; ++d) {
+    ab[d] = b[d] - a[d];
+    ac[d] = c[d] - a[d];
+    ap[d] = p[d] - a[d];
+    bp[d] = p[d] - b[d];
+    cp[d] = p[d] - c[d];
+  }
+  const double d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+  const double d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+  const double d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+  const double d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+  const double d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+  const double d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+  const double va = d3 * d6 - d5 * d4;
+  const double vb = d5 * d2 - d1 * d6;
+  const double vc = d1 * d4 - d3 * d2;
+  double v, w;
+  if (d1 <= .0 && d2 <= .0) {
+    v = w = .0;
+  } else if (d3 >= .0 && d4 <= d3) {
+    v = 1.0, w = .0;
+  } else if (d6 >= .0 && d5 <= d6) {
+    v = .0, w = 1.0;
+  } else if (vc <= .0 && d1 >= .0 && d3 <= .0) {
+    v = d1 / (d1 - d3), w = .0;
+  } else if (vb <= .0 && d2 >= .0 && d6 <= .0) {
+    v = .0, w = d2 / (d2 - d6);
+  } else if (va <= .0 && d4 - d3 >= .0 && d5 - d6 >= .0) {
+    w = (d4 - d3) / ((d4 - d3) + (d5 - d6)), v = 1.0 - w;
+  } else if (va + vb + vc > .0) {
+    v = vb / (va + vb + vc), w = vc / (va + vb + vc);
+  } else {
+    v = w = .0;
+  }
+  double dist2 = .0;
+  for (int d = 0; d < 3; ++d) {
+    q[d] = a[d] + v * ab[d] + w * ac[d];
+    dist2 += (q[d] - p[d]) * (q[d] - p[d]);
+  }
+  return dist2;
+}
+
+// -----------------------------------------------------------------------------
+/// Compute unsigned distance to triangles at lattice points within narrow band
+///
+/// Each range of lattice slices is processed by one thread, which visits all
+/// triangles whose narrow band intersects these slices. Distances outside
+/// the narrow band are set to its width and the lattice boundary is capped.
+struct ComputeDistanceField
+{
+  const Array<double> *_Triangles;
+  const Array<int>    *_TriangleBounds;
+  float               *_Distance;
+  int                  _Size[3];
+  double               _Origin[3];
+  double               _Spacing[3];
+  double               _Band;
+  float                _CapValue;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int    nx = _Size[0], ny = _Size[1], nz = _Size[2];
+    const size_t nxy = static_cast<size_t>(nx) * static_cast<size_t>(ny);
+    const int    ntriangles = static_cast<int>(_Triangles->size() / 9);
+
+    float *begin = _Distance + static_cast<size_t>(re.begin()) * nxy;
+    float *end   = _Distance + static_cast<size_t>(re.end())   * nxy;
+    const float band2 = static_cast<float>(_Band * _Band);
+    for (float *v = begin; v != end; ++v) *v = band2;
+
+    double p[3], q[3], dist2;
+    float *v;
+    for (int t = 0; t < ntriangles; ++t) {
+      const int    *b  = _TriangleBounds->data() + 6 * t;
+      const int     k1 = max(b[4], re.begin());
+      const int     k2 = min(b[5], re.end() - 1);
+      if (k1 > k2) continue;
+      const double *a = _Triangles->data() + 9 * t;
+      for (int k = k1; k <= k2; ++k)
+      for (int j = b[2]; j <= b[3]; ++j) {
+        p[1] = _Origin[1] + j * _Spacing[1];
+        p[2] = _Origin[2] + k * _Spacing[2];
+        v = _Distance + static_cast<size_t>(k) * nxy + static_cast<size_t>(j) * nx + b[0];
+        for (int i = b[0]; i <= b[1]; ++i, ++v) {
+          p[0] = _Origin[0] + i * _Spacing[0];
+          dist2 = ClosestPointOnTriangle(p, a, a + 3, a + 6, q);
+          if (dist2 < static_cast<double>(*v)) *v = static_cast<float>(dist2);
+        }
+      }
+    }
+
+    v = begin;
+    for (int k = re.begin(); k != re.end(); ++k)
+    for (int j = 0; j < ny; ++j)
+    for (int i = 0; i < nx; ++i, ++v) {
+      if (i == 0 || j == 0 || k == 0 || i == nx - 1 || j == ny - 1 || k == nz - 1) {
+        *v = _CapValue;
+      } else {
+        *v = sqrt(*v);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Interleave lower 21 bits of lattice coordinates to 63-bit Morton code
+inline uint64_t MortonCode(uint64_t x, uint64_t y, uint64_t z)
+{
+  uint64_t code = 0;
+  for (int b = 0; b < 21; ++b) {
+    code |= ((x >> b) & 1ULL) << (3 * b);
+    code |= ((y >> b) & 1ULL) << (3 * b + 1);
+    code |= ((z >> b) & 1ULL) << (3 * b + 2);
+  }
+  return code;
+}
+
+// -----------------------------------------------------------------------------
+/// Get indices of points sorted along the Morton (Z-order) curve
+void SortByMortonCode(const PointSet &points, Array<int> &order)
+{
+  const int n = points.Size();
+  double bounds[6] = { +inf, -inf, +inf, -inf, +inf, -inf };
+  for (int i = 0; i < n; ++i) {
+    const Point &p = points(i);
+    bounds[0] = min(bounds[0], p._x), bounds[1] = max(bounds[1], p._x);
+    bounds[2] = min(bounds[2], p._y), bounds[3] = max(bounds[3], p._y);
+    bounds[4] = min(bounds[4], p._z), bounds[5] = max(bounds[5], p._z);
+  }
+  const double scale = double((1 << 21) - 1) / max(max(max(bounds[1] - bounds[0],
+                                                             bounds[3] - bounds[2]),
+                                                             bounds[5] - bounds[4]), 1e-12);
+  Array<Pair<uint64_t, int> > codes(n);
+  for (int i = 0; i < n; ++i) {
+    const Point &p = points(i);
+    codes[i].first  = MortonCode(static_cast<uint64_t>((p._x - bounds[0]) * scale),
+                                 static_cast<uint64_t>((p._y - bounds[2]) * scale),
+                                 static_cast<uint64_t>((p._z - bounds[4]) * scale));
+    codes[i].second = i;
+  }
+  sort(codes.begin(), codes.end());
+  order.resize(n);
+  for (int i = 0; i < n; ++i) order[i] = codes[i].second;
+}
+
+// -----------------------------------------------------------------------------
+/// Assign points to closest cluster center and sum up cluster points
+struct AssignToClusters
+{
+  const PointSet *_Points;
+  const double   *_Centers;
+  int             _NumberOfClusters;
+  int            *_Labels;
+  Array<double>   _Sum;
+  Array<int>      _Count;
+  int             _NumberOfChanges;
+
+  AssignToClusters() : _NumberOfChanges(0) {}
+
+  AssignToClusters(const AssignToClusters &other, split)
+  :
+    _Points(other._Points),
+    _Centers(other._Centers),
+    _NumberOfClusters(other._NumberOfClusters),
+    _Labels(other._Labels),
+    _Sum(3 * other._NumberOfClusters, .0),
+    _Count(other._NumberOfClusters, 0),
+    _NumberOfChanges(0)
+  {}
+
+  void join(const AssignToClusters &other)
+  {
+    for (size_t i = 0; i < _Sum.size();   ++i) _Sum[i]   += other._Sum[i];
+    for (size_t i = 0; i < _Count.size(); ++i) _Count[i] += other._Count[i];
+    _NumberOfChanges += other._NumberOfChanges;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    double dx, dy, dz, dist2, min_dist2;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      const Point &p = (*_Points)(i);
+      int label = 0;
+      min_dist2 = inf;
+      for (int k = 0; k < _NumberOfClusters; ++k) {
+        dx = p._x - _Centers[3 * k];
+        dy = p._y - _Centers[3 * k + 1];
+        dz = p._z - _Centers[3 * k + 2];
+        dist2 = dx * dx + dy * dy + dz * dz;
+        if (dist2 < min_dist2) min_dist2 = dist2, label = k;
+      }
+      if (_Labels[i] != label) ++_NumberOfChanges;
+      _Labels[i] = label;
+      _Sum[3 * label    ] += p._x;
+      _Sum[3 * label + 1] += p._y;
+      _Sum[3 * label + 2] += p._z;
+      _Count[label] += 1;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Uniform grid of triangles for thread-safe closest point queries
+///
+/// Unlike vtkCellLocator, whose queries modify the state of the locator,
+/// the closest point queries of this grid only read its data and can be
+/// executed by multiple threads at once.
+class TriangleGrid
+{
+  Array<double> _Triangles; ///< Point coordinates of triangles
+  Array<int>    _Offset;    ///< Offset of first triangle index of each cell
+  Array<int>    _Index;     ///< Indices of triangles overlapping each cell
+  double        _Origin[3]; ///< Lower bounds of grid
+  double        _CellSize;  ///< Side length of grid cells
+  int           _Size[3];   ///< Number of grid cells along each axis
+
+  int CellIndex(int i, int j, int k) const
+  {
+    return (k * _Size[1] + j) * _Size[0] + i;
+  }
+
+public:
+
+  /// Bin triangles of surface mesh
+  void Initialize(vtkPolyData *surface)
+  {
+    GetTriangles(surface, _Triangles);
+    const int ntriangles = static_cast<int>(_Triangles.size() / 9);
+
+    double bounds[6];
+    surface->GetBounds(bounds);
+    double extent = .0;
+    for (int d = 0; d < 3; ++d) {
+      _Origin[d] = bounds[2 * d];
+      extent = max(extent, bounds[2 * d + 1] - bounds[2 * d]);
+    }
+    // About sqrt(n) triangles per non-empty cell of a surface with n triangles
+    const int n = max(1, min(256, iround(.5 * sqrt(double(ntriangles)))));
+    _CellSize = (extent > .0 ? extent / n : 1.0);
+    for (int d = 0; d < 3; ++d) {
+      _Size[d] = max(1, min(n, iceil((bounds[2 * d + 1] - bounds[2 * d]) / _CellSize)));
+    }
+
+    Array<int> cell_bounds;
+    const double spacing[3] = { _CellSize, _CellSize, _CellSize };
+    GetTriangleBounds(_Triangles, .0, _Origin, spacing, _Size, cell_bounds);
+    _Offset.clear();
+    _Offset.resize(_Size[0] * _Size[1] * _Size[2] + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        for (size_t c = 1; c < _Offset.size(); ++c) _Offset[c] += _Offset[c - 1];
+        _Index.resize(_Offset.back());
+      }
+      for (int t = ntriangles - 1; t >= 0; --t) {
+        const int *b = cell_bounds.data() + 6 * t;
+        for (int k = b[4]; k <= b[5]; ++k)
+        for (int j = b[2]; j <= b[3]; ++j)
+        for (int i = b[0]; i <= b[1]; ++i) {
+          const int c = CellIndex(i, j, k);
+          if (pass == 0) ++_Offset[c];
+          else           _Index[--_Offset[c]] = t;
+        }
+      }
+    }
+  }
+
+  /// Find closest point on surface
+  ///
+  /// The grid cells are visited in shells of increasing distance from the
+  /// cell containing the query point until no closer triangle can exist.
+  ///
+  /// \returns Squared distance of closest point or infinity if surface is empty.
+  double FindClosestPoint(const double p[3], double closest[3]) const
+  {
+    int  c[3];
+    bool inside = true;
+    for (int d = 0; d < 3; ++d) {
+      const double x = (p[d] - _Origin[d]) / _CellSize;
+      if (x < .0 || x >= double(_Size[d])) inside = false;
+      c[d] = max(0, min(_Size[d] - 1, ifloor(x)));
+    }
+    const int rmax = max(max(_Size[0], _Size[1]), _Size[2]);
+    double q[3], dist2, min_dist2 = numeric_limits<double>::infinity();
+    for (int r = 0; r <= rmax; ++r) {
+      for (int k = max(0, c[2] - r); k <= min(_Size[2] - 1, c[2] + r); ++k)
+      for (int j = max(0, c[1] - r); j <= min(_Size[1] - 1, c[1] + r); ++j)
+      for (int i = max(0, c[0] - r); i <= min(_Size[0] - 1, c[0] + r); ++i) {
+        if (max(max(abs(i - c[0]), abs(j - c[1])), abs(k - c[2])) != r) continue;
+        const int cell = CellIndex(i, j, k);
+        for (int l = _Offset[cell]; l < _Offset[cell + 1]; ++l) {
+          const double *a = _Triangles.data() + 9 * _Index[l];
+          dist2 = ClosestPointOnTriangle(p, a, a + 3, a + 6, q);
+          if (dist2 < min_dist2) {
+            min_dist2 = dist2;
+            closest[0] = q[0], closest[1] = q[1], closest[2] = q[2];
+          }
+        }
+      }
+      if (inside && min_dist2 <= pow(r * _CellSize, 2)) break;
+    }
+    return min_dist2;
+  }
+
+  /// Mean edge length of triangles
+  double MeanEdgeLength() const
+  {
+    const int ntriangles = static_cast<int>(_Triangles.size() / 9);
+    double sum = .0;
+    for (int t = 0; t < ntriangles; ++t) {
+      const double *a = _Triangles.data() + 9 * t;
+      sum += sqrt(vtkMath::Distance2BetweenPoints(a,     a + 3));
+      sum += sqrt(vtkMath::Distance2BetweenPoints(a + 3, a + 6));
+      sum += sqrt(vtkMath::Distance2BetweenPoints(a + 6, a));
+    }
+    return (ntriangles > 0 ? sum / (3 * ntriangles) : .0);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Select boundary points whose squared residual norm exceeds a threshold
+struct SelectBoundaryPoints
+{
+  vtkDataArray     *_ResidualMap;
+  double            _Threshold;
+  Array<vtkIdType>  _PointIds;
+
+  SelectBoundaryPoints() {}
+
+  SelectBoundaryPoints(const SelectBoundaryPoints &other, split)
+  :
+    _ResidualMap(other._ResidualMap),
+    _Threshold(other._Threshold)
+  {}
+
+  void join(const SelectBoundaryPoints &other)
+  {
+    _PointIds.insert(_PointIds.end(), other._PointIds.begin(), other._PointIds.end());
+  }
+
+  void operator ()(const blocked_range<vtkIdType> &re)
+  {
+    const int d = _ResidualMap->GetNumberOfComponents();
+    double df, dist2;
+    for (vtkIdType ptId = re.begin(); ptId != re.end(); ++ptId) {
+      dist2 = .0;
+      for (int i = 0; i < d; ++i) {
+        df = _ResidualMap->GetComponent(ptId, i);
+        dist2 += df * df;
+      }
+      if (dist2 > _Threshold) _PointIds.push_back(ptId);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Project boundary points onto offset surface
+struct ProjectOntoOffsetSurface
+{
+  vtkPoints              *_Boundary;
+  const vtkIdType        *_PointIds;
+  const TriangleGrid     *_OffsetSurface;
+  double                 *_Points;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    double p[3];
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Boundary->GetPoint(_PointIds[i], p);
+      _OffsetSurface->FindClosestPoint(p, _Points + 3 * i);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Spatial hash of points used to discard near-duplicate points
+class PointHash
+{
+  double                        _CellSize;
+  Array<double>                 _Points;
+  UnorderedMap<int64_t, Array<int> > _Cells;
+
+  static int64_t Key(int64_t i, int64_t j, int64_t k)
+  {
+    return (i * 73856093LL) ^ (j * 19349663LL) ^ (k * 83492791LL);
+  }
+
+public:
+
+  PointHash(double tol) : _CellSize(tol) {}
+
+  /// Add point when no other point is within the tolerance distance
+  ///
+  /// \returns Whether point was added.
+  bool Add(const double p[3])
+  {
+    const double tol2 = _CellSize * _CellSize;
+    const int64_t ci = static_cast<int64_t>(floor(p[0] / _CellSize));
+    const int64_t cj = static_cast<int64_t>(floor(p[1] / _CellSize));
+    const int64_t ck = static_cast<int64_t>(floor(p[2] / _CellSize));
+    for (int64_t k = ck - 1; k <= ck + 1; ++k)
+    for (int64_t j = cj - 1; j <= cj + 1; ++j)
+    for (int64_t i = ci - 1; i <= ci + 1; ++i) {
+      auto cell = _Cells.find(Key(i, j, k));
+      if (cell == _Cells.end()) continue;
+      const Array<int> &idx = cell->second;
+      for (size_t l = 0; l < idx.size(); ++l) {
+        if (vtkMath::Distance2BetweenPoints(p, _Points.data() + 3 * idx[l]) < tol2) {
+          return false;
+        }
+      }
+    }
+    const int idx = static_cast<int>(_Points.size() / 3);
+    _Points.insert(_Points.end(), p, p + 3);
+    _Cells[Key(ci, cj, ck)].push_back(idx);
+    return true;
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Update 64-bit FNV-1a hash value
+inline void Hash(uint64_t &h, const void *data, size_t n)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<uint64_t>(p[i]);
+    h *= 1099511628211ULL;
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Compute hash value of boundary surface and offset surface parameters
+uint64_t HashOffsetSurfaceInput(vtkPolyData *boundary, double offset, int size,
+                                double spacing, double ratio)
+{
+  const int32_t version = 1;
+
+  uint64_t h = 14695981039346656037ULL;
+  int64_t  n;
+  double   p[3];
+
+  Hash(h, &version, sizeof(version));
+  Hash(h, &offset,  sizeof(offset));
+  n = static_cast<int64_t>(size);
+  Hash(h, &n,       sizeof(n));
+  Hash(h, &spacing, sizeof(spacing));
+  Hash(h, &ratio,   sizeof(ratio));
+
+  n = static_cast<int64_t>(boundary->GetNumberOfPoints());
+  Hash(h, &n, sizeof(n));
+  for (vtkIdType ptId = 0; ptId < boundary->GetNumberOfPoints(); ++ptId) {
+    boundary->GetPoint(ptId, p);
+    Hash(h, p, sizeof(p));
+  }
+
+  vtkNew<vtkIdList> ptIds;
+  n = static_cast<int64_t>(boundary->GetNumberOfCells());
+  Hash(h, &n, sizeof(n));
+  for (vtkIdType cellId = 0; cellId < boundary->GetNumberOfCells(); ++cellId) {
+    n = static_cast<int64_t>(boundary->GetCellType(cellId));
+    Hash(h, &n, sizeof(n));
+    GetCellPoints(boundary, cellId, ptIds.GetPointer());
+    n = static_cast<int64_t>(ptIds->GetNumberOfIds());
+    Hash(h, &n, sizeof(n));
+    for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
+      n = static_cast<int64_t>(ptIds->GetId(i));
+      Hash(h, &n, sizeof(n));
+    }
+  }
+  return h;
+}
+
+// -----------------------------------------------------------------------------
+/// Get file path of cached offset surface without file name extension
+string CacheFileName(const string &dir, uint64_t hash)
+{
+  std::ostringstream os;
+  os << dir;
+  if (!dir.empty() && dir[dir.length()-1] != '/' && dir[dir.length()-1] != '\\') os << '/';
+  os << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return os.str();
+}
+
+// -----------------------------------------------------------------------------
+/// Read cached offset surface, returns nullptr when file is missing or invalid
+vtkSmartPointer<vtkPolyData> ReadCache(const char *name)
+{
+  const string fname = string(name) + ".vtp";
+  if (!std::ifstream(fname.c_str())) return nullptr;
+  const bool exit_on_failure = false;
+  vtkSmartPointer<vtkPointSet> pointset = ReadPointSet(fname.c_str(), exit_on_failure);
+  vtkSmartPointer<vtkPolyData> surface  = vtkPolyData::SafeDownCast(pointset);
+  if (!surface || surface->GetNumberOfPoints() == 0) return nullptr;
+  return surface;
+}
+
+// -----------------------------------------------------------------------------
+/// Write offset surface to cache file
+///
+/// The file is first written to a temporary file which is then renamed, such
+/// that concurrent runs with the same input never read an incomplete file.
+bool WriteCache(const char *name, vtkPolyData *surface)
+{
+  const string fname   = string(name) + ".vtp";
+  const string tmpname = TemporaryFileName(name, ".vtp");
+  if (!WritePolyData(tmpname.c_str(), surface) ||
+      std::rename(tmpname.c_str(), fname.c_str()) != 0) {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+  return true;
+}
+
+
 } // namespace MeshlessVolumeMapperUtils
 using namespace MeshlessVolumeMapperUtils;
 
@@ -149,13 +896,26 @@ void MeshlessVolumeMapper
   _BoundaryPointsRatio         = other._BoundaryPointsRatio;
   _SourcePointsRatio           = other._SourcePointsRatio;
   _MaximumNumberOfSourcePoints = other._MaximumNumberOfSourcePoints;
+  _SourcePartitioning          = other._SourcePartitioning;
   _NumberOfIterations          = other._NumberOfIterations;
   _ImplicitSurfaceSize         = other._ImplicitSurfaceSize;
   _ImplicitSurfaceSpacing      = other._ImplicitSurfaceSpacing;
   _DistanceOffset              = other._DistanceOffset;
+  _OffsetSurfaceCache          = other._OffsetSurfaceCache;
+  _MinimumSourcePointDistance  = other._MinimumSourcePointDistance;
   _MaximumConditionNumber      = other._MaximumConditionNumber;
+  _AdditiveSubsets             = other._AdditiveSubsets;
+  _AdditiveDamping             = other._AdditiveDamping;
+  _CheckpointFile              = other._CheckpointFile;
+  _CheckpointInterval          = other._CheckpointInterval;
+  _Resume                      = other._Resume;
+  _SparsificationTolerance     = other._SparsificationTolerance;
+  _NumberOfSparsificationIterations = other._NumberOfSparsificationIterations;
   _OffsetSurface               = other._OffsetSurface;
   _SourcePartition             = other._SourcePartition;
+  _FactorPartition             = other._FactorPartition;
+  _Factor                      = other._Factor;
+  _FactorRegularization        = other._FactorRegularization;
 }
 
 // -----------------------------------------------------------------------------
@@ -164,11 +924,20 @@ MeshlessVolumeMapper::MeshlessVolumeMapper()
   _BoundaryPointsRatio(.1),
   _SourcePointsRatio(.1),
   _MaximumNumberOfSourcePoints(500),
+  _SourcePartitioning(MeshlessPartition_RoundRobin),
   _NumberOfIterations(10),
   _ImplicitSurfaceSize(0),
   _ImplicitSurfaceSpacing(.0),
   _DistanceOffset(-.1),
-  _MaximumConditionNumber(1.0e6)
+  _MinimumSourcePointDistance(-.25),
+  _MaximumConditionNumber(1.0e6),
+  _AdditiveSubsets(false),
+  _AdditiveDamping(.0),
+  _CheckpointInterval(1),
+  _Resume(false),
+  _SparsificationTolerance(.0),
+  _NumberOfSparsificationIterations(2),
+  _FactorRegularization(.0)
 {
 }
 
@@ -324,11 +1093,9 @@ void MeshlessVolumeMapper::PlaceSourcePoints()
     cout << "Place source points...", cout.flush();
   }
 
-  // Compute input surface bounds
+  // Offset surface distance
   double bounds[6];
   _Boundary->GetBounds(bounds);
-
-  // Offset surface distance
   double offset = _DistanceOffset;
   if (offset < .0) {
     offset *= -sqrt(pow(bounds[1] - bounds[0], 2) +
@@ -336,6 +1103,53 @@ void MeshlessVolumeMapper::PlaceSourcePoints()
                     pow(bounds[5] - bounds[4], 2));
   }
 
+  // Read cached offset surface
+  uint64_t hash = 0;
+  string   cache_name;
+  _OffsetSurface = nullptr;
+  if (!_OffsetSurfaceCache.empty()) {
+    hash       = HashOffsetSurfaceInput(_Boundary, offset, _ImplicitSurfaceSize,
+                                        _ImplicitSurfaceSpacing, _SourcePointsRatio);
+    cache_name = CacheFileName(_OffsetSurfaceCache, hash);
+    _OffsetSurface = ReadCache(cache_name.c_str());
+    if (_OffsetSurface && verbose > 1) {
+      cout << "\n" << this->NameOfType() << "::PlaceSourcePoints: Read offset surface from " << cache_name << endl;
+    }
+  }
+
+  // Compute offset surface and write it to cache
+  if (!_OffsetSurface) {
+    _OffsetSurface = this->ComputeOffsetSurface(offset);
+    if (!cache_name.empty()) {
+      if (WriteCache(cache_name.c_str(), _OffsetSurface)) {
+        if (verbose > 1) {
+          cout << "\n" << this->NameOfType() << "::PlaceSourcePoints: Wrote offset surface to " << cache_name << endl;
+        }
+      } else if (verbose) {
+        cerr << "\n" << this->NameOfType() << "::PlaceSourcePoints: Warning: Failed to cache offset surface in " << cache_name << endl;
+      }
+    }
+  }
+
+  // Initialize offset surface point locator
+  _OffsetPointLocator = vtkSmartPointer<vtkCellLocator>::New();
+  _OffsetPointLocator->SetDataSet(_OffsetSurface);
+  _OffsetPointLocator->BuildLocator();
+
+  if (debug) WritePolyData("offset_surface.vtp", _OffsetSurface);
+
+  if (verbose) {
+    cout << " done: N_s = " << _OffsetSurface->GetNumberOfPoints() << endl;
+  }
+}
+
+// -----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> MeshlessVolumeMapper::ComputeOffsetSurface(double offset)
+{
+  // Compute input surface bounds
+  double bounds[6];
+  _Boundary->GetBounds(bounds);
+
   // Adjust implicit surface model bounds
   const double margin = 1.15 * offset;
   bounds[0] -= margin;
@@ -371,28 +1185,47 @@ void MeshlessVolumeMapper::PlaceSourcePoints()
     if (nz <=  0) nz = int(ceil((bounds[5] - bounds[4]) / dz));
   }
 
-  // Create implicit surface model from input surface
-  vtkSmartPointer<vtkImplicitModeller> model;
-  model = vtkSmartPointer<vtkImplicitModeller>::New();
-  model->SetSampleDimensions(nx, ny, nz);
-  model->SetMaximumDistance(1.1 * offset);
-  model->SetModelBounds(bounds);
-  model->AdjustBoundsOff();
-  model->ScaleToMaximumDistanceOff();
-  model->SetOutputScalarTypeToFloat();
-  model->CappingOn();
-  model->SetCapValue(margin);
-  model->SetProcessModeToPerVoxel();
-  SetVTKInput(model, _Boundary);
+  // Compute unsigned distance field within narrow band around input surface,
+  // with lattice points on the boundary of the lattice set to the cap value
+  // such that the offset surface is closed
+  Array<double> triangles;
+  Array<int>    triangle_bounds;
+  GetTriangles(_Boundary, triangles);
+
+  vtkSmartPointer<vtkFloatArray> values = vtkSmartPointer<vtkFloatArray>::New();
+  values->SetNumberOfComponents(1);
+  values->SetNumberOfTuples(static_cast<vtkIdType>(nx) * static_cast<vtkIdType>(ny) * static_cast<vtkIdType>(nz));
+
+  ComputeDistanceField eval;
+  eval._Size[0] = nx;
+  eval._Size[1] = ny;
+  eval._Size[2] = nz;
+  for (int d = 0; d < 3; ++d) {
+    eval._Origin [d] = bounds[2 * d];
+    eval._Spacing[d] = (bounds[2 * d + 1] - bounds[2 * d]) / max(1, eval._Size[d] - 1);
+  }
+  eval._Band     = 1.1 * offset;
+  eval._CapValue = static_cast<float>(margin);
+  GetTriangleBounds(triangles, eval._Band, eval._Origin, eval._Spacing, eval._Size, triangle_bounds);
+  eval._Triangles      = &triangles;
+  eval._TriangleBounds = &triangle_bounds;
+  eval._Distance       = values->GetPointer(0);
+  parallel_for(blocked_range<int>(0, nz), eval);
+
+  vtkSmartPointer<vtkImageData> distance = vtkSmartPointer<vtkImageData>::New();
+  distance->SetDimensions(nx, ny, nz);
+  distance->SetOrigin(eval._Origin);
+  distance->SetSpacing(eval._Spacing);
+  distance->GetPointData()->SetScalars(values);
 
   // Extract inside/outside offset surfaces
-  // Note: Unfortunately, vtkImplicitModeller creates an unsigned distance field.
+  // Note: The distance field is unsigned.
   vtkSmartPointer<vtkContourFilter> contours;
   contours = vtkSmartPointer<vtkContourFilter>::New();
   contours->UseScalarTreeOn();
   contours->SetNumberOfContours(1);
   contours->SetValue(0, offset);
-  SetVTKConnection(contours,  model);
+  SetVTKInput(contours, distance);
 
   // Only keep offset surface closest to bounding box corner (i.e., outside)
   vtkSmartPointer<vtkPolyDataConnectivityFilter> outside;
@@ -401,14 +1234,8 @@ void MeshlessVolumeMapper::PlaceSourcePoints()
   outside->SetExtractionModeToClosestPointRegion();
   SetVTKConnection(outside, contours);
 
-  // Subdivide offset surface to generate dense surface mesh
-  vtkSmartPointer<vtkLinearSubdivisionFilter> subdiv;
-  subdiv = vtkSmartPointer<vtkLinearSubdivisionFilter>::New();
-  subdiv->SetNumberOfSubdivisions(1);
-  SetVTKConnection(subdiv, outside);
-
-  // Execute dense offset surface mesh generation
-  subdiv->Update();
+  // Execute offset surface mesh generation
+  outside->Update();
 
   // Smooth offset surface to reduce sampling artifacts
   MeshSmoothing smoother;
@@ -432,18 +1259,7 @@ void MeshlessVolumeMapper::PlaceSourcePoints()
   SetVTKInput(decimate, smoother.Output());
 
   decimate->Update();
-  _OffsetSurface = decimate->GetOutput();
-
-  // Initialize offset surface point locator
-  _OffsetPointLocator = vtkSmartPointer<vtkCellLocator>::New();
-  _OffsetPointLocator->SetDataSet(_OffsetSurface);
-  _OffsetPointLocator->BuildLocator();
-
-  if (debug) WritePolyData("offset_surface.vtp", _OffsetSurface);
-
-  if (verbose) {
-    cout << " done: N_s = " << _OffsetSurface->GetNumberOfPoints() << endl;
-  }
+  return decimate->GetOutput();
 }
 
 // -----------------------------------------------------------------------------
@@ -453,6 +1269,66 @@ bool MeshlessVolumeMapper::AddSourcePoint(double q[3])
   return map->AddSourcePoint(q, 1e-9);
 }
 
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::AddSourcePoints(const PointSet &points)
+{
+  MeshlessMap *map = dynamic_cast<MeshlessMap *>(_Output.get());
+  map->AddSourcePoints(points);
+}
+
+// -----------------------------------------------------------------------------
+int MeshlessVolumeMapper::InsertSourcePoints(double threshold)
+{
+  MeshlessMap *map = dynamic_cast<MeshlessMap *>(_Output.get());
+
+  // Select boundary points with high residual error
+  SelectBoundaryPoints select;
+  select._ResidualMap = _ResidualMap;
+  select._Threshold   = threshold;
+  parallel_reduce(blocked_range<vtkIdType>(0, _Boundary->GetNumberOfPoints()), select);
+  Array<vtkIdType> &ptIds = select._PointIds;
+  if (ptIds.empty()) return 0;
+  sort(ptIds.begin(), ptIds.end());
+
+  // Project selected boundary points onto offset surface
+  TriangleGrid offset_surface;
+  offset_surface.Initialize(_OffsetSurface);
+
+  const int     npoints = static_cast<int>(ptIds.size());
+  Array<double> points(3 * npoints);
+  ProjectOntoOffsetSurface project;
+  project._Boundary      = _Boundary->GetPoints();
+  project._PointIds      = ptIds.data();
+  project._OffsetSurface = &offset_surface;
+  project._Points        = points.data();
+  parallel_for(blocked_range<int>(0, npoints), project);
+
+  // Discard projected points close to other source points
+  double tol = _MinimumSourcePointDistance;
+  if (tol < .0) tol *= -offset_surface.MeanEdgeLength();
+  tol = max(tol, 1e-9);
+
+  PointHash hash(tol);
+  const PointSet &sources = map->SourcePoints();
+  for (int i = 0; i < sources.Size(); ++i) {
+    const Point &q = sources(i);
+    const double p[3] = { q._x, q._y, q._z };
+    hash.Add(p);
+  }
+  PointSet new_points;
+  new_points.Reserve(npoints);
+  for (int i = 0; i < npoints; ++i) {
+    const double *p = points.data() + 3 * i;
+    if (hash.Add(p)) new_points.Add(Point(p));
+  }
+
+  // Add new source points at once
+  if (new_points.Size() > 0) {
+    this->AddSourcePoints(new_points);
+  }
+  return new_points.Size();
+}
+
 // -----------------------------------------------------------------------------
 void MeshlessVolumeMapper::PartitionSourcePoints()
 {
@@ -460,6 +1336,10 @@ void MeshlessVolumeMapper::PartitionSourcePoints()
   if (_MaximumNumberOfSourcePoints > 0) {
     nsubsets = int(ceil(double(NumberOfSourcePoints()) / _MaximumNumberOfSourcePoints));
   }
+  if (nsubsets > 1 && _SourcePartitioning != MeshlessPartition_RoundRobin) {
+    this->PartitionSourcePointsSpatially(nsubsets);
+    return;
+  }
   _SourcePartition.resize(nsubsets);
   if (nsubsets > 0) {
     int npoints = NumberOfSourcePoints() / nsubsets;
@@ -476,6 +1356,95 @@ void MeshlessVolumeMapper::PartitionSourcePoints()
   }
 }
 
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::PartitionSourcePointsSpatially(int nsubsets)
+{
+  const MeshlessMap *map    = dynamic_cast<const MeshlessMap *>(_Output.get());
+  const PointSet    &points = map->SourcePoints();
+  const int          n      = points.Size();
+
+  // Split source points sorted along Morton curve into contiguous segments
+  Array<int> order;
+  SortByMortonCode(points, order);
+  Array<int> labels(n);
+  for (int i = 0; i < n; ++i) {
+    labels[order[i]] = static_cast<int>((static_cast<int64_t>(i) * nsubsets) / n);
+  }
+
+  // Refine Morton segments using Lloyd's k-means iterations
+  if (_SourcePartitioning == MeshlessPartition_KMeans) {
+    Array<double> centers(3 * nsubsets, .0);
+    Array<int>    count(nsubsets, 0);
+    for (int i = 0; i < n; ++i) {
+      const Point &p = points(i);
+      centers[3 * labels[i]    ] += p._x;
+      centers[3 * labels[i] + 1] += p._y;
+      centers[3 * labels[i] + 2] += p._z;
+      count[labels[i]] += 1;
+    }
+    for (int iter = 0; iter < 20; ++iter) {
+      for (int k = 0; k < nsubsets; ++k) {
+        if (count[k] > 0) {
+          for (int d = 0; d < 3; ++d) centers[3 * k + d] /= count[k];
+        }
+      }
+      AssignToClusters assign;
+      assign._Points           = &points;
+      assign._Centers          = centers.data();
+      assign._NumberOfClusters = nsubsets;
+      assign._Labels           = labels.data();
+      assign._Sum  .resize(3 * nsubsets, .0);
+      assign._Count.resize(nsubsets, 0);
+      parallel_reduce(blocked_range<int>(0, n), assign);
+      // Keep previous center of empty cluster
+      for (int k = 0; k < nsubsets; ++k) {
+        if (assign._Count[k] == 0) {
+          for (int d = 0; d < 3; ++d) assign._Sum[3 * k + d] = centers[3 * k + d];
+          assign._Count[k] = 1;
+        }
+      }
+      centers.swap(assign._Sum);
+      count  .swap(assign._Count);
+      if (assign._NumberOfChanges == 0) break;
+    }
+  }
+
+  // Collect sorted indices of source points of each subset
+  Array<Array<int> > subsets(nsubsets);
+  for (int i = 0; i < n; ++i) {
+    subsets[labels[i]].push_back(i);
+  }
+
+  // Split clusters exceeding the maximum subset size along the Morton curve
+  _SourcePartition.clear();
+  _SourcePartition.reserve(nsubsets);
+  Array<int> rank(n);
+  for (int i = 0; i < n; ++i) rank[order[i]] = i;
+  for (int k = 0; k < nsubsets; ++k) {
+    Array<int> &subset = subsets[k];
+    if (subset.empty()) continue;
+    const int size = static_cast<int>(subset.size());
+    const int nparts = int(ceil(double(size) / _MaximumNumberOfSourcePoints));
+    if (nparts <= 1) {
+      _SourcePartition.push_back(subset);
+      continue;
+    }
+    Array<Pair<int, int> > sorted(size);
+    for (int i = 0; i < size; ++i) {
+      sorted[i] = MakePair(rank[subset[i]], subset[i]);
+    }
+    sort(sorted.begin(), sorted.end());
+    for (int l = 0; l < nparts; ++l) {
+      Array<int> part;
+      for (int i = (l * size) / nparts; i < ((l + 1) * size) / nparts; ++i) {
+        part.push_back(sorted[i].second);
+      }
+      sort(part.begin(), part.end());
+      _SourcePartition.push_back(part);
+    }
+  }
+}
+
 // -----------------------------------------------------------------------------
 void MeshlessVolumeMapper::InitializeResidualMap()
 {
@@ -502,6 +1471,27 @@ double MeshlessVolumeMapper::UpdateResidualMap(double *min, double *max, double
   return avg;
 }
 
+// -----------------------------------------------------------------------------
+double MeshlessVolumeMapper
+::UpdateResidualMap(int k, const Matrix &w, double *min, double *max, double *std)
+{
+  Matrix f;
+  if (!this->GetBoundaryMap(k, w, f)) {
+    return this->UpdateResidualMap(min, max, std);
+  }
+  mirtkAssert(f.Rows() == NumberOfBoundaryPoints(), "boundary map has one row per boundary point");
+  SubtractFromResidualMap eval;
+  eval._BoundaryMap     = &f;
+  eval._ResidualMap     = _ResidualMap;
+  eval._OutputDimension = _Output->NumberOfComponents();
+  parallel_reduce(blocked_range<vtkIdType>(0, _Boundary->GetNumberOfPoints()), eval);
+  double avg = eval._SquaredError / NumberOfBoundaryPoints();
+  if (min) *min = eval._MinSquaredError;
+  if (max) *max = eval._MaxSquaredError;
+  if (std) *std = sqrt(eval._SquaredError2 / NumberOfBoundaryPoints() - avg * avg);
+  return avg;
+}
+
 // -----------------------------------------------------------------------------
 void MeshlessVolumeMapper::Initialize()
 {
@@ -522,6 +1512,11 @@ void MeshlessVolumeMapper::Initialize()
   // Initialize residual boundary map
   this->InitializeResidualMap();
 
+  // Discard cached factors of previous boundary points
+  _FactorPartition.clear();
+  _Factor.clear();
+  _FactorRegularization = .0;
+
   if (_MaximumNumberOfSourcePoints <= 0) {
     _MaximumNumberOfSourcePoints = NumberOfBoundaryPoints() + 1;
   }
@@ -530,21 +1525,15 @@ void MeshlessVolumeMapper::Initialize()
 // -----------------------------------------------------------------------------
 void MeshlessVolumeMapper::Solve()
 {
-  typedef Eigen::JacobiSVD<Eigen::MatrixXd> SVD;
-  typedef SVD::SingularValuesType           SingularValues;
-
-  Matrix         A, b, x; // coefficients matrix, right-hand side, solution of Ax = b
-  SingularValues sigma;   // singular values
   double         alpha;   // weight of regularization term
   double         error;   // error of boundary map approximation
   double         min_error, max_error, std_error;
-  double         p[3], q[3], *df;
-
-  const int d = NumberOfComponents();
 
-  df    = new double[d];
   alpha = .015;
 
+  // Restore map from previous run
+  const int iter0 = this->RestoreCheckpoint();
+
   // Compute initial error
   if (verbose) {
     cout << "Initialize residual boundary map...";
@@ -558,13 +1547,68 @@ void MeshlessVolumeMapper::Solve()
   }
 
   // Iteratively approximate volumetric map
-  for (int iter = 0; iter < _NumberOfIterations; ++iter) {
+  int nfit = 0;
+  for (int iter = iter0; iter < _NumberOfIterations; ++iter) {
 
     if (verbose) cout << "\nIteration " << (iter+1) << endl;
 
     // Evenly partition set of source points
     this->PartitionSourcePoints();
 
+    // Perform boundary fitting for all subsets
+    error = this->FitSourcePointSets(alpha, &min_error, &max_error, &std_error);
+    ++nfit;
+
+    // Notify observer, which may stop the iteration with the current map
+    if (!this->NotifyFittingError(iter + 1, error, min_error, max_error, std_error)) break;
+
+    // Insert new source points by projecting boundary points with
+    // high residual error onto the offset surface (cf. Xu et al., 2013)
+    if (verbose) cout << "Insert new source points...", cout.flush();
+    const int n = NumberOfSourcePoints();
+    this->InsertSourcePoints(error + 1.5 * std_error);
+    if (verbose) {
+      cout << " done: #points = " << NumberOfSourcePoints()
+           << " (+" << (NumberOfSourcePoints() - n) << ")" << endl;
+    }
+
+    // Save intermediate result
+    this->WriteCheckpointIfDue(iter + 1);
+  }
+
+  // Remove source points with insignificant contribution (cf. Li et al., 2010)
+  if (_SparsificationTolerance > .0) {
+    if (verbose) cout << "\nSparsify source points" << endl;
+    this->SparsifySourcePoints(alpha);
+    error = this->UpdateResidualMap(&min_error, &max_error, &std_error);
+  }
+
+  // Record number of source points, fitting iterations, and final fitting error
+  _Statistics.NumberOfUnknowns(NumberOfSourcePoints());
+  _Statistics.NumberOfIterations(nfit);
+  _Statistics.Residual(error);
+
+  if (debug) WritePolyData("boundary_surface.vtp", _Boundary);
+}
+
+// -----------------------------------------------------------------------------
+double MeshlessVolumeMapper::FitSourcePointSets(double &alpha, double *min, double *max, double *std)
+{
+  Matrix b, x;       // right-hand side and solution of Ax = b
+  double error = .0; // error of boundary map approximation
+  double min_error = .0, max_error = .0, std_error = .0;
+
+  // Perform boundary fitting for all subsets concurrently
+  if (_AdditiveSubsets && NumberOfSourcePointSets() > 1) {
+    error = this->SolveAdditive(alpha, &min_error, &max_error, &std_error);
+    if (verbose) {
+      cout << "Boundary fitting error (MSE) = " << error
+           << " (+/-" << std_error << "), range = ["
+           << min_error << ", " << max_error << "]" << endl;
+    }
+
+  } else {
+
     // Perform boundary fitting for each subset
     for (int k = 0; k < NumberOfSourcePointSets(); ++k) {
 
@@ -572,10 +1616,6 @@ void MeshlessVolumeMapper::Solve()
         cout << "Source points subset " << (k+1) << " out of " << NumberOfSourcePointSets() << endl;
       }
 
-      // Get linear system of unregularized boundary fitting problem
-      this->GetCoefficients(k, A);
-      this->GetConstraints (k, b);
-
       // This generic implementation minimizes an energy function
       //
       //   E = w^T A w - b^T w + c
@@ -593,30 +1633,20 @@ void MeshlessVolumeMapper::Solve()
       // can be solved instead, using the (truncated or randomized) SVD as in
       // (Li et al., 2010). This alternative (slower!) method is implemented by
       // MeshlessHarmonicVolumeMapper::Parameterize for comparison.
-      mirtkAssert(A.Rows() == A.Cols(), "coefficients matrix is square");
-      mirtkAssert(b.Rows() == A.Rows(), "right-hand side has required number of rows");
-
-      // Compute singular values of coefficients matrix
-      if (alpha == .0) {
-        if (verbose) cout << "Compute singular values...", cout.flush();
-        SVD svd(MatrixToEigen(A));
-        sigma = svd.singularValues();
-        alpha = sigma(0) / (_MaximumConditionNumber - 1.0);
-        if (verbose) {
-          cout << " done\nmax(sigma) = " << sigma(0)
-               << ", alpha = " << alpha
-               << ", cond(A) = " << ((alpha + sigma(0)) / alpha) << endl;
-        }
-      }
-
-      // Add regularization weight to diagonal matrix elements
-      for (int i = 0; i < A.Rows(); ++i) {
-        A(i, i) += alpha;
+      //
+      // The regularized matrix A + alpha I is symmetric positive definite and
+      // only depends on the boundary points and the source points subset,
+      // whereas the right-hand side depends on the residual boundary map.
+      // Its Cholesky factor is thus computed only when the subset changed.
+      if (this->Factorize(k, alpha)) {
+        if (verbose) cout << "Reuse or update Cholesky factorization of coefficients matrix" << endl;
       }
 
-      // Solve linear system using LU decomposition
-      if (verbose) cout << "Solve linear system using LU decomposition...", cout.flush();
-      x = EigenToMatrix(MatrixToEigen(A).partialPivLu().solve(MatrixToEigen(b)));
+      // Solve linear system using Cholesky factorization
+      if (verbose) cout << "Solve linear system using Cholesky factorization...", cout.flush();
+      this->GetConstraints(k, b);
+      mirtkAssert(b.Rows() == _Factor[k].Rows(), "right-hand side has required number of rows");
+      this->SolveFactorized(k, b, x);
       if (verbose) cout << " done" << endl;
 
       // Add solution to volumetric map
@@ -626,42 +1656,454 @@ void MeshlessVolumeMapper::Solve()
 
       // Update residual boundary map
       if (verbose) cout << "Update residual boundary map...", cout.flush();
-      error = this->UpdateResidualMap(&min_error, &max_error, &std_error);
+      error = this->UpdateResidualMap(k, x, &min_error, &max_error, &std_error);
       if (verbose) {
         cout << " done" << endl;
         cout << "Boundary fitting error (MSE) = " << error
              << " (+/-" << std_error << "), range = ["
              << min_error << ", " << max_error << "]" << endl;
       }
+    }
+  }
+
+
+  if (min) *min = min_error;
+  if (max) *max = max_error;
+  if (std) *std = std_error;
+  return error;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::GetSourcePointContributions(Array<double> &contrib) const
+{
+  const MeshlessMap *map = dynamic_cast<const MeshlessMap *>(_Output.get());
+  contrib.resize(NumberOfSourcePoints());
+  for (int i = 0; i < NumberOfSourcePoints(); ++i) {
+    contrib[i] = map->CoefficientsNorm(i);
+  }
+}
 
-      // TODO: Remove source points with insignificant contribution
-      //       if possible as done in (Li et al., 2010) and also mentioned
-      //       in (Xu et al., 2013). This, however, is based on the singular
-      //       values associated with each source point and thus requires
-      //       an expensive SVD computation.
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::RemoveSourcePoints(const Array<bool> &remove)
+{
+  MeshlessMap *map = dynamic_cast<MeshlessMap *>(_Output.get());
+  map->RemoveSourcePoints(remove);
+  _SourcePartition.clear();
+  _FactorPartition.clear();
+  _Factor.clear();
+}
+
+// -----------------------------------------------------------------------------
+double MeshlessVolumeMapper::RefitSourcePoints(double &alpha, const Array<bool> &removed,
+                                               double *min, double *max, double *std)
+{
+  double error = this->UpdateResidualMap(min, max, std);
+  for (int iter = 0; iter < _NumberOfSparsificationIterations; ++iter) {
+    this->PartitionSourcePoints();
+    Array<Array<int> > subsets;
+    subsets.reserve(_SourcePartition.size());
+    for (size_t k = 0; k < _SourcePartition.size(); ++k) {
+      Array<int> subset;
+      subset.reserve(_SourcePartition[k].size());
+      for (size_t i = 0; i < _SourcePartition[k].size(); ++i) {
+        const int j = _SourcePartition[k][i];
+        if (!removed[j]) subset.push_back(j);
+      }
+      if (!subset.empty()) subsets.push_back(subset);
     }
+    _SourcePartition = subsets;
+    if (_SourcePartition.empty()) break;
+    error = this->FitSourcePointSets(alpha, min, max, std);
+  }
+  return error;
+}
 
-    // Insert new source points by projecting boundary points with
-    // high residual error onto the offset surface (cf. Xu et al., 2013)
-    if (verbose) cout << "Insert new source points...", cout.flush();
-    const int n = NumberOfSourcePoints();
-    for (vtkIdType ptId = 0; ptId < _Boundary->GetNumberOfPoints(); ++ptId) {
-      _ResidualMap->GetTuple(ptId, df);
-      if ((df[0]*df[0] + df[1]*df[1] + df[2]*df[2]) > (error + 1.5 * std_error)) {
-        _Boundary->GetPoint(ptId, p);
-        GetClosestPointOnOffsetSurface(p, q);
-        this->AddSourcePoint(q);
+// -----------------------------------------------------------------------------
+int MeshlessVolumeMapper::SparsifySourcePoints(double &alpha)
+{
+  MeshlessMap *map = dynamic_cast<MeshlessMap *>(_Output.get());
+  const int    n   = NumberOfSourcePoints();
+  if (_SparsificationTolerance <= .0 || n < 2) return 0;
+
+  MIRTK_START_TIMING();
+
+  // Maximum admissible boundary fitting error
+  const double error0    = this->UpdateResidualMap();
+  const double max_error = (1.0 + _SparsificationTolerance) * error0;
+
+  // Candidates for removal in order of increasing contribution
+  Array<double> contrib;
+  this->GetSourcePointContributions(contrib);
+  const Array<int> order = IncreasingOrder(contrib);
+
+  // Greedy backward elimination of batches of source points, where the batch
+  // size is halved whenever the refitted map exceeds the admissible error
+  Array<bool> removed(n, false);
+  Matrix      coeffs;
+  double      error = error0;
+  int         nremoved = 0;
+  int         next     = 0;
+  int         batch    = n / 2;
+  while (batch > 0 && next < n && n - nremoved > 1) {
+    const int nbatch = min(min(batch, n - next), n - nremoved - 1);
+    coeffs = map->Coefficients();
+    for (int i = next; i < next + nbatch; ++i) {
+      removed[order[i]] = true;
+      map->ClearCoefficients(order[i]);
+    }
+    const double e = this->RefitSourcePoints(alpha, removed);
+    if (e <= max_error) {
+      error     = e;
+      next     += nbatch;
+      nremoved += nbatch;
+    } else {
+      for (int i = next; i < next + nbatch; ++i) {
+        removed[order[i]] = false;
       }
+      map->Coefficients(coeffs);
+      batch = nbatch / 2;
     }
+  }
+
+  // Remove eliminated source points and recompute residual boundary map
+  if (nremoved > 0) {
+    this->RemoveSourcePoints(removed);
+    this->PartitionSourcePoints();
+  }
+  error = this->UpdateResidualMap();
+
+  if (verbose) {
+    cout << "Removed " << nremoved << " out of " << n << " source points:"
+         << " #points = " << NumberOfSourcePoints()
+         << ", boundary fitting error (MSE) = " << error
+         << " (initial = " << error0 << ")" << endl;
+  }
+
+  MIRTK_DEBUG_TIMING(2, "sparsification of source points");
+  return nremoved;
+}
+
+// -----------------------------------------------------------------------------
+int MeshlessVolumeMapper::RestoreCheckpoint()
+{
+  if (!_Resume || _CheckpointFile.empty()) return 0;
+
+  const string state_name = _CheckpointFile + ".state";
+  if (!std::ifstream(_CheckpointFile.c_str()) || !std::ifstream(state_name.c_str())) {
+    if (verbose) cout << "No checkpoint found, start from first iteration" << endl;
+    return 0;
+  }
+  if (verbose) cout << "Restore map from checkpoint " << _CheckpointFile << "...", cout.flush();
+
+  // Read number of completed iterations and size of checkpointed map
+  int state[3];
+  Cifstream is(state_name.c_str());
+  is.ReadAsInt(state, 3);
+  is.Close();
+  const int niter = state[0];
+  const int npoints = state[1];
+  const int ncomps  = state[2];
+
+  // Read checkpointed map into a copy of the initial map
+  MeshlessMap *map = dynamic_cast<MeshlessMap *>(_Output.get());
+  UniquePtr<MeshlessMap> saved(dynamic_cast<MeshlessMap *>(map->NewCopy()));
+  if (!saved->Read(_CheckpointFile.c_str())) {
+    cerr << this->NameOfType() << "::RestoreCheckpoint: Checkpoint file "
+         << _CheckpointFile << " does not contain a " << map->NameOfClass() << endl;
+    exit(1);
+  }
+  if (saved->NumberOfSourcePoints() != npoints || saved->NumberOfComponents() != ncomps) {
+    cerr << this->NameOfType() << "::RestoreCheckpoint: Checkpoint file "
+         << _CheckpointFile << " was modified after " << state_name << " was written" << endl;
+    exit(1);
+  }
+
+  // Source points of checkpointed map start with the initial source points,
+  // up to the precision of the offset surface, which may have been cached
+  const int n0 = map->NumberOfSourcePoints();
+  bool match = (n0 <= npoints && map->NumberOfComponents() == ncomps);
+  for (int i = 0; match && i < n0; ++i) {
+    match = (map->SourcePoints()(i).Distance(saved->SourcePoints()(i)) < 1e-6);
+  }
+  if (!match) {
+    cerr << this->NameOfType() << "::RestoreCheckpoint: Checkpoint " << _CheckpointFile
+         << " was computed for a different input or with different parameters" << endl;
+    exit(1);
+  }
+
+  // Add inserted source points and restore map coefficients
+  PointSet points;
+  for (int i = n0; i < npoints; ++i) {
+    points.Add(saved->SourcePoints()(i));
+  }
+  if (points.Size() > 0) this->AddSourcePoints(points);
+  map->Read(_CheckpointFile.c_str());
+
+  if (verbose) {
+    cout << " done: #iterations = " << niter << ", #points = " << npoints << endl;
+  }
+  return niter;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::WriteCheckpoint(int iter) const
+{
+  if (_CheckpointFile.empty()) return;
+
+  // Write to temporary files first which are then renamed, such that an
+  // interrupted run never leaves an incomplete checkpoint behind
+  const string state_name = _CheckpointFile + ".state";
+  const string tmp_map    = TemporaryFileName(_CheckpointFile);
+  const string tmp_state  = TemporaryFileName(state_name);
+
+  const MeshlessMap *map = dynamic_cast<const MeshlessMap *>(_Output.get());
+  const int state[3] = { iter, map->NumberOfSourcePoints(), map->NumberOfComponents() };
+
+  bool ok = map->Write(tmp_map.c_str());
+  if (ok) {
+    Cofstream os(tmp_state.c_str());
+    os.WriteAsInt(state, 3);
+    os.Close();
+    ok = (std::rename(tmp_map  .c_str(), _CheckpointFile.c_str()) == 0 &&
+          std::rename(tmp_state.c_str(), state_name     .c_str()) == 0);
+  }
+  if (!ok) {
+    std::remove(tmp_map  .c_str());
+    std::remove(tmp_state.c_str());
+    cerr << this->NameOfType() << "::WriteCheckpoint: Failed to write checkpoint " << _CheckpointFile << endl;
+    return;
+  }
+  if (verbose) cout << "Wrote checkpoint after iteration " << iter << " to " << _CheckpointFile << endl;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::WriteCheckpointIfDue(int iter) const
+{
+  if (_CheckpointInterval > 0 && iter < _NumberOfIterations && iter % _CheckpointInterval == 0) {
+    this->WriteCheckpoint(iter);
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessVolumeMapper::NotifyFittingError(int iter, double error, double min_error,
+                                              double max_error, double std_error) const
+{
+  if (!_Observer) return true;
+  MapperProgress progress("fit", iter, error);
+  progress._MinError = min_error;
+  progress._MaxError = max_error;
+  progress._StdError = std_error;
+  return _Observer->Notify(progress);
+}
+
+// -----------------------------------------------------------------------------
+double MeshlessVolumeMapper::SolveAdditive(double &alpha, double *min, double *max, double *std)
+{
+  const int nsets = NumberOfSourcePointSets();
+
+  // Factorize coefficients matrices of changed subsets
+  if (verbose) cout << "Factorize coefficients matrices of " << nsets << " subsets...", cout.flush();
+  for (int k = 0; k < nsets; ++k) {
+    this->Factorize(k, alpha);
+  }
+  if (verbose) cout << " done" << endl;
+
+  // Solve linear systems of all subsets for the same residual boundary map
+  if (verbose) cout << "Solve linear systems of all subsets...", cout.flush();
+  Array<Matrix> x(nsets);
+  for (int k = 0; k < nsets; ++k) {
+    this->GetConstraints(k, x[k]);
+    mirtkAssert(x[k].Rows() == _Factor[k].Rows(), "right-hand side has required number of rows");
+  }
+  SolveCholesky solve;
+  solve._Factor   = _Factor.data();
+  solve._Solution = x.data();
+  parallel_for(blocked_range<int>(0, nsets), solve);
+  if (verbose) cout << " done" << endl;
+
+  // Add damped solutions to volumetric map
+  double omega = _AdditiveDamping;
+  vtkSmartPointer<vtkDataArray> residual;
+  if (omega <= .0) {
+    residual.TakeReference(_ResidualMap->NewInstance());
+    residual->DeepCopy(_ResidualMap);
+    omega = 1.0;
+  }
+  for (int k = 0; k < nsets; ++k) {
+    Matrix &w = x[k];
+    for (int j = 0; j < w.Cols(); ++j)
+    for (int i = 0; i < w.Rows(); ++i) {
+      w(i, j) *= omega;
+    }
+    this->AddWeights(k, w);
+  }
+  double error = .0;
+  for (int k = 0; k < nsets; ++k) {
+    error = this->UpdateResidualMap(k, x[k], min, max, std);
+  }
+
+  // Rescale combined solution such that boundary fitting error is minimized,
+  // i.e., minimize |r0 - omega (r0 - r1)|^2, where r0 is the previous residual
+  // and r1 the residual after adding the undamped solutions
+  if (residual) {
+    ComputeResidualChange change;
+    change._Residual0 = residual;
+    change._Residual1 = _ResidualMap;
+    parallel_reduce(blocked_range<vtkIdType>(0, _ResidualMap->GetNumberOfTuples()), change);
+    if (change._Norm2 > .0) {
+      omega = change._Dot / change._Norm2;
+      if (verbose) cout << "Additive damping factor = " << omega << endl;
+      if (omega != 1.0) {
+        for (int k = 0; k < nsets; ++k) {
+          Matrix &w = x[k];
+          for (int j = 0; j < w.Cols(); ++j)
+          for (int i = 0; i < w.Rows(); ++i) {
+            w(i, j) *= omega - 1.0;
+          }
+          this->AddWeights(k, w);
+        }
+        for (int k = 0; k < nsets; ++k) {
+          error = this->UpdateResidualMap(k, x[k], min, max, std);
+        }
+      }
+    }
+  }
+
+  return error;
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessVolumeMapper::GetAppendedCoefficients(int, int, Matrix &) const
+{
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessVolumeMapper::GetBoundaryMap(int, const Matrix &, Matrix &) const
+{
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+bool MeshlessVolumeMapper::Factorize(int k, double &alpha)
+{
+  // Discard cached factors when regularization or partition changed
+  if (alpha != _FactorRegularization) {
+    _FactorPartition.clear();
+    _Factor.clear();
+  }
+  _FactorPartition.resize(_SourcePartition.size());
+  _Factor         .resize(_SourcePartition.size());
+  if (alpha != .0 && alpha == _FactorRegularization) {
+    if (_FactorPartition[k] == _SourcePartition[k]) return true;
+    if (this->UpdateFactor(k)) return true;
+  }
+
+  // Get coefficients matrix of unregularized boundary fitting problem
+  Matrix &A = _Factor[k];
+  this->GetCoefficients(k, A);
+  mirtkAssert(A.Rows() == A.Cols(), "coefficients matrix is square");
+  const int n = A.Rows();
+
+  // Choose regularization weight given upper bound of condition number,
+  // using Lanczos iterations instead of a (much) more expensive SVD, i.e.,
+  // the smallest alpha such that (lmax + alpha) / (lmin + alpha) <= cond_max
+  if (alpha == .0) {
+    if (verbose) cout << "Estimate extreme eigenvalues...", cout.flush();
+    double lmin, lmax;
+    ExtremeEigenvalues(Eigen::Map<const Eigen::MatrixXd>(A.RawPointer(), n, n), lmin, lmax);
+    alpha = (lmax - _MaximumConditionNumber * lmin) / (_MaximumConditionNumber - 1.0);
+    alpha = max(alpha, 1e-12 * lmax);
     if (verbose) {
-      cout << " done: #points = " << NumberOfSourcePoints()
-           << " (+" << (NumberOfSourcePoints() - n) << ")" << endl;
+      cout << " done\nmin(lambda) = " << lmin << ", max(lambda) = " << lmax
+           << ", cond(A) = " << (lmin > .0 ? lmax / lmin : inf) << ", alpha = " << alpha
+           << ", cond(A + alpha I) = " << ((lmax + alpha) / (lmin + alpha)) << endl;
     }
   }
+  _FactorRegularization = alpha;
+
+  // Compute Cholesky factor in place, adding more regularization to the
+  // diagonal when the matrix is numerically not positive definite
+  double shift = alpha;
+  for (int attempt = 0; true; ++attempt) {
+    for (int i = 0; i < n; ++i) {
+      A(i, i) += shift;
+    }
+    Eigen::Map<Eigen::MatrixXd> L(A.RawPointer(), n, n);
+    Eigen::LLT<Eigen::Ref<Eigen::MatrixXd> > llt(L);
+    if (llt.info() == Eigen::Success) {
+      if (verbose > 1) {
+        cout << "Estimated cond(A + alpha I) = " << (1.0 / llt.rcond()) << endl;
+      }
+      break;
+    }
+    if (attempt == 10) {
+      cerr << this->NameOfType() << "::Factorize: Coefficients matrix is not positive definite" << endl;
+      exit(1);
+    }
+    this->GetCoefficients(k, A);
+    if (shift == .0) {
+      shift = numeric_limits<double>::epsilon();
+      for (int i = 0; i < n; ++i) shift += abs(A(i, i));
+    } else {
+      shift *= 10.0;
+    }
+  }
+  _FactorPartition[k] = _SourcePartition[k];
+  return false;
+}
 
-  delete[] df;
+// -----------------------------------------------------------------------------
+bool MeshlessVolumeMapper::UpdateFactor(int k)
+{
+  const Array<int> &subset = _SourcePartition[k];
+  const Array<int> &cached = _FactorPartition[k];
+  const int         n0     = static_cast<int>(cached.size());
+  if (n0 == 0 || n0 >= static_cast<int>(subset.size()) ||
+      !equal(cached.begin(), cached.end(), subset.begin())) {
+    return false;
+  }
 
-  if (debug) WritePolyData("boundary_surface.vtp", _Boundary);
+  // Get trailing columns of coefficients matrix
+  Matrix c;
+  if (!this->GetAppendedCoefficients(k, n0, c)) return false;
+  const Matrix &F  = _Factor[k];
+  const int     r0 = F.Rows();
+  const int     n  = c.Rows();
+  const int     p  = n - r0;
+  if (p <= 0 || c.Cols() != p) return false;
+
+  // Solve L11 L21^T = A12 and factorize A22 + alpha I - L21 L21^T = L22 L22^T
+  Eigen::Map<const Eigen::MatrixXd> L11(F.RawPointer(), r0, r0);
+  Eigen::Map<const Eigen::MatrixXd> C  (c.RawPointer(), n,  p);
+  Eigen::MatrixXd L21t = C.topRows(r0);
+  L11.triangularView<Eigen::Lower>().solveInPlace(L21t);
+  Eigen::MatrixXd S = C.bottomRows(p);
+  S.diagonal().array() += _FactorRegularization;
+  S.selfadjointView<Eigen::Lower>().rankUpdate(L21t.transpose(), -1.0);
+  Eigen::LLT<Eigen::Ref<Eigen::MatrixXd> > llt(S);
+  if (llt.info() != Eigen::Success) return false;
+
+  // Assemble extended factor
+  Matrix factor(n, n);
+  Eigen::Map<Eigen::MatrixXd> L(factor.RawPointer(), n, n);
+  L.topLeftCorner    (r0, r0) = L11;
+  L.topRightCorner   (r0, p ).setZero();
+  L.bottomLeftCorner (p,  r0) = L21t.transpose();
+  L.bottomRightCorner(p,  p ) = S;
+  _Factor[k]          = factor;
+  _FactorPartition[k] = subset;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void MeshlessVolumeMapper::SolveFactorized(int k, const Matrix &b, Matrix &x) const
+{
+  x = b;
+  SolveCholesky solve;
+  solve._Factor   = &_Factor[k];
+  solve._Solution = &x;
+  solve(blocked_range<int>(0, 1));
 }
 
 
@@ -0,0 +1,604 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/MultiResolutionMap.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Vtk.h"
+#include "mirtk/PointSetUtils.h"
+#include "mirtk/DataArrayView.h"
+
+#include "vtkNew.h"
+#include "vtkSmartPointer.h"
+#include "vtkPoints.h"
+#include "vtkPointData.h"
+#include "vtkCellData.h"
+#include "vtkPolyData.h"
+#include "vtkUnstructuredGrid.h"
+#include "vtkDoubleArray.h"
+#include "vtkIdList.h"
+#include "vtkCellLocator.h"
+#include "vtkGenericCell.h"
+#include "vtkDecimatePro.h"
+#include "vtkUnstructuredGridQuadricDecimation.h"
+
+#include <limits>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace MultiResolutionMapUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Decimate triangulated surface mesh or tetrahedral mesh
+///
+/// \returns Decimated mesh without point and cell data or nullptr when the
+///          type of the mesh is not supported.
+vtkSmartPointer<vtkPointSet> Decimate(vtkDataSet *domain, double reduction)
+{
+  const double target = max(.0, min(reduction, .99));
+  vtkSmartPointer<vtkPointSet> coarse;
+  if (vtkPolyData::SafeDownCast(domain) && IsTriangularMesh(domain)) {
+    vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+    surface->ShallowCopy(domain);
+    surface->GetPointData()->Initialize();
+    surface->GetCellData ()->Initialize();
+    vtkNew<vtkDecimatePro> decimator;
+    SetVTKInput(decimator, surface);
+    decimator->SetTargetReduction(target);
+    decimator->PreserveTopologyOn();
+    decimator->SplittingOff();
+    decimator->BoundaryVertexDeletionOff();
+    decimator->Update();
+    coarse = decimator->GetOutput();
+  } else if (vtkUnstructuredGrid::SafeDownCast(domain) && IsTetrahedralMesh(domain)) {
+    vtkSmartPointer<vtkUnstructuredGrid> volume = vtkSmartPointer<vtkUnstructuredGrid>::New();
+    volume->ShallowCopy(domain);
+    volume->GetPointData()->Initialize();
+    volume->GetCellData ()->Initialize();
+    vtkNew<vtkUnstructuredGridQuadricDecimation> decimator;
+    SetVTKInput(decimator, volume);
+    decimator->SetTargetReduction(target);
+    decimator->Update();
+    coarse = decimator->GetOutput();
+  }
+  if (coarse) {
+    coarse->GetPointData()->Initialize();
+    coarse->GetCellData ()->Initialize();
+  }
+  return coarse;
+}
+
+// -----------------------------------------------------------------------------
+/// Interpolate piecewise linear map at the closest points of its domain mesh
+///
+/// \param[in]  locator Cell locator of domain mesh of the map.
+/// \param[in]  values  Map values at domain mesh points.
+/// \param[in]  points  Points at which to interpolate the map.
+/// \param[out] output  Interpolated map values at each point.
+void InterpolateAtClosestPoints(vtkCellLocator *locator, vtkDataArray *values,
+                                vtkPoints *points, vtkDataArray *output)
+{
+  const DataArrayView map(values);
+  const int dim = map.NumberOfComponents();
+  output->SetNumberOfComponents(dim);
+  output->SetNumberOfTuples(points->GetNumberOfPoints());
+
+  vtkNew<vtkGenericCell> cell;
+  Array<double> weights(max(4, locator->GetDataSet()->GetMaxCellSize())), v(dim);
+  double p[3], q[3], pcoords[3], dist2;
+  vtkIdType cellId;
+  int subId;
+  for (vtkIdType ptId = 0; ptId < points->GetNumberOfPoints(); ++ptId) {
+    points->GetPoint(ptId, p);
+    locator->FindClosestPoint(p, q, cell.GetPointer(), cellId, subId, dist2);
+    for (int l = 0; l < dim; ++l) v[l] = .0;
+    if (cellId >= 0) {
+      cell->EvaluatePosition(q, nullptr, subId, pcoords, dist2, weights.data());
+      for (vtkIdType k = 0; k < cell->GetNumberOfPoints(); ++k) {
+        for (int l = 0; l < dim; ++l) {
+          v[l] += weights[k] * map.Get(cell->GetPointId(k), l);
+        }
+      }
+    }
+    output->SetTuple(ptId, v.data());
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Maximum norm of difference between corresponding map values
+double MaximumDifference(vtkDataArray *a, vtkDataArray *b)
+{
+  const DataArrayView u(a), v(b);
+  const int dim = u.NumberOfComponents();
+  double d, norm2, max_norm2 = .0;
+  for (vtkIdType i = 0; i < a->GetNumberOfTuples(); ++i) {
+    norm2 = .0;
+    for (int l = 0; l < dim; ++l) {
+      d = u.Get(i, l) - v.Get(i, l);
+      norm2 += d * d;
+    }
+    if (norm2 > max_norm2) max_norm2 = norm2;
+  }
+  return sqrt(max_norm2);
+}
+
+// -----------------------------------------------------------------------------
+/// Write piecewise linear map of one level of detail to file stream
+///
+/// \returns Whether the map was written, i.e., its size fits into 32-bit integers.
+bool WriteLevel(Cofstream &os, const PiecewiseLinearMap &map)
+{
+  vtkDataSet   * const domain = map.Domain();
+  vtkDataArray * const values = map.Values();
+
+  const vtkIdType max_size = static_cast<vtkIdType>(numeric_limits<int>::max());
+  const vtkIdType npoints  = domain->GetNumberOfPoints();
+  const vtkIdType ncells   = domain->GetNumberOfCells();
+  const int       ncomps   = values->GetNumberOfComponents();
+  if (npoints > max_size / max(3, ncomps) || ncells > max_size) return false;
+
+  vtkNew<vtkIdList> ptIds;
+  Array<int> types(ncells), sizes(ncells), conn;
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    domain->GetCellPoints(cellId, ptIds.GetPointer());
+    types[cellId] = domain->GetCellType(cellId);
+    sizes[cellId] = static_cast<int>(ptIds->GetNumberOfIds());
+    for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
+      conn.push_back(static_cast<int>(ptIds->GetId(i)));
+    }
+  }
+  if (static_cast<vtkIdType>(conn.size()) > max_size) return false;
+
+  int info[5] = {
+    vtkPolyData::SafeDownCast(domain) ? 0 : 1,
+    static_cast<int>(npoints),
+    static_cast<int>(ncells),
+    static_cast<int>(conn.size()),
+    ncomps
+  };
+  os.WriteAsInt(info, 5);
+
+  Array<double> buffer(3 * npoints);
+  for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+    domain->GetPoint(ptId, buffer.data() + 3 * ptId);
+  }
+  os.WriteAsDouble(buffer.data(), static_cast<int>(buffer.size()));
+  os.WriteAsInt(types.data(), info[2]);
+  os.WriteAsInt(sizes.data(), info[2]);
+  os.WriteAsInt(conn.data(), info[3]);
+
+  buffer.resize(ncomps * npoints);
+  for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+    values->GetTuple(ptId, buffer.data() + ncomps * ptId);
+  }
+  os.WriteAsDouble(buffer.data(), static_cast<int>(buffer.size()));
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Read piecewise linear map of one level of detail from file stream
+///
+/// \returns Initialized map or nullptr when the mesh read is invalid.
+SharedPtr<PiecewiseLinearMap> ReadLevel(Cifstream &is, double outside_value)
+{
+  SharedPtr<PiecewiseLinearMap> map;
+
+  int info[5];
+  is.ReadAsInt(info, 5);
+  const int npoints = info[1];
+  const int ncells  = info[2];
+  const int nconn   = info[3];
+  const int ncomps  = info[4];
+  if (info[0] < 0 || info[0] > 1 || npoints < 0 || ncells < 0 || nconn < 0 || ncomps < 1 ||
+      npoints > numeric_limits<int>::max() / max(3, ncomps)) {
+    return map;
+  }
+
+  Array<double> coords(3 * npoints);
+  Array<int>    types(ncells), sizes(ncells), conn(nconn);
+  is.ReadAsDouble(coords.data(), 3 * npoints);
+  is.ReadAsInt(types.data(), ncells);
+  is.ReadAsInt(sizes.data(), ncells);
+  is.ReadAsInt(conn.data(), nconn);
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetDataTypeToDouble();
+  points->SetNumberOfPoints(npoints);
+  for (int ptId = 0; ptId < npoints; ++ptId) {
+    points->SetPoint(ptId, coords.data() + 3 * ptId);
+  }
+
+  vtkSmartPointer<vtkPointSet>         domain;
+  vtkSmartPointer<vtkPolyData>         surface;
+  vtkSmartPointer<vtkUnstructuredGrid> volume;
+  if (info[0] == 0) {
+    surface = vtkSmartPointer<vtkPolyData>::New();
+    surface->SetPoints(points);
+    surface->Allocate(ncells);
+    domain = surface;
+  } else {
+    volume = vtkSmartPointer<vtkUnstructuredGrid>::New();
+    volume->SetPoints(points);
+    volume->Allocate(ncells);
+    domain = volume;
+  }
+  Array<vtkIdType> ptIds;
+  for (int cellId = 0, offset = 0; cellId < ncells; ++cellId) {
+    const int npts = sizes[cellId];
+    if (npts < 0 || offset + npts > nconn) return map;
+    ptIds.resize(npts);
+    for (int i = 0; i < npts; ++i, ++offset) {
+      if (conn[offset] < 0 || conn[offset] >= npoints) return map;
+      ptIds[i] = static_cast<vtkIdType>(conn[offset]);
+    }
+    if (surface) surface->InsertNextCell(types[cellId], npts, ptIds.data());
+    else         volume ->InsertNextCell(types[cellId], npts, ptIds.data());
+  }
+
+  vtkSmartPointer<vtkDoubleArray> values = vtkSmartPointer<vtkDoubleArray>::New();
+  values->SetName("Map");
+  values->SetNumberOfComponents(ncomps);
+  values->SetNumberOfTuples(npoints);
+  is.ReadAsDouble(values->GetPointer(0), ncomps * npoints);
+
+  map = NewShared<PiecewiseLinearMap>();
+  map->Domain(domain);
+  map->Values(values);
+  map->OutsideValue(outside_value);
+  map->Initialize();
+  return map;
+}
+
+
+} // namespace MultiResolutionMapUtils
+using namespace MultiResolutionMapUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::CopyAttributes(const MultiResolutionMap &other)
+{
+  _Levels            = other._Levels;
+  _LevelErrors       = other._LevelErrors;
+  _Level             = other._Level;
+  _FinestLevelToRead = other._FinestLevelToRead;
+  _LevelReduction    = other._LevelReduction;
+}
+
+// -----------------------------------------------------------------------------
+MultiResolutionMap::MultiResolutionMap()
+:
+  _Level(0),
+  _FinestLevelToRead(0),
+  _LevelReduction(.75)
+{
+}
+
+// -----------------------------------------------------------------------------
+MultiResolutionMap::MultiResolutionMap(const MultiResolutionMap &other)
+:
+  Mapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+MultiResolutionMap &MultiResolutionMap::operator =(const MultiResolutionMap &other)
+{
+  if (this != &other) {
+    Mapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::Initialize()
+{
+  Mapping::Initialize();
+  if (FinestLevel() < 0) {
+    cerr << this->NameOfType() << "::Initialize: Map has no levels of detail" << endl;
+    exit(1);
+  }
+  // Level maps are shared with copies of this map, which may use another
+  // outside value. A copy of a level map shares its domain and map values.
+  for (int level = 0; level < NumberOfLevels(); ++level) {
+    if (_Levels[level] && _Levels[level]->OutsideValue() != _OutsideValue) {
+      _Levels[level] = NewShared<PiecewiseLinearMap>(*_Levels[level]);
+      _Levels[level]->OutsideValue(_OutsideValue);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *MultiResolutionMap::NewCopy() const
+{
+  return new MultiResolutionMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+MultiResolutionMap::~MultiResolutionMap()
+{
+}
+
+// =============================================================================
+// Levels of detail
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::Build(const PiecewiseLinearMap &map, int nlevels)
+{
+  vtkDataSet   * const finest_domain = map.Domain();
+  vtkDataArray * const finest_values = map.Values();
+  if (!finest_domain || !finest_values) {
+    cerr << this->NameOfType() << "::Build: Input map has no domain mesh or map values" << endl;
+    exit(1);
+  }
+
+  _OutsideValue = map.OutsideValue();
+  _Levels.clear();
+  _LevelErrors.clear();
+  _Levels.push_back(NewShared<PiecewiseLinearMap>(map));
+  _LevelErrors.push_back(.0);
+  _Level = 0;
+
+  vtkSmartPointer<vtkCellLocator> finest_locator;
+  for (int level = 1; level < nlevels; ++level) {
+    const PiecewiseLinearMap &finer = *_Levels.back();
+    vtkDataSet * const domain = finer.Domain();
+
+    // Decimate domain mesh of previous level
+    vtkSmartPointer<vtkPointSet> coarse = Decimate(domain, _LevelReduction);
+    if (!coarse || coarse->GetNumberOfPoints() < 4 ||
+        coarse->GetNumberOfPoints() > .9 * domain->GetNumberOfPoints()) {
+      break;
+    }
+
+    // Interpolate finest map at closest points of finest domain mesh
+    if (!finest_locator) {
+      finest_locator = vtkSmartPointer<vtkCellLocator>::New();
+      finest_locator->SetDataSet(finest_domain);
+      finest_locator->BuildLocator();
+    }
+    vtkSmartPointer<vtkDataArray> values;
+    values.TakeReference(finest_values->NewInstance());
+    values->SetName(finest_values->GetName());
+    InterpolateAtClosestPoints(finest_locator, finest_values, coarse->GetPoints(), values);
+
+    SharedPtr<PiecewiseLinearMap> coarse_map = NewShared<PiecewiseLinearMap>();
+    coarse_map->Domain(coarse);
+    coarse_map->Values(values);
+    coarse_map->OutsideValue(_OutsideValue);
+    coarse_map->Initialize();
+
+    // Approximation error of coarse map at points of finest domain mesh
+    vtkNew<vtkCellLocator> locator;
+    locator->SetDataSet(coarse);
+    locator->BuildLocator();
+    vtkNew<vtkDoubleArray> approx;
+    InterpolateAtClosestPoints(locator.GetPointer(), values,
+                               vtkPointSet::SafeDownCast(finest_domain)->GetPoints(),
+                               approx.GetPointer());
+
+    _Levels.push_back(coarse_map);
+    _LevelErrors.push_back(MaximumDifference(finest_values, approx.GetPointer()));
+  }
+}
+
+// -----------------------------------------------------------------------------
+int MultiResolutionMap::FinestLevel() const
+{
+  for (int level = 0; level < NumberOfLevels(); ++level) {
+    if (_Levels[level]) return level;
+  }
+  return -1;
+}
+
+// -----------------------------------------------------------------------------
+int MultiResolutionMap::FindLevel(double tol) const
+{
+  const int finest = FinestLevel();
+  for (int level = NumberOfLevels() - 1; level > finest; --level) {
+    if (_LevelErrors[level] <= tol) return level;
+  }
+  return finest;
+}
+
+// -----------------------------------------------------------------------------
+const PiecewiseLinearMap &MultiResolutionMap::LevelMap(int level) const
+{
+  level = max(min(level, NumberOfLevels() - 1), FinestLevel());
+  if (!IsLoaded(level)) {
+    cerr << this->NameOfType() << "::LevelMap: Map has no levels of detail" << endl;
+    exit(1);
+  }
+  return *_Levels[level];
+}
+
+// -----------------------------------------------------------------------------
+Mapping::EvaluationContext &MultiResolutionMap::LevelContext(EvaluationContext &ctx, int level) const
+{
+  if (static_cast<int>(ctx._Nested.size()) < NumberOfLevels()) {
+    ctx._Nested.resize(NumberOfLevels());
+  }
+  if (!ctx._Nested[level]) ctx._Nested[level] = NewShared<EvaluationContext>();
+  return *ctx._Nested[level];
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::BoundingBox(double &x1, double &y1, double &z1,
+                                     double &x2, double &y2, double &z2) const
+{
+  LevelMap(_Level).BoundingBox(x1, y1, z1, x2, y2, z2);
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap
+::MarkDomainBricks(const ImageAttributes &lattice, int n, Array<bool> &occupied) const
+{
+  LevelMap(_Level).MarkDomainBricks(lattice, n, occupied);
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int MultiResolutionMap::NumberOfComponents() const
+{
+  const int finest = FinestLevel();
+  return finest < 0 ? 0 : _Levels[finest]->NumberOfComponents();
+}
+
+// -----------------------------------------------------------------------------
+bool MultiResolutionMap::Evaluate(double *v, double x, double y, double z) const
+{
+  return LevelMap(_Level).Evaluate(v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+double MultiResolutionMap::Evaluate(double x, double y, double z, int l) const
+{
+  return LevelMap(_Level).Evaluate(x, y, z, l);
+}
+
+// -----------------------------------------------------------------------------
+bool MultiResolutionMap::Evaluate(EvaluationContext &ctx, double *v,
+                                  double x, double y, double z) const
+{
+  const int level = ActiveLevel();
+  return LevelMap(level).Evaluate(LevelContext(ctx, level), v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  LevelMap(_Level).Evaluate(n, xyz, values, inside);
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::Resample(vtkPointSet *mesh, double *values, bool *inside) const
+{
+  LevelMap(_Level).Resample(mesh, values, inside);
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::Evaluate(GenericImage<float> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  LevelMap(_Level).Evaluate(f, l, m);
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::Evaluate(GenericImage<double> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  LevelMap(_Level).Evaluate(f, l, m);
+}
+
+// -----------------------------------------------------------------------------
+bool MultiResolutionMap::EvaluateAtLevel(int level, double *v, double x, double y, double z) const
+{
+  return LevelMap(level).Evaluate(v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::EvaluateAtLevel(int level, int n, const double *xyz, double *values, bool *inside) const
+{
+  LevelMap(level).Evaluate(n, xyz, values, inside);
+}
+
+// -----------------------------------------------------------------------------
+bool MultiResolutionMap::EvaluateWithTolerance(double tol, double *v, double x, double y, double z) const
+{
+  return LevelMap(FindLevel(tol)).Evaluate(v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+bool MultiResolutionMap::EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                          double x, double y, double z) const
+{
+  const int level = ActiveLevel();
+  return LevelMap(level).EvaluateJacobian(LevelContext(ctx, level), jac, x, y, z);
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::ReadMap(Cifstream &is)
+{
+  int header[2];
+  is.ReadAsInt(header, 2);
+  if (header[0] != FileVersion || header[1] < 1) {
+    cerr << this->NameOfType() << "::ReadMap: Invalid header or unsupported file format version" << endl;
+    exit(1);
+  }
+  const int nlevels = header[1];
+  _LevelErrors.resize(nlevels);
+  is.ReadAsDouble(_LevelErrors.data(), nlevels);
+
+  // Levels are stored coarsest first such that reading can stop early
+  _Levels.clear();
+  _Levels.resize(nlevels);
+  const int finest = max(0, min(_FinestLevelToRead, nlevels - 1));
+  for (int level = nlevels - 1; level >= finest; --level) {
+    _Levels[level] = ReadLevel(is, _OutsideValue);
+    if (!_Levels[level]) {
+      cerr << this->NameOfType() << "::ReadMap: Invalid mesh of level " << level << endl;
+      exit(1);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MultiResolutionMap::WriteMap(Cofstream &os) const
+{
+  const int nlevels = NumberOfLevels();
+  for (int level = 0; level < nlevels; ++level) {
+    if (!_Levels[level]) {
+      cerr << this->NameOfType() << "::WriteMap: Level " << level << " was not read from file" << endl;
+      exit(1);
+    }
+  }
+  int header[2] = { FileVersion, nlevels };
+  os.WriteAsInt(header, 2);
+  os.WriteAsDouble(_LevelErrors.data(), nlevels);
+  for (int level = nlevels - 1; level >= 0; --level) {
+    if (!WriteLevel(os, *_Levels[level])) {
+      cerr << this->NameOfType() << "::WriteMap: Mesh of level " << level << " exceeds 32-bit size" << endl;
+      exit(1);
+    }
+  }
+}
+
+
+} // namespace mirtk
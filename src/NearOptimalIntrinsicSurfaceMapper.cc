@@ -20,6 +20,7 @@
 #include "mirtk/NearOptimalIntrinsicSurfaceMapper.h"
 
 #include "mirtk/IntrinsicSurfaceMapper.h"
+#include "mirtk/Parallel.h"
 
 #include "vtkPointData.h"
 #include "vtkCellData.h"
@@ -38,6 +39,49 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace NearOptimalIntrinsicSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Blend authalic and conformal map values in place, i.e., u1 = mu u0 + lambda u1
+template <class T>
+struct BlendMapValues
+{
+  const T *_U0;
+  T       *_U1;
+  double   _Mu;
+  double   _Lambda;
+
+  void operator ()(const blocked_range<vtkIdType> &re) const
+  {
+    for (vtkIdType i = re.begin(); i != re.end(); ++i) {
+      _U1[i] = static_cast<T>(_Mu * static_cast<double>(_U0[i]) + _Lambda * static_cast<double>(_U1[i]));
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Blend authalic and conformal map values in place
+template <class T>
+void Blend(vtkDataArray *u0, vtkDataArray *u1, double lambda)
+{
+  BlendMapValues<T> blend;
+  blend._U0     = reinterpret_cast<const T *>(u0->GetVoidPointer(0));
+  blend._U1     = reinterpret_cast<T *>(u1->GetVoidPointer(0));
+  blend._Mu     = 1. - lambda;
+  blend._Lambda = lambda;
+  const vtkIdType n = u1->GetNumberOfTuples() * u1->GetNumberOfComponents();
+  parallel_for(blocked_range<vtkIdType>(0, n), blend);
+}
+
+
+} // namespace NearOptimalIntrinsicSurfaceMapperUtils
+using namespace NearOptimalIntrinsicSurfaceMapperUtils;
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -96,8 +140,7 @@ void NearOptimalIntrinsicSurfaceMapper::ComputeMap()
     cout << "\n  Computing discrete authalic map...";
   }
   _Lambda = 0., IntrinsicSurfaceMapper::ComputeMap();
-  u0.TakeReference(_Values->NewInstance());
-  u0->DeepCopy(_Values);
+  u0 = _Values;
   if (verbose > 0) {
     cout << "  Computing discrete authalic map... done\n";
   }
@@ -106,6 +149,23 @@ void NearOptimalIntrinsicSurfaceMapper::ComputeMap()
   if (verbose > 0) {
     cout << "\n  Computing discrete conformal map...";
   }
+  //
+  // The authalic map values are kept as they are, and only the fixed values
+  // are copied to the new output array of the conformal map. An iterative
+  // solver is further initialized with the authalic map as initial guess.
+  const bool use_direct_solver = (_NumberOfIterations < 0 || _NumberOfIterations == 1);
+  _Values.TakeReference(u0->NewInstance());
+  if (_Solver == SparseSolver_Default ? !use_direct_solver : !IsDirectSolver(_Solver)) {
+    _Values->DeepCopy(u0);
+  } else {
+    _Values->SetName(u0->GetName());
+    _Values->SetNumberOfComponents(m);
+    _Values->SetNumberOfTuples(n);
+    memset(_Values->GetVoidPointer(0), 0, n * m * _Values->GetDataTypeSize());
+    for (int i = 0; i < NumberOfFixedPoints(); ++i) {
+      _Values->SetTuple(FixedPointId(i), FixedPointId(i), u0);
+    }
+  }
   _Lambda = 1., IntrinsicSurfaceMapper::ComputeMap();
   u1 = _Values;
   if (verbose > 0) {
@@ -120,11 +180,21 @@ void NearOptimalIntrinsicSurfaceMapper::ComputeMap()
     cout.flush();
   }
 
-  // Set near-optimal surface map values
-  for (vtkIdType i = 0; i < n; ++i)
-  for (int       j = 0; j < m; ++j) {
-    _Values->SetComponent(i, j, mu * u0->GetComponent(i, j) + _Lambda * u1->GetComponent(i, j));
+  // Set near-optimal surface map values in place of conformal map values
+  if (u0->GetDataType() == VTK_FLOAT && u1->GetDataType() == VTK_FLOAT) {
+    Blend<float >(u0, u1, _Lambda);
+  } else if (u0->GetDataType() == VTK_DOUBLE && u1->GetDataType() == VTK_DOUBLE) {
+    Blend<double>(u0, u1, _Lambda);
+  } else {
+    for (vtkIdType i = 0; i < n; ++i)
+    for (int       j = 0; j < m; ++j) {
+      u1->SetComponent(i, j, mu * u0->GetComponent(i, j) + _Lambda * u1->GetComponent(i, j));
+    }
   }
+
+  // Blended map is not the solution of the last linear system,
+  // hence it cannot be recomputed by RunWithFixedValues
+  _CouplingOffset.clear();
 }
 
 // =============================================================================
@@ -19,10 +19,11 @@
 
 #include "mirtk/NonSymmetricWeightsSurfaceMapper.h"
 
-#include "Eigen/SparseCore"
-#include "Eigen/SparseLU"
-#include "Eigen/OrderingMethods"
-#include "Eigen/IterativeLinearSolvers"
+#include "mirtk/Memory.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/DataArrayView.h"
+#include "mirtk/SparseSolver.h"
+#include "mirtk/MapperWorkspace.h"
 
 
 namespace mirtk {
@@ -32,6 +33,94 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace NonSymmetricWeightsSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute weights of directed edges starting at free points in parallel
+///
+/// The weights of the edges of the r-th free point are written to the
+/// pre-allocated buffer in compressed row order, starting at offset r.
+/// The mapper's Weights function thus writes directly into its output row,
+/// without per-thread scratch memory or synchronization.
+struct ComputeEdgeWeights
+{
+  const NonSymmetricWeightsSurfaceMapper *_Mapper;
+  const EdgeTable                        *_EdgeTable;
+  const int                              *_Offset;
+  double                                 *_Weights;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    // Skip remaining rows when time limit exceeded or run cancelled
+    MapperObserver * const observer = _Mapper->Observer();
+    if (observer && !observer->Continue()) return;
+
+    int i, d_i;
+    const int *j;
+    for (int r = re.begin(); r != re.end(); ++r) {
+      i = _Mapper->FreePointId(r);
+      _EdgeTable->GetAdjacentPoints(i, d_i, j);
+      _Mapper->Weights(i, j, _Weights + _Offset[r], d_i);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Assemble linear system from pre-computed edge weights in parallel
+///
+/// Each row of the linear system corresponds to one free point. Its values
+/// are written in place into the pre-allocated sparse matrix, such that rows
+/// can be assembled concurrently and the result is independent of the number
+/// of threads.
+struct AssembleLinearSystem
+{
+  const NonSymmetricWeightsSurfaceMapper *_Mapper;
+  const EdgeTable                        *_EdgeTable;
+  const DataArrayView                    *_Values;
+  const int                              *_Offset;
+  const double                           *_Weights;
+  Eigen::SparseMatrix<double>            *_Matrix;
+  Eigen::MatrixXd                        *_RightHandSide;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int m = static_cast<int>(_RightHandSide->cols());
+
+    int i, c, d_i;
+    const int *j;
+    const double *w_i;
+    double w_ii;
+
+    for (int r = re.begin(); r != re.end(); ++r) {
+      i = _Mapper->FreePointId(r);
+      _EdgeTable->GetAdjacentPoints(i, d_i, j);
+      w_i = _Weights + _Offset[r];
+      w_ii = .0;
+      for (int k = 0; k < d_i; ++k) {
+        c = _Mapper->FreePointIndex(j[k]);
+        if (c >= 0) {
+          _Matrix->coeffRef(r, c) = -w_i[k];
+        } else {
+          for (int l = 0; l < m; ++l) {
+            (*_RightHandSide)(r, l) += w_i[k] * _Values->Get(j[k], l);
+          }
+        }
+        w_ii += w_i[k];
+      }
+      _Matrix->coeffRef(r, r) = w_ii;
+    }
+  }
+};
+
+
+} // namespace NonSymmetricWeightsSurfaceMapperUtils
+using namespace NonSymmetricWeightsSurfaceMapperUtils;
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -99,53 +188,64 @@ void NonSymmetricWeightsSurfaceMapper::ComputeMap()
 
   typedef Eigen::MatrixXd             Values;
   typedef Eigen::SparseMatrix<double> Matrix;
-  typedef Eigen::Triplet<double>      NZEntry;
 
-  const int N = NumberOfPoints();
   const int n = NumberOfFreePoints();
   const int m = NumberOfComponents();
 
-  int i, k, l, r, c;
-  const int *j;
+  int i, l, r;
+  const DataArrayView values(_Values);
 
-  Matrix A(n, n);
-  Values b(n, m);
-  {
-    Array<NZEntry> w;
-    Array<double>  w_ii(n, .0);
+  // Buffers of previous solves keep their capacity
+  MapperWorkspace &workspace = GetWorkspace();
 
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
+  Matrix &A = workspace._Matrix;
+  Values &b = workspace._RightHandSide;
+  A.resize(n, n);
+  b.resize(n, m);
+  {
+    // Allocate compressed storage of system matrix with known sparsity pattern
+    A.resizeNonZeros(NumberOfNonZeros());
+    GetSparsityPattern(A.outerIndexPtr(), A.innerIndexPtr());
+    Eigen::Map<Eigen::VectorXd>(A.valuePtr(), A.nonZeros()).setZero();
     b.setZero();
-    w.reserve(2 * _EdgeTable->NumberOfEdges() + n);
-
-    int     d_i;
-    double *w_i = new double[_EdgeTable->MaxNumberOfAdjacentPoints()];
-
-    EdgeIterator edgeIt(*_EdgeTable);
-    for (i = 0; i < N; ++i) {
-      r = FreePointIndex(i);
-      if (r >= 0) {
-        _EdgeTable->GetAdjacentPoints(i, d_i, j);
-        this->Weights(i, j, w_i, d_i);
-        for (k = 0; k < d_i; ++k) {
-          c = FreePointIndex(j[k]);
-          if (c >= 0) {
-            w.push_back(NZEntry(r, c, -w_i[k]));
-          } else {
-            for (l = 0; l < m; ++l) {
-              b(r, l) += w_i[k] * GetValue(j[k], l);
-            }
-          }
-          w_ii[r] += w_i[k];
-        }
-      }
-    }
+
+    // Compute edge weights of all free points in a first parallel pass,
+    // where the weight computation dominates the assembly time
+    Array<int> &offset = workspace._Offset;
+    int         d_i;
+    const int  *j;
+    offset.resize(n + 1);
+    offset[0] = 0;
     for (r = 0; r < n; ++r) {
-      w.push_back(NZEntry(r, r, w_ii[r]));
+      _EdgeTable->GetAdjacentPoints(FreePointId(r), d_i, j);
+      offset[r + 1] = offset[r] + d_i;
     }
-    delete[] w_i;
-
-    A.setFromTriplets(w.begin(), w.end());
+    Array<double> &weights = workspace._Weights;
+    weights.resize(offset[n]);
+
+    ComputeEdgeWeights eval;
+    eval._Mapper    = this;
+    eval._EdgeTable = _EdgeTable.get();
+    eval._Offset    = offset.data();
+    eval._Weights   = weights.data();
+    parallel_for(blocked_range<int>(0, n), eval);
+
+    // Keep initial values of free points when edge weights are incomplete
+    if (_Observer && !_Observer->Continue()) return;
+
+    // Write coefficients of linear system in a second parallel pass
+    AssembleLinearSystem assemble;
+    assemble._Mapper        = this;
+    assemble._EdgeTable     = _EdgeTable.get();
+    assemble._Values        = &values;
+    assemble._Offset        = offset.data();
+    assemble._Weights       = weights.data();
+    assemble._Matrix        = &A;
+    assemble._RightHandSide = &b;
+    parallel_for(blocked_range<int>(0, n), assemble);
   }
+  assembly.Stop();
 
   if (verbose) {
     cout << "\n";
@@ -156,40 +256,46 @@ void NonSymmetricWeightsSurfaceMapper::ComputeMap()
     cout.flush();
   }
 
-  Values x(n, m);
+  Values &x = workspace._Solution;
+  x.resize(n, m);
   int    niter = 0;
   double error = nan;
 
-  if (use_direct_solver) {
-    Eigen::SparseLU<Matrix> solver;
-    solver.analyzePattern(A);
-    solver.factorize(A);
-    x = solver.solve(b);
-  } else {
-    Eigen::BiCGSTAB<Matrix> solver(A);
-    if (_NumberOfIterations > 0 ) solver.setMaxIterations(_NumberOfIterations);
-    if (_Tolerance          > 0.) solver.setTolerance(_Tolerance);
-    for (r = 0; r < n; ++r) {
-      i = FreePointId(r);
-      for (l = 0; l < m; ++l) {
-        x(r, l) = GetValue(i, l);
-      }
+  for (r = 0; r < n; ++r) {
+    i = FreePointId(r);
+    for (l = 0; l < m; ++l) {
+      x(r, l) = values.Get(i, l);
     }
-    x = solver.solveWithGuess(b, x);
-    niter = solver.iterations();
-    error = solver.error();
   }
+  if (!_Factorization) _Factorization = NewShared<SparseFactorization>();
+  _Factorization->MixedPrecision(_MixedPrecision);
+  _Factorization->Statistics(&_Statistics);
+  _Factorization->Observer(_Observer);
+  const SparseSolverType solver = _Factorization->Solve(_Solver, SparseMatrix_General,
+                                                        use_direct_solver, A, b, x,
+                                                        _NumberOfIterations, _Tolerance,
+                                                        true, &niter, &error);
 
   for (r = 0; r < n; ++r) {
     i = FreePointId(r);
     for (l = 0; l < m; ++l) {
-      SetValue(i, l, x(r, l));
+      values.Set(i, l, x(r, l));
     }
   }
 
-  if (verbose && !use_direct_solver) {
-    cout << "  No. of iterations            = " << niter << "\n";
-    cout << "  Estimated error              = " << error << "\n";
+  if (verbose) {
+    cout << "  Sparse linear solver         = " << ToString(solver) << "\n";
+    if (IsDirectSolver(solver)) {
+      cout << "  No. of symbolic analyses     = " << _Factorization->NumberOfAnalyses() << "\n";
+      cout << "  No. of factorizations        = " << _Factorization->NumberOfFactorizations() << "\n";
+      if (_Factorization->MixedPrecision()) {
+        cout << "  No. of refinement steps      = " << niter << "\n";
+        cout << "  Relative residual            = " << error << "\n";
+      }
+    } else {
+      cout << "  No. of iterations            = " << niter << "\n";
+      cout << "  Estimated error              = " << error << "\n";
+    }
     cout.flush();
   }
 }
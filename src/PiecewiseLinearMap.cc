@@ -20,9 +20,15 @@
 #include "mirtk/PiecewiseLinearMap.h"
 
 #include "mirtk/Vtk.h"
+#include "mirtk/Math.h"
 #include "mirtk/Path.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/Profiling.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/GenericImage.h"
 #include "mirtk/PointSetIO.h"
 #include "mirtk/PointSetUtils.h"
+#include "mirtk/DataArrayView.h"
 
 #include "vtkPoints.h"
 #include "vtkImageData.h"
@@ -30,226 +36,2382 @@
 #include "vtkCellData.h"
 #include "vtkGenericCell.h"
 #include "vtkIdList.h"
+#include "vtkCellType.h"
 #include "vtkCellLocator.h"
+#include "vtkCellTypes.h"
 
 #include "vtkXMLImageDataWriter.h"
 #include "vtkXMLImageDataReader.h"
+#include "vtkPolyData.h"
+#include "vtkUnstructuredGrid.h"
+#include "vtkCellArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkFloatArray.h"
+#include "vtkDoubleArray.h"
+#include "vtkVersionMacros.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 
 
 namespace mirtk {
 
 
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
+// =============================================================================
+// Auxiliary functors
+// =============================================================================
+
+namespace PiecewiseLinearMapUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Interpolate values of any number of components at the points of any cell
+void InterpolateValues(const DataArrayView &values, const vtkIdType *ptIds,
+                       int npts, const double *w, double *v)
+{
+  const int dim = values.NumberOfComponents();
+  for (int j = 0; j < dim; ++j) {
+    v[j] = .0;
+  }
+  for (int i = 0; i < npts; ++i)
+  for (int j = 0; j < dim; ++j) {
+    v[j] += w[i] * values.Get(ptIds[i], j);
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Interpolate values with Dim components of type T at the points of a cell
+/// with NumPts points, falling back to the generic kernel for other cells
+template <int NumPts, int Dim, class T>
+void InterpolateValues(const DataArrayView &values, const vtkIdType *ptIds,
+                       int npts, const double *w, double *v)
+{
+  const T * const data = values.Pointer<T>();
+  if (data == nullptr || npts != NumPts || values.NumberOfComponents() != Dim) {
+    InterpolateValues(values, ptIds, npts, w, v);
+    return;
+  }
+  double sum[Dim];
+  const T *p = data + Dim * ptIds[0];
+  for (int j = 0; j < Dim; ++j) {
+    sum[j] = w[0] * static_cast<double>(p[j]);
+  }
+  for (int i = 1; i < NumPts; ++i) {
+    p = data + Dim * ptIds[i];
+    for (int j = 0; j < Dim; ++j) {
+      sum[j] += w[i] * static_cast<double>(p[j]);
+    }
+  }
+  for (int j = 0; j < Dim; ++j) {
+    v[j] = sum[j];
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Get interpolation kernel specialized for the given number of cell points
+template <int NumPts>
+PiecewiseLinearMap::InterpolationKernel SelectKernel(int dim, bool single)
+{
+  switch (dim) {
+    case 1: return single ? &InterpolateValues<NumPts, 1, float> : &InterpolateValues<NumPts, 1, double>;
+    case 2: return single ? &InterpolateValues<NumPts, 2, float> : &InterpolateValues<NumPts, 2, double>;
+    case 3: return single ? &InterpolateValues<NumPts, 3, float> : &InterpolateValues<NumPts, 3, double>;
+    default: return &InterpolateValues;
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Get interpolation kernel for map values at the points of a domain mesh
+PiecewiseLinearMap::InterpolationKernel SelectKernel(vtkDataSet *domain, vtkDataArray *values)
+{
+  const bool single = (DataArrayPointer<float>(values) != nullptr);
+  if (!single && DataArrayPointer<double>(values) == nullptr) {
+    return &InterpolateValues;
+  }
+  vtkNew<vtkCellTypes> types;
+  domain->GetCellTypes(types.GetPointer());
+  if (types->GetNumberOfTypes() != 1) {
+    return &InterpolateValues;
+  }
+  const int dim = static_cast<int>(values->GetNumberOfComponents());
+  switch (types->GetCellType(0)) {
+    case VTK_TRIANGLE: return SelectKernel<3>(dim, single);
+    case VTK_TETRA:    return SelectKernel<4>(dim, single);
+    default:           return &InterpolateValues;
+  }
+}
+
+
+// -----------------------------------------------------------------------------
+/// Evaluate piecewise linear map at contiguous set of points
+struct EvaluateMapAtPoints
+{
+  const PiecewiseLinearMap *_Map;
+  const double             *_Points;
+  double                   *_Values;
+  bool                     *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int dim = _Map->NumberOfComponents();
+    Mapping::EvaluationContext ctx; // scratch memory shared by block of points
+    const double *x = _Points + 3   * re.begin();
+    double       *v = _Values + dim * re.begin();
+    bool          inside;
+    for (int n = re.begin(); n != re.end(); ++n, x += 3, v += dim) {
+      inside = _Map->Evaluate(ctx, v, x[0], x[1], x[2]);
+      if (_Inside) _Inside[n] = inside;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate multiple fields of piecewise linear map at contiguous set of points
+struct EvaluateFieldsAtPoints
+{
+  const PiecewiseLinearMap *_Map;
+  int                       _NumberOfFields;
+  const int                *_Fields;
+  int                       _NumberOfComponents;
+  const double             *_Points;
+  double                   *_Values;
+  bool                     *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int dim = _NumberOfComponents;
+    Mapping::EvaluationContext ctx;
+    const double *x = _Points + 3   * re.begin();
+    double       *v = _Values + dim * re.begin();
+    bool          inside;
+    for (int n = re.begin(); n != re.end(); ++n, x += 3, v += dim) {
+      inside = _Map->EvaluateFields(ctx, _NumberOfFields, _Fields, v, x[0], x[1], x[2]);
+      if (_Inside) _Inside[n] = inside;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate multiple fields of piecewise linear map at lattice points slice by slice
+template <class T>
+struct EvaluateFieldsAtLattice
+{
+  const PiecewiseLinearMap *_Map;
+  int                       _NumberOfFields;
+  const int                *_Fields;
+  const unsigned char      *_Mask;
+  GenericImage<T>          *_Output;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int nx   = _Output->X();
+    const int ny   = _Output->Y();
+    const int nt   = _Output->T();
+    const int nvox = _Output->NumberOfSpatialVoxels();
+    Mapping::EvaluationContext ctx;
+    Array<double> v(nt);
+    double x, y, z;
+    int    vox;
+    T * const data = _Output->Data();
+    for (int k = re.begin(); k != re.end(); ++k)
+    for (int j = 0; j < ny; ++j)
+    for (int i = 0; i < nx; ++i) {
+      vox = i + nx * (j + ny * k);
+      if (_Mask && _Mask[vox] == 0) {
+        for (int l = 0; l < nt; ++l) {
+          data[vox + l * nvox] = numeric_limits<T>::quiet_NaN();
+        }
+        continue;
+      }
+      x = i, y = j, z = k;
+      _Output->ImageToWorld(x, y, z);
+      _Map->EvaluateFields(ctx, _NumberOfFields, _Fields, v.data(), x, y, z);
+      for (int l = 0; l < nt; ++l) {
+        data[vox + l * nvox] = static_cast<T>(v[l]);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate map at mesh points patch by patch in breadth-first order
+///
+/// The points of each patch are processed by one thread only. The mesh walk
+/// to a point starts at the cell containing the point from which it was
+/// reached during the breadth-first traversal when that point belongs to the
+/// same patch, and at the cell of the previously evaluated point otherwise.
+struct ResampleMapInPatches
+{
+  const PiecewiseLinearMap *_Map;
+  vtkPointSet              *_Mesh;
+  const Array<int>         *_Order;  ///< Mesh points in breadth-first order
+  const Array<int>         *_Parent; ///< Point from which each point was reached
+  const Array<int>         *_Offset; ///< Offset of each patch in breadth-first order
+  const Array<int>         *_Patch;  ///< Patch of each mesh point
+  Array<vtkIdType>         *_CellId; ///< Cell containing each mesh point or -1
+  double                   *_Values;
+  bool                     *_Inside;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int dim = _Map->NumberOfComponents();
+    Mapping::EvaluationContext ctx;
+    double p[3];
+    int    ptId, parent;
+    bool   inside;
+    for (int patch = re.begin(); patch != re.end(); ++patch) {
+      for (int pos = (*_Offset)[patch]; pos < (*_Offset)[patch + 1]; ++pos) {
+        ptId   = (*_Order)[pos];
+        parent = (*_Parent)[ptId];
+        if (parent >= 0 && (*_Patch)[parent] == patch && (*_CellId)[parent] >= 0) {
+          ctx._CellId = (*_CellId)[parent];
+        }
+        _Mesh->GetPoint(static_cast<vtkIdType>(ptId), p);
+        inside = _Map->Evaluate(ctx, _Values + dim * ptId, p[0], p[1], p[2]);
+        (*_CellId)[ptId] = (inside ? ctx._CellId : -1);
+        if (_Inside) _Inside[ptId] = inside;
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Face of a simplicial cell used to determine face neighbors
+struct CellFace
+{
+  vtkIdType _PtIds[3]; ///< Sorted IDs of face points, last ID is -1 for edges
+  vtkIdType _Index;    ///< Cell ID times number of cell faces plus face index
+
+  bool operator <(const CellFace &other) const
+  {
+    if (_PtIds[0] != other._PtIds[0]) return _PtIds[0] < other._PtIds[0];
+    if (_PtIds[1] != other._PtIds[1]) return _PtIds[1] < other._PtIds[1];
+    return _PtIds[2] < other._PtIds[2];
+  }
+
+  bool operator ==(const CellFace &other) const
+  {
+    return _PtIds[0] == other._PtIds[0] &&
+           _PtIds[1] == other._PtIds[1] &&
+           _PtIds[2] == other._PtIds[2];
+  }
+};
+
+
+// -----------------------------------------------------------------------------
+/// Compute gradients of barycentric coordinates of a triangle or tetrahedron
+///
+/// \param[in]  domain Domain mesh.
+/// \param[in]  ptIds  IDs of the 3 or 4 cell points.
+/// \param[in]  npts   Number of cell points.
+/// \param[out] grad   Gradient of the barycentric coordinate of each cell point.
+///
+/// \returns Whether the cell is non-degenerate. When \c false, the gradients are zero.
+bool BarycentricGradients(vtkDataSet *domain, const vtkIdType *ptIds, int npts, double *grad)
+{
+  double p0[3], p[3], e[3][3], inv[9];
+  for (int i = 0; i < 3 * npts; ++i) grad[i] = .0;
+  domain->GetPoint(ptIds[0], p0);
+  for (int i = 1; i < npts; ++i) {
+    domain->GetPoint(ptIds[i], p);
+    e[i-1][0] = p[0] - p0[0];
+    e[i-1][1] = p[1] - p0[1];
+    e[i-1][2] = p[2] - p0[2];
+  }
+  if (npts == 4) {
+    // Rows of inverse of matrix with edge vectors as columns
+    const double m[9] = {e[0][0], e[1][0], e[2][0],
+                         e[0][1], e[1][1], e[2][1],
+                         e[0][2], e[1][2], e[2][2]};
+    if (!SimplicialCellLocator::Invert3x3(m, inv)) return false;
+    for (int i = 0; i < 9; ++i) grad[3 + i] = inv[i];
+  } else if (npts == 3) {
+    // Rows of pseudo-inverse of 3x2 matrix with edge vectors as columns
+    const double g00 = e[0][0] * e[0][0] + e[0][1] * e[0][1] + e[0][2] * e[0][2];
+    const double g01 = e[0][0] * e[1][0] + e[0][1] * e[1][1] + e[0][2] * e[1][2];
+    const double g11 = e[1][0] * e[1][0] + e[1][1] * e[1][1] + e[1][2] * e[1][2];
+    const double det = g00 * g11 - g01 * g01;
+    if (abs(det) < 1e-24) return false;
+    for (int a = 0; a < 3; ++a) {
+      grad[3 + a] = ( g11 * e[0][a] - g01 * e[1][a]) / det;
+      grad[6 + a] = (-g01 * e[0][a] + g00 * e[1][a]) / det;
+    }
+  } else {
+    return false;
+  }
+  for (int i = 1; i < npts; ++i)
+  for (int a = 0; a < 3; ++a) {
+    grad[a] -= grad[3 * i + a];
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Compute gradients of barycentric coordinates of each simplicial cell
+struct ComputeCellGradients
+{
+  vtkDataSet *_Domain;
+  int         _NumberOfCellPoints;
+  double     *_Gradients;
+
+  void operator ()(const blocked_range<vtkIdType> &re) const
+  {
+    vtkNew<vtkIdList> ptIds;
+    const int stride = 3 * _NumberOfCellPoints;
+    for (vtkIdType cellId = re.begin(); cellId != re.end(); ++cellId) {
+      _Domain->GetCellPoints(cellId, ptIds.GetPointer());
+      BarycentricGradients(_Domain, ptIds->GetPointer(0), _NumberOfCellPoints,
+                           _Gradients + stride * cellId);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Simplicial cells of map domain with geometry precomputed for rasterization
+struct RasterCells
+{
+  int              _NumberOfCellPoints; ///< 3 for triangles, 4 for tetrahedra
+  Array<vtkIdType> _PtIds;              ///< Point IDs of each cell
+  Array<double>    _Origin;             ///< Image coordinates of first cell point
+  Array<double>    _Inverse;            ///< Inverse of matrix of cell edge vectors
+  Array<int>       _Bounds;             ///< Lattice index bounds [i1, i2, j1, j2]
+  Array<Array<int> > _BandCells;        ///< IDs of cells intersecting each band
+  bool             _RowBands;           ///< Whether bands are rows of a 2D lattice
+
+  /// Whether bands are lattice rows of a 2D lattice instead of slices
+  ///
+  /// Triangles and tetrahedra rasterized onto a single slice are split into
+  /// row bands, such that these are processed in parallel as well.
+  bool RowBands() const { return _RowBands; }
+};
+
+// -----------------------------------------------------------------------------
+/// Precompute geometry of simplicial cells in image coordinates
+///
+/// Triangles are only rasterized when all points of the domain mesh lie
+/// in the plane of the 2D lattice. The z coordinate is otherwise ignored,
+/// which would assign map values to lattice points outside the surface.
+///
+/// \returns Whether the cells of the map domain can be rasterized.
+bool InitializeRasterCells(RasterCells &cells, vtkDataSet *domain, const ImageAttributes &lattice)
+{
+  const int ncells = static_cast<int>(domain->GetNumberOfCells());
+  if (ncells == 0) return false;
+
+  const int type = domain->GetCellType(0);
+  if (type == VTK_TETRA) {
+    cells._NumberOfCellPoints = 4;
+  } else if (type == VTK_TRIANGLE && lattice._z == 1) {
+    cells._NumberOfCellPoints = 3;
+  } else {
+    return false;
+  }
+  for (int cellId = 1; cellId < ncells; ++cellId) {
+    if (domain->GetCellType(cellId) != type) return false;
+  }
+  const int npts = cells._NumberOfCellPoints;
+  const int dim  = npts - 1;
+
+  // Map domain points to image coordinates
+  const int npoints = static_cast<int>(domain->GetNumberOfPoints());
+  Array<double> x(3 * npoints);
+  double *p = x.data();
+  for (int ptId = 0; ptId < npoints; ++ptId, p += 3) {
+    domain->GetPoint(ptId, p);
+    lattice.WorldToLattice(p[0], p[1], p[2]);
+    if (dim == 2 && abs(p[2]) > 1e-6) return false;
+  }
+
+  // Precompute inverse of edge vector matrices and voxel bounding boxes
+  cells._PtIds  .resize(npts * ncells);
+  cells._Origin .resize(3    * ncells);
+  cells._Inverse.resize(9    * ncells, .0);
+  cells._Bounds .resize(6    * ncells);
+  cells._RowBands = (lattice._z == 1);
+  cells._BandCells.clear();
+  cells._BandCells.resize(cells._RowBands ? lattice._y : lattice._z);
+
+  vtkNew<vtkIdList> ptIds;
+  double m[9], bounds[6], *inv;
+  const double *a, *b;
+  int    *ijk;
+  for (int cellId = 0; cellId < ncells; ++cellId) {
+    domain->GetCellPoints(cellId, ptIds.GetPointer());
+    for (int i = 0; i < npts; ++i) {
+      cells._PtIds[npts * cellId + i] = ptIds->GetId(i);
+    }
+    a = x.data() + 3 * ptIds->GetId(0);
+    memcpy(cells._Origin.data() + 3 * cellId, a, 3 * sizeof(double));
+    bounds[0] = bounds[1] = a[0];
+    bounds[2] = bounds[3] = a[1];
+    bounds[4] = bounds[5] = a[2];
+    for (int i = 1; i < npts; ++i) {
+      b = x.data() + 3 * ptIds->GetId(i);
+      for (int d = 0; d < 3; ++d) {
+        bounds[2*d  ] = min(bounds[2*d  ], b[d]);
+        bounds[2*d+1] = max(bounds[2*d+1], b[d]);
+      }
+    }
+    inv = cells._Inverse.data() + 9 * cellId;
+    ijk = cells._Bounds .data() + 6 * cellId;
+    ijk[0] = max(0,               iceil (bounds[0] - 1e-6));
+    ijk[1] = min(lattice._x - 1,  ifloor(bounds[1] + 1e-6));
+    ijk[2] = max(0,               iceil (bounds[2] - 1e-6));
+    ijk[3] = min(lattice._y - 1,  ifloor(bounds[3] + 1e-6));
+    if (dim == 3) {
+      ijk[4] = max(0,             iceil (bounds[4] - 1e-6));
+      ijk[5] = min(lattice._z - 1, ifloor(bounds[5] + 1e-6));
+      for (int i = 0; i < 3; ++i) {
+        b = x.data() + 3 * ptIds->GetId(i + 1);
+        m[0 + i] = b[0] - a[0];
+        m[3 + i] = b[1] - a[1];
+        m[6 + i] = b[2] - a[2];
+      }
+      if (!SimplicialCellLocator::Invert3x3(m, inv)) continue;
+    } else {
+      ijk[4] = ijk[5] = 0;
+      const double *b1 = x.data() + 3 * ptIds->GetId(1);
+      const double *b2 = x.data() + 3 * ptIds->GetId(2);
+      m[0] = b1[0] - a[0], m[1] = b2[0] - a[0];
+      m[2] = b1[1] - a[1], m[3] = b2[1] - a[1];
+      const double det = m[0] * m[3] - m[1] * m[2];
+      if (abs(det) < 1e-12) continue;
+      inv[0] =  m[3] / det, inv[1] = -m[1] / det;
+      inv[2] = -m[2] / det, inv[3] =  m[0] / det;
+    }
+    if (ijk[0] > ijk[1] || ijk[2] > ijk[3] || ijk[4] > ijk[5]) continue;
+    if (cells._RowBands) {
+      for (int j = ijk[2]; j <= ijk[3]; ++j) {
+        cells._BandCells[j].push_back(cellId);
+      }
+    } else {
+      for (int k = ijk[4]; k <= ijk[5]; ++k) {
+        cells._BandCells[k].push_back(cellId);
+      }
+    }
+  }
+
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Range of value components of a field which are stored in consecutive
+/// frames of the output image of RasterizeMap
+struct RasterField
+{
+  vtkDataArray *_Values; ///< Values at domain mesh points
+  int           _l1;     ///< Index of first component
+  int           _l2;     ///< Index one past last component
+
+  /// Kernel which interpolates all components at once or \c nullptr
+  PiecewiseLinearMap::InterpolationKernel _Kernel;
+};
+
+// -----------------------------------------------------------------------------
+/// Rasterize simplicial cells of piecewise linear map band by band
+///
+/// A band is a slice of a 3D lattice or a row of a 2D lattice, such that
+/// triangles and tetrahedra rasterized onto a single slice are also processed
+/// in parallel. Each band is processed by one thread only such that no two
+/// threads write to the same voxel. The interpolation weights of a lattice
+/// point are computed once for all fields.
+template <class T>
+struct RasterizeMap
+{
+  const RasterCells        *_Cells;
+  const Array<RasterField> *_Fields;
+  vtkImageData             *_Mask;
+  GenericImage<T>          *_Output;
+  double                    _OutsideValue;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const double eps  = 1e-9;
+    const int    nx   = _Output->X();
+    const int    ny   = _Output->Y();
+    const int    nt   = _Output->T();
+    const int    nvox = _Output->NumberOfSpatialVoxels();
+    const int    npts = _Cells->_NumberOfCellPoints;
+
+    double    w[4], dx, dy, dz, value;
+    int       vox, t;
+    const int *ijk;
+    const double *a, *inv;
+    const vtkIdType *ptIds;
+    bool inside;
+
+    const unsigned char * const mask = (_Mask ? reinterpret_cast<const unsigned char *>(_Mask->GetScalarPointer()) : nullptr);
+    const Array<RasterField> &fields = *_Fields;
+    Array<DataArrayView> values;
+    values.reserve(fields.size());
+    int maxdim = 0;
+    for (size_t f = 0; f < fields.size(); ++f) {
+      values.push_back(DataArrayView(fields[f]._Values));
+      maxdim = max(maxdim, values.back().NumberOfComponents());
+    }
+    Array<double> tuple(maxdim);
+
+    T * const data = _Output->Data();
+    const bool rows = _Cells->RowBands();
+    for (int band = re.begin(); band != re.end(); ++band) {
+      const int k  = (rows ? 0    : band);
+      const int j1 = (rows ? band : 0);
+      const int j2 = (rows ? band : ny - 1);
+      // Initialize values of lattice points in this band
+      for (int j = j1; j <= j2; ++j)
+      for (int i = 0; i < nx; ++i) {
+        vox = i + nx * (j + ny * k);
+        if (mask && mask[vox] == 0) {
+          value = numeric_limits<T>::quiet_NaN();
+        } else {
+          value = _OutsideValue;
+        }
+        for (t = 0; t < nt; ++t) {
+          data[vox + t * nvox] = static_cast<T>(value);
+        }
+      }
+      // Interpolate values at lattice points inside each intersecting cell
+      const Array<int> &cellIds = _Cells->_BandCells[band];
+      for (size_t n = 0; n < cellIds.size(); ++n) {
+        const int cellId = cellIds[n];
+        ijk   = _Cells->_Bounds .data() + 6    * cellId;
+        a     = _Cells->_Origin .data() + 3    * cellId;
+        inv   = _Cells->_Inverse.data() + 9    * cellId;
+        ptIds = _Cells->_PtIds  .data() + npts * cellId;
+        dz    = k - a[2];
+        for (int j = max(ijk[2], j1); j <= min(ijk[3], j2); ++j)
+        for (int i = ijk[0]; i <= ijk[1]; ++i) {
+          dx = i - a[0];
+          dy = j - a[1];
+          if (npts == 4) {
+            w[1] = inv[0] * dx + inv[1] * dy + inv[2] * dz;
+            w[2] = inv[3] * dx + inv[4] * dy + inv[5] * dz;
+            w[3] = inv[6] * dx + inv[7] * dy + inv[8] * dz;
+            w[0] = 1.0 - w[1] - w[2] - w[3];
+          } else {
+            w[1] = inv[0] * dx + inv[1] * dy;
+            w[2] = inv[2] * dx + inv[3] * dy;
+            w[0] = 1.0 - w[1] - w[2];
+          }
+          inside = true;
+          for (int v = 0; v < npts; ++v) {
+            if (w[v] < -eps) {
+              inside = false;
+              break;
+            }
+          }
+          if (!inside) continue;
+          vox = i + nx * (j + ny * k);
+          if (mask && mask[vox] == 0) continue;
+          t = 0;
+          for (size_t f = 0; f < fields.size(); ++f) {
+            if (fields[f]._Kernel) {
+              fields[f]._Kernel(values[f], ptIds, npts, w, tuple.data());
+              for (int l = fields[f]._l1; l < fields[f]._l2; ++l, ++t) {
+                data[vox + t * nvox] = static_cast<T>(tuple[l]);
+              }
+            } else {
+              for (int l = fields[f]._l1; l < fields[f]._l2; ++l, ++t) {
+                value = .0;
+                for (int v = 0; v < npts; ++v) {
+                  value += w[v] * values[f].Get(ptIds[v], l);
+                }
+                data[vox + t * nvox] = static_cast<T>(value);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Interpolate fields at lattice points by rasterizing the cells of a mesh
+///
+/// \param[in]  domain  Simplicial mesh, i.e., map domain or codomain.
+/// \param[in]  outside Value of lattice points outside the mesh.
+/// \param[in]  fields  Fields with values at the mesh points.
+/// \param[out] f       Output image whose frames are the field components.
+/// \param[in]  m       Piecewise linear complex (PLC) defining ROI or \c nullptr.
+///
+/// \returns Whether the mesh could be rasterized onto the lattice.
+template <class T>
+bool RasterizeFields(vtkDataSet *domain, double outside, const Array<RasterField> &fields,
+                     GenericImage<T> &f, vtkSmartPointer<vtkPointSet> m)
+{
+  ImageAttributes lattice = f.Attributes();
+  lattice._dt = .0;
+
+  RasterCells cells;
+  if (!InitializeRasterCells(cells, domain, lattice)) return false;
+
+  vtkSmartPointer<vtkImageData> mask;
+  if (m) {
+    mask = NewVtkMask(lattice._x, lattice._y, lattice._z);
+    ImageStencilToMask(ImageStencil(mask, WorldToImage(m, &f)), mask);
+  }
+
+  RasterizeMap<T> raster;
+  raster._Cells        = &cells;
+  raster._Fields       = &fields;
+  raster._Mask         = mask;
+  raster._Output       = &f;
+  raster._OutsideValue = outside;
+  parallel_for(blocked_range<int>(0, static_cast<int>(cells._BandCells.size())), raster);
+
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate piecewise linear map at lattice points by rasterizing its cells
+///
+/// \returns Whether the map domain could be rasterized onto the lattice.
+template <class T>
+bool Rasterize(const PiecewiseLinearMap *map, GenericImage<T> &f, int l,
+               vtkSmartPointer<vtkPointSet> m)
+{
+  const int nt = max(f.T(), 1);
+  if (l >= map->NumberOfComponents() || l + nt > map->NumberOfComponents()) {
+    cerr << map->NameOfType() << "::Evaluate: Component index out of range" << endl;
+    exit(1);
+  }
+  Array<RasterField> fields(1);
+  fields[0]._Values = map->Values();
+  fields[0]._l1     = l;
+  fields[0]._l2     = l + nt;
+  fields[0]._Kernel = (nt > 1 && nt == map->NumberOfComponents() ? map->Kernel() : nullptr);
+  return RasterizeFields(map->Domain(), map->OutsideValue(), fields, f, m);
+}
+
+// -----------------------------------------------------------------------------
+/// Evaluate multiple fields of piecewise linear map at lattice points
+template <class T>
+void EvaluateFieldsOnLattice(const PiecewiseLinearMap *map, int nfields, const int *fields,
+                             GenericImage<T> &f, vtkSmartPointer<vtkPointSet> m)
+{
+  if (map->NumberOfFieldComponents(nfields, fields) != f.T()) {
+    cerr << map->NameOfType() << "::EvaluateFields: Number of output frames must equal number of field components" << endl;
+    exit(1);
+  }
+  Array<RasterField> raster_fields(nfields);
+  for (int i = 0; i < nfields; ++i) {
+    raster_fields[i]._Values = map->Field(fields[i]);
+    raster_fields[i]._l1     = 0;
+    raster_fields[i]._l2     = map->Field(fields[i])->GetNumberOfComponents();
+    raster_fields[i]._Kernel = (fields[i] == 0 ? map->Kernel() : nullptr);
+  }
+  if (RasterizeFields(map->Domain(), map->OutsideValue(), raster_fields, f, m)) return;
+
+  vtkSmartPointer<vtkImageData> mask;
+  if (m) {
+    mask = NewVtkMask(f.X(), f.Y(), f.Z());
+    ImageStencilToMask(ImageStencil(mask, WorldToImage(m, &f)), mask);
+  }
+  EvaluateFieldsAtLattice<T> eval;
+  eval._Map            = map;
+  eval._NumberOfFields = nfields;
+  eval._Fields         = fields;
+  eval._Mask           = (mask ? reinterpret_cast<const unsigned char *>(mask->GetScalarPointer()) : nullptr);
+  eval._Output         = &f;
+  parallel_for(blocked_range<int>(0, f.Z()), eval);
+}
+
+// -----------------------------------------------------------------------------
+/// Bake values at domain mesh points into an image of the map codomain
+template <class T>
+bool BakeValues(const PiecewiseLinearMap *map, GenericImage<T> &f, vtkDataArray *values)
+{
+  vtkPointSet * const domain = vtkPointSet::SafeDownCast(map->Domain());
+  if (domain == nullptr || domain->GetNumberOfCells() == 0) return false;
+  // Triangles are only rasterized onto a 2D lattice
+  if (domain->GetCellType(0) == VTK_TRIANGLE && map->NumberOfComponents() != 2) {
+    return false;
+  }
+  vtkSmartPointer<vtkDataSet> codomain = map->Codomain();
+  if (codomain == nullptr) return false;
+  if (values == nullptr) values = domain->GetPoints()->GetData();
+  if (values->GetNumberOfTuples() != domain->GetNumberOfPoints()) {
+    cerr << map->NameOfType() << "::Bake: Number of values must equal number of domain points" << endl;
+    exit(1);
+  }
+  if (values->GetNumberOfComponents() != f.T()) {
+    cerr << map->NameOfType() << "::Bake: Number of output frames must equal number of value components" << endl;
+    exit(1);
+  }
+  Array<RasterField> fields(1);
+  fields[0]._Values = values;
+  fields[0]._l1     = 0;
+  fields[0]._l2     = f.T();
+  fields[0]._Kernel = SelectKernel(codomain, values);
+  return RasterizeFields(codomain, map->OutsideValue(), fields, f, nullptr);
+}
+
+
+// -----------------------------------------------------------------------------
+/// Header of native binary map file
+///
+/// The header is followed by data blocks, each aligned to BinaryAlignment
+/// bytes relative to the start of the file: point coordinates (double, or
+/// float when BinaryFloatPoints is set), cell types (int32, unstructured grid
+/// only), cell connectivity in VTK legacy layout (int64, or int32 when
+/// BinaryInt32Ids is set), map values, and optionally the serialized simplicial
+/// cell locator and the table of cell face neighbors (same ID type as the
+/// connectivity). All values are stored in native byte order, which is
+/// recorded by the _ByteOrder mark. Version 1 files have neither flag set.
+///
+/// When BinaryDeltaCells is set, the cell connectivity block is instead split
+/// into chunks of BinaryChunkSize cells, whose numbers of cell points and
+/// differences of consecutive point IDs are stored as zigzag encoded variable
+/// length integers; see WriteDeltaCells. When
+/// BinaryQuantizedValues is set, the map values block consists of an offset
+/// and scale per component (double) followed by the values as 16-bit fixed
+/// point numbers (uint16). Version 2 files have neither of these flags set.
+/// The IDs of the cell locator are stored as int64 since version 4, and as
+/// vtkIdType before, so that an older locator block is only read when the
+/// size of vtkIdType is 64 bits.
+struct BinaryHeader
+{
+  char    _Magic[8];           ///< File type identifier
+  int32_t _Version;            ///< File format version
+  int32_t _ByteOrder;          ///< Byte order mark, i.e., 0x01020304
+  int32_t _DataSetType;        ///< VTK_POLY_DATA or VTK_UNSTRUCTURED_GRID
+  int32_t _ValueType;          ///< VTK_FLOAT or VTK_DOUBLE
+  int32_t _NumberOfComponents; ///< Number of map value components
+  int32_t _Flags;              ///< Optional blocks and compact storage types
+  int64_t _NumberOfPoints;     ///< Number of domain mesh points
+  int64_t _NumberOfCells;      ///< Number of domain mesh cells
+  int64_t _ConnectivitySize;   ///< Length of cell connectivity array
+  int32_t _NumberOfCellFaces;  ///< Number of face neighbors per cell
+  int32_t _Reserved;           ///< Unused
+};
+
+const char    BinaryMagic[8]  = { 'M', 'I', 'R', 'T', 'K', 'P', 'L', 'M' };
+const int32_t BinaryVersion         = 4;
+const int32_t BinaryByteOrder       = 0x01020304;
+const int32_t BinaryLocator         = 1;
+const int32_t BinaryNeighbors       = 2;
+const int32_t BinaryFloatPoints     = 4;
+const int32_t BinaryInt32Ids        = 8;
+const int32_t BinaryDeltaCells      = 16;
+const int32_t BinaryQuantizedValues = 32;
+const int     BinaryAlignment       = 64;
+const int64_t BinaryChunkSize       = 16384;
+const double  BinaryQuantizedMax    = 65535.;
+
+// -----------------------------------------------------------------------------
+/// Write zero bytes up to the next aligned file position
+inline void WritePadding(std::ostream &os)
+{
+  const char zero[BinaryAlignment] = {0};
+  const long pos = static_cast<long>(os.tellp());
+  const long pad = (BinaryAlignment - pos % BinaryAlignment) % BinaryAlignment;
+  if (pad > 0) os.write(zero, pad);
+}
+
+// -----------------------------------------------------------------------------
+/// Skip padding bytes up to the next aligned file position
+inline void SkipPadding(std::istream &is)
+{
+  const long pos = static_cast<long>(is.tellg());
+  const long pad = (BinaryAlignment - pos % BinaryAlignment) % BinaryAlignment;
+  if (pad > 0) is.seekg(pad, std::ios::cur);
+}
+
+// -----------------------------------------------------------------------------
+/// Read block of IDs stored either as int32 or int64 values
+inline void ReadIds(std::istream &is, bool int32, size_t n, Array<int64_t> &ids)
+{
+  ids.resize(n);
+  if (int32) {
+    Array<int32_t> buffer(n);
+    is.read(reinterpret_cast<char *>(buffer.data()), n * sizeof(int32_t));
+    for (size_t i = 0; i < n; ++i) ids[i] = static_cast<int64_t>(buffer[i]);
+  } else {
+    is.read(reinterpret_cast<char *>(ids.data()), n * sizeof(int64_t));
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Write block of IDs either as int32 or int64 values
+inline void WriteIds(std::ostream &os, bool int32, const Array<int64_t> &ids)
+{
+  if (int32) {
+    Array<int32_t> buffer(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) buffer[i] = static_cast<int32_t>(ids[i]);
+    os.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(int32_t));
+  } else {
+    os.write(reinterpret_cast<const char *>(ids.data()), ids.size() * sizeof(int64_t));
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Append zigzag encoded variable length integer to byte sequence
+inline void EncodeVarint(int64_t value, Array<uint8_t> &bytes)
+{
+  uint64_t u = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+  while (u >= 0x80) {
+    bytes.push_back(static_cast<uint8_t>(u | 0x80));
+    u >>= 7;
+  }
+  bytes.push_back(static_cast<uint8_t>(u));
+}
+
+// -----------------------------------------------------------------------------
+/// Decode zigzag encoded variable length integer and advance byte pointer
+///
+/// \returns Whether a complete integer was read before the end of the bytes.
+inline bool DecodeVarint(const uint8_t *&p, const uint8_t *end, int64_t &value)
+{
+  uint64_t u = 0;
+  for (int shift = 0; p != end && shift < 64; shift += 7) {
+    const uint8_t b = *p++;
+    u |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      value = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+/// Delta code the cells of each chunk of cell connectivity in VTK legacy layout
+struct EncodeCellChunks
+{
+  const int64_t  *_Connectivity; ///< Cell connectivity in VTK legacy layout
+  const int64_t  *_Offsets;      ///< Offset of first cell of each chunk in connectivity
+  Array<uint8_t> *_Chunks;       ///< Encoded bytes of each chunk
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int c = re.begin(); c != re.end(); ++c) {
+      Array<uint8_t> &bytes = _Chunks[c];
+      int64_t prev = 0;
+      for (int64_t pos = _Offsets[c]; pos < _Offsets[c+1];) {
+        const int64_t n = _Connectivity[pos++];
+        EncodeVarint(n, bytes);
+        for (int64_t i = 0; i < n; ++i, ++pos) {
+          EncodeVarint(_Connectivity[pos] - prev, bytes);
+          prev = _Connectivity[pos];
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Decode delta coded chunks of cell connectivity in VTK legacy layout
+struct DecodeCellChunks
+{
+  const uint8_t *_Bytes;        ///< Encoded bytes of all chunks
+  const int64_t *_ByteOffsets;  ///< Offset of each chunk in encoded bytes
+  const int64_t *_Offsets;      ///< Offset of first cell of each chunk in connectivity
+  int64_t        _NumberOfIds;  ///< Number of points, i.e., upper bound of point IDs
+  vtkIdType     *_Connectivity; ///< Decoded cell connectivity
+  char          *_Valid;        ///< Whether each chunk was decoded successfully
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    int64_t id = 0, n = 0;
+    for (int c = re.begin(); c != re.end(); ++c) {
+      const uint8_t *p   = _Bytes + _ByteOffsets[c];
+      const uint8_t *end = _Bytes + _ByteOffsets[c+1];
+      const int64_t  last = _Offsets[c+1];
+      int64_t pos = _Offsets[c], prev = 0;
+      bool    ok  = true;
+      while (ok && pos < last) {
+        ok = (DecodeVarint(p, end, n) && n >= 0 && pos + n < last);
+        if (ok) _Connectivity[pos++] = static_cast<vtkIdType>(n);
+        for (int64_t i = 0; ok && i < n; ++i, ++pos) {
+          ok = DecodeVarint(p, end, id);
+          id += prev;
+          ok = ok && id >= 0 && id < _NumberOfIds;
+          _Connectivity[pos] = static_cast<vtkIdType>(id);
+          prev = id;
+        }
+      }
+      _Valid[c] = (ok && p == end ? 1 : 0);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Write delta coded cell connectivity
+///
+/// The block consists of the number of chunks (int64), the offsets of the
+/// first cell of each chunk and of the end of the connectivity in VTK legacy
+/// layout (int64), the offsets of the encoded bytes of each chunk and of their
+/// end (int64), and the encoded bytes of all chunks. Chunks are encoded and
+/// decoded in parallel.
+void WriteDeltaCells(std::ostream &os, const Array<int64_t> &conn, int64_t ncells)
+{
+  const int64_t nchunks = (ncells + BinaryChunkSize - 1) / BinaryChunkSize;
+  Array<int64_t> offsets(nchunks + 1), bytes(nchunks + 1, 0);
+  int64_t pos = 0;
+  for (int64_t cellId = 0; cellId < ncells; ++cellId) {
+    if (cellId % BinaryChunkSize == 0) offsets[cellId / BinaryChunkSize] = pos;
+    pos += conn[pos] + 1;
+  }
+  offsets[nchunks] = pos;
+
+  Array<Array<uint8_t> > chunks(nchunks);
+  EncodeCellChunks encode;
+  encode._Connectivity = conn.data();
+  encode._Offsets      = offsets.data();
+  encode._Chunks       = chunks.data();
+  parallel_for(blocked_range<int>(0, static_cast<int>(nchunks), 1), encode);
+  for (int64_t c = 0; c < nchunks; ++c) {
+    bytes[c+1] = bytes[c] + static_cast<int64_t>(chunks[c].size());
+  }
+
+  os.write(reinterpret_cast<const char *>(&nchunks), sizeof(int64_t));
+  os.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(int64_t));
+  os.write(reinterpret_cast<const char *>(bytes  .data()), bytes  .size() * sizeof(int64_t));
+  WritePadding(os);
+  for (int64_t c = 0; c < nchunks; ++c) {
+    os.write(reinterpret_cast<const char *>(chunks[c].data()), chunks[c].size());
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Read delta coded cell connectivity written by WriteDeltaCells
+///
+/// \returns Whether the block is valid and was decoded successfully.
+bool ReadDeltaCells(std::istream &is, int64_t ncells, int64_t npoints, vtkIdTypeArray *conn)
+{
+  const int64_t nconn = static_cast<int64_t>(conn->GetNumberOfTuples());
+  int64_t nchunks = 0;
+  is.read(reinterpret_cast<char *>(&nchunks), sizeof(int64_t));
+  if (is.fail() || nchunks != (ncells + BinaryChunkSize - 1) / BinaryChunkSize) return false;
+  Array<int64_t> offsets(nchunks + 1), bytes(nchunks + 1);
+  is.read(reinterpret_cast<char *>(offsets.data()), offsets.size() * sizeof(int64_t));
+  is.read(reinterpret_cast<char *>(bytes  .data()), bytes  .size() * sizeof(int64_t));
+  if (is.fail() || offsets[0] != 0 || bytes[0] != 0 || offsets[nchunks] != nconn) return false;
+  for (int64_t c = 0; c < nchunks; ++c) {
+    if (offsets[c+1] < offsets[c] || bytes[c+1] < bytes[c]) return false;
+  }
+
+  Array<uint8_t> buffer(static_cast<size_t>(bytes[nchunks]));
+  SkipPadding(is);
+  is.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+  if (is.fail()) return false;
+
+  Array<char> valid(nchunks, 0);
+  DecodeCellChunks decode;
+  decode._Bytes        = buffer.data();
+  decode._ByteOffsets  = bytes.data();
+  decode._Offsets      = offsets.data();
+  decode._NumberOfIds  = npoints;
+  decode._Connectivity = conn->GetPointer(0);
+  decode._Valid        = valid.data();
+  parallel_for(blocked_range<int>(0, static_cast<int>(nchunks), 1), decode);
+  for (int64_t c = 0; c < nchunks; ++c) {
+    if (!valid[c]) return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Quantize map values to 16-bit fixed point numbers
+struct QuantizeValues
+{
+  const DataArrayView *_Values;         ///< Map values
+  const double        *_Offset;         ///< Offset of each component
+  const double        *_Scale;          ///< Scale of each component
+  uint16_t            *_Output;         ///< Quantized map values
+  int                  _NumberOfComponents;
+
+  void operator ()(const blocked_range<vtkIdType> &re) const
+  {
+    double q;
+    uint16_t *out = _Output + re.begin() * _NumberOfComponents;
+    for (vtkIdType i = re.begin(); i != re.end(); ++i)
+    for (int j = 0; j < _NumberOfComponents; ++j, ++out) {
+      q = (_Scale[j] > .0 ? (_Values->Get(i, j) - _Offset[j]) / _Scale[j] : .0);
+      if (IsNaN(q)) q = .0;
+      *out = static_cast<uint16_t>(iround(max(.0, min(q, BinaryQuantizedMax))));
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Decode map values from 16-bit fixed point numbers
+struct DequantizeValues
+{
+  const uint16_t      *_Input;          ///< Quantized map values
+  const double        *_Offset;         ///< Offset of each component
+  const double        *_Scale;          ///< Scale of each component
+  const DataArrayView *_Values;         ///< Decoded map values
+  int                  _NumberOfComponents;
+
+  void operator ()(const blocked_range<vtkIdType> &re) const
+  {
+    const uint16_t *in = _Input + re.begin() * _NumberOfComponents;
+    for (vtkIdType i = re.begin(); i != re.end(); ++i)
+    for (int j = 0; j < _NumberOfComponents; ++j, ++in) {
+      _Values->Set(i, j, _Offset[j] + _Scale[j] * static_cast<double>(*in));
+    }
+  }
+};
+
+#if VTK_MAJOR_VERSION >= 9
+
+// -----------------------------------------------------------------------------
+/// Copy of cell array with 32-bit offsets and connectivity when all IDs fit,
+/// otherwise the cell array itself
+vtkSmartPointer<vtkCellArray> CompactCellArray(vtkCellArray *cells)
+{
+  if (cells == nullptr || !cells->IsStorage64Bit() || !cells->CanConvertTo32BitStorage()) {
+    return cells;
+  }
+  vtkSmartPointer<vtkCellArray> compact = vtkSmartPointer<vtkCellArray>::New();
+  compact->DeepCopy(cells);
+  compact->ConvertTo32BitStorage();
+  return compact;
+}
+
+#endif // VTK_MAJOR_VERSION >= 9
+
+
+} // namespace PiecewiseLinearMapUtils
+using namespace PiecewiseLinearMapUtils;
+
 // =============================================================================
 // Construction/Destruction
 // =============================================================================
 
-const double PiecewiseLinearMap::_Tolerance2 = 1e-9;
+const double PiecewiseLinearMap::_Tolerance2 = 1e-9;
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::CopyAttributes(const PiecewiseLinearMap &other)
+{
+  _Domain                   = other._Domain;
+  _DomainRefs               = other._DomainRefs;
+  _Values                   = other._Values;
+  _Fields                   = other._Fields;
+  _ValuesRefs               = other._ValuesRefs;
+  _Locators                 = other._Locators;
+  _MaxCellSize              = other._MaxCellSize;
+  _Kernel                   = other._Kernel;
+  _MaximumNumberOfWalkSteps = other._MaximumNumberOfWalkSteps;
+  _InverseMap               = other._InverseMap;
+  _NumberOfCellGradients    = other._NumberOfCellGradients;
+  _CellGradients            = other._CellGradients;
+}
+
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap::PiecewiseLinearMap()
+:
+  _MaxCellSize(0),
+  _Kernel(&InterpolateValues),
+  _MaximumNumberOfWalkSteps(32),
+  _NumberOfCellGradients(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap::PiecewiseLinearMap(const PiecewiseLinearMap &other)
+:
+  Mapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap &PiecewiseLinearMap::operator =(const PiecewiseLinearMap &other)
+{
+  if (this != &other) {
+    Mapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Initialize()
+{
+  // Check input mesh
+  if (!_Domain) {
+    cerr << this->NameOfType() << "::Initialize: No domain mesh is set" << endl;
+    exit(1);
+  }
+  if (_Domain->GetNumberOfCells() == 0) {
+    cerr << this->NameOfType() << "::Initialize: Domain mesh has no cells" << endl;
+    exit(1);
+  }
+  if (!_Values) {
+    cerr << this->NameOfType() << "::Initialize: No discrete map values at domain mesh points is set!" << endl;
+    exit(1);
+  }
+  for (size_t i = 0; i < _Fields.size(); ++i) {
+    if (_Fields[i]->GetNumberOfTuples() != _Domain->GetNumberOfPoints()) {
+      cerr << this->NameOfType() << "::Initialize: Number of values of field "
+           << _Fields[i]->GetName() << " differs from number of domain mesh points" << endl;
+      exit(1);
+    }
+  }
+  // Determine maximum number of cell points
+  _MaxCellSize = _Domain->GetMaxCellSize();
+
+  // Select interpolation kernel for cell type and map values
+  _Kernel = SelectKernel(_Domain, _Values);
+
+  // Cell locator is built on demand by first evaluation
+  _Locators = NewShared<CellLocators>();
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::BuildLocators() const
+{
+  if (!_Locators) {
+    cerr << this->NameOfType() << "::BuildLocators: Map not initialized" << endl;
+    exit(1);
+  }
+  CellLocators &locators = *_Locators;
+  if (locators._Built.load(std::memory_order_acquire)) return;
+  std::lock_guard<std::mutex> lock(locators._Mutex);
+  if (!locators._Built.load(std::memory_order_relaxed)) {
+    InitializeLocators(locators);
+    locators._Built.store(true, std::memory_order_release);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::InitializeLocators(CellLocators &locators) const
+{
+  MIRTK_START_TIMING();
+
+  // Build cell locator
+  locators._Locator = nullptr;
+  locators._SimplicialLocator = NewShared<SimplicialCellLocator>();
+  if (locators._SimplicialLocator->Build(_Domain)) {
+    if (verbose > 1) {
+      cout << this->NameOfType() << "::BuildLocators: Size of simplicial cell locator = "
+           << static_cast<double>(locators._SimplicialLocator->MemorySize()) / 1048576.0 << " MB" << endl;
+    }
+  } else {
+    locators._SimplicialLocator = nullptr;
+    locators._Locator = vtkSmartPointer<vtkCellLocator>::New();
+    locators._Locator->SetDataSet(_Domain);
+    locators._Locator->BuildLocator();
+  }
+
+  // Determine face neighbors used to walk from cell to cell
+  InitializeCellNeighbors(locators);
+
+  MIRTK_DEBUG_TIMING(2, "building cell locator of piecewise linear map");
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::InitializeCellNeighbors(CellLocators &locators) const
+{
+  locators._NumberOfCellFaces = 0;
+  locators._CellNeighbors.clear();
+
+  if (_MaximumNumberOfWalkSteps <= 0) return;
+
+  // Mesh walk only implemented for triangular and tetrahedral meshes
+  const vtkIdType ncells = _Domain->GetNumberOfCells();
+  const int       type   = _Domain->GetCellType(0);
+  if (type != VTK_TRIANGLE && type != VTK_TETRA) return;
+  for (vtkIdType cellId = 1; cellId < ncells; ++cellId) {
+    if (_Domain->GetCellType(cellId) != type) return;
+  }
+  const int nfaces = (type == VTK_TETRA ? 4 : 3);
+
+  // Collect faces of all cells, where face i is opposite to the i-th point
+  Array<CellFace> faces;
+  faces.reserve(static_cast<size_t>(nfaces * ncells));
+  vtkNew<vtkIdList> ptIds;
+  CellFace face;
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    _Domain->GetCellPoints(cellId, ptIds.GetPointer());
+    for (int i = 0; i < nfaces; ++i) {
+      face._PtIds[2] = -1;
+      for (int j = 1, k = 0; j < nfaces; ++j, ++k) {
+        face._PtIds[k] = ptIds->GetId((i + j) % nfaces);
+      }
+      sort(face._PtIds, face._PtIds + nfaces - 1);
+      face._Index = nfaces * cellId + i;
+      faces.push_back(face);
+    }
+  }
+  sort(faces.begin(), faces.end());
+
+  // Faces shared by two cells are adjacent after sorting
+  Array<vtkIdType> &neighbors = locators._CellNeighbors;
+  neighbors.assign(faces.size(), -1);
+  for (size_t n = 1; n < faces.size(); ++n) {
+    if (faces[n] == faces[n-1]) {
+      neighbors[faces[n-1]._Index] = faces[n  ]._Index / nfaces;
+      neighbors[faces[n  ]._Index] = faces[n-1]._Index / nfaces;
+    }
+  }
+  locators._NumberOfCellFaces = nfaces;
+}
+
+// -----------------------------------------------------------------------------
+Mapping *PiecewiseLinearMap::NewCopy() const
+{
+  return new PiecewiseLinearMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Compact()
+{
+  // Single precision map values
+  if (_Values && _Values->GetDataType() != VTK_FLOAT) {
+    vtkSmartPointer<vtkDataArray> values = vtkSmartPointer<vtkFloatArray>::New();
+    values->DeepCopy(_Values);
+    values->SetName(_Values->GetName());
+    this->Values(values);
+  }
+  for (size_t i = 0; i < _Fields.size(); ++i) {
+    if (_Fields[i]->GetDataType() != VTK_FLOAT) {
+      vtkSmartPointer<vtkDataArray> values = vtkSmartPointer<vtkFloatArray>::New();
+      values->DeepCopy(_Fields[i]);
+      values->SetName(_Fields[i]->GetName());
+      _Fields[i] = values;
+    }
+  }
+
+  // Domain mesh with single precision points and 32-bit cell connectivity,
+  // which shares all other data with the previous domain mesh
+  vtkPointSet * const pointset = vtkPointSet::SafeDownCast(_Domain);
+  if (pointset == nullptr || pointset->GetPoints() == nullptr) return;
+
+  vtkSmartPointer<vtkPointSet> domain;
+  domain.TakeReference(pointset->NewInstance());
+  domain->ShallowCopy(pointset);
+  if (pointset->GetPoints()->GetDataType() != VTK_FLOAT) {
+    vtkNew<vtkPoints> points;
+    points->SetDataTypeToFloat();
+    points->GetData()->DeepCopy(pointset->GetPoints()->GetData());
+    domain->SetPoints(points.GetPointer());
+  }
+  #if VTK_MAJOR_VERSION >= 9
+    vtkPolyData         * const surface = vtkPolyData        ::SafeDownCast(domain);
+    vtkUnstructuredGrid * const grid    = vtkUnstructuredGrid::SafeDownCast(domain);
+    if (surface) {
+      surface->SetVerts (CompactCellArray(surface->GetVerts ()));
+      surface->SetLines (CompactCellArray(surface->GetLines ()));
+      surface->SetPolys (CompactCellArray(surface->GetPolys ()));
+      surface->SetStrips(CompactCellArray(surface->GetStrips()));
+    } else if (grid && grid->GetCells()) {
+      vtkSmartPointer<vtkCellArray> cells = CompactCellArray(grid->GetCells());
+      if (cells != grid->GetCells()) {
+        grid->SetCells(grid->GetCellTypesArray(), cells);
+      }
+    }
+  #endif
+  this->Domain(domain);
+}
+
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap::~PiecewiseLinearMap()
+{
+}
+
+// =============================================================================
+// Input domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Domain(vtkDataSet *domain)
+{
+  _Domain                = domain;
+  _DomainRefs            = NewShared<int>(0);
+  _NumberOfCellGradients = 0;
+  _CellGradients         = nullptr;
+}
+
+// -----------------------------------------------------------------------------
+vtkDataSet *PiecewiseLinearMap::MutableDomain()
+{
+  if (_Domain && _DomainRefs.use_count() > 1) {
+    vtkSmartPointer<vtkDataSet> domain;
+    domain.TakeReference(_Domain->NewInstance());
+    domain->DeepCopy(_Domain);
+    this->Domain(domain);
+  }
+  _NumberOfCellGradients = 0;
+  _CellGradients         = nullptr;
+  return _Domain;
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::BoundingBox(double &x1, double &y1, double &z1,
+                                     double &x2, double &y2, double &z2) const
+{
+  if (_Domain) {
+    double bounds[6];
+    _Domain->GetBounds(bounds);
+    x1 = bounds[0], x2 = bounds[1];
+    y1 = bounds[2], y2 = bounds[3];
+    z1 = bounds[4], z2 = bounds[5];
+  } else {
+    x1 = x2 = y1 = y2 = z1 = z2 = .0;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::MarkDomainBricks(const ImageAttributes &lattice, int n,
+                                          Array<bool> &occupied) const
+{
+  const int nbx = (lattice._x + n - 1) / n;
+  const int nby = (lattice._y + n - 1) / n;
+  const int nbz = (lattice._z + n - 1) / n;
+  occupied.assign(nbx * nby * nbz, false);
+  if (!_Domain) return;
+
+  // Map domain points to lattice coordinates
+  const int npoints = static_cast<int>(_Domain->GetNumberOfPoints());
+  Array<double> x(3 * npoints);
+  double *p = x.data();
+  for (int ptId = 0; ptId < npoints; ++ptId, p += 3) {
+    _Domain->GetPoint(ptId, p);
+    lattice.WorldToLattice(p[0], p[1], p[2]);
+  }
+
+  // Point location tolerance in lattice units, plus a safety margin
+  double ds = numeric_limits<double>::infinity();
+  if (lattice._dx > .0) ds = min(ds, lattice._dx);
+  if (lattice._dy > .0) ds = min(ds, lattice._dy);
+  if (lattice._dz > .0) ds = min(ds, lattice._dz);
+  const double margin = (IsInf(ds) ? .0 : sqrt(_Tolerance2) / ds) + 1e-6;
+
+  // Mark bricks intersecting the lattice bounding box of each cell
+  vtkNew<vtkIdList> ptIds;
+  double bounds[6];
+  const double *b;
+  int ijk[6];
+  for (vtkIdType cellId = 0; cellId < _Domain->GetNumberOfCells(); ++cellId) {
+    _Domain->GetCellPoints(cellId, ptIds.GetPointer());
+    if (ptIds->GetNumberOfIds() == 0) continue;
+    b = x.data() + 3 * ptIds->GetId(0);
+    bounds[0] = bounds[1] = b[0];
+    bounds[2] = bounds[3] = b[1];
+    bounds[4] = bounds[5] = b[2];
+    for (vtkIdType i = 1; i < ptIds->GetNumberOfIds(); ++i) {
+      b = x.data() + 3 * ptIds->GetId(i);
+      for (int d = 0; d < 3; ++d) {
+        bounds[2*d  ] = min(bounds[2*d  ], b[d]);
+        bounds[2*d+1] = max(bounds[2*d+1], b[d]);
+      }
+    }
+    ijk[0] = max(0,              iceil (bounds[0] - margin));
+    ijk[1] = min(lattice._x - 1, ifloor(bounds[1] + margin));
+    ijk[2] = max(0,              iceil (bounds[2] - margin));
+    ijk[3] = min(lattice._y - 1, ifloor(bounds[3] + margin));
+    ijk[4] = max(0,              iceil (bounds[4] - margin));
+    ijk[5] = min(lattice._z - 1, ifloor(bounds[5] + margin));
+    if (ijk[0] > ijk[1] || ijk[2] > ijk[3] || ijk[4] > ijk[5]) continue;
+    for (int bk = ijk[4] / n; bk <= ijk[5] / n; ++bk)
+    for (int bj = ijk[2] / n; bj <= ijk[3] / n; ++bj)
+    for (int bi = ijk[0] / n; bi <= ijk[1] / n; ++bi) {
+      occupied[bi + nbx * (bj + nby * bk)] = true;
+    }
+  }
+}
+
+// =============================================================================
+// Map codomain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int PiecewiseLinearMap::NumberOfComponents() const
+{
+  return _Values ? static_cast<int>(_Values->GetNumberOfComponents()) : 0;
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Values(vtkDataArray *values)
+{
+  _Values     = values;
+  _ValuesRefs = NewShared<int>(0);
+}
+
+// -----------------------------------------------------------------------------
+vtkDataArray *PiecewiseLinearMap::MutableValues()
+{
+  if (_Values && _ValuesRefs.use_count() > 1) {
+    vtkSmartPointer<vtkDataArray> values;
+    values.TakeReference(_Values->NewInstance());
+    values->DeepCopy(_Values);
+    this->Values(values);
+  }
+  return _Values;
+}
+
+// -----------------------------------------------------------------------------
+vtkSmartPointer<vtkDataSet> PiecewiseLinearMap::Codomain() const
+{
+  const int dim = this->NumberOfComponents();
+  vtkPointSet *domain = vtkPointSet::SafeDownCast(_Domain);
+  if (domain == nullptr || dim < 2 || dim > 3) return nullptr;
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  if (dim == 3 && (_Values->GetDataType() == VTK_FLOAT || _Values->GetDataType() == VTK_DOUBLE)) {
+    // Copy contiguous map values at once
+    vtkSmartPointer<vtkDataArray> coords;
+    coords.TakeReference(_Values->NewInstance());
+    coords->DeepCopy(_Values);
+    coords->SetName(nullptr);
+    points->SetData(coords);
+  } else {
+    double p[3] = {.0};
+    points->SetNumberOfPoints(domain->GetNumberOfPoints());
+    for (vtkIdType ptId = 0; ptId < domain->GetNumberOfPoints(); ++ptId) {
+      _Values->GetTuple(ptId, p);
+      points->SetPoint(ptId, p);
+    }
+  }
+  vtkSmartPointer<vtkPointSet> codomain;
+  codomain.TakeReference(domain->NewInstance());
+  codomain->ShallowCopy(domain);
+  codomain->SetPoints(points);
+  codomain->GetPointData()->Initialize();
+  codomain->GetCellData()->Initialize();
+  return codomain;
+}
+
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap *PiecewiseLinearMap::Inverse() const
+{
+  vtkSmartPointer<vtkDataSet> codomain = this->Codomain();
+  if (codomain == nullptr) return nullptr;
+  vtkSmartPointer<vtkDataArray> values;
+  values.TakeReference(vtkPointSet::SafeDownCast(_Domain)->GetPoints()->GetData()->NewInstance());
+  values->DeepCopy(vtkPointSet::SafeDownCast(_Domain)->GetPoints()->GetData());
+  values->SetName("InverseMap");
+  PiecewiseLinearMap *inv = new PiecewiseLinearMap();
+  inv->OutsideValue(_OutsideValue);
+  inv->MaximumNumberOfWalkSteps(_MaximumNumberOfWalkSteps);
+  inv->Domain(codomain);
+  inv->Values(values);
+  inv->Initialize();
+  return inv;
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::Bake(GenericImage<float> &f, vtkDataArray *values) const
+{
+  return BakeValues(this, f, values);
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::Bake(GenericImage<double> &f, vtkDataArray *values) const
+{
+  return BakeValues(this, f, values);
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::InitializeContext(EvaluationContext &ctx) const
+{
+  if (!ctx._Cell) ctx._Cell = vtkSmartPointer<vtkGenericCell>::New();
+  const size_t n = static_cast<size_t>(max(_MaxCellSize, 1));
+  if (ctx._Weights.size() < n) ctx._Weights.resize(n);
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::WalkToCell(EvaluationContext &ctx, const double p[3]) const
+{
+  const CellLocators &locators = *_Locators;
+  const int nfaces = locators._NumberOfCellFaces;
+  double    closest[3], pcoords[3], dist2;
+  double   *weight = ctx._Weights.data();
+  int       subId, i, imin;
+  vtkIdType cellId = ctx._CellId;
+
+  for (int step = 0; step < _MaximumNumberOfWalkSteps; ++step) {
+    _Domain->GetCell(cellId, ctx._Cell);
+    i = ctx._Cell->EvaluatePosition(const_cast<double *>(p), closest, subId, pcoords, dist2, weight);
+    if (i == 1 && dist2 <= _Tolerance2) {
+      vtkIdList * const ptIds = ctx._Cell->GetPointIds();
+      ctx._PtIds.resize(ptIds->GetNumberOfIds());
+      for (vtkIdType j = 0; j < ptIds->GetNumberOfIds(); ++j) {
+        ctx._PtIds[j] = ptIds->GetId(j);
+      }
+      ctx._CellId = cellId;
+      return true;
+    }
+    if (i == -1) break;
+    // Step across face opposite to cell point with most negative weight
+    imin = 0;
+    for (i = 1; i < nfaces; ++i) {
+      if (weight[i] < weight[imin]) imin = i;
+    }
+    if (weight[imin] >= .0) break; // off surface, but within triangle
+    cellId = locators._CellNeighbors[nfaces * cellId + imin];
+    if (cellId < 0) break; // reached domain boundary
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::FindCell(EvaluationContext &ctx, double x, double y, double z) const
+{
+  double p[3] = {x, y, z}, pcoords[3];
+  if (!_Locators) {
+    ctx._CellId = -1;
+    return false;
+  }
+  BuildLocators();
+  const CellLocators &locators = *_Locators;
+  InitializeContext(ctx);
+  if (locators._NumberOfCellFaces > 0 && ctx._CellId >= 0 &&
+      ctx._CellId < _Domain->GetNumberOfCells() && WalkToCell(ctx, p)) {
+    return true;
+  }
+  if (locators._SimplicialLocator) {
+    const vtkIdType *ptIds;
+    ctx._CellId = locators._SimplicialLocator->FindCell(p, _Tolerance2, ctx._Weights.data(), ptIds);
+    if (ctx._CellId == -1) return false;
+    const int npts = locators._SimplicialLocator->NumberOfCellPoints();
+    ctx._PtIds.assign(ptIds, ptIds + npts);
+    return true;
+  }
+  if (!locators._Locator) {
+    ctx._CellId = -1;
+    return false;
+  }
+  ctx._CellId = locators._Locator->FindCell(p, _Tolerance2, ctx._Cell, pcoords, ctx._Weights.data());
+  if (ctx._CellId == -1) return false;
+  vtkIdList * const ptIds = ctx._Cell->GetPointIds();
+  ctx._PtIds.resize(ptIds->GetNumberOfIds());
+  for (vtkIdType j = 0; j < ptIds->GetNumberOfIds(); ++j) {
+    ctx._PtIds[j] = ptIds->GetId(j);
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::Evaluate(EvaluationContext &ctx, double *v, double x, double y, double z) const
+{
+  const int dim = static_cast<int>(_Values->GetNumberOfComponents());
+  if (!FindCell(ctx, x, y, z)) {
+    for (int j = 0; j < dim; ++j) {
+      v[j] = _OutsideValue;
+    }
+    return false;
+  }
+  const DataArrayView values(_Values);
+  _Kernel(values, ctx._PtIds.data(), static_cast<int>(ctx._PtIds.size()), ctx._Weights.data(), v);
+  return true;
+}
 
 // -----------------------------------------------------------------------------
-void PiecewiseLinearMap::CopyAttributes(const PiecewiseLinearMap &other)
+double PiecewiseLinearMap::Evaluate(EvaluationContext &ctx, double x, double y, double z, int l) const
 {
-  _Domain      = other._Domain;
-  _Values      = other._Values;
-  _MaxCellSize = other._MaxCellSize;
+  double value;
+  Evaluate(ctx, &value, x, y, z, l, l + 1);
+  return value;
+}
 
-  if (other._Locator) {
-    _Locator = vtkSmartPointer<vtkCellLocator>::New();
-    _Locator->SetDataSet(_Domain);
-    _Locator->BuildLocator();
-  } else {
-    _Locator = nullptr;
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::Evaluate(EvaluationContext &ctx, double *v,
+                                  double x, double y, double z, int l1, int l2) const
+{
+  if (l1 == 0 && l2 == static_cast<int>(_Values->GetNumberOfComponents())) {
+    return Evaluate(ctx, v, x, y, z);
+  }
+  if (!FindCell(ctx, x, y, z)) {
+    for (int l = l1; l < l2; ++l) {
+      v[l - l1] = _OutsideValue;
+    }
+    return false;
+  }
+  const DataArrayView values(_Values);
+  const double * const weight = ctx._Weights.data();
+  double value;
+  for (int l = l1; l < l2; ++l) {
+    value = .0;
+    for (size_t i = 0; i < ctx._PtIds.size(); ++i) {
+      value += weight[i] * values.Get(ctx._PtIds[i], l);
+    }
+    v[l - l1] = value;
   }
+  return true;
 }
 
 // -----------------------------------------------------------------------------
-PiecewiseLinearMap::PiecewiseLinearMap()
-:
-  _MaxCellSize(0)
+bool PiecewiseLinearMap::Evaluate(double *v, double x, double y, double z) const
 {
+  EvaluationContext ctx;
+  return Evaluate(ctx, v, x, y, z);
 }
 
 // -----------------------------------------------------------------------------
-PiecewiseLinearMap::PiecewiseLinearMap(const PiecewiseLinearMap &other)
-:
-  Mapping(other)
+double PiecewiseLinearMap::Evaluate(double x, double y, double z, int l) const
 {
-  CopyAttributes(other);
+  EvaluationContext ctx;
+  return Evaluate(ctx, x, y, z, l);
 }
 
 // -----------------------------------------------------------------------------
-PiecewiseLinearMap &PiecewiseLinearMap::operator =(const PiecewiseLinearMap &other)
+bool PiecewiseLinearMap::Evaluate(double *v, double x, double y, double z, int l1, int l2) const
 {
-  if (this != &other) {
-    Mapping::operator =(other);
-    CopyAttributes(other);
+  EvaluationContext ctx;
+  return Evaluate(ctx, v, x, y, z, l1, l2);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateMapAtPoints eval;
+  eval._Map    = this;
+  eval._Points = xyz;
+  eval._Values = values;
+  eval._Inside = inside;
+  parallel_for(blocked_range<int>(0, n), eval);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Resample(vtkPointSet *mesh, double *values, bool *inside) const
+{
+  const int npoints = static_cast<int>(mesh->GetNumberOfPoints());
+  const int ncells  = static_cast<int>(mesh->GetNumberOfCells());
+  if (npoints <= 0) return;
+  if (_Locators) BuildLocators();
+  if (!_Locators || _Locators->_NumberOfCellFaces <= 0 || ncells <= 0) {
+    Mapping::Resample(mesh, values, inside);
+    return;
   }
-  return *this;
+
+  // Edge graph of mesh cells in compressed row storage, where each cell
+  // contributes the edges between consecutive cell points
+  Array<int> offset(npoints + 1, 0), adjacent;
+  vtkNew<vtkIdList> ptIds;
+  vtkIdType a, b;
+  for (int pass = 0; pass < 2; ++pass) {
+    Array<int> pos;
+    if (pass == 1) {
+      for (int ptId = 0; ptId < npoints; ++ptId) {
+        offset[ptId + 1] += offset[ptId];
+      }
+      adjacent.resize(offset[npoints]);
+      pos.assign(offset.begin(), offset.end() - 1);
+    }
+    for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+      mesh->GetCellPoints(cellId, ptIds.GetPointer());
+      const vtkIdType n = ptIds->GetNumberOfIds();
+      if (n < 2) continue;
+      for (vtkIdType i = 0; i < (n == 2 ? 1 : n); ++i) {
+        a = ptIds->GetId(i);
+        b = ptIds->GetId((i + 1) % n);
+        if (pass == 0) {
+          ++offset[a + 1], ++offset[b + 1];
+        } else {
+          adjacent[pos[a]++] = static_cast<int>(b);
+          adjacent[pos[b]++] = static_cast<int>(a);
+        }
+      }
+    }
+  }
+
+  // Breadth-first order of points in each connected component, split into
+  // patches of consecutive points which are evaluated in parallel
+  const int patch_size = 1024;
+  Array<int> order, parent(npoints, -2), patch(npoints), start;
+  order.reserve(npoints);
+  for (int seed = 0; seed < npoints; ++seed) {
+    if (parent[seed] != -2) continue;
+    parent[seed] = -1;
+    order.push_back(seed);
+    for (size_t head = order.size() - 1; head < order.size(); ++head) {
+      const int ptId = order[head];
+      for (int i = offset[ptId]; i < offset[ptId + 1]; ++i) {
+        const int nbrId = adjacent[i];
+        if (parent[nbrId] == -2) {
+          parent[nbrId] = ptId;
+          order.push_back(nbrId);
+        }
+      }
+    }
+  }
+  for (int pos = 0; pos < npoints; ++pos) {
+    if (pos % patch_size == 0) start.push_back(pos);
+    patch[order[pos]] = static_cast<int>(start.size()) - 1;
+  }
+  const int npatches = static_cast<int>(start.size());
+  start.push_back(npoints);
+
+  Array<vtkIdType> cellIds(npoints, -1);
+  ResampleMapInPatches eval;
+  eval._Map    = this;
+  eval._Mesh   = mesh;
+  eval._Order  = &order;
+  eval._Parent = &parent;
+  eval._Offset = &start;
+  eval._Patch  = &patch;
+  eval._CellId = &cellIds;
+  eval._Values = values;
+  eval._Inside = inside;
+  parallel_for(blocked_range<int>(0, npatches), eval);
 }
 
 // -----------------------------------------------------------------------------
-void PiecewiseLinearMap::Initialize()
+void PiecewiseLinearMap::Evaluate(GenericImage<float> &f, int l, vtkSmartPointer<vtkPointSet> m) const
 {
-  // Check input mesh
-  if (!_Domain) {
-    cerr << this->NameOfType() << "::Initialize: No domain mesh is set" << endl;
+  if (!Rasterize(this, f, l, m)) Mapping::Evaluate(f, l, m);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::Evaluate(GenericImage<double> &f, int l, vtkSmartPointer<vtkPointSet> m) const
+{
+  if (!Rasterize(this, f, l, m)) Mapping::Evaluate(f, l, m);
+}
+
+// =============================================================================
+// Multiple fields
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int PiecewiseLinearMap::AddField(vtkDataArray *values)
+{
+  const char * const name = (values ? values->GetName() : nullptr);
+  if (name == nullptr || name[0] == '\0') {
+    cerr << this->NameOfType() << "::AddField: Field must be a named data array" << endl;
     exit(1);
   }
-  if (_Domain->GetNumberOfCells() == 0) {
-    cerr << this->NameOfType() << "::Initialize: Domain mesh has no cells" << endl;
+  if (_Domain && values->GetNumberOfTuples() != _Domain->GetNumberOfPoints()) {
+    cerr << this->NameOfType() << "::AddField: Number of values of field " << name
+         << " differs from number of domain mesh points" << endl;
     exit(1);
   }
-  if (!_Values) {
-    cerr << this->NameOfType() << "::Initialize: No discrete map values at domain mesh points is set!" << endl;
-    exit(1);
+  for (size_t i = 0; i < _Fields.size(); ++i) {
+    if (strcmp(_Fields[i]->GetName(), name) == 0) {
+      _Fields[i] = values;
+      return static_cast<int>(i) + 1;
+    }
   }
-  // Determine maximum number of cell points
-  _MaxCellSize = _Domain->GetMaxCellSize();
+  _Fields.push_back(values);
+  return static_cast<int>(_Fields.size());
+}
 
-  // Build cell locator
-  _Locator = vtkSmartPointer<vtkCellLocator>::New();
-  _Locator->SetDataSet(_Domain);
-  _Locator->BuildLocator();
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::ClearFields()
+{
+  _Fields.clear();
 }
 
 // -----------------------------------------------------------------------------
-Mapping *PiecewiseLinearMap::NewCopy() const
+int PiecewiseLinearMap::FieldIndex(const char *name) const
 {
-  return new PiecewiseLinearMap(*this);
+  if (name == nullptr) return -1;
+  if (_Values && _Values->GetName() && strcmp(_Values->GetName(), name) == 0) return 0;
+  for (size_t i = 0; i < _Fields.size(); ++i) {
+    if (strcmp(_Fields[i]->GetName(), name) == 0) return static_cast<int>(i) + 1;
+  }
+  return -1;
 }
 
 // -----------------------------------------------------------------------------
-PiecewiseLinearMap::~PiecewiseLinearMap()
+int PiecewiseLinearMap::NumberOfFieldComponents(int nfields, const int *fields) const
+{
+  int n = 0;
+  for (int i = 0; i < nfields; ++i) {
+    if (fields[i] < 0 || fields[i] >= NumberOfFields()) {
+      cerr << this->NameOfType() << "::EvaluateFields: Invalid field index: " << fields[i] << endl;
+      exit(1);
+    }
+    n += static_cast<int>(Field(fields[i])->GetNumberOfComponents());
+  }
+  return n;
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::EvaluateFields(EvaluationContext &ctx, int nfields, const int *fields,
+                                        double *v, double x, double y, double z) const
+{
+  const bool inside = FindCell(ctx, x, y, z);
+  const double * const weight = ctx._Weights.data();
+  vtkIdType ptId;
+  int       dim;
+  for (int f = 0; f < nfields; ++f, v += dim) {
+    const DataArrayView values(Field(fields[f]));
+    dim = values.NumberOfComponents();
+    if (!inside) {
+      for (int j = 0; j < dim; ++j) {
+        v[j] = _OutsideValue;
+      }
+      continue;
+    }
+    for (int j = 0; j < dim; ++j) {
+      v[j] = .0;
+    }
+    for (size_t i = 0; i < ctx._PtIds.size(); ++i) {
+      ptId = ctx._PtIds[i];
+      for (int j = 0; j < dim; ++j) {
+        v[j] += weight[i] * values.Get(ptId, j);
+      }
+    }
+  }
+  return inside;
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::EvaluateFields(int nfields, const int *fields, int n,
+                                        const double *xyz, double *values, bool *inside) const
+{
+  if (n <= 0) return;
+  EvaluateFieldsAtPoints eval;
+  eval._Map                = this;
+  eval._NumberOfFields     = nfields;
+  eval._Fields             = fields;
+  eval._NumberOfComponents = NumberOfFieldComponents(nfields, fields);
+  eval._Points             = xyz;
+  eval._Values             = values;
+  eval._Inside             = inside;
+  parallel_for(blocked_range<int>(0, n), eval);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::EvaluateFields(int nfields, const int *fields, GenericImage<float> &f,
+                                        vtkSmartPointer<vtkPointSet> m) const
+{
+  EvaluateFieldsOnLattice(this, nfields, fields, f, m);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::EvaluateFields(int nfields, const int *fields, GenericImage<double> &f,
+                                        vtkSmartPointer<vtkPointSet> m) const
 {
+  EvaluateFieldsOnLattice(this, nfields, fields, f, m);
 }
 
 // =============================================================================
-// Input domain
+// Jacobian evaluation
 // =============================================================================
 
 // -----------------------------------------------------------------------------
-void PiecewiseLinearMap::BoundingBox(double &x1, double &y1, double &z1,
-                                     double &x2, double &y2, double &z2) const
+bool PiecewiseLinearMap::InitializeCellGradients()
 {
-  if (_Domain) {
-    double bounds[6];
-    _Domain->GetBounds(bounds);
-    x1 = bounds[0], x2 = bounds[1];
-    y1 = bounds[2], y2 = bounds[3];
-    z1 = bounds[4], z2 = bounds[5];
-  } else {
-    x1 = x2 = y1 = y2 = z1 = z2 = .0;
+  _NumberOfCellGradients = 0;
+  _CellGradients         = nullptr;
+
+  const vtkIdType ncells = _Domain->GetNumberOfCells();
+  if (ncells == 0) return false;
+  const int type = _Domain->GetCellType(0);
+  if (type != VTK_TRIANGLE && type != VTK_TETRA) return false;
+  for (vtkIdType cellId = 1; cellId < ncells; ++cellId) {
+    if (_Domain->GetCellType(cellId) != type) return false;
+  }
+  const int npts = (type == VTK_TETRA ? 4 : 3);
+
+  SharedPtr<Array<double> > gradients;
+  gradients = NewShared<Array<double> >(static_cast<size_t>(3 * npts * ncells), .0);
+  ComputeCellGradients eval;
+  eval._Domain             = _Domain;
+  eval._NumberOfCellPoints = npts;
+  eval._Gradients          = gradients->data();
+  parallel_for(blocked_range<vtkIdType>(0, ncells), eval);
+
+  _NumberOfCellGradients = npts;
+  _CellGradients         = gradients;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::EvaluateJacobian(EvaluationContext &ctx, double *jac,
+                                          double x, double y, double z) const
+{
+  const int dim = static_cast<int>(_Values->GetNumberOfComponents());
+  if (!FindCell(ctx, x, y, z)) {
+    for (int j = 0; j < 3 * dim; ++j) {
+      jac[j] = _OutsideValue;
+    }
+    return false;
+  }
+
+  // Gradients of barycentric coordinates of cell points
+  const int npts = static_cast<int>(ctx._PtIds.size());
+  double    buffer[12];
+  const double *grad = nullptr;
+  if (_CellGradients && npts == _NumberOfCellGradients) {
+    grad = _CellGradients->data() + 3 * npts * ctx._CellId;
+  } else if (npts == 3 || npts == 4) {
+    int type = _Domain->GetCellType(ctx._CellId);
+    if (type == VTK_TRIANGLE || type == VTK_TETRA) {
+      BarycentricGradients(_Domain, ctx._PtIds.data(), npts, buffer);
+      grad = buffer;
+    }
+  }
+  if (grad == nullptr) {
+    return Mapping::EvaluateJacobian(ctx, jac, x, y, z);
+  }
+
+  // Jacobian is constant within simplicial cell
+  for (int j = 0; j < 3 * dim; ++j) {
+    jac[j] = .0;
   }
+  const DataArrayView values(_Values);
+  double value;
+  for (int i = 0; i < npts; ++i, grad += 3) {
+    for (int l = 0; l < dim; ++l) {
+      value = values.Get(ctx._PtIds[i], l);
+      jac[3 * l    ] += value * grad[0];
+      jac[3 * l + 1] += value * grad[1];
+      jac[3 * l + 2] += value * grad[2];
+    }
+  }
+  return true;
 }
 
 // =============================================================================
-// Map codomain
+// Inverse evaluation
 // =============================================================================
 
 // -----------------------------------------------------------------------------
-int PiecewiseLinearMap::NumberOfComponents() const
+bool PiecewiseLinearMap::InitializeInverse()
 {
-  return static_cast<int>(_Values->GetNumberOfComponents());
+  _InverseMap.reset(this->Inverse());
+  return _InverseMap != nullptr;
 }
 
 // -----------------------------------------------------------------------------
-vtkSmartPointer<vtkDataSet> PiecewiseLinearMap::Codomain() const
+bool PiecewiseLinearMap::EvaluateInverse(double *v, double x, double y, double z) const
 {
-  const int dim = this->NumberOfComponents();
-  vtkPolyData *domain = vtkPolyData::SafeDownCast(_Domain);
-  if (domain == nullptr || dim < 2 || dim > 3) return nullptr;
-  double p[3] = {.0};
-  vtkSmartPointer<vtkPoints> points;
-  points.TakeReference(domain->GetPoints()->NewInstance());
-  points->SetNumberOfPoints(domain->GetNumberOfPoints());
-  for (vtkIdType ptId = 0; ptId < domain->GetNumberOfPoints(); ++ptId) {
-    _Values->GetTuple(ptId, p);
-    points->SetPoint(ptId, p);
-  }
-  vtkSmartPointer<vtkPolyData> codomain;
-  codomain.TakeReference(domain->NewInstance());
-  codomain->ShallowCopy(domain);
-  codomain->SetPoints(points);
-  codomain->GetPointData()->Initialize();
-  codomain->GetCellData()->Initialize();
-  return codomain;
+  if (!_InverseMap) {
+    cerr << this->NameOfType() << "::EvaluateInverse: Inverse map not initialized" << endl;
+    exit(1);
+  }
+  return _InverseMap->Evaluate(v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::EvaluateInverse(EvaluationContext &ctx, double *v,
+                                         double x, double y, double z) const
+{
+  if (!_InverseMap) {
+    cerr << this->NameOfType() << "::EvaluateInverse: Inverse map not initialized" << endl;
+    exit(1);
+  }
+  return _InverseMap->Evaluate(ctx, v, x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+void PiecewiseLinearMap::EvaluateInverse(int n, const double *xyz, double *values, bool *inside) const
+{
+  if (!_InverseMap) {
+    cerr << this->NameOfType() << "::EvaluateInverse: Inverse map not initialized" << endl;
+    exit(1);
+  }
+  _InverseMap->Evaluate(n, xyz, values, inside);
 }
 
 // =============================================================================
-// Evaluation
+// I/O
 // =============================================================================
 
 // -----------------------------------------------------------------------------
-bool PiecewiseLinearMap::Evaluate(double *v, double x, double y, double z) const
+bool PiecewiseLinearMap::ReadBinary(const char *fname)
 {
-  vtkSmartPointer<vtkGenericCell> cell = vtkSmartPointer<vtkGenericCell>::New();
-  double p[3] = {x, y, z}, pcoords[3];
-  double *weight = new double[_MaxCellSize];
-  if (_Locator->FindCell(p, _Tolerance2, cell, pcoords, weight) == -1) {
-      for (int j = 0; j < _Values->GetNumberOfComponents(); ++j) {
-        v[j] = _OutsideValue;
-      }
-      delete[] weight;
+  std::ifstream is(fname, std::ios::in | std::ios::binary);
+  if (!is) return false;
+
+  BinaryHeader header;
+  is.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (is.fail() || memcmp(header._Magic, BinaryMagic, sizeof(BinaryMagic)) != 0) {
+    return false;
+  }
+  if (header._Version < 1 || header._Version > BinaryVersion) {
+    cerr << this->NameOfType() << "::Read: Unsupported binary file version: " << header._Version << endl;
+    return false;
+  }
+  if (header._ByteOrder != BinaryByteOrder) {
+    cerr << this->NameOfType() << "::Read: Binary file was written on machine with different byte order" << endl;
+    return false;
+  }
+  if ((header._DataSetType != VTK_POLY_DATA && header._DataSetType != VTK_UNSTRUCTURED_GRID) ||
+      (header._ValueType   != VTK_FLOAT     && header._ValueType   != VTK_DOUBLE) ||
+      header._NumberOfPoints <= 0 || header._NumberOfCells <= 0 || header._NumberOfComponents <= 0) {
+    cerr << this->NameOfType() << "::Read: Invalid binary file header" << endl;
+    return false;
+  }
+  const vtkIdType npoints = static_cast<vtkIdType>(header._NumberOfPoints);
+  const vtkIdType ncells  = static_cast<vtkIdType>(header._NumberOfCells);
+  const bool      int32   = ((header._Flags & BinaryInt32Ids) != 0);
+
+  // Point coordinates
+  vtkSmartPointer<vtkDataArray> coords;
+  if (header._Flags & BinaryFloatPoints) {
+    coords = vtkSmartPointer<vtkFloatArray>::New();
+  } else {
+    coords = vtkSmartPointer<vtkDoubleArray>::New();
+  }
+  coords->SetNumberOfComponents(3);
+  coords->SetNumberOfTuples(npoints);
+  SkipPadding(is);
+  is.read(reinterpret_cast<char *>(coords->GetVoidPointer(0)), 3 * npoints * coords->GetDataTypeSize());
+  vtkNew<vtkPoints> points;
+  points->SetData(coords);
+
+  // Cell types
+  Array<int> types;
+  if (header._DataSetType == VTK_UNSTRUCTURED_GRID) {
+    Array<int32_t> buffer(ncells);
+    SkipPadding(is);
+    is.read(reinterpret_cast<char *>(buffer.data()), ncells * sizeof(int32_t));
+    types.assign(buffer.begin(), buffer.end());
+  }
+
+  // Cell connectivity
+  const vtkIdType nconn = static_cast<vtkIdType>(header._ConnectivitySize);
+  vtkNew<vtkIdTypeArray> conn;
+  conn->SetNumberOfTuples(nconn);
+  SkipPadding(is);
+  if (header._Flags & BinaryDeltaCells) {
+    if (!ReadDeltaCells(is, header._NumberOfCells, header._NumberOfPoints, conn.GetPointer())) {
+      cerr << this->NameOfType() << "::Read: Failed to decode cell connectivity of binary file" << endl;
       return false;
+    }
+  } else if (!int32 && sizeof(vtkIdType) == sizeof(int64_t)) {
+    is.read(reinterpret_cast<char *>(conn->GetPointer(0)), nconn * sizeof(int64_t));
+  } else {
+    Array<int64_t> buffer;
+    ReadIds(is, int32, static_cast<size_t>(nconn), buffer);
+    for (vtkIdType i = 0; i < nconn; ++i) {
+      conn->SetValue(i, static_cast<vtkIdType>(buffer[i]));
+    }
   }
-  for (int j = 0; j < _Values->GetNumberOfComponents(); ++j) {
-    v[j] = .0;
+  vtkNew<vtkCellArray> cells;
+  cells->SetCells(ncells, conn.GetPointer());
+
+  // Map values
+  vtkSmartPointer<vtkDataArray> values;
+  values.TakeReference(vtkDataArray::CreateDataArray(header._ValueType));
+  values->SetNumberOfComponents(header._NumberOfComponents);
+  values->SetNumberOfTuples(npoints);
+  SkipPadding(is);
+  if (header._Flags & BinaryQuantizedValues) {
+    const int ncomps = header._NumberOfComponents;
+    Array<double>   range(2 * ncomps);
+    Array<uint16_t> quantized(static_cast<size_t>(npoints * ncomps));
+    is.read(reinterpret_cast<char *>(range.data()), range.size() * sizeof(double));
+    SkipPadding(is);
+    is.read(reinterpret_cast<char *>(quantized.data()), quantized.size() * sizeof(uint16_t));
+    if (!is.fail()) {
+      const DataArrayView output(values);
+      DequantizeValues decode;
+      decode._Input              = quantized.data();
+      decode._Offset             = range.data();
+      decode._Scale              = range.data() + ncomps;
+      decode._Values             = &output;
+      decode._NumberOfComponents = ncomps;
+      parallel_for(blocked_range<vtkIdType>(0, npoints), decode);
+    }
+  } else {
+    is.read(reinterpret_cast<char *>(values->GetVoidPointer(0)),
+            npoints * header._NumberOfComponents * values->GetDataTypeSize());
+  }
+  if (is.fail()) {
+    cerr << this->NameOfType() << "::Read: Failed to read data blocks of binary file" << endl;
+    return false;
+  }
+
+  // Domain mesh
+  if (header._DataSetType == VTK_POLY_DATA) {
+    vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+    surface->SetPoints(points.GetPointer());
+    surface->SetPolys(cells.GetPointer());
+    this->Domain(surface);
+  } else {
+    vtkSmartPointer<vtkUnstructuredGrid> grid = vtkSmartPointer<vtkUnstructuredGrid>::New();
+    grid->SetPoints(points.GetPointer());
+    grid->SetCells(types.data(), cells.GetPointer());
+    this->Domain(grid);
   }
-  vtkIdList * const ptIds = cell->GetPointIds();
-  for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
-    for (int j = 0; j < _Values->GetNumberOfComponents(); ++j) {
-      v[j] += weight[i] * _Values->GetComponent(ptIds->GetId(i), j);
+  this->Values(values);
+  _Fields.clear();
+
+  // Cell locator and face neighbors
+  if ((header._Flags & BinaryLocator) == 0 ||
+      (header._Version < 4 && sizeof(vtkIdType) != sizeof(int64_t))) {
+    this->Initialize();
+    return true;
+  }
+  _MaxCellSize = _Domain->GetMaxCellSize();
+  _Kernel      = SelectKernel(_Domain, _Values);
+  _Locators    = NewShared<CellLocators>();
+  CellLocators &locators = *_Locators;
+  locators._SimplicialLocator = NewShared<SimplicialCellLocator>();
+  SkipPadding(is);
+  if (!locators._SimplicialLocator->ReadBinary(is) ||
+      locators._SimplicialLocator->NumberOfCells() != static_cast<int>(ncells)) {
+    cerr << this->NameOfType() << "::Read: Failed to read cell locator from binary file" << endl;
+    _Locators = nullptr;
+    return false;
+  }
+  if ((header._Flags & BinaryNeighbors) != 0 && header._NumberOfCellFaces > 0) {
+    const size_t n = static_cast<size_t>(header._NumberOfCellFaces * ncells);
+    Array<int64_t> buffer;
+    SkipPadding(is);
+    ReadIds(is, int32, n, buffer);
+    if (is.fail()) {
+      cerr << this->NameOfType() << "::Read: Failed to read cell neighbors from binary file" << endl;
+      _Locators = nullptr;
+      return false;
     }
+    locators._CellNeighbors.assign(buffer.begin(), buffer.end());
+    locators._NumberOfCellFaces = header._NumberOfCellFaces;
+  } else {
+    this->InitializeCellNeighbors(locators);
   }
-  delete[] weight;
+  locators._Built.store(true, std::memory_order_release);
   return true;
 }
 
 // -----------------------------------------------------------------------------
-double PiecewiseLinearMap::Evaluate(double x, double y, double z, int l) const
+bool PiecewiseLinearMap::WriteBinary(const char *fname, bool compress) const
 {
-  vtkSmartPointer<vtkGenericCell> cell = vtkSmartPointer<vtkGenericCell>::New();
-  double p[3] = {x, y, z}, pcoords[3];
-  double *weight = new double[_MaxCellSize];
-  if (_Locator->FindCell(p, _Tolerance2, cell, pcoords, weight) == -1) {
-      delete[] weight;
-      return _OutsideValue;
+  vtkPolyData         * const surface = vtkPolyData        ::SafeDownCast(_Domain);
+  vtkUnstructuredGrid * const grid    = vtkUnstructuredGrid::SafeDownCast(_Domain);
+  if (surface) {
+    if (surface->GetNumberOfPolys() != surface->GetNumberOfCells()) {
+      cerr << this->NameOfType() << "::Write: Binary file format requires surface with polygons only" << endl;
+      return false;
+    }
+  } else if (!grid) {
+    cerr << this->NameOfType() << "::Write: Binary file format requires surface mesh or unstructured grid" << endl;
+    return false;
   }
-  double value = .0;
-  vtkIdList * const ptIds = cell->GetPointIds();
-  for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
-    value += weight[i] * _Values->GetComponent(ptIds->GetId(i), l);
+
+  const vtkIdType npoints = _Domain->GetNumberOfPoints();
+  const vtkIdType ncells  = _Domain->GetNumberOfCells();
+  const int       ncomps  = _Values->GetNumberOfComponents();
+  const int       type    = _Values->GetDataType();
+
+  // Store point coordinates in the precision of the domain mesh and IDs as
+  // int32 whenever all point and cell IDs fit, neither of which loses data
+  vtkPointSet * const pointset = vtkPointSet::SafeDownCast(_Domain);
+  const bool float_points = (pointset->GetPoints()->GetDataType() == VTK_FLOAT);
+  const bool int32 = (npoints <= static_cast<vtkIdType>(numeric_limits<int32_t>::max()) &&
+                      ncells  <= static_cast<vtkIdType>(numeric_limits<int32_t>::max()));
+
+  // Cell connectivity in VTK legacy layout
+  Array<int64_t> conn;
+  conn.reserve(static_cast<size_t>(ncells * (_MaxCellSize + 1)));
+  vtkNew<vtkIdList> ptIds;
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    _Domain->GetCellPoints(cellId, ptIds.GetPointer());
+    conn.push_back(static_cast<int64_t>(ptIds->GetNumberOfIds()));
+    for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
+      conn.push_back(static_cast<int64_t>(ptIds->GetId(i)));
+    }
   }
-  delete[] weight;
-  return value;
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header._Magic, BinaryMagic, sizeof(BinaryMagic));
+  header._Version            = BinaryVersion;
+  header._ByteOrder          = BinaryByteOrder;
+  header._DataSetType        = (surface ? VTK_POLY_DATA : VTK_UNSTRUCTURED_GRID);
+  header._ValueType          = (type == VTK_FLOAT ? VTK_FLOAT : VTK_DOUBLE);
+  header._NumberOfComponents = ncomps;
+  header._NumberOfPoints     = static_cast<int64_t>(npoints);
+  header._NumberOfCells      = static_cast<int64_t>(ncells);
+  header._ConnectivitySize   = static_cast<int64_t>(conn.size());
+  this->BuildLocators();
+  const CellLocators &locators = *_Locators;
+  header._NumberOfCellFaces  = locators._NumberOfCellFaces;
+  if (locators._SimplicialLocator) {
+    header._Flags |= BinaryLocator;
+    if (header._NumberOfCellFaces > 0) header._Flags |= BinaryNeighbors;
+  }
+  if (float_points) header._Flags |= BinaryFloatPoints;
+  if (int32)        header._Flags |= BinaryInt32Ids;
+  if (compress)     header._Flags |= BinaryDeltaCells | BinaryQuantizedValues;
+
+  std::ofstream os(fname, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!os) {
+    cerr << this->NameOfType() << "::Write: Failed to open file " << fname << endl;
+    return false;
+  }
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  // Point coordinates
+  WritePadding(os);
+  if (float_points) {
+    Array<float> coords(3 * npoints);
+    double p[3];
+    for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+      _Domain->GetPoint(ptId, p);
+      coords[3 * ptId    ] = static_cast<float>(p[0]);
+      coords[3 * ptId + 1] = static_cast<float>(p[1]);
+      coords[3 * ptId + 2] = static_cast<float>(p[2]);
+    }
+    os.write(reinterpret_cast<const char *>(coords.data()), coords.size() * sizeof(float));
+  } else {
+    Array<double> coords(3 * npoints);
+    for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+      _Domain->GetPoint(ptId, coords.data() + 3 * ptId);
+    }
+    os.write(reinterpret_cast<const char *>(coords.data()), coords.size() * sizeof(double));
+  }
+
+  // Cell types
+  if (grid) {
+    Array<int32_t> types(ncells);
+    for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+      types[cellId] = static_cast<int32_t>(grid->GetCellType(cellId));
+    }
+    WritePadding(os);
+    os.write(reinterpret_cast<const char *>(types.data()), types.size() * sizeof(int32_t));
+  }
+
+  // Cell connectivity
+  WritePadding(os);
+  if (compress) {
+    WriteDeltaCells(os, conn, header._NumberOfCells);
+  } else {
+    WriteIds(os, int32, conn);
+  }
+
+  // Map values
+  WritePadding(os);
+  if (compress) {
+    // Offset and scale of each component given by the bounds of the codomain
+    const DataArrayView values(_Values);
+    Array<double> range(2 * ncomps);
+    double * const offset = range.data();
+    double * const scale  = range.data() + ncomps;
+    for (int j = 0; j < ncomps; ++j) {
+      double vmin = +inf, vmax = -inf, v;
+      for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+        v = values.Get(ptId, j);
+        if (v < vmin) vmin = v;
+        if (v > vmax) vmax = v;
+      }
+      if (vmin > vmax) vmin = vmax = .0;
+      offset[j] = vmin;
+      scale [j] = (vmax - vmin) / BinaryQuantizedMax;
+    }
+    Array<uint16_t> quantized(static_cast<size_t>(npoints * ncomps));
+    QuantizeValues encode;
+    encode._Values             = &values;
+    encode._Offset             = offset;
+    encode._Scale              = scale;
+    encode._Output             = quantized.data();
+    encode._NumberOfComponents = ncomps;
+    parallel_for(blocked_range<vtkIdType>(0, npoints), encode);
+    os.write(reinterpret_cast<const char *>(range.data()), range.size() * sizeof(double));
+    WritePadding(os);
+    os.write(reinterpret_cast<const char *>(quantized.data()), quantized.size() * sizeof(uint16_t));
+  } else if (type == VTK_FLOAT || type == VTK_DOUBLE) {
+    os.write(reinterpret_cast<const char *>(_Values->GetVoidPointer(0)),
+             npoints * ncomps * _Values->GetDataTypeSize());
+  } else {
+    Array<double> values(npoints * ncomps);
+    for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+      _Values->GetTuple(ptId, values.data() + ncomps * ptId);
+    }
+    os.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(double));
+  }
+
+  // Cell locator and face neighbors
+  if (header._Flags & BinaryLocator) {
+    WritePadding(os);
+    locators._SimplicialLocator->WriteBinary(os);
+  }
+  if (header._Flags & BinaryNeighbors) {
+    Array<int64_t> neighbors(locators._CellNeighbors.begin(), locators._CellNeighbors.end());
+    WritePadding(os);
+    WriteIds(os, int32, neighbors);
+  }
+
+  return !os.fail();
 }
 
-// =============================================================================
-// I/O
-// =============================================================================
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap::FileFormat
+PiecewiseLinearMap::DetectFileFormat(const char *fname, const char *data, int n)
+{
+  const string header(data, static_cast<size_t>(max(n, 0)));
+  if (header.compare(0, sizeof(BinaryMagic), BinaryMagic, sizeof(BinaryMagic)) == 0) {
+    return NativeFileFormat;
+  }
+  if (header.compare(0, 14, "# vtk DataFile") == 0) {
+    return PointSetFormat;
+  }
+  const string ext = Extension(fname);
+  if (header.compare(0, 5, "<?xml") == 0 || header.compare(0, 8, "<VTKFile") == 0) {
+    if (header.find("type=\"ImageData\"") != string::npos) return ImageDataFormat;
+    if (header.find("type=\"PolyData\"")         != string::npos ||
+        header.find("type=\"UnstructuredGrid\"") != string::npos) {
+      return PointSetFormat;
+    }
+    // VTK file type attribute beyond the given leading bytes
+    return (ext == ".vti" ? ImageDataFormat : PointSetFormat);
+  }
+  if (ext == ".plm" || ext == ".plmz") return NativeFileFormat;
+  if (ext == ".vti") return ImageDataFormat;
+  if (ext == ".vtk" || ext == ".vtp" || ext == ".vtu" ||
+      ext == ".stl" || ext == ".ply" || ext == ".obj") {
+    return PointSetFormat;
+  }
+  return UnknownFileFormat;
+}
+
+// -----------------------------------------------------------------------------
+PiecewiseLinearMap::FileFormat PiecewiseLinearMap::DetectFileFormat(const char *fname)
+{
+  char data[256];
+  std::ifstream is(fname, std::ios::in | std::ios::binary);
+  is.read(data, sizeof(data));
+  return DetectFileFormat(fname, data, static_cast<int>(is.gcount()));
+}
 
 // -----------------------------------------------------------------------------
 bool PiecewiseLinearMap::Read(const char *fname)
 {
-  const string ext = Extension(fname);
+  return this->Read(fname, DetectFileFormat(fname));
+}
+
+// -----------------------------------------------------------------------------
+bool PiecewiseLinearMap::Read(const char *fname, FileFormat format)
+{
+  if (format == NativeFileFormat) return this->ReadBinary(fname);
   _Domain = nullptr;
-  if (ext != ".vti") {
+  if (format == PointSetFormat || format == UnknownFileFormat) {
     const bool exit_on_failure = false;
     _Domain = ReadPointSet(fname, exit_on_failure);
   }
-  if (_Domain == nullptr || _Domain->GetNumberOfPoints() == 0) {
+  if (format == ImageDataFormat ||
+      (format == UnknownFileFormat && (_Domain == nullptr || _Domain->GetNumberOfPoints() == 0))) {
     vtkNew<vtkXMLImageDataReader> reader;
     reader->SetFileName(fname);
     reader->Update();
     _Domain = reader->GetOutput();
   }
-  if (_Domain->GetNumberOfPoints() == 0 ||
+  if (_Domain == nullptr || _Domain->GetNumberOfPoints() == 0 ||
       _Domain->GetNumberOfCells()  == 0) return false;
-  if (_Domain->GetPointData()->GetNumberOfArrays() == 1) {
-    _Values = _Domain->GetPointData()->GetArray(0);
-    _Domain->GetPointData()->Initialize();
+  vtkPointData * const pd = _Domain->GetPointData();
+  _Fields.clear();
+  if (pd->GetNumberOfArrays() >= 1) {
+    _Values = pd->GetArray(0);
+    for (int i = 1; i < pd->GetNumberOfArrays(); ++i) {
+      vtkDataArray * const field = pd->GetArray(i);
+      if (field && field->GetName()) _Fields.push_back(field);
+    }
+    pd->Initialize();
   } else {
     _Values = nullptr;
   }
+  _DomainRefs = NewShared<int>(0);
+  _ValuesRefs = NewShared<int>(0);
+  _NumberOfCellGradients = 0;
+  _CellGradients         = nullptr;
   this->Initialize();
   return true;
 }
@@ -257,6 +2419,9 @@ bool PiecewiseLinearMap::Read(const char *fname)
 // -----------------------------------------------------------------------------
 bool PiecewiseLinearMap::Write(const char *fname) const
 {
+  const string ext = Extension(fname);
+  if (ext == ".plm")  return this->WriteBinary(fname);
+  if (ext == ".plmz") return this->WriteBinary(fname, true);
   vtkSmartPointer<vtkDataSet> output;
   output.TakeReference(_Domain->NewInstance());
   output->ShallowCopy(_Domain);
@@ -270,6 +2435,9 @@ bool PiecewiseLinearMap::Write(const char *fname) const
   } else {
     output->GetPointData()->AddArray(_Values);
   }
+  for (size_t i = 0; i < _Fields.size(); ++i) {
+    output->GetPointData()->AddArray(_Fields[i]);
+  }
   vtkPointSet *pointset = vtkPointSet::SafeDownCast(output);
   if (pointset) {
     return WritePointSet(fname, pointset);
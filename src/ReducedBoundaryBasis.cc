@@ -0,0 +1,135 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/ReducedBoundaryBasis.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Stream.h"
+
+#include "Eigen/SVD"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+ReducedBoundaryBasis::ReducedBoundaryBasis()
+:
+  _ExplainedVariance(.0)
+{
+}
+
+// -----------------------------------------------------------------------------
+void ReducedBoundaryBasis
+::Initialize(const Eigen::MatrixXd &samples, int max_modes, double energy)
+{
+  if (samples.rows() == 0 || samples.cols() == 0) {
+    cerr << "ReducedBoundaryBasis::Initialize: No sample boundary values given" << endl;
+    exit(1);
+  }
+  const int m = static_cast<int>(samples.rows());
+  const int s = static_cast<int>(samples.cols());
+
+  _Mean = samples.rowwise().mean();
+  _Response.resize(0, 0);
+  _ExplainedVariance = 1.0;
+
+  // Principal modes of centered samples
+  Eigen::MatrixXd d = samples.colwise() - _Mean;
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd(d, Eigen::ComputeThinU);
+  const Eigen::VectorXd &sigma = svd.singularValues();
+
+  const double total = sigma.squaredNorm();
+  const double eps   = numeric_limits<double>::epsilon() * max(m, s) * (sigma.rows() > 0 ? sigma(0) : .0);
+  if (max_modes <= 0 || max_modes > static_cast<int>(sigma.rows())) {
+    max_modes = static_cast<int>(sigma.rows());
+  }
+  int    k   = 0;
+  double var = .0;
+  while (k < max_modes && sigma(k) > eps) {
+    if (total > .0 && var / total >= energy) break;
+    var += sigma(k) * sigma(k);
+    ++k;
+  }
+  _Modes = svd.matrixU().leftCols(k);
+  if (total > .0) _ExplainedVariance = var / total;
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+Eigen::MatrixXd ReducedBoundaryBasis::Functions() const
+{
+  Eigen::MatrixXd f(_Mean.rows(), _Modes.cols() + 1);
+  f.col(0) = _Mean;
+  f.rightCols(_Modes.cols()) = _Modes;
+  return f;
+}
+
+// -----------------------------------------------------------------------------
+void ReducedBoundaryBasis::Response(const Eigen::MatrixXd &r)
+{
+  if (r.cols() != _Modes.cols() + 1) {
+    cerr << "ReducedBoundaryBasis::Response: Expected one column per boundary function" << endl;
+    exit(1);
+  }
+  _Response = r;
+}
+
+// -----------------------------------------------------------------------------
+void ReducedBoundaryBasis::Project(const Eigen::MatrixXd &g, Eigen::MatrixXd &alpha) const
+{
+  if (g.rows() != _Mean.rows()) {
+    cerr << "ReducedBoundaryBasis::Project: Invalid number of boundary values" << endl;
+    exit(1);
+  }
+  alpha.noalias() = _Modes.transpose() * (g.colwise() - _Mean);
+}
+
+// -----------------------------------------------------------------------------
+void ReducedBoundaryBasis
+::Evaluate(const Eigen::MatrixXd &g, Eigen::MatrixXd &x, double *error) const
+{
+  if (!HasResponse()) {
+    cerr << "ReducedBoundaryBasis::Evaluate: Response of boundary functions not set" << endl;
+    exit(1);
+  }
+  Eigen::MatrixXd alpha;
+  Project(g, alpha);
+  x = _Response.col(0).replicate(1, g.cols());
+  x.noalias() += _Response.rightCols(_Modes.cols()) * alpha;
+  if (error) {
+    *error = .0;
+    Eigen::MatrixXd r = g.colwise() - _Mean;
+    r.noalias() -= _Modes * alpha;
+    for (int j = 0; j < static_cast<int>(g.cols()); ++j) {
+      const double norm = g.col(j).norm();
+      if (norm > .0) *error = max(*error, r.col(j).norm() / norm);
+    }
+  }
+}
+
+
+} // namespace mirtk
@@ -20,7 +20,7 @@
 #include "mirtk/ShapePreservingSurfaceMapper.h"
 
 #include "mirtk/Math.h"
-#include "mirtk/Matrix.h"
+#include "mirtk/Array.h"
 #include "mirtk/Vector3D.h"
 #include "mirtk/Triangle.h"
 
@@ -80,9 +80,21 @@ void ShapePreservingSurfaceMapper
     exit(1);
   }
 
+  // Scratch memory of side lengths, arcs, and planar point coordinates,
+  // which is on the stack unless the point has an unusually high degree,
+  // because this function is called concurrently for all free points
+  const int     max_stack_degree = 32;
+  double        stack[4 * max_stack_degree];
+  Array<double> heap;
+  double       *l = stack;
+  if (d_i > max_stack_degree) {
+    heap.resize(4 * d_i);
+    l = heap.data();
+  }
+  double * const a = l + d_i;
+  double * const p = a + d_i;
+
   // Compute side lengths and arcs
-  Vector l(d_i);
-  Vector a(d_i);
   {
     const class Point q = Point(i);
     class Point       p0, p1, p2;
@@ -95,23 +107,27 @@ void ShapePreservingSurfaceMapper
       p2 = Point(j[k]);
       e2 = Vector3D<double>(p2 - q);
       e2.Normalize();
-      l(k-1) = p1.Distance(p2);
-      a(k-1) = acos(clamp(e1.DotProduct(e2), -1., 1.));
+      l[k-1] = p1.Distance(p2);
+      a[k-1] = acos(clamp(e1.DotProduct(e2), -1., 1.));
       p1 = p2, e1 = e2;
     }
-    l(d_i-1) = p1.Distance(p0);
-    a(d_i-1) = acos(clamp(e1.DotProduct(e0), -1., 1.));
+    l[d_i-1] = p1.Distance(p0);
+    a[d_i-1] = acos(clamp(e1.DotProduct(e0), -1., 1.));
   }
 
   // Step i) Project subgraph into plane
-  Matrix p(2, d_i);
   {
-    double alpha = 0.;
-    a *= two_pi / a.Sum();
+    double alpha = 0., sum = 0.;
+    for (int k = 0; k < d_i; ++k) {
+      sum += a[k];
+    }
+    for (int k = 0; k < d_i; ++k) {
+      a[k] *= two_pi / sum;
+    }
     for (int k = 0; k < d_i; ++k) {
-      p.Col(k)[0] = l(k) * cos(alpha);
-      p.Col(k)[1] = l(k) * sin(alpha);
-      alpha += a(k);
+      p[2*k  ] = l[k] * cos(alpha);
+      p[2*k+1] = l[k] * sin(alpha);
+      alpha += a[k];
     }
   }
 
@@ -122,17 +138,17 @@ void ShapePreservingSurfaceMapper
     w_i[k] = 0.;
   }
   for (int c1 = 0, c2, c3; c1 < d_i; ++c1) {
-    alpha = a(c1);
+    alpha = a[c1];
     c3 = (c1 + 1) % d_i;
     while (alpha < pi) {
-      alpha += a(c3);
+      alpha += a[c3];
       c3 = (c3 + 1) % d_i;
     }
     c2 = (c3 == 0 ? d_i : c3) - 1;
-    area  = Triangle::Area2D(p.Col(c1), p.Col(c2), p.Col(c3));
-    area1 = Triangle::Area2D(center,    p.Col(c2), p.Col(c3));
-    area2 = Triangle::Area2D(p.Col(c1), center,    p.Col(c3));
-    area3 = Triangle::Area2D(p.Col(c1), p.Col(c2), center);
+    area  = Triangle::Area2D(p + 2*c1, p + 2*c2, p + 2*c3);
+    area1 = Triangle::Area2D(center,   p + 2*c2, p + 2*c3);
+    area2 = Triangle::Area2D(p + 2*c1, center,   p + 2*c3);
+    area3 = Triangle::Area2D(p + 2*c1, p + 2*c2, center);
     w_i[c1] += area1 / area;
     w_i[c2] += area2 / area;
     w_i[c3] += area3 / area;
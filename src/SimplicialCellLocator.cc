@@ -0,0 +1,379 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SimplicialCellLocator.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Algorithm.h"
+
+#include "vtkNew.h"
+#include "vtkIdList.h"
+#include "vtkCellType.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SimplicialCellLocator::CopyAttributes(const SimplicialCellLocator &other)
+{
+  _NumberOfCellPoints = other._NumberOfCellPoints;
+  _NumberOfCells      = other._NumberOfCells;
+  _Nodes              = other._Nodes;
+  _CellIds            = other._CellIds;
+  _PointIds           = other._PointIds;
+  _Geometry           = other._Geometry;
+}
+
+// -----------------------------------------------------------------------------
+SimplicialCellLocator::SimplicialCellLocator()
+:
+  _NumberOfCellPoints(0),
+  _NumberOfCells(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+SimplicialCellLocator::SimplicialCellLocator(const SimplicialCellLocator &other)
+:
+  Object(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+SimplicialCellLocator &SimplicialCellLocator::operator =(const SimplicialCellLocator &other)
+{
+  if (this != &other) {
+    Object::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+SimplicialCellLocator::~SimplicialCellLocator()
+{
+}
+
+// -----------------------------------------------------------------------------
+bool SimplicialCellLocator::IsSupported(vtkDataSet *dataset)
+{
+  const vtkIdType ncells = dataset->GetNumberOfCells();
+  if (ncells == 0) return false;
+  const int type = dataset->GetCellType(0);
+  if (type != VTK_TRIANGLE && type != VTK_TETRA) return false;
+  for (vtkIdType cellId = 1; cellId < ncells; ++cellId) {
+    if (dataset->GetCellType(cellId) != type) return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool SimplicialCellLocator::Invert3x3(const double *m, double *inv)
+{
+  inv[0] = m[4] * m[8] - m[5] * m[7];
+  inv[1] = m[2] * m[7] - m[1] * m[8];
+  inv[2] = m[1] * m[5] - m[2] * m[4];
+  inv[3] = m[5] * m[6] - m[3] * m[8];
+  inv[4] = m[0] * m[8] - m[2] * m[6];
+  inv[5] = m[2] * m[3] - m[0] * m[5];
+  inv[6] = m[3] * m[7] - m[4] * m[6];
+  inv[7] = m[1] * m[6] - m[0] * m[7];
+  inv[8] = m[0] * m[4] - m[1] * m[3];
+  const double det = m[0] * inv[0] + m[1] * inv[3] + m[2] * inv[6];
+  if (abs(det) < 1e-24) return false;
+  for (int i = 0; i < 9; ++i) inv[i] /= det;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+size_t SimplicialCellLocator::MemorySize() const
+{
+  return _Nodes   .size() * sizeof(Node)
+       + _CellIds .size() * sizeof(vtkIdType)
+       + _PointIds.size() * sizeof(vtkIdType)
+       + _Geometry.size() * sizeof(double);
+}
+
+// =============================================================================
+// Build
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int SimplicialCellLocator::BuildNode(Array<int> &order, const Array<double> &centers,
+                                     const Array<double> &bounds, int begin, int end)
+{
+  const int index = static_cast<int>(_Nodes.size());
+  _Nodes.push_back(Node());
+
+  // Bounding box of cells and of cell centers
+  double b[6], c[6];
+  for (int d = 0; d < 3; ++d) {
+    b[2*d] = c[2*d] = +inf;
+    b[2*d+1] = c[2*d+1] = -inf;
+  }
+  for (int i = begin; i < end; ++i) {
+    const double *cb = bounds .data() + 6 * order[i];
+    const double *cc = centers.data() + 3 * order[i];
+    for (int d = 0; d < 3; ++d) {
+      b[2*d  ] = min(b[2*d  ], cb[2*d  ]);
+      b[2*d+1] = max(b[2*d+1], cb[2*d+1]);
+      c[2*d  ] = min(c[2*d  ], cc[d]);
+      c[2*d+1] = max(c[2*d+1], cc[d]);
+    }
+  }
+  memcpy(_Nodes[index]._Bounds, b, 6 * sizeof(double));
+
+  // Leaf node
+  if (end - begin <= LeafSize) {
+    _Nodes[index]._Offset = begin;
+    _Nodes[index]._Count  = end - begin;
+    return index;
+  }
+
+  // Split cells at median of cell centers along longest axis
+  int axis = 0;
+  if (c[3] - c[2] > c[2*axis+1] - c[2*axis]) axis = 1;
+  if (c[5] - c[4] > c[2*axis+1] - c[2*axis]) axis = 2;
+  const int mid = begin + (end - begin) / 2;
+  nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+              [&centers, axis](int a, int b) {
+                return centers[3 * a + axis] < centers[3 * b + axis];
+              });
+
+  BuildNode(order, centers, bounds, begin, mid);
+  const int right = BuildNode(order, centers, bounds, mid, end);
+  _Nodes[index]._Offset = right;
+  _Nodes[index]._Count  = 0;
+  return index;
+}
+
+// -----------------------------------------------------------------------------
+bool SimplicialCellLocator::Build(vtkDataSet *dataset)
+{
+  _Nodes.clear();
+  _CellIds.clear();
+  _PointIds.clear();
+  _Geometry.clear();
+  _NumberOfCells      = 0;
+  _NumberOfCellPoints = 0;
+
+  if (!IsSupported(dataset)) return false;
+
+  const int ncells = static_cast<int>(dataset->GetNumberOfCells());
+  const int npts   = (dataset->GetCellType(0) == VTK_TETRA ? 4 : 3);
+
+  // Cell bounds and centers
+  Array<double> bounds (6 * ncells);
+  Array<double> centers(3 * ncells);
+  for (int cellId = 0; cellId < ncells; ++cellId) {
+    dataset->GetCellBounds(cellId, bounds.data() + 6 * cellId);
+    double *c = centers.data() + 3 * cellId;
+    double *b = bounds .data() + 6 * cellId;
+    c[0] = .5 * (b[0] + b[1]);
+    c[1] = .5 * (b[2] + b[3]);
+    c[2] = .5 * (b[4] + b[5]);
+  }
+
+  // Build hierarchy
+  Array<int> order(ncells);
+  for (int cellId = 0; cellId < ncells; ++cellId) order[cellId] = cellId;
+  _Nodes.reserve(4 * (ncells / LeafSize + 1));
+  BuildNode(order, centers, bounds, 0, ncells);
+
+  // Store cell geometry in order of leaf nodes
+  _CellIds .resize(ncells);
+  _PointIds.resize(npts * ncells);
+  _Geometry.resize(12   * ncells);
+
+  vtkNew<vtkIdList> ptIds;
+  double p[4][3], m[9], inv[9], n[3], len;
+  for (int i = 0; i < ncells; ++i) {
+    const int cellId = order[i];
+    _CellIds[i] = cellId;
+    dataset->GetCellPoints(cellId, ptIds.GetPointer());
+    for (int j = 0; j < npts; ++j) {
+      _PointIds[npts * i + j] = ptIds->GetId(j);
+      dataset->GetPoint(ptIds->GetId(j), p[j]);
+    }
+    for (int d = 0; d < 3; ++d) {
+      m[3*d    ] = p[1][d] - p[0][d];
+      m[3*d + 1] = p[2][d] - p[0][d];
+    }
+    if (npts == 4) {
+      for (int d = 0; d < 3; ++d) {
+        m[3*d + 2] = p[3][d] - p[0][d];
+      }
+    } else {
+      n[0] = m[3] * m[7] - m[6] * m[4];
+      n[1] = m[6] * m[1] - m[0] * m[7];
+      n[2] = m[0] * m[4] - m[3] * m[1];
+      len  = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (len > .0) n[0] /= len, n[1] /= len, n[2] /= len;
+      m[2] = n[0], m[5] = n[1], m[8] = n[2];
+    }
+    if (!Invert3x3(m, inv)) {
+      // Degenerate cell never contains any point
+      for (int j = 0; j < 9; ++j) inv[j] = mirtk::nan;
+    }
+    for (int d = 0; d < 3; ++d) {
+      _Geometry[d * ncells + i] = p[0][d];
+    }
+    for (int j = 0; j < 9; ++j) {
+      _Geometry[(3 + j) * ncells + i] = inv[j];
+    }
+  }
+
+  _NumberOfCells      = ncells;
+  _NumberOfCellPoints = npts;
+  return true;
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool SimplicialCellLocator::WriteBinary(std::ostream &os) const
+{
+  const int64_t nnodes = static_cast<int64_t>(_Nodes.size());
+  const int32_t header[2] = { _NumberOfCellPoints, _NumberOfCells };
+  os.write(reinterpret_cast<const char *>(header),  sizeof(header));
+  os.write(reinterpret_cast<const char *>(&nnodes), sizeof(nnodes));
+  os.write(reinterpret_cast<const char *>(_Nodes   .data()), _Nodes   .size() * sizeof(Node));
+  Array<int64_t> ids(_CellIds.begin(), _CellIds.end());
+  os.write(reinterpret_cast<const char *>(ids.data()), ids.size() * sizeof(int64_t));
+  ids.assign(_PointIds.begin(), _PointIds.end());
+  os.write(reinterpret_cast<const char *>(ids.data()), ids.size() * sizeof(int64_t));
+  os.write(reinterpret_cast<const char *>(_Geometry.data()), _Geometry.size() * sizeof(double));
+  return !os.fail();
+}
+
+// -----------------------------------------------------------------------------
+bool SimplicialCellLocator::ReadBinary(std::istream &is)
+{
+  int32_t header[2];
+  int64_t nnodes;
+  is.read(reinterpret_cast<char *>(header),  sizeof(header));
+  is.read(reinterpret_cast<char *>(&nnodes), sizeof(nnodes));
+  if (is.fail() || (header[0] != 3 && header[0] != 4) || header[1] < 0 || nnodes < 0) {
+    return false;
+  }
+  _NumberOfCellPoints = header[0];
+  _NumberOfCells      = header[1];
+  _Nodes   .resize(static_cast<size_t>(nnodes));
+  _Geometry.resize(12 * _NumberOfCells);
+  Array<int64_t> ids(_NumberOfCells);
+  is.read(reinterpret_cast<char *>(_Nodes.data()), _Nodes.size() * sizeof(Node));
+  is.read(reinterpret_cast<char *>(ids.data()), ids.size() * sizeof(int64_t));
+  _CellIds.assign(ids.begin(), ids.end());
+  ids.resize(_NumberOfCellPoints * _NumberOfCells);
+  is.read(reinterpret_cast<char *>(ids.data()), ids.size() * sizeof(int64_t));
+  _PointIds.assign(ids.begin(), ids.end());
+  is.read(reinterpret_cast<char *>(_Geometry.data()), _Geometry.size() * sizeof(double));
+  if (is.fail()) {
+    _Nodes.clear(), _CellIds.clear(), _PointIds.clear(), _Geometry.clear();
+    _NumberOfCellPoints = _NumberOfCells = 0;
+    return false;
+  }
+  return true;
+}
+
+// =============================================================================
+// Point location
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+vtkIdType SimplicialCellLocator
+::FindCell(const double p[3], double tol2, double *w, const vtkIdType *&ptIds) const
+{
+  if (_Nodes.empty()) return -1;
+
+  const double eps = 1e-9;
+  const double tol = sqrt(tol2) + eps;
+  const int    nc  = _NumberOfCells;
+
+  double u[LeafSize], v[LeafSize], t[LeafSize], s, dx, dy, dz;
+  int    stack[64], top = 0;
+
+  stack[top++] = 0;
+  while (top > 0) {
+    const int   index = stack[--top];
+    const Node &node  = _Nodes[index];
+    if (p[0] < node._Bounds[0] - tol || p[0] > node._Bounds[1] + tol ||
+        p[1] < node._Bounds[2] - tol || p[1] > node._Bounds[3] + tol ||
+        p[2] < node._Bounds[4] - tol || p[2] > node._Bounds[5] + tol) {
+      continue;
+    }
+    if (node._Count == 0) {
+      stack[top++] = node._Offset;
+      stack[top++] = index + 1;
+      continue;
+    }
+    // Barycentric coordinates with respect to all cells of leaf
+    const int     o   = node._Offset;
+    const int     n   = node._Count;
+    const double *g   = _Geometry.data();
+    const double *ox  = g +  0 * nc + o, *oy  = g +  1 * nc + o, *oz  = g +  2 * nc + o;
+    const double *m00 = g +  3 * nc + o, *m01 = g +  4 * nc + o, *m02 = g +  5 * nc + o;
+    const double *m10 = g +  6 * nc + o, *m11 = g +  7 * nc + o, *m12 = g +  8 * nc + o;
+    const double *m20 = g +  9 * nc + o, *m21 = g + 10 * nc + o, *m22 = g + 11 * nc + o;
+    for (int c = 0; c < n; ++c) {
+      dx = p[0] - ox[c];
+      dy = p[1] - oy[c];
+      dz = p[2] - oz[c];
+      u[c] = m00[c] * dx + m01[c] * dy + m02[c] * dz;
+      v[c] = m10[c] * dx + m11[c] * dy + m12[c] * dz;
+      t[c] = m20[c] * dx + m21[c] * dy + m22[c] * dz;
+    }
+    if (_NumberOfCellPoints == 4) {
+      for (int c = 0; c < n; ++c) {
+        s = 1.0 - u[c] - v[c] - t[c];
+        if (u[c] >= -eps && v[c] >= -eps && t[c] >= -eps && s >= -eps) {
+          w[0] = s, w[1] = u[c], w[2] = v[c], w[3] = t[c];
+          ptIds = _PointIds.data() + 4 * (o + c);
+          return _CellIds[o + c];
+        }
+      }
+    } else {
+      for (int c = 0; c < n; ++c) {
+        s = 1.0 - u[c] - v[c];
+        if (u[c] >= -eps && v[c] >= -eps && s >= -eps && t[c] * t[c] <= tol2) {
+          w[0] = s, w[1] = u[c], w[2] = v[c];
+          ptIds = _PointIds.data() + 3 * (o + c);
+          return _CellIds[o + c];
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,151 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SparseMatrixOrdering.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Algorithm.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace SparseMatrixOrderingUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Breadth-first traversal of connected component of adjacency graph
+///
+/// \param[in]     root    Start node.
+/// \param[in]     degree  Number of off-diagonal entries of each row.
+/// \param[in,out] visited Marks nodes visited by previous traversals.
+/// \param[out]    queue   Appended nodes in order of traversal.
+/// \param[out]    levels  Number of levels of the level structure.
+///
+/// \returns Node of minimum degree in the last level.
+int BreadthFirstSearch(const int *offset, const int *index, const Array<int> &degree,
+                       int root, Array<char> &visited, Array<int> &queue, int &levels)
+{
+  const size_t begin = queue.size();
+  Array<int> nbrs;
+  size_t level_begin = begin, level_end;
+  int    last = root, c;
+  queue.push_back(root);
+  visited[root] = 1;
+  levels = 0;
+  while (level_begin < queue.size()) {
+    level_end = queue.size();
+    last = queue[level_begin];
+    for (size_t i = level_begin; i < level_end; ++i) {
+      const int r = queue[i];
+      if (degree[r] < degree[last]) last = r;
+      nbrs.clear();
+      for (int k = offset[r]; k < offset[r + 1]; ++k) {
+        c = index[k];
+        if (!visited[c]) {
+          visited[c] = 1;
+          nbrs.push_back(c);
+        }
+      }
+      sort(nbrs.begin(), nbrs.end(), [&degree](int a, int b) {
+        return degree[a] < degree[b] || (degree[a] == degree[b] && a < b);
+      });
+      queue.insert(queue.end(), nbrs.begin(), nbrs.end());
+    }
+    level_begin = level_end;
+    ++levels;
+  }
+  return last;
+}
+
+
+} // namespace SparseMatrixOrderingUtils
+using namespace SparseMatrixOrderingUtils;
+
+// =============================================================================
+// Orderings
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void ReverseCuthillMcKeeOrdering(int n, const int *offset, const int *index, Array<int> &order)
+{
+  const int max_root_iterations = 5;
+
+  Array<int> degree(n);
+  for (int r = 0; r < n; ++r) {
+    degree[r] = offset[r + 1] - offset[r];
+    for (int k = offset[r]; k < offset[r + 1]; ++k) {
+      if (index[k] == r) --degree[r];
+    }
+  }
+
+  order.clear();
+  order.reserve(n);
+
+  Array<char> visited(n, 0), marked(n, 0);
+  Array<int>  queue;
+  int         root, next, levels, max_levels, iter;
+
+  for (int start = 0; start < n; ++start) {
+    if (visited[start]) continue;
+
+    // Find pseudo-peripheral node of connected component, i.e., a node of
+    // minimum degree in the last level of a search with maximum no. of levels
+    root = start;
+    max_levels = 0;
+    for (iter = 0; iter < max_root_iterations; ++iter) {
+      queue.clear();
+      next = BreadthFirstSearch(offset, index, degree, root, marked, queue, levels);
+      for (size_t i = 0; i < queue.size(); ++i) marked[queue[i]] = 0;
+      if (levels <= max_levels) break;
+      max_levels = levels;
+      if (next == root) break;
+      root = next;
+    }
+
+    // Cuthill-McKee traversal of connected component
+    BreadthFirstSearch(offset, index, degree, root, visited, order, levels);
+  }
+  reverse(order.begin(), order.end());
+}
+
+// -----------------------------------------------------------------------------
+int Bandwidth(int n, const int *offset, const int *index, const int *order)
+{
+  Array<int> rank;
+  if (order) {
+    rank.resize(n);
+    for (int i = 0; i < n; ++i) rank[order[i]] = i;
+  }
+  int bandwidth = 0;
+  for (int r = 0; r < n; ++r) {
+    for (int k = offset[r]; k < offset[r + 1]; ++k) {
+      if (order) bandwidth = max(bandwidth, abs(rank[r] - rank[index[k]]));
+      else       bandwidth = max(bandwidth, abs(r - index[k]));
+    }
+  }
+  return bandwidth;
+}
+
+
+} // namespace mirtk
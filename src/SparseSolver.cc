@@ -0,0 +1,672 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SparseSolver.h"
+#include "mirtk/MapperStatistics.h"
+
+#include "mirtk/Parallel.h"
+#include "mirtk/ParallelConjugateGradient.h"
+
+#include <algorithm>
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Multi-threaded Krylov subspace solvers
+// =============================================================================
+
+namespace SparseSolverUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Multiply symmetric sparse matrix in compressed column storage by vector
+///
+/// Because the matrix is symmetric, the i-th column equals the i-th row and
+/// each output value is computed independently from the entries of one column.
+struct MultiplySymmetricColumns
+{
+  const Eigen::SparseMatrix<double> *_Matrix;
+  const double                      *_X;
+  double                            *_Y;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int    *outer = _Matrix->outerIndexPtr();
+    const int    *inner = _Matrix->innerIndexPtr();
+    const double *value = _Matrix->valuePtr();
+    double        y;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      y = .0;
+      for (int k = outer[i]; k < outer[i + 1]; ++k) {
+        y += value[k] * _X[inner[k]];
+      }
+      _Y[i] = y;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Apply diagonal preconditioner, i.e., z = D^-1 r
+struct ApplyDiagonal
+{
+  const double *_Inverse;
+  const double *_R;
+  double       *_Z;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int i = re.begin(); i != re.end(); ++i) {
+      _Z[i] = _Inverse[i] * _R[i];
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Symmetric sparse matrix with diagonal preconditioner
+struct DiagonalOperator
+{
+  const Eigen::SparseMatrix<double> *_Matrix;
+  Array<double>                      _Inverse;
+
+  DiagonalOperator(const Eigen::SparseMatrix<double> &A)
+  :
+    _Matrix(&A), _Inverse(A.cols(), 1.)
+  {
+    for (int i = 0; i < A.outerSize(); ++i) {
+      for (Eigen::SparseMatrix<double>::InnerIterator it(A, i); it; ++it) {
+        if (it.row() == i && it.value() != .0) _Inverse[i] = 1. / it.value();
+      }
+    }
+  }
+
+  void Multiply(const double *x, double *y) const
+  {
+    MultiplySymmetricColumns mul;
+    mul._Matrix = _Matrix;
+    mul._X      = x;
+    mul._Y      = y;
+    parallel_for(blocked_range<int>(0, static_cast<int>(_Matrix->cols())), mul);
+  }
+
+  void Precondition(const double *r, double *z) const
+  {
+    ApplyDiagonal precond;
+    precond._Inverse = _Inverse.data();
+    precond._R       = r;
+    precond._Z       = z;
+    parallel_for(blocked_range<int>(0, static_cast<int>(_Inverse.size())), precond);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Multiply sparse matrix in compressed row storage by vector
+struct MultiplyRows
+{
+  const Eigen::SparseMatrix<double, Eigen::RowMajor> *_Matrix;
+  const double                                       *_X;
+  double                                             *_Y;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int    *outer = _Matrix->outerIndexPtr();
+    const int    *inner = _Matrix->innerIndexPtr();
+    const double *value = _Matrix->valuePtr();
+    double        y;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      y = .0;
+      for (int k = outer[i]; k < outer[i + 1]; ++k) {
+        y += value[k] * _X[inner[k]];
+      }
+      _Y[i] = y;
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// General sparse matrix with diagonal preconditioner
+struct GeneralDiagonalOperator
+{
+  Eigen::SparseMatrix<double, Eigen::RowMajor> _Matrix;
+  Array<double>                                _Inverse;
+
+  GeneralDiagonalOperator(const Eigen::SparseMatrix<double> &A)
+  :
+    _Matrix(A), _Inverse(A.rows(), 1.)
+  {
+    _Matrix.makeCompressed();
+    for (int i = 0; i < _Matrix.outerSize(); ++i) {
+      for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(_Matrix, i); it; ++it) {
+        if (it.col() == i && it.value() != .0) _Inverse[i] = 1. / it.value();
+      }
+    }
+  }
+
+  void Multiply(const double *x, double *y) const
+  {
+    MultiplyRows mul;
+    mul._Matrix = &_Matrix;
+    mul._X      = x;
+    mul._Y      = y;
+    parallel_for(blocked_range<int>(0, static_cast<int>(_Matrix.rows())), mul);
+  }
+
+  void Precondition(const double *r, double *z) const
+  {
+    ApplyDiagonal precond;
+    precond._Inverse = _Inverse.data();
+    precond._R       = r;
+    precond._Z       = z;
+    parallel_for(blocked_range<int>(0, static_cast<int>(_Inverse.size())), precond);
+  }
+};
+
+// -----------------------------------------------------------------------------
+bool SolveConjugateGradient(const Eigen::SparseMatrix<double> &A,
+                            const Eigen::VectorXd &b, Eigen::VectorXd &x,
+                            int maxiter, double tol, bool guess, int &niter, double &error,
+                            MapperObserver *observer)
+{
+  if (!A.isCompressed()) {
+    Eigen::SparseMatrix<double> B(A);
+    B.makeCompressed();
+    return SolveConjugateGradient(B, b, x, maxiter, tol, guess, niter, error, observer);
+  }
+  const int n = static_cast<int>(A.rows());
+  if (x.rows() != n) x.setZero(n), guess = false;
+  DiagonalOperator op(A);
+  ParallelConjugateGradient(op, n, b.data(), x.data(), guess, maxiter, tol, &niter, &error, observer);
+  return !IsNaN(error);
+}
+
+// -----------------------------------------------------------------------------
+bool SolveConjugateGradient(const Eigen::SparseMatrix<double> &A,
+                            const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+                            int maxiter, double tol, bool guess, int &niter, double &error,
+                            MapperObserver *observer)
+{
+  if (!A.isCompressed()) {
+    Eigen::SparseMatrix<double> B(A);
+    B.makeCompressed();
+    return SolveConjugateGradient(B, b, x, maxiter, tol, guess, niter, error, observer);
+  }
+  const int n = static_cast<int>(A.rows());
+  if (x.rows() != n || x.cols() != b.cols()) x.setZero(n, b.cols()), guess = false;
+  DiagonalOperator op(A);
+  int    k;
+  double e;
+  niter = 0;
+  error = .0;
+  for (int j = 0; j < b.cols(); ++j) {
+    ParallelConjugateGradient(op, n, b.col(j).data(), x.col(j).data(),
+                              guess, maxiter, tol, &k, &e, observer);
+    if (IsNaN(e)) return false;
+    niter = max(niter, k);
+    error = max(error, e);
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool SolveBiCGSTAB(const Eigen::SparseMatrix<double> &A,
+                   const Eigen::VectorXd &b, Eigen::VectorXd &x,
+                   int maxiter, double tol, bool guess, int &niter, double &error,
+                   MapperObserver *observer)
+{
+  const int n = static_cast<int>(A.rows());
+  if (x.rows() != n) x.setZero(n), guess = false;
+  GeneralDiagonalOperator op(A);
+  ParallelBiCGSTAB(op, n, b.data(), x.data(), guess, maxiter, tol, &niter, &error, observer);
+  return !IsNaN(error);
+}
+
+// -----------------------------------------------------------------------------
+bool SolveBiCGSTAB(const Eigen::SparseMatrix<double> &A,
+                   const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+                   int maxiter, double tol, bool guess, int &niter, double &error,
+                   MapperObserver *observer)
+{
+  const int n = static_cast<int>(A.rows());
+  if (x.rows() != n || x.cols() != b.cols()) x.setZero(n, b.cols()), guess = false;
+  GeneralDiagonalOperator op(A);
+  int    k;
+  double e;
+  niter = 0;
+  error = .0;
+  for (int j = 0; j < b.cols(); ++j) {
+    ParallelBiCGSTAB(op, n, b.col(j).data(), x.col(j).data(),
+                     guess, maxiter, tol, &k, &e, observer);
+    if (IsNaN(e)) return false;
+    niter = max(niter, k);
+    error = max(error, e);
+  }
+  return true;
+}
+
+
+} // namespace SparseSolverUtils
+
+// =============================================================================
+// Solvers
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+struct SparseFactorization::Solvers
+{
+  Eigen::SparseLU<MatrixType, Eigen::COLAMDOrdering<int> > _LU;
+  Eigen::SimplicialLDLT<MatrixType>                         _LDLT;
+  Eigen::SimplicialLLT<MatrixType>                          _LLT;
+  Eigen::ConjugateGradient<MatrixType, Eigen::Lower|Eigen::Upper, AlgebraicMultigrid> _AMG;
+
+  #if MIRTK_Mapping_WITH_CHOLMOD
+    Eigen::CholmodSupernodalLLT<MatrixType> _CHOLMOD;
+  #endif
+  #if MIRTK_Mapping_WITH_Pardiso
+    Eigen::PardisoLLT<MatrixType> _PardisoLLT; ///< Used for SPD matrices
+    Eigen::PardisoLU<MatrixType>  _PardisoLU;
+  #endif
+
+  // Single precision solvers of mixed precision mode
+  typedef Eigen::SparseMatrix<float> FloatMatrixType;
+  FloatMatrixType                                                _Matrix;
+  Eigen::SparseLU<FloatMatrixType, Eigen::COLAMDOrdering<int> > _FloatLU;
+  Eigen::SimplicialLDLT<FloatMatrixType>                         _FloatLDLT;
+  Eigen::SimplicialLLT<FloatMatrixType>                          _FloatLLT;
+  Eigen::ConjugateGradient<FloatMatrixType, Eigen::Lower|Eigen::Upper,
+                           Eigen::DiagonalPreconditioner<float> > _FloatCG;
+};
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace SparseFactorizationUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute numeric factorization, analyzing the sparsity pattern if requested
+template <class TSolver, class TMatrix>
+bool Factorize(TSolver &solver, const TMatrix &A, bool analyze)
+{
+  // Note: SparseLU::info asserts that the numeric factorization was computed
+  if (analyze) solver.analyzePattern(A);
+  solver.factorize(A);
+  return solver.info() == Eigen::Success;
+}
+
+// -----------------------------------------------------------------------------
+/// Solve linear system using previously computed factorization
+template <class TSolver, class TRhs, class TSol>
+bool Solve(const TSolver &solver, const TRhs &b, TSol &x)
+{
+  x = solver.solve(b);
+  return solver.info() == Eigen::Success;
+}
+
+// -----------------------------------------------------------------------------
+/// Solve linear system using iterative solver with previously set up preconditioner
+template <class TSolver, class TRhs, class TSol>
+bool Solve(TSolver &solver, const TRhs &b, TSol &x,
+           int maxiter, double tol, bool guess, int &niter, double &error)
+{
+  solver.setMaxIterations(maxiter > 0 ? maxiter : 2 * static_cast<int>(b.rows()));
+  solver.setTolerance(tol > .0 ? tol : Eigen::NumTraits<double>::epsilon());
+  if (guess) x = solver.solveWithGuess(b, x);
+  else       x = solver.solve(b);
+  niter = static_cast<int>(solver.iterations());
+  error = solver.error();
+  return solver.info() != Eigen::NumericalIssue && solver.info() != Eigen::InvalidInput;
+}
+
+// -----------------------------------------------------------------------------
+/// Solve linear system using single precision solver and iterative refinement
+///
+/// \returns Whether the single precision solver succeeded. The number of
+///          refinement steps and the relative residual norm are returned
+///          as \p niter and \p error, respectively.
+template <class TSolver, class TRhs, class TSol>
+bool SolveRefined(const TSolver &solver, const SparseFactorization::MatrixType &A,
+                  const TRhs &b, TSol &x, double tol, bool guess, int &niter, double &error)
+{
+  typedef Eigen::Matrix<float, TRhs::RowsAtCompileTime, TRhs::ColsAtCompileTime> FloatType;
+
+  const int    maxsteps = 30;
+  const double eps      = (tol > .0 ? tol : 1e-12);
+  const double bnorm    = b.norm();
+
+  if (!guess) x.setZero(b.rows(), b.cols());
+  niter = 0;
+  error = .0;
+  if (bnorm == .0) {
+    x.setZero(b.rows(), b.cols());
+    return true;
+  }
+
+  TSol      r = b - A * x;
+  FloatType c;
+  for (niter = 0; niter < maxsteps; ++niter) {
+    error = r.norm() / bnorm;
+    if (error <= eps) break;
+    c = solver.solve(r.template cast<float>());
+    if (solver.info() == Eigen::NumericalIssue || solver.info() == Eigen::InvalidInput) {
+      return false;
+    }
+    x += c.template cast<double>();
+    r  = b - A * x;
+  }
+  error = r.norm() / bnorm;
+  return true;
+}
+
+
+} // namespace SparseFactorizationUtils
+using namespace SparseFactorizationUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+SparseFactorization::SparseFactorization()
+:
+  _Type(SparseSolver_Default),
+  _Mixed(false),
+  _FactorMatrixType(SparseMatrix_General),
+  _Rows(0),
+  _BlockSize(1),
+  _MixedPrecision(false),
+  _NumberOfAnalyses(0),
+  _NumberOfFactorizations(0),
+  _MatrixSolver(SparseSolver_Default),
+  _MatrixType(SparseMatrix_General),
+  _MatrixDirect(false),
+  _HasMatrix(false),
+  _Statistics(nullptr),
+  _Observer(nullptr)
+{
+}
+
+// -----------------------------------------------------------------------------
+SparseFactorization::~SparseFactorization()
+{
+}
+
+// -----------------------------------------------------------------------------
+void SparseFactorization::Clear()
+{
+  _Solvers.reset();
+  _Type = SparseSolver_Default;
+  _Mixed = false;
+  _FactorMatrixType = SparseMatrix_General;
+  _Rows = 0;
+  _OuterIndex.clear();
+  _InnerIndex.clear();
+  _Matrix = MatrixType();
+  _HasMatrix = false;
+}
+
+// =============================================================================
+// Factorization
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+bool SparseFactorization::IsReusable(SparseSolverType type) const
+{
+  if (_MixedPrecision && IsMixedPrecisionSolver(type)) return true;
+  #if MIRTK_Mapping_WITH_CHOLMOD
+    if (type == SparseSolver_CHOLMOD) return true;
+  #endif
+  #if MIRTK_Mapping_WITH_Pardiso
+    if (type == SparseSolver_Pardiso) return true;
+  #endif
+  return type == SparseSolver_LU || type == SparseSolver_LDLT || type == SparseSolver_LLT ||
+         type == SparseSolver_AMG;
+}
+
+// -----------------------------------------------------------------------------
+bool SparseFactorization::IsMixedPrecisionSolver(SparseSolverType type)
+{
+  return type == SparseSolver_LU || type == SparseSolver_LDLT || type == SparseSolver_LLT ||
+         type == SparseSolver_CG;
+}
+
+// -----------------------------------------------------------------------------
+bool SparseFactorization::Factorize(SparseSolverType type, const MatrixType &A)
+{
+  if (!A.isCompressed()) {
+    MatrixType B(A);
+    B.makeCompressed();
+    return Factorize(type, B);
+  }
+
+  MapperStatistics::Timer timer(_Statistics, "factorization");
+
+  const int  n   = static_cast<int>(A.outerSize());
+  const int  nnz = static_cast<int>(A.nonZeros());
+  const int *outer = A.outerIndexPtr();
+  const int *inner = A.innerIndexPtr();
+
+  // Compare solver, precision mode, matrix type, and sparsity pattern with
+  // the ones of the previous factorization. The matrix type selects the
+  // Pardiso solver instance, which must have analyzed the pattern before.
+  const bool mixed = (_MixedPrecision && IsMixedPrecisionSolver(type));
+  bool analyze = (!_Solvers || type != _Type || mixed != _Mixed ||
+                  _MatrixType != _FactorMatrixType || A.rows() != _Rows ||
+                  static_cast<int>(_OuterIndex.size()) != n + 1 ||
+                  static_cast<int>(_InnerIndex.size()) != nnz);
+  if (!analyze) {
+    analyze = !std::equal(_OuterIndex.begin(), _OuterIndex.end(), outer) ||
+              !std::equal(_InnerIndex.begin(), _InnerIndex.end(), inner);
+  }
+  if (analyze) {
+    _Solvers.reset(new Solvers());
+    _Solvers->_AMG.preconditioner().BlockSize(_BlockSize);
+    _Type  = type;
+    _Mixed = mixed;
+    _FactorMatrixType = _MatrixType;
+    _Rows  = static_cast<int>(A.rows());
+    _OuterIndex.assign(outer, outer + n + 1);
+    _InnerIndex.assign(inner, inner + nnz);
+    ++_NumberOfAnalyses;
+  }
+
+  bool ok = false;
+  if (mixed) {
+    Solvers::FloatMatrixType &B = _Solvers->_Matrix;
+    B = A.cast<float>();
+    switch (type) {
+      case SparseSolver_LU:   ok = SparseFactorizationUtils::Factorize(_Solvers->_FloatLU,   B, analyze); break;
+      case SparseSolver_LDLT: ok = SparseFactorizationUtils::Factorize(_Solvers->_FloatLDLT, B, analyze); break;
+      case SparseSolver_LLT:  ok = SparseFactorizationUtils::Factorize(_Solvers->_FloatLLT,  B, analyze); break;
+      case SparseSolver_CG:   ok = SparseFactorizationUtils::Factorize(_Solvers->_FloatCG,   B, analyze); break;
+      default: break;
+    }
+  } else switch (type) {
+    case SparseSolver_LU:   ok = SparseFactorizationUtils::Factorize(_Solvers->_LU,   A, analyze); break;
+    case SparseSolver_LDLT: ok = SparseFactorizationUtils::Factorize(_Solvers->_LDLT, A, analyze); break;
+    case SparseSolver_LLT:  ok = SparseFactorizationUtils::Factorize(_Solvers->_LLT,  A, analyze); break;
+    case SparseSolver_AMG:  ok = SparseFactorizationUtils::Factorize(_Solvers->_AMG,  A, analyze); break;
+    #if MIRTK_Mapping_WITH_CHOLMOD
+      case SparseSolver_CHOLMOD: {
+        ok = SparseFactorizationUtils::Factorize(_Solvers->_CHOLMOD, A, analyze);
+      } break;
+    #endif
+    #if MIRTK_Mapping_WITH_Pardiso
+      case SparseSolver_Pardiso: {
+        if (_MatrixType == SparseMatrix_SPD) {
+          ok = SparseFactorizationUtils::Factorize(_Solvers->_PardisoLLT, A, analyze);
+        } else {
+          ok = SparseFactorizationUtils::Factorize(_Solvers->_PardisoLU, A, analyze);
+        }
+      } break;
+    #endif
+    default: break;
+  }
+  if (ok) ++_NumberOfFactorizations;
+  else    Clear();
+  return ok;
+}
+
+// =============================================================================
+// Solve
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+template <class TRhs, class TSol>
+SparseSolverType SparseFactorization
+::SolveSystem(SparseSolverType type, SparseMatrixType mtype, bool direct, const MatrixType &A,
+              const TRhs &b, TSol &x, int maxiter, double tol, bool guess, int *niter, double *error)
+{
+  if (type == SparseSolver_Default) type = DefaultSparseSolver(mtype, direct);
+
+  // Retain copy of system matrix for subsequent Resolve calls, which is also
+  // the matrix referenced by the iterative solvers
+  _Matrix = A;
+  _Matrix.makeCompressed();
+  _MatrixSolver = type;
+  _MatrixType   = mtype;
+  _MatrixDirect = direct;
+  _HasMatrix    = true;
+
+  if (!IsReusable(type)) {
+    return ResolveSystem(b, x, maxiter, tol, guess, niter, error);
+  }
+  if (mtype == SparseMatrix_General && IsSymmetricSolver(type)) {
+    cerr << "SparseFactorization::Solve: " << ToString(type) << " solver requires symmetric matrix" << endl;
+    exit(1);
+  }
+  if (!Factorize(type, _Matrix)) {
+    cerr << "SparseFactorization::Solve: " << ToString(type) << " solver failed to factorize matrix" << endl;
+    exit(1);
+  }
+  return ResolveSystem(b, x, maxiter, tol, guess, niter, error);
+}
+
+// -----------------------------------------------------------------------------
+template <class TRhs, class TSol>
+SparseSolverType SparseFactorization
+::ResolveSystem(const TRhs &b, TSol &x, int maxiter, double tol, bool guess, int *niter, double *error)
+{
+  if (!_HasMatrix) {
+    cerr << "SparseFactorization::Resolve: No system matrix of previous solve retained" << endl;
+    exit(1);
+  }
+  const SparseSolverType type = _MatrixSolver;
+  const MatrixType      &A    = _Matrix;
+  MapperStatistics::Timer timer(_Statistics, "solve");
+  int    n  = 0;
+  double e  = .0;
+  if (!IsReusable(type)) {
+    const SparseSolverType used = SolveSparseLinearSystem(type, _MatrixType, _MatrixDirect, A, b, x,
+                                                          maxiter, tol, guess, &n, &e, _Observer);
+    if (niter) *niter = n;
+    if (error) *error = e;
+    if (_Statistics) {
+      _Statistics->AddLinearSolve(ToString(used), A.rows(), A.nonZeros(), n, e);
+    }
+    return used;
+  }
+  const bool mixed = (_MixedPrecision && IsMixedPrecisionSolver(type));
+  bool   ok = (_Solvers && type == _Type && mixed == _Mixed && _MatrixType == _FactorMatrixType);
+  if (ok && mixed) {
+    Solvers &s = *_Solvers;
+    if (type == SparseSolver_CG) {
+      // Inner iterations only need to reduce the residual to single precision
+      s._FloatCG.setMaxIterations(maxiter > 0 ? maxiter : 2 * static_cast<int>(A.rows()));
+      s._FloatCG.setTolerance(1e-5f);
+    }
+    switch (type) {
+      case SparseSolver_LU:   ok = SolveRefined(s._FloatLU,   A, b, x, tol, guess, n, e); break;
+      case SparseSolver_LDLT: ok = SolveRefined(s._FloatLDLT, A, b, x, tol, guess, n, e); break;
+      case SparseSolver_LLT:  ok = SolveRefined(s._FloatLLT,  A, b, x, tol, guess, n, e); break;
+      case SparseSolver_CG:   ok = SolveRefined(s._FloatCG,   A, b, x, tol, guess, n, e); break;
+      default: ok = false; break;
+    }
+  } else if (ok) {
+    switch (type) {
+      case SparseSolver_LU:   ok = SparseFactorizationUtils::Solve(_Solvers->_LU,   b, x); break;
+      case SparseSolver_LDLT: ok = SparseFactorizationUtils::Solve(_Solvers->_LDLT, b, x); break;
+      case SparseSolver_LLT:  ok = SparseFactorizationUtils::Solve(_Solvers->_LLT,  b, x); break;
+      case SparseSolver_AMG:  ok = SparseFactorizationUtils::Solve(_Solvers->_AMG,  b, x, maxiter, tol, guess, n, e); break;
+      #if MIRTK_Mapping_WITH_CHOLMOD
+        case SparseSolver_CHOLMOD: {
+          ok = SparseFactorizationUtils::Solve(_Solvers->_CHOLMOD, b, x);
+        } break;
+      #endif
+      #if MIRTK_Mapping_WITH_Pardiso
+        case SparseSolver_Pardiso: {
+          if (_MatrixType == SparseMatrix_SPD) {
+            ok = SparseFactorizationUtils::Solve(_Solvers->_PardisoLLT, b, x);
+          } else {
+            ok = SparseFactorizationUtils::Solve(_Solvers->_PardisoLU, b, x);
+          }
+        } break;
+      #endif
+      default: ok = false; break;
+    }
+  }
+  if (!ok) {
+    cerr << "SparseFactorization::Solve: " << ToString(type) << " solver failed to solve linear system" << endl;
+    exit(1);
+  }
+  if (niter) *niter = n;
+  if (error) *error = e;
+  if (_Statistics) {
+    _Statistics->AddLinearSolve(ToString(type), A.rows(), A.nonZeros(), n, e);
+  }
+  return type;
+}
+
+// -----------------------------------------------------------------------------
+SparseSolverType SparseFactorization
+::Solve(SparseSolverType type, SparseMatrixType mtype, bool direct, const MatrixType &A,
+        const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+        int maxiter, double tol, bool guess, int *niter, double *error)
+{
+  return SolveSystem(type, mtype, direct, A, b, x, maxiter, tol, guess, niter, error);
+}
+
+// -----------------------------------------------------------------------------
+SparseSolverType SparseFactorization
+::Solve(SparseSolverType type, SparseMatrixType mtype, bool direct, const MatrixType &A,
+        const Eigen::VectorXd &b, Eigen::VectorXd &x,
+        int maxiter, double tol, bool guess, int *niter, double *error)
+{
+  return SolveSystem(type, mtype, direct, A, b, x, maxiter, tol, guess, niter, error);
+}
+
+// -----------------------------------------------------------------------------
+SparseSolverType SparseFactorization
+::Resolve(const Eigen::MatrixXd &b, Eigen::MatrixXd &x,
+          int maxiter, double tol, bool guess, int *niter, double *error)
+{
+  return ResolveSystem(b, x, maxiter, tol, guess, niter, error);
+}
+
+// -----------------------------------------------------------------------------
+SparseSolverType SparseFactorization
+::Resolve(const Eigen::VectorXd &b, Eigen::VectorXd &x,
+          int maxiter, double tol, bool guess, int *niter, double *error)
+{
+  return ResolveSystem(b, x, maxiter, tol, guess, niter, error);
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,64 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SparseSolverType.h"
+
+
+namespace mirtk {
+
+
+// -----------------------------------------------------------------------------
+bool IsAvailable(SparseSolverType type)
+{
+  switch (type) {
+    #if !MIRTK_Mapping_WITH_CHOLMOD
+      case SparseSolver_CHOLMOD: return false;
+    #endif
+    #if !MIRTK_Mapping_WITH_SuperLU
+      case SparseSolver_SuperLU: return false;
+    #endif
+    #if !MIRTK_Mapping_WITH_Pardiso
+      case SparseSolver_Pardiso: return false;
+    #endif
+    default: return true;
+  }
+}
+
+// -----------------------------------------------------------------------------
+SparseSolverType DefaultSparseSolver(SparseMatrixType mtype, bool direct)
+{
+  if (direct) {
+    if (mtype == SparseMatrix_SPD) {
+      #if MIRTK_Mapping_WITH_CHOLMOD
+        return SparseSolver_CHOLMOD;
+      #else
+        return SparseSolver_LDLT;
+      #endif
+    }
+    #if MIRTK_Mapping_WITH_Pardiso
+      return SparseSolver_Pardiso;
+    #else
+      return SparseSolver_LU;
+    #endif
+  }
+  return (mtype == SparseMatrix_General ? SparseSolver_BiCGSTAB : SparseSolver_CG);
+}
+
+
+} // namespace mirtk
@@ -20,8 +20,10 @@
 #include "mirtk/SpectralConformalSurfaceMapper.h"
 
 #include "mirtk/Algorithm.h"
+#include "mirtk/Math.h"
 #include "mirtk/Triangle.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/DataArrayView.h"
 #include "mirtk/ChordLengthBoundarySegmentParameterizer.h"
 
 #include "vtkPointData.h"
@@ -29,7 +31,9 @@
 #include "vtkFloatArray.h"
 #include "vtkDoubleArray.h"
 
-#include "Eigen/Sparse"
+#include "mirtk/SparseSolver.h"
+
+#include "Eigen/Eigenvalues"
 
 
 namespace mirtk {
@@ -39,6 +43,43 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliary functions
+// =============================================================================
+
+namespace SpectralConformalSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Remove B-orthogonal projection onto the translations, i.e., the
+/// eigenvectors of eigenvalue zero, from each column of a subspace basis
+///
+/// \param[in,out] Y  Subspace basis with u values followed by v values.
+/// \param[in]     B  Diagonal of boundary point indicator matrix.
+/// \param[in]     nb Number of boundary points.
+void DeflateTranslations(Eigen::MatrixXd &Y, const Eigen::VectorXd &B, int nb)
+{
+  const int n = static_cast<int>(Y.rows() / 2);
+  for (int l = 0; l < Y.cols(); ++l) {
+    double tu = .0, tv = .0;
+    for (int i = 0; i < n; ++i) {
+      tu += B(i)     * Y(i,     l);
+      tv += B(i + n) * Y(i + n, l);
+    }
+    tu /= nb, tv /= nb;
+    for (int i = 0; i < n; ++i) {
+      Y(i,     l) -= tu;
+      Y(i + n, l) -= tv;
+    }
+  }
+}
+
+
+} // namespace SpectralConformalSurfaceMapperUtils
+
+using namespace SpectralConformalSurfaceMapperUtils;
+
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -49,6 +90,11 @@ void SpectralConformalSurfaceMapper
 {
   _NumberOfIterations = other._NumberOfIterations;
   _Tolerance          = other._Tolerance;
+  _Solver             = other._Solver;
+  _NumberOfEigenIterations = other._NumberOfEigenIterations;
+  _EigenTolerance     = other._EigenTolerance;
+  _InitialValues      = other._InitialValues;
+  _Eigenvalue         = other._Eigenvalue;
   _PointIndex         = other._PointIndex;
   _FreePoints         = other._FreePoints;
   _FixedPoints        = other._FixedPoints;
@@ -66,7 +112,11 @@ void SpectralConformalSurfaceMapper
 SpectralConformalSurfaceMapper::SpectralConformalSurfaceMapper()
 :
   _NumberOfIterations(-1),
-  _Tolerance(-1.)
+  _Tolerance(-1.),
+  _Solver(SparseSolver_Default),
+  _NumberOfEigenIterations(100),
+  _EigenTolerance(1e-6),
+  _Eigenvalue(nan)
 {
 }
 
@@ -125,22 +175,16 @@ void SpectralConformalSurfaceMapper::AddFixedPoint(int i, double u, double v)
 // -----------------------------------------------------------------------------
 double SpectralConformalSurfaceMapper::Weight(int i, int j) const
 {
-  int    k, l;
-  double a[3], b[3], c[3], w;
-
-  const int n = GetEdgeNeighborPoints(i, j, k, l);
-  if (n == 0 || n > 2) {
+  int t[2], k[2];
+  if (GetEdgeTriangles(i, j, t, k) == 0) {
     cerr << this->NameOfType() << "::Weight: Surface mesh must be triangulated!" << endl;
     exit(1);
   }
+  const class TriangleGeometry &tris = *_TriangleGeometry;
 
-  _Surface->GetPoint(static_cast<vtkIdType>(i), a);
-  _Surface->GetPoint(static_cast<vtkIdType>(k), b);
-  _Surface->GetPoint(static_cast<vtkIdType>(j), c);
-  w = Triangle::Cotangent(a, b, c);
-  if (n == 2) {
-    _Surface->GetPoint(static_cast<vtkIdType>(l), b);
-    w += Triangle::Cotangent(a, b, c);
+  double w = tris.Cotangent(t[0], k[0]);
+  if (t[1] >= 0) {
+    w += tris.Cotangent(t[1], k[1]);
   }
 
   return w;
@@ -158,13 +202,9 @@ void SpectralConformalSurfaceMapper::Initialize()
     exit(1);
   }
 
-  // Choose fixed points
+  // Complete fixed points, if any, otherwise compute spectral map
   int s, i;
-  if (NumberOfFixedPoints() == 0) {
-    i = 0;
-    s = _Boundary->FindLongestSegment();
-    AddFixedPoint(_Boundary->Segment(s).PointId(i), 0., 0.);
-  } else {
+  if (NumberOfFixedPoints() > 0) {
     s = _Boundary->FindSegment(FixedPointId(0), &i);
     if (s == -1) {
       cerr << this->NameOfType() << "::Initialize: Fixed point must be on boundary" << endl;
@@ -184,7 +224,7 @@ void SpectralConformalSurfaceMapper::Initialize()
         break;
       }
     }
-  } else {
+  } else if (NumberOfFixedPoints() > 1) {
     for (i = 1; i < NumberOfFixedPoints(); ++i) {
       if (_Boundary->FindSegment(FixedPointId(i)) != s) {
         cerr << this->NameOfType() << "::Initialize: All fixed points must be on the same boundary segment" << endl;
@@ -229,9 +269,15 @@ void SpectralConformalSurfaceMapper::Initialize()
 // -----------------------------------------------------------------------------
 void SpectralConformalSurfaceMapper::ComputeMap()
 {
+  if (NumberOfFixedPoints() == 0) {
+    ComputeSpectralMap();
+    return;
+  }
+
   const bool use_direct_solver = (_NumberOfIterations < 0 || _NumberOfIterations == 1);
 
   MIRTK_START_TIMING();
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
 
   typedef Eigen::VectorXd             Vector;
   typedef Eigen::SparseMatrix<double> Matrix;
@@ -241,6 +287,7 @@ void SpectralConformalSurfaceMapper::ComputeMap()
   const int m = 2;
 
   int i, j, ui, vi, uj, vj;
+  const DataArrayView values(_Values);
 
   Matrix A(m * n, m * n);
   Vector b(m * n);
@@ -264,11 +311,11 @@ void SpectralConformalSurfaceMapper::ComputeMap()
           w.push_back(NZEntry(vi, vj, w_ij));
           w.push_back(NZEntry(vj, vi, w_ij));
         } else if (ui >= 0) {
-          b(ui) -= w_ij * GetValue(j, 0);
-          b(vi) -= w_ij * GetValue(j, 1);
+          b(ui) -= w_ij * values.Get(j, 0);
+          b(vi) -= w_ij * values.Get(j, 1);
         } else if (uj >= 0) {
-          b(uj) -= w_ij * GetValue(i, 0);
-          b(vj) -= w_ij * GetValue(i, 1);
+          b(uj) -= w_ij * values.Get(i, 0);
+          b(vj) -= w_ij * values.Get(i, 1);
         }
         if (ui >= 0) {
           w_ii[ui] -= w_ij;
@@ -298,11 +345,11 @@ void SpectralConformalSurfaceMapper::ComputeMap()
         A.coeffRef(uj, vi) += 1.;
         A.coeffRef(vi, uj) += 1.;
       } else if (ui >= 0) {
-        b(ui) += GetValue(j, 1);
-        b(vi) -= GetValue(j, 0);
+        b(ui) += values.Get(j, 1);
+        b(vi) -= values.Get(j, 0);
       } else if (uj >= 0) {
-        b(uj) -= GetValue(i, 1);
-        b(vj) += GetValue(i, 0);
+        b(uj) -= values.Get(i, 1);
+        b(vj) += values.Get(i, 0);
       }
     }
 
@@ -310,6 +357,7 @@ void SpectralConformalSurfaceMapper::ComputeMap()
   }
 
   MIRTK_DEBUG_TIMING(1, "building sparse linear system");
+  assembly.Stop();
 
   if (verbose) {
     cout << "\n";
@@ -327,31 +375,247 @@ void SpectralConformalSurfaceMapper::ComputeMap()
   int    niter = 0;
   double error = nan;
 
-  if (use_direct_solver) {
-    Eigen::SparseLU<Matrix> solver;
-    solver.analyzePattern(A);
-    solver.factorize(A);
-    x = solver.solve(b);
-  } else {
-    Eigen::ConjugateGradient<Matrix> solver(A);
-    if (_NumberOfIterations > 0 ) solver.setMaxIterations(_NumberOfIterations);
-    if (_Tolerance          > 0.) solver.setTolerance(_Tolerance);
-    x = solver.solve(b);
-    niter = solver.iterations();
-    error = solver.error();
-  }
+  MapperStatistics::Timer timer(&_Statistics, "solve");
+  const SparseSolverType solver = SolveSparseLinearSystem(_Solver, SparseMatrix_SPD,
+                                                          use_direct_solver, A, b, x,
+                                                          _NumberOfIterations, _Tolerance,
+                                                          false, &niter, &error, _Observer);
+  timer.Stop();
+  _Statistics.AddLinearSolve(ToString(solver), A.rows(), A.nonZeros(), niter, error);
 
   for (ui = 0, vi = n; ui < n; ++ui, ++vi) {
     i = FreePointId(ui);
-    SetValue(i, 0, x(ui));
-    SetValue(i, 1, x(vi));
+    values.Set(i, 0, x(ui));
+    values.Set(i, 1, x(vi));
   }
 
   MIRTK_DEBUG_TIMING(1, "solving sparse linear system");
 
-  if (verbose && !use_direct_solver) {
-    cout << "  No. of iterations            = " << niter << "\n";
-    cout << "  Estimated error              = " << error << "\n";
+  if (verbose) {
+    cout << "  Sparse linear solver         = " << ToString(solver) << "\n";
+    if (!IsDirectSolver(solver)) {
+      cout << "  No. of iterations            = " << niter << "\n";
+      cout << "  Estimated error              = " << error << "\n";
+    }
+    cout.flush();
+  }
+}
+
+// -----------------------------------------------------------------------------
+void SpectralConformalSurfaceMapper::ComputeSpectralMap()
+{
+  MIRTK_START_TIMING();
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
+
+  typedef Eigen::VectorXd             Vector;
+  typedef Eigen::MatrixXd             DenseMatrix;
+  typedef Eigen::SparseMatrix<double> Matrix;
+  typedef Eigen::Triplet<double>      NZEntry;
+
+  const int n = NumberOfPoints();
+  const int m = 2;
+  const int p = 4; // Size of subspace, twice the multiplicity of the eigenvalue
+
+  int i, j, ui, vi, uj, vj;
+  const DataArrayView values(_Values);
+
+  // Conformal energy matrix L_C = L_D - A of all points, where the boundary
+  // area term is summed over all boundary segments, and diagonal matrix B
+  // selecting the map values of the boundary points
+  Matrix L(m * n, m * n);
+  Vector B(m * n);
+  int    nb = 0;
+  {
+    Array<NZEntry> w;
+    Array<double>  w_ii(n, .0);
+    double         w_ij;
+
+    w.reserve(m * n * (_EdgeTable->MaxNumberOfAdjacentPoints() + 1));
+
+    EdgeIterator edgeIt(*_EdgeTable);
+    for (edgeIt.InitTraversal(); edgeIt.GetNextEdge(i, j) != -1;) {
+      ui = i, vi = ui + n;
+      uj = j, vj = uj + n;
+      w_ij = - this->Weight(i, j);
+      w.push_back(NZEntry(ui, uj, w_ij));
+      w.push_back(NZEntry(uj, ui, w_ij));
+      w.push_back(NZEntry(vi, vj, w_ij));
+      w.push_back(NZEntry(vj, vi, w_ij));
+      w_ii[i] -= w_ij;
+      w_ii[j] -= w_ij;
+    }
+    for (ui = 0, vi = n; ui < n; ++ui, ++vi) {
+      w.push_back(NZEntry(ui, ui, w_ii[ui]));
+      w.push_back(NZEntry(vi, vi, w_ii[ui]));
+    }
+
+    B.setZero();
+    for (int s = 0; s < _Boundary->NumberOfSegments(); ++s) {
+      const auto &segment = _Boundary->Segment(s);
+      for (int k = 0; k < segment.NumberOfPoints(); ++k) {
+        i = segment.PointId(k);
+        j = segment.PointId(k+1);
+        ui = i, vi = ui + n;
+        uj = j, vj = uj + n;
+        w.push_back(NZEntry(ui, vj, -1.));
+        w.push_back(NZEntry(vj, ui, -1.));
+        w.push_back(NZEntry(uj, vi,  1.));
+        w.push_back(NZEntry(vi, uj,  1.));
+        if (B(ui) == .0) {
+          B(ui) = B(vi) = 1.;
+          ++nb;
+        }
+      }
+    }
+
+    L.setFromTriplets(w.begin(), w.end());
+    L.makeCompressed();
+  }
+  if (nb == 0) {
+    cerr << this->NameOfType() << "::ComputeSpectralMap: Surface has no boundary points" << endl;
+    exit(1);
+  }
+
+  // Shifted system matrix K = L_C + sigma B, which is positive definite since
+  // the null space of L_C is spanned by the translations, which B does not map
+  // to zero. Its factorization is reused by each iteration below.
+  const double sigma = 1e-6 * L.diagonal().sum() / B.sum();
+  Matrix K = L;
+  for (int r = 0; r < m * n; ++r) {
+    if (B(r) != .0) K.coeffRef(r, r) += sigma * B(r);
+  }
+  K.makeCompressed();
+
+  MIRTK_DEBUG_TIMING(1, "building generalized eigenproblem");
+  assembly.Stop();
+
+  if (verbose) {
+    cout << "\n";
+    cout << "  No. of surface points        = " << NumberOfPoints() << "\n";
+    cout << "  No. of boundary points       = " << nb << "\n";
+    cout << "  No. of non-zero coefficients = " << L.nonZeros() << "\n";
+    cout << "  Dimension of map codomain    = " << m << "\n";
+    cout.flush();
+  }
+
+  MIRTK_RESET_TIMING();
+
+  // Initial subspace, either from given map values and their rotation by
+  // 90 degrees, or from the centered point coordinates
+  DenseMatrix X(m * n, p);
+  {
+    double c[3] = {.0, .0, .0}, x[3];
+    for (i = 0; i < n; ++i) {
+      _Surface->GetPoint(i, x);
+      c[0] += x[0], c[1] += x[1], c[2] += x[2];
+    }
+    c[0] /= n, c[1] /= n, c[2] /= n;
+    for (i = 0; i < n; ++i) {
+      _Surface->GetPoint(i, x);
+      x[0] -= c[0], x[1] -= c[1], x[2] -= c[2];
+      X(i, 0) =   x[0], X(i + n, 0) = x[1];
+      X(i, 1) = - x[1], X(i + n, 1) = x[0];
+      X(i, 2) =   x[1], X(i + n, 2) = x[2];
+      X(i, 3) = - x[2], X(i + n, 3) = x[1];
+    }
+    if (_InitialValues) {
+      if (_InitialValues->GetNumberOfTuples() != static_cast<vtkIdType>(n) ||
+          _InitialValues->GetNumberOfComponents() != m) {
+        cerr << this->NameOfType() << "::ComputeSpectralMap: Initial values must have one "
+             << m << "-dimensional value per surface point" << endl;
+        exit(1);
+      }
+      const DataArrayView init(_InitialValues);
+      for (i = 0; i < n; ++i) {
+        X(i, 0) =   init.Get(i, 0), X(i + n, 0) = init.Get(i, 1);
+        X(i, 1) = - init.Get(i, 1), X(i + n, 1) = init.Get(i, 0);
+      }
+    }
+  }
+
+  DeflateTranslations(X, B, nb);
+
+  // Block inverse subspace iteration with Rayleigh-Ritz projection
+  if (!_Factorization) _Factorization = NewShared<SparseFactorization>();
+  _Factorization->Statistics(&_Statistics);
+  _Factorization->Observer(_Observer);
+
+  DenseMatrix BX(m * n, p), Y(m * n, p);
+  Vector      x(m * n), r(m * n);
+  SparseSolverType solver = SparseSolver_Default;
+  double lambda = nan, residual = inf;
+  int    iter = 0;
+
+  MapperStatistics::Timer timer(&_Statistics, "eigensolver");
+  while (iter < _NumberOfEigenIterations) {
+    BX = B.asDiagonal() * X;
+    if (iter == 0) {
+      solver = _Factorization->Solve(_Solver, SparseMatrix_SPD, true, K, BX, Y);
+    } else {
+      solver = _Factorization->Resolve(BX, Y);
+    }
+    ++iter;
+    DeflateTranslations(Y, B, nb);
+    for (int l = 0; l < p; ++l) {
+      const double norm = Y.col(l).norm();
+      if (norm > .0) Y.col(l) /= norm;
+    }
+    const DenseMatrix LY = L * Y;
+    const DenseMatrix Lr = Y.transpose() * LY;
+    const DenseMatrix Br = Y.transpose() * (B.asDiagonal() * Y);
+    Eigen::GeneralizedSelfAdjointEigenSolver<DenseMatrix> ritz(Lr, Br);
+    if (ritz.info() != Eigen::Success) {
+      if (iter == 1) {
+        cerr << this->NameOfType() << "::ComputeSpectralMap: Initial subspace is rank deficient" << endl;
+        exit(1);
+      }
+      break;
+    }
+    X = Y * ritz.eigenvectors();
+    lambda = ritz.eigenvalues()(0);
+    x = X.col(0);
+    r = LY * ritz.eigenvectors().col(0) - lambda * B.cwiseProduct(x);
+    residual = r.norm() / max(lambda * B.cwiseProduct(x).norm(), 1e-12);
+    if (verbose > 1) {
+      cout << "  Iteration " << iter << ": eigenvalue = " << lambda
+           << ", relative residual = " << residual << endl;
+    }
+    if (residual <= _EigenTolerance) break;
+    if (_Observer && !_Observer->Continue()) break;
+  }
+  timer.Stop();
+  _Statistics.AddLinearSolve(ToString(solver), K.rows(), K.nonZeros(), iter, residual);
+  _Eigenvalue = lambda;
+
+  // Scale map such that its area equals the surface area
+  double area = .0, map_area = .0;
+  {
+    const class TriangleGeometry &tris = *_TriangleGeometry;
+    double du1, dv1, du2, dv2;
+    int a, b, c;
+    for (int t = 0; t < tris.NumberOfTriangles(); ++t) {
+      a = tris.PointId(t, 0);
+      b = tris.PointId(t, 1);
+      c = tris.PointId(t, 2);
+      du1 = x(b) - x(a), dv1 = x(b + n) - x(a + n);
+      du2 = x(c) - x(a), dv2 = x(c + n) - x(a + n);
+      map_area += .5 * (du1 * dv2 - dv1 * du2);
+      area     += tris.Area(t);
+    }
+  }
+  const double scale = (map_area != .0 ? sqrt(area / abs(map_area)) : 1.);
+  for (i = 0; i < n; ++i) {
+    values.Set(i, 0, scale * x(i));
+    values.Set(i, 1, (map_area < .0 ? -scale : scale) * x(i + n));
+  }
+
+  MIRTK_DEBUG_TIMING(1, "solving generalized eigenproblem");
+
+  if (verbose) {
+    cout << "  Sparse linear solver         = " << ToString(solver) << "\n";
+    cout << "  No. of iterations            = " << iter << "\n";
+    cout << "  Eigenvalue                   = " << lambda << "\n";
+    cout << "  Relative residual            = " << residual << "\n";
     cout.flush();
   }
 }
@@ -0,0 +1,549 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SpectralTetrahedralMeshMapper.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/DataArrayView.h"
+#include "mirtk/AlgebraicMultigrid.h"
+#include "mirtk/MapperObserver.h"
+
+#include "vtkNew.h"
+#include "vtkIdList.h"
+
+#include "Eigen/SparseCore"
+#include "Eigen/Dense"
+#include "Eigen/Eigenvalues"
+
+
+namespace mirtk {
+
+
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
+// =============================================================================
+// Auxiliary functions
+// =============================================================================
+
+namespace SpectralTetrahedralMeshMapperUtils {
+
+typedef Eigen::VectorXd             Vector;
+typedef Eigen::MatrixXd             DenseMatrix;
+typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+
+// -----------------------------------------------------------------------------
+/// Compute gradients of barycentric coordinates and volume of a tetrahedron
+///
+/// \returns Whether the tetrahedron is not degenerate.
+bool TetrahedronGradients(const double *x, const int *ptIds, double g[4][3], double &volume)
+{
+  Eigen::Matrix3d e;
+  const double *p0 = x + 3 * ptIds[0];
+  for (int k = 0; k < 3; ++k) {
+    const double *p = x + 3 * ptIds[k + 1];
+    e(0, k) = p[0] - p0[0];
+    e(1, k) = p[1] - p0[1];
+    e(2, k) = p[2] - p0[2];
+  }
+  const double det = e.determinant();
+  volume = abs(det) / 6.;
+  if (volume < 1e-16) return false;
+  const Eigen::Matrix3d inv = e.inverse();
+  for (int d = 0; d < 3; ++d) {
+    g[0][d] = .0;
+    for (int k = 0; k < 3; ++k) {
+      g[k + 1][d] = inv(k, d);
+      g[0][d]    -= inv(k, d);
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Collect sorted points which share a tetrahedron with each point
+struct CollectNeighbors
+{
+  const int *_CellPoints; ///< Point IDs of each tetrahedron
+  const int *_LinkOffset; ///< Offsets into _Links of each point
+  const int *_Links;      ///< IDs of tetrahedra of each point
+  int       *_Count;      ///< Number of neighbors of each point
+  const int *_Offset;     ///< Offsets into _Neighbors if not null
+  int       *_Neighbors;  ///< Sorted neighbors of each point
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    Array<int> adj;
+    int cellId;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      adj.clear();
+      adj.push_back(i);
+      for (int l = _LinkOffset[i]; l < _LinkOffset[i + 1]; ++l) {
+        cellId = _Links[l];
+        for (int k = 0; k < 4; ++k) {
+          adj.push_back(_CellPoints[4 * cellId + k]);
+        }
+      }
+      sort(adj.begin(), adj.end());
+      adj.erase(unique(adj.begin(), adj.end()), adj.end());
+      if (_Offset) {
+        copy(adj.begin(), adj.end(), _Neighbors + _Offset[i]);
+      } else {
+        _Count[i] = static_cast<int>(adj.size());
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Add stiffness and lumped mass of tetrahedra to the rows of each point
+///
+/// Each column of the symmetric stiffness matrix, i.e., each row, is only
+/// written by the thread which processes this point.
+struct AssembleLaplacian
+{
+  const double *_Points;     ///< Point coordinates
+  const int    *_CellPoints; ///< Point IDs of each tetrahedron
+  const int    *_LinkOffset; ///< Offsets into _Links of each point
+  const int    *_Links;      ///< IDs of tetrahedra of each point
+  SparseMatrix *_Stiffness;  ///< Stiffness matrix with precomputed pattern
+  Vector       *_Mass;       ///< Lumped mass of each point
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int * const outer = _Stiffness->outerIndexPtr();
+    const int * const inner = _Stiffness->innerIndexPtr();
+    double    * const value = _Stiffness->valuePtr();
+
+    double g[4][3], volume, w;
+    int    a, j;
+    for (int i = re.begin(); i != re.end(); ++i) {
+      (*_Mass)(i) = .0;
+      for (int l = _LinkOffset[i]; l < _LinkOffset[i + 1]; ++l) {
+        const int *ptIds = _CellPoints + 4 * _Links[l];
+        if (!TetrahedronGradients(_Points, ptIds, g, volume)) continue;
+        for (a = 0; a < 4; ++a) {
+          if (ptIds[a] == i) break;
+        }
+        (*_Mass)(i) += .25 * volume;
+        for (int b = 0; b < 4; ++b) {
+          w = volume * (g[a][0] * g[b][0] + g[a][1] * g[b][1] + g[a][2] * g[b][2]);
+          j = ptIds[b];
+          const int *pos = lower_bound(inner + outer[i], inner + outer[i + 1], j);
+          value[pos - inner] += w;
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Multiply symmetric sparse matrix with each column of a dense matrix
+struct MultiplyMatrix
+{
+  const SparseMatrix *_Matrix;
+  const DenseMatrix  *_Input;
+  DenseMatrix        *_Output;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int * const outer = _Matrix->outerIndexPtr();
+    const int * const inner = _Matrix->innerIndexPtr();
+    const double * const value = _Matrix->valuePtr();
+    const DenseMatrix &X = *_Input;
+    DenseMatrix       &Y = *_Output;
+    const int m = static_cast<int>(X.cols());
+    for (int i = re.begin(); i != re.end(); ++i) {
+      for (int c = 0; c < m; ++c) Y(i, c) = .0;
+      for (int k = outer[i]; k < outer[i + 1]; ++k) {
+        const int    j = inner[k];
+        const double v = value[k];
+        for (int c = 0; c < m; ++c) {
+          Y(i, c) += v * X(j, c);
+        }
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Multiply symmetric sparse matrix with each column of a dense matrix
+void Multiply(const SparseMatrix &A, const DenseMatrix &X, DenseMatrix &Y)
+{
+  Y.resize(X.rows(), X.cols());
+  MultiplyMatrix mul;
+  mul._Matrix = &A;
+  mul._Input  = &X;
+  mul._Output = &Y;
+  parallel_for(blocked_range<int>(0, static_cast<int>(X.rows()), 1024), mul);
+}
+
+// -----------------------------------------------------------------------------
+/// Apply one multigrid V-cycle to each column of the residual block
+struct ApplyPreconditioner
+{
+  const AlgebraicMultigrid *_Preconditioner;
+  const DenseMatrix        *_Residual;
+  DenseMatrix              *_Output;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int c = re.begin(); c != re.end(); ++c) {
+      _Output->col(c) = _Preconditioner->solve(_Residual->col(c));
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Orthonormalize columns with respect to the lumped mass inner product
+///
+/// The columns are made M-orthogonal to the constant function, i.e., the
+/// eigenvector of eigenvalue zero, and to all previous columns by modified
+/// Gram-Schmidt with reorthogonalization. Columns which are numerically
+/// linearly dependent on the previous columns are removed.
+///
+/// \param[in,out] S     Subspace basis.
+/// \param[in]     mass  Diagonal of lumped mass matrix.
+/// \param[in]     first Number of columns of first block of S.
+///
+/// \returns Number of remaining columns of the first block.
+int MOrthonormalize(DenseMatrix &S, const Vector &mass, int first)
+{
+  const double one = 1.0 / sqrt(mass.sum());
+  int    ncols  = 0;
+  int    nfirst = 0;
+  double norm0, norm, dot;
+  for (int c = 0; c < S.cols(); ++c) {
+    norm0 = sqrt(S.col(c).cwiseProduct(mass).dot(S.col(c)));
+    if (norm0 == .0) continue;
+    for (int pass = 0; pass < 2; ++pass) {
+      dot = one * S.col(c).dot(mass);
+      S.col(c).array() -= dot * one;
+      for (int p = 0; p < ncols; ++p) {
+        dot = S.col(p).cwiseProduct(mass).dot(S.col(c));
+        S.col(c) -= dot * S.col(p);
+      }
+    }
+    norm = sqrt(S.col(c).cwiseProduct(mass).dot(S.col(c)));
+    if (norm <= 1e-10 * norm0) continue;
+    if (ncols != c) S.col(ncols) = S.col(c);
+    S.col(ncols) /= norm;
+    ++ncols;
+    if (c < first) ++nfirst;
+  }
+  S.conservativeResize(Eigen::NoChange, ncols);
+  return nfirst;
+}
+
+// -----------------------------------------------------------------------------
+/// Deterministic pseudo-random initial value in [-.5, .5]
+double InitialValue(int i, int c)
+{
+  unsigned int h = static_cast<unsigned int>(i + 1) * 2654435761u;
+  h ^= static_cast<unsigned int>(c + 1) * 40503u;
+  h ^= h >> 13;
+  h *= 0x5bd1e995u;
+  h ^= h >> 15;
+  return static_cast<double>(h) / 4294967295.0 - .5;
+}
+
+
+} // namespace SpectralTetrahedralMeshMapperUtils
+
+using namespace SpectralTetrahedralMeshMapperUtils;
+
+
+// =============================================================================
+// Construction/destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SpectralTetrahedralMeshMapper::CopyAttributes(const SpectralTetrahedralMeshMapper &other)
+{
+  _NumberOfEigenvectors = other._NumberOfEigenvectors;
+  _NumberOfIterations   = other._NumberOfIterations;
+  _Tolerance            = other._Tolerance;
+  _Eigenvalues          = other._Eigenvalues;
+}
+
+// -----------------------------------------------------------------------------
+SpectralTetrahedralMeshMapper::SpectralTetrahedralMeshMapper()
+:
+  _NumberOfEigenvectors(0),
+  _NumberOfIterations(500),
+  _Tolerance(1e-6)
+{
+}
+
+// -----------------------------------------------------------------------------
+SpectralTetrahedralMeshMapper
+::SpectralTetrahedralMeshMapper(const SpectralTetrahedralMeshMapper &other)
+:
+  TetrahedralMeshMapper(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+SpectralTetrahedralMeshMapper &SpectralTetrahedralMeshMapper
+::operator =(const SpectralTetrahedralMeshMapper &other)
+{
+  if (this != &other) {
+    TetrahedralMeshMapper::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+SpectralTetrahedralMeshMapper::~SpectralTetrahedralMeshMapper()
+{
+}
+
+// =============================================================================
+// Execution
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SpectralTetrahedralMeshMapper::Solve()
+{
+  const int n      = _NumberOfPoints;
+  const int ncells = static_cast<int>(_Volume->GetNumberOfCells());
+  const int dim    = static_cast<int>(_Coords->GetNumberOfComponents());
+  const int k      = (_NumberOfEigenvectors > 0 ? _NumberOfEigenvectors : dim);
+  const int m      = k + 2; // Block size, including two guard vectors
+
+  if (n <= m + 1) {
+    cerr << this->NameOfType() << "::Solve: Volume mesh has too few points for "
+         << k << " spectral coordinates" << endl;
+    exit(1);
+  }
+  if (_NumberOfBoundaryPoints <= k) {
+    cerr << this->NameOfType() << "::Solve: Number of boundary points must exceed"
+            " number of spectral coordinates" << endl;
+    exit(1);
+  }
+
+  // Build stiffness matrix of Laplace operator and lumped mass matrix
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
+  if (verbose) cout << "\nBuilding Laplace operator...", cout.flush();
+  SparseMatrix L(n, n);
+  Vector       mass(n);
+  {
+    Array<double> x(3 * n);
+    for (int ptId = 0; ptId < n; ++ptId) {
+      _Volume->GetPoint(ptId, x.data() + 3 * ptId);
+    }
+    Array<int> cellPts(4 * ncells);
+    Array<int> linkOffset(n + 1, 0);
+    vtkNew<vtkIdList> ptIds;
+    for (int cellId = 0; cellId < ncells; ++cellId) {
+      _Volume->GetCellPoints(cellId, ptIds.GetPointer());
+      if (ptIds->GetNumberOfIds() != 4) {
+        cerr << this->NameOfType() << "::Solve: Volume mesh must consist of tetrahedra only" << endl;
+        exit(1);
+      }
+      for (int i = 0; i < 4; ++i) {
+        cellPts[4 * cellId + i] = static_cast<int>(ptIds->GetId(i));
+        ++linkOffset[cellPts[4 * cellId + i] + 1];
+      }
+    }
+    for (int ptId = 0; ptId < n; ++ptId) {
+      linkOffset[ptId + 1] += linkOffset[ptId];
+    }
+    Array<int> links(linkOffset[n]);
+    {
+      Array<int> pos(linkOffset.begin(), linkOffset.end() - 1);
+      for (int cellId = 0; cellId < ncells; ++cellId) {
+        for (int i = 0; i < 4; ++i) {
+          links[pos[cellPts[4 * cellId + i]]++] = cellId;
+        }
+      }
+    }
+
+    Array<int> offset(n + 1);
+    CollectNeighbors nbrs;
+    nbrs._CellPoints = cellPts.data();
+    nbrs._LinkOffset = linkOffset.data();
+    nbrs._Links      = links.data();
+    nbrs._Count      = offset.data() + 1;
+    nbrs._Offset     = nullptr;
+    nbrs._Neighbors  = nullptr;
+    parallel_for(blocked_range<int>(0, n), nbrs);
+    offset[0] = 0;
+    for (int i = 0; i < n; ++i) {
+      offset[i + 1] += offset[i];
+    }
+    L.resizeNonZeros(offset[n]);
+    copy(offset.begin(), offset.end(), L.outerIndexPtr());
+    nbrs._Offset    = offset.data();
+    nbrs._Neighbors = L.innerIndexPtr();
+    parallel_for(blocked_range<int>(0, n), nbrs);
+    fill(L.valuePtr(), L.valuePtr() + offset[n], .0);
+
+    AssembleLaplacian assemble;
+    assemble._Points     = x.data();
+    assemble._CellPoints = cellPts.data();
+    assemble._LinkOffset = linkOffset.data();
+    assemble._Links      = links.data();
+    assemble._Stiffness  = &L;
+    assemble._Mass       = &mass;
+    parallel_for(blocked_range<int>(0, n), assemble);
+  }
+  assembly.Stop();
+  if (verbose) cout << " done" << endl;
+
+  // Algebraic multigrid preconditioner of slightly shifted operator, which
+  // is positive definite, whereas L is singular with natural boundary conditions
+  MapperStatistics::Timer setup(&_Statistics, "factorization");
+  if (verbose) cout << "Setting up multigrid preconditioner...", cout.flush();
+  AlgebraicMultigrid amg;
+  {
+    const double sigma = 1e-4 * L.diagonal().sum() / mass.sum();
+    SparseMatrix K(L);
+    K.diagonal() += sigma * mass;
+    amg.BlockSize(1);
+    amg.compute(K);
+    if (amg.info() != Eigen::Success) {
+      if (verbose) cout << " failed" << endl;
+      cerr << this->NameOfType() << "::Solve: Failed to set up multigrid preconditioner" << endl;
+      exit(1);
+    }
+  }
+  setup.Stop();
+  if (verbose) cout << " done" << endl;
+
+  // Locally optimal block preconditioned conjugate gradient method
+  MapperStatistics::Timer timer(&_Statistics, "solve");
+  if (verbose) cout << "Computing " << k << " spectral coordinates using LOBPCG...", cout.flush();
+
+  DenseMatrix X(n, m), LX, R, W, P, S, LS, C;
+  Vector      lambda;
+  {
+    double p[3];
+    for (int i = 0; i < n; ++i) {
+      _Volume->GetPoint(i, p);
+      for (int c = 0; c < m; ++c) {
+        X(i, c) = (c < 3 ? p[c] : InitialValue(i, c));
+      }
+    }
+  }
+  if (MOrthonormalize(X, mass, m) < m) {
+    if (verbose) cout << " failed" << endl;
+    cerr << this->NameOfType() << "::Solve: Failed to initialize eigenvectors" << endl;
+    exit(1);
+  }
+  Multiply(L, X, LX);
+  {
+    DenseMatrix H = X.transpose() * LX;
+    H = .5 * (H + H.transpose());
+    Eigen::SelfAdjointEigenSolver<DenseMatrix> eig(H);
+    X      = X  * eig.eigenvectors();
+    LX     = LX * eig.eigenvectors();
+    lambda = eig.eigenvalues();
+  }
+
+  int    iter  = 0;
+  double error = inf;
+  ApplyPreconditioner precond;
+  precond._Preconditioner = &amg;
+  precond._Residual       = &R;
+  precond._Output         = &W;
+  while (iter < _NumberOfIterations) {
+    ++iter;
+
+    // Residuals of current approximate eigenpairs
+    R = LX - mass.asDiagonal() * (X * lambda.asDiagonal());
+    error = .0;
+    for (int c = 0; c < k; ++c) {
+      error = max(error, R.col(c).norm() / max(LX.col(c).norm(), 1e-300));
+    }
+    if (_Observer && !_Observer->Notify("solve", iter, error)) break;
+    if (error <= _Tolerance) break;
+
+    // Preconditioned residuals
+    W.resize(n, m);
+    parallel_for(blocked_range<int>(0, m, 1), precond);
+
+    // Rayleigh-Ritz projection onto span of [X, W, P]
+    S.resize(n, m + W.cols() + P.cols());
+    S.leftCols(m) = X;
+    S.middleCols(m, W.cols()) = W;
+    if (P.cols() > 0) S.rightCols(P.cols()) = P;
+    const int nx = MOrthonormalize(S, mass, m);
+    const int ns = static_cast<int>(S.cols());
+    if (ns < m) break;
+    Multiply(L, S, LS);
+    DenseMatrix H = S.transpose() * LS;
+    H = .5 * (H + H.transpose());
+    Eigen::SelfAdjointEigenSolver<DenseMatrix> eig(H);
+    C = eig.eigenvectors().leftCols(m);
+    if (ns > nx) P = S.rightCols(ns - nx) * C.bottomRows(ns - nx);
+    else         P.resize(n, 0);
+    X      = S  * C;
+    LX     = LS * C;
+    lambda = eig.eigenvalues().head(m);
+  }
+  timer.Stop();
+  _Statistics.AddLinearSolve("LOBPCG", n, L.nonZeros(), iter, error);
+  if (verbose) {
+    cout << " done" << endl;
+    cout << "\nNo. of iterations = " << iter;
+    cout << "\nEstimated error   = " << error;
+    cout << endl;
+  }
+
+  _Eigenvalues.resize(k);
+  for (int c = 0; c < k; ++c) {
+    _Eigenvalues[c] = lambda(c);
+  }
+
+  // Affine combination of spectral coordinates fitted to the boundary map
+  const DataArrayView coords(_Coords);
+  DenseMatrix B(_NumberOfBoundaryPoints, k + 1), G(_NumberOfBoundaryPoints, dim);
+  for (int i = 0, r = 0; i < n; ++i) {
+    if (!IsBoundaryPoint(i)) continue;
+    B(r, 0) = 1.0;
+    for (int c = 0; c < k; ++c) {
+      B(r, c + 1) = X(i, c);
+    }
+    for (int j = 0; j < dim; ++j) {
+      G(r, j) = coords.Get(i, j);
+    }
+    ++r;
+  }
+  const DenseMatrix A = (B.transpose() * B).ldlt().solve(B.transpose() * G);
+  Vector phi(k + 1);
+  phi(0) = 1.0;
+  for (int i = 0; i < n; ++i) {
+    for (int c = 0; c < k; ++c) {
+      phi(c + 1) = X(i, c);
+    }
+    for (int j = 0; j < dim; ++j) {
+      coords.Set(i, j, phi.dot(A.col(j)));
+    }
+  }
+}
+
+
+} // namespace mirtk
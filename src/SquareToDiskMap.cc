@@ -0,0 +1,141 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SquareToDiskMap.h"
+
+#include "mirtk/Cfstream.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SquareToDiskMap::CopyAttributes(const SquareToDiskMap &other)
+{
+  _SquareCenter = other._SquareCenter;
+  _SquareRadius = other._SquareRadius;
+  _DiskCenter   = other._DiskCenter;
+  _DiskRadius   = other._DiskRadius;
+}
+
+// -----------------------------------------------------------------------------
+SquareToDiskMap::SquareToDiskMap()
+:
+  _SquareCenter(.0, .0, .0),
+  _SquareRadius(1.0),
+  _DiskCenter(.0, .0, .0),
+  _DiskRadius(1.0)
+{
+}
+
+// -----------------------------------------------------------------------------
+SquareToDiskMap::SquareToDiskMap(const SquareToDiskMap &other)
+:
+  AnalyticMapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+SquareToDiskMap &SquareToDiskMap::operator =(const SquareToDiskMap &other)
+{
+  if (this != &other) {
+    AnalyticMapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void SquareToDiskMap::Initialize()
+{
+  AnalyticMapping::Initialize();
+  if (_SquareRadius <= .0 || _DiskRadius <= .0) {
+    cerr << this->NameOfType() << "::Initialize: Square and disk radius must be positive" << endl;
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *SquareToDiskMap::NewCopy() const
+{
+  return new SquareToDiskMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+SquareToDiskMap::~SquareToDiskMap()
+{
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SquareToDiskMap::BoundingBox(double &x1, double &y1, double &z1,
+                                  double &x2, double &y2, double &z2) const
+{
+  x1 = _SquareCenter._x - _SquareRadius;
+  y1 = _SquareCenter._y - _SquareRadius;
+  x2 = _SquareCenter._x + _SquareRadius;
+  y2 = _SquareCenter._y + _SquareRadius;
+  z1 = z2 = .0;
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SquareToDiskMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  EvaluatePoints(this, n, xyz, values, inside);
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SquareToDiskMap::ReadMap(Cifstream &is)
+{
+  double params[6];
+  is.ReadAsDouble(params, 6);
+  _SquareCenter = Point(params[0], params[1], .0);
+  _SquareRadius = params[2];
+  _DiskCenter   = Point(params[3], params[4], .0);
+  _DiskRadius   = params[5];
+}
+
+// -----------------------------------------------------------------------------
+void SquareToDiskMap::WriteMap(Cofstream &os) const
+{
+  const double params[6] = {
+    _SquareCenter._x, _SquareCenter._y, _SquareRadius,
+    _DiskCenter._x,   _DiskCenter._y,   _DiskRadius
+  };
+  os.WriteAsDouble(params, 6);
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,145 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/StereographicMap.h"
+
+#include "mirtk/Cfstream.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void StereographicMap::CopyAttributes(const StereographicMap &other)
+{
+  _SphereCenter = other._SphereCenter;
+  _SphereRadius = other._SphereRadius;
+  _Pole         = other._Pole;
+  _PlaneOffset  = other._PlaneOffset;
+}
+
+// -----------------------------------------------------------------------------
+StereographicMap::StereographicMap()
+:
+  _SphereCenter(.0, .0, .0),
+  _SphereRadius(1.0),
+  _Pole(SpherePole_North),
+  _PlaneOffset(.0)
+{
+}
+
+// -----------------------------------------------------------------------------
+StereographicMap::StereographicMap(const StereographicMap &other)
+:
+  AnalyticMapping(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+StereographicMap &StereographicMap::operator =(const StereographicMap &other)
+{
+  if (this != &other) {
+    AnalyticMapping::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+void StereographicMap::Initialize()
+{
+  AnalyticMapping::Initialize();
+  if (_SphereRadius <= .0) {
+    cerr << this->NameOfType() << "::Initialize: Sphere radius must be positive" << endl;
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+Mapping *StereographicMap::NewCopy() const
+{
+  return new StereographicMap(*this);
+}
+
+// -----------------------------------------------------------------------------
+StereographicMap::~StereographicMap()
+{
+}
+
+// =============================================================================
+// Map domain
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void StereographicMap::BoundingBox(double &x1, double &y1, double &z1,
+                                   double &x2, double &y2, double &z2) const
+{
+  x1 = _SphereCenter._x - _SphereRadius;
+  y1 = _SphereCenter._y - _SphereRadius;
+  z1 = _SphereCenter._z - _SphereRadius;
+  x2 = _SphereCenter._x + _SphereRadius;
+  y2 = _SphereCenter._y + _SphereRadius;
+  z2 = _SphereCenter._z + _SphereRadius;
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void StereographicMap::Evaluate(int n, const double *xyz, double *values, bool *inside) const
+{
+  EvaluatePoints(this, n, xyz, values, inside);
+}
+
+// =============================================================================
+// I/O
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void StereographicMap::ReadMap(Cifstream &is)
+{
+  double params[5];
+  int    pole;
+  is.ReadAsDouble(params, 5);
+  is.ReadAsInt(&pole, 1);
+  _SphereCenter = Point(params[0], params[1], params[2]);
+  _SphereRadius = params[3];
+  _PlaneOffset  = params[4];
+  _Pole         = static_cast<SpherePole>(pole);
+}
+
+// -----------------------------------------------------------------------------
+void StereographicMap::WriteMap(Cofstream &os) const
+{
+  const double params[5] = {
+    _SphereCenter._x, _SphereCenter._y, _SphereCenter._z, _SphereRadius, _PlaneOffset
+  };
+  const int pole = static_cast<int>(_Pole);
+  os.WriteAsDouble(params, 5);
+  os.WriteAsInt(&pole, 1);
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,422 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SurfaceMapQuality.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/EdgeTable.h"
+#include "mirtk/Triangle.h"
+#include "mirtk/Vtk.h"
+
+#include "vtkNew.h"
+#include "vtkIdList.h"
+#include "vtkPolyData.h"
+#include "vtkFloatArray.h"
+#include "vtkMath.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace SurfaceMapQualityUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute area, edge lengths, and signed parametric area of each triangle
+struct ComputeTriangleMeasures
+{
+  vtkPolyData  *_Surface;
+  vtkDataArray *_Values;
+  const int    *_PointIds;
+  const char   *_IsEdgeOwner;
+  double        _AreaTolerance;
+  double       *_Area1;
+  double       *_Area2;
+  double       *_Length1;
+  double       *_Length2;
+  float        *_SignedArea;
+
+  double _SumArea1;
+  double _SumArea2;
+  double _SumLength1;
+  double _SumLength2;
+  int    _NumberOfPositive;
+  int    _NumberOfNegative;
+  int    _NumberOfZero;
+
+  ComputeTriangleMeasures()
+  :
+    _SumArea1(.0), _SumArea2(.0), _SumLength1(.0), _SumLength2(.0),
+    _NumberOfPositive(0), _NumberOfNegative(0), _NumberOfZero(0)
+  {}
+
+  ComputeTriangleMeasures(const ComputeTriangleMeasures &other, split)
+  :
+    _Surface(other._Surface),
+    _Values(other._Values),
+    _PointIds(other._PointIds),
+    _IsEdgeOwner(other._IsEdgeOwner),
+    _AreaTolerance(other._AreaTolerance),
+    _Area1(other._Area1),
+    _Area2(other._Area2),
+    _Length1(other._Length1),
+    _Length2(other._Length2),
+    _SignedArea(other._SignedArea),
+    _SumArea1(.0), _SumArea2(.0), _SumLength1(.0), _SumLength2(.0),
+    _NumberOfPositive(0), _NumberOfNegative(0), _NumberOfZero(0)
+  {}
+
+  void join(const ComputeTriangleMeasures &other)
+  {
+    _SumArea1         += other._SumArea1;
+    _SumArea2         += other._SumArea2;
+    _SumLength1       += other._SumLength1;
+    _SumLength2       += other._SumLength2;
+    _NumberOfPositive += other._NumberOfPositive;
+    _NumberOfNegative += other._NumberOfNegative;
+    _NumberOfZero     += other._NumberOfZero;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    const double eps = 1e-12;
+
+    int    i, j, e;
+    double p[3][3], u[3][3] = {{.0}}, A;
+
+    for (int t = re.begin(); t != re.end(); ++t) {
+      for (int k = 0; k < 3; ++k) {
+        _Surface->GetPoint(static_cast<vtkIdType>(_PointIds[3 * t + k]), p[k]);
+        _Values->GetTuple(static_cast<vtkIdType>(_PointIds[3 * t + k]), u[k]);
+      }
+      if (_Area1) {
+        _Area1[t] = Triangle::DoubleArea(p[0], p[1], p[2]) + eps;
+        _Area2[t] = Triangle::DoubleArea(u[0], u[1], u[2]) + eps;
+        _SumArea1 += _Area1[t];
+        _SumArea2 += _Area2[t];
+      }
+      if (_Length1) {
+        for (int k = 0; k < 3; ++k) {
+          i = (k + 1) % 3, j = (k + 2) % 3, e = 3 * t + k;
+          _Length1[e] = sqrt(vtkMath::Distance2BetweenPoints(p[i], p[j])) + eps;
+          _Length2[e] = sqrt(vtkMath::Distance2BetweenPoints(u[i], u[j])) + eps;
+          if (_IsEdgeOwner[e]) {
+            _SumLength1 += _Length1[e];
+            _SumLength2 += _Length2[e];
+          }
+        }
+      }
+      if (_SignedArea) {
+        A = Triangle::SignedArea2D(u[0], u[1], u[2]);
+        if (abs(A) < _AreaTolerance) A = .0;
+        _SignedArea[t] = static_cast<float>(A);
+        if      (A < .0) ++_NumberOfNegative;
+        else if (A > .0) ++_NumberOfPositive;
+        else             ++_NumberOfZero;
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Normalize area and edge-length ratios and sum squared deviations from one
+struct EvaluateDistortion
+{
+  const char   *_IsEdgeOwner;
+  const double *_Area1;
+  const double *_Area2;
+  const double *_Length1;
+  const double *_Length2;
+  double        _AreaNorm;
+  double        _LengthNorm;
+  float        *_CellAreaDistortion;
+  float        *_CellEdgeLengthDistortion;
+
+  double _SumAreaError;
+  double _SumLengthError;
+
+  EvaluateDistortion()
+  :
+    _SumAreaError(.0), _SumLengthError(.0)
+  {}
+
+  EvaluateDistortion(const EvaluateDistortion &other, split)
+  :
+    _IsEdgeOwner(other._IsEdgeOwner),
+    _Area1(other._Area1),
+    _Area2(other._Area2),
+    _Length1(other._Length1),
+    _Length2(other._Length2),
+    _AreaNorm(other._AreaNorm),
+    _LengthNorm(other._LengthNorm),
+    _CellAreaDistortion(other._CellAreaDistortion),
+    _CellEdgeLengthDistortion(other._CellEdgeLengthDistortion),
+    _SumAreaError(.0), _SumLengthError(.0)
+  {}
+
+  void join(const EvaluateDistortion &other)
+  {
+    _SumAreaError   += other._SumAreaError;
+    _SumLengthError += other._SumLengthError;
+  }
+
+  void operator ()(const blocked_range<int> &re)
+  {
+    int    e;
+    double scale, sum;
+
+    for (int t = re.begin(); t != re.end(); ++t) {
+      if (_Area1) {
+        scale = _AreaNorm * _Area2[t] / _Area1[t];
+        _CellAreaDistortion[t] = static_cast<float>(scale);
+        _SumAreaError += pow(scale - 1., 2);
+      }
+      if (_Length1) {
+        sum = .0;
+        for (int k = 0; k < 3; ++k) {
+          e = 3 * t + k;
+          scale = _LengthNorm * _Length1[e] / _Length2[e];
+          if (_IsEdgeOwner[e]) _SumLengthError += pow(scale - 1., 2);
+          sum += scale;
+        }
+        _CellEdgeLengthDistortion[t] = static_cast<float>(sum / 3.);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Create new single component cell data array
+vtkSmartPointer<vtkDataArray> NewCellArray(const char *name, vtkIdType ncells)
+{
+  vtkSmartPointer<vtkDataArray> array = vtkSmartPointer<vtkFloatArray>::New();
+  array->SetName(name);
+  array->SetNumberOfComponents(1);
+  array->SetNumberOfTuples(ncells);
+  return array;
+}
+
+
+} // namespace SurfaceMapQualityUtils
+using namespace SurfaceMapQualityUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SurfaceMapQuality::CopyAttributes(const SurfaceMapQuality &other)
+{
+  _Map                          = other._Map;
+  _EvaluateSignedArea           = other._EvaluateSignedArea;
+  _EvaluateAreaDistortion       = other._EvaluateAreaDistortion;
+  _EvaluateEdgeLengthDistortion = other._EvaluateEdgeLengthDistortion;
+  _AreaTolerance                = other._AreaTolerance;
+  _SignedArea                   = other._SignedArea;
+  _CellAreaDistortion           = other._CellAreaDistortion;
+  _CellEdgeLengthDistortion     = other._CellEdgeLengthDistortion;
+  _NumberOfFlippedTriangles     = other._NumberOfFlippedTriangles;
+  _NumberOfDegeneratedTriangles = other._NumberOfDegeneratedTriangles;
+  _AreaDistortion               = other._AreaDistortion;
+  _EdgeLengthDistortion         = other._EdgeLengthDistortion;
+}
+
+// -----------------------------------------------------------------------------
+SurfaceMapQuality::SurfaceMapQuality()
+:
+  _Map(nullptr),
+  _EvaluateSignedArea(true),
+  _EvaluateAreaDistortion(true),
+  _EvaluateEdgeLengthDistortion(true),
+  _AreaTolerance(1e-9),
+  _NumberOfFlippedTriangles(0),
+  _NumberOfDegeneratedTriangles(0),
+  _AreaDistortion(.0),
+  _EdgeLengthDistortion(.0)
+{
+}
+
+// -----------------------------------------------------------------------------
+SurfaceMapQuality::SurfaceMapQuality(const SurfaceMapQuality &other)
+:
+  Object(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+SurfaceMapQuality &SurfaceMapQuality::operator =(const SurfaceMapQuality &other)
+{
+  if (this != &other) {
+    Object::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+SurfaceMapQuality::~SurfaceMapQuality()
+{
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SurfaceMapQuality::Run()
+{
+  _SignedArea                   = nullptr;
+  _CellAreaDistortion           = nullptr;
+  _CellEdgeLengthDistortion     = nullptr;
+  _NumberOfFlippedTriangles     = 0;
+  _NumberOfDegeneratedTriangles = 0;
+  _AreaDistortion               = .0;
+  _EdgeLengthDistortion         = .0;
+
+  if (_Map == nullptr) {
+    cerr << this->NameOfType() << "::Run: Input map not set" << endl;
+    exit(1);
+  }
+  vtkPolyData * const surface = vtkPolyData::SafeDownCast(_Map->Domain());
+  if (surface == nullptr) {
+    cerr << this->NameOfType() << "::Run: Surface map domain must be surface mesh (i.e., vtkPolyData)" << endl;
+    exit(1);
+  }
+  vtkDataArray * const values = _Map->Values();
+  if (values->GetNumberOfComponents() < 2 || values->GetNumberOfComponents() > 3) {
+    cerr << this->NameOfType() << "::Run: Surface map must have codomain dimension 2 or 3" << endl;
+    exit(1);
+  }
+  if (_EvaluateSignedArea && values->GetNumberOfComponents() != 2) {
+    cerr << this->NameOfType() << "::Run: Signed area requires piecewise linear 2D parameterization" << endl;
+    exit(1);
+  }
+
+  // Collect point IDs of triangles
+  const int ntris = static_cast<int>(surface->GetNumberOfCells());
+  if (ntris == 0) return;
+
+  Array<int> ptIds(3 * ntris);
+  vtkNew<vtkIdList> cellPtIds;
+  for (int t = 0; t < ntris; ++t) {
+    GetCellPoints(surface, static_cast<vtkIdType>(t), cellPtIds.GetPointer());
+    if (cellPtIds->GetNumberOfIds() != 3) {
+      cerr << this->NameOfType() << "::Run: Map domain must be triangulated" << endl;
+      exit(1);
+    }
+    for (int k = 0; k < 3; ++k) {
+      ptIds[3 * t + k] = static_cast<int>(cellPtIds->GetId(k));
+    }
+  }
+
+  // Assign each edge to the first triangle which contains it
+  Array<char> owner;
+  int nedges = 0;
+  if (_EvaluateEdgeLengthDistortion) {
+    EdgeTable edgeTable(surface);
+    Array<char> visited(edgeTable.NumberOfEdges(), 0);
+    owner.resize(3 * ntris, 0);
+    int edgeId;
+    for (int t = 0; t < ntris; ++t)
+    for (int k = 0; k < 3; ++k) {
+      edgeId = edgeTable.EdgeId(ptIds[3 * t + (k + 1) % 3], ptIds[3 * t + (k + 2) % 3]);
+      if (edgeId >= 0 && !visited[edgeId]) {
+        visited[edgeId] = 1;
+        owner[3 * t + k] = 1;
+        ++nedges;
+      }
+    }
+  }
+
+  // Compute triangle measures before and after mapping
+  Array<double> A1, A2, d1, d2;
+  if (_EvaluateAreaDistortion) {
+    A1.resize(ntris);
+    A2.resize(ntris);
+  }
+  if (_EvaluateEdgeLengthDistortion) {
+    d1.resize(3 * ntris);
+    d2.resize(3 * ntris);
+  }
+  if (_EvaluateSignedArea) {
+    _SignedArea = NewCellArray("SignedArea", ntris);
+  }
+
+  ComputeTriangleMeasures measures;
+  measures._Surface       = surface;
+  measures._Values        = values;
+  measures._PointIds      = ptIds.data();
+  measures._IsEdgeOwner   = owner.data();
+  measures._AreaTolerance = _AreaTolerance;
+  measures._Area1         = (A1.empty() ? nullptr : A1.data());
+  measures._Area2         = (A2.empty() ? nullptr : A2.data());
+  measures._Length1       = (d1.empty() ? nullptr : d1.data());
+  measures._Length2       = (d2.empty() ? nullptr : d2.data());
+  measures._SignedArea    = nullptr;
+  if (_SignedArea) {
+    measures._SignedArea = vtkFloatArray::SafeDownCast(_SignedArea)->GetPointer(0);
+  }
+  parallel_reduce(blocked_range<int>(0, ntris), measures);
+
+  if (_EvaluateSignedArea) {
+    _NumberOfFlippedTriangles     = min(measures._NumberOfPositive, measures._NumberOfNegative);
+    _NumberOfDegeneratedTriangles = measures._NumberOfZero;
+  }
+
+  // Evaluate normalized distortion measures
+  if (_EvaluateAreaDistortion || _EvaluateEdgeLengthDistortion) {
+    EvaluateDistortion distortion;
+    distortion._IsEdgeOwner              = measures._IsEdgeOwner;
+    distortion._Area1                    = measures._Area1;
+    distortion._Area2                    = measures._Area2;
+    distortion._Length1                  = measures._Length1;
+    distortion._Length2                  = measures._Length2;
+    distortion._AreaNorm                 = .0;
+    distortion._LengthNorm               = .0;
+    distortion._CellAreaDistortion       = nullptr;
+    distortion._CellEdgeLengthDistortion = nullptr;
+    if (_EvaluateAreaDistortion) {
+      _CellAreaDistortion = NewCellArray("AreaDistortion", ntris);
+      distortion._CellAreaDistortion = vtkFloatArray::SafeDownCast(_CellAreaDistortion)->GetPointer(0);
+      distortion._AreaNorm = measures._SumArea1 / measures._SumArea2;
+    }
+    if (_EvaluateEdgeLengthDistortion) {
+      _CellEdgeLengthDistortion = NewCellArray("EdgeLengthDistortion", ntris);
+      distortion._CellEdgeLengthDistortion = vtkFloatArray::SafeDownCast(_CellEdgeLengthDistortion)->GetPointer(0);
+      if (nedges > 0) distortion._LengthNorm = measures._SumLength2 / measures._SumLength1;
+    }
+    parallel_reduce(blocked_range<int>(0, ntris), distortion);
+    if (_EvaluateAreaDistortion) {
+      _AreaDistortion = sqrt(distortion._SumAreaError / ntris);
+    }
+    if (_EvaluateEdgeLengthDistortion && nedges > 0) {
+      _EdgeLengthDistortion = sqrt(distortion._SumLengthError / nedges);
+    }
+  }
+}
+
+
+} // namespace mirtk
@@ -20,6 +20,7 @@
 #include "mirtk/SurfaceMapper.h"
 
 #include "mirtk/Assert.h"
+#include "mirtk/Memory.h"
 #include "mirtk/Vtk.h"
 
 #include "vtkIdList.h"
@@ -35,9 +36,14 @@ namespace mirtk {
 // -----------------------------------------------------------------------------
 void SurfaceMapper::CopyAttributes(const SurfaceMapper &other)
 {
-  _Surface   = other._Surface;
-  _Boundary  = other._Boundary;
-  _EdgeTable = other._EdgeTable;
+  _Surface          = other._Surface;
+  _Boundary         = other._Boundary;
+  _EdgeTable        = other._EdgeTable;
+  _TriangleGeometry = other._TriangleGeometry;
+  _Topology         = other._Topology;
+  _Statistics       = other._Statistics;
+  _Observer         = other._Observer;
+  _CompactOutput    = other._CompactOutput;
 
   if (other._Output) {
     _Output = SharedPtr<Mapping>(other._Output->NewCopy());
@@ -48,6 +54,9 @@ void SurfaceMapper::CopyAttributes(const SurfaceMapper &other)
 
 // -----------------------------------------------------------------------------
 SurfaceMapper::SurfaceMapper()
+:
+  _Observer(nullptr),
+  _CompactOutput(false)
 {
 }
 
@@ -72,6 +81,21 @@ SurfaceMapper::~SurfaceMapper()
 {
 }
 
+// =============================================================================
+// Input
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void SurfaceMapper::Topology(const SharedPtr<const SurfaceTopology> &topology)
+{
+  _Topology = topology;
+  if (topology) {
+    _Surface   = topology->Surface();
+    _EdgeTable = topology->EdgeTable();
+    _Boundary  = topology->Boundary();
+  }
+}
+
 // =============================================================================
 // Execution
 // =============================================================================
@@ -79,9 +103,25 @@ SurfaceMapper::~SurfaceMapper()
 // -----------------------------------------------------------------------------
 void SurfaceMapper::Run()
 {
-  this->Initialize();
-  this->ComputeMap();
-  this->Finalize();
+  _Statistics.Clear();
+  _Statistics.Mapper(this->NameOfClass());
+  if (_Observer) _Observer->Start();
+  MapperStatistics::Timer run(&_Statistics, "run");
+  {
+    MapperStatistics::Timer timer(&_Statistics, "initialize");
+    this->Initialize();
+  }
+  if (!_Observer || _Observer->Continue()) {
+    MapperStatistics::Timer timer(&_Statistics, "compute");
+    this->ComputeMap();
+  }
+  {
+    MapperStatistics::Timer timer(&_Statistics, "finalize");
+    this->Finalize();
+  }
+  run.Stop();
+  _Statistics.Status(_Observer ? _Observer->Status() : MapperStatus_Completed);
+  _Statistics.UpdatePeakMemory();
 }
 
 // -----------------------------------------------------------------------------
@@ -100,17 +140,33 @@ void SurfaceMapper::Initialize()
     exit(1);
   }
 
+  // Use topology context shared with other mappers, which must not modify the surface
+  const bool shared = (_Topology && _Topology->Surface() == _Surface);
+
   // Build links
-  _Surface->BuildLinks();
+  if (!shared) {
+    _Surface->BuildLinks();
+  }
 
   // Determine adjacencies
   if (!_EdgeTable) {
-    _EdgeTable = SharedPtr<class EdgeTable>(new class EdgeTable(_Surface));
+    if (shared) _EdgeTable = _Topology->EdgeTable();
+    else _EdgeTable = SharedPtr<class EdgeTable>(new class EdgeTable(_Surface));
   }
 
   // Extract boundaries
   if (!_Boundary) {
-    _Boundary = SharedPtr<SurfaceBoundary>(new SurfaceBoundary(_Surface, _EdgeTable));
+    if (shared) _Boundary = _Topology->Boundary();
+    else _Boundary = SharedPtr<SurfaceBoundary>(new SurfaceBoundary(_Surface, _EdgeTable));
+  }
+
+  // Compute geometry of triangles
+  if (shared && _EdgeTable == _Topology->EdgeTable()) {
+    _TriangleGeometry = _Topology->TriangleGeometry();
+  } else if (_Surface->GetNumberOfPolys() > 0) {
+    _TriangleGeometry = NewShared<class TriangleGeometry>(_Surface, _EdgeTable.get());
+  } else {
+    _TriangleGeometry = nullptr;
   }
 }
 
@@ -119,6 +175,9 @@ void SurfaceMapper::Finalize()
 {
   // Check that subclass produced output map
   mirtkAssert(_Output != nullptr, "output surface map is not nullptr");
+
+  // Convert output map to compact storage
+  if (_CompactOutput && _Output) _Output->Compact();
 }
 
 // =============================================================================
@@ -154,5 +213,18 @@ int SurfaceMapper::GetEdgeNeighborPoints(int i, int j, int &k, int &l) const
   return ncells;
 }
 
+// -----------------------------------------------------------------------------
+int SurfaceMapper::GetEdgeTriangles(int i, int j, int t[2], int k[2]) const
+{
+  if (!_TriangleGeometry || !_TriangleGeometry->IsTriangulated()) {
+    cerr << this->NameOfType() << "::GetEdgeTriangles: Surface mesh must be triangulated!" << endl;
+    exit(1);
+  }
+  const int n = _TriangleGeometry->GetEdgeTriangles(i, j, t[0], t[1]);
+  k[0] = (t[0] >= 0 ? _TriangleGeometry->OppositeCorner(t[0], i, j) : -1);
+  k[1] = (t[1] >= 0 ? _TriangleGeometry->OppositeCorner(t[1], i, j) : -1);
+  return n;
+}
+
 
 } // namespace mirtk
@@ -0,0 +1,110 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/SurfaceTopology.h"
+
+#include "mirtk/Parallel.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace SurfaceTopologyUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Extract boundary and compute triangle geometry concurrently, both of
+/// which only read the surface and its edge table
+struct ComputeBoundaryAndTriangleGeometry
+{
+  vtkPolyData                       *_Surface;
+  const SharedPtr<EdgeTable>        *_EdgeTable;
+  SharedPtr<SurfaceBoundary>        *_Boundary;
+  SharedPtr<TriangleGeometry>       *_TriangleGeometry;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    for (int task = re.begin(); task != re.end(); ++task) {
+      if (task == 0) {
+        *_Boundary = NewShared<SurfaceBoundary>(_Surface, *_EdgeTable);
+      } else if (_Surface->GetNumberOfPolys() > 0) {
+        *_TriangleGeometry = NewShared<TriangleGeometry>(_Surface, _EdgeTable->get());
+      }
+    }
+  }
+};
+
+
+} // namespace SurfaceTopologyUtils
+using namespace SurfaceTopologyUtils;
+
+// =============================================================================
+// Construction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+SurfaceTopology::SurfaceTopology(vtkPolyData *surface)
+:
+  _Surface(surface)
+{
+  if (!surface) {
+    cerr << "SurfaceTopology::SurfaceTopology: Missing surface mesh" << endl;
+    exit(1);
+  }
+
+  // Build links before the surface is shared read-only
+  _Surface->BuildLinks();
+  _EdgeTable = NewShared<class EdgeTable>(_Surface);
+
+  ComputeBoundaryAndTriangleGeometry eval;
+  eval._Surface          = _Surface;
+  eval._EdgeTable        = &_EdgeTable;
+  eval._Boundary         = &_Boundary;
+  eval._TriangleGeometry = &_TriangleGeometry;
+  parallel_for(blocked_range<int>(0, 2, 1), eval);
+
+  // Partition points into interior and boundary points
+  const int n = static_cast<int>(_Surface->GetNumberOfPoints());
+  Array<bool> is_boundary(n, false);
+  for (int s = 0; s < _Boundary->NumberOfSegments(); ++s) {
+    const auto &segment = _Boundary->Segment(s);
+    for (int k = 0; k < segment.NumberOfPoints(); ++k) {
+      is_boundary[segment.PointId(k)] = true;
+    }
+  }
+  _PointIndex.resize(n);
+  _InteriorPoints.reserve(n);
+  for (int ptId = 0; ptId < n; ++ptId) {
+    if (is_boundary[ptId]) {
+      _PointIndex[ptId] = -(static_cast<int>(_BoundaryPoints.size()) + 1);
+      _BoundaryPoints.push_back(ptId);
+    } else {
+      _PointIndex[ptId] = static_cast<int>(_InteriorPoints.size());
+      _InteriorPoints.push_back(ptId);
+    }
+  }
+  _InteriorPoints.shrink_to_fit();
+}
+
+
+} // namespace mirtk
@@ -21,10 +21,11 @@
 
 #include "mirtk/EdgeTable.h"
 
-#include "Eigen/SparseCore"
-#include "Eigen/SparseLU"
-#include "Eigen/OrderingMethods"
-#include "Eigen/IterativeLinearSolvers"
+#include "mirtk/Memory.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/DataArrayView.h"
+#include "mirtk/SparseSolver.h"
+#include "mirtk/MapperWorkspace.h"
 
 
 namespace mirtk {
@@ -34,6 +35,36 @@ namespace mirtk {
 MIRTK_Common_EXPORT extern int verbose;
 
 
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace SymmetricWeightsSurfaceMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute weights of undirected edges in parallel
+struct ComputeEdgeWeights
+{
+  const SymmetricWeightsSurfaceMapper *_Mapper;
+  const int                           *_Edges;
+  double                              *_Weights;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    // Skip remaining edges when time limit exceeded or run cancelled
+    MapperObserver * const observer = _Mapper->Observer();
+    if (observer && !observer->Continue()) return;
+    for (int e = re.begin(); e != re.end(); ++e) {
+      _Weights[e] = _Mapper->Weight(_Edges[2 * e], _Edges[2 * e + 1]);
+    }
+  }
+};
+
+
+} // namespace SymmetricWeightsSurfaceMapperUtils
+using namespace SymmetricWeightsSurfaceMapperUtils;
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -85,55 +116,105 @@ void SymmetricWeightsSurfaceMapper::ComputeMap()
 
   typedef Eigen::MatrixXd             Values;
   typedef Eigen::SparseMatrix<double> Matrix;
-  typedef Eigen::Triplet<double>      NZEntry;
 
   const int n = NumberOfFreePoints();
   const int m = NumberOfComponents();
 
   int i, j, r, c, l;
+  const DataArrayView values(_Values);
+
+  // Buffers of previous solves keep their capacity
+  MapperWorkspace &workspace = GetWorkspace();
 
-  Matrix A(n, n);
-  Values b(n, m);
+  MapperStatistics::Timer assembly(&_Statistics, "assembly");
+  Matrix &A = workspace._Matrix;
+  Values &b = workspace._RightHandSide;
+  A.resize(n, n);
+  b.resize(n, m);
   {
-    Array<NZEntry> w;
-    Array<double>  w_ii(n, .0);
+    Array<double> &w_ii = workspace._Diagonal;
     double         w_ij; // = w_ji
+    w_ii.assign(n, .0);
 
-    w.reserve(2 * _EdgeTable->NumberOfEdges() + n);
+    // Allocate compressed storage of system matrix with known sparsity pattern
+    A.resizeNonZeros(NumberOfNonZeros());
+    GetSparsityPattern(A.outerIndexPtr(), A.innerIndexPtr());
+    Eigen::Map<Eigen::VectorXd>(A.valuePtr(), A.nonZeros()).setZero();
     b.setZero();
 
+    // Collect edges with at least one free end point
+    Array<int> &edges = workspace._Edges;
+    edges.clear();
+    edges.reserve(2 * _EdgeTable->NumberOfEdges());
     EdgeIterator edgeIt(*_EdgeTable);
     for (edgeIt.InitTraversal(); edgeIt.GetNextEdge(i, j) != -1;) {
+      if (IsFreePoint(i) || IsFreePoint(j)) {
+        edges.push_back(i);
+        edges.push_back(j);
+      }
+    }
+    const int ne = static_cast<int>(edges.size() / 2);
+
+    // Compute edge weights in parallel, which dominates the assembly time
+    Array<double> &weights = workspace._Weights;
+    weights.resize(ne);
+    ComputeEdgeWeights eval;
+    eval._Mapper  = this;
+    eval._Edges   = edges.data();
+    eval._Weights = weights.data();
+    parallel_for(blocked_range<int>(0, ne), eval);
+
+    // Coefficients of fixed point values in right-hand side, which are
+    // retained to recompute the map for new fixed values by RunWithFixedValues
+    Array<int>    &coupling_rows    = workspace._CouplingRows;
+    Array<int>    &coupling_cols    = workspace._CouplingCols;
+    Array<double> &coupling_weights = workspace._CouplingWeights;
+    coupling_rows   .clear();
+    coupling_cols   .clear();
+    coupling_weights.clear();
+
+    // Accumulate coefficients in edge order such that the result is
+    // independent of the number of threads used to compute the weights
+    for (int e = 0; e < ne; ++e) {
+      i = edges[2 * e];
+      j = edges[2 * e + 1];
       r = FreePointIndex(i);
       c = FreePointIndex(j);
-      if (r >= 0 || c >= 0) {
-        w_ij = this->Weight(i, j);
-        if (r >= 0 && c >= 0) {
-          w.push_back(NZEntry(r, c, -w_ij));
-          w.push_back(NZEntry(c, r, -w_ij));
-        } else if (r >= 0) {
-          for (l = 0; l < m; ++l) {
-            b(r, l) += w_ij * GetValue(j, l);
-          }
-        } else if (c >= 0) {
-          for (l = 0; l < m; ++l) {
-            b(c, l) += w_ij * GetValue(i, l);
-          }
-        }
-        if (r >= 0) {
-          w_ii[r] += w_ij;
+      w_ij = weights[e];
+      if (r >= 0 && c >= 0) {
+        A.coeffRef(r, c) = -w_ij;
+        A.coeffRef(c, r) = -w_ij;
+      } else if (r >= 0) {
+        for (l = 0; l < m; ++l) {
+          b(r, l) += w_ij * values.Get(j, l);
         }
-        if (c >= 0) {
-          w_ii[c] += w_ij;
+        coupling_rows   .push_back(r);
+        coupling_cols   .push_back(FixedPointIndex(j));
+        coupling_weights.push_back(w_ij);
+      } else if (c >= 0) {
+        for (l = 0; l < m; ++l) {
+          b(c, l) += w_ij * values.Get(i, l);
         }
+        coupling_rows   .push_back(c);
+        coupling_cols   .push_back(FixedPointIndex(i));
+        coupling_weights.push_back(w_ij);
+      }
+      if (r >= 0) {
+        w_ii[r] += w_ij;
+      }
+      if (c >= 0) {
+        w_ii[c] += w_ij;
       }
     }
     for (r = 0; r < n; ++r) {
-      w.push_back(NZEntry(r, r, w_ii[r]));
+      A.coeffRef(r, r) = w_ii[r];
     }
-
-    A.setFromTriplets(w.begin(), w.end());
+    SetCoupling(coupling_rows, coupling_cols, coupling_weights);
   }
+  assembly.Stop();
+
+  // Keep initial values of free points when linear system is incomplete
+  if (_Observer && !_Observer->Continue()) return;
 
   if (verbose) {
     cout << "\n";
@@ -144,40 +225,46 @@ void SymmetricWeightsSurfaceMapper::ComputeMap()
     cout.flush();
   }
 
-  Values x(n, m);
+  Values &x = workspace._Solution;
+  x.resize(n, m);
   int    niter = 0;
   double error = nan;
 
-  if (use_direct_solver) {
-    Eigen::SparseLU<Matrix> solver;
-    solver.analyzePattern(A);
-    solver.factorize(A);
-    x = solver.solve(b);
-  } else {
-    Eigen::ConjugateGradient<Matrix> solver(A);
-    if (_NumberOfIterations > 0 ) solver.setMaxIterations(_NumberOfIterations);
-    if (_Tolerance          > 0.) solver.setTolerance(_Tolerance);
-    for (r = 0; r < n; ++r) {
-      i = FreePointId(r);
-      for (l = 0; l < m; ++l) {
-        x(r, l) = GetValue(i, l);
-      }
+  for (r = 0; r < n; ++r) {
+    i = FreePointId(r);
+    for (l = 0; l < m; ++l) {
+      x(r, l) = values.Get(i, l);
     }
-    x = solver.solveWithGuess(b, x);
-    niter = solver.iterations();
-    error = solver.error();
   }
+  if (!_Factorization) _Factorization = NewShared<SparseFactorization>();
+  _Factorization->MixedPrecision(_MixedPrecision);
+  _Factorization->Statistics(&_Statistics);
+  _Factorization->Observer(_Observer);
+  const SparseSolverType solver = _Factorization->Solve(_Solver, SparseMatrix_SPD,
+                                                        use_direct_solver, A, b, x,
+                                                        _NumberOfIterations, _Tolerance,
+                                                        true, &niter, &error);
 
   for (r = 0; r < n; ++r) {
     i = FreePointId(r);
     for (l = 0; l < m; ++l) {
-      SetValue(i, l, x(r, l));
+      values.Set(i, l, x(r, l));
     }
   }
 
-  if (verbose && !use_direct_solver) {
-    cout << "  No. of iterations            = " << niter << "\n";
-    cout << "  Estimated error              = " << error << "\n";
+  if (verbose) {
+    cout << "  Sparse linear solver         = " << ToString(solver) << "\n";
+    if (IsDirectSolver(solver)) {
+      cout << "  No. of symbolic analyses     = " << _Factorization->NumberOfAnalyses() << "\n";
+      cout << "  No. of factorizations        = " << _Factorization->NumberOfFactorizations() << "\n";
+      if (_Factorization->MixedPrecision()) {
+        cout << "  No. of refinement steps      = " << niter << "\n";
+        cout << "  Relative residual            = " << error << "\n";
+      }
+    } else {
+      cout << "  No. of iterations            = " << niter << "\n";
+      cout << "  Estimated error              = " << error << "\n";
+    }
     cout.flush();
   }
 }
@@ -0,0 +1,58 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mirtk/TemporaryFile.h"
+
+#include "mirtk/Config.h" // WINDOWS
+
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#ifdef WINDOWS
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+
+namespace mirtk {
+
+
+// -----------------------------------------------------------------------------
+string TemporaryFileName(const string &fname, const char *ext)
+{
+  static std::atomic<unsigned long> counter(0);
+  #ifdef WINDOWS
+    const long pid = static_cast<long>(_getpid());
+  #else
+    const long pid = static_cast<long>(getpid());
+  #endif
+  std::ostringstream os;
+  os << fname << ".tmp." << pid
+     << "." << std::hash<std::thread::id>()(std::this_thread::get_id())
+     << "." << counter++;
+  if (ext) os << ext;
+  return os.str();
+}
+
+
+} // namespace mirtk
@@ -19,20 +19,655 @@
 
 #include "mirtk/TetrahedralMeshMapper.h"
 
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Pair.h"
+#include "mirtk/Algorithm.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/DataArrayView.h"
+#include "mirtk/Stream.h"
 #include "mirtk/Vtk.h"
 #include "mirtk/PointSetUtils.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/TemporaryFile.h"
 
+#include "vtkNew.h"
 #include "vtkSmartPointer.h"
 #include "vtkPointSet.h"
 #include "vtkPointData.h"
 #include "vtkCellData.h"
 #include "vtkDataArray.h"
+#include "vtkDoubleArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkIdList.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkUnstructuredGrid.h"
+#include "vtkPolyData.h"
+#include "vtkPointLocator.h"
+#include "vtkMath.h"
+#include "vtkVersionMacros.h"
+#if VTK_MAJOR_VERSION >= 9
+#  include "vtkTypeInt32Array.h"
+#endif
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 
 
 namespace mirtk {
 
 
+// Global flags (cf. mirtk/Options.h)
+MIRTK_Common_EXPORT extern int verbose;
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace TetrahedralMeshMapperUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Header of cached tetrahedralization file
+///
+/// The header is followed by the point coordinates (double) and the four
+/// point indices of each tetrahedron (int64) in native byte order.
+struct CacheHeader
+{
+  char     _Magic[8];             ///< File type identifier
+  int32_t  _Version;              ///< File format version
+  int32_t  _ByteOrder;            ///< Byte order mark, i.e., 0x01020304
+  uint64_t _Hash;                 ///< Hash value of input point set
+  int64_t  _NumberOfInputPoints;  ///< Number of input points
+  int64_t  _NumberOfPoints;       ///< Number of tetrahedral mesh points
+  int64_t  _NumberOfCells;        ///< Number of tetrahedra
+};
+
+const char    CacheMagic[8]  = { 'M', 'I', 'R', 'T', 'K', 'T', 'E', 'T' };
+const int32_t CacheVersion   = 1;
+const int32_t CacheByteOrder = 0x01020304;
+
+/// Number of points or tetrahedra read or written at once from or to the cache
+const vtkIdType CacheChunkSize = 65536;
+
+// -----------------------------------------------------------------------------
+/// Cell array of tetrahedra whose point indices are appended in chunks
+///
+/// With VTK >= 9, the offsets and connectivity are stored as 32-bit integers
+/// when all indices fit, which halves the memory of the cell array. With older
+/// VTK versions, the cells are stored in the legacy format with the number of
+/// points preceding the point indices of each tetrahedron.
+class TetrahedronCells
+{
+  vtkSmartPointer<vtkCellArray> _Cells;  ///< Cell array
+  int32_t   *_Conn32;                    ///< Next 32-bit connectivity entry
+  vtkIdType *_Conn64;                    ///< Next vtkIdType connectivity entry
+  bool       _Legacy;                    ///< Whether cells use legacy format
+
+public:
+
+  /// Allocate cell array for the given number of tetrahedra
+  TetrahedronCells(vtkIdType ncells, vtkIdType npoints)
+  :
+    _Cells(vtkSmartPointer<vtkCellArray>::New()),
+    _Conn32(nullptr), _Conn64(nullptr), _Legacy(false)
+  {
+    #if VTK_MAJOR_VERSION >= 9
+      if (static_cast<int64_t>(npoints) <= static_cast<int64_t>(INT32_MAX) &&
+          4 * static_cast<int64_t>(ncells) <= static_cast<int64_t>(INT32_MAX)) {
+        vtkNew<vtkTypeInt32Array> offsets, conn;
+        offsets->SetNumberOfValues(ncells + 1);
+        for (vtkIdType cellId = 0; cellId <= ncells; ++cellId) {
+          offsets->SetValue(cellId, static_cast<int32_t>(4 * cellId));
+        }
+        conn->SetNumberOfValues(4 * ncells);
+        _Conn32 = conn->GetPointer(0);
+        _Cells->SetData(offsets.GetPointer(), conn.GetPointer());
+      } else {
+        vtkNew<vtkIdTypeArray> offsets, conn;
+        offsets->SetNumberOfValues(ncells + 1);
+        for (vtkIdType cellId = 0; cellId <= ncells; ++cellId) {
+          offsets->SetValue(cellId, 4 * cellId);
+        }
+        conn->SetNumberOfValues(4 * ncells);
+        _Conn64 = conn->GetPointer(0);
+        _Cells->SetData(offsets.GetPointer(), conn.GetPointer());
+      }
+    #else
+      vtkNew<vtkIdTypeArray> conn;
+      conn->SetNumberOfTuples(5 * ncells);
+      _Conn64 = conn->GetPointer(0);
+      _Legacy = true;
+      _Cells->SetCells(ncells, conn.GetPointer());
+    #endif
+  }
+
+  /// Append point indices of n tetrahedra
+  template <class T>
+  void Append(const T *tets, vtkIdType n)
+  {
+    if (_Conn32) {
+      for (vtkIdType i = 0; i < 4 * n; ++i) {
+        *_Conn32++ = static_cast<int32_t>(tets[i]);
+      }
+    } else {
+      for (vtkIdType cellId = 0; cellId < n; ++cellId, tets += 4) {
+        if (_Legacy) *_Conn64++ = 4;
+        for (int i = 0; i < 4; ++i) *_Conn64++ = static_cast<vtkIdType>(tets[i]);
+      }
+    }
+  }
+
+  /// Get cell array
+  vtkCellArray *Cells() const
+  {
+    return _Cells;
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Convert cell array of tetrahedral mesh to 32-bit storage when all IDs fit
+void CompactCells(vtkPointSet *volume)
+{
+  #if VTK_MAJOR_VERSION >= 9
+    vtkUnstructuredGrid *grid = vtkUnstructuredGrid::SafeDownCast(volume);
+    vtkCellArray *cells = (grid ? grid->GetCells() : nullptr);
+    if (cells && cells->IsStorage64Bit() && cells->CanConvertTo32BitStorage()) {
+      cells->ConvertTo32BitStorage();
+      grid->Modified();
+    }
+  #endif
+}
+
+// -----------------------------------------------------------------------------
+/// Update 64-bit FNV-1a hash value
+inline void Hash(uint64_t &h, const void *data, size_t n)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<uint64_t>(p[i]);
+    h *= 1099511628211ULL;
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Compute hash value of input points, cells, and mask values
+uint64_t HashInput(vtkPointSet *input, vtkDataArray *mask)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int64_t  n;
+  double   p[3], v;
+
+  n = static_cast<int64_t>(input->GetNumberOfPoints());
+  Hash(h, &n, sizeof(n));
+  for (vtkIdType ptId = 0; ptId < input->GetNumberOfPoints(); ++ptId) {
+    input->GetPoint(ptId, p);
+    Hash(h, p, sizeof(p));
+  }
+
+  vtkNew<vtkIdList> ptIds;
+  n = static_cast<int64_t>(input->GetNumberOfCells());
+  Hash(h, &n, sizeof(n));
+  for (vtkIdType cellId = 0; cellId < input->GetNumberOfCells(); ++cellId) {
+    n = static_cast<int64_t>(input->GetCellType(cellId));
+    Hash(h, &n, sizeof(n));
+    GetCellPoints(input, cellId, ptIds.GetPointer());
+    n = static_cast<int64_t>(ptIds->GetNumberOfIds());
+    Hash(h, &n, sizeof(n));
+    for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
+      n = static_cast<int64_t>(ptIds->GetId(i));
+      Hash(h, &n, sizeof(n));
+    }
+  }
+
+  if (mask) {
+    for (vtkIdType ptId = 0; ptId < mask->GetNumberOfTuples(); ++ptId) {
+      v = mask->GetComponent(ptId, 0);
+      Hash(h, &v, sizeof(v));
+    }
+  }
+  return h;
+}
+
+// -----------------------------------------------------------------------------
+/// Get file path of cached tetrahedralization
+string CacheFileName(const string &dir, uint64_t hash)
+{
+  std::ostringstream os;
+  os << dir;
+  if (!dir.empty() && dir[dir.length()-1] != '/' && dir[dir.length()-1] != '\\') os << '/';
+  os << std::hex << std::setw(16) << std::setfill('0') << hash << ".tet";
+  return os.str();
+}
+
+// -----------------------------------------------------------------------------
+/// Read cached tetrahedralization, returns nullptr when file is missing or invalid
+vtkSmartPointer<vtkPointSet> ReadCache(const char *fname, uint64_t hash, vtkIdType ninput)
+{
+  std::ifstream is(fname, std::ios::in | std::ios::binary);
+  if (!is) return nullptr;
+
+  CacheHeader header;
+  is.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (is.fail() || memcmp(header._Magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+      header._Version != CacheVersion || header._ByteOrder != CacheByteOrder ||
+      header._Hash != hash || header._NumberOfInputPoints != static_cast<int64_t>(ninput) ||
+      header._NumberOfPoints < header._NumberOfInputPoints || header._NumberOfCells <= 0) {
+    return nullptr;
+  }
+  const vtkIdType npoints = static_cast<vtkIdType>(header._NumberOfPoints);
+  const vtkIdType ncells  = static_cast<vtkIdType>(header._NumberOfCells);
+
+  vtkNew<vtkDoubleArray> coords;
+  coords->SetNumberOfComponents(3);
+  coords->SetNumberOfTuples(npoints);
+  is.read(reinterpret_cast<char *>(coords->GetPointer(0)), 3 * npoints * sizeof(double));
+  vtkNew<vtkPoints> points;
+  points->SetData(coords.GetPointer());
+
+  // Read point indices in chunks directly into the cell array
+  TetrahedronCells cells(ncells, npoints);
+  Array<int64_t> buffer(4 * min(ncells, CacheChunkSize));
+  for (vtkIdType begin = 0; begin < ncells; begin += CacheChunkSize) {
+    const vtkIdType n = min(CacheChunkSize, ncells - begin);
+    is.read(reinterpret_cast<char *>(buffer.data()), 4 * n * sizeof(int64_t));
+    if (is.fail()) return nullptr;
+    for (vtkIdType i = 0; i < 4 * n; ++i) {
+      if (buffer[i] < 0 || buffer[i] >= header._NumberOfPoints) return nullptr;
+    }
+    cells.Append(buffer.data(), n);
+  }
+
+  vtkSmartPointer<vtkUnstructuredGrid> volume = vtkSmartPointer<vtkUnstructuredGrid>::New();
+  volume->SetPoints(points.GetPointer());
+  volume->SetCells(VTK_TETRA, cells.Cells());
+  return volume;
+}
+
+// -----------------------------------------------------------------------------
+/// Write tetrahedralization to cache file
+///
+/// The file is first written to a temporary file which is then renamed, such
+/// that concurrent runs with the same input never read an incomplete file.
+/// The temporary file name is unique for each writer, such that concurrent
+/// writers of the same cache file do not write to the same temporary file.
+bool WriteCache(const char *fname, uint64_t hash, vtkIdType ninput, vtkPointSet *volume)
+{
+  const vtkIdType npoints = volume->GetNumberOfPoints();
+  const vtkIdType ncells  = volume->GetNumberOfCells();
+  if (npoints < ninput || ncells == 0) return false;
+
+  CacheHeader header;
+  memcpy(header._Magic, CacheMagic, sizeof(CacheMagic));
+  header._Version             = CacheVersion;
+  header._ByteOrder           = CacheByteOrder;
+  header._Hash                = hash;
+  header._NumberOfInputPoints = static_cast<int64_t>(ninput);
+  header._NumberOfPoints      = static_cast<int64_t>(npoints);
+  header._NumberOfCells       = static_cast<int64_t>(ncells);
+
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    if (volume->GetCellType(cellId) != VTK_TETRA) return false;
+  }
+
+  const string tmpname = TemporaryFileName(fname);
+  std::ofstream os(tmpname.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!os) return false;
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  // Write point coordinates and indices in chunks
+  Array<double> coords(3 * min(npoints, CacheChunkSize));
+  for (vtkIdType begin = 0; begin < npoints; begin += CacheChunkSize) {
+    const vtkIdType n = min(CacheChunkSize, npoints - begin);
+    for (vtkIdType i = 0; i < n; ++i) {
+      volume->GetPoint(begin + i, coords.data() + 3 * i);
+    }
+    os.write(reinterpret_cast<const char *>(coords.data()), 3 * n * sizeof(double));
+  }
+  vtkNew<vtkIdList> ptIds;
+  Array<int64_t> buffer(4 * min(ncells, CacheChunkSize));
+  for (vtkIdType begin = 0; begin < ncells; begin += CacheChunkSize) {
+    const vtkIdType n = min(CacheChunkSize, ncells - begin);
+    for (vtkIdType i = 0; i < n; ++i) {
+      GetCellPoints(volume, begin + i, ptIds.GetPointer());
+      for (int j = 0; j < 4; ++j) {
+        buffer[4 * i + j] = static_cast<int64_t>(ptIds->GetId(j));
+      }
+    }
+    os.write(reinterpret_cast<const char *>(buffer.data()), 4 * n * sizeof(int64_t));
+  }
+  os.close();
+  if (os.fail() || std::rename(tmpname.c_str(), fname) != 0) {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Whether the first points of the tetrahedral mesh are the input points
+bool HasInputPoints(vtkPointSet *volume, vtkPointSet *input)
+{
+  if (volume->GetNumberOfPoints() < input->GetNumberOfPoints()) return false;
+  double p[3], q[3];
+  for (vtkIdType ptId = 0; ptId < input->GetNumberOfPoints(); ++ptId) {
+    input ->GetPoint(ptId, p);
+    volume->GetPoint(ptId, q);
+    if (p[0] != q[0] || p[1] != q[1] || p[2] != q[2]) return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Copy values of input points to new array, with zero values at Steiner points
+vtkSmartPointer<vtkDataArray> CopyInputPointData(vtkDataArray *input, vtkIdType npoints)
+{
+  vtkSmartPointer<vtkDataArray> output;
+  output.TakeReference(input->NewInstance());
+  output->SetName(input->GetName());
+  output->SetNumberOfComponents(input->GetNumberOfComponents());
+  output->SetNumberOfTuples(npoints);
+  for (vtkIdType ptId = 0; ptId < input->GetNumberOfTuples(); ++ptId) {
+    output->SetTuple(ptId, input->GetTuple(ptId));
+  }
+  for (int j = 0; j < output->GetNumberOfComponents(); ++j) {
+    for (vtkIdType ptId = input->GetNumberOfTuples(); ptId < npoints; ++ptId) {
+      output->SetComponent(ptId, j, .0);
+    }
+  }
+  return output;
+}
+
+
+// -----------------------------------------------------------------------------
+/// Edge of tetrahedral mesh given by its point indices in ascending order
+typedef Pair<vtkIdType, vtkIdType> Edge;
+
+// -----------------------------------------------------------------------------
+/// Make edge with ordered point indices
+inline Edge MakeEdge(vtkIdType a, vtkIdType b)
+{
+  return (a < b ? MakePair(a, b) : MakePair(b, a));
+}
+
+// -----------------------------------------------------------------------------
+/// Face of tetrahedral mesh given by its point indices in ascending order
+struct Face
+{
+  vtkIdType _Id[3];
+
+  Face(vtkIdType a, vtkIdType b, vtkIdType c)
+  {
+    if (a > b) std::swap(a, b);
+    if (b > c) std::swap(b, c);
+    if (a > b) std::swap(a, b);
+    _Id[0] = a, _Id[1] = b, _Id[2] = c;
+  }
+
+  bool operator <(const Face &other) const
+  {
+    if (_Id[0] != other._Id[0]) return _Id[0] < other._Id[0];
+    if (_Id[1] != other._Id[1]) return _Id[1] < other._Id[1];
+    return _Id[2] < other._Id[2];
+  }
+
+  bool operator ==(const Face &other) const
+  {
+    return _Id[0] == other._Id[0] && _Id[1] == other._Id[1] && _Id[2] == other._Id[2];
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Get point coordinates and point indices of tetrahedra
+///
+/// \returns Whether all cells of the volume mesh are tetrahedra.
+bool GetTetrahedra(vtkPointSet *volume, Array<double> &points, Array<vtkIdType> &tets)
+{
+  const vtkIdType npoints = volume->GetNumberOfPoints();
+  const vtkIdType ncells  = volume->GetNumberOfCells();
+  points.resize(3 * npoints);
+  for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+    volume->GetPoint(ptId, points.data() + 3 * ptId);
+  }
+  vtkNew<vtkIdList> ptIds;
+  tets.resize(4 * ncells);
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    if (volume->GetCellType(cellId) != VTK_TETRA) return false;
+    GetCellPoints(volume, cellId, ptIds.GetPointer());
+    for (int i = 0; i < 4; ++i) tets[4 * cellId + i] = ptIds->GetId(i);
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Create tetrahedral mesh from point coordinates and point indices of tetrahedra
+vtkSmartPointer<vtkPointSet>
+NewTetrahedralMesh(const Array<double> &points, const Array<vtkIdType> &tets)
+{
+  const vtkIdType npoints = static_cast<vtkIdType>(points.size() / 3);
+  const vtkIdType ncells  = static_cast<vtkIdType>(tets.size() / 4);
+
+  vtkNew<vtkDoubleArray> coords;
+  coords->SetNumberOfComponents(3);
+  coords->SetNumberOfTuples(npoints);
+  memcpy(coords->GetPointer(0), points.data(), points.size() * sizeof(double));
+  vtkNew<vtkPoints> pts;
+  pts->SetData(coords.GetPointer());
+
+  TetrahedronCells cells(ncells, npoints);
+  cells.Append(tets.data(), ncells);
+
+  vtkSmartPointer<vtkUnstructuredGrid> volume = vtkSmartPointer<vtkUnstructuredGrid>::New();
+  volume->SetPoints(pts.GetPointer());
+  volume->SetCells(VTK_TETRA, cells.Cells());
+  return volume;
+}
+
+// -----------------------------------------------------------------------------
+/// Get edges of faces which belong to only one tetrahedron, i.e., boundary faces
+///
+/// \param[in]  tets     Point indices of tetrahedra.
+/// \param[out] edges    Sorted edges of boundary faces.
+/// \param[out] boundary Indices of boundary points in ascending order.
+void GetBoundaryEdges(const Array<vtkIdType> &tets, Array<Edge> &edges, Array<vtkIdType> &boundary)
+{
+  static const int face[4][3] = {{1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}};
+  Array<Face> faces;
+  faces.reserve(tets.size());
+  for (size_t t = 0; t < tets.size(); t += 4) {
+    for (int i = 0; i < 4; ++i) {
+      faces.push_back(Face(tets[t + face[i][0]], tets[t + face[i][1]], tets[t + face[i][2]]));
+    }
+  }
+  sort(faces.begin(), faces.end());
+  edges.clear();
+  boundary.clear();
+  for (size_t i = 0, j; i < faces.size(); i = j) {
+    for (j = i + 1; j < faces.size() && faces[j] == faces[i]; ++j);
+    if (j - i == 1) {
+      const vtkIdType *id = faces[i]._Id;
+      edges.push_back(MakePair(id[0], id[1]));
+      edges.push_back(MakePair(id[0], id[2]));
+      edges.push_back(MakePair(id[1], id[2]));
+      boundary.push_back(id[0]);
+      boundary.push_back(id[1]);
+      boundary.push_back(id[2]);
+    }
+  }
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
+  sort(boundary.begin(), boundary.end());
+  boundary.erase(unique(boundary.begin(), boundary.end()), boundary.end());
+}
+
+// -----------------------------------------------------------------------------
+/// Signed volume of tetrahedron
+inline double TetrahedronVolume(const Array<double> &points, const vtkIdType *tet)
+{
+  const double *p0 = points.data() + 3 * tet[0];
+  const double *p1 = points.data() + 3 * tet[1];
+  const double *p2 = points.data() + 3 * tet[2];
+  const double *p3 = points.data() + 3 * tet[3];
+  double a[3], b[3], c[3];
+  for (int i = 0; i < 3; ++i) {
+    a[i] = p1[i] - p0[i];
+    b[i] = p2[i] - p0[i];
+    c[i] = p3[i] - p0[i];
+  }
+  return (a[0] * (b[1] * c[2] - b[2] * c[1]) +
+          a[1] * (b[2] * c[0] - b[0] * c[2]) +
+          a[2] * (b[0] * c[1] - b[1] * c[0])) / 6.0;
+}
+
+// -----------------------------------------------------------------------------
+/// Squared distance of two mesh points
+inline double SquaredDistance(const Array<double> &points, vtkIdType a, vtkIdType b)
+{
+  const double *p = points.data() + 3 * a;
+  const double *q = points.data() + 3 * b;
+  return pow(p[0] - q[0], 2) + pow(p[1] - q[1], 2) + pow(p[2] - q[2], 2);
+}
+
+// -----------------------------------------------------------------------------
+/// Get longest edge of tetrahedron which is not an edge of the boundary surface
+///
+/// \returns Squared length of longest interior edge or zero if there is none.
+double LongestInteriorEdge(const Array<double> &points, const vtkIdType *tet,
+                           const Array<Edge> &boundary_edges, Edge &edge)
+{
+  double d2, max_d2 = .0;
+  for (int i = 0; i < 3; ++i)
+  for (int j = i + 1; j < 4; ++j) {
+    const Edge e = MakeEdge(tet[i], tet[j]);
+    if (std::binary_search(boundary_edges.begin(), boundary_edges.end(), e)) continue;
+    d2 = SquaredDistance(points, e.first, e.second);
+    if (d2 > max_d2) {
+      max_d2 = d2;
+      edge   = e;
+    }
+  }
+  return max_d2;
+}
+
+// -----------------------------------------------------------------------------
+/// Split edges at their midpoints and all tetrahedra which contain them
+///
+/// The new points are appended to the mesh points, and the edges which were
+/// split are appended to the list of parents in the order of the new points.
+/// The two halves of a split tetrahedron have the orientation of the original.
+void BisectEdges(Array<double> &points, Array<vtkIdType> &tets,
+                 const Array<Edge> &edges, Array<Edge> &parents)
+{
+  vtkIdType npoints = static_cast<vtkIdType>(points.size() / 3);
+  vtkIdType ncells  = static_cast<vtkIdType>(tets.size()   / 4);
+
+  // Tetrahedra adjacent to each point
+  Array<Array<vtkIdType> > adj(npoints);
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    for (int i = 0; i < 4; ++i) adj[tets[4 * cellId + i]].push_back(cellId);
+  }
+
+  Array<vtkIdType> cells;
+  for (size_t k = 0; k < edges.size(); ++k) {
+    const vtkIdType a = edges[k].first;
+    const vtkIdType b = edges[k].second;
+    vtkIdType m = -1;
+    cells = adj[a];
+    for (size_t l = 0; l < cells.size(); ++l) {
+      const vtkIdType cellId = cells[l];
+      vtkIdType *tet = tets.data() + 4 * cellId;
+      int ia = -1, ib = -1;
+      for (int i = 0; i < 4; ++i) {
+        if      (tet[i] == a) ia = i;
+        else if (tet[i] == b) ib = i;
+      }
+      if (ib == -1) continue;
+      if (m == -1) {
+        m = npoints++;
+        for (int i = 0; i < 3; ++i) {
+          points.push_back(.5 * (points[3 * a + i] + points[3 * b + i]));
+        }
+        parents.push_back(edges[k]);
+        adj.push_back(Array<vtkIdType>());
+      }
+      // Add tetrahedron with point b, where a is replaced by midpoint m
+      const vtkIdType newId = ncells++;
+      for (int i = 0; i < 4; ++i) {
+        tets.push_back(i == ia ? m : tets[4 * cellId + i]);
+      }
+      tet = tets.data() + 4 * cellId;
+      // Replace b by midpoint m in split tetrahedron with point a
+      tet[ib] = m;
+      // Update adjacency of points
+      for (int i = 0; i < 4; ++i) {
+        if (i != ia && i != ib) adj[tet[i]].push_back(newId);
+      }
+      std::replace(adj[b].begin(), adj[b].end(), cellId, newId);
+      adj[m].push_back(cellId);
+      adj[m].push_back(newId);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Compute Frobenius norm of deformation gradient of each tetrahedron
+struct ComputeDeformationGradientNorm
+{
+  const double        *_Points;
+  const vtkIdType     *_Tets;
+  const DataArrayView *_Map;
+  double              *_Norm;
+
+  void operator ()(const blocked_range<vtkIdType> &re) const
+  {
+    const int m = _Map->NumberOfComponents();
+    double e[3][3], r[3][3], det, d[3], jac, norm;
+    for (vtkIdType cellId = re.begin(); cellId != re.end(); ++cellId) {
+      const vtkIdType *tet = _Tets + 4 * cellId;
+      const double    *p0  = _Points + 3 * tet[0];
+      for (int k = 0; k < 3; ++k) {
+        const double *p = _Points + 3 * tet[k + 1];
+        for (int i = 0; i < 3; ++i) e[k][i] = p[i] - p0[i];
+      }
+      // Rows of inverse of matrix with edge vectors as columns
+      for (int k = 0; k < 3; ++k) {
+        const double *u = e[(k + 1) % 3];
+        const double *v = e[(k + 2) % 3];
+        r[k][0] = u[1] * v[2] - u[2] * v[1];
+        r[k][1] = u[2] * v[0] - u[0] * v[2];
+        r[k][2] = u[0] * v[1] - u[1] * v[0];
+      }
+      det = e[0][0] * r[0][0] + e[0][1] * r[0][1] + e[0][2] * r[0][2];
+      if (fequal(det, .0)) {
+        _Norm[cellId] = .0;
+        continue;
+      }
+      norm = .0;
+      for (int i = 0; i < m; ++i) {
+        for (int k = 0; k < 3; ++k) {
+          d[k] = _Map->Get(tet[k + 1], i) - _Map->Get(tet[0], i);
+        }
+        for (int j = 0; j < 3; ++j) {
+          jac   = (d[0] * r[0][j] + d[1] * r[1][j] + d[2] * r[2][j]) / det;
+          norm += jac * jac;
+        }
+      }
+      _Norm[cellId] = sqrt(norm);
+    }
+  }
+};
+
+
+} // namespace TetrahedralMeshMapperUtils
+using namespace TetrahedralMeshMapperUtils;
+
+
 // =============================================================================
 // Construction/destruction
 // =============================================================================
@@ -40,7 +675,15 @@ namespace mirtk {
 // -----------------------------------------------------------------------------
 void TetrahedralMeshMapper::CopyAttributes(const TetrahedralMeshMapper &other)
 {
-  _InputMask = other._InputMask;
+  _InputMask               = other._InputMask;
+  _InputVolume             = other._InputVolume;
+  _TetrahedralizationCache = other._TetrahedralizationCache;
+  _MaximumVolume           = other._MaximumVolume;
+  _SizeGrading             = other._SizeGrading;
+  _NumberOfRefinements     = other._NumberOfRefinements;
+  _RefinementThreshold     = other._RefinementThreshold;
+  _RefinedVolume           = other._RefinedVolume;
+  _RefinementLevel         = other._RefinementLevel;
   if (other._Volume && other._Coords && other._BoundaryMask) {
     _Coords.TakeReference(other._Coords->NewInstance());
     _Coords->DeepCopy(other._Coords);
@@ -63,6 +706,15 @@ void TetrahedralMeshMapper::CopyAttributes(const TetrahedralMeshMapper &other)
 
 // -----------------------------------------------------------------------------
 TetrahedralMeshMapper::TetrahedralMeshMapper()
+:
+  _MaximumVolume(.0),
+  _SizeGrading(.0),
+  _NumberOfRefinements(0),
+  _RefinementThreshold(2.0),
+  _RefinementLevel(0),
+  _NumberOfPoints(0),
+  _NumberOfBoundaryPoints(0),
+  _NumberOfInteriorPoints(0)
 {
 }
 
@@ -96,6 +748,174 @@ TetrahedralMeshMapper::~TetrahedralMeshMapper()
 // Execution
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+vtkSmartPointer<vtkPointSet>
+TetrahedralMeshMapper::TetrahedralizeInput(int &map_index, int &mask_index) const
+{
+  const vtkIdType ninput = _InputSet->GetNumberOfPoints();
+  vtkSmartPointer<vtkPointSet> volume, mesh;
+
+  // Use refined, precomputed, or cached tetrahedral mesh
+  uint64_t hash = 0;
+  string   cache_name;
+  if (_RefinedVolume) {
+    mesh = _RefinedVolume;
+  } else if (_InputVolume) {
+    if (!IsTetrahedralMesh(_InputVolume) || !HasInputPoints(_InputVolume, _InputSet)) {
+      cerr << this->NameOfType() << "::Initialize: Input volume must be a tetrahedral mesh"
+              " whose first points are the points of the input point set" << endl;
+      exit(1);
+    }
+    mesh = _InputVolume;
+  } else if (!_TetrahedralizationCache.empty()) {
+    hash       = HashInput(_InputSet, _InputMask);
+    cache_name = CacheFileName(_TetrahedralizationCache, hash);
+    mesh       = ReadCache(cache_name.c_str(), hash, ninput);
+    if (mesh) {
+      if (verbose > 1) {
+        cout << "\n" << this->NameOfType() << "::Initialize: Read tetrahedralization from " << cache_name << endl;
+      }
+      mesh = RefineToSize(mesh);
+    }
+  }
+
+  if (!mesh) {
+    // Tetrahedralize interior of input point set
+    vtkSmartPointer<vtkPointSet> input;
+    input.TakeReference(_InputSet->NewInstance());
+    input->ShallowCopy(_InputSet);
+    input->GetCellData ()->Initialize();
+    input->GetPointData()->Initialize();
+    map_index  = input->GetPointData()->AddArray(_InputMap);
+    mask_index = (_InputMask ? input->GetPointData()->AddArray(_InputMask) : -1);
+    volume = Tetrahedralize(input);
+    CompactCells(volume);
+
+    // Write tetrahedralization to cache
+    const bool has_input_points = HasInputPoints(volume, _InputSet);
+    if (!cache_name.empty()) {
+      if (has_input_points && WriteCache(cache_name.c_str(), hash, ninput, volume)) {
+        if (verbose > 1) {
+          cout << "\n" << this->NameOfType() << "::Initialize: Wrote tetrahedralization to " << cache_name << endl;
+        }
+      } else if (verbose) {
+        cerr << "\n" << this->NameOfType() << "::Initialize: Warning: Failed to cache tetrahedralization in " << cache_name << endl;
+      }
+    }
+
+    // Refine tetrahedralization to requested element sizes
+    if (_MaximumVolume <= .0 && _SizeGrading <= .0) return volume;
+    if (!has_input_points) {
+      if (verbose) {
+        cerr << "\n" << this->NameOfType() << "::Initialize: Warning: Cannot refine tetrahedralization"
+                " which reordered the input points" << endl;
+      }
+      return volume;
+    }
+    mesh = RefineToSize(volume);
+  }
+
+  volume.TakeReference(mesh->NewInstance());
+  volume->ShallowCopy(mesh);
+  volume->GetCellData ()->Initialize();
+  volume->GetPointData()->Initialize();
+  const vtkIdType npoints = volume->GetNumberOfPoints();
+  map_index = volume->GetPointData()->AddArray(CopyInputPointData(_InputMap, npoints));
+  if (_InputMask) {
+    mask_index = volume->GetPointData()->AddArray(CopyInputPointData(_InputMask, npoints));
+  } else {
+    mask_index = -1;
+  }
+  return volume;
+}
+
+// -----------------------------------------------------------------------------
+vtkSmartPointer<vtkPointSet> TetrahedralMeshMapper::RefineToSize(vtkPointSet *mesh) const
+{
+  const int max_passes = 50;
+
+  if (_MaximumVolume <= .0 && _SizeGrading <= .0) return mesh;
+
+  Array<double>    points;
+  Array<vtkIdType> tets;
+  if (!GetTetrahedra(mesh, points, tets)) return mesh;
+  const vtkIdType npoints = mesh->GetNumberOfPoints();
+
+  // Boundary edges are never split
+  Array<Edge>      boundary_edges;
+  Array<vtkIdType> boundary;
+  GetBoundaryEdges(tets, boundary_edges, boundary);
+  if (boundary_edges.empty()) return mesh;
+
+  // Mean boundary edge length and point locator for distance to boundary
+  double h = .0;
+  vtkNew<vtkPointLocator> locator;
+  vtkNew<vtkPolyData>     boundary_points;
+  if (_SizeGrading > .0) {
+    for (size_t i = 0; i < boundary_edges.size(); ++i) {
+      h += sqrt(SquaredDistance(points, boundary_edges[i].first, boundary_edges[i].second));
+    }
+    h /= boundary_edges.size();
+    vtkNew<vtkPoints> pts;
+    pts->SetNumberOfPoints(static_cast<vtkIdType>(boundary.size()));
+    for (size_t i = 0; i < boundary.size(); ++i) {
+      pts->SetPoint(static_cast<vtkIdType>(i), points.data() + 3 * boundary[i]);
+    }
+    boundary_points->SetPoints(pts.GetPointer());
+    locator->SetDataSet(boundary_points.GetPointer());
+    locator->BuildLocator();
+  }
+
+  // Bisect longest interior edge of too large tetrahedra until none is left
+  Array<Edge> edges, parents;
+  double c[3], q[3], max_length;
+  Edge   edge;
+  for (int pass = 0; pass < max_passes; ++pass) {
+    edges.clear();
+    for (size_t t = 0; t < tets.size(); t += 4) {
+      const vtkIdType *tet = tets.data() + t;
+      if (LongestInteriorEdge(points, tet, boundary_edges, edge) == .0) continue;
+      bool refine = (_MaximumVolume > .0 && abs(TetrahedronVolume(points, tet)) > _MaximumVolume);
+      if (!refine && _SizeGrading > .0) {
+        for (int i = 0; i < 3; ++i) {
+          c[i] = .25 * (points[3 * tet[0] + i] + points[3 * tet[1] + i] +
+                        points[3 * tet[2] + i] + points[3 * tet[3] + i]);
+        }
+        boundary_points->GetPoint(locator->FindClosestPoint(c), q);
+        max_length = h + _SizeGrading * sqrt(vtkMath::Distance2BetweenPoints(c, q));
+        refine = (SquaredDistance(points, edge.first, edge.second) > max_length * max_length);
+      }
+      if (refine) edges.push_back(edge);
+    }
+    if (edges.empty()) break;
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    BisectEdges(points, tets, edges, parents);
+  }
+  if (parents.empty()) return mesh;
+
+  if (verbose > 1) {
+    cout << "\n" << this->NameOfType() << "::Initialize: Refined tetrahedralization from "
+         << npoints << " to " << (points.size() / 3) << " points" << endl;
+  }
+  return NewTetrahedralMesh(points, tets);
+}
+
+// -----------------------------------------------------------------------------
+vtkSmartPointer<vtkPointSet> TetrahedralMeshMapper::TetrahedralizeInputSet() const
+{
+  if (!_InputSet || !_InputMap) {
+    cerr << this->NameOfType() << "::TetrahedralizeInputSet: Missing input point set or map" << endl;
+    exit(1);
+  }
+  int map_index, mask_index;
+  vtkSmartPointer<vtkPointSet> volume = TetrahedralizeInput(map_index, mask_index);
+  if (!HasInputPoints(volume, _InputSet)) return nullptr;
+  volume->GetCellData ()->Initialize();
+  volume->GetPointData()->Initialize();
+  return volume;
+}
+
 // -----------------------------------------------------------------------------
 void TetrahedralMeshMapper::Initialize()
 {
@@ -103,17 +923,12 @@ void TetrahedralMeshMapper::Initialize()
   VolumeMapper::Initialize();
 
   // Tetrahedralize interior of input point set
-  int map_index, mask_index = -1;
-  vtkSmartPointer<vtkPointSet> input;
-  input.TakeReference(_InputSet->NewInstance());
-  input->ShallowCopy(_InputSet);
-  input->GetCellData ()->Initialize();
-  input->GetPointData()->Initialize();
-  map_index = input->GetPointData()->AddArray(_InputMap);
-  if (_InputMask) mask_index = input->GetPointData()->AddArray(_InputMask);
-  _Volume = Tetrahedralize(input);
+  int map_index, mask_index;
+  if (!_RefinedVolume) _RefinementLevel = 0;
+  _Volume = TetrahedralizeInput(map_index, mask_index);
   _Coords = _Volume->GetPointData()->GetArray(map_index);
   _Coords->SetName("VolumetricMap");
+  _NumberOfPoints = static_cast<int>(_Volume->GetNumberOfPoints());
 
   // Extract surface of volume mesh
   this->InitializeBoundary(_Volume, _Coords);
@@ -133,7 +948,6 @@ void TetrahedralMeshMapper::Initialize()
     origPtId = static_cast<vtkIdType>(origPtIds->GetComponent(ptId, 0));
     _BoundaryMask->SetComponent(origPtId, 0, 1.0);
   }
-  _NumberOfPoints         = static_cast<int>(_Volume->GetNumberOfPoints());
   _NumberOfBoundaryPoints = 0;
   for (vtkIdType ptId = 0; ptId < _BoundaryMask->GetNumberOfTuples(); ++ptId) {
     if (IsBoundaryPoint(ptId)) ++_NumberOfBoundaryPoints;
@@ -141,9 +955,96 @@ void TetrahedralMeshMapper::Initialize()
   _NumberOfInteriorPoints = _NumberOfPoints - _NumberOfBoundaryPoints;
 }
 
+// -----------------------------------------------------------------------------
+bool TetrahedralMeshMapper::Refine()
+{
+  if (_RefinementLevel >= _NumberOfRefinements || _RefinementThreshold <= .0) return false;
+  if (!HasInputPoints(_Volume, _InputSet)) {
+    if (verbose) {
+      cerr << "\n" << this->NameOfType() << "::Refine: Warning: Cannot refine tetrahedralization"
+              " which reordered the input points" << endl;
+    }
+    return false;
+  }
+
+  Array<double>    points;
+  Array<vtkIdType> tets;
+  if (!GetTetrahedra(_Volume, points, tets)) return false;
+  const vtkIdType ncells = static_cast<vtkIdType>(tets.size() / 4);
+  if (ncells == 0) return false;
+
+  // Compute norm of deformation gradient of each tetrahedron
+  const DataArrayView map(_Coords);
+  Array<double> norm(ncells);
+  ComputeDeformationGradientNorm eval;
+  eval._Points = points.data();
+  eval._Tets   = tets.data();
+  eval._Map    = &map;
+  eval._Norm   = norm.data();
+  parallel_for(blocked_range<vtkIdType>(0, ncells), eval);
+
+  Array<double> sorted(norm);
+  nth_element(sorted.begin(), sorted.begin() + ncells / 2, sorted.end());
+  const double threshold = _RefinementThreshold * sorted[ncells / 2];
+  if (threshold <= .0) return false;
+
+  // Bisect longest interior edge of tetrahedra with large deformation gradient
+  Array<Edge>      boundary_edges;
+  Array<vtkIdType> boundary;
+  GetBoundaryEdges(tets, boundary_edges, boundary);
+
+  Array<Edge> edges, parents;
+  Edge        edge;
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    if (norm[cellId] > threshold &&
+        LongestInteriorEdge(points, tets.data() + 4 * cellId, boundary_edges, edge) > .0) {
+      edges.push_back(edge);
+    }
+  }
+  if (edges.empty()) return false;
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
+  BisectEdges(points, tets, edges, parents);
+
+  // Linearly interpolate current map at new points
+  const vtkIdType npoints = static_cast<vtkIdType>(_NumberOfPoints);
+  const int       m       = map.NumberOfComponents();
+  Array<double> values(m * (npoints + parents.size()));
+  for (vtkIdType ptId = 0; ptId < npoints; ++ptId) {
+    map.GetTuple(ptId, values.data() + m * ptId);
+  }
+  for (size_t i = 0; i < parents.size(); ++i) {
+    double       *v = values.data() + m * (npoints + i);
+    const double *a = values.data() + m * parents[i].first;
+    const double *b = values.data() + m * parents[i].second;
+    for (int j = 0; j < m; ++j) v[j] = .5 * (a[j] + b[j]);
+  }
+
+  ++_RefinementLevel;
+  if (verbose) {
+    cout << "\nRefinement " << _RefinementLevel << ": Split " << edges.size()
+         << " edges of tetrahedra with deformation gradient norm above "
+         << threshold << ", new no. of points = " << (points.size() / 3) << endl;
+  }
+
+  // Re-initialize filter with refined mesh and previous map as initial guess
+  _RefinedVolume = NewTetrahedralMesh(points, tets);
+  this->Initialize();
+  const DataArrayView coords(_Coords);
+  const int n = min(m, coords.NumberOfComponents());
+  for (vtkIdType ptId = 0; ptId < static_cast<vtkIdType>(_NumberOfPoints); ++ptId) {
+    if (IsBoundaryPoint(ptId)) continue;
+    for (int j = 0; j < n; ++j) coords.Set(ptId, j, values[m * ptId + j]);
+  }
+  return true;
+}
+
 // -----------------------------------------------------------------------------
 void TetrahedralMeshMapper::Finalize()
 {
+  // Discard adaptively refined mesh of this Run
+  _RefinedVolume = nullptr;
+
   // Create output map
   SharedPtr<PiecewiseLinearMap> map = NewShared<PiecewiseLinearMap>();
   map->Domain(_Volume);
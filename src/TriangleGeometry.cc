@@ -0,0 +1,147 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/TriangleGeometry.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/Vtk.h"
+
+#include "vtkIdList.h"
+#include "vtkMath.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+namespace TriangleGeometryUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Compute geometry of each triangle in parallel
+struct ComputeTriangleGeometry
+{
+  vtkPolyData   *_Surface;
+  const int     *_PointIds;
+  Array<double> *_Angle;
+  Array<double> *_Cotangent;
+  Array<double> *_EdgeLength;
+  Array<double> *_Area;
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    double p[3][3], e[3][3], n[3], sin2, dot[3];
+    for (int t = re.begin(); t != re.end(); ++t) {
+      for (int k = 0; k < 3; ++k) {
+        _Surface->GetPoint(static_cast<vtkIdType>(_PointIds[3 * t + k]), p[k]);
+      }
+      // Edge vectors opposite each corner
+      vtkMath::Subtract(p[2], p[1], e[0]);
+      vtkMath::Subtract(p[0], p[2], e[1]);
+      vtkMath::Subtract(p[1], p[0], e[2]);
+      // Twice the triangle area, i.e., the magnitude of the cross product
+      // of any two edge vectors, which is the same for all corners
+      vtkMath::Cross(e[2], e[1], n);
+      sin2 = vtkMath::Norm(n);
+      // Dot products of the two edge vectors emanating from each corner
+      dot[0] = - vtkMath::Dot(e[2], e[1]);
+      dot[1] = - vtkMath::Dot(e[0], e[2]);
+      dot[2] = - vtkMath::Dot(e[1], e[0]);
+      for (int k = 0; k < 3; ++k) {
+        _EdgeLength[k][t] = vtkMath::Norm(e[k]);
+        _Cotangent [k][t] = dot[k] / sin2;
+        _Angle     [k][t] = atan2(sin2, dot[k]);
+      }
+      (*_Area)[t] = .5 * sin2;
+    }
+  }
+};
+
+
+} // namespace TriangleGeometryUtils
+using namespace TriangleGeometryUtils;
+
+// =============================================================================
+// Construction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+TriangleGeometry::TriangleGeometry(vtkPolyData *surface, const EdgeTable *edges)
+:
+  _EdgeTable(edges),
+  _IsTriangulated(true)
+{
+  // Collect point IDs of triangles
+  vtkNew<vtkIdList> ptIds;
+  const vtkIdType ncells = surface->GetNumberOfCells();
+  _PointIds.reserve(3 * static_cast<size_t>(surface->GetNumberOfPolys()));
+  for (vtkIdType cellId = 0; cellId < ncells; ++cellId) {
+    const int type = surface->GetCellType(cellId);
+    if (type == VTK_TRIANGLE) {
+      GetCellPoints(surface, cellId, ptIds.GetPointer());
+      for (vtkIdType k = 0; k < 3; ++k) {
+        _PointIds.push_back(static_cast<int>(ptIds->GetId(k)));
+      }
+    } else if (type != VTK_VERTEX && type != VTK_POLY_VERTEX &&
+               type != VTK_LINE   && type != VTK_POLY_LINE   && type != VTK_EMPTY_CELL) {
+      _IsTriangulated = false;
+    }
+  }
+  const int ntris = static_cast<int>(_PointIds.size() / 3);
+
+  // Compute geometry of triangles
+  for (int k = 0; k < 3; ++k) {
+    _Angle     [k].resize(ntris);
+    _Cotangent [k].resize(ntris);
+    _EdgeLength[k].resize(ntris);
+  }
+  _Area.resize(ntris);
+
+  ComputeTriangleGeometry eval;
+  eval._Surface    = surface;
+  eval._PointIds   = _PointIds.data();
+  eval._Angle      = _Angle;
+  eval._Cotangent  = _Cotangent;
+  eval._EdgeLength = _EdgeLength;
+  eval._Area       = &_Area;
+  parallel_for(blocked_range<int>(0, ntris), eval);
+
+  // Determine triangles adjacent to each edge
+  int edgeId, *adj;
+  _EdgeTriangles.resize(2 * edges->NumberOfEdges(), -1);
+  for (int t = 0; t < ntris; ++t)
+  for (int k = 0; k < 3; ++k) {
+    edgeId = edges->EdgeId(PointId(t, (k + 1) % 3), PointId(t, (k + 2) % 3));
+    if (edgeId < 0) {
+      _IsTriangulated = false;
+      continue;
+    }
+    adj = _EdgeTriangles.data() + 2 * edgeId;
+    if      (adj[0] < 0) adj[0] = t;
+    else if (adj[1] < 0) adj[1] = t;
+    else _IsTriangulated = false;
+  }
+}
+
+
+} // namespace mirtk
@@ -0,0 +1,471 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/VolumeMapEnergy.h"
+
+#include "mirtk/Math.h"
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/PointSetUtils.h"
+
+#include "vtkImageData.h"
+
+
+namespace mirtk {
+
+
+// =============================================================================
+// Auxiliary functions and functors
+// =============================================================================
+
+namespace VolumeMapEnergyUtils {
+
+
+// -----------------------------------------------------------------------------
+/// Add value to sum using Neumaier's compensated summation
+inline void CompensatedAdd(double &sum, double &c, double value)
+{
+  const double t = sum + value;
+  if (abs(sum) >= abs(value)) c += (sum - t) + value;
+  else                        c += (value - t) + sum;
+  sum = t;
+}
+
+// -----------------------------------------------------------------------------
+/// Harmonic energy density, i.e., sum of squared gradient norms
+inline double HarmonicEnergyDensity(const double *jac, int ncomps)
+{
+  double value = .0;
+  for (int i = 0; i < 3 * ncomps; ++i) value += jac[i] * jac[i];
+  return value;
+}
+
+// -----------------------------------------------------------------------------
+/// Elastic potential of strain tensor of 3D -> 3D map
+inline double DeformationEnergyDensity(const double *jac, double lambda, double mu)
+{
+  double strain[3][3], stress, trace, value = .0;
+  for (int b = 0; b < 3; ++b)
+  for (int a = 0; a < 3; ++a) {
+    strain[a][b] = jac[a] * jac[b] + jac[3 + a] * jac[3 + b] + jac[6 + a] * jac[6 + b];
+    if (a == b) strain[a][b] -= 1.0;
+  }
+  trace = strain[0][0] + strain[1][1] + strain[2][2];
+  for (int b = 0; b < 3; ++b)
+  for (int a = 0; a < 3; ++a) {
+    stress = 2.0 * mu * strain[a][b];
+    if (a == b) stress += lambda * trace;
+    value += stress * strain[a][b];
+  }
+  return .5 * value;
+}
+
+// -----------------------------------------------------------------------------
+/// Common parameters and operations of slice energy functors
+struct EvaluateEnergies
+{
+  int                   _NumberOfSlices;   ///< Number of lattice slices
+  int                   _NumberOfComponents;
+  const double         *_DomainScale;
+  const double         *_CodomainScale;
+  double                _Volume;
+  double                _Lambda;
+  double                _Mu;
+  bool                  _Harmonic;
+  bool                  _Deformation;
+  double               *_HarmonicSum;      ///< Energy of each lattice slice
+  double               *_DeformationSum;   ///< Energy of each lattice slice
+  GenericImage<double> *_HarmonicImage;
+  GenericImage<double> *_DeformationImage;
+
+  /// Scale Jacobian of map to normalized domain and codomain
+  void Normalize(double *jac) const
+  {
+    for (int l = 0; l < _NumberOfComponents; ++l) {
+      const double s = (l < 3 ? _CodomainScale[l] : 1.0);
+      for (int a = 0; a < 3; ++a) jac[3 * l + a] *= s / _DomainScale[a];
+    }
+  }
+
+  /// Add energy at lattice point with given Jacobian to slice sums
+  void Add(const double *jac, int i, int j, int k,
+           double &hsum, double &hc, double &dsum, double &dc) const
+  {
+    double value;
+    if (_Harmonic) {
+      value = _Volume * HarmonicEnergyDensity(jac, _NumberOfComponents);
+      if (_HarmonicImage) _HarmonicImage->Put(i, j, k, value);
+      CompensatedAdd(hsum, hc, value);
+    }
+    if (_Deformation) {
+      value = _Volume * DeformationEnergyDensity(jac, _Lambda, _Mu);
+      if (_DeformationImage) _DeformationImage->Put(i, j, k, value);
+      CompensatedAdd(dsum, dc, value);
+    }
+  }
+
+  /// Mark lattice point as outside the map domain
+  void Outside(int i, int j, int k) const
+  {
+    if (_HarmonicImage   ) _HarmonicImage   ->Put(i, j, k, mirtk::nan);
+    if (_DeformationImage) _DeformationImage->Put(i, j, k, mirtk::nan);
+  }
+
+  /// Store compensated sums of lattice slice
+  void Store(int k, double hsum, double hc, double dsum, double dc) const
+  {
+    if (_Harmonic   ) _HarmonicSum   [k] = hsum + hc;
+    if (_Deformation) _DeformationSum[k] = dsum + dc;
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate energy density at the lattice points of the slices of a slab
+/// using central differences of the map values at neighboring lattice points
+struct EvaluateSliceEnergies : public EvaluateEnergies
+{
+  const GenericImage<double> *_Slab;        ///< Map values of slab including adjacent slices
+  int                         _SliceOffset; ///< Lattice index of first slab image slice
+  double                      _Spacing[3];
+
+  /// Central difference of l-th component along axis a, zero at domain boundary
+  double Derivative(int i, int j, int k, int l, int a) const
+  {
+    int i1 = i, j1 = j, k1 = k, i2 = i, j2 = j, k2 = k;
+    switch (a) {
+      case 0: i1 -= 1, i2 += 1; if (i1 < 0 || i2 >= _Slab->X()) return .0; break;
+      case 1: j1 -= 1, j2 += 1; if (j1 < 0 || j2 >= _Slab->Y()) return .0; break;
+      default:
+        k1 -= 1, k2 += 1;
+        if (k1 < 0 || k2 >= _Slab->Z()) return .0;
+        if (_SliceOffset + k1 < 0 || _SliceOffset + k2 >= _NumberOfSlices) return .0;
+        break;
+    }
+    const double v1 = _Slab->Get(i1, j1, k1, l);
+    const double v2 = _Slab->Get(i2, j2, k2, l);
+    if (IsNaN(v1) || IsNaN(v2)) return .0;
+    return (v2 - v1) / (2.0 * _Spacing[a]);
+  }
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    Array<double> jac(3 * _NumberOfComponents);
+    for (int k = re.begin(); k != re.end(); ++k) {
+      const int kk = _SliceOffset + k; // lattice slice index
+      double hsum = .0, hc = .0, dsum = .0, dc = .0;
+      for (int j = 0; j < _Slab->Y(); ++j)
+      for (int i = 0; i < _Slab->X(); ++i) {
+        if (IsNaN(_Slab->Get(i, j, k, 0))) {
+          Outside(i, j, kk);
+          continue;
+        }
+        for (int l = 0; l < _NumberOfComponents; ++l)
+        for (int a = 0; a < 3; ++a) {
+          jac[3 * l + a] = Derivative(i, j, k, l, a);
+        }
+        Normalize(jac.data());
+        Add(jac.data(), i, j, kk, hsum, hc, dsum, dc);
+      }
+      Store(kk, hsum, hc, dsum, dc);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Evaluate energy density at the lattice points of the slices of a slab
+/// given the Jacobian of the map evaluated at these points
+struct EvaluateJacobianEnergies : public EvaluateEnergies
+{
+  const double *_Jacobian;    ///< Jacobian at each lattice point of slab
+  const bool   *_Inside;      ///< Whether lattice point is inside map domain
+  const int    *_Index;       ///< Lattice index i + nx * j of each point
+  const int    *_Offset;      ///< Index of first point of each slab slice
+  int           _SliceOffset; ///< Lattice index of first slab slice
+  int           _X;           ///< Number of lattice points along x axis
+
+  void operator ()(const blocked_range<int> &re) const
+  {
+    const int stride = 3 * _NumberOfComponents;
+    Array<double> jac(stride);
+    for (int k = re.begin(); k != re.end(); ++k) {
+      const int kk = _SliceOffset + k; // lattice slice index
+      double hsum = .0, hc = .0, dsum = .0, dc = .0;
+      for (int n = _Offset[k]; n < _Offset[k + 1]; ++n) {
+        const int i = _Index[n] % _X;
+        const int j = _Index[n] / _X;
+        if (!_Inside[n]) {
+          Outside(i, j, kk);
+          continue;
+        }
+        for (int c = 0; c < stride; ++c) jac[c] = _Jacobian[stride * n + c];
+        Normalize(jac.data());
+        Add(jac.data(), i, j, kk, hsum, hc, dsum, dc);
+      }
+      Store(kk, hsum, hc, dsum, dc);
+    }
+  }
+};
+
+
+} // namespace VolumeMapEnergyUtils
+using namespace VolumeMapEnergyUtils;
+
+// =============================================================================
+// Construction/Destruction
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void VolumeMapEnergy::CopyAttributes(const VolumeMapEnergy &other)
+{
+  _Lattice                   = other._Lattice;
+  _Mask                      = other._Mask;
+  _EvaluateHarmonicEnergy    = other._EvaluateHarmonicEnergy;
+  _EvaluateDeformationEnergy = other._EvaluateDeformationEnergy;
+  _Lambda                    = other._Lambda;
+  _Mu                        = other._Mu;
+  _UseMapJacobian            = other._UseMapJacobian;
+  _NumberOfSlicesPerSlab     = other._NumberOfSlicesPerSlab;
+  _HarmonicEnergyImage       = other._HarmonicEnergyImage;
+  _DeformationEnergyImage    = other._DeformationEnergyImage;
+  _HarmonicEnergy            = other._HarmonicEnergy;
+  _DeformationEnergy         = other._DeformationEnergy;
+  for (int i = 0; i < 3; ++i) {
+    _DomainScale  [i] = other._DomainScale  [i];
+    _CodomainScale[i] = other._CodomainScale[i];
+  }
+}
+
+// -----------------------------------------------------------------------------
+VolumeMapEnergy::VolumeMapEnergy()
+:
+  _EvaluateHarmonicEnergy(true),
+  _EvaluateDeformationEnergy(false),
+  _Lambda(.0335),
+  _Mu(.0224),
+  _UseMapJacobian(false),
+  _NumberOfSlicesPerSlab(0),
+  _HarmonicEnergyImage(nullptr),
+  _DeformationEnergyImage(nullptr),
+  _HarmonicEnergy(.0),
+  _DeformationEnergy(.0)
+{
+  for (int i = 0; i < 3; ++i) {
+    _DomainScale  [i] = 1.0;
+    _CodomainScale[i] = 1.0;
+  }
+}
+
+// -----------------------------------------------------------------------------
+VolumeMapEnergy::VolumeMapEnergy(const VolumeMapEnergy &other)
+:
+  Object(other)
+{
+  CopyAttributes(other);
+}
+
+// -----------------------------------------------------------------------------
+VolumeMapEnergy &VolumeMapEnergy::operator =(const VolumeMapEnergy &other)
+{
+  if (this != &other) {
+    Object::operator =(other);
+    CopyAttributes(other);
+  }
+  return *this;
+}
+
+// -----------------------------------------------------------------------------
+VolumeMapEnergy::~VolumeMapEnergy()
+{
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void VolumeMapEnergy::Normalize(const double domain[6], const double codomain[6])
+{
+  for (int i = 0; i < 3; ++i) {
+    const double l1 = domain  [2 * i + 1] - domain  [2 * i];
+    const double l2 = codomain[2 * i + 1] - codomain[2 * i];
+    _DomainScale  [i] = (l1 > .0 ? 1.0 / l1 : 1.0);
+    _CodomainScale[i] = (l2 > .0 ? 1.0 / l2 : 1.0);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void VolumeMapEnergy::Run(const Mapping *map)
+{
+  const ImageAttributes &lattice = _Lattice;
+  const int ncomps = map->NumberOfComponents();
+  const int nz     = lattice._z;
+
+  if (_EvaluateDeformationEnergy && ncomps != 3) {
+    cerr << this->NameOfType() << "::Run: Can compute deformation energy only from 3D -> 3D volumetric map" << endl;
+    exit(1);
+  }
+
+  _HarmonicEnergy = _DeformationEnergy = .0;
+  if (!_EvaluateHarmonicEnergy && !_EvaluateDeformationEnergy) return;
+
+  ImageAttributes attr = lattice;
+  attr._t  = (_UseMapJacobian ? 1 : ncomps);
+  attr._dt = .0;
+
+  ImageAttributes scalar_attr = lattice;
+  scalar_attr._t  = 1;
+  scalar_attr._dt = .0;
+  if (_HarmonicEnergyImage    && _EvaluateHarmonicEnergy   ) _HarmonicEnergyImage   ->Initialize(scalar_attr, 1);
+  if (_DeformationEnergyImage && _EvaluateDeformationEnergy) _DeformationEnergyImage->Initialize(scalar_attr, 1);
+
+  // Number of lattice slices per slab
+  const long nxy = static_cast<long>(lattice._x) * static_cast<long>(lattice._y);
+  const long nv  = (_UseMapJacobian ? 3 * ncomps : ncomps);
+  int nslices = _NumberOfSlicesPerSlab;
+  if (nslices <= 0) nslices = static_cast<int>(max(1L, (1L << 24) / (nxy * nv)));
+  if (nslices > nz) nslices = nz;
+
+  Array<double> harmonic_sum   (_EvaluateHarmonicEnergy    ? nz : 0, .0);
+  Array<double> deformation_sum(_EvaluateDeformationEnergy ? nz : 0, .0);
+
+  EvaluateEnergies params;
+  params._NumberOfSlices     = nz;
+  params._NumberOfComponents = ncomps;
+  params._DomainScale        = _DomainScale;
+  params._CodomainScale      = _CodomainScale;
+  params._Volume             = lattice._dx * lattice._dy * lattice._dz
+                             * _DomainScale[0] * _DomainScale[1] * _DomainScale[2];
+  params._Lambda             = _Lambda;
+  params._Mu                 = _Mu;
+  params._Harmonic           = _EvaluateHarmonicEnergy;
+  params._Deformation        = _EvaluateDeformationEnergy;
+  params._HarmonicSum        = harmonic_sum.data();
+  params._DeformationSum     = deformation_sum.data();
+  params._HarmonicImage      = (_EvaluateHarmonicEnergy    ? _HarmonicEnergyImage    : nullptr);
+  params._DeformationImage   = (_EvaluateDeformationEnergy ? _DeformationEnergyImage : nullptr);
+
+  // Evaluate map for each slab, where the slab lattice is centered at the
+  // world coordinates of its central slice
+  GenericImage<double> slab;
+  double x, y, z;
+  if (_UseMapJacobian) {
+    EvaluateJacobianEnergies eval;
+    static_cast<EvaluateEnergies &>(eval) = params;
+    eval._X = lattice._x;
+    Array<double>     xyz, jac;
+    Array<int>        index, offset(nslices + 1);
+    UniquePtr<bool[]> inside;
+    int               ninside = 0;
+    for (int k1 = 0; k1 < nz; k1 += nslices) {
+      const int k2 = min(k1 + nslices, nz);
+      ImageAttributes slab_attr = attr;
+      slab_attr._z = k2 - k1;
+      x = .5 * (lattice._x - 1);
+      y = .5 * (lattice._y - 1);
+      z = k1 + .5 * (slab_attr._z - 1);
+      lattice.LatticeToWorld(x, y, z);
+      slab_attr._xorigin = x;
+      slab_attr._yorigin = y;
+      slab_attr._zorigin = z;
+      if (slab.Z() != slab_attr._z) slab.Initialize(slab_attr);
+      else                          slab.PutOrigin(x, y, z);
+      vtkSmartPointer<vtkImageData> mask;
+      if (_Mask) {
+        mask = NewVtkMask(slab_attr._x, slab_attr._y, slab_attr._z);
+        ImageStencilToMask(ImageStencil(mask, WorldToImage(_Mask, &slab)), mask);
+      }
+      // Collect lattice points within mask slice by slice
+      xyz.clear(), index.clear();
+      for (int k = 0; k < slab_attr._z; ++k) {
+        offset[k] = static_cast<int>(index.size());
+        for (int j = 0; j < slab_attr._y; ++j)
+        for (int i = 0; i < slab_attr._x; ++i) {
+          if (mask && mask->GetScalarComponentAsFloat(i, j, k, 0) == .0) {
+            params.Outside(i, j, k1 + k);
+            continue;
+          }
+          x = i, y = j, z = k;
+          slab.ImageToWorld(x, y, z);
+          xyz.push_back(x);
+          xyz.push_back(y);
+          xyz.push_back(z);
+          index.push_back(i + slab_attr._x * j);
+        }
+      }
+      offset[slab_attr._z] = static_cast<int>(index.size());
+      const int npoints = offset[slab_attr._z];
+      jac.resize(3 * ncomps * static_cast<size_t>(npoints));
+      if (npoints > ninside) {
+        inside.reset(new bool[npoints]);
+        ninside = npoints;
+      }
+      map->EvaluateJacobian(npoints, xyz.data(), jac.data(), inside.get());
+      eval._Jacobian    = jac.data();
+      eval._Inside      = inside.get();
+      eval._Index       = index.data();
+      eval._Offset      = offset.data();
+      eval._SliceOffset = k1;
+      parallel_for(blocked_range<int>(0, slab_attr._z), eval);
+    }
+  } else {
+    // Evaluate map values of each slab with one adjacent slice on either side
+    EvaluateSliceEnergies eval;
+    static_cast<EvaluateEnergies &>(eval) = params;
+    eval._Spacing[0] = (lattice._dx > .0 ? lattice._dx : 1.0);
+    eval._Spacing[1] = (lattice._dy > .0 ? lattice._dy : 1.0);
+    eval._Spacing[2] = (lattice._dz > .0 ? lattice._dz : 1.0);
+    for (int k1 = 0; k1 < nz; k1 += nslices) {
+      const int k2  = min(k1 + nslices, nz);
+      const int kk1 = max(0,  k1 - 1);
+      const int kk2 = min(nz, k2 + 1);
+      ImageAttributes slab_attr = attr;
+      slab_attr._z = kk2 - kk1;
+      x = .5 * (lattice._x - 1);
+      y = .5 * (lattice._y - 1);
+      z = kk1 + .5 * (slab_attr._z - 1);
+      lattice.LatticeToWorld(x, y, z);
+      slab_attr._xorigin = x;
+      slab_attr._yorigin = y;
+      slab_attr._zorigin = z;
+      if (slab.Z() != slab_attr._z) slab.Initialize(slab_attr);
+      else                          slab.PutOrigin(x, y, z);
+      map->Evaluate(slab, 0, _Mask);
+      eval._Slab        = &slab;
+      eval._SliceOffset = kk1;
+      parallel_for(blocked_range<int>(k1 - kk1, k2 - kk1), eval);
+    }
+  }
+
+  // Sum slice energies in order independent of number of threads
+  double sum, c;
+  if (_EvaluateHarmonicEnergy) {
+    sum = c = .0;
+    for (int k = 0; k < nz; ++k) CompensatedAdd(sum, c, harmonic_sum[k]);
+    _HarmonicEnergy = sum + c;
+  }
+  if (_EvaluateDeformationEnergy) {
+    sum = c = .0;
+    for (int k = 0; k < nz; ++k) CompensatedAdd(sum, c, deformation_sum[k]);
+    _DeformationEnergy = sum + c;
+  }
+}
+
+
+} // namespace mirtk
@@ -28,6 +28,10 @@
 #include "vtkCellData.h"
 #include "vtkDataArray.h"
 
+#ifdef HAVE_TBB
+#  include "tbb/task_arena.h"
+#endif
+
 
 namespace mirtk {
 
@@ -39,10 +43,14 @@ namespace mirtk {
 // -----------------------------------------------------------------------------
 void VolumeMapper::CopyAttributes(const VolumeMapper &other)
 {
-  _InputSet    = other._InputSet;
-  _InputMap    = other._InputMap;
-  _Boundary    = other._Boundary;
-  _BoundaryMap = other._BoundaryMap;
+  _InputSet               = other._InputSet;
+  _InputMap               = other._InputMap;
+  _Boundary               = other._Boundary;
+  _BoundaryMap            = other._BoundaryMap;
+  _Statistics             = other._Statistics;
+  _Observer               = other._Observer;
+  _CompactOutput          = other._CompactOutput;
+  _MaximumNumberOfThreads = other._MaximumNumberOfThreads;
 
   if (other._Output) {
     _Output = SharedPtr<Mapping>(other._Output->NewCopy());
@@ -53,6 +61,10 @@ void VolumeMapper::CopyAttributes(const VolumeMapper &other)
 
 // -----------------------------------------------------------------------------
 VolumeMapper::VolumeMapper()
+:
+  _Observer(nullptr),
+  _CompactOutput(false),
+  _MaximumNumberOfThreads(0)
 {
 }
 
@@ -81,12 +93,57 @@ VolumeMapper::~VolumeMapper()
 // Execution
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+struct VolumeMapper::Execution
+{
+  VolumeMapper *_Mapper;
+
+  void operator ()() const
+  {
+    _Mapper->Execute();
+  }
+};
+
 // -----------------------------------------------------------------------------
 void VolumeMapper::Run()
 {
-  this->Initialize();
-  this->Solve();
-  this->Finalize();
+  #ifdef HAVE_TBB
+    if (_MaximumNumberOfThreads > 0) {
+      Execution execution;
+      execution._Mapper = this;
+      tbb::task_arena arena(_MaximumNumberOfThreads);
+      arena.execute(execution);
+      return;
+    }
+  #endif
+  this->Execute();
+}
+
+// -----------------------------------------------------------------------------
+void VolumeMapper::Execute()
+{
+  _Statistics.Clear();
+  _Statistics.Mapper(this->NameOfClass());
+  if (_Observer) _Observer->Start();
+  MapperStatistics::Timer run(&_Statistics, "run");
+  {
+    MapperStatistics::Timer timer(&_Statistics, "initialize");
+    this->Initialize();
+  }
+  if (!_Observer || _Observer->Continue()) {
+    MapperStatistics::Timer timer(&_Statistics, "compute");
+    this->Solve();
+    while ((!_Observer || _Observer->Continue()) && this->Refine()) {
+      this->Solve();
+    }
+  }
+  {
+    MapperStatistics::Timer timer(&_Statistics, "finalize");
+    this->Finalize();
+  }
+  run.Stop();
+  _Statistics.Status(_Observer ? _Observer->Status() : MapperStatus_Completed);
+  _Statistics.UpdatePeakMemory();
 }
 
 // -----------------------------------------------------------------------------
@@ -128,9 +185,17 @@ void VolumeMapper::InitializeBoundary(vtkPointSet *input, vtkDataArray *map)
   _BoundaryMap->SetName("BoundaryMap");
 }
 
+// -----------------------------------------------------------------------------
+bool VolumeMapper::Refine()
+{
+  return false;
+}
+
 // -----------------------------------------------------------------------------
 void VolumeMapper::Finalize()
 {
+  // Convert output map to compact storage
+  if (_CompactOutput && _Output) _Output->Compact();
 }
 
 
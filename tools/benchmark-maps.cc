@@ -0,0 +1,920 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/Common.h"
+#include "mirtk/Options.h"
+
+#include "mirtk/Array.h"
+#include "mirtk/Memory.h"
+#include "mirtk/UnorderedMap.h"
+#include "mirtk/GenericImage.h"
+#include "mirtk/SurfaceBoundary.h"
+
+#include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/CompositeMapping.h"
+#include "mirtk/LatticeMap.h"
+#include "mirtk/MultiResolutionMap.h"
+#include "mirtk/SquareToDiskMap.h"
+#include "mirtk/DiskToSquareMap.h"
+#include "mirtk/StereographicMap.h"
+#include "mirtk/InverseStereographicMap.h"
+
+#include "mirtk/BoundaryToDiskMapper.h"
+#include "mirtk/BoundaryToSquareMapper.h"
+#include "mirtk/BoundaryToPolygonMapper.h"
+
+#include "mirtk/UniformSurfaceMapper.h"
+#include "mirtk/ChordLengthSurfaceMapper.h"
+#include "mirtk/HarmonicSurfaceMapper.h"
+#include "mirtk/ShapePreservingSurfaceMapper.h"
+#include "mirtk/AuthalicSurfaceMapper.h"
+#include "mirtk/IntrinsicSurfaceMapper.h"
+#include "mirtk/IntrinsicLeastAreaDistortionSurfaceMapper.h"
+#include "mirtk/IntrinsicLeastEdgeLengthDistortionSurfaceMapper.h"
+#include "mirtk/MeanValueSurfaceMapper.h"
+#include "mirtk/ConformalSurfaceFlattening.h"
+#include "mirtk/LeastSquaresConformalSurfaceMapper.h"
+#include "mirtk/SpectralConformalSurfaceMapper.h"
+
+#include "mirtk/AsConformalAsPossibleMapper.h"
+#include "mirtk/HarmonicTetrahedralMeshMapper.h"
+#include "mirtk/SpectralTetrahedralMeshMapper.h"
+#include "mirtk/MeshlessHarmonicVolumeMapper.h"
+#include "mirtk/MeshlessBiharmonicVolumeMapper.h"
+#include "mirtk/MeshlessCompactVolumeMapper.h"
+#include "mirtk/MeanValueCoordinatesVolumeMapper.h"
+
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <fstream>
+
+#include "vtkNew.h"
+#include "vtkSmartPointer.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkPolyData.h"
+#include "vtkUnstructuredGrid.h"
+#include "vtkPointData.h"
+#include "vtkDataArray.h"
+#include "vtkFloatArray.h"
+
+
+using namespace mirtk;
+
+
+// =============================================================================
+// Help
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void PrintHelp(const char* name)
+{
+  cout << "\n";
+  cout << "usage: " << name << " <output> [options]\n";
+  cout << "\n";
+  cout << "Measures the execution time of the boundary, surface, and volume mappers as well as\n";
+  cout << "the lattice evaluation and file I/O of the maps of this module on synthetic inputs.\n";
+  cout << "The inputs are icospheres, open disks obtained by cutting an icosphere in half, and\n";
+  cout << "tetrahedral meshes of a ball, each generated at several sizes. The wall-clock and CPU\n";
+  cout << "time of each execution phase (Initialize, ComputeMap or Solve, Finalize) is averaged\n";
+  cout << "over the given number of repetitions and written to a JSON file.\n";
+  cout << "\n";
+  cout << "Arguments:\n";
+  cout << "  output   Output JSON file.\n";
+  cout << "\n";
+  cout << "Optional arguments:\n";
+  cout << "  -icosphere-levels <n>...   Subdivision levels of icosphere and disk inputs. (default: 2 3 4)\n";
+  cout << "  -ball-resolutions <n>...   Number of lattice cells along the diameter of the tetrahedralized\n";
+  cout << "                             ball inputs. (default: 8 12 16)\n";
+  cout << "  -lattice-size <n>          Number of lattice points along each axis at which maps are\n";
+  cout << "                             evaluated. (default: 64)\n";
+  cout << "  -repetitions <n>           Number of repetitions of each benchmark. (default: 3)\n";
+  cout << "  -class <name>...           Only benchmark the named mapper and map classes. (default: all)\n";
+  cout << "  -temp-dir <dir>            Directory of temporary map files. (default: .)\n";
+  PrintCommonOptions(cout);
+  cout << "\n";
+}
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Wall-clock and CPU time elapsed since construction
+struct Stopwatch
+{
+  std::chrono::steady_clock::time_point _Wall;
+  clock_t                               _CPU;
+
+  Stopwatch() : _Wall(std::chrono::steady_clock::now()), _CPU(clock()) {}
+
+  double WallTime() const
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _Wall).count();
+  }
+
+  double CPUTime() const
+  {
+    return static_cast<double>(clock() - _CPU) / static_cast<double>(CLOCKS_PER_SEC);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Accumulated execution time of a benchmarked phase
+struct PhaseTime
+{
+  double _WallTime;
+  double _CPUTime;
+  int    _Count;
+
+  PhaseTime() : _WallTime(.0), _CPUTime(.0), _Count(0) {}
+
+  void Add(const Stopwatch &t)
+  {
+    _WallTime += t.WallTime();
+    _CPUTime  += t.CPUTime();
+    _Count    += 1;
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Synthetic benchmark input
+struct BenchmarkInput
+{
+  string                       _Name;     ///< Type of input, e.g., "icosphere"
+  int                          _Size;     ///< Size parameter of generated input
+  vtkSmartPointer<vtkPointSet> _PointSet; ///< Generated input point set
+};
+
+// -----------------------------------------------------------------------------
+/// Timing of one phase of one benchmarked class for a given input
+struct BenchmarkResult
+{
+  string    _Class;
+  string    _Phase;
+  string    _Input;
+  int       _Size;
+  vtkIdType _NumberOfPoints;
+  vtkIdType _NumberOfCells;
+  PhaseTime _Time;
+};
+
+// -----------------------------------------------------------------------------
+/// Benchmark settings and results
+struct Benchmark
+{
+  int                     _Repetitions;
+  int                     _LatticeSize;
+  string                  _TempDir;
+  Array<string>           _Classes;
+  Array<BenchmarkResult>  _Results;
+
+  /// Whether to benchmark the named class
+  bool Selected(const char *name) const
+  {
+    if (_Classes.empty()) return true;
+    for (const auto &cls : _Classes) {
+      if (cls == name) return true;
+    }
+    return false;
+  }
+
+  /// Append result of benchmarked phase
+  void Record(const char *cls, const char *phase, const BenchmarkInput &input, const PhaseTime &t)
+  {
+    if (t._Count == 0) return;
+    BenchmarkResult result;
+    result._Class          = cls;
+    result._Phase          = phase;
+    result._Input          = input._Name;
+    result._Size           = input._Size;
+    result._NumberOfPoints = (input._PointSet ? input._PointSet->GetNumberOfPoints() : 0);
+    result._NumberOfCells  = (input._PointSet ? input._PointSet->GetNumberOfCells()  : 0);
+    result._Time           = t;
+    _Results.push_back(result);
+    if (verbose) {
+      cout << "  " << cls << "::" << phase << " (" << input._Name << " " << input._Size
+           << "): " << t._WallTime / t._Count << " s" << endl;
+    }
+  }
+
+  /// Write results to JSON file
+  bool Write(const char *fname) const
+  {
+    std::ofstream ofs(fname);
+    if (!ofs) return false;
+    char date[32];
+    const time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    ofs << "{\n";
+    ofs << "  \"context\": {\n";
+    ofs << "    \"date\": \"" << date << "\",\n";
+    ofs << "    \"repetitions\": " << _Repetitions << ",\n";
+    ofs << "    \"lattice_size\": " << _LatticeSize << "\n";
+    ofs << "  },\n";
+    ofs << "  \"benchmarks\": [";
+    ofs.precision(9);
+    for (size_t i = 0; i < _Results.size(); ++i) {
+      const BenchmarkResult &r = _Results[i];
+      ofs << (i > 0 ? "," : "") << "\n    {";
+      ofs << "\"class\": \"" << r._Class << "\", ";
+      ofs << "\"phase\": \"" << r._Phase << "\", ";
+      ofs << "\"input\": \"" << r._Input << "\", ";
+      ofs << "\"size\": " << r._Size << ", ";
+      ofs << "\"points\": " << r._NumberOfPoints << ", ";
+      ofs << "\"cells\": " << r._NumberOfCells << ", ";
+      ofs << "\"repetitions\": " << r._Time._Count << ", ";
+      ofs << "\"wall_time\": " << r._Time._WallTime / r._Time._Count << ", ";
+      ofs << "\"cpu_time\": " << r._Time._CPUTime / r._Time._Count << "}";
+    }
+    ofs << "\n  ]\n";
+    ofs << "}\n";
+    return !ofs.fail();
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Mapper which measures the execution time of each phase of Run
+///
+/// Used for boundary and surface mappers whose Run calls Initialize,
+/// ComputeMap, and Finalize.
+template <class TMapper>
+class TimedMapper : public TMapper
+{
+  PhaseTime *_Times;
+
+public:
+
+  TimedMapper(const TMapper &mapper, PhaseTime times[3])
+  :
+    TMapper(mapper), _Times(times)
+  {}
+
+protected:
+
+  virtual void Initialize()
+  {
+    Stopwatch t;
+    TMapper::Initialize();
+    _Times[0].Add(t);
+  }
+
+  virtual void ComputeMap()
+  {
+    Stopwatch t;
+    TMapper::ComputeMap();
+    _Times[1].Add(t);
+  }
+
+  virtual void Finalize()
+  {
+    Stopwatch t;
+    TMapper::Finalize();
+    _Times[2].Add(t);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Volume mapper which measures the execution time of each phase of Run
+template <class TMapper>
+class TimedVolumeMapper : public TMapper
+{
+  PhaseTime *_Times;
+
+public:
+
+  TimedVolumeMapper(const TMapper &mapper, PhaseTime times[3])
+  :
+    TMapper(mapper), _Times(times)
+  {}
+
+protected:
+
+  virtual void Initialize()
+  {
+    Stopwatch t;
+    TMapper::Initialize();
+    _Times[0].Add(t);
+  }
+
+  virtual void Solve()
+  {
+    Stopwatch t;
+    TMapper::Solve();
+    _Times[1].Add(t);
+  }
+
+  virtual void Finalize()
+  {
+    Stopwatch t;
+    TMapper::Finalize();
+    _Times[2].Add(t);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Benchmark boundary or surface mapper with given settings
+///
+/// \param[in]  bench  Benchmark settings and results.
+/// \param[in]  input  Benchmark input.
+/// \param[in]  mapper Mapper with inputs and parameters set.
+/// \param[out] output Output map of the last repetition.
+template <class TMapper, class TMap>
+void BenchmarkMapper(Benchmark &bench, const BenchmarkInput &input,
+                     const TMapper &mapper, SharedPtr<TMap> &output)
+{
+  output = nullptr;
+  if (!bench.Selected(TMapper::NameOfType())) return;
+  PhaseTime times[3];
+  for (int rep = 0; rep < bench._Repetitions; ++rep) {
+    TimedMapper<TMapper> timed(mapper, times);
+    timed.Run();
+    output = timed.Output();
+  }
+  bench.Record(TMapper::NameOfType(), "Initialize", input, times[0]);
+  bench.Record(TMapper::NameOfType(), "ComputeMap", input, times[1]);
+  bench.Record(TMapper::NameOfType(), "Finalize",   input, times[2]);
+}
+
+// -----------------------------------------------------------------------------
+/// Benchmark volume mapper with given settings
+template <class TMapper>
+SharedPtr<Mapping> BenchmarkVolumeMapper(Benchmark &bench, const BenchmarkInput &input,
+                                         const TMapper &mapper)
+{
+  SharedPtr<Mapping> output;
+  if (!bench.Selected(TMapper::NameOfType())) return output;
+  PhaseTime times[3];
+  for (int rep = 0; rep < bench._Repetitions; ++rep) {
+    TimedVolumeMapper<TMapper> timed(mapper, times);
+    timed.Run();
+    output = timed.Output();
+  }
+  bench.Record(TMapper::NameOfType(), "Initialize", input, times[0]);
+  bench.Record(TMapper::NameOfType(), "Solve",      input, times[1]);
+  bench.Record(TMapper::NameOfType(), "Finalize",   input, times[2]);
+  return output;
+}
+
+// -----------------------------------------------------------------------------
+/// Benchmark lattice evaluation and file I/O of a map
+///
+/// \param[in] bench Benchmark settings and results.
+/// \param[in] input Input of mapper which computed the map.
+/// \param[in] map   Initialized map.
+/// \param[in] io    Whether the map type supports file I/O.
+void BenchmarkMap(Benchmark &bench, const BenchmarkInput &input,
+                  const SharedPtr<const Mapping> &map, bool io = true)
+{
+  if (!map || !bench.Selected(map->NameOfClass())) return;
+  const char * const cls = map->NameOfClass();
+
+  // Exclude on demand construction of cell locator from evaluation time
+  const PiecewiseLinearMap * const plm = dynamic_cast<const PiecewiseLinearMap *>(map.get());
+  if (plm) plm->BuildLocators();
+
+  const int n = bench._LatticeSize;
+  GenericImage<float> values(map->Attributes(n, n, n), map->NumberOfComponents());
+  PhaseTime eval_time;
+  for (int rep = 0; rep < bench._Repetitions; ++rep) {
+    Stopwatch t;
+    map->Evaluate(values);
+    eval_time.Add(t);
+  }
+  bench.Record(cls, "Evaluate", input, eval_time);
+
+  if (io) {
+    string fname = bench._TempDir + "/benchmark-maps-tmp";
+    if (plm) fname += ".plm";
+    else     fname += ".map";
+    PhaseTime write_time, read_time;
+    for (int rep = 0; rep < bench._Repetitions; ++rep) {
+      {
+        Stopwatch t;
+        if (!map->Write(fname.c_str())) {
+          FatalError("Failed to write " << cls << " to temporary file " << fname);
+        }
+        write_time.Add(t);
+      }
+      {
+        Stopwatch t;
+        UniquePtr<Mapping> copy(Mapping::New(fname.c_str()));
+        read_time.Add(t);
+      }
+    }
+    remove(fname.c_str());
+    bench.Record(cls, "Write", input, write_time);
+    bench.Record(cls, "Read",  input, read_time);
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Convert point coordinates and triangles to surface mesh
+vtkSmartPointer<vtkPolyData> NewSurface(const Array<double> &coords, const Array<int> &tris)
+{
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetNumberOfPoints(static_cast<vtkIdType>(coords.size() / 3));
+  for (vtkIdType ptId = 0; ptId < points->GetNumberOfPoints(); ++ptId) {
+    points->SetPoint(ptId, coords.data() + 3 * ptId);
+  }
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  vtkIdType ptIds[3];
+  for (size_t i = 0; i < tris.size(); i += 3) {
+    ptIds[0] = tris[i], ptIds[1] = tris[i + 1], ptIds[2] = tris[i + 2];
+    polys->InsertNextCell(3, ptIds);
+  }
+  vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+  surface->SetPoints(points);
+  surface->SetPolys(polys);
+  surface->BuildLinks();
+  return surface;
+}
+
+// -----------------------------------------------------------------------------
+/// Generate unit icosphere by repeated subdivision of an icosahedron
+///
+/// \param[in]  level  Number of subdivision levels.
+/// \param[out] coords Point coordinates.
+/// \param[out] tris   Point indices of triangles.
+void Icosphere(int level, Array<double> &coords, Array<int> &tris)
+{
+  const double t = .5 * (1. + sqrt(5.));
+  coords = {
+    -1.,  t,  0.,   1.,  t,  0.,  -1., -t,  0.,   1., -t,  0.,
+     0., -1.,  t,   0.,  1.,  t,   0., -1., -t,   0.,  1., -t,
+      t,  0., -1.,   t,  0.,  1.,  -t,  0., -1.,  -t,  0.,  1.
+  };
+  tris = {
+    0, 11,  5,   0,  5,  1,   0,  1,  7,   0,  7, 10,   0, 10, 11,
+    1,  5,  9,   5, 11,  4,  11, 10,  2,  10,  7,  6,   7,  1,  8,
+    3,  9,  4,   3,  4,  2,   3,  2,  6,   3,  6,  8,   3,  8,  9,
+    4,  9,  5,   2,  4, 11,   6,  2, 10,   8,  6,  7,   9,  8,  1
+  };
+  for (int l = 0; l < level; ++l) {
+    UnorderedMap<int64_t, int> midpoints;
+    Array<int> subdivided;
+    subdivided.reserve(4 * tris.size());
+    for (size_t i = 0; i < tris.size(); i += 3) {
+      int m[3];
+      for (int k = 0; k < 3; ++k) {
+        const int a = tris[i + k];
+        const int b = tris[i + (k + 1) % 3];
+        const int64_t key = (static_cast<int64_t>(min(a, b)) << 32) | static_cast<int64_t>(max(a, b));
+        auto it = midpoints.find(key);
+        if (it == midpoints.end()) {
+          m[k] = static_cast<int>(coords.size() / 3);
+          for (int j = 0; j < 3; ++j) {
+            coords.push_back(.5 * (coords[3 * a + j] + coords[3 * b + j]));
+          }
+          midpoints[key] = m[k];
+        } else {
+          m[k] = it->second;
+        }
+      }
+      const int a = tris[i], b = tris[i + 1], c = tris[i + 2];
+      subdivided.insert(subdivided.end(), { a, m[0], m[2] });
+      subdivided.insert(subdivided.end(), { b, m[1], m[0] });
+      subdivided.insert(subdivided.end(), { c, m[2], m[1] });
+      subdivided.insert(subdivided.end(), { m[0], m[1], m[2] });
+    }
+    tris.swap(subdivided);
+  }
+  for (size_t i = 0; i < coords.size(); i += 3) {
+    const double r = sqrt(coords[i] * coords[i] + coords[i+1] * coords[i+1] + coords[i+2] * coords[i+2]);
+    for (int j = 0; j < 3; ++j) coords[i + j] /= r;
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Generate closed icosphere surface mesh
+vtkSmartPointer<vtkPolyData> IcosphereSurface(int level)
+{
+  Array<double> coords;
+  Array<int>    tris;
+  Icosphere(level, coords, tris);
+  return NewSurface(coords, tris);
+}
+
+// -----------------------------------------------------------------------------
+/// Generate open disk topology surface mesh from upper half of icosphere
+vtkSmartPointer<vtkPolyData> HemisphereSurface(int level)
+{
+  Array<double> coords, disk_coords;
+  Array<int>    tris, disk_tris;
+  Icosphere(level, coords, tris);
+  Array<int> index(coords.size() / 3, -1);
+  for (size_t i = 0; i < tris.size(); i += 3) {
+    if (coords[3 * tris[i] + 2] < -1e-6 || coords[3 * tris[i + 1] + 2] < -1e-6 || coords[3 * tris[i + 2] + 2] < -1e-6) {
+      continue;
+    }
+    for (int k = 0; k < 3; ++k) {
+      int &idx = index[tris[i + k]];
+      if (idx < 0) {
+        idx = static_cast<int>(disk_coords.size() / 3);
+        for (int j = 0; j < 3; ++j) disk_coords.push_back(coords[3 * tris[i + k] + j]);
+      }
+      disk_tris.push_back(idx);
+    }
+  }
+  return NewSurface(disk_coords, disk_tris);
+}
+
+// -----------------------------------------------------------------------------
+/// Generate tetrahedral mesh of unit ball
+///
+/// The cubes of a regular lattice whose center is inside the ball are each
+/// subdivided into six tetrahedra sharing the main diagonal of the cube,
+/// which results in a conforming tetrahedralization. The point data of the
+/// returned mesh contains the boundary map values, i.e., the projection of
+/// each point onto the unit sphere.
+///
+/// \param[in] n Number of lattice cells along the diameter of the ball.
+vtkSmartPointer<vtkUnstructuredGrid> TetrahedralBall(int n)
+{
+  const double h = 2. / n;
+  const int    m = n + 1;
+  const int perm[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+  vtkSmartPointer<vtkPoints>           points = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkUnstructuredGrid> mesh   = vtkSmartPointer<vtkUnstructuredGrid>::New();
+  mesh->Allocate(6 * n * n * n);
+
+  Array<vtkIdType> index(m * m * m, -1);
+  int       v[3], w[4][3];
+  double    p[4][3], c[3], a[3], b[3], d[3], r;
+  vtkIdType ptIds[4];
+
+  for (int k = 0; k < n; ++k)
+  for (int j = 0; j < n; ++j)
+  for (int i = 0; i < n; ++i) {
+    c[0] = -1. + (i + .5) * h;
+    c[1] = -1. + (j + .5) * h;
+    c[2] = -1. + (k + .5) * h;
+    if (c[0] * c[0] + c[1] * c[1] + c[2] * c[2] > 1.) continue;
+    for (int t = 0; t < 6; ++t) {
+      v[0] = i, v[1] = j, v[2] = k;
+      for (int l = 0; l < 4; ++l) {
+        if (l > 0) v[perm[t][l - 1]] += 1;
+        for (int x = 0; x < 3; ++x) {
+          w[l][x] = v[x];
+          p[l][x] = -1. + v[x] * h;
+        }
+      }
+      for (int l = 0; l < 4; ++l) {
+        vtkIdType &ptId = index[(w[l][2] * m + w[l][1]) * m + w[l][0]];
+        if (ptId < 0) ptId = points->InsertNextPoint(p[l]);
+        ptIds[l] = ptId;
+      }
+      // Ensure positive orientation of tetrahedron
+      for (int x = 0; x < 3; ++x) {
+        a[x] = p[1][x] - p[0][x];
+        b[x] = p[2][x] - p[0][x];
+        d[x] = p[3][x] - p[0][x];
+      }
+      if (a[0] * (b[1] * d[2] - b[2] * d[1]) -
+          a[1] * (b[0] * d[2] - b[2] * d[0]) +
+          a[2] * (b[0] * d[1] - b[1] * d[0]) < .0) {
+        std::swap(ptIds[2], ptIds[3]);
+      }
+      mesh->InsertNextCell(VTK_TETRA, 4, ptIds);
+    }
+  }
+  mesh->SetPoints(points);
+
+  vtkSmartPointer<vtkDataArray> values = vtkSmartPointer<vtkFloatArray>::New();
+  values->SetName("BoundaryMap");
+  values->SetNumberOfComponents(3);
+  values->SetNumberOfTuples(points->GetNumberOfPoints());
+  for (vtkIdType ptId = 0; ptId < points->GetNumberOfPoints(); ++ptId) {
+    points->GetPoint(ptId, c);
+    r = sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+    if (r > .0) c[0] /= r, c[1] /= r, c[2] /= r;
+    values->SetTuple(ptId, c);
+  }
+  mesh->GetPointData()->AddArray(values);
+
+  return mesh;
+}
+
+// -----------------------------------------------------------------------------
+/// Benchmark mappers of surfaces with disk topology
+void BenchmarkDiskMappers(Benchmark &bench, int level)
+{
+  BenchmarkInput input;
+  input._Name     = "disk";
+  input._Size     = level;
+  input._PointSet = HemisphereSurface(level);
+  vtkPolyData * const surface = vtkPolyData::SafeDownCast(input._PointSet);
+
+  if (verbose) {
+    cout << "Disk with " << surface->GetNumberOfPoints() << " points and "
+         << surface->GetNumberOfCells() << " triangles" << endl;
+  }
+
+  SharedPtr<SurfaceBoundary>    boundary = NewShared<SurfaceBoundary>(surface);
+  SharedPtr<PiecewiseLinearMap> boundary_map, output;
+  SharedPtr<Mapping>            surface_map;
+
+  // Boundary mappers
+  {
+    BoundaryToDiskMapper mapper;
+    mapper.Boundary(boundary);
+    BenchmarkMapper(bench, input, mapper, boundary_map);
+  }
+  {
+    BoundaryToSquareMapper mapper;
+    mapper.Boundary(boundary);
+    BenchmarkMapper(bench, input, mapper, output);
+  }
+  {
+    BoundaryToPolygonMapper mapper;
+    mapper.Boundary(boundary);
+    BenchmarkMapper(bench, input, mapper, output);
+  }
+  if (!boundary_map) {
+    // Fixed boundary mappers require a boundary map even if the boundary
+    // mapper itself is not selected for benchmarking
+    BoundaryToDiskMapper mapper;
+    mapper.Boundary(boundary);
+    mapper.Run();
+    boundary_map = mapper.Output();
+  }
+  boundary_map->OutsideValue(0.);
+  BenchmarkMap(bench, input, boundary_map);
+
+  // Fixed boundary surface mappers
+  #define BENCHMARK_FIXED_BOUNDARY_MAPPER(TMapper) \
+    { \
+      TMapper mapper; \
+      mapper.Surface(surface); \
+      mapper.Input(boundary_map); \
+      BenchmarkMapper(bench, input, mapper, surface_map); \
+      BenchmarkMap(bench, input, surface_map); \
+    }
+
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(UniformSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(ChordLengthSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(HarmonicSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(ShapePreservingSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(AuthalicSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(IntrinsicSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(IntrinsicLeastAreaDistortionSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(IntrinsicLeastEdgeLengthDistortionSurfaceMapper);
+  BENCHMARK_FIXED_BOUNDARY_MAPPER(MeanValueSurfaceMapper);
+
+  #undef BENCHMARK_FIXED_BOUNDARY_MAPPER
+
+  // Free boundary surface mappers
+  {
+    LeastSquaresConformalSurfaceMapper mapper;
+    mapper.Surface(surface);
+    BenchmarkMapper(bench, input, mapper, surface_map);
+    BenchmarkMap(bench, input, surface_map);
+  }
+  {
+    SpectralConformalSurfaceMapper mapper;
+    mapper.Surface(surface);
+    BenchmarkMapper(bench, input, mapper, surface_map);
+    BenchmarkMap(bench, input, surface_map);
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Benchmark mappers of closed genus-0 surfaces
+void BenchmarkSphereMappers(Benchmark &bench, int level)
+{
+  BenchmarkInput input;
+  input._Name     = "icosphere";
+  input._Size     = level;
+  input._PointSet = IcosphereSurface(level);
+  vtkPolyData * const surface = vtkPolyData::SafeDownCast(input._PointSet);
+
+  if (verbose) {
+    cout << "Icosphere with " << surface->GetNumberOfPoints() << " points and "
+         << surface->GetNumberOfCells() << " triangles" << endl;
+  }
+
+  SharedPtr<Mapping> surface_map;
+  ConformalSurfaceFlattening mapper;
+  mapper.Surface(surface);
+  BenchmarkMapper(bench, input, mapper, surface_map);
+  BenchmarkMap(bench, input, surface_map);
+}
+
+// -----------------------------------------------------------------------------
+/// Benchmark volume mappers of tetrahedralized ball
+void BenchmarkVolumeMappers(Benchmark &bench, int resolution)
+{
+  BenchmarkInput input;
+  input._Name     = "ball";
+  input._Size     = resolution;
+  input._PointSet = TetrahedralBall(resolution);
+  vtkPointSet  * const volume = input._PointSet;
+  vtkDataArray * const values = volume->GetPointData()->GetArray("BoundaryMap");
+
+  if (verbose) {
+    cout << "Ball with " << volume->GetNumberOfPoints() << " points and "
+         << volume->GetNumberOfCells() << " tetrahedra" << endl;
+  }
+
+  SharedPtr<Mapping> map, volume_map;
+  {
+    HarmonicTetrahedralMeshMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    mapper.InputVolume(volume);
+    volume_map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, volume_map);
+  }
+  {
+    SpectralTetrahedralMeshMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    mapper.InputVolume(volume);
+    map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, map);
+  }
+  {
+    AsConformalAsPossibleMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    mapper.InputVolume(volume);
+    map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, map);
+  }
+  {
+    MeshlessHarmonicVolumeMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, map);
+  }
+  {
+    MeshlessBiharmonicVolumeMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, map);
+  }
+  {
+    MeshlessCompactVolumeMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, map);
+  }
+  {
+    MeanValueCoordinatesVolumeMapper mapper;
+    mapper.InputSet(volume);
+    mapper.InputMap(values);
+    map = BenchmarkVolumeMapper(bench, input, mapper);
+    BenchmarkMap(bench, input, map);
+  }
+
+  // Regular lattice approximation of piecewise linear volumetric map
+  if (volume_map && bench.Selected(LatticeMap::NameOfType())) {
+    SharedPtr<LatticeMap> lattice_map;
+    PhaseTime init_time;
+    for (int rep = 0; rep < bench._Repetitions; ++rep) {
+      Stopwatch t;
+      lattice_map = NewShared<LatticeMap>(volume_map);
+      lattice_map->Initialize();
+      init_time.Add(t);
+    }
+    bench.Record(LatticeMap::NameOfType(), "Initialize", input, init_time);
+    BenchmarkMap(bench, input, lattice_map);
+  }
+
+  // Levels of detail of piecewise linear volumetric map
+  const PiecewiseLinearMap * const plm = dynamic_cast<const PiecewiseLinearMap *>(volume_map.get());
+  if (plm && bench.Selected(MultiResolutionMap::NameOfType())) {
+    SharedPtr<MultiResolutionMap> lod_map;
+    PhaseTime build_time;
+    for (int rep = 0; rep < bench._Repetitions; ++rep) {
+      Stopwatch t;
+      lod_map = NewShared<MultiResolutionMap>();
+      lod_map->Build(*plm, 3);
+      lod_map->Initialize();
+      build_time.Add(t);
+    }
+    bench.Record(MultiResolutionMap::NameOfType(), "Build", input, build_time);
+    BenchmarkMap(bench, input, lod_map);
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Benchmark evaluation and I/O of analytic maps
+void BenchmarkAnalyticMaps(Benchmark &bench)
+{
+  BenchmarkInput input;
+  input._Name = "lattice";
+  input._Size = bench._LatticeSize;
+
+  SharedPtr<SquareToDiskMap> square_to_disk = NewShared<SquareToDiskMap>();
+  square_to_disk->Initialize();
+  BenchmarkMap(bench, input, square_to_disk);
+
+  SharedPtr<DiskToSquareMap> disk_to_square = NewShared<DiskToSquareMap>();
+  disk_to_square->Initialize();
+  BenchmarkMap(bench, input, disk_to_square);
+
+  SharedPtr<StereographicMap> stereographic = NewShared<StereographicMap>();
+  stereographic->Initialize();
+  BenchmarkMap(bench, input, stereographic);
+
+  SharedPtr<InverseStereographicMap> inverse_stereographic = NewShared<InverseStereographicMap>();
+  inverse_stereographic->Initialize();
+  BenchmarkMap(bench, input, inverse_stereographic);
+
+  // Composition of inverse and forward stereographic projection
+  SharedPtr<CompositeMapping> composite = NewShared<CompositeMapping>();
+  composite->Add(inverse_stereographic);
+  composite->Add(stereographic);
+  composite->Initialize();
+  BenchmarkMap(bench, input, composite, false);
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  REQUIRES_POSARGS(1);
+
+  const char *output_name = POSARG(1);
+
+  Array<int> icosphere_levels;
+  Array<int> ball_resolutions;
+
+  Benchmark bench;
+  bench._Repetitions = 3;
+  bench._LatticeSize = 64;
+  bench._TempDir     = ".";
+
+  for (ALL_OPTIONS) {
+    if (OPTION("-icosphere-levels")) {
+      int level;
+      icosphere_levels.clear();
+      do {
+        PARSE_ARGUMENT(level);
+        icosphere_levels.push_back(level);
+      } while (HAS_ARGUMENT);
+    }
+    else if (OPTION("-ball-resolutions")) {
+      int n;
+      ball_resolutions.clear();
+      do {
+        PARSE_ARGUMENT(n);
+        if (n < 2) FatalError("Ball resolution must be at least 2!");
+        ball_resolutions.push_back(n);
+      } while (HAS_ARGUMENT);
+    }
+    else if (OPTION("-lattice-size")) PARSE_ARGUMENT(bench._LatticeSize);
+    else if (OPTION("-repetitions")) PARSE_ARGUMENT(bench._Repetitions);
+    else if (OPTION("-class")) {
+      do {
+        bench._Classes.push_back(ARGUMENT);
+      } while (HAS_ARGUMENT);
+    }
+    else if (OPTION("-temp-dir")) bench._TempDir = ARGUMENT;
+    else HANDLE_COMMON_OR_UNKNOWN_OPTION();
+  }
+  if (icosphere_levels.empty()) icosphere_levels = {2, 3, 4};
+  if (ball_resolutions.empty()) ball_resolutions = {8, 12, 16};
+  if (bench._Repetitions < 1) FatalError("Number of -repetitions must be positive!");
+  if (bench._LatticeSize < 2) FatalError("Option -lattice-size must be at least 2!");
+
+  for (auto level : icosphere_levels) {
+    BenchmarkDiskMappers(bench, level);
+    BenchmarkSphereMappers(bench, level);
+  }
+  for (auto n : ball_resolutions) {
+    BenchmarkVolumeMappers(bench, n);
+  }
+  BenchmarkAnalyticMaps(bench);
+
+  if (!bench.Write(output_name)) {
+    FatalError("Failed to write benchmark results to " << output_name);
+  }
+
+  return 0;
+}
@@ -76,6 +76,8 @@ void PrintHelp(const char* name)
   cout << "                    output curve length with chord-length parameterization of each\n";
   cout << "                    selected boundary sub-segment. (default)\n";
   cout << "  -select <id>...   Indices of selected surface points. (default: none)\n";
+  cout << "  -stats <file>     Write execution time of each phase and peak memory of the\n";
+  cout << "                    boundary mapper to JSON file.\n";
   PrintCommonOptions(cout);
   cout << "\n";
 }
@@ -94,6 +96,7 @@ int main(int argc, char *argv[])
   const char *output_name   = POSARG(3); // File name of output point set
   const char *values_name   = "Map";     // Name of boundary values array
   const char *mask_name     = nullptr;   // Name of boundary mask array
+  const char *stats_name    = nullptr;   // Name of output statistics file
   double      radius        = .0;        // Radius of primitive shape
   List<int>   selection;                 // Selected (boundary) points
 
@@ -122,6 +125,7 @@ int main(int argc, char *argv[])
     else if (OPTION("-subdivided")) {
       parameterizer = NewShared<SubdividedBoundarySegmentParameterizer>();
     }
+    else if (OPTION("-stats")) stats_name = ARGUMENT;
     else HANDLE_COMMON_OR_UNKNOWN_OPTION();
   }
 
@@ -187,6 +191,9 @@ int main(int argc, char *argv[])
     FatalError("Failed to write boundary map to " << output_name);
   }
   if (verbose) cout << " done" << endl;
+  if (stats_name && !mapper->Statistics().Write(stats_name)) {
+    FatalError("Failed to write mapper statistics to " << stats_name);
+  }
 
   return 0;
 }
\ No newline at end of file
@@ -19,9 +19,12 @@
 
 #include "mirtk/Common.h"
 #include "mirtk/Options.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/BoundedQueue.h"
 
 #include "mirtk/PointSetIO.h"
 #include "mirtk/PointSetUtils.h"
+#include "mirtk/SparseSolverType.h"
 
 #include "mirtk/UniformSurfaceMapper.h"                   // Tutte (1964)
 #include "mirtk/ChordLengthSurfaceMapper.h"               // Kent et al. (1991), Floater (1997)
@@ -34,6 +37,15 @@
 #include "mirtk/MeanValueSurfaceMapper.h"                 // Floater (2003)
 #include "mirtk/ConformalSurfaceFlattening.h"             // Angenent (1999), Haker (2000)
 #include "mirtk/LeastSquaresConformalSurfaceMapper.h"     // Levy (2002), Desbrun et al. (2002)
+#include "mirtk/SpectralConformalSurfaceMapper.h"         // Mullen et al. (2008)
+
+#include "mirtk/MultiResolutionMap.h"
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 #include "vtkSmartPointer.h"
 #include "vtkPolyData.h"
@@ -52,6 +64,7 @@ void PrintHelp(const char* name)
 {
   cout << "\n";
   cout << "usage: " << name << " <input> <output> [options]\n";
+  cout << "       " << name << " -manifest <file> [options]\n";
   cout << "\n";
   cout << "This tool computes a mapping for each point on the surface of a given input shape\n";
   cout << "embedded in 3D space. The output is a (piecewise linear) function which assigns each\n";
@@ -80,6 +93,47 @@ void PrintHelp(const char* name)
   cout << "  -name <string>        Name of point data array used as fixed point map.  (default: tcoords)\n";
   cout << "  -mask <string>        Name of point data array used as fixed point mask. (default: boundary)\n";
   cout << "  -max-iterations <n>   Maximum no. of linear solver iterations. (default: 1 or size of problem)\n";
+  cout << "  -solver <name>        Sparse linear solver: LU, LDLT, LLT, CHOLMOD, SuperLU, Pardiso, CG, BiCGSTAB,\n";
+  cout << "                        or AMG, i.e., CG with algebraic multigrid preconditioner.\n";
+  cout << "                        The latter three are iterative methods, the others direct methods.\n";
+  cout << "                        (default: fastest for type of linear system, direct unless -max-iterations > 1)\n";
+  cout << "  -levels <n>           No. of levels of coarse-to-fine initialization of iterative solver, where\n";
+  cout << "                        the map of a decimated surface is the initial guess at the next finer level.\n";
+  cout << "                        Only used by fixed boundary methods which solve a linear system. (default: 1)\n";
+  cout << "  -mixed-precision      Solve linear system in single precision with double precision refinement.\n";
+  cout << "                        Only used by fixed boundary methods with LU, LDLT, LLT, or CG solver.\n";
+  cout << "  -flip-free            Remove flipped triangles of planar map by nonlinear refinement of the\n";
+  cout << "                        free map values. Only used by fixed boundary methods. (default: off)\n";
+  cout << "  -matrix-free, -lsqr   Minimize least squares conformal energy by matrix-free LSQR instead of\n";
+  cout << "                        solving the assembled normal equations. Uses -max-iterations when > 1.\n";
+  cout << "  -compact-output       Store output map with single precision point coordinates and map values\n";
+  cout << "                        and 32-bit cell connectivity if possible. (default: off)\n";
+  cout << "  -levels-of-detail <n> Store piecewise linear output map together with up to n-1 decimated levels\n";
+  cout << "                        of detail in a single file, which can be read up to a coarse level only.\n";
+  cout << "                        (default: 1)\n";
+  cout << "  -batch <file>         Text file with one subject per line, each consisting of the file path of a\n";
+  cout << "                        surface mesh with the same connectivity as the input surface and the file\n";
+  cout << "                        path of its output map. The input surface serves as template whose edge table,\n";
+  cout << "                        boundary, and sparse matrix analysis are reused for each subject surface.\n";
+  cout << "                        Only supported by fixed boundary methods which solve a linear system.\n";
+  cout << "  -manifest <file>      Text file with one subject per line, each consisting of the file path of an\n";
+  cout << "                        input surface mesh, the file path of its output map, and optionally the file\n";
+  cout << "                        path of its fixed boundary map, which overrides the -boundary-map. The\n";
+  cout << "                        subjects are processed concurrently instead of the positional arguments.\n";
+  cout << "  -jobs <n>             Maximum no. of -manifest subjects processed concurrently. Each job reuses\n";
+  cout << "                        one surface mapper for its subjects, and its parallel loops share the\n";
+  cout << "                        threads of all jobs, whose total number is set by -threads.\n";
+  cout << "                        (default: no. of hardware threads)\n";
+  cout << "  -prefetch <n>         Maximum no. of -manifest subjects read ahead of the surface mappers by an\n";
+  cout << "                        input thread, and no. of output maps queued for an output thread, which\n";
+  cout << "                        writes them while the mappers continue. (default: -jobs)\n";
+  cout << "  -time-limit <secs>    Wall-clock time limit of the surface mapper. When exceeded, the remaining\n";
+  cout << "                        iterations are skipped and the best map reached so far is written.\n";
+  cout << "                        Only the conjugate gradient solver and the assembly of the linear system of\n";
+  cout << "                        fixed boundary methods are interrupted. (default: none)\n";
+  cout << "  -stats <file>         Write execution time of each phase, peak memory, and linear solver\n";
+  cout << "                        statistics of the surface mapper to JSON file. With -manifest, the file\n";
+  cout << "                        contains an array with the statistics of each subject.\n";
   PrintCommonOptions(cout);
   cout << "\n";
 }
@@ -115,6 +169,386 @@ enum SurfaceMappingMethod
   MAP_Spherical                     ///< Spherical surface map w/o boundary constraints
 };
 
+// -----------------------------------------------------------------------------
+/// Parameters of surface mapper
+struct SurfaceMapperParameters
+{
+  SurfaceMappingMethod _Method;              ///< Surface mapping method
+  int                  _NumberOfIterations;  ///< Maximum no. of linear solver iterations
+  int                  _NumberOfLevels;      ///< Number of coarse-to-fine levels
+  bool                 _MixedPrecision;      ///< Single precision solve with refinement
+  bool                 _FlipFree;            ///< Flip-free refinement of planar map
+  bool                 _MatrixFree;          ///< Matrix-free least squares solve
+  bool                 _CompactOutput;       ///< Compact storage of output map
+  int                  _LevelsOfDetail;      ///< No. of levels of detail of output map
+  int                  _ChordLengthExponent; ///< Weighted least squares exponent
+  double               _IntrinsicLambda;     ///< Conformal vs. authalic energy weight
+  Array<int>           _Selection;           ///< Selected (boundary) points
+  SparseSolverType     _Solver;              ///< Sparse linear solver
+};
+
+// -----------------------------------------------------------------------------
+/// Progress message of surface mapping method
+const char *ProgressMessage(SurfaceMappingMethod method)
+{
+  switch (method) {
+    case MAP_Uniform:                      return "Computing uniform surface map...";
+    case MAP_ChordLength:                  return "Computing chord length weighted surface map...";
+    case MAP_ShapePreserving:              return "Computing shape preserving surface map...";
+    case MAP_MeanValue:                    return "Computing mean value convex map...";
+    case MAP_Harmonic:                     return "Computing harmonic surface map...";
+    case MAP_Authalic:                     return "Computing discrete authalic surface map...";
+    case MAP_Intrinsic:                    return "Computing surface map using intrinsic parameterization...";
+    case MAP_IntrinsicLeastAreaDistortion: return "Computing intrinsic surface map with least area distortion...";
+    case MAP_IntrinsicLeastEdgeDistortion: return "Computing intrinsic surface map with least edge length distortion...";
+    case MAP_ConformalFlattening:          return "Computing conformal flattening...";
+    case MAP_LeastSquaresConformal:        return "Computing least squares conformal map...";
+    case MAP_Spectral:                     return "Computing spectral conformal map...";
+    default:                               return "Computing surface map...";
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Create surface mapper of selected method
+///
+/// The same mapper can compute the maps of multiple surfaces one after
+/// another, where SetSurface sets the input of the next Run.
+SharedPtr<SurfaceMapper> NewSurfaceMapper(const SurfaceMapperParameters &params)
+{
+  SharedPtr<SurfaceMapper> mapper;
+  SharedPtr<LinearFixedBoundarySurfaceMapper> linear;
+  switch (params._Method) {
+    case MAP_Uniform: {
+      linear = NewShared<UniformSurfaceMapper>();
+    } break;
+    case MAP_ChordLength: {
+      linear = NewShared<ChordLengthSurfaceMapper>(params._ChordLengthExponent);
+    } break;
+    case MAP_ShapePreserving: {
+      linear = NewShared<ShapePreservingSurfaceMapper>();
+    } break;
+    case MAP_MeanValue: {
+      linear = NewShared<MeanValueSurfaceMapper>();
+    } break;
+    case MAP_Harmonic: {
+      linear = NewShared<HarmonicSurfaceMapper>();
+    } break;
+    case MAP_PHarmonic: {
+      FatalError("p-harmonic mapping using finite element method (FEM) not implemented");
+    } break;
+    case MAP_Authalic: {
+      linear = NewShared<AuthalicSurfaceMapper>();
+    } break;
+    case MAP_Intrinsic: {
+      linear = NewShared<IntrinsicSurfaceMapper>(params._IntrinsicLambda);
+    } break;
+    case MAP_IntrinsicLeastAreaDistortion: {
+      linear = NewShared<IntrinsicLeastAreaDistortionSurfaceMapper>();
+    } break;
+    case MAP_IntrinsicLeastEdgeDistortion: {
+      linear = NewShared<IntrinsicLeastEdgeLengthDistortionSurfaceMapper>();
+    } break;
+    case MAP_ConformalFlattening: {
+      SharedPtr<ConformalSurfaceFlattening> flattening = NewShared<ConformalSurfaceFlattening>();
+      flattening->NumberOfIterations(params._NumberOfIterations);
+      flattening->Solver(params._Solver);
+      mapper = flattening;
+    } break;
+    case MAP_LeastSquaresConformal: {
+      SharedPtr<LeastSquaresConformalSurfaceMapper> lscm = NewShared<LeastSquaresConformalSurfaceMapper>();
+      lscm->NumberOfIterations(params._NumberOfIterations);
+      lscm->Solver(params._Solver);
+      lscm->MatrixFree(params._MatrixFree);
+      if (params._Selection.size() > 0) {
+        lscm->AddFixedPoint(params._Selection[0], 0., 0.);
+        if (params._Selection.size() > 1) {
+          lscm->AddFixedPoint(params._Selection[1], 1., 0.);
+        }
+      }
+      mapper = lscm;
+    } break;
+    case MAP_Spectral: {
+      SharedPtr<SpectralConformalSurfaceMapper> scp = NewShared<SpectralConformalSurfaceMapper>();
+      scp->NumberOfIterations(params._NumberOfIterations);
+      scp->Solver(params._Solver);
+      for (size_t i = 0; i < params._Selection.size() && i < 2; ++i) {
+        scp->AddFixedPoint(params._Selection[i], static_cast<double>(i), 0.);
+      }
+      mapper = scp;
+    } break;
+    default: {
+      FatalError("Selected mapping method not implemented");
+    } break;
+  }
+  if (linear) {
+    linear->NumberOfIterations(params._NumberOfIterations);
+    linear->Solver(params._Solver);
+    linear->NumberOfLevels(params._NumberOfLevels);
+    linear->MixedPrecision(params._MixedPrecision);
+    linear->FlipFreeRefinement(params._FlipFree);
+    mapper = linear;
+  }
+  mapper->CompactOutput(params._CompactOutput);
+  return mapper;
+}
+
+// -----------------------------------------------------------------------------
+/// Set input surface and boundary map of next surface mapper Run
+///
+/// The edge table and boundary of a previous input surface are discarded,
+/// whereas the sparse matrix analysis of the linear solver is kept and
+/// reused when the next surface has the same connectivity.
+void SetSurface(SurfaceMapper *mapper, vtkPolyData *surface,
+                const SharedPtr<PiecewiseLinearMap> &boundary_map)
+{
+  mapper->EdgeTable(nullptr);
+  mapper->Boundary(nullptr);
+  mapper->Surface(surface);
+  FixedBoundarySurfaceMapper *fixed = dynamic_cast<FixedBoundarySurfaceMapper *>(mapper);
+  if (fixed) fixed->Input(boundary_map);
+}
+
+// -----------------------------------------------------------------------------
+/// Read fixed boundary map
+SharedPtr<PiecewiseLinearMap> ReadBoundaryMap(const char *fname)
+{
+  SharedPtr<PiecewiseLinearMap> boundary_map = NewShared<PiecewiseLinearMap>();
+  if (!boundary_map->Read(fname)) {
+    FatalError("Failed to read boundary map from " << fname);
+  }
+  boundary_map->OutsideValue(0.);
+  boundary_map->Initialize();
+  return boundary_map;
+}
+
+// -----------------------------------------------------------------------------
+/// Write output map, optionally with decimated levels of detail
+///
+/// \param[in] map     Surface map.
+/// \param[in] fname   Output file name.
+/// \param[in] nlevels Number of levels of detail of piecewise linear map.
+bool WriteOutputMap(const Mapping &map, const char *fname, int nlevels)
+{
+  const PiecewiseLinearMap *plm = dynamic_cast<const PiecewiseLinearMap *>(&map);
+  if (plm && nlevels > 1) {
+    MultiResolutionMap lod;
+    lod.Build(*plm, nlevels);
+    return lod.Write(fname);
+  }
+  return map.Write(fname);
+}
+
+// -----------------------------------------------------------------------------
+/// Compute surface maps of subject surfaces with the topology of the template
+///
+/// \param[in] mapper  Surface mapper which computed the map of the template.
+/// \param[in] fname   Name of text file listing subject surfaces and output maps.
+/// \param[in] nlevels Number of levels of detail of output maps.
+void RunBatch(LinearFixedBoundarySurfaceMapper &mapper, const char *fname, int nlevels)
+{
+  std::ifstream ifs(fname);
+  if (!ifs.is_open()) {
+    FatalError("Failed to open batch file " << fname);
+  }
+  const vtkIdType ncells = mapper.Surface()->GetNumberOfCells();
+  string line, input_name, output_name;
+  int n = 0;
+  if (verbose) cout << "\n";
+  while (std::getline(ifs, line)) {
+    const size_t pos = line.find_first_not_of(" \t");
+    if (pos == string::npos || line[pos] == '#') continue;
+    std::istringstream is(line);
+    if (!(is >> input_name >> output_name)) {
+      FatalError("Invalid line in batch file " << fname << ": " << line);
+    }
+    vtkSmartPointer<vtkPolyData> surface = ReadPolyData(input_name.c_str());
+    if (surface->GetNumberOfPoints() != mapper.Surface()->GetNumberOfPoints() ||
+        surface->GetNumberOfCells()  != ncells) {
+      FatalError("Surface " << input_name << " does not have the topology of the input surface");
+    }
+    if (verbose) cout << "Computing surface map of " << input_name << "...", cout.flush();
+    mapper.Run(surface->GetPoints());
+    if (!WriteOutputMap(*mapper.Output(), output_name.c_str(), nlevels)) {
+      if (verbose) cout << " failed" << endl;
+      FatalError("Failed to write surface map to " << output_name);
+    }
+    if (verbose) cout << " done" << endl;
+    ++n;
+  }
+  if (verbose) cout << "Computed surface maps of " << n << " subjects, writing template map...";
+}
+
+// -----------------------------------------------------------------------------
+/// Subject of manifest file
+struct ManifestEntry
+{
+  string _Input;       ///< File path of input surface
+  string _Output;      ///< File path of output map
+  string _BoundaryMap; ///< File path of fixed boundary map, empty if default
+};
+
+// -----------------------------------------------------------------------------
+/// Read manifest file with one "<input> <output> [<boundary map>]" per line
+Array<ManifestEntry> ReadManifest(const char *fname)
+{
+  std::ifstream ifs(fname);
+  if (!ifs.is_open()) {
+    FatalError("Failed to open manifest file " << fname);
+  }
+  Array<ManifestEntry> subjects;
+  ManifestEntry subject;
+  string line;
+  while (std::getline(ifs, line)) {
+    const size_t pos = line.find_first_not_of(" \t");
+    if (pos == string::npos || line[pos] == '#') continue;
+    std::istringstream is(line);
+    subject._BoundaryMap.clear();
+    if (!(is >> subject._Input >> subject._Output)) {
+      FatalError("Invalid line in manifest file " << fname << ": " << line);
+    }
+    is >> subject._BoundaryMap;
+    subjects.push_back(subject);
+  }
+  return subjects;
+}
+
+// -----------------------------------------------------------------------------
+/// Write execution statistics of manifest subjects as JSON array
+bool WriteManifestStatistics(const char *fname, const Array<ManifestEntry> &subjects,
+                             const Array<MapperStatistics> &stats)
+{
+  std::ofstream ofs(fname);
+  if (!ofs) return false;
+  ofs << "[";
+  for (size_t i = 0; i < subjects.size(); ++i) {
+    ofs << (i > 0 ? "," : "") << "\n  {\n";
+    ofs << "    \"input\": \"" << subjects[i]._Input << "\",\n";
+    ofs << "    \"output\": \"" << subjects[i]._Output << "\",\n";
+    ofs << "    \"statistics\": ";
+    stats[i].Print(ofs, 4);
+    ofs << "\n  }";
+  }
+  ofs << "\n]\n";
+  return !ofs.fail();
+}
+
+// -----------------------------------------------------------------------------
+/// Subject of manifest passed between the stages of the processing pipeline
+struct ManifestItem
+{
+  int                           _Index;       ///< Index of manifest entry
+  vtkSmartPointer<vtkPolyData>  _Surface;     ///< Input surface
+  SharedPtr<PiecewiseLinearMap> _BoundaryMap; ///< Boundary map of subject, \c nullptr if default
+  SharedPtr<Mapping>            _Map;         ///< Output map
+};
+
+// -----------------------------------------------------------------------------
+/// First stage of manifest pipeline which reads the input surfaces and
+/// boundary maps of the subjects ahead of the surface mappers
+struct ReadManifestInputs
+{
+  const Array<ManifestEntry> *_Subjects;
+  BoundedQueue<ManifestItem> *_Output;
+
+  void operator ()() const
+  {
+    const int n = static_cast<int>(_Subjects->size());
+    for (int i = 0; i < n; ++i) {
+      const ManifestEntry &subject = (*_Subjects)[i];
+      ManifestItem item;
+      item._Index   = i;
+      item._Surface = ReadPolyData(subject._Input.c_str());
+      if (!subject._BoundaryMap.empty()) {
+        item._BoundaryMap = ReadBoundaryMap(subject._BoundaryMap.c_str());
+      }
+      if (!_Output->Push(item)) break;
+    }
+    _Output->Close();
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Second stage of manifest pipeline which computes the surface maps
+///
+/// Each job creates one surface mapper and computes the maps of the subjects
+/// it takes from the input queue until all subjects are processed. The jobs
+/// are executed by the same thread pool as the parallel loops of the mappers,
+/// such that idle threads of one job help with the inner loops of another.
+struct ProcessManifest
+{
+  const SurfaceMapperParameters *_Parameters;
+  const Array<ManifestEntry>    *_Subjects;
+  Array<MapperStatistics>       *_Statistics;
+  const char                    *_BoundaryMap;
+  double                         _TimeLimit;
+  BoundedQueue<ManifestItem>    *_Input;
+  BoundedQueue<ManifestItem>    *_Output;
+  std::mutex                    *_Mutex;
+
+  void operator ()(const blocked_range<int> &jobs) const
+  {
+    for (int job = jobs.begin(); job != jobs.end(); ++job) {
+      SharedPtr<SurfaceMapper>      mapper = NewSurfaceMapper(*_Parameters);
+      SharedPtr<PiecewiseLinearMap> default_boundary_map;
+      MapperObserver                observer;
+      ManifestItem                  item;
+      observer.TimeLimit(_TimeLimit);
+      mapper->Observer(&observer);
+      if (_BoundaryMap) default_boundary_map = ReadBoundaryMap(_BoundaryMap);
+      while (_Input->Pop(item)) {
+        if (!item._BoundaryMap) item._BoundaryMap = default_boundary_map;
+        SetSurface(mapper.get(), item._Surface, item._BoundaryMap);
+        mapper->Run();
+        MapperStatistics &stats = (*_Statistics)[item._Index];
+        stats     = mapper->Statistics();
+        item._Map = mapper->Output();
+        item._Surface     = nullptr;
+        item._BoundaryMap = nullptr;
+        if (stats.Status() != MapperStatus_Completed) {
+          std::lock_guard<std::mutex> lock(*_Mutex);
+          Warning("Surface mapper did not complete for " << (*_Subjects)[item._Index]._Input
+                  << ", status: " << ToString(stats.Status()));
+        }
+        _Output->Push(item);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Last stage of manifest pipeline which writes the output maps behind
+/// the surface mappers
+struct WriteManifestOutputs
+{
+  const Array<ManifestEntry> *_Subjects;
+  BoundedQueue<ManifestItem> *_Input;
+  std::atomic<int>           *_Failed;
+  std::mutex                 *_Mutex;
+  int                         _LevelsOfDetail;
+  bool                        _Verbose;
+
+  void operator ()() const
+  {
+    const int n = static_cast<int>(_Subjects->size());
+    int       m = 0;
+    ManifestItem item;
+    while (_Input->Pop(item)) {
+      const ManifestEntry &subject = (*_Subjects)[item._Index];
+      const bool ok = WriteOutputMap(*item._Map, subject._Output.c_str(), _LevelsOfDetail);
+      item._Map = nullptr;
+      ++m;
+      std::lock_guard<std::mutex> lock(*_Mutex);
+      if (!ok) {
+        cerr << "Error: Failed to write surface map to " << subject._Output << endl;
+        ++(*_Failed);
+      }
+      if (_Verbose) {
+        cout << "Computed surface map of " << subject._Input << " (" << m << "/" << n << ")" << endl;
+      }
+    }
+  }
+};
+
 // =============================================================================
 // Main
 // =============================================================================
@@ -122,19 +556,33 @@ enum SurfaceMappingMethod
 // -----------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
-  REQUIRES_POSARGS(2);
+  REQUIRES_POSARGS(0);
 
-  const char *input_name        = POSARG(1);
-  const char *output_name       = POSARG(2);
+  const char *input_name        = (NUM_POSARGS >= 1 ? POSARG(1) : nullptr);
+  const char *output_name       = (NUM_POSARGS >= 2 ? POSARG(2) : nullptr);
   const char *boundary_map_name = nullptr;
-
-  SurfaceMappingMethod method = MAP_MeanValue;
-
-  int    niters                = -1; // Number of iterations
-  int    p_harmonic_exponent   = 2;  // Exponent of p-harmonic energy
-  int    chord_length_exponent = 1;  // Weighted least squares exponent
-  double intrinsic_lambda      = .5; // Conformal vs. authalic energy weight
-  Array<int> selection;              // Selected (boundary) points
+  const char *batch_name        = nullptr;
+  const char *manifest_name     = nullptr;
+  const char *stats_name        = nullptr;
+
+  MapperObserver observer; // Time limit of surface mapper
+  int            njobs = 0; // Number of concurrent manifest subjects
+  int            nprefetch = 0; // Number of subjects read ahead or written behind
+
+  SurfaceMapperParameters params;
+  params._Method              = MAP_MeanValue;
+  params._NumberOfIterations  = -1;
+  params._NumberOfLevels      = 1;
+  params._MixedPrecision      = false;
+  params._FlipFree            = false;
+  params._MatrixFree          = false;
+  params._CompactOutput       = false;
+  params._LevelsOfDetail      = 1;
+  params._ChordLengthExponent = 1;
+  params._IntrinsicLambda     = .5;
+  params._Solver              = SparseSolver_Default;
+
+  int p_harmonic_exponent = 2; // Exponent of p-harmonic energy
 
   for (ALL_OPTIONS) {
     // Fixed boundary map
@@ -143,241 +591,219 @@ int main(int argc, char *argv[])
       int i;
       do {
         PARSE_ARGUMENT(i);
-        selection.push_back(i);
+        params._Selection.push_back(i);
       } while (HAS_ARGUMENT);
     }
     // Surface mapping method
     else if (OPTION("-uniform")) {
-      method = MAP_Uniform;
+      params._Method = MAP_Uniform;
     }
     else if (OPTION("-chord-length")) {
-      method = MAP_ChordLength;
-      if (HAS_ARGUMENT) PARSE_ARGUMENT(chord_length_exponent);
-      else chord_length_exponent = 1;
+      params._Method = MAP_ChordLength;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(params._ChordLengthExponent);
+      else params._ChordLengthExponent = 1;
     }
     else if (OPTION("-shape-preserving") || OPTION("-average-barycenter")) {
-      method = MAP_ShapePreserving;
+      params._Method = MAP_ShapePreserving;
     }
     else if (OPTION("-mean-value") || OPTION("-mean-value-coordinates") || OPTION("-mvc")) {
-      method = MAP_MeanValue;
+      params._Method = MAP_MeanValue;
     }
     else if (OPTION("-harmonic")) {
-      method = MAP_Harmonic;
+      params._Method = MAP_Harmonic;
     }
     else if (OPTION("-p-harmonic")) {
-      method = MAP_PHarmonic;
+      params._Method = MAP_PHarmonic;
       if (HAS_ARGUMENT) PARSE_ARGUMENT(p_harmonic_exponent);
       else p_harmonic_exponent = 2;
     }
     else if (OPTION("-authalic")) {
-      method = MAP_Authalic;
+      params._Method = MAP_Authalic;
     }
     else if (OPTION("-intrinsic")) {
-      method = MAP_Intrinsic;
-      if (HAS_ARGUMENT) PARSE_ARGUMENT(intrinsic_lambda);
-      else intrinsic_lambda = .5;
+      params._Method = MAP_Intrinsic;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(params._IntrinsicLambda);
+      else params._IntrinsicLambda = .5;
     }
     else if (OPTION("-intrinsic-least-area-distortion") ||
              OPTION("-intrinsic-min-area-distortion")) {
-      method = MAP_IntrinsicLeastAreaDistortion;
+      params._Method = MAP_IntrinsicLeastAreaDistortion;
     }
     else if (OPTION("-intrinsic-least-edge-length-distortion") ||
              OPTION("-intrinsic-min-edge-length-distortion") ||
              OPTION("-intrinsic-least-edge-distortion") ||
              OPTION("-intrinsic-min-edge-distortion")) {
-      method = MAP_IntrinsicLeastEdgeDistortion;
+      params._Method = MAP_IntrinsicLeastEdgeDistortion;
     }
     else if (OPTION("-conformal-flattening")) {
-      method = MAP_ConformalFlattening;
+      params._Method = MAP_ConformalFlattening;
     }
     else if (OPTION("-least-squares-conformal") || OPTION("-lscm") ||
              OPTION("-natural-conformal") || OPTION("-discrete-natural-conformal") || OPTION("-dncp")) {
-      method = MAP_LeastSquaresConformal;
+      params._Method = MAP_LeastSquaresConformal;
+    }
+    else if (OPTION("-spectral") || OPTION("-spectral-conformal") || OPTION("-scp")) {
+      params._Method = MAP_Spectral;
     }
     // Linear solver parameters
     else if (OPTION("-max-iterations") || OPTION("-max-iter") || OPTION("-iterations") || OPTION("-iter")) {
-      PARSE_ARGUMENT(niters);
+      PARSE_ARGUMENT(params._NumberOfIterations);
+    }
+    else if (OPTION("-mixed-precision")) params._MixedPrecision = true;
+    else if (OPTION("-flip-free")) params._FlipFree = true;
+    else if (OPTION("-matrix-free") || OPTION("-lsqr")) params._MatrixFree = true;
+    else if (OPTION("-compact-output")) params._CompactOutput = true;
+    else if (OPTION("-levels-of-detail")) {
+      PARSE_ARGUMENT(params._LevelsOfDetail);
+    }
+    else if (OPTION("-levels")) {
+      PARSE_ARGUMENT(params._NumberOfLevels);
+    }
+    else if (OPTION("-solver")) {
+      PARSE_ARGUMENT(params._Solver);
+      if (!IsAvailable(params._Solver)) {
+        FatalError("Sparse linear solver not available in this build: " << ToString(params._Solver));
+      }
+    }
+    else if (OPTION("-batch")) batch_name = ARGUMENT;
+    else if (OPTION("-manifest")) manifest_name = ARGUMENT;
+    else if (OPTION("-jobs")) PARSE_ARGUMENT(njobs);
+    else if (OPTION("-prefetch")) PARSE_ARGUMENT(nprefetch);
+    else if (OPTION("-stats")) stats_name = ARGUMENT;
+    else if (OPTION("-time-limit")) {
+      double time_limit;
+      PARSE_ARGUMENT(time_limit);
+      observer.TimeLimit(time_limit);
     }
     else HANDLE_COMMON_OR_UNKNOWN_OPTION();
   }
 
+  const SurfaceMappingMethod method = params._Method;
+  if (method == MAP_ConformalFlattening && boundary_map_name) {
+    FatalError("Conformal flattening requires closed genus-0 input surface mesh! Input -boundary-map makes no sense.");
+  }
+  if (method == MAP_LeastSquaresConformal && boundary_map_name) {
+    Warning("Input -boundary-map ignored by least squares conformal mapping.");
+  }
+  if (method == MAP_Spectral && boundary_map_name) {
+    Warning("Input -boundary-map ignored by spectral conformal mapping.");
+  }
+  if (method == MAP_PHarmonic && verbose) {
+    cout << "Computing p=" << p_harmonic_exponent << " harmonic surface map...", cout.flush();
+  }
+
+  // Compute surface maps of manifest subjects
+  if (manifest_name) {
+    if (input_name || output_name) {
+      FatalError("No positional <input> and <output> arguments allowed with -manifest");
+    }
+    if (batch_name) {
+      FatalError("Options -batch and -manifest are mutually exclusive");
+    }
+    const Array<ManifestEntry> subjects = ReadManifest(manifest_name);
+    const int n = static_cast<int>(subjects.size());
+    for (const auto &subject : subjects) {
+      if (method == MAP_ConformalFlattening && !subject._BoundaryMap.empty()) {
+        FatalError("Conformal flattening requires closed genus-0 input surface mesh! Boundary map of "
+                   << subject._Input << " in manifest file makes no sense.");
+      }
+    }
+    if (njobs <= 0) njobs = static_cast<int>(std::thread::hardware_concurrency());
+    njobs = max(1, min(njobs, n));
+    if (verbose) {
+      cout << "Computing surface maps of " << n << " subjects using " << njobs << " concurrent job(s)" << endl;
+    }
+    if (nprefetch <= 0) nprefetch = njobs;
+    Array<MapperStatistics> stats(subjects.size());
+    BoundedQueue<ManifestItem> inputs(nprefetch), outputs(nprefetch);
+    std::atomic<int> failed(0);
+    std::mutex mutex;
+    ReadManifestInputs reader;
+    reader._Subjects = &subjects;
+    reader._Output   = &inputs;
+    ProcessManifest body;
+    body._Parameters  = &params;
+    body._Subjects    = &subjects;
+    body._Statistics  = &stats;
+    body._BoundaryMap = boundary_map_name;
+    body._TimeLimit   = observer.TimeLimit();
+    body._Input       = &inputs;
+    body._Output      = &outputs;
+    body._Mutex       = &mutex;
+    WriteManifestOutputs writer;
+    writer._Subjects       = &subjects;
+    writer._Input          = &outputs;
+    writer._Failed         = &failed;
+    writer._Mutex          = &mutex;
+    writer._LevelsOfDetail = params._LevelsOfDetail;
+    writer._Verbose        = (verbose > 0);
+    // Mapper output of concurrent jobs would be interleaved
+    const int verbosity = verbose;
+    verbose = 0;
+    std::thread read_thread(reader);
+    std::thread write_thread(writer);
+    parallel_for(blocked_range<int>(0, njobs, 1), body);
+    outputs.Close();
+    read_thread.join();
+    write_thread.join();
+    verbose = verbosity;
+    if (stats_name && !WriteManifestStatistics(stats_name, subjects, stats)) {
+      FatalError("Failed to write mapper statistics to " << stats_name);
+    }
+    if (failed > 0) {
+      FatalError("Failed to compute surface maps of " << failed << " out of " << n << " subjects");
+    }
+    return 0;
+  }
+  if (!input_name || !output_name) {
+    PrintHelp(argv[0]);
+    exit(1);
+  }
+
   vtkSmartPointer<vtkPolyData>  surface;
   SharedPtr<PiecewiseLinearMap> boundary_map;
-  SharedPtr<Mapping>            surface_map;
+  SharedPtr<SurfaceMapper>      mapper;
+  MapperStatistics              stats;
 
   surface = ReadPolyData(input_name);
   if (boundary_map_name) {
-    boundary_map = NewShared<PiecewiseLinearMap>();
-    if (!boundary_map->Read(boundary_map_name)) {
-      FatalError("Failed to read boundary map from " << boundary_map_name);
-    }
-    boundary_map->OutsideValue(0.);
-    boundary_map->Initialize();
+    boundary_map = ReadBoundaryMap(boundary_map_name);
   }
 
-  switch (method) {
-    case MAP_Uniform: {
-      const char *msg = "Computing uniform surface map...";
-      if (verbose) cout << msg, cout.flush();
-      UniformSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_ChordLength: {
-      const char *msg = "Computing chord length weighted surface map...";
-      if (verbose) cout << msg, cout.flush();
-      ChordLengthSurfaceMapper mapper(chord_length_exponent);
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_ShapePreserving: {
-      const char *msg = "Computing shape preserving surface map...";
-      if (verbose) cout << msg, cout.flush();
-      ShapePreservingSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_MeanValue: {
-      const char *msg = "Computing mean value convex map...";
-      if (verbose) cout << msg, cout.flush();
-      MeanValueSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_Harmonic: {
-      const char *msg = "Computing harmonic surface map...";
-      if (verbose) cout << msg, cout.flush();
-      HarmonicSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_PHarmonic: {
-      FatalError("p-harmonic mapping using finite element method (FEM) not implemented");
-      if (verbose) cout << "Computing p=" << p_harmonic_exponent << " harmonic surface map...", cout.flush();
-    } break;
-
-    case MAP_Authalic: {
-      const char *msg = "Computing discrete authalic surface map...";
-      if (verbose) cout << msg, cout.flush();
-      AuthalicSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_Intrinsic: {
-      const char *msg = "Computing surface map using intrinsic parameterization...";
-      if (verbose) cout << msg, cout.flush();
-      IntrinsicSurfaceMapper mapper(intrinsic_lambda);
-      if (verbose) {
-        cout << "\n  Conformal energy weight      = " << mapper.Lambda();
-        cout << "\n  Authalic  energy weight      = " << 1. - mapper.Lambda();
-        cout.flush();
-      }
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_IntrinsicLeastAreaDistortion: {
-      const char *msg = "Computing intrinsic surface map with least area distortion...";
-      if (verbose) cout << msg, cout.flush();
-      IntrinsicLeastAreaDistortionSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_IntrinsicLeastEdgeDistortion: {
-      const char *msg = "Computing intrinsic surface map with least edge length distortion...";
-      if (verbose) cout << msg, cout.flush();
-      IntrinsicLeastEdgeLengthDistortionSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Input(boundary_map);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_ConformalFlattening: {
-      if (boundary_map) {
-        FatalError("Conformal flattening requires closed genus-0 input surface mesh! Input -boundary-map makes no sense.");
-      }
-      const char *msg = "Computing conformal flattening...";
-      if (verbose) cout << msg, cout.flush();
-      ConformalSurfaceFlattening mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    case MAP_LeastSquaresConformal: {
-      if (boundary_map) {
-        Warning("Input -boundary-map ignored by least squares conformal mapping.");
-      }
-      const char *msg = "Computing least squares conformal map...";
-      if (verbose) cout << msg, cout.flush();
-      LeastSquaresConformalSurfaceMapper mapper;
-      mapper.NumberOfIterations(niters);
-      mapper.Surface(surface);
-      if (selection.size() > 0) {
-        mapper.AddFixedPoint(selection[0], 0., 0.);
-        if (selection.size() > 1) {
-          mapper.AddFixedPoint(selection[1], 1., 0.);
-        }
-      }
-      mapper.Run();
-      surface_map = mapper.Output();
-      if (verbose) cout << msg, cout.flush();
-    } break;
-
-    default: {
-      FatalError("Selected mapping method not implemented");
-    } break;
+  mapper = NewSurfaceMapper(params);
+  LinearFixedBoundarySurfaceMapper *linear = dynamic_cast<LinearFixedBoundarySurfaceMapper *>(mapper.get());
+  if (batch_name && !linear) {
+    FatalError("Option -batch not supported by selected surface mapping method");
   }
 
-  if (!surface_map->Write(output_name)) {
+  const char *msg = ProgressMessage(method);
+  if (verbose) cout << msg, cout.flush();
+  if (method == MAP_Intrinsic && verbose) {
+    const double lambda = static_cast<IntrinsicSurfaceMapper *>(mapper.get())->Lambda();
+    cout << "\n  Conformal energy weight      = " << lambda;
+    cout << "\n  Authalic  energy weight      = " << 1. - lambda;
+    cout.flush();
+  }
+  SetSurface(mapper.get(), surface, boundary_map);
+  mapper->Observer(&observer);
+  mapper->Run();
+  SharedPtr<Mapping> surface_map = mapper->Output();
+  stats = mapper->Statistics();
+  if (verbose) cout << msg, cout.flush();
+  if (batch_name) RunBatch(*linear, batch_name, params._LevelsOfDetail);
+
+  if (!WriteOutputMap(*surface_map, output_name, params._LevelsOfDetail)) {
     if (verbose) cout << " failed" << endl;
     FatalError("Failed to write surface map to " << output_name);
   }
   if (verbose) cout << " done" << endl;
+  if (stats.Status() != MapperStatus_Completed) {
+    Warning("Surface mapper did not complete, status: " << ToString(stats.Status()));
+  }
+
+  if (stats_name && !stats.Write(stats_name)) {
+    FatalError("Failed to write mapper statistics to " << stats_name);
+  }
 
   return 0;
 }
@@ -19,13 +19,27 @@
 
 #include "mirtk/Common.h"
 #include "mirtk/Options.h"
+#include "mirtk/Parallel.h"
+#include "mirtk/BoundedQueue.h"
 
 #include "mirtk/PointSetIO.h"
 #include "mirtk/PointSetUtils.h"
+#include "mirtk/GenericImage.h"
 
 #include "mirtk/AsConformalAsPossibleMapper.h"
 #include "mirtk/HarmonicTetrahedralMeshMapper.h"
+#include "mirtk/SpectralTetrahedralMeshMapper.h"
 #include "mirtk/MeshlessHarmonicVolumeMapper.h"
+#include "mirtk/MeshlessBiharmonicVolumeMapper.h"
+#include "mirtk/MeshlessCompactVolumeMapper.h"
+#include "mirtk/MeanValueCoordinatesVolumeMapper.h"
+#include "mirtk/MultiResolutionMap.h"
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 #include "vtkSmartPointer.h"
 #include "vtkPointSet.h"
@@ -44,6 +58,7 @@ void PrintHelp(const char* name)
 {
   cout << "\n";
   cout << "usage: " << name << " <input> <output> [options]\n";
+  cout << "       " << name << " -manifest <file> [options]\n";
   cout << "\n";
   cout << "This tool computes a mapping for each point of the volume of a given input point set.\n";
   cout << "The input is either a piecewise linear complex (PLC), i.e., a tesselation of the surface,\n";
@@ -64,7 +79,92 @@ void PrintHelp(const char* name)
   cout << "Output options:\n";
   cout << "  -acap         As-conformal-as-possible volumetric map.\n";
   cout << "  -harmonic     Harmonic volumetric map.\n";
+  cout << "  -biharmonic   Meshless biharmonic volumetric map using the method of fundamental solutions.\n";
+  cout << "  -mean-value   Volumetric map defined by mean value coordinates of the boundary surface.\n";
+  cout << "  -barycentric  Alias of -mean-value, i.e., generalized barycentric coordinates of a triangulated\n";
+  cout << "                boundary surface.\n";
+  cout << "  -spectral [<n>]  Piecewise linear volumetric map given by the affine combination of the first\n";
+  cout << "                <n> non-trivial eigenvectors of the Laplace operator of the tetrahedral mesh which\n";
+  cout << "                best fits the boundary map. (default: no. of map components)\n";
   cout << "  -meshless     Use meshless mapping method if possible.\n";
+  cout << "  -compact [<radius>]  Meshless volumetric map with compactly supported radial basis functions,\n";
+  cout << "                whose sparse linear system is solved with the -solver. A negative radius is\n";
+  cout << "                relative to the bounding box diagonal of the boundary. (default: -.25)\n";
+  cout << "\n";
+  cout << "Solver options:\n";
+  cout << "  -solver <name>  Sparse linear solver of piecewise linear maps: LDLT, LLT, CHOLMOD, Pardiso, CG,\n";
+  cout << "                  or AMG, i.e., CG with algebraic multigrid preconditioner. The factorization\n";
+  cout << "                  of a direct solver is reused by subsequent solves. (default: CG)\n";
+  cout << "  -max-iterations <n>  Maximum no. of iterations of iterative solver.\n";
+  cout << "  -levels <n>     No. of levels of coarse-to-fine initialization of iterative solver, where\n";
+  cout << "                  the map of a coarser volume is the initial guess at the next finer level.\n";
+  cout << "  -mixed-precision  Solve linear system in single precision with double precision refinement.\n";
+  cout << "  -subdomains <n>  No. of subdomains of the additive Schwarz preconditioner of the CG solver\n";
+  cout << "                  of piecewise linear maps. (default: 0, i.e., 3x3 block Jacobi preconditioner)\n";
+  cout << "  -compact-output  Store piecewise linear output map with single precision point coordinates and\n";
+  cout << "                  map values and 32-bit cell connectivity if possible. (default: off)\n";
+  cout << "  -levels-of-detail <n>  Store piecewise linear output map together with up to n-1 decimated\n";
+  cout << "                  levels of detail in a single file, which can be read up to a coarse level only.\n";
+  cout << "                  (default: 1)\n";
+  cout << "  -volume <file>  Precomputed tetrahedralization of the input whose first points are the input points.\n";
+  cout << "  -tetrahedralization-cache <dir>  Directory of cached tetrahedralizations of input meshes. When the\n";
+  cout << "                  input was tetrahedralized before, the tetrahedral mesh is read from this directory.\n";
+  cout << "  -max-volume <value>  Refine tetrahedralization of the input until no tetrahedron is larger\n";
+  cout << "                  than this volume. Not applied to a precomputed -volume. (default: off)\n";
+  cout << "  -size-grading <value>  Refine tetrahedralization of the input until the interior edges of each\n";
+  cout << "                  tetrahedron are shorter than the mean boundary edge length plus this factor\n";
+  cout << "                  times the distance from the boundary. Not applied to a precomputed -volume. (default: off)\n";
+  cout << "  -refinements <n>  Maximum no. of adaptive refinements of tetrahedra with large deformation\n";
+  cout << "                  gradient of the map, after each of which the map is recomputed. (default: 0)\n";
+  cout << "  -refinement-threshold <value>  Refine tetrahedra whose deformation gradient norm exceeds the\n";
+  cout << "                  median by this factor. (default: 2)\n";
+  cout << "  -weights-lattice <image>  Precompute truncated mean value coordinates at the voxel centers of\n";
+  cout << "                  this image and store them in the output map, which is then evaluated at these\n";
+  cout << "                  points by a sparse matrix-vector product. (default: off)\n";
+  cout << "  -weight-threshold <value>  Minimum magnitude of precomputed mean value coordinates. (default: 1e-4)\n";
+  cout << "  -acap-iterations <n>  Maximum no. of local/global iterations of ACAP map. (default: 1)\n";
+  cout << "  -acap-tolerance <value>  Minimum relative change of ACAP energy. (default: 1e-4)\n";
+  cout << "  -meshless-kernel <type>  Storage of kernel function values of meshless map: Double, Float,\n";
+  cout << "                  or MatrixFree, i.e., evaluated when needed. (default: Double)\n";
+  cout << "  -offset-surface-cache <dir>  Directory of cached offset surfaces of meshless maps. When the\n";
+  cout << "                  offset surface of the input was computed before, it is read from this directory.\n";
+  cout << "  -meshless-additive [<damping>]  Solve the linear systems of all source points subsets of the\n";
+  cout << "                  meshless map concurrently and add their damped solutions. When no damping\n";
+  cout << "                  factor is given, it is chosen by a line search. (default: off)\n";
+  cout << "  -meshless-partition <type>  Partitioning of meshless map source points into subsets:\n";
+  cout << "                  RoundRobin, Morton, or KMeans. (default: RoundRobin)\n";
+  cout << "  -meshless-svd [<method>]  Solve linear systems of harmonic meshless map using SVD: Jacobi,\n";
+  cout << "                  BDC, or Randomized. (default: off, BDC if no method given)\n";
+  cout << "  -meshless-svd-rank <n>  Rank of randomized SVD. (default: number of source points)\n";
+  cout << "  -meshless-sparsify <tol> [<n>]  Remove source points of the final (bi-)harmonic meshless map\n";
+  cout << "                  whose removal increases the boundary fitting error by at most the relative\n";
+  cout << "                  tolerance, with n refitting iterations per removed batch. (default: off, n=2)\n";
+  cout << "  -checkpoint <file> [<n>]  Write meshless map to this file every n iterations. (default: off, n=1)\n";
+  cout << "  -resume <file>  Resume meshless map iterations from checkpoint file written by a previous\n";
+  cout << "                  run with identical input and options, and continue writing checkpoints to it.\n";
+  cout << "  -time-limit <secs>  Wall-clock time limit of the volume mapper. When exceeded, the remaining\n";
+  cout << "                  solver and boundary fitting iterations are skipped and the best map reached\n";
+  cout << "                  so far is written. (default: none)\n";
+  cout << "  -stats <file>   Write execution time of each phase, peak memory, and linear solver\n";
+  cout << "                  statistics of the volume mapper to JSON file. With -manifest, the file\n";
+  cout << "                  contains an array with the statistics of each subject.\n";
+  cout << "\n";
+  cout << "Batch options:\n";
+  cout << "  -manifest <file>  Text file with one subject per line, each consisting of the file path of\n";
+  cout << "                  an input mesh and the file path of its output map. The subjects are processed\n";
+  cout << "                  concurrently instead of the positional arguments. Not supported with -volume,\n";
+  cout << "                  -checkpoint, or -resume.\n";
+  cout << "  -jobs <n>       Maximum no. of -manifest subjects processed concurrently. Each job reuses its\n";
+  cout << "                  volume mappers for its subjects, and their parallel loops share the threads\n";
+  cout << "                  of all jobs, whose total number is set by -threads. (default: no. of hardware threads)\n";
+  cout << "  -mapper-threads <n>  Maximum no. of threads used by each volume mapper, such that concurrent\n";
+  cout << "                  -jobs, or multiple processes which share a machine, do not compete for\n";
+  cout << "                  all hardware threads. Requires TBB. (default: no limit)\n";
+  cout << "  -prefetch <n>   Maximum no. of -manifest subjects queued between the pipeline stages, i.e.,\n";
+  cout << "                  the input meshes read ahead by an input thread, their tetrahedralizations, and\n";
+  cout << "                  the output maps written behind by an output thread. (default: -jobs)\n";
+  cout << "  -preprocess-threads <n>  No. of threads which tetrahedralize the -manifest inputs of piecewise\n";
+  cout << "                  linear maps ahead of the volume mappers. (default: 1)\n";
   cout << "\n";
   cout << "Optional arguments:\n";
   PrintCommonOptions(cout);
@@ -87,6 +187,7 @@ enum MapVolumeMethod
   MAP_HarmonicMFS,   ///< Use MFS to compute harmonic volumetric map
   MAP_Biharmonic,    ///< Compute biharmonic volumetric map
   MAP_BiharmonicMFS, ///< Use MFS to compute biharmonic volumetric map
+  MAP_CompactRBF,    ///< Compute meshless map with compactly supported kernels
   MAP_Spectral       ///< Compute volumetric map using spectral coordinates
 };
 
@@ -113,57 +214,452 @@ vtkSmartPointer<vtkPointSet> ReadMesh(const char *fname)
 }
 
 // -----------------------------------------------------------------------------
-/// Compute volumetric map for free interior points
-SharedPtr<Mapping> SolveVolumetricMap(vtkSmartPointer<vtkPointSet>  domain,
-                                      vtkSmartPointer<vtkDataArray> values,
-                                      vtkSmartPointer<vtkDataArray> mask,
-                                      MapVolumeMethod               method,
-                                      int                           niterations)
+/// Parameters of volume mapper
+struct VolumeMapperParameters
+{
+  MapVolumeMethod       _Method;             ///< Volumetric mapping method
+  SparseSolverType      _Solver;             ///< Sparse linear solver
+  int                   _NumberOfIterations; ///< Maximum no. of iterative solver iterations
+  int                   _SpectralModes;      ///< Number of spectral coordinates
+  int                   _NumberOfLevels;     ///< Number of coarse-to-fine levels
+  bool                  _MixedPrecision;     ///< Single precision solve with refinement
+  int                   _Subdomains;         ///< Number of Schwarz preconditioner subdomains
+  int                   _MapperThreads;      ///< Maximum no. of threads of each mapper
+  bool                  _CompactOutput;      ///< Compact storage of output map
+  int                   _LevelsOfDetail;     ///< No. of levels of detail of output map
+  int                   _ACAPIterations;     ///< Maximum no. of local/global ACAP iterations
+  double                _ACAPTolerance;      ///< Minimum relative change of ACAP energy
+  const char           *_CacheDir;           ///< Directory of cached tetrahedralizations
+  double                _MaximumVolume;      ///< Maximum volume of tetrahedra
+  double                _SizeGrading;        ///< Grading of edge lengths away from boundary
+  int                   _Refinements;        ///< Maximum no. of adaptive mesh refinements
+  double                _RefineThreshold;    ///< Relative deformation gradient threshold
+  ImageAttributes       _WeightsLattice;     ///< Lattice of precomputed mean value coordinates
+  double                _WeightThreshold;    ///< Minimum magnitude of mean value coordinates
+  MeshlessKernelStorage _KernelStorage;      ///< Storage of meshless kernel function values
+  bool                  _Additive;           ///< Solve source points subsets concurrently
+  double                _AdditiveDamping;    ///< Damping of additive subset solutions
+  const char           *_OffsetCacheDir;     ///< Directory of cached offset surfaces
+  MeshlessPartitioning  _Partitioning;       ///< Partitioning of meshless source points
+  double                _SupportRadius;      ///< Support radius of compact kernels
+  bool                  _UseSVD;             ///< Solve harmonic meshless map using SVD
+  MeshlessSVDMethod     _SVDMethod;          ///< SVD method
+  int                   _SVDRank;            ///< Rank of randomized SVD
+  double                _SparsifyTolerance;  ///< Tolerance of source point sparsification
+  int                   _SparsifyIterations; ///< Refitting iterations of sparsification
+  const char           *_CheckpointFile;     ///< Checkpoint file of meshless map
+  int                   _CheckpointInterval; ///< Number of iterations between checkpoints
+  bool                  _Resume;             ///< Resume meshless map from checkpoint
+};
+
+// -----------------------------------------------------------------------------
+/// Resolve volumetric mapping method for given map domain
+MapVolumeMethod ResolveMethod(MapVolumeMethod method, vtkPointSet *domain)
 {
-  SharedPtr<Mapping> map;
   if (method == MAP_Harmonic) {
     if (IsTetrahedralMesh(domain)) method = MAP_HarmonicFEM;
     else                           method = MAP_HarmonicMFS;
   } else if (method == MAP_Biharmonic) {
     method = MAP_BiharmonicMFS;
   }
+  return method;
+}
+
+// -----------------------------------------------------------------------------
+/// Create volume mapper of resolved mapping method
+///
+/// The same mapper can compute the maps of multiple map domains one after
+/// another, where SolveVolumetricMap sets the input of the next Run.
+SharedPtr<VolumeMapper> NewVolumeMapper(MapVolumeMethod method, const VolumeMapperParameters &params)
+{
+  SharedPtr<VolumeMapper> mapper;
   switch (method) {
     case MAP_ACAP: {
-      if (verbose) cout << "Computing as-conformal-as-possible map...", cout.flush();
-      AsConformalAsPossibleMapper mapper;
-      mapper.InputSet(domain);
-      mapper.InputMap(values);
-      mapper.Run();
-      map = mapper.Output();
+      SharedPtr<AsConformalAsPossibleMapper> acap = NewShared<AsConformalAsPossibleMapper>();
+      acap->Solver(params._Solver);
+      acap->NumberOfIterations(params._NumberOfIterations);
+      acap->NumberOfLevels(params._NumberOfLevels);
+      acap->MixedPrecision(params._MixedPrecision);
+      acap->NumberOfSubdomains(params._Subdomains);
+      acap->NumberOfLocalGlobalIterations(params._ACAPIterations);
+      acap->EnergyTolerance(params._ACAPTolerance);
+      if (params._CacheDir) acap->TetrahedralizationCache(params._CacheDir);
+      acap->MaximumVolume(params._MaximumVolume);
+      acap->SizeGrading(params._SizeGrading);
+      acap->NumberOfRefinements(params._Refinements);
+      acap->RefinementThreshold(params._RefineThreshold);
+      mapper = acap;
     } break;
     case MAP_HarmonicFEM: {
-      if (verbose) cout << "Computing piecewise linear harmonic map...", cout.flush();
-      HarmonicTetrahedralMeshMapper mapper;
-      mapper.NumberOfIterations(niterations);
-      mapper.InputSet(domain);
-      mapper.InputMap(values);
-      mapper.InputMask(mask);
-      mapper.Run();
-      map = mapper.Output();
+      SharedPtr<HarmonicTetrahedralMeshMapper> fem = NewShared<HarmonicTetrahedralMeshMapper>();
+      fem->Solver(params._Solver);
+      fem->NumberOfIterations(params._NumberOfIterations);
+      fem->NumberOfLevels(params._NumberOfLevels);
+      fem->MixedPrecision(params._MixedPrecision);
+      fem->NumberOfSubdomains(params._Subdomains);
+      if (params._CacheDir) fem->TetrahedralizationCache(params._CacheDir);
+      fem->MaximumVolume(params._MaximumVolume);
+      fem->SizeGrading(params._SizeGrading);
+      fem->NumberOfRefinements(params._Refinements);
+      fem->RefinementThreshold(params._RefineThreshold);
+      mapper = fem;
     } break;
-    case MAP_HarmonicMFS: {
-      if (verbose) cout << "Computing harmonic map using MFS...", cout.flush();
-      MeshlessHarmonicVolumeMapper mapper;
-      mapper.InputSet(domain);
-      mapper.InputMap(values);
-      mapper.Run();
-      map = mapper.Output();
+    case MAP_Spectral: {
+      SharedPtr<SpectralTetrahedralMeshMapper> spectral = NewShared<SpectralTetrahedralMeshMapper>();
+      spectral->NumberOfEigenvectors(params._SpectralModes);
+      if (params._NumberOfIterations > 0) {
+        spectral->NumberOfIterations(params._NumberOfIterations);
+      }
+      if (params._CacheDir) spectral->TetrahedralizationCache(params._CacheDir);
+      spectral->MaximumVolume(params._MaximumVolume);
+      spectral->SizeGrading(params._SizeGrading);
+      spectral->NumberOfRefinements(params._Refinements);
+      spectral->RefinementThreshold(params._RefineThreshold);
+      mapper = spectral;
     } break;
+    case MAP_HarmonicMFS:
     case MAP_BiharmonicMFS: {
-      FatalError("Biharmonic mapping using MFS not implemented");
+      SharedPtr<MeshlessHarmonicVolumeMapper> mfs;
+      if (method == MAP_BiharmonicMFS) mfs = NewShared<MeshlessBiharmonicVolumeMapper>();
+      else                             mfs = NewShared<MeshlessHarmonicVolumeMapper>();
+      mfs->KernelStorage(params._KernelStorage);
+      mfs->AdditiveSubsets(params._Additive);
+      mfs->AdditiveDamping(params._AdditiveDamping);
+      mfs->SourcePartitioning(params._Partitioning);
+      mfs->UseSVD(params._UseSVD);
+      mfs->SVDMethod(params._SVDMethod);
+      mfs->SVDRank(params._SVDRank);
+      mfs->SparsificationTolerance(params._SparsifyTolerance);
+      mfs->NumberOfSparsificationIterations(params._SparsifyIterations);
+      if (params._OffsetCacheDir) mfs->OffsetSurfaceCache(params._OffsetCacheDir);
+      if (params._CheckpointFile) mfs->CheckpointFile(params._CheckpointFile);
+      mfs->CheckpointInterval(params._CheckpointInterval);
+      mfs->Resume(params._Resume);
+      mapper = mfs;
+    } break;
+    case MAP_CompactRBF: {
+      SharedPtr<MeshlessCompactVolumeMapper> rbf = NewShared<MeshlessCompactVolumeMapper>();
+      rbf->SupportRadius(params._SupportRadius);
+      rbf->Solver(params._Solver);
+      rbf->NumberOfSolverIterations(params._NumberOfIterations);
+      rbf->SourcePartitioning(params._Partitioning);
+      if (params._OffsetCacheDir) rbf->OffsetSurfaceCache(params._OffsetCacheDir);
+      if (params._CheckpointFile) rbf->CheckpointFile(params._CheckpointFile);
+      rbf->CheckpointInterval(params._CheckpointInterval);
+      rbf->Resume(params._Resume);
+      mapper = rbf;
+    } break;
+    case MAP_Barycentric:
+    case MAP_MeanValue: {
+      SharedPtr<MeanValueCoordinatesVolumeMapper> mvc = NewShared<MeanValueCoordinatesVolumeMapper>();
+      mvc->WeightsLattice(params._WeightsLattice);
+      mvc->WeightThreshold(params._WeightThreshold);
+      mapper = mvc;
     } break;
     default:
       FatalError("Invalid volumetric map type: " << method);
   }
+  mapper->CompactOutput(params._CompactOutput);
+  mapper->MaximumNumberOfThreads(params._MapperThreads);
+  return mapper;
+}
+
+// -----------------------------------------------------------------------------
+/// Progress message of volumetric mapping method
+const char *ProgressMessage(MapVolumeMethod method)
+{
+  switch (method) {
+    case MAP_ACAP:          return "Computing as-conformal-as-possible map...";
+    case MAP_HarmonicFEM:   return "Computing piecewise linear harmonic map...";
+    case MAP_Spectral:      return "Computing spectral coordinates map...";
+    case MAP_HarmonicMFS:   return "Computing harmonic map using MFS...";
+    case MAP_BiharmonicMFS: return "Computing biharmonic map using MFS...";
+    case MAP_CompactRBF:    return "Computing meshless map with compactly supported kernels...";
+    case MAP_Barycentric:
+    case MAP_MeanValue:     return "Computing mean value coordinates map...";
+    default:                return "Computing volumetric map...";
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// Compute volumetric map for free interior points using the given mapper,
+/// optionally observed by the given observer, and optionally return the
+/// execution statistics
+SharedPtr<Mapping> SolveVolumetricMap(VolumeMapper                 &mapper,
+                                      MapVolumeMethod               method,
+                                      vtkSmartPointer<vtkPointSet>  domain,
+                                      vtkSmartPointer<vtkDataArray> values,
+                                      vtkSmartPointer<vtkDataArray> mask,
+                                      vtkSmartPointer<vtkPointSet>  volume,
+                                      MapperObserver               *observer = nullptr,
+                                      MapperStatistics             *stats = nullptr)
+{
+  if (verbose) cout << ProgressMessage(method), cout.flush();
+  mapper.InputSet(domain);
+  mapper.Observer(observer);
+  mapper.InputMap(values);
+  TetrahedralMeshMapper *tet = dynamic_cast<TetrahedralMeshMapper *>(&mapper);
+  if (tet) {
+    if (method == MAP_HarmonicFEM) tet->InputMask(mask);
+    tet->InputVolume(volume);
+  }
+  mapper.Run();
+  if (stats) *stats = mapper.Statistics();
   if (verbose) cout << " done" << endl;
-  return map;
+  return mapper.Output();
+}
+
+// -----------------------------------------------------------------------------
+/// Write output map, optionally with decimated levels of detail
+///
+/// \param[in] map     Volumetric map.
+/// \param[in] fname   Output file name.
+/// \param[in] nlevels Number of levels of detail of piecewise linear map.
+bool WriteOutputMap(const Mapping &map, const char *fname, int nlevels)
+{
+  const PiecewiseLinearMap *plm = dynamic_cast<const PiecewiseLinearMap *>(&map);
+  if (plm && nlevels > 1) {
+    MultiResolutionMap lod;
+    lod.Build(*plm, nlevels);
+    return lod.Write(fname);
+  }
+  return map.Write(fname);
+}
+
+// -----------------------------------------------------------------------------
+/// Get point data array with fixed point values
+vtkSmartPointer<vtkDataArray> GetBoundaryValues(vtkPointSet *domain, const char *values_name)
+{
+  vtkPointData *pd = domain->GetPointData();
+  vtkSmartPointer<vtkDataArray> values;
+  const string name = ToLower(values_name);
+  if      (name == "tcoords") values = pd->GetTCoords();
+  else if (name == "vectors") values = pd->GetVectors();
+  else if (name == "scalars") values = pd->GetScalars();
+  else values = GetArrayByCaseInsensitiveName(pd, values_name);
+  if (!values) {
+    FatalError("Input has no point data array named " << values_name);
+  }
+  return values;
+}
+
+// -----------------------------------------------------------------------------
+/// Get point data array with fixed point mask
+vtkSmartPointer<vtkDataArray> GetBoundaryMask(vtkPointSet *domain, const char *mask_name)
+{
+  vtkSmartPointer<vtkDataArray> mask;
+  if (mask_name) {
+    mask = GetArrayByCaseInsensitiveName(domain->GetPointData(), mask_name);
+    if (!mask) {
+      FatalError("Input has no point data array named " << mask_name);
+    }
+  }
+  return mask;
+}
+
+// -----------------------------------------------------------------------------
+/// Subject of manifest file
+struct ManifestEntry
+{
+  string _Input;  ///< File path of input PLC or volumetric mesh
+  string _Output; ///< File path of output map
+};
+
+// -----------------------------------------------------------------------------
+/// Read manifest file with one "<input> <output>" pair per line
+Array<ManifestEntry> ReadManifest(const char *fname)
+{
+  std::ifstream ifs(fname);
+  if (!ifs.is_open()) {
+    FatalError("Failed to open manifest file " << fname);
+  }
+  Array<ManifestEntry> subjects;
+  ManifestEntry subject;
+  string line;
+  while (std::getline(ifs, line)) {
+    const size_t pos = line.find_first_not_of(" \t");
+    if (pos == string::npos || line[pos] == '#') continue;
+    std::istringstream is(line);
+    if (!(is >> subject._Input >> subject._Output)) {
+      FatalError("Invalid line in manifest file " << fname << ": " << line);
+    }
+    subjects.push_back(subject);
+  }
+  return subjects;
 }
 
+// -----------------------------------------------------------------------------
+/// Write execution statistics of manifest subjects as JSON array
+bool WriteManifestStatistics(const char *fname, const Array<ManifestEntry> &subjects,
+                             const Array<MapperStatistics> &stats)
+{
+  std::ofstream ofs(fname);
+  if (!ofs) return false;
+  ofs << "[";
+  for (size_t i = 0; i < subjects.size(); ++i) {
+    ofs << (i > 0 ? "," : "") << "\n  {\n";
+    ofs << "    \"input\": \"" << subjects[i]._Input << "\",\n";
+    ofs << "    \"output\": \"" << subjects[i]._Output << "\",\n";
+    ofs << "    \"statistics\": ";
+    stats[i].Print(ofs, 4);
+    ofs << "\n  }";
+  }
+  ofs << "\n]\n";
+  return !ofs.fail();
+}
+
+// -----------------------------------------------------------------------------
+/// Subject of manifest passed between the stages of the processing pipeline
+struct ManifestItem
+{
+  int                           _Index;  ///< Index of manifest entry
+  MapVolumeMethod               _Method; ///< Resolved mapping method
+  vtkSmartPointer<vtkPointSet>  _Domain; ///< Input point set
+  vtkSmartPointer<vtkDataArray> _Values; ///< Fixed point values
+  vtkSmartPointer<vtkDataArray> _Mask;   ///< Fixed point mask
+  vtkSmartPointer<vtkPointSet>  _Volume; ///< Tetrahedralization of input point set
+  SharedPtr<Mapping>            _Map;    ///< Output map
+};
+
+// -----------------------------------------------------------------------------
+/// First stage of manifest pipeline which reads the input meshes of the
+/// subjects ahead of the volume mappers
+struct ReadManifestInputs
+{
+  const Array<ManifestEntry> *_Subjects;
+  MapVolumeMethod             _Method;
+  const char                 *_ValuesName;
+  const char                 *_MaskName;
+  BoundedQueue<ManifestItem> *_Output;
+
+  void operator ()() const
+  {
+    const int n = static_cast<int>(_Subjects->size());
+    for (int i = 0; i < n; ++i) {
+      ManifestItem item;
+      item._Index  = i;
+      item._Domain = ReadMesh((*_Subjects)[i]._Input.c_str());
+      item._Values = GetBoundaryValues(item._Domain, _ValuesName);
+      item._Mask   = GetBoundaryMask(item._Domain, _MaskName);
+      item._Method = ResolveMethod(_Method, item._Domain);
+      if (!_Output->Push(item)) break;
+    }
+    _Output->Close();
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Second stage of manifest pipeline which tetrahedralizes the input point
+/// sets of the piecewise linear mapping methods ahead of the volume mappers
+struct PreprocessManifestInputs
+{
+  const VolumeMapperParameters *_Parameters;
+  BoundedQueue<ManifestItem>   *_Input;
+  BoundedQueue<ManifestItem>   *_Output;
+  std::atomic<int>             *_Active;
+
+  void operator ()() const
+  {
+    SharedPtr<VolumeMapper> mappers[MAP_Spectral + 1];
+    ManifestItem item;
+    while (_Input->Pop(item)) {
+      const MapVolumeMethod method = item._Method;
+      if (method == MAP_ACAP || method == MAP_HarmonicFEM || method == MAP_Spectral) {
+        if (!IsTetrahedralMesh(item._Domain)) {
+          if (!mappers[method]) mappers[method] = NewVolumeMapper(method, *_Parameters);
+          TetrahedralMeshMapper *tet = dynamic_cast<TetrahedralMeshMapper *>(mappers[method].get());
+          tet->InputSet(item._Domain);
+          tet->InputMap(item._Values);
+          if (method == MAP_HarmonicFEM) tet->InputMask(item._Mask);
+          item._Volume = tet->TetrahedralizeInputSet();
+        }
+      }
+      if (!_Output->Push(item)) break;
+    }
+    if (--(*_Active) == 0) _Output->Close();
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Third stage of manifest pipeline which computes the volumetric maps
+///
+/// Each job creates one volume mapper per resolved mapping method and computes
+/// the maps of the subjects it takes from the input queue until all subjects
+/// are processed. The jobs are executed by the same thread pool as the parallel
+/// loops of the mappers, such that idle threads of one job help with the inner
+/// loops of another.
+struct ProcessManifest
+{
+  const VolumeMapperParameters *_Parameters;
+  const Array<ManifestEntry>   *_Subjects;
+  Array<MapperStatistics>      *_Statistics;
+  double                        _TimeLimit;
+  BoundedQueue<ManifestItem>   *_Input;
+  BoundedQueue<ManifestItem>   *_Output;
+  std::mutex                   *_Mutex;
+
+  void operator ()(const blocked_range<int> &jobs) const
+  {
+    for (int job = jobs.begin(); job != jobs.end(); ++job) {
+      SharedPtr<VolumeMapper> mappers[MAP_Spectral + 1];
+      MapperObserver          observer;
+      ManifestItem            item;
+      observer.TimeLimit(_TimeLimit);
+      while (_Input->Pop(item)) {
+        const MapVolumeMethod method = item._Method;
+        if (!mappers[method]) mappers[method] = NewVolumeMapper(method, *_Parameters);
+        MapperStatistics &stats = (*_Statistics)[item._Index];
+        item._Map = SolveVolumetricMap(*mappers[method], method, item._Domain, item._Values,
+                                       item._Mask, item._Volume, &observer, &stats);
+        item._Domain = nullptr;
+        item._Values = nullptr;
+        item._Mask   = nullptr;
+        item._Volume = nullptr;
+        if (stats.Status() != MapperStatus_Completed) {
+          std::lock_guard<std::mutex> lock(*_Mutex);
+          Warning("Volume mapper did not complete for " << (*_Subjects)[item._Index]._Input
+                  << ", status: " << ToString(stats.Status()));
+        }
+        _Output->Push(item);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Last stage of manifest pipeline which writes the output maps behind
+/// the volume mappers
+struct WriteManifestOutputs
+{
+  const Array<ManifestEntry> *_Subjects;
+  BoundedQueue<ManifestItem> *_Input;
+  std::atomic<int>           *_Failed;
+  std::mutex                 *_Mutex;
+  int                         _LevelsOfDetail;
+  bool                        _Verbose;
+
+  void operator ()() const
+  {
+    const int n = static_cast<int>(_Subjects->size());
+    int       m = 0;
+    ManifestItem item;
+    while (_Input->Pop(item)) {
+      const ManifestEntry &subject = (*_Subjects)[item._Index];
+      const bool ok = WriteOutputMap(*item._Map, subject._Output.c_str(), _LevelsOfDetail);
+      item._Map = nullptr;
+      ++m;
+      std::lock_guard<std::mutex> lock(*_Mutex);
+      if (!ok) {
+        cerr << "Error: Failed to write volumetric map to " << subject._Output << endl;
+        ++(*_Failed);
+      }
+      if (_Verbose) {
+        cout << "Computed volumetric map of " << subject._Input << " (" << m << "/" << n << ")" << endl;
+      }
+    }
+  }
+};
+
 // =============================================================================
 // Main
 // =============================================================================
@@ -171,67 +667,320 @@ SharedPtr<Mapping> SolveVolumetricMap(vtkSmartPointer<vtkPointSet>  domain,
 // -----------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
-  REQUIRES_POSARGS(2);
+  REQUIRES_POSARGS(0);
 
-  const char *input_name  = POSARG(1); // Input PLC or volumetric mesh
-  const char *output_name = POSARG(2); // File name of output map
+  const char *input_name  = (NUM_POSARGS >= 1 ? POSARG(1) : nullptr); // Input PLC or volumetric mesh
+  const char *output_name = (NUM_POSARGS >= 2 ? POSARG(2) : nullptr); // File name of output map
   const char *values_name = nullptr;   // Name of point data array with fixed point values
   const char *mask_name   = nullptr;   // Name of point data array with fixed point mask
+  const char *volume_name = nullptr;   // Precomputed tetrahedralization of input
+  const char *cache_dir   = nullptr;   // Directory of cached tetrahedralizations
+  const char *offset_dir  = nullptr;   // Directory of cached offset surfaces
 
   MapVolumeMethod method   = MAP_Harmonic;
   bool            meshless = false;
   int             niter    = 0;
+  int             nspectral = 0;
+  int             nlevels  = 1;
+  int             nsubdomains = 0;
+  bool            mixed    = false;
+  bool            compact  = false;
+  int             nlod     = 1;
+  int             acap_iter = 1;
+  double          acap_tol  = 1e-4;
+  double          max_volume   = .0;
+  double          size_grading = .0;
+  int             nrefine      = 0;
+  double          refine_threshold = 2.;
+  ImageAttributes weights_lattice;
+  double          weight_threshold = 1e-4;
+
+  MeshlessKernelStorage kernel_storage = MeshlessKernel_Double;
+  bool                  additive         = false;
+  double                additive_damping = .0;
+  MeshlessPartitioning  partitioning     = MeshlessPartition_RoundRobin;
+  double                support_radius   = -.25;
+  bool                  use_svd          = false;
+  MeshlessSVDMethod     svd_method       = MeshlessSVD_BDC;
+  int                   svd_rank         = 0;
+  double                sparsify_tol     = .0;
+  int                   sparsify_iter    = 2;
+  const char           *checkpoint_file  = nullptr;
+  int                   checkpoint_interval = 1;
+  bool                  resume           = false;
+  const char           *stats_name       = nullptr;
+  const char           *manifest_name    = nullptr;
+  int                   njobs            = 0; // Number of concurrent manifest subjects
+  int                   nprefetch        = 0; // Number of subjects queued between stages
+  int                   npreprocess      = 1; // Number of tetrahedralization threads
+  int                   nmapper_threads  = 0; // Maximum number of threads of each mapper
+  MapperObserver        observer;        // Time limit of volume mapper
+
+  SparseSolverType solver = SparseSolver_CG;
 
   for (ALL_OPTIONS) {
     if      (OPTION("-name")) values_name = ARGUMENT;
     else if (OPTION("-mask")) mask_name   = ARGUMENT;
+    else if (OPTION("-volume")) volume_name = ARGUMENT;
+    else if (OPTION("-tetrahedralization-cache")) cache_dir = ARGUMENT;
+    else if (OPTION("-offset-surface-cache")) offset_dir = ARGUMENT;
     // Mapping method
     else if (OPTION("-acap"))        method = MAP_ACAP;
     else if (OPTION("-barycentric")) method = MAP_Barycentric;
     else if (OPTION("-mean-value"))  method = MAP_MeanValue;
     else if (OPTION("-harmonic"))    method = MAP_Harmonic;
     else if (OPTION("-biharmonic"))  method = MAP_Biharmonic;
+    else if (OPTION("-spectral")) {
+      method = MAP_Spectral;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(nspectral);
+    }
+    else if (OPTION("-compact")) {
+      method = MAP_CompactRBF;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(support_radius);
+    }
     else if (OPTION("-meshless"))    meshless = true;
     // Parameters of mapping method
     else if (OPTION("-max-iterations") || OPTION("-max-iter") || OPTION("-iterations") || OPTION("-iter")) {
       PARSE_ARGUMENT(niter);
     }
+    else if (OPTION("-mixed-precision")) mixed = true;
+    else if (OPTION("-compact-output")) compact = true;
+    else if (OPTION("-levels-of-detail")) {
+      PARSE_ARGUMENT(nlod);
+    }
+    else if (OPTION("-max-volume")) {
+      PARSE_ARGUMENT(max_volume);
+    }
+    else if (OPTION("-size-grading")) {
+      PARSE_ARGUMENT(size_grading);
+    }
+    else if (OPTION("-refinements")) {
+      PARSE_ARGUMENT(nrefine);
+    }
+    else if (OPTION("-refinement-threshold")) {
+      PARSE_ARGUMENT(refine_threshold);
+    }
+    else if (OPTION("-weights-lattice")) {
+      RealImage image(ARGUMENT);
+      weights_lattice = image.Attributes();
+      weights_lattice._t  = 1;
+      weights_lattice._dt = .0;
+    }
+    else if (OPTION("-weight-threshold")) {
+      PARSE_ARGUMENT(weight_threshold);
+    }
+    else if (OPTION("-acap-iterations")) {
+      PARSE_ARGUMENT(acap_iter);
+    }
+    else if (OPTION("-acap-tolerance")) {
+      PARSE_ARGUMENT(acap_tol);
+    }
+    else if (OPTION("-meshless-kernel")) {
+      PARSE_ARGUMENT(kernel_storage);
+    }
+    else if (OPTION("-meshless-additive")) {
+      additive = true;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(additive_damping);
+    }
+    else if (OPTION("-meshless-partition")) {
+      PARSE_ARGUMENT(partitioning);
+    }
+    else if (OPTION("-meshless-svd")) {
+      use_svd = true;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(svd_method);
+    }
+    else if (OPTION("-meshless-svd-rank")) {
+      PARSE_ARGUMENT(svd_rank);
+    }
+    else if (OPTION("-meshless-sparsify")) {
+      PARSE_ARGUMENT(sparsify_tol);
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(sparsify_iter);
+    }
+    else if (OPTION("-checkpoint")) {
+      checkpoint_file = ARGUMENT;
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(checkpoint_interval);
+    }
+    else if (OPTION("-resume")) {
+      checkpoint_file = ARGUMENT;
+      resume = true;
+    }
+    else if (OPTION("-stats")) stats_name = ARGUMENT;
+    else if (OPTION("-manifest")) manifest_name = ARGUMENT;
+    else if (OPTION("-jobs")) PARSE_ARGUMENT(njobs);
+    else if (OPTION("-mapper-threads")) PARSE_ARGUMENT(nmapper_threads);
+    else if (OPTION("-prefetch")) PARSE_ARGUMENT(nprefetch);
+    else if (OPTION("-preprocess-threads")) PARSE_ARGUMENT(npreprocess);
+    else if (OPTION("-time-limit")) {
+      double time_limit;
+      PARSE_ARGUMENT(time_limit);
+      observer.TimeLimit(time_limit);
+    }
+    else if (OPTION("-levels")) {
+      PARSE_ARGUMENT(nlevels);
+    }
+    else if (OPTION("-subdomains")) {
+      PARSE_ARGUMENT(nsubdomains);
+    }
+    else if (OPTION("-solver")) {
+      PARSE_ARGUMENT(solver);
+      if (!IsAvailable(solver)) {
+        FatalError("Sparse linear solver not available in this build: " << ToString(solver));
+      }
+    }
     else HANDLE_COMMON_OR_UNKNOWN_OPTION();
   }
   if (meshless) {
-    if (method == MAP_Harmonic) method = MAP_HarmonicMFS;
-    else                        method = MAP_HarmonicFEM;
+    if      (method == MAP_Harmonic)   method = MAP_HarmonicMFS;
+    else if (method == MAP_Biharmonic) method = MAP_BiharmonicMFS;
+    else if (method != MAP_CompactRBF &&
+             method != MAP_MeanValue &&
+             method != MAP_Barycentric) method = MAP_HarmonicFEM;
+  }
+
+  VolumeMapperParameters params;
+  params._Method             = method;
+  params._Solver             = solver;
+  params._NumberOfIterations = niter;
+  params._SpectralModes      = nspectral;
+  params._NumberOfLevels     = nlevels;
+  params._Subdomains         = nsubdomains;
+  params._MapperThreads      = nmapper_threads;
+  params._MixedPrecision     = mixed;
+  params._CompactOutput      = compact;
+  params._LevelsOfDetail     = nlod;
+  params._ACAPIterations     = acap_iter;
+  params._ACAPTolerance      = acap_tol;
+  params._CacheDir           = cache_dir;
+  params._MaximumVolume      = max_volume;
+  params._SizeGrading        = size_grading;
+  params._Refinements        = nrefine;
+  params._RefineThreshold    = refine_threshold;
+  params._WeightsLattice     = weights_lattice;
+  params._WeightThreshold    = weight_threshold;
+  params._KernelStorage      = kernel_storage;
+  params._Additive           = additive;
+  params._AdditiveDamping    = additive_damping;
+  params._OffsetCacheDir     = offset_dir;
+  params._Partitioning       = partitioning;
+  params._SupportRadius      = support_radius;
+  params._UseSVD             = use_svd;
+  params._SVDMethod          = svd_method;
+  params._SVDRank            = svd_rank;
+  params._SparsifyTolerance  = sparsify_tol;
+  params._SparsifyIterations = sparsify_iter;
+  params._CheckpointFile     = checkpoint_file;
+  params._CheckpointInterval = checkpoint_interval;
+  params._Resume             = resume;
+
+  // Compute volumetric maps of manifest subjects
+  if (manifest_name) {
+    if (input_name || output_name) {
+      FatalError("No positional <input> and <output> arguments allowed with -manifest");
+    }
+    if (volume_name) {
+      FatalError("Option -volume not supported with -manifest, use -tetrahedralization-cache instead");
+    }
+    if (checkpoint_file) {
+      FatalError("Options -checkpoint and -resume not supported with -manifest");
+    }
+    const Array<ManifestEntry> subjects = ReadManifest(manifest_name);
+    const int n = static_cast<int>(subjects.size());
+    if (njobs <= 0) njobs = static_cast<int>(std::thread::hardware_concurrency());
+    njobs = max(1, min(njobs, n));
+    if (verbose) {
+      cout << "Computing volumetric maps of " << n << " subjects using " << njobs << " concurrent job(s)" << endl;
+    }
+    if (nprefetch <= 0) nprefetch = njobs;
+    if (npreprocess <= 0) npreprocess = 1;
+    Array<MapperStatistics> stats(subjects.size());
+    BoundedQueue<ManifestItem> inputs(nprefetch), volumes(nprefetch), outputs(nprefetch);
+    std::atomic<int> failed(0), active(npreprocess);
+    std::mutex mutex;
+    ReadManifestInputs reader;
+    reader._Subjects   = &subjects;
+    reader._Method     = method;
+    reader._ValuesName = values_name;
+    reader._MaskName   = mask_name;
+    reader._Output     = &inputs;
+    PreprocessManifestInputs preprocessor;
+    preprocessor._Parameters = &params;
+    preprocessor._Input      = &inputs;
+    preprocessor._Output     = &volumes;
+    preprocessor._Active     = &active;
+    ProcessManifest body;
+    body._Parameters = &params;
+    body._Subjects   = &subjects;
+    body._Statistics = &stats;
+    body._TimeLimit  = observer.TimeLimit();
+    body._Input      = &volumes;
+    body._Output     = &outputs;
+    body._Mutex      = &mutex;
+    WriteManifestOutputs writer;
+    writer._Subjects       = &subjects;
+    writer._Input          = &outputs;
+    writer._Failed         = &failed;
+    writer._Mutex          = &mutex;
+    writer._LevelsOfDetail = nlod;
+    writer._Verbose        = (verbose > 0);
+    // Mapper output of concurrent jobs would be interleaved
+    const int verbosity = verbose;
+    verbose = 0;
+    std::thread read_thread(reader);
+    Array<std::thread> preprocess_threads;
+    for (int i = 0; i < npreprocess; ++i) {
+      preprocess_threads.push_back(std::thread(preprocessor));
+    }
+    std::thread write_thread(writer);
+    parallel_for(blocked_range<int>(0, njobs, 1), body);
+    outputs.Close();
+    read_thread.join();
+    for (auto &thread : preprocess_threads) thread.join();
+    write_thread.join();
+    verbose = verbosity;
+    if (stats_name && !WriteManifestStatistics(stats_name, subjects, stats)) {
+      FatalError("Failed to write mapper statistics to " << stats_name);
+    }
+    if (failed > 0) {
+      FatalError("Failed to compute volumetric maps of " << failed << " out of " << n << " subjects");
+    }
+    return 0;
+  }
+  if (!input_name || !output_name) {
+    PrintHelp(argv[0]);
+    exit(1);
   }
 
   // Read input point set
   vtkSmartPointer<vtkPointSet> domain = ReadMesh(input_name);
-  vtkPointData *pd = domain->GetPointData();
 
-  // Get boundary map
-  vtkSmartPointer<vtkDataArray> values;
-  const string name = ToLower(values_name);
-  if      (name == "tcoords") values = pd->GetTCoords();
-  else if (name == "vectors") values = pd->GetVectors();
-  else if (name == "scalars") values = pd->GetScalars();
-  else values = GetArrayByCaseInsensitiveName(pd, values_name);
-  if (!values) {
-    FatalError("Input has no point data array named " << values_name);
-  }
+  // Get boundary map and mask
+  vtkSmartPointer<vtkDataArray> values = GetBoundaryValues(domain, values_name);
+  vtkSmartPointer<vtkDataArray> mask   = GetBoundaryMask(domain, mask_name);
 
-  // Get boundary mask
-  vtkSmartPointer<vtkDataArray> mask;
-  if (mask_name) {
-    mask = GetArrayByCaseInsensitiveName(pd, mask_name);
-    if (!mask) {
-      FatalError("Input has no point data array named " << mask_name);
+  // Read precomputed tetrahedralization
+  vtkSmartPointer<vtkPointSet> volume;
+  if (volume_name) {
+    volume = ReadPointSet(volume_name);
+    if (!IsTetrahedralMesh(volume)) {
+      FatalError("Input volume must be a tetrahedral mesh: " << volume_name);
     }
   }
 
   // Compute volumetric map given boundary surface map
-  SharedPtr<Mapping> map(SolveVolumetricMap(domain, values, mask, method, niter));
-  if (!map->Write(output_name)) {
+  MapperStatistics stats;
+  const MapVolumeMethod resolved = ResolveMethod(method, domain);
+  SharedPtr<VolumeMapper> mapper = NewVolumeMapper(resolved, params);
+  SharedPtr<Mapping> map(SolveVolumetricMap(*mapper, resolved, domain, values, mask, volume,
+                                            &observer, &stats));
+  if (!WriteOutputMap(*map, output_name, nlod)) {
     FatalError("Failed to write volumetric map to " << output_name);
   }
+  if (stats_name && !stats.Write(stats_name)) {
+    FatalError("Failed to write mapper statistics to " << stats_name);
+  }
+  if (stats.Status() != MapperStatus_Completed) {
+    Warning("Volume mapper did not complete, status: " << ToString(stats.Status()));
+  }
 
   return 0;
 }
@@ -22,6 +22,14 @@
 
 #include "mirtk/PointSetIO.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/CompositeMapping.h"
+#include "mirtk/SquareToDiskMap.h"
+#include "mirtk/DiskToSquareMap.h"
+#include "mirtk/StereographicMap.h"
+#include "mirtk/InverseStereographicMap.h"
+
+#include "vtkPoints.h"
+#include "vtkPointSet.h"
 
 using namespace mirtk;
 
@@ -125,6 +133,67 @@ MapType ParseMapArgument(const char *arg, ParameterList &params)
   return type;
 }
 
+// =============================================================================
+// Input mapping
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Compose piecewise linear map with another Mapping
+///
+/// \param[in,out] map   Piecewise linear map whose values are replaced.
+/// \param[in]     other Map evaluated at the values of the first map.
+/// \param[in]     keep  Whether to keep the value components of the first map
+///                      beyond the codomain dimension of the other map, e.g.,
+///                      the third component of a planar map composed with a
+///                      2D analytic map.
+void Compose(PiecewiseLinearMap &map, const Mapping *other, bool keep = false)
+{
+  vtkDataArray *f = map.MutableValues();
+  const int n   = static_cast<int>(f->GetNumberOfTuples());
+  const int m   = static_cast<int>(f->GetNumberOfComponents());
+  const int dim = other->NumberOfComponents();
+  const int l   = (keep ? max(m, dim) : dim);
+  if (m > 3) {
+    FatalError("Cannot compose map with codomain dimension " << m << " with another map,"
+               " which must be evaluated at points of up to three dimensions!");
+  }
+  vtkSmartPointer<vtkDataArray> values;
+  values.TakeReference(f->NewInstance());
+  values->SetName(f->GetName());
+  values->SetNumberOfComponents(l);
+  values->SetNumberOfTuples(n);
+  // Evaluate other map at all intermediate points at once, where the
+  // intermediate points inherit the cells of the discretized domain
+  Array<double> p(3 * n, .0), v(dim * n);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < m; ++j) {
+      p[3 * i + j] = f->GetComponent(i, j);
+    }
+  }
+  vtkPointSet * const domain = vtkPointSet::SafeDownCast(map.Domain());
+  if (domain && domain->GetNumberOfPoints() == n) {
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToDouble();
+    points->SetNumberOfPoints(n);
+    for (int i = 0; i < n; ++i) {
+      points->SetPoint(static_cast<vtkIdType>(i), p.data() + 3 * i);
+    }
+    vtkSmartPointer<vtkPointSet> mesh;
+    mesh.TakeReference(domain->NewInstance());
+    mesh->ShallowCopy(domain);
+    mesh->SetPoints(points);
+    other->Resample(mesh, v.data());
+  } else {
+    other->Evaluate(n, p.data(), v.data());
+  }
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < l; ++j) {
+      values->SetComponent(i, j, j < dim ? v[dim * i + j] : f->GetComponent(i, j));
+    }
+  }
+  map.Values(values);
+}
+
 // =============================================================================
 // Square <-> Disk
 // =============================================================================
@@ -133,7 +202,7 @@ MapType ParseMapArgument(const char *arg, ParameterList &params)
 /// Compose surface to square map with map to disk
 void SquareToDisk(PiecewiseLinearMap &map, const ParameterList &params)
 {
-  vtkDataArray * const f = map.Values();
+  vtkDataArray * const f = map.MutableValues();
   Vector cdisk;
   double rdisk = .0;
   for (auto it = params.begin(); it != params.end(); ++it) {
@@ -162,25 +231,20 @@ void SquareToDisk(PiecewiseLinearMap &map, const ParameterList &params)
   double rsquare = max(xrange[1] - xrange[0], yrange[1] - yrange[0]) / 2.0;
   if (cdisk.Rows() ==  0) cdisk.Initialize(2, csquare);
   if (rdisk        <= .0) rdisk = rsquare;
-  double p[3], s, r;
-  for (vtkIdType ptId = 0; ptId < f->GetNumberOfTuples(); ++ptId) {
-    f->GetTuple(ptId, p);
-    p[0] -= csquare[0], p[1] -= csquare[1];
-    r = sqrt(p[0]*p[0] + p[1]*p[1]);
-    if (r > .0) {
-      s = (rdisk / rsquare) * (max(abs(p[0]), abs(p[1])) / r);
-      p[0] = cdisk(0) + s * p[0];
-      p[1] = cdisk(1) + s * p[1];
-      f->SetTuple(ptId, p);
-    }
-  }
+  SquareToDiskMap g;
+  g.SquareCenter(Point(csquare[0], csquare[1], .0));
+  g.SquareRadius(rsquare);
+  g.DiskCenter(Point(cdisk(0), cdisk(1), .0));
+  g.DiskRadius(rdisk);
+  g.Initialize();
+  Compose(map, &g, true);
 }
 
 // -----------------------------------------------------------------------------
 /// Compose surface to disk map with map to square
 void DiskToSquare(PiecewiseLinearMap &map, const ParameterList &params)
 {
-  vtkDataArray * const f = map.Values();
+  vtkDataArray * const f = map.MutableValues();
   Vector csquare;
   double rsquare = .0;
   for (auto it = params.begin(); it != params.end(); ++it) {
@@ -201,7 +265,7 @@ void DiskToSquare(PiecewiseLinearMap &map, const ParameterList &params)
       FatalError("DiskToSquare: Unknown parameter: " << it->first);
     }
   }
-  double xrange[2], yrange[2], p[3], r, r2, cosa, sina;
+  double xrange[2], yrange[2];
   f->GetRange(xrange, 0);
   f->GetRange(yrange, 1);
   double cdisk[2] = { xrange[0] + (xrange[1] - xrange[0]) / 2.0,
@@ -210,58 +274,34 @@ void DiskToSquare(PiecewiseLinearMap &map, const ParameterList &params)
                           yrange[1] - yrange[0]);
   if (csquare.Rows() ==  0) csquare.Initialize(2, cdisk);
   if (rsquare        <= .0) rsquare = rdisk;
-  double scale = (rsquare / rdisk);
-  for (vtkIdType ptId = 0; ptId < f->GetNumberOfTuples(); ++ptId) {
-    f->GetTuple(ptId, p);
-    p[0] -= cdisk[0], p[1] -= cdisk[1];
-    r = sqrt(p[0]*p[0] + p[1]*p[1]);
-    if (r > .0) {
-      r2 = r * r;
-      if (fequal(p[0], p[1], 1e-6)) {
-        p[0] = copysign(r, p[0]);
-        p[1] = copysign(r, p[1]);
-      } else if (abs(p[0]) > abs(p[1])) {
-        cosa = p[0] / r;
-        p[0] = copysign(r,                           p[0]);
-        p[1] = copysign(sqrt(r2 / (cosa*cosa) - r2), p[1]);
-      } else {
-        sina = p[1] / r;
-        p[0] = copysign(sqrt(r2 / (sina*sina) - r2), p[0]);
-        p[1] = copysign(r,                           p[1]);
-      }
-      p[0] = csquare(0) + scale * p[0];
-      p[1] = csquare(1) + scale * p[1];
-      f->SetTuple(ptId, p);
-    }
-  }
+  DiskToSquareMap g;
+  g.DiskCenter(Point(cdisk[0], cdisk[1], .0));
+  g.DiskRadius(rdisk);
+  g.SquareCenter(Point(csquare(0), csquare(1), .0));
+  g.SquareRadius(rsquare);
+  g.Initialize();
+  Compose(map, &g, true);
 }
 
 // =============================================================================
 // Spherical projection
 // =============================================================================
 
-/// Enumeration of pole used for stereographic projection
-enum SpherePole { NorthPole, SouthPole };
-
 // -----------------------------------------------------------------------------
 /// Compose surface to sphere map with stereographic projection to plane
 void StereographicProjection(PiecewiseLinearMap &map, const ParameterList &params)
 {
-  vtkDataArray *f = map.Values();
+  vtkDataArray *f = map.MutableValues();
   // Check input map codomain dimension
   if (f->GetNumberOfComponents() != 3) {
     FatalError("StereographicProjection: Input must be a surface map with codomain dimension 3!");
   }
   // Parse parameters
-  double c[3], p[3], z = .0, r = -1.0, s;
-  SpherePole pole = NorthPole;
+  double c[3], p[3], z = .0, r = -1.0;
+  SpherePole pole = SpherePole_North;
   for (auto it = params.begin(); it != params.end(); ++it) {
     if (it->first == "pole") {
-      if (it->second == "N" || it->second == "North" || it->second == "north") {
-        pole = NorthPole;
-      } else if (it->second == "S" || it->second == "South" || it->second == "south") {
-        pole = SouthPole;
-      } else {
+      if (!FromString(it->second, pole)) {
         FatalError("Failed to parse \"pole\" parameter value: " << it->second);
       }
     } else if (it->first == "r") {
@@ -299,42 +339,30 @@ void StereographicProjection(PiecewiseLinearMap &map, const ParameterList &param
     r /= f->GetNumberOfTuples();
   }
   // Project sphere to plane from either the north or south pole
-  const double zpole = (pole == NorthPole ? r : -r);;
-  vtkSmartPointer<vtkDataArray> g;
-  g.TakeReference(f->NewInstance());
-  g->SetNumberOfComponents(fequal(c[2] + z, .0, 1e-6) ? 2 : 3);
-  g->SetNumberOfTuples(f->GetNumberOfTuples());
-  for (vtkIdType ptId = 0; ptId < f->GetNumberOfTuples(); ++ptId) {
-    f->GetTuple(ptId, p);
-    p[0] -= c[0], p[1] -= c[1], p[2] -= c[2];
-    s = (z - zpole) / (p[2] - zpole);
-    p[0] = c[0] + s * p[0];
-    p[1] = c[1] + s * p[1];
-    p[2] = c[2] + z;
-    g->SetTuple(ptId, p);
-  }
-  map.Values(g);
+  StereographicMap g;
+  g.SphereCenter(Point(c));
+  g.SphereRadius(r);
+  g.Pole(pole);
+  g.PlaneOffset(z);
+  g.Initialize();
+  Compose(map, &g);
 }
 
 // -----------------------------------------------------------------------------
 /// Compose planar surface map with inverse stereographic projection to sphere
 void InverseStereographicProjection(PiecewiseLinearMap &map, const ParameterList &params)
 {
-  vtkDataArray *f = map.Values();
+  vtkDataArray *f = map.MutableValues();
   // Check input map codomain dimension
   if (f->GetNumberOfComponents() != 2) {
     FatalError("InverseStereographicProjection: Input must be a surface map with codomain dimension 2!");
   }
   // Parse parameters
-  double p[3], s, r = -1.0;
-  SpherePole pole = NorthPole;
+  double r = -1.0;
+  SpherePole pole = SpherePole_North;
   for (auto it = params.begin(); it != params.end(); ++it) {
     if (it->first == "pole") {
-      if (it->second == "N" || it->second == "North" || it->second == "north") {
-        pole = NorthPole;
-      } else if (it->second == "S" || it->second == "South" || it->second == "south") {
-        pole = SouthPole;
-      } else {
+      if (!FromString(it->second, pole)) {
         FatalError("Failed to parse \"pole\" parameter value: " << it->second);
       }
     } else if (it->first == "r") {
@@ -354,47 +382,11 @@ void InverseStereographicProjection(PiecewiseLinearMap &map, const ParameterList
             max(abs(yrange[0]), abs(yrange[1])));
   }
   // Compose input map with inverse of stereographic projection
-  const double z = (pole == NorthPole ? -r : r);
-  vtkSmartPointer<vtkDataArray> g;
-  g.TakeReference(f->NewInstance());
-  g->SetName(f->GetName());
-  g->SetNumberOfComponents(3);
-  g->SetNumberOfTuples(f->GetNumberOfTuples());
-  for (vtkIdType ptId = 0; ptId < f->GetNumberOfTuples(); ++ptId) {
-    f->GetTuple(ptId, p);
-    s = 2.0 * r * r / (p[0]*p[0] + p[1]*p[1] + r*r);
-    p[0] = s * p[0];
-    p[1] = s * p[1];
-    p[2] = (1.0 - s) * z;
-    g->SetTuple(ptId, p);
-  }
-  map.Values(g);
-}
-
-// =============================================================================
-// Input mapping
-// =============================================================================
-
-// -----------------------------------------------------------------------------
-/// Compose piecewise linear map with another Mapping
-void Compose(PiecewiseLinearMap &map, const char *input_name)
-{
-  UniquePtr<Mapping> other(Mapping::New(input_name));
-  vtkDataArray *f = map.Values();
-  vtkSmartPointer<vtkDataArray> values;
-  values.TakeReference(f->NewInstance());
-  values->SetName(f->GetName());
-  values->SetNumberOfComponents(f->GetNumberOfComponents());
-  values->SetNumberOfTuples(f->GetNumberOfTuples());
-  double p[3] = {.0};
-  double *v = new double[f->GetNumberOfComponents()];
-  for (vtkIdType i = 0; i < f->GetNumberOfTuples(); ++i) {
-    f->GetTuple(i, v);
-    other->Evaluate(v, p);
-    values->SetTuple(static_cast<vtkIdType>(i), v);
-  }
-  delete[] v;
-  map.Values(values);
+  InverseStereographicMap g;
+  g.SphereRadius(r);
+  g.Pole(pole);
+  g.Initialize();
+  Compose(map, &g);
 }
 
 // =============================================================================
@@ -422,12 +414,23 @@ int main(int argc, char *argv[])
       FatalError("Codomain dimension of intermediate maps must be 2 or 3!");
     }
     map = ParseMapArgument(POSARG(n), params);
+    if (map == MAP_Other) {
+      // Evaluate consecutive input maps as one composite map without
+      // storing their intermediate values at the input points
+      CompositeMapping chain;
+      chain.Add(SharedPtr<const Mapping>(Mapping::New(POSARG(n))));
+      while (n < N && ParseMapArgument(POSARG(n + 1), params) == MAP_Other) {
+        chain.Add(SharedPtr<const Mapping>(Mapping::New(POSARG(++n))));
+      }
+      chain.Initialize();
+      Compose(g, &chain);
+      continue;
+    }
     switch (map) {
       case MAP_SquareToDisk:     SquareToDisk(g, params); break;
       case MAP_DiskToSquare:     DiskToSquare(g, params); break;
       case MAP_Stereographic:    StereographicProjection(g, params); break;
       case MAP_InvStereographic: InverseStereographicProjection(g, params); break;
-      case MAP_Other:            Compose(g, POSARG(n)); break;
       default:
         FatalError("Unknown analytic mapping: " << POSARG(n));
     }
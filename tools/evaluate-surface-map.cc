@@ -20,11 +20,12 @@
 #include "mirtk/Common.h"
 #include "mirtk/Options.h"
 
-#include "mirtk/EdgeTable.h"
-#include "mirtk/Triangle.h"
+#include "mirtk/GenericImage.h"
 #include "mirtk/PointSetIO.h"
 #include "mirtk/PointSetUtils.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/MultiResolutionMap.h"
+#include "mirtk/SurfaceMapQuality.h"
 
 #include "mirtk/Vtk.h"
 #include "vtkSmartPointer.h"
@@ -32,7 +33,6 @@
 #include "vtkPointData.h"
 #include "vtkCellData.h"
 #include "vtkDataArray.h"
-#include "vtkFloatArray.h"
 
 
 using namespace mirtk;
@@ -54,6 +54,13 @@ void PrintHelp(const char* name)
   cout << "  input   Surface map.\n";
   cout << "\n";
   cout << "Optional arguments:\n";
+  cout << "  -level <n>   Level of detail of multi-resolution map. Finer levels are not read. (default: 0)\n";
+  cout << "  -bake <image> <size> [<field>]\n";
+  cout << "      Rasterize the codomain of a planar surface map onto a <size> x <size> image\n";
+  cout << "      which covers the bounding box of the map values and write it to the named file.\n";
+  cout << "      The image frames are the interpolated components of the named map field, i.e.,\n";
+  cout << "      a texture image of a surface attribute, or the coordinates of the surface points,\n";
+  cout << "      i.e., a geometry image, when no field name is given.\n";
   PrintCommonOptions(cout);
   cout << endl;
 }
@@ -72,6 +79,19 @@ void Print(const char *name, const TValue &value)
   cout.width(w);
 }
 
+// -----------------------------------------------------------------------------
+/// Read map, where a multi-resolution map is read up to the given level only
+Mapping *ReadMap(const char *fname, int level)
+{
+  if (level > 0) {
+    UniquePtr<MultiResolutionMap> lod(new MultiResolutionMap());
+    lod->FinestLevelToRead(level);
+    lod->Level(level);
+    if (lod->Read(fname)) return lod.release();
+  }
+  return Mapping::New(fname);
+}
+
 // -----------------------------------------------------------------------------
 /// Get copy of surface mesh which discretizes the domain of the piecewise linear map
 vtkSmartPointer<vtkPolyData> CopyMapSurface(const PiecewiseLinearMap *map)
@@ -122,280 +142,40 @@ double MappedArea(const PiecewiseLinearMap *map)
 }
 
 // -----------------------------------------------------------------------------
-/// Compute signed area of mapped triangles
-vtkSmartPointer<vtkDataArray>
-ComputeSignedAreaOfMappedPlanarTriangles(const PiecewiseLinearMap *map)
-{
-  vtkDataArray * const values  = map->Values();
-  vtkPolyData  * const surface = vtkPolyData::SafeDownCast(map->Domain());
-  if (surface == nullptr || values->GetNumberOfComponents() != 2) {
-    FatalError("Surface map must be piecewise linear 2D parameterization!");
-  }
-
-  vtkSmartPointer<vtkDataArray> area;
-  area = vtkSmartPointer<vtkFloatArray>::New();
-  area->SetName("SignedArea");
-  area->SetNumberOfComponents(1);
-  area->SetNumberOfTuples(surface->GetNumberOfCells());
-
-  vtkNew<vtkIdList> ptIds;
-  double a[2], b[2], c[2], A;
-
-  for (vtkIdType cellId = 0; cellId < surface->GetNumberOfCells(); ++cellId) {
-    GetCellPoints(surface, cellId, ptIds.GetPointer());
-    if (ptIds->GetNumberOfIds() != 3) FatalError("Surface mesh must have triangular faces!");
-    values->GetTuple(ptIds->GetId(0), a);
-    values->GetTuple(ptIds->GetId(1), b);
-    values->GetTuple(ptIds->GetId(2), c);
-    A = Triangle::SignedArea2D(a, b, c);
-    if (abs(A) < 1e-9) A = 0.;
-    area->SetComponent(cellId, 0, A);
-  }
-
-  return area;
-}
-
-// -----------------------------------------------------------------------------
-/// Count number of mapped triangles in x-y plane with inconsistent normal direction
-///
-/// \param[in] map   Piecewise linear map from surface in 3D to 2D plane.
-/// \param[in] areas Previously computed signed areas of mapped triangles.
-///
-/// \returns Number of flipped triangles.
-int NumberOfFlippedPlanarTriangles(const PiecewiseLinearMap     *map,
-                                   vtkSmartPointer<vtkDataArray> areas = nullptr)
-{
-  if (areas == nullptr) {
-    areas = ComputeSignedAreaOfMappedPlanarTriangles(map);
-  }
-
-  int n_negative = 0;
-  int n_positive = 0;
-
-  double area;
-  for (vtkIdType cellId = 0; cellId < areas->GetNumberOfTuples(); ++cellId) {
-    area = areas->GetComponent(cellId, 0);
-    if      (area < 0.) ++n_negative;
-    else if (area > 0.) ++n_positive;
-  }
-
-  return min(n_positive, n_negative);
-}
-
-// -----------------------------------------------------------------------------
-/// Count number of mapped triangles with zero area
-///
-/// \param[in] map   Piecewise linear map from surface in 3D to 2D plane.
-/// \param[in] areas Previously computed (signed) areas of mapped triangles.
-///
-/// \returns Number of degenerated triangles.
-int NumberOfDegeneratedPlanarTriangles(const PiecewiseLinearMap     *map,
-                                       vtkSmartPointer<vtkDataArray> areas = nullptr)
+/// Rasterize codomain of planar surface map onto square lattice covering its bounds
+void BakeImage(const PiecewiseLinearMap *map, const char *fname, int size, const char *field)
 {
-  if (areas == nullptr) {
-    areas = ComputeSignedAreaOfMappedPlanarTriangles(map);
-  }
-
-  int n = 0;
-
-  double area;
-  for (vtkIdType cellId = 0; cellId < areas->GetNumberOfTuples(); ++cellId) {
-    area = areas->GetComponent(cellId, 0);
-    if (area == 0.) ++n;
-  }
-
-  return n;
-}
-
-// -----------------------------------------------------------------------------
-/// Evaluate edge-length distortion
-double EdgeLengthDistortion(const PiecewiseLinearMap *map,
-                            vtkPointData *pd = nullptr, vtkCellData *cd = nullptr)
-{
-  vtkPolyData * const surface = vtkPolyData::SafeDownCast(map->Domain());
-  if (surface == nullptr) {
-    FatalError("Surface map domain must be surface mesh (i.e., vtkPolyData)");
-  }
-
-  vtkDataArray * const u_value = map->Values();
-  if (u_value->GetNumberOfComponents() < 2 ||
-      u_value->GetNumberOfComponents() > 3) {
-    FatalError("Surface map must have codomain dimension 2 or 3!");
-  }
-
-
-  double avg_distortion = 0.;
-  vtkSmartPointer<vtkDataArray> pa, ca;
-
-  if (pd) {
-    pa = vtkSmartPointer<vtkFloatArray>::New();
-    pa->SetName("EdgeLengthDistortion");
-    pa->SetNumberOfComponents(1);
-    pa->SetNumberOfTuples(surface->GetNumberOfPoints());
-    pa->FillComponent(0, 0.);
-    pd->AddArray(pa);
-  }
-  if (cd) {
-    ca = vtkSmartPointer<vtkFloatArray>::New();
-    ca->SetName("EdgeLengthDistortion");
-    ca->SetNumberOfComponents(1);
-    ca->SetNumberOfTuples(surface->GetNumberOfCells());
-    ca->FillComponent(0, 0.);
-    cd->AddArray(ca);
-  }
-
-  EdgeTable edgeTable(surface);
-  if (edgeTable.NumberOfEdges() > 0) {
-    const double eps = 1e-12;
-
-    int       i;
-    double    p1[3], p2[3], u1[3] = {0.}, u2[3] = {0.}, scale;
-    vtkIdType ptId1, ptId2, cellId;
-    vtkSmartPointer<vtkIdList> cells1, cells2;
-    if (cd) {
-      cells1 = vtkSmartPointer<vtkIdList>::New();
-      cells2 = vtkSmartPointer<vtkIdList>::New();
-    }
-
-    Vector d1(edgeTable.NumberOfEdges());
-    Vector d2(edgeTable.NumberOfEdges());
-    EdgeIterator edgeIt(edgeTable);
-    for (edgeIt.InitTraversal(); (i = edgeIt.GetNextEdge(ptId1, ptId2)) != -1;) {
-      surface->GetPoint(ptId1, p1);
-      surface->GetPoint(ptId2, p2);
-      u_value->GetTuple(ptId1, u1);
-      u_value->GetTuple(ptId2, u2);
-      d1(i) = sqrt(vtkMath::Distance2BetweenPoints(p1, p2)) + eps;
-      d2(i) = sqrt(vtkMath::Distance2BetweenPoints(u1, u2)) + eps;
-    }
-
-    const double norm = d2.Sum() / d1.Sum();
-    for (edgeIt.InitTraversal(); (i = edgeIt.GetNextEdge(ptId1, ptId2)) != -1;) {
-      scale = norm * d1(i) / d2(i);
-      if (pa) {
-        pa->SetComponent(ptId1, 0, pa->GetComponent(ptId1, 0) + scale);
-        pa->SetComponent(ptId2, 0, pa->GetComponent(ptId2, 0) + scale);
-      }
-      if (ca) {
-        surface->GetPointCells(ptId1, cells1);
-        surface->GetPointCells(ptId2, cells2);
-        cells1->IntersectWith(cells2);
-        for (vtkIdType i = 0; i < cells1->GetNumberOfIds(); ++i) {
-          cellId = cells1->GetId(i);
-          ca->SetComponent(cellId, 0, ca->GetComponent(cellId, 0) + scale);
-        }
-      }
-      avg_distortion += pow(scale - 1., 2);
-    }
-    if (pa) {
-      int n;
-      for (vtkIdType ptId = 0; ptId < surface->GetNumberOfPoints(); ++ptId) {
-        n = edgeTable.NumberOfAdjacentPoints(ptId);
-        if (n > 0) pa->SetComponent(ptId, 0, pa->GetComponent(ptId, 0) / n);
-      }
-    }
-    if (ca) {
-      vtkNew<vtkIdList> ptIds;
-      for (vtkIdType cellId = 0; cellId < surface->GetNumberOfCells(); ++cellId) {
-        GetCellPoints(surface, cellId, ptIds.GetPointer());
-        if (ptIds->GetNumberOfIds() > 0) {
-          ca->SetComponent(cellId, 0, ca->GetComponent(cellId, 0) / ptIds->GetNumberOfIds());
-        }
-      }
-    }
-    avg_distortion /= edgeTable.NumberOfEdges();
-  }
-
-  return sqrt(avg_distortion);
-}
-
-// -----------------------------------------------------------------------------
-/// Evaluate triangle area distortion
-double TriangleAreaDistortion(const PiecewiseLinearMap *map,
-                              vtkPointData *pd = nullptr, vtkCellData *cd = nullptr)
-{
-  vtkPolyData * const surface = vtkPolyData::SafeDownCast(map->Domain());
-  if (surface == nullptr) {
-    FatalError("Surface map domain must be surface mesh (i.e., vtkPolyData)");
-  }
-
-  vtkDataArray * const u_value = map->Values();
-  if (u_value->GetNumberOfComponents() < 2 ||
-      u_value->GetNumberOfComponents() > 3) {
-    FatalError("Surface map must have codomain dimension 2 or 3!");
+  if (map->NumberOfComponents() != 2) {
+    FatalError("Surface map codomain dimension must be 2 to bake an image!");
   }
-
-  double avg_distortion = 0.;
-  vtkSmartPointer<vtkDataArray> pa, ca;
-
-  if (pd) {
-    pa = vtkSmartPointer<vtkFloatArray>::New();
-    pa->SetName("AreaDistortion");
-    pa->SetNumberOfComponents(1);
-    pa->SetNumberOfTuples(surface->GetNumberOfPoints());
-    pa->FillComponent(0, 0.);
-    pd->AddArray(pa);
+  if (size < 2) {
+    FatalError("Size of baked image must be at least 2!");
   }
-  if (cd) {
-    ca = vtkSmartPointer<vtkFloatArray>::New();
-    ca->SetName("AreaDistortion");
-    ca->SetNumberOfComponents(1);
-    ca->SetNumberOfTuples(surface->GetNumberOfCells());
-    ca->FillComponent(0, 0.);
-    cd->AddArray(ca);
+  vtkDataArray *values = nullptr;
+  if (field) {
+    const int i = map->FieldIndex(field);
+    if (i < 0) FatalError("Surface map has no field named " << field);
+    values = map->Field(i);
   }
-
-  if (surface->GetNumberOfCells()) {
-    const double eps = 1e-12;
-
-    double    p1[3], p2[3], p3[3];
-    double    u1[3] = {0.}, u2[3] = {0.}, u3[3] = {0.};
-    double    scale;
-
-    vtkNew<vtkIdList> ptIds;
-
-    Vector A1(surface->GetNumberOfCells());
-    Vector A2(surface->GetNumberOfCells());
-    for (vtkIdType cellId = 0; cellId < surface->GetNumberOfCells(); ++cellId) {
-      GetCellPoints(surface, cellId, ptIds.GetPointer());
-      if (ptIds->GetNumberOfIds() != 3) FatalError("Map domain must be triangulated!");
-      surface->GetPoint(ptIds->GetId(0), p1);
-      surface->GetPoint(ptIds->GetId(1), p2);
-      surface->GetPoint(ptIds->GetId(2), p3);
-      u_value->GetTuple(ptIds->GetId(0), u1);
-      u_value->GetTuple(ptIds->GetId(1), u2);
-      u_value->GetTuple(ptIds->GetId(2), u3);
-      A1(static_cast<int>(cellId)) = Triangle::DoubleArea(p1, p2, p3) + eps;
-      A2(static_cast<int>(cellId)) = Triangle::DoubleArea(u1, u2, u3) + eps;
-    }
-
-    const double norm = A1.Sum() / A2.Sum();
-    for (vtkIdType cellId = 0; cellId < surface->GetNumberOfCells(); ++cellId) {
-      scale = norm * A2(static_cast<int>(cellId)) / A1(static_cast<int>(cellId));
-      if (pa) {
-        GetCellPoints(surface, cellId, ptIds.GetPointer());
-        for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); ++i) {
-          pa->SetComponent(ptIds->GetId(i), 0, pa->GetComponent(ptIds->GetId(i), 0) + scale);
-        }
-      }
-      if (ca) {
-        ca->SetComponent(cellId, 0, ca->GetComponent(cellId, 0) + scale);
-      }
-      avg_distortion += pow(scale - 1., 2);
-    }
-    if (pa) {
-      vtkNew<vtkIdList> cellIds;
-      for (vtkIdType ptId = 0; ptId < surface->GetNumberOfPoints(); ++ptId) {
-        surface->GetPointCells(ptId, cellIds.GetPointer());
-        if (cellIds->GetNumberOfIds() > 0) {
-          pa->SetComponent(ptId, 0, pa->GetComponent(ptId, 0) / cellIds->GetNumberOfIds());
-        }
-      }
-    }
-    avg_distortion /= surface->GetNumberOfCells();
+  double x[2], y[2];
+  map->Field(0)->GetRange(x, 0);
+  map->Field(0)->GetRange(y, 1);
+  ImageAttributes lattice;
+  lattice._x       = size;
+  lattice._y       = size;
+  lattice._z       = 1;
+  lattice._xorigin = .5 * (x[0] + x[1]);
+  lattice._yorigin = .5 * (y[0] + y[1]);
+  lattice._zorigin = .0;
+  lattice._dx      = max((x[1] - x[0]) / (size - 1), 1e-6);
+  lattice._dy      = max((y[1] - y[0]) / (size - 1), 1e-6);
+  lattice._dz      = 1.;
+  const int nt = (values ? static_cast<int>(values->GetNumberOfComponents()) : 3);
+  GenericImage<float> image(lattice, nt);
+  if (!map->Bake(image, values)) {
+    FatalError("Failed to rasterize codomain of surface map!");
   }
-
-  return sqrt(avg_distortion);
+  image.Write(fname);
 }
 
 // =============================================================================
@@ -411,13 +191,22 @@ int main(int argc, char *argv[])
 {
   EXPECTS_POSARGS(1);
 
-  vtkSmartPointer<vtkPolyData>  surface;
-  vtkSmartPointer<vtkDataArray> array;
-  vtkPointData                 *pd;
-  vtkCellData                  *cd;
+  vtkSmartPointer<vtkPolyData> surface;
+  vtkPointData                *pd;
+  vtkCellData                 *cd;
 
-  UniquePtr<Mapping> map(Mapping::New(POSARG(1)));
-  PiecewiseLinearMap *linmap = dynamic_cast<PiecewiseLinearMap *>(map.get());
+  // Level of detail is needed before the map is read
+  int level = 0;
+  for (int i = 1; i < argc - 1; ++i) {
+    if (strcmp(argv[i], "-level") == 0 && !FromString(argv[i + 1], level)) {
+      FatalError("Invalid -level argument: " << argv[i + 1]);
+    }
+  }
+
+  UniquePtr<Mapping> map(ReadMap(POSARG(1), level));
+  const PiecewiseLinearMap *linmap = dynamic_cast<const PiecewiseLinearMap *>(map.get());
+  const MultiResolutionMap *lod    = dynamic_cast<const MultiResolutionMap *>(map.get());
+  if (lod) linmap = lod->Map(lod->ActiveLevel());
   if (linmap) {
     surface = CopyMapSurface(linmap);
     pd = surface->GetPointData();
@@ -426,41 +215,75 @@ int main(int argc, char *argv[])
 
   map->Initialize();
 
+  // Evaluate all requested quality measures at once
+  SurfaceMapQuality quality;
+  quality.Map(linmap);
+  quality.EvaluateSignedArea(false);
+  quality.EvaluateAreaDistortion(false);
+  quality.EvaluateEdgeLengthDistortion(false);
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-parametric-area")       == 0 ||
+        strcmp(argv[i], "-flipped-triangles")     == 0 ||
+        strcmp(argv[i], "-degenerated-triangles") == 0) {
+      quality.EvaluateSignedArea(true);
+    } else if (strcmp(argv[i], "-area-distortion") == 0) {
+      quality.EvaluateAreaDistortion(true);
+    } else if (strcmp(argv[i], "-edge-distortion")        == 0 ||
+               strcmp(argv[i], "-edge-length-distortion") == 0) {
+      quality.EvaluateEdgeLengthDistortion(true);
+    }
+  }
+  if (linmap && (quality.EvaluateSignedArea() ||
+                 quality.EvaluateAreaDistortion() ||
+                 quality.EvaluateEdgeLengthDistortion())) {
+    quality.Run();
+  }
+
   for (ALL_OPTIONS) {
     if (OPTION("-parametric-area")) {
       ASSERT_IS_LINEAR_MAP();
-      int n;
-      array = ComputeSignedAreaOfMappedPlanarTriangles(linmap);
-      cd->AddArray(array);
-      n = NumberOfFlippedPlanarTriangles(linmap, array);
-      Print("No. of flipped triangles", n);
-      n = NumberOfDegeneratedPlanarTriangles(linmap, array);
-      Print("No. of degenerated triangles", n);
+      cd->AddArray(quality.SignedArea());
+      Print("No. of flipped triangles", quality.NumberOfFlippedTriangles());
+      Print("No. of degenerated triangles", quality.NumberOfDegeneratedTriangles());
     }
     else if (OPTION("-flipped-triangles")) {
       ASSERT_IS_LINEAR_MAP();
-      int n = NumberOfFlippedPlanarTriangles(linmap, cd->GetArray("SignedArea"));
-      Print("No. of flipped triangles", n);
+      Print("No. of flipped triangles", quality.NumberOfFlippedTriangles());
     }
     else if (OPTION("-degenerated-triangles")) {
       ASSERT_IS_LINEAR_MAP();
-      int n = NumberOfDegeneratedPlanarTriangles(linmap, cd->GetArray("SignedArea"));
-      Print("No. of degenerated triangles", n);
+      Print("No. of degenerated triangles", quality.NumberOfDegeneratedTriangles());
     }
     else if (OPTION("-edge-distortion") || OPTION("-edge-length-distortion")) {
       ASSERT_IS_LINEAR_MAP();
-      double distortion = EdgeLengthDistortion(linmap, nullptr, cd);
-      Print("Average edge-length distortion", distortion);
+      if (quality.CellEdgeLengthDistortion()) {
+        cd->AddArray(quality.CellEdgeLengthDistortion());
+      }
+      Print("Average edge-length distortion", quality.EdgeLengthDistortion());
     }
     else if (OPTION("-area-distortion")) {
       ASSERT_IS_LINEAR_MAP();
-      double distortion = TriangleAreaDistortion(linmap, nullptr, cd);
-      Print("Average area distortion", distortion);
+      if (quality.CellAreaDistortion()) {
+        cd->AddArray(quality.CellAreaDistortion());
+      }
+      Print("Average area distortion", quality.AreaDistortion());
     }
     else if (OPTION("-map-points")) {
       ASSERT_IS_LINEAR_MAP();
       surface->SetPoints(MapSurfacePoints(linmap));
     }
+    else if (OPTION("-level")) {
+      PARSE_ARGUMENT(level);
+    }
+    else if (OPTION("-bake")) {
+      ASSERT_IS_LINEAR_MAP();
+      const char *image_name = ARGUMENT;
+      int size;
+      PARSE_ARGUMENT(size);
+      const char *field_name = nullptr;
+      if (HAS_ARGUMENT) field_name = ARGUMENT;
+      BakeImage(linmap, image_name, size, field_name);
+    }
     else if (OPTION("-o") || OPTION("-output")) {
       ASSERT_IS_LINEAR_MAP();
       // Write surface mesh with thus far computed point/cell attributes
@@ -24,8 +24,11 @@
 #include "mirtk/PointSetIO.h"
 #include "mirtk/PointSetUtils.h"
 #include "mirtk/GenericImage.h"
-#include "mirtk/GradientImageFilter.h"
 #include "mirtk/PiecewiseLinearMap.h"
+#include "mirtk/MultiResolutionMap.h"
+#include "mirtk/MeshlessHarmonicMap.h"
+#include "mirtk/VolumeMapEnergy.h"
+#include "mirtk/BoundaryDistanceField.h"
 
 #include "vtkNew.h"
 #include "vtkSmartPointer.h"
@@ -62,6 +65,19 @@ void PrintHelp(const char* name)
   cout << "  -lattice <file>             Lattice attributes used to discretize the map domain\n";
   cout << "                              on a regular grid are read from the given image file.\n";
   cout << "                              (default: derived from map domain)\n";
+  cout << "  -jacobian                   Evaluate energies from the Jacobian of the map at each lattice\n";
+  cout << "                              point instead of finite differences of the map values. (default: off)\n";
+  cout << "  -treecode [<theta>]         Approximate the kernel sum of a meshless map using a treecode\n";
+  cout << "                              with the given opening angle in (0, 1). (default: off, 0.5)\n";
+  cout << "  -level <n>                  Level of detail at which a multi-resolution map is evaluated.\n";
+  cout << "                              Finer levels are not read from the map file. (default: 0)\n";
+  cout << "  -tolerance <value>          Evaluate multi-resolution map at the coarsest level of detail whose\n";
+  cout << "                              maximum approximation error is within the given tolerance. (default: off)\n";
+  cout << "  -distance-lattice-size <n>  Maximum number of lattice points along each axis of the precomputed signed\n";
+  cout << "                              distance field of the codomain boundary used by -outside and -distance.\n";
+  cout << "                              Distances near the boundary are computed exactly. (default: 128)\n";
+  cout << "  -exact-distance             Compute distance of each mapped point by a closest cell search on the\n";
+  cout << "                              codomain boundary instead of the precomputed distance field. (default: off)\n";
   PrintCommonOptions(cout);
   cout << endl;
 }
@@ -70,6 +86,19 @@ void PrintHelp(const char* name)
 // Auxiliaries
 // =============================================================================
 
+// -----------------------------------------------------------------------------
+/// Read map, where a multi-resolution map is read up to the given level only
+Mapping *ReadMap(const char *fname, int level)
+{
+  if (level > 0) {
+    UniquePtr<MultiResolutionMap> lod(new MultiResolutionMap());
+    lod->FinestLevelToRead(level);
+    lod->Level(level);
+    if (lod->Read(fname)) return lod.release();
+  }
+  return Mapping::New(fname);
+}
+
 // -----------------------------------------------------------------------------
 /// Read surface or volumetric mesh
 vtkSmartPointer<vtkPointSet> ReadMesh(const char *fname)
@@ -129,170 +158,19 @@ int NumberOfFlippedTriangles(const PiecewiseLinearMap *map)
   return min(n_positive, n_negative);
 }
 
-// -----------------------------------------------------------------------------
-/// Normalize target and source models to fit into the unit box
-template <class Real>
-void NormalizeCoordinates(GenericImage<Real>          &map,
-                          vtkSmartPointer<vtkPointSet> target,
-                          vtkSmartPointer<vtkPointSet> source)
-{
-  double bounds[6];
-
-  // Get homogeneous transformation matrix to map target points to unit box
-  Matrix T(4, 4);
-  target->GetBounds(bounds);
-  T(0, 0) = 1.0 / (bounds[1] - bounds[0]);
-  T(1, 1) = 1.0 / (bounds[3] - bounds[2]);
-  T(2, 2) = 1.0 / (bounds[5] - bounds[4]);
-  T(0, 3) = - bounds[0] / (bounds[1] - bounds[0]);
-  T(1, 3) = - bounds[2] / (bounds[3] - bounds[2]);
-  T(2, 3) = - bounds[4] / (bounds[5] - bounds[4]);
-  T(3, 3) = 1.0;
-
-  // Get homogeneous transformation matrix to map source points to unit box
-  Matrix S(4, 4);
-  source->GetBounds(bounds);
-  S(0, 0) = 1.0 / (bounds[1] - bounds[0]);
-  S(1, 1) = 1.0 / (bounds[3] - bounds[2]);
-  S(2, 2) = 1.0 / (bounds[5] - bounds[4]);
-  S(0, 3) = - bounds[0] / (bounds[1] - bounds[0]);
-  S(1, 3) = - bounds[2] / (bounds[3] - bounds[2]);
-  S(2, 3) = - bounds[4] / (bounds[5] - bounds[4]);
-  S(3, 3) = 1.0;
-
-  // Adjust attributes of discrete target domain lattice
-  map.PutAffineMatrix(T, true);
-
-  // Map source domain to unit box
-  const int nvox = map.NumberOfSpatialVoxels();
-  Real *x = map.Data(), *y = x + nvox, *z = y + nvox;
-  for (int vox = 0; vox < nvox; ++vox, ++x, ++y, ++z) {
-    Transform(S, *x, *y, *z);
-  }
-}
-
-// -----------------------------------------------------------------------------
-/// Evaluate harmonic energy of discretized volumetric map
-///
-/// Li et al. (2009). Meshless harmonic volumetric mapping using fundamental solution methods.
-/// IEEE Transactions on Automation Science and Engineering, 6(3), 409–422.
-template <class Real>
-double EvaluateHarmonicEnergy(const GenericImage<Real> &map,
-                              GenericImage<Real>       *energy = NULL)
-{
-  typedef GradientImageFilter<Real> GradientFilter;
-
-  const ImageAttributes &lattice = map.Attributes();
-  if (energy) energy->Initialize(lattice, 1);
-
-  // Compute squared norm of gradient vectors for each component
-  GenericImage<Real> squared_gradient_norm;
-  GradientFilter gradient(GradientFilter::GRADIENT_DOT_PRODUCT);
-  gradient.Input(&map);
-  gradient.Output(&squared_gradient_norm);
-  gradient.UseVoxelSize(true);
-  gradient.UseOrientation(false); // R = I
-  gradient.PaddingValue(numeric_limits<Real>::quiet_NaN());
-  gradient.Run();
-
-  // Evaluate harmonic energy
-  const double vol  = lattice._dx * lattice._dy * lattice._dz;
-  const int    nvox = lattice.NumberOfSpatialPoints();
-  double value, harmonic_energy = .0;
-  for (int vox = 0; vox < nvox; ++vox) {
-    value = .0;
-    for (int j = 0; j < lattice._t; ++j) {
-      value += squared_gradient_norm(vox + j * nvox);
-    }
-    value *= vol;
-    if (energy) energy->Put(vox, value);
-    harmonic_energy += value;
-  }
-
-  return harmonic_energy;
-}
-
-// -----------------------------------------------------------------------------
-/// Evaluate deformation energy of discretized volumetric map
-///
-/// Li et al. (2009). Meshless harmonic volumetric mapping using fundamental solution methods.
-/// IEEE Transactions on Automation Science and Engineering, 6(3), 409–422.
-template <class Real>
-double EvaluateDeformationEnergy(const GenericImage<Real> &map,
-                                 GenericImage<Real>       *energy = NULL,
-                                 double lambda = .0335, double mu = .0224)
-{
-  typedef GradientImageFilter<Real> GradientFilter;
-
-  if (map.T() != 3) {
-    cerr << "Error: Can compute deformation energy only from 3D -> 3D volumetric map" << endl;
-    exit(1);
-  }
-
-  const ImageAttributes &lattice = map.Attributes();
-  if (energy) energy->Initialize(lattice, 1);
-
-  // Compute squared norm of gradient vectors for each component
-  GenericImage<Real> jac;
-  GradientFilter gradient(GradientFilter::GRADIENT_VECTOR);
-  gradient.Input(&map);
-  gradient.Output(&jac);
-  gradient.UseVoxelSize(true);
-  gradient.UseOrientation(false); // R = I
-  gradient.PaddingValue(numeric_limits<Real>::quiet_NaN());
-  gradient.Run();
-
-  // Evaluate deformation energy
-  const double vol = lattice._dx * lattice._dy * lattice._dz;
-
-  double stress, value, deformation_energy = .0;
-  Vector3D<Real> ga, gb;
-  Matrix strain(3, 3);
-
-  for (int k = 0; k < lattice._z; ++k)
-  for (int j = 0; j < lattice._y; ++j)
-  for (int i = 0; i < lattice._x; ++i) {
-    // Compute strain tensor, \epsilon
-    for (int b = 0; b < 3; ++b) {
-      gb._x = jac(i, j, k, b    ); // dq_x / dp_b
-      gb._y = jac(i, j, k, b + 3); // dq_y / dp_b
-      gb._z = jac(i, j, k, b + 6); // dq_z / dp_b
-      for (int a = 0; a < 3; ++a) {
-        ga._x = jac(i, j, k, a    ); // dq_x / dp_a
-        ga._y = jac(i, j, k, a + 3); // dq_y / dp_a
-        ga._z = jac(i, j, k, a + 6); // dq_z / dp_a
-        strain(a, b) = ga.DotProduct(gb);
-        if (a == b) strain(a, b) -= 1.0;
-      }
-    }
-    // Compute elastic potential, \eta
-    value = .0;
-    for (int b = 0; b < 3; ++b)
-    for (int a = 0; a < 3; ++a) {
-      stress = 2.0 * mu * strain(a, b);
-      if (a == b) {
-        stress += lambda * strain(0, 0);
-        stress += lambda * strain(1, 1);
-        stress += lambda * strain(2, 2);
-      }
-      value += stress * strain(a, b);
-    }
-    value *= .5;
-    // Multiply by cube volume
-    value *= vol;
-    // Add to total deformation energy
-    if (energy) energy->Put(i, j, k, value);
-    deformation_energy += value;
-  }
-
-  return deformation_energy;
-}
-
 // -----------------------------------------------------------------------------
 /// Count number of lattice points mapped outside the output domain
+///
+/// \param[in]  map    Discrete volumetric map.
+/// \param[in]  source Output domain.
+/// \param[in]  field  Precomputed signed distance field of output domain boundary.
+///                    When \c nullptr, the distance of each mapped point is
+///                    computed by a closest cell search on the boundary.
+/// \param[out] dfield Optional output image of signed distances.
 template <class Real>
 int NumberOfPointsOutside(const GenericImage<Real>     &map,
                           vtkSmartPointer<vtkPointSet>  source,
+                          const BoundaryDistanceField  *field,
                           RealImage                    *dfield = NULL)
 {
   const int nvox = map.NumberOfSpatialVoxels();
@@ -300,14 +178,30 @@ int NumberOfPointsOutside(const GenericImage<Real>     &map,
   int    n = 0;
   double p[3], d;
 
+  if (dfield) dfield->Initialize(map.Attributes(), 1);
+
+  if (field) {
+    Array<double> xyz(3 * nvox), dists(nvox);
+    const Real *x = map.Data(), *y = x + nvox, *z = y + nvox;
+    for (int vox = 0; vox < nvox; ++vox) {
+      xyz[3 * vox    ] = static_cast<double>(x[vox]);
+      xyz[3 * vox + 1] = static_cast<double>(y[vox]);
+      xyz[3 * vox + 2] = static_cast<double>(z[vox]);
+    }
+    field->Evaluate(nvox, xyz.data(), dists.data());
+    for (int vox = 0; vox < nvox; ++vox) {
+      if (dfield) dfield->Put(vox, dists[vox]);
+      if (dists[vox] > 0) ++n;
+    }
+    return n;
+  }
+
   vtkSmartPointer<vtkPolyData> surface = DataSetSurface(source);
 
   vtkSmartPointer<vtkImplicitPolyDataDistance> dist;
   dist = vtkSmartPointer<vtkImplicitPolyDataDistance>::New();
   dist->SetInput(surface);
 
-  if (dfield) dfield->Initialize(map.Attributes(), 1);
-
   const Real *x = map.Data(), *y = x + nvox, *z = y + nvox;
   for (int vox = 0; vox < nvox; ++vox, ++x, ++y, ++z) {
     p[0] = *x, p[1] = *y, p[2] = *z;
@@ -321,15 +215,16 @@ int NumberOfPointsOutside(const GenericImage<Real>     &map,
 
 // -----------------------------------------------------------------------------
 /// Compute distance of each mapped point to the output domain boundary
+///
+/// \param[in] map    Piecewise linear volumetric map.
+/// \param[in] source Output domain.
+/// \param[in] field  Precomputed signed distance field of output domain boundary.
+///                   When \c nullptr, the distance of each mapped point is
+///                   computed by a closest cell search on the boundary.
 vtkSmartPointer<vtkDataSet> DistanceField(const PiecewiseLinearMap    *map,
-                                          vtkSmartPointer<vtkPointSet> source)
+                                          vtkSmartPointer<vtkPointSet> source,
+                                          const BoundaryDistanceField *field)
 {
-  vtkSmartPointer<vtkPolyData> surface = DataSetSurface(source);
-
-  vtkSmartPointer<vtkImplicitPolyDataDistance> dist;
-  dist = vtkSmartPointer<vtkImplicitPolyDataDistance>::New();
-  dist->SetInput(surface);
-
   vtkSmartPointer<vtkDataArray> darray = vtkSmartPointer<vtkFloatArray>::New();
   darray->SetName("Distance");
   darray->SetNumberOfComponents(1);
@@ -341,8 +236,27 @@ vtkSmartPointer<vtkDataSet> DistanceField(const PiecewiseLinearMap    *map,
   dfield->GetPointData()->Initialize();
   dfield->GetPointData()->SetScalars(darray);
 
+  const int npoints = static_cast<int>(dfield->GetNumberOfPoints());
+  if (field) {
+    Array<double> xyz(3 * npoints), dists(npoints);
+    for (int ptId = 0; ptId < npoints; ++ptId) {
+      map->Values()->GetTuple(ptId, xyz.data() + 3 * ptId);
+    }
+    field->Evaluate(npoints, xyz.data(), dists.data());
+    for (int ptId = 0; ptId < npoints; ++ptId) {
+      darray->SetTuple(ptId, &dists[ptId]);
+    }
+    return dfield;
+  }
+
+  vtkSmartPointer<vtkPolyData> surface = DataSetSurface(source);
+
+  vtkSmartPointer<vtkImplicitPolyDataDistance> dist;
+  dist = vtkSmartPointer<vtkImplicitPolyDataDistance>::New();
+  dist->SetInput(surface);
+
   double p[3], d;
-  for (vtkIdType ptId = 0; ptId < dfield->GetNumberOfPoints(); ++ptId) {
+  for (int ptId = 0; ptId < npoints; ++ptId) {
     map->Values()->GetTuple(ptId, p);
     d = dist->EvaluateFunction(p);
     darray->SetTuple(ptId, &d);
@@ -380,6 +294,13 @@ int main(int argc, char *argv[])
   const char *outside_name            = nullptr;
   const char *distance_name           = nullptr;
 
+  double treecode_theta = .0;
+  bool   use_jacobian   = false;
+  int    lod_level      = 0;
+  double lod_tolerance  = -1.;
+  int    distance_size  = 128;
+  bool   exact_distance = false;
+
   for (ALL_OPTIONS) {
     if      (OPTION("-target") || OPTION("-domain"))   target_name = ARGUMENT;
     else if (OPTION("-source") || OPTION("-codomain")) source_name = ARGUMENT;
@@ -399,12 +320,27 @@ int main(int argc, char *argv[])
     else if (OPTION("-distance")) {
       distance_name = ARGUMENT;
     }
+    else if (OPTION("-jacobian")) use_jacobian = true;
+    else if (OPTION("-level")) PARSE_ARGUMENT(lod_level);
+    else if (OPTION("-tolerance")) PARSE_ARGUMENT(lod_tolerance);
+    else if (OPTION("-distance-lattice-size")) PARSE_ARGUMENT(distance_size);
+    else if (OPTION("-exact-distance")) exact_distance = true;
+    else if (OPTION("-treecode")) {
+      if (HAS_ARGUMENT) PARSE_ARGUMENT(treecode_theta);
+      else treecode_theta = .5;
+      if (treecode_theta <= .0 || treecode_theta >= 1.0) {
+        FatalError("Option -treecode argument must be in the open interval (0, 1)");
+      }
+    }
     else HANDLE_COMMON_OR_UNKNOWN_OPTION();
   }
 
   if (eval_outside && !source_name) {
     FatalError("Input -source required by -outside option");
   }
+  if (distance_name && !source_name) {
+    FatalError("Input -source required by -distance option");
+  }
 
   // Read input point sets
   vtkSmartPointer<vtkPointSet> target, source;
@@ -413,30 +349,43 @@ int main(int argc, char *argv[])
 
   // Read input map
   if (verbose) cout << "Read map from " << input_name << "...", cout.flush();
-  UniquePtr<Mapping> map(Mapping::New(input_name));
+  UniquePtr<Mapping> map(ReadMap(input_name, lod_level));
   PiecewiseLinearMap *dmap = dynamic_cast<PiecewiseLinearMap *>(map.get());
   if (verbose) cout << " done" << endl;
 
-  if (target && output_name) {
-    double p[3];
+  MultiResolutionMap *lod = dynamic_cast<MultiResolutionMap *>(map.get());
+  if (lod && lod_tolerance >= .0) lod->Level(lod->FindLevel(lod_tolerance));
+  if (lod && verbose) {
+    const int level = lod->ActiveLevel();
+    cout << "Evaluate level " << level << " of " << lod->NumberOfLevels()
+         << " levels of detail with maximum error " << lod->LevelErrors()[level] << endl;
+  }
 
+  MeshlessHarmonicMap *mmap = dynamic_cast<MeshlessHarmonicMap *>(map.get());
+  if (mmap) mmap->TreecodeOpeningAngle(treecode_theta);
+
+  if (target && output_name) {
     // Evaluate volumetric map at points of target point set
     if (verbose) cout << "Evaluate map...", cout.flush();
     vtkSmartPointer<vtkDataArray> discrete_map = vtkSmartPointer<vtkFloatArray>::New();
     discrete_map->SetName("Map");
     discrete_map->SetNumberOfComponents(map->NumberOfComponents());
     discrete_map->SetNumberOfTuples(target->GetNumberOfPoints());
-    double *v = new double[map->NumberOfComponents()];
+    const int npoints = static_cast<int>(target->GetNumberOfPoints());
+    const int ncomps  = map->NumberOfComponents();
+    Array<double> v(ncomps * npoints);
+    UniquePtr<bool[]> inside(new bool[npoints]);
+    map->Resample(target, v.data(), inside.get());
+    double p[3];
     for (vtkIdType ptId = 0; ptId < target->GetNumberOfPoints(); ++ptId) {
-      target->GetPoint(ptId, p);
-      if (!map->Evaluate(v, p)) {
+      if (!inside[ptId]) {
+        target->GetPoint(ptId, p);
         cerr << "Warning: Map undefined at point ("
              << p[0] << ", " << p[1] << ", " << p[2]
              << ") with ID " << ptId << endl;
       }
-      discrete_map->SetTuple(ptId, v);
+      discrete_map->SetTuple(ptId, v.data() + ncomps * ptId);
     }
-    delete[] v;
     if (discrete_map->GetNumberOfComponents() == 1) {
       target->GetPointData()->SetScalars(discrete_map);
     } else if (discrete_map->GetNumberOfComponents() == 3) {
@@ -452,16 +401,24 @@ int main(int argc, char *argv[])
     FatalError("Failed to write point set to " << output_name);
   }
 
-  // Evaluate volumetric map at lattice points
-  RealImage discrete_map;
+  // Lattice on which to evaluate volumetric map
+  ImageAttributes lattice;
   if (eval_harmonic_energy || eval_deformation_energy || eval_outside || (distance_name && !dmap)) {
-    if (verbose) cout << "Discretize volumetric map", cout.flush();
     if (lattice_name) {
-      discrete_map.Read(lattice_name);
-      discrete_map.Initialize(discrete_map.Attributes(), map->NumberOfComponents());
+      RealImage image(lattice_name);
+      lattice = image.Attributes();
+      lattice._t  = 1;
+      lattice._dt = .0;
     } else {
-      discrete_map.Initialize(map->Attributes(128, 128, 128), map->NumberOfComponents());
+      lattice = map->Attributes(128, 128, 128);
     }
+  }
+
+  // Evaluate volumetric map at lattice points
+  RealImage discrete_map;
+  if (eval_outside || (distance_name && !dmap)) {
+    if (verbose) cout << "Discretize volumetric map", cout.flush();
+    discrete_map.Initialize(lattice, map->NumberOfComponents());
     if (verbose > 1) {
       cout << " (N = " << discrete_map.X()
            <<    " x " << discrete_map.Y()
@@ -474,11 +431,22 @@ int main(int argc, char *argv[])
     if (verbose) cout << " done" << endl;
   }
 
+  // Precompute signed distance field of output domain boundary
+  UniquePtr<BoundaryDistanceField> boundary_distance;
+  if ((eval_outside || distance_name) && source && !exact_distance) {
+    if (verbose) cout << "Compute signed distance field of codomain boundary...", cout.flush();
+    boundary_distance.reset(new BoundaryDistanceField());
+    boundary_distance->Surface(DataSetSurface(source));
+    boundary_distance->MaximumSize(max(distance_size, 2));
+    boundary_distance->Initialize();
+    if (verbose) cout << " done" << endl;
+  }
+
   // Evaluate distance of mapped points to output domain boundary
   if (distance_name) {
     vtkSmartPointer<vtkPointSet> dfield;
     if (dmap) {
-      vtkSmartPointer<vtkDataSet> dists = DistanceField(dmap, source);
+      vtkSmartPointer<vtkDataSet> dists = DistanceField(dmap, source, boundary_distance.get());
       dfield = vtkPointSet::SafeDownCast(dists);
     }
     if (dfield) {
@@ -551,43 +519,40 @@ int main(int argc, char *argv[])
     if (verbose) cout << "Evaluate distance of mapped points to codomain boundary...", cout.flush();
     if (outside_name || distance_name) {
       RealImage dfield;
-      noutside = NumberOfPointsOutside(discrete_map, source, &dfield);
+      noutside = NumberOfPointsOutside(discrete_map, source, boundary_distance.get(), &dfield);
       if (outside_name ) dfield.Write(outside_name);
       if (distance_name) dfield.Write(distance_name);
     } else {
-      noutside = NumberOfPointsOutside(discrete_map, source);
+      noutside = NumberOfPointsOutside(discrete_map, source, boundary_distance.get());
     }
     if (verbose) cout << " done" << endl;
   }
 
-  // Normalize models to unit box before evaluating energy measures
-  if ((eval_harmonic_energy || eval_deformation_energy) && target && source) {
-    NormalizeCoordinates(discrete_map, target, source);
-  }
-
-  // Evaluate harmonic energy
-  if (eval_harmonic_energy) {
-    if (verbose) cout << "Evaluate harmonic energy...", cout.flush();
-    if (harmonic_energy_name) {
-      RealImage energy;
-      harmonic_energy = EvaluateHarmonicEnergy(discrete_map, &energy);
-      energy.Write(harmonic_energy_name);
-    } else {
-      harmonic_energy = EvaluateHarmonicEnergy(discrete_map);
-    }
-    if (verbose) cout << " done" << endl;
-  }
-
-  // Evaluate deformation energy
-  if (eval_deformation_energy) {
-    if (verbose) cout << "Evaluate deformation energy...", cout.flush();
-    if (deformation_energy_name) {
-      RealImage energy;
-      deformation_energy = EvaluateDeformationEnergy(discrete_map, &energy);
-      energy.Write(deformation_energy_name);
-    } else {
-      deformation_energy = EvaluateDeformationEnergy(discrete_map);
+  // Evaluate energy measures slab by slab
+  if (eval_harmonic_energy || eval_deformation_energy) {
+    if (verbose) cout << "Evaluate energy of volumetric map...", cout.flush();
+    GenericImage<double> harmonic_energy_image, deformation_energy_image;
+    VolumeMapEnergy energy;
+    energy.Lattice(lattice);
+    energy.Mask(target);
+    energy.EvaluateHarmonicEnergy(eval_harmonic_energy);
+    energy.EvaluateDeformationEnergy(eval_deformation_energy);
+    energy.UseMapJacobian(use_jacobian);
+    if (use_jacobian && dmap) dmap->InitializeCellGradients();
+    if (harmonic_energy_name   ) energy.HarmonicEnergyImage(&harmonic_energy_image);
+    if (deformation_energy_name) energy.DeformationEnergyImage(&deformation_energy_image);
+    // Normalize models to unit box before evaluating energy measures
+    if (target && source) {
+      double target_bounds[6], source_bounds[6];
+      target->GetBounds(target_bounds);
+      source->GetBounds(source_bounds);
+      energy.Normalize(target_bounds, source_bounds);
     }
+    energy.Run(map.get());
+    harmonic_energy    = energy.HarmonicEnergy();
+    deformation_energy = energy.DeformationEnergy();
+    if (harmonic_energy_name   ) harmonic_energy_image   .Write(harmonic_energy_name);
+    if (deformation_energy_name) deformation_energy_image.Write(deformation_energy_name);
     if (verbose) cout << " done" << endl;
   }
 
@@ -0,0 +1,491 @@
+/*
+ * Medical Image Registration ToolKit (MIRTK)
+ *
+ * Copyright 2016 Imperial College London
+ * Copyright 2016 Andreas Schuh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mirtk/Common.h"
+#include "mirtk/Options.h"
+
+#include "mirtk/Mapping.h"
+#include "mirtk/GenericImage.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <list>
+#include <new>
+#include <sstream>
+#include <unordered_map>
+
+#ifndef WINDOWS
+  #include <csignal>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+#endif
+
+using namespace mirtk;
+
+
+// =============================================================================
+// Help
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+void PrintHelp(const char* name)
+{
+  cout << "\n";
+  cout << "usage: " << name << " [options]\n";
+  cout << "\n";
+  cout << "Long-running server which evaluates surface and volumetric maps on request.\n";
+  cout << "A least recently used (LRU) cache keeps the loaded maps, including their cell\n";
+  cout << "locators, in memory, such that repeated queries of the same map do not include\n";
+  cout << "the time needed to read and initialize the map. A cached map is reloaded when\n";
+  cout << "its file was modified since it was loaded.\n";
+  cout << "\n";
+  cout << "The server reads one request per line and answers each request with a line starting\n";
+  cout << "with either \"ok\" or \"error <message>\". Requests are read from standard input and\n";
+  cout << "answered on standard output, or from the clients of a local socket, one client at\n";
+  cout << "a time. The evaluation of each request is parallelized.\n";
+  cout << "\n";
+  cout << "Requests:\n";
+  cout << "  evaluate <map> <n>          Followed by n lines with the x, y, z coordinates of each point.\n";
+  cout << "                              Answered by \"ok <n> <m>\" and n lines with a 0/1 flag whether the\n";
+  cout << "                              point is inside the map domain followed by the m map values.\n";
+  cout << "  evaluate-binary <map> <n>   Followed by 3n doubles with the point coordinates in native byte\n";
+  cout << "                              order. Answered by \"ok <n> <m>\", n bytes with the inside flags,\n";
+  cout << "                              and n*m doubles with the map values.\n";
+  cout << "  lattice <map> <output> <image>|<nx> [<ny> [<nz>]]\n";
+  cout << "                              Evaluate map at lattice points and write values to NIfTI file.\n";
+  cout << "                              The lattice is read from an image or of given size covering the\n";
+  cout << "                              map domain. Answered by \"ok <output>\".\n";
+  cout << "  load <map>                  Load map into cache. Answered by \"ok <m>\".\n";
+  cout << "  evict <map>                 Remove map from cache. Answered by \"ok\".\n";
+  cout << "  stats                       Answered by \"ok <size> <capacity> <hits> <misses>\".\n";
+  cout << "  quit                        Close connection of current client.\n";
+  cout << "  shutdown                    Stop server.\n";
+  cout << "\n";
+  cout << "Optional arguments:\n";
+  cout << "  -cache-size <n>   Maximum number of maps kept in memory. (default: 8)\n";
+  cout << "  -max-points <n>   Maximum number of points of an evaluate request. (default: 10000000)\n";
+  #ifndef WINDOWS
+  cout << "  -socket <path>    Serve requests of clients connecting to this local (Unix domain) socket.\n";
+  cout << "                    (default: standard input and output)\n";
+  #endif
+  PrintCommonOptions(cout);
+  cout << "\n";
+}
+
+// =============================================================================
+// Auxiliaries
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/// Whether the leading bytes of a file are those of a supported image file
+///
+/// The image readers terminate the process when the file format is not
+/// recognized. This cheap check precedes reading a lattice image, such that
+/// the client is answered with an error instead. Recognized are gzip
+/// compressed files, NIfTI and Analyze headers, GIPL, and legacy VTK files.
+bool IsImageFile(const string &fname)
+{
+  unsigned char header[256] = {0};
+  std::ifstream is(fname.c_str(), std::ios::in | std::ios::binary);
+  is.read(reinterpret_cast<char *>(header), sizeof(header));
+  const std::streamsize n = is.gcount();
+  if (n < 4) return false;
+  if (header[0] == 0x1f && header[1] == 0x8b) return true;
+  int32_t hdr_size;
+  memcpy(&hdr_size, header, sizeof(hdr_size));
+  if (hdr_size == 348 || hdr_size == 0x5C010000 ||
+      hdr_size == 540 || hdr_size == 0x1C020000) {
+    return true;
+  }
+  if (n >= 256 && header[252] == 0xef && header[253] == 0xff &&
+                  header[254] == 0xe9 && header[255] == 0xb0) {
+    return true;
+  }
+  return n >= 14 && memcmp(header, "# vtk DataFile", 14) == 0;
+}
+
+// -----------------------------------------------------------------------------
+/// Least recently used cache of initialized maps
+class MapCache
+{
+  /// Cached map
+  struct Entry
+  {
+    string                   _Name; ///< File path of map
+    SharedPtr<const Mapping> _Map;  ///< Initialized map
+    time_t                   _Time; ///< Modification time of map file when loaded
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  EntryList _Entries; ///< Cached maps, most recently used first
+  std::unordered_map<string, EntryList::iterator> _Index; ///< Cached maps by name
+  size_t    _Capacity;
+  int64_t   _Hits;
+  int64_t   _Misses;
+
+public:
+
+  /// Constructor
+  MapCache(size_t capacity)
+  :
+    _Capacity(capacity > 0 ? capacity : 1), _Hits(0), _Misses(0)
+  {}
+
+  /// Number of cached maps
+  size_t Size() const { return _Entries.size(); }
+
+  /// Maximum number of cached maps
+  size_t Capacity() const { return _Capacity; }
+
+  /// Number of requests answered from cache
+  int64_t Hits() const { return _Hits; }
+
+  /// Number of requests which loaded the map
+  int64_t Misses() const { return _Misses; }
+
+  /// Modification time of file, zero if not available
+  static time_t ModificationTime(const string &fname)
+  {
+    #ifndef WINDOWS
+      struct stat info;
+      if (stat(fname.c_str(), &info) == 0) return info.st_mtime;
+    #endif
+    return 0;
+  }
+
+  /// Get map, loading it when not cached or modified since it was loaded
+  ///
+  /// \returns Initialized map or \c nullptr if the map could not be read.
+  SharedPtr<const Mapping> Get(const string &fname)
+  {
+    const time_t mtime = ModificationTime(fname);
+    auto it = _Index.find(fname);
+    if (it != _Index.end()) {
+      if (it->second->_Time == mtime) {
+        _Entries.splice(_Entries.begin(), _Entries, it->second);
+        ++_Hits;
+        return _Entries.front()._Map;
+      }
+      Evict(fname);
+    }
+    ++_Misses;
+    if (!Mapping::IsMapFile(fname.c_str())) return nullptr;
+    SharedPtr<const Mapping> map(Mapping::New(fname.c_str()));
+    if (!map || map->NumberOfComponents() <= 0) return nullptr;
+    while (_Entries.size() >= _Capacity) {
+      _Index.erase(_Entries.back()._Name);
+      _Entries.pop_back();
+    }
+    Entry entry;
+    entry._Name = fname;
+    entry._Map  = map;
+    entry._Time = mtime;
+    _Entries.push_front(entry);
+    _Index[fname] = _Entries.begin();
+    return map;
+  }
+
+  /// Remove map from cache
+  void Evict(const string &fname)
+  {
+    auto it = _Index.find(fname);
+    if (it != _Index.end()) {
+      _Entries.erase(it->second);
+      _Index.erase(it);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// Read line without trailing newline
+bool ReadLine(FILE *fp, string &line)
+{
+  char buffer[1024];
+  line.clear();
+  while (fgets(buffer, sizeof(buffer), fp)) {
+    line += buffer;
+    if (!line.empty() && line.back() == '\n') {
+      line.pop_back();
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      return true;
+    }
+  }
+  return !line.empty();
+}
+
+// -----------------------------------------------------------------------------
+/// Write response line and flush output
+void Respond(FILE *fp, const string &msg)
+{
+  fputs(msg.c_str(), fp);
+  fputc('\n', fp);
+  fflush(fp);
+}
+
+// -----------------------------------------------------------------------------
+/// Discard the points of an evaluate request which is not answered
+///
+/// \returns Whether the input was consumed without reaching its end.
+bool SkipPoints(FILE *in, const string &cmd, int n)
+{
+  if (cmd == "evaluate") {
+    string line;
+    for (int i = 0; i < n; ++i) {
+      if (!ReadLine(in, line)) return false;
+    }
+  } else {
+    double buffer[3 * 1024];
+    size_t count = 3 * static_cast<size_t>(n);
+    while (count > 0) {
+      const size_t m = min(count, sizeof(buffer) / sizeof(double));
+      if (fread(buffer, sizeof(double), m, in) != m) return false;
+      count -= m;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// Answer requests read from the given input until end of input or until
+/// a "quit" or "shutdown" request was received
+///
+/// \returns Whether the server should continue with the next client.
+bool Serve(FILE *in, FILE *out, MapCache &cache, int max_points)
+{
+  string line, cmd, name;
+  // Stop serving a client which closed the connection before reading a response
+  while (!ferror(out) && ReadLine(in, line)) {
+    std::istringstream is(line);
+    if (!(is >> cmd) || cmd[0] == '#') continue;
+    if (cmd == "quit") {
+      Respond(out, "ok");
+      return true;
+    }
+    if (cmd == "shutdown") {
+      Respond(out, "ok");
+      return false;
+    }
+    if (cmd == "stats") {
+      std::ostringstream os;
+      os << "ok " << cache.Size() << " " << cache.Capacity() << " " << cache.Hits() << " " << cache.Misses();
+      Respond(out, os.str());
+      continue;
+    }
+    if (!(is >> name)) {
+      Respond(out, "error missing map file name");
+      continue;
+    }
+    if (cmd == "evict") {
+      cache.Evict(name);
+      Respond(out, "ok");
+      continue;
+    }
+    // Parse request arguments before loading the map such that the input
+    // of a request is consumed even when the map cannot be read
+    int n = 0;
+    string output_name, lattice_name;
+    Array<int> size;
+    Array<double> xyz;
+    if (cmd == "evaluate" || cmd == "evaluate-binary") {
+      if (!(is >> n) || n < 0) {
+        Respond(out, "error invalid number of points");
+        continue;
+      }
+      if (n > max_points) {
+        Respond(out, "error number of points exceeds maximum of " + ToString(max_points));
+        if (!SkipPoints(in, cmd, n)) return true;
+        continue;
+      }
+      xyz.resize(3 * static_cast<size_t>(n));
+      bool ok = true;
+      if (cmd == "evaluate") {
+        for (int i = 0; i < n && ok; ++i) {
+          ok = ReadLine(in, line);
+          if (ok) {
+            std::istringstream ps(line);
+            ok = static_cast<bool>(ps >> xyz[3 * i] >> xyz[3 * i + 1] >> xyz[3 * i + 2]);
+          }
+        }
+      } else if (n > 0) {
+        ok = (fread(xyz.data(), sizeof(double), xyz.size(), in) == xyz.size());
+      }
+      if (!ok) {
+        Respond(out, "error invalid point coordinates");
+        if (feof(in)) return true;
+        continue;
+      }
+    } else if (cmd == "lattice") {
+      string arg;
+      if (!(is >> output_name >> arg)) {
+        Respond(out, "error missing output file name or lattice");
+        continue;
+      }
+      int nx;
+      if (FromString(arg.c_str(), nx)) {
+        size.push_back(nx);
+        while (is >> nx) size.push_back(nx);
+      } else {
+        lattice_name = arg;
+      }
+    } else if (cmd != "load") {
+      Respond(out, "error unknown request: " + cmd);
+      continue;
+    }
+    // A request too large for the available memory is answered with an error
+    // instead of terminating the server for all clients
+    try {
+      SharedPtr<const Mapping> map = cache.Get(name);
+      if (!map) {
+        Respond(out, "error failed to read map from " + name);
+        continue;
+      }
+      const int m = map->NumberOfComponents();
+      if (cmd == "load") {
+        Respond(out, "ok " + ToString(m));
+      } else if (cmd == "evaluate" || cmd == "evaluate-binary") {
+        Array<double> values(static_cast<size_t>(n) * m);
+        UniquePtr<bool[]> inside(new bool[n > 0 ? n : 1]);
+        if (n > 0) map->Evaluate(n, xyz.data(), values.data(), inside.get());
+        Respond(out, "ok " + ToString(n) + " " + ToString(m));
+        if (cmd == "evaluate") {
+          const double *v = values.data();
+          for (int i = 0; i < n; ++i) {
+            fprintf(out, "%d", inside[i] ? 1 : 0);
+            for (int l = 0; l < m; ++l, ++v) fprintf(out, " %.17g", *v);
+            fputc('\n', out);
+          }
+        } else {
+          Array<uint8_t> flags(n);
+          for (int i = 0; i < n; ++i) flags[i] = (inside[i] ? 1 : 0);
+          fwrite(flags.data(), 1, flags.size(), out);
+          fwrite(values.data(), sizeof(double), values.size(), out);
+        }
+        fflush(out);
+      } else if (cmd == "lattice") {
+        ImageAttributes lattice;
+        if (!lattice_name.empty()) {
+          if (!IsImageFile(lattice_name)) {
+            Respond(out, "error failed to read lattice from " + lattice_name);
+            continue;
+          }
+          RealImage image(lattice_name.c_str());
+          lattice = image.Attributes();
+        } else {
+          size.resize(3, 0);
+          lattice = map->Attributes(size[0], size[1], size[2]);
+        }
+        lattice._t  = m;
+        lattice._dt = .0;
+        if (map->Evaluate(output_name.c_str(), lattice)) {
+          Respond(out, "ok " + output_name);
+        } else {
+          Respond(out, "error failed to write lattice values to " + output_name);
+        }
+      }
+    } catch (const std::bad_alloc &) {
+      Respond(out, "error out of memory");
+    }
+  }
+  return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  EXPECTS_POSARGS(0);
+
+  int         cache_size  = 8;
+  int         max_points  = 10000000;
+  const char *socket_name = nullptr;
+
+  for (ALL_OPTIONS) {
+    if (OPTION("-cache-size")) PARSE_ARGUMENT(cache_size);
+    else if (OPTION("-max-points")) PARSE_ARGUMENT(max_points);
+    #ifndef WINDOWS
+    else if (OPTION("-socket")) socket_name = ARGUMENT;
+    #endif
+    else HANDLE_COMMON_OR_UNKNOWN_OPTION();
+  }
+
+  if (max_points < 0) FatalError("Option -max-points must be non-negative!");
+
+  #ifndef WINDOWS
+    // A client which disconnects before reading the response must not
+    // terminate the server when the response is written
+    signal(SIGPIPE, SIG_IGN);
+  #endif
+
+  MapCache cache(static_cast<size_t>(max(1, cache_size)));
+
+  if (!socket_name) {
+    Serve(stdin, stdout, cache, max_points);
+    return 0;
+  }
+
+  #ifndef WINDOWS
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_name) >= sizeof(addr.sun_path)) {
+      FatalError("Socket path too long: " << socket_name);
+    }
+    strncpy(addr.sun_path, socket_name, sizeof(addr.sun_path) - 1);
+
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+      FatalError("Failed to create socket");
+    }
+    unlink(socket_name);
+    if (bind(server, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(server, 8) != 0) {
+      close(server);
+      FatalError("Failed to listen on socket " << socket_name);
+    }
+    if (verbose) cout << "Listening on " << socket_name << endl;
+
+    bool serve = true;
+    while (serve) {
+      const int client = accept(server, nullptr, nullptr);
+      if (client < 0) continue;
+      FILE *in  = fdopen(client, "rb");
+      FILE *out = fdopen(dup(client), "wb");
+      if (in && out) {
+        serve = Serve(in, out, cache, max_points);
+      }
+      if (in)  fclose(in);
+      else     close(client);
+      if (out) fclose(out);
+    }
+
+    close(server);
+    unlink(socket_name);
+  #endif
+
+  return 0;
+}